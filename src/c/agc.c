@@ -26,6 +26,7 @@
 #include <pthread.h>
 
 #include "agc.h"
+#include "rtarena.h"
 
 /* coefficients of agc_RC_Filter */   
 struct agc_RC_Coe
@@ -139,6 +140,16 @@ static float agc_phaserotate(struct agc_RC_Filter *f, float input)
     return v->lp - v->hp;
     }
 
+void agc_process_stage1_filtered(struct agc *s, float input)
+    {
+    /* feed input into ring-buffer, store input */
+    s->buffer[s->in_pos % s->buffer_len] = s->input = input;
+    
+    /* update pointers of the ring-buffer */  
+    s->in_pos++;
+    s->out_pos++;
+    }
+
 void agc_process_stage1(struct agc *s, float input)
     {
     /* An analog active RC-Highpassfilter network to remove DC and subsonic sounds
@@ -164,12 +175,158 @@ void agc_process_stage1(struct agc *s, float input)
         for (int i = 0; i < 4; ++i)
             input = agc_phaserotate(s->filters.RC_PHR + i, input);
 
-    /* feed input into ring-buffer, store input */
-    s->buffer[s->in_pos % s->buffer_len] = s->input = input;
-    
-    /* update pointers of the ring-buffer */  
-    s->in_pos++;
-    s->out_pos++;
+    agc_process_stage1_filtered(s, input);
+    }
+
+/* the stage1 filter cascade of up to AGC_LANES agcs as structure of arrays
+ * the per sample loops run across the lanes so they can be vectorised
+ */
+struct agc_lanes
+    {
+    int hpf_on[4][AGC_LANES];
+    float hpf_a[4][AGC_LANES], hpf_b[4][AGC_LANES], hpf_c[4][AGC_LANES], hpf_q[4][AGC_LANES];
+    float hpf_last_in[4][AGC_LANES], hpf_bp[4][AGC_LANES], hpf_hp[4][AGC_LANES];
+    float hfd_c[AGC_LANES], hfd_detail[AGC_LANES];
+    float hfd_last_in[AGC_LANES], hfd_hp[AGC_LANES];
+    float lfd_a[AGC_LANES], lfd_b[AGC_LANES], lfd_detail[AGC_LANES];
+    float lfd_lp[AGC_LANES];
+    int phr_on[AGC_LANES];
+    float phr_a[4][AGC_LANES], phr_b[4][AGC_LANES], phr_c[4][AGC_LANES];
+    float phr_last_in[4][AGC_LANES], phr_lp[4][AGC_LANES], phr_hp[4][AGC_LANES];
+    };
+
+static void agc_lanes_gather(struct agc_lanes *l, struct agc **agcs, int n)
+    {
+    for (int j = 0; j < n; ++j)
+        {
+        struct agc *s = agcs[j];
+        struct agc_RC_FilterGroup *coe = &s->host->filters;
+        struct agc_RC_FilterGroup *var = &s->filters;
+
+        for (int k = 0; k < 4; ++k)
+            {
+            l->hpf_on[k][j] = k < s->host->hpstages;
+            l->hpf_a[k][j] = coe->RC_HPF_initial[k].coe.a;
+            l->hpf_b[k][j] = coe->RC_HPF_initial[k].coe.b;
+            l->hpf_c[k][j] = coe->RC_HPF_initial[k].coe.c;
+            l->hpf_q[k][j] = coe->RC_HPF_initial[k].coe.q;
+            l->hpf_last_in[k][j] = var->RC_HPF_initial[k].var.last_in;
+            l->hpf_bp[k][j] = var->RC_HPF_initial[k].var.bp;
+            l->hpf_hp[k][j] = var->RC_HPF_initial[k].var.hp;
+
+            /* the phase rotator uses its own coefficients */
+            l->phr_a[k][j] = var->RC_PHR[k].coe.a;
+            l->phr_b[k][j] = var->RC_PHR[k].coe.b;
+            l->phr_c[k][j] = var->RC_PHR[k].coe.c;
+            l->phr_last_in[k][j] = var->RC_PHR[k].var.last_in;
+            l->phr_lp[k][j] = var->RC_PHR[k].var.lp;
+            l->phr_hp[k][j] = var->RC_PHR[k].var.hp;
+            }
+
+        l->hfd_c[j] = coe->RC_HPF_detail.coe.c;
+        l->hfd_detail[j] = s->host->hf_detail;
+        l->hfd_last_in[j] = var->RC_HPF_detail.var.last_in;
+        l->hfd_hp[j] = var->RC_HPF_detail.var.hp;
+        l->lfd_a[j] = coe->RC_LPF_detail.coe.a;
+        l->lfd_b[j] = coe->RC_LPF_detail.coe.b;
+        l->lfd_detail[j] = s->host->lf_detail;
+        l->lfd_lp[j] = var->RC_LPF_detail.var.lp;
+        l->phr_on[j] = s->host->use_phaserotator;
+        }
+    }
+
+static void agc_lanes_scatter(struct agc_lanes *l, struct agc **agcs, int n)
+    {
+    for (int j = 0; j < n; ++j)
+        {
+        struct agc_RC_FilterGroup *var = &agcs[j]->filters;
+
+        for (int k = 0; k < 4; ++k)
+            {
+            var->RC_HPF_initial[k].var.last_in = l->hpf_last_in[k][j];
+            var->RC_HPF_initial[k].var.bp = l->hpf_bp[k][j];
+            var->RC_HPF_initial[k].var.hp = l->hpf_hp[k][j];
+            var->RC_PHR[k].var.last_in = l->phr_last_in[k][j];
+            var->RC_PHR[k].var.lp = l->phr_lp[k][j];
+            var->RC_PHR[k].var.hp = l->phr_hp[k][j];
+            }
+
+        var->RC_HPF_detail.var.last_in = l->hfd_last_in[j];
+        var->RC_HPF_detail.var.hp = l->hfd_hp[j];
+        var->RC_LPF_detail.var.lp = l->lfd_lp[j];
+        }
+    }
+
+static void agc_lanes_run(struct agc **agcs, float **io, int n, int n_samples)
+    {
+    struct agc_lanes l;
+    float x[AGC_LANES];
+
+    agc_lanes_gather(&l, agcs, n);
+
+    for (int i = 0; i < n_samples; ++i)
+        {
+        for (int j = 0; j < n; ++j)
+            x[j] = io[j][i];
+
+        /* same arithmetic as agc_12db_hpfilter, lanes beyond hpstages pass through */
+        for (int k = 0; k < 4; ++k)
+            for (int j = 0; j < n; ++j)
+                {
+                const int on = l.hpf_on[k][j];
+                const float in = x[j] + l.hpf_q[k][j] * l.hpf_bp[k][j];
+                const float hp = l.hpf_c[k][j] * (l.hpf_hp[k][j] + in - l.hpf_last_in[k][j]);
+                const float bp = l.hpf_bp[k][j] * l.hpf_a[k][j] + hp * l.hpf_b[k][j];
+
+                l.hpf_hp[k][j] = on ? hp : l.hpf_hp[k][j];
+                l.hpf_bp[k][j] = on ? bp : l.hpf_bp[k][j];
+                l.hpf_last_in[k][j] = on ? in : l.hpf_last_in[k][j];
+                x[j] = on ? hp : x[j];
+                }
+
+        /* agc_6db_hpfilter and agc_6db_lpfilter */
+        for (int j = 0; j < n; ++j)
+            {
+            l.hfd_hp[j] = l.hfd_c[j] * (l.hfd_hp[j] + x[j] - l.hfd_last_in[j]);
+            l.hfd_last_in[j] = x[j];
+            x[j] = x[j] + l.hfd_hp[j] * l.hfd_detail[j];
+
+            l.lfd_lp[j] = l.lfd_lp[j] * l.lfd_a[j] + x[j] * l.lfd_b[j];
+            x[j] = x[j] + l.lfd_lp[j] * l.lfd_detail[j];
+            }
+
+        /* agc_phaserotate */
+        for (int k = 0; k < 4; ++k)
+            for (int j = 0; j < n; ++j)
+                {
+                const int on = l.phr_on[j];
+                const float hp = l.phr_c[k][j] * (l.phr_hp[k][j] + x[j] - l.phr_last_in[k][j]);
+                const float lp = l.phr_lp[k][j] * l.phr_a[k][j] + x[j] * l.phr_b[k][j];
+
+                l.phr_hp[k][j] = on ? hp : l.phr_hp[k][j];
+                l.phr_lp[k][j] = on ? lp : l.phr_lp[k][j];
+                l.phr_last_in[k][j] = on ? x[j] : l.phr_last_in[k][j];
+                x[j] = on ? lp - hp : x[j];
+                }
+
+        for (int j = 0; j < n; ++j)
+            io[j][i] = x[j];
+        }
+
+    agc_lanes_scatter(&l, agcs, n);
+    }
+
+void agc_process_stage1_block(struct agc **agcs, float **io, int n_agcs, int n_samples)
+    {
+    while (n_agcs > 0)
+        {
+        int n = (n_agcs > AGC_LANES) ? AGC_LANES : n_agcs;
+
+        agc_lanes_run(agcs, io, n, n_samples);
+        agcs += n;
+        io += n;
+        n_agcs -= n;
+        }
     }
 
 static float agc_quad_rr(float *storage, int *reset_point, int phase, float input)
@@ -567,16 +724,16 @@ struct agc *agc_init(int sRate, float lookahead, int id)
     
     pthread_once(&control_hash_table_once, setup_control_hash_table);
 
-    if (!(s = calloc(1, sizeof (struct agc))))
+    if (!(s = rtarena_calloc(1, sizeof (struct agc))))
         {
         fprintf(stderr, "agc_init: malloc failure\n");
         return NULL;
         }
 
-    if (!(s->buffer = calloc((s->buffer_len = (s->sRate = sRate) * lookahead), sizeof (float))))
+    if (!(s->buffer = rtarena_calloc((s->buffer_len = (s->sRate = sRate) * lookahead), sizeof (float))))
         {
         fprintf(stderr, "agc_init: malloc failure\n");
-        free(s);
+        rtarena_free(s);
         return NULL;
         }
 
@@ -648,6 +805,6 @@ struct agc *agc_init(int sRate, float lookahead, int id)
 
 void agc_free(struct agc *s)
     {
-    free(s->buffer);
-    free(s);
+    rtarena_free(s->buffer);
+    rtarena_free(s);
     }
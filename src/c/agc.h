@@ -37,6 +37,16 @@ void agc_process_stage1(struct agc *self, float input);
 void agc_process_stage2(struct agc *self, int mic_is_mute);
 float agc_process_stage3(struct agc *self);
 
+/* the number of agcs whose stage1 filter cascades run side by side */
+#define AGC_LANES 8
+
+/* run the stage1 filter cascade in place over n_samples of audio for
+ * several agcs at once, the results are then handed in one sample at a
+ * time with agc_process_stage1_filtered in place of agc_process_stage1
+ */
+void agc_process_stage1_block(struct agc **agcs, float **io, int n_agcs, int n_samples);
+void agc_process_stage1_filtered(struct agc *self, float input);
+
 /* the amount of attenuation broken down into three parts */
 void agc_get_meter_levels(struct agc *self, int *signal_cap, int *de_ess, int *noise_gate);
 
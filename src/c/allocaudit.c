@@ -0,0 +1,183 @@
+/*
+#   allocaudit.c: counts of the heap allocations made at each call site
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "allocaudit.h"
+
+#ifdef ALLOC_AUDIT
+
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include "sig.h"
+
+/* the real functions from here on */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef strndup
+#undef free
+#undef pthread_mutex_lock
+#undef pthread_cond_wait
+
+#define TOP_SITES 20
+
+__thread int allocaudit_in_rt;
+
+static struct allocaudit_site *sites;   /* each site is pushed here on its first call */
+static int n_sites;
+
+static void allocaudit_rt_violation(struct allocaudit_site *site)
+    {
+    fprintf(stderr, "allocaudit: %s in the jack callback at %s:%d\n", site->what, site->file, site->line);
+    assert(!"no allocating or blocking in the jack callback");
+    }
+
+void allocaudit_count(struct allocaudit_site *site)
+    {
+    __atomic_add_fetch(&site->calls, 1, __ATOMIC_RELAXED);
+    if (!__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE) && !__atomic_exchange_n(&site->registered, 1, __ATOMIC_ACQ_REL))
+        {
+        site->next = __atomic_load_n(&sites, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sites, &site->next, site, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+        __atomic_add_fetch(&n_sites, 1, __ATOMIC_RELAXED);
+        }
+    if (allocaudit_in_rt)
+        allocaudit_rt_violation(site);
+    }
+
+void *allocaudit_malloc(struct allocaudit_site *site, size_t size)
+    {
+    allocaudit_count(site);
+    return malloc(size);
+    }
+
+void *allocaudit_calloc(struct allocaudit_site *site, size_t nmemb, size_t size)
+    {
+    allocaudit_count(site);
+    return calloc(nmemb, size);
+    }
+
+void *allocaudit_realloc(struct allocaudit_site *site, void *ptr, size_t size)
+    {
+    allocaudit_count(site);
+    return realloc(ptr, size);
+    }
+
+char *allocaudit_strdup(struct allocaudit_site *site, const char *s)
+    {
+    allocaudit_count(site);
+    return strdup(s);
+    }
+
+char *allocaudit_strndup(struct allocaudit_site *site, const char *s, size_t n)
+    {
+    allocaudit_count(site);
+    return strndup(s, n);
+    }
+
+void allocaudit_free(struct allocaudit_site *site, void *ptr)
+    {
+    if (ptr)
+        allocaudit_count(site);
+    free(ptr);
+    }
+
+int allocaudit_mutex_lock(struct allocaudit_site *site, pthread_mutex_t *mutex)
+    {
+    if (allocaudit_in_rt)
+        allocaudit_rt_violation(site);
+    return pthread_mutex_lock(mutex);
+    }
+
+int allocaudit_cond_wait(struct allocaudit_site *site, pthread_cond_t *cond, pthread_mutex_t *mutex)
+    {
+    if (allocaudit_in_rt)
+        allocaudit_rt_violation(site);
+    return pthread_cond_wait(cond, mutex);
+    }
+
+struct allocaudit_tally
+    {
+    struct allocaudit_site *site;
+    unsigned long calls;
+    };
+
+static int by_calls(const void *a, const void *b)
+    {
+    const struct allocaudit_tally *ta = a, *tb = b;
+
+    return (ta->calls < tb->calls) - (ta->calls > tb->calls);
+    }
+
+/* allocaudit_report: the busiest sites since the last report, per second */
+static void allocaudit_report(int interval)
+    {
+    struct allocaudit_tally *list;
+    struct allocaudit_site *site;
+    unsigned long total = 0, calls;
+    int n = __atomic_load_n(&n_sites, __ATOMIC_ACQUIRE), i = 0;
+
+    if (!n || !(list = malloc(n * sizeof *list)))
+        return;
+    /* sites are only ever pushed at the head so the rest of the list holds still */
+    for (site = __atomic_load_n(&sites, __ATOMIC_ACQUIRE); site && i < n; site = site->next)
+        {
+        calls = __atomic_load_n(&site->calls, __ATOMIC_RELAXED);
+        list[i].site = site;
+        total += list[i++].calls = calls - site->reported;
+        site->reported = calls;
+        }
+    qsort(list, i, sizeof *list, by_calls);
+
+    fprintf(stderr, "allocaudit: %.1f calls/s at %d sites\n", (double)total / interval, i);
+    for (int j = 0; j < i && j < TOP_SITES && list[j].calls; ++j)
+        fprintf(stderr, "allocaudit: %10.1f/s %-18s %s:%d\n", (double)list[j].calls / interval,
+                    list[j].site->what, list[j].site->file, list[j].site->line);
+    free(list);
+    }
+
+static void *allocaudit_main(void *args)
+    {
+    const char *env = getenv("allocaudit_interval");
+    int interval = env && atoi(env) > 0 ? atoi(env) : 10;
+
+    sig_mask_thread();
+    for (;;)
+        {
+        sleep(interval);
+        allocaudit_report(interval);
+        }
+    return NULL;
+    }
+
+__attribute__((constructor)) static void allocaudit_start()
+    {
+    pthread_t thread_h;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread_h, &attr, allocaudit_main, NULL))
+        fprintf(stderr, "allocaudit_start: pthread_create failed, no reports will be made\n");
+    pthread_attr_destroy(&attr);
+    }
+
+#endif /* ALLOC_AUDIT */
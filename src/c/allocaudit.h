@@ -0,0 +1,95 @@
+/*
+#   allocaudit.h: counts of the heap allocations made at each call site
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* build with make ALLOC_AUDIT=1 and this header is forced into every source file of the module
+ *
+ * malloc, calloc, realloc, strdup, strndup and free then count at the call site
+ * and the totals per second of the busiest sites go to stderr every allocaudit_interval
+ * seconds, the environment variable, default 10
+ *
+ * code between allocaudit_rt_enter and allocaudit_rt_leave, the jack process callback,
+ * may not allocate, free or take a blocking lock: the call site is reported and
+ * unless NDEBUG is defined the backend aborts
+ *
+ * allocations made inside the libraries are not seen, only those made by our own code
+ */
+
+#ifndef ALLOCAUDIT_H
+#define ALLOCAUDIT_H
+
+#ifdef ALLOC_AUDIT
+
+#include "gnusource.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+struct allocaudit_site
+    {
+    const char *file;
+    int line;
+    const char *what;
+    unsigned long calls;
+    unsigned long reported;
+    struct allocaudit_site *next;
+    int registered;
+    };
+
+extern __thread int allocaudit_in_rt;
+
+void allocaudit_count(struct allocaudit_site *site);
+void *allocaudit_malloc(struct allocaudit_site *site, size_t size);
+void *allocaudit_calloc(struct allocaudit_site *site, size_t nmemb, size_t size);
+void *allocaudit_realloc(struct allocaudit_site *site, void *ptr, size_t size);
+char *allocaudit_strdup(struct allocaudit_site *site, const char *s);
+char *allocaudit_strndup(struct allocaudit_site *site, const char *s, size_t n);
+void allocaudit_free(struct allocaudit_site *site, void *ptr);
+int allocaudit_mutex_lock(struct allocaudit_site *site, pthread_mutex_t *mutex);
+int allocaudit_cond_wait(struct allocaudit_site *site, pthread_cond_t *cond, pthread_mutex_t *mutex);
+
+#define ALLOCAUDIT_SITE(what) ({ static struct allocaudit_site site_ = { __FILE__, __LINE__, what }; &site_; })
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef strndup
+#undef free
+#undef pthread_mutex_lock
+#undef pthread_cond_wait
+#define malloc(size) allocaudit_malloc(ALLOCAUDIT_SITE("malloc"), size)
+#define calloc(nmemb, size) allocaudit_calloc(ALLOCAUDIT_SITE("calloc"), nmemb, size)
+#define realloc(ptr, size) allocaudit_realloc(ALLOCAUDIT_SITE("realloc"), ptr, size)
+#define strdup(s) allocaudit_strdup(ALLOCAUDIT_SITE("strdup"), s)
+#define strndup(s, n) allocaudit_strndup(ALLOCAUDIT_SITE("strndup"), s, n)
+#define free(ptr) allocaudit_free(ALLOCAUDIT_SITE("free"), ptr)
+#define pthread_mutex_lock(mutex) allocaudit_mutex_lock(ALLOCAUDIT_SITE("pthread_mutex_lock"), mutex)
+#define pthread_cond_wait(cond, mutex) allocaudit_cond_wait(ALLOCAUDIT_SITE("pthread_cond_wait"), cond, mutex)
+
+#define allocaudit_rt_enter() (allocaudit_in_rt = 1)
+#define allocaudit_rt_leave() (allocaudit_in_rt = 0)
+
+#else
+
+#define allocaudit_rt_enter()
+#define allocaudit_rt_leave()
+
+#endif /* ALLOC_AUDIT */
+
+#endif /* ALLOCAUDIT_H */
@@ -21,45 +21,145 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
 #include "sourceclient.h"
 #include "main.h"
+#include "mixer.h"
 
 typedef jack_default_audio_sample_t sample_t;
 
+#define RS_FEED_INPUT_SAMPLES 512
+#define RS_FEED_OUTPUT_SAMPLES 4096
+#define RS_FEED_RB_SAMPLES 53000
+
 static struct audio_feed *audio_feed;
 
+int audio_feed_latency_probe;
+
+/* audio_feed_rb_sample: note the input ringbuffer fill, by the writer as it is about to write */
+void audio_feed_rb_sample(struct audio_feed_data *afdata)
+    {
+    jack_ringbuffer_t *rb = afdata->input_rb[0];
+
+    rbstat_sample(&afdata->rb_stats, jack_ringbuffer_read_space(rb), rb->size);
+    }
+
+/* audio_feed_stamp: by the writer, having written n_frames that entered the mixer at usecs */
+void audio_feed_stamp(struct audio_feed_data *afdata, size_t n_frames, jack_time_t usecs)
+    {
+    struct audio_feed_stamp *stamp = &afdata->stamp[afdata->n_stamps++ % AUDIO_FEED_STAMPS];
+
+    __atomic_store_n(&stamp->usecs, usecs, __ATOMIC_RELAXED);
+    __atomic_store_n(&stamp->frame, afdata->frames_in, __ATOMIC_RELEASE);
+    __atomic_store_n(&afdata->frames_in, afdata->frames_in + n_frames, __ATOMIC_RELEASE);
+    }
+
+/* audio_feed_frames_consumed: by the reader, the frame count of the next frame it will read */
+uint64_t audio_feed_frames_consumed(struct audio_feed_data *afdata)
+    {
+    uint64_t frames_in = __atomic_load_n(&afdata->frames_in, __ATOMIC_ACQUIRE);
+    size_t waiting = jack_ringbuffer_read_space(afdata->input_rb[0]) / (sizeof (sample_t) * (afdata->interleaved ? 2 : 1));
+
+    return waiting < frames_in ? frames_in - waiting : 0;
+    }
+
+/* audio_feed_capture_time: when the given frame entered the mixer or 0 if that is no longer known */
+jack_time_t audio_feed_capture_time(struct audio_feed_data *afdata, uint64_t frame)
+    {
+    jack_time_t usecs = 0;
+    uint64_t best = 0, f;
+
+    for (int i = 0; i < AUDIO_FEED_STAMPS; i++)
+        if ((f = __atomic_load_n(&afdata->stamp[i].frame, __ATOMIC_ACQUIRE)) <= frame && f >= best)
+            {
+            usecs = __atomic_load_n(&afdata->stamp[i].usecs, __ATOMIC_RELAXED);
+            best = f;
+            }
+    return usecs;
+    }
+
 int audio_feed_process_audio(jack_nframes_t n_frames, void *arg)
     {
     struct audio_feed *self = audio_feed;
     struct threads_info *ti = self->threads_info;
     sample_t *input_port_buffer[2];
+    jack_time_t period_usecs = 0;
     int i;
 
+    /* the limiter's lookahead held this audio back so it entered the mixer that much earlier */
+    if (audio_feed_latency_probe)
+        period_usecs = jack_frames_to_time(g.client, jack_last_frame_time(g.client) - mixer_stream_latency());
     input_port_buffer[0] = jack_port_get_buffer(g.port.output_in_l, n_frames);
     input_port_buffer[1] = jack_port_get_buffer(g.port.output_in_r, n_frames);
 
+    /* interleave straight into the ringbuffer so the consumer needn't */
+    void process_interleaved(struct audio_feed_data *afdata)
+        {
+        jack_ringbuffer_data_t vec[2];
+        jack_nframes_t done = 0, n;
+        sample_t *w;
+
+        if (jack_ringbuffer_write_space(afdata->input_rb[0]) < n_frames * 2 * sizeof (sample_t))
+            {
+            afdata->overruns++;
+            rbstat_overrun(&afdata->rb_stats);
+            return;
+            }
+
+        /* the ringbuffer size is a power of two so frames never straddle its end */
+        jack_ringbuffer_get_write_vector(afdata->input_rb[0], vec);
+        for (int r = 0; r < 2 && done < n_frames; r++)
+            {
+            n = vec[r].len / (2 * sizeof (sample_t));
+            if (n > n_frames - done)
+                n = n_frames - done;
+            w = (sample_t *)vec[r].buf;
+            for (jack_nframes_t j = done; j < done + n; j++)
+                {
+                *w++ = input_port_buffer[0][j];
+                *w++ = input_port_buffer[1][j];
+                }
+            done += n;
+            }
+        jack_ringbuffer_write_advance(afdata->input_rb[0], n_frames * 2 * sizeof (sample_t));
+        if (period_usecs)
+            audio_feed_stamp(afdata, n_frames, period_usecs);
+        }
+
     void process(struct audio_feed_data *afdata)
         {
-        reevaluate:
         switch (afdata->jack_dataflow_control)
             {
             case JD_OFF:
                 break;
             case JD_ON:
-                while (jack_ringbuffer_write_space(afdata->input_rb[1]) < n_frames * sizeof (sample_t)) {
-                    nanosleep(&(struct timespec){0, 100000}, NULL);
-                    if (afdata->jack_dataflow_control != JD_ON)
-                        goto reevaluate;
-                }
+                /* the fill is noted once per period whichever way the audio is written */
+                audio_feed_rb_sample(afdata);
+                if (afdata->interleaved)
+                    {
+                    process_interleaved(afdata);
+                    break;
+                    }
+
+                /* never wait on a slow consumer in the realtime thread */
+                if (jack_ringbuffer_write_space(afdata->input_rb[1]) < n_frames * sizeof (sample_t))
+                    {
+                    afdata->overruns++;
+                    rbstat_overrun(&afdata->rb_stats);
+                    break;
+                    }
 
                 jack_ringbuffer_write(afdata->input_rb[0], (char *)input_port_buffer[0], n_frames * sizeof (sample_t));
                 jack_ringbuffer_write(afdata->input_rb[1], (char *)input_port_buffer[1], n_frames * sizeof (sample_t));
+                if (period_usecs)
+                    audio_feed_stamp(afdata, n_frames, period_usecs);
                 break;
             case JD_FLUSH:
                 jack_ringbuffer_reset(afdata->input_rb[0]);
-                jack_ringbuffer_reset(afdata->input_rb[1]);
+                if (afdata->input_rb[1])
+                    jack_ringbuffer_reset(afdata->input_rb[1]);
                 afdata->jack_dataflow_control = JD_OFF;
                 break;
             default:
@@ -67,8 +167,17 @@ int audio_feed_process_audio(jack_nframes_t n_frames, void *arg)
             }
         }
 
+    /* the encoder array can be replaced by encoder_swap_slots
+     * which waits for the epoch to move on before reusing the array it replaced
+     */
+    __atomic_add_fetch(&ti->encoder_walk_epoch, 1, __ATOMIC_SEQ_CST);
+    struct encoder **encoder = __atomic_load_n(&ti->encoder, __ATOMIC_ACQUIRE);
     for (i = 0; i < ti->n_encoders; i++)
-        process(&(ti->encoder[i]->afdata));
+        process(&(encoder[i]->afdata));
+    __atomic_add_fetch(&ti->encoder_walk_epoch, 1, __ATOMIC_RELEASE);
+
+    for (i = 0; i < self->n_resampled; i++)
+        process(&self->resampled[i].afdata);
 
     for (i = 0; i < ti->n_recorders; i++)
         process(&(ti->recorder[i]->afdata));
@@ -85,6 +194,74 @@ int audio_feed_jack_samplerate_request(struct threads_info *ti, struct universal
     return SUCCEEDED;
     }
 
+/* audio_feed_rb_create: make the ringbuffer pair for a feed
+ * the depth in samples is taken from the named environment variable if set
+ */
+int audio_feed_rb_create(struct audio_feed_data *afdata, const char *env_name, size_t default_samples)
+    {
+    char *env = getenv(env_name);
+    long n_samples = env ? atol(env) : 0;
+
+    if (n_samples <= 0)
+        n_samples = default_samples;
+
+    afdata->input_rb[0] = jack_ringbuffer_create(n_samples * sizeof (sample_t));
+    afdata->input_rb[1] = jack_ringbuffer_create(n_samples * sizeof (sample_t));
+    if (!afdata->input_rb[0] || !afdata->input_rb[1])
+        {
+        audio_feed_rb_free(afdata);
+        return FALSE;
+        }
+    afdata->interleaved = FALSE;
+    afdata->overruns = afdata->overruns_seen = 0;
+    memset(&afdata->rb_stats, 0, sizeof afdata->rb_stats);
+    memset(afdata->stamp, 0, sizeof afdata->stamp);
+    afdata->n_stamps = 0;
+    afdata->frames_in = 0;
+    return TRUE;
+    }
+
+/* audio_feed_rb_create_interleaved: make a single ringbuffer of stereo frames for a feed */
+int audio_feed_rb_create_interleaved(struct audio_feed_data *afdata, const char *env_name, size_t default_frames)
+    {
+    char *env = getenv(env_name);
+    long n_frames = env ? atol(env) : 0;
+
+    if (n_frames <= 0)
+        n_frames = default_frames;
+
+    afdata->input_rb[0] = jack_ringbuffer_create(n_frames * 2 * sizeof (sample_t));
+    afdata->input_rb[1] = NULL;
+    afdata->interleaved = TRUE;
+    afdata->overruns = afdata->overruns_seen = 0;
+    memset(&afdata->rb_stats, 0, sizeof afdata->rb_stats);
+    memset(afdata->stamp, 0, sizeof afdata->stamp);
+    afdata->n_stamps = 0;
+    afdata->frames_in = 0;
+    return afdata->input_rb[0] != NULL;
+    }
+
+/* audio_feed_rb_free: free the ringbuffers of a feed the jack callback has stopped using */
+void audio_feed_rb_free(struct audio_feed_data *afdata)
+    {
+    for (int i = 0; i < 2; i++)
+        if (afdata->input_rb[i])
+            {
+            jack_ringbuffer_free(afdata->input_rb[i]);
+            afdata->input_rb[i] = NULL;
+            }
+    }
+
+/* audio_feed_new_overruns: the number of audio periods dropped since last called */
+unsigned int audio_feed_new_overruns(struct audio_feed_data *afdata)
+    {
+    unsigned int overruns = afdata->overruns;
+    unsigned int new_overruns = overruns - afdata->overruns_seen;
+
+    afdata->overruns_seen = overruns;
+    return new_overruns;
+    }
+
 struct audio_feed *audio_feed_init(struct threads_info *ti)
     {
     struct audio_feed *self;
@@ -97,6 +274,26 @@ struct audio_feed *audio_feed_init(struct threads_info *ti)
 
     self->threads_info = ti;
     self->sample_rate = jack_get_sample_rate(g.client);
+    if ((audio_feed_latency_probe = getenv("latency_probe") != NULL))
+        fprintf(stderr, "audio_feed_init: probing the latency from mixer to server\n");
+
+    self->n_resampled = ti->n_encoders;
+    if (!(self->resampled = calloc(self->n_resampled, sizeof (struct audio_feed_resampled))))
+        {
+        fprintf(stderr, "audio_feed_init: malloc failure\n");
+        free(self);
+        return NULL;
+        }
+    for (int i = 0; i < self->n_resampled; i++)
+        {
+        if (!(self->resampled[i].subscriber = calloc(ti->n_encoders, sizeof (struct audio_feed_data *))))
+            {
+            fprintf(stderr, "audio_feed_init: malloc failure\n");
+            exit(5);
+            }
+        pthread_mutex_init(&self->resampled[i].mutex, NULL);
+        }
+
     return self;
     }
 
@@ -104,5 +301,188 @@ struct audio_feed *audio_feed_init(struct threads_info *ti)
 void audio_feed_destroy(struct audio_feed *self)
     {
     self->threads_info->audio_feed = NULL;
+    for (int i = 0; i < self->n_resampled; i++)
+        {
+        pthread_mutex_destroy(&self->resampled[i].mutex);
+        free(self->resampled[i].subscriber);
+        }
+    free(self->resampled);
     free(self);
     }
+
+/* resampler input callback, stereo is interleaved and mono downmixed on the way in */
+static long audio_feed_resampled_get_data(void *cb_data, float **data)
+    {
+    struct audio_feed_resampled *feed = cb_data;
+    jack_ringbuffer_t **rb = feed->afdata.input_rb;
+    float *in0 = feed->rs_output[0], *in1 = feed->rs_output[1];
+    size_t n_samples, i;
+
+    n_samples = jack_ringbuffer_read_space(rb[1]) / sizeof (sample_t);
+    if (n_samples > RS_FEED_INPUT_SAMPLES)
+        n_samples = RS_FEED_INPUT_SAMPLES;
+
+    /* the output channel buffers are free for use as scratch space here */
+    jack_ringbuffer_read(rb[0], (char *)in0, n_samples * sizeof (sample_t));
+    jack_ringbuffer_read(rb[1], (char *)in1, n_samples * sizeof (sample_t));
+    if (feed->channels == 2)
+        for (i = 0; i < n_samples; i++)
+            {
+            feed->rs_input[2 * i] = in0[i];
+            feed->rs_input[2 * i + 1] = in1[i];
+            }
+    else
+        for (i = 0; i < n_samples; i++)
+            feed->rs_input[i] = (in0[i] + in1[i]) * 0.5F;
+
+    *data = feed->rs_input;
+    return (long)n_samples;
+    }
+
+static void audio_feed_resampled_free(struct audio_feed_resampled *feed)
+    {
+    struct timespec ms10 = { 0, 10000000 };
+
+    if (feed->afdata.jack_dataflow_control == JD_ON)
+        feed->afdata.jack_dataflow_control = JD_FLUSH;
+    while (feed->afdata.jack_dataflow_control != JD_OFF)
+        nanosleep(&ms10, NULL);
+
+    for (int i = 0; i < 2; i++)
+        {
+        if (feed->afdata.input_rb[i])
+            jack_ringbuffer_free(feed->afdata.input_rb[i]);
+        feed->afdata.input_rb[i] = NULL;
+        free(feed->rs_output[i]);
+        feed->rs_output[i] = NULL;
+        }
+    if (feed->src_state)
+        feed->src_state = src_delete(feed->src_state);
+    free(feed->rs_input);
+    free(feed->rs_interleaved);
+    feed->rs_input = feed->rs_interleaved = NULL;
+    }
+
+/* audio_feed_resampled_subscribe: have afdata receive the jack feed converted to target_samplerate
+ * the caller's ringbuffers must already exist, returns NULL if no conversion could be set up
+ */
+struct audio_feed_resampled *audio_feed_resampled_subscribe(struct audio_feed *self, struct audio_feed_data *afdata, long target_samplerate, int resample_mode, int channels)
+    {
+    struct audio_feed_resampled *feed, *vacant = NULL;
+    int error;
+
+    for (feed = self->resampled; feed < self->resampled + self->n_resampled; feed++)
+        {
+        if (feed->n_subscribers)
+            {
+            if (feed->target_samplerate == target_samplerate && feed->resample_mode == resample_mode && feed->channels == channels)
+                goto subscribe;
+            }
+        else
+            if (!vacant)
+                vacant = feed;
+        }
+
+    if (!(feed = vacant))
+        return NULL;
+
+    feed->target_samplerate = target_samplerate;
+    feed->resample_mode = resample_mode;
+    feed->channels = channels;
+    feed->ratio = (double)target_samplerate / (double)self->sample_rate;
+    feed->rs_input = malloc(2 * RS_FEED_INPUT_SAMPLES * sizeof (sample_t));
+    feed->rs_interleaved = malloc(2 * RS_FEED_OUTPUT_SAMPLES * sizeof (sample_t));
+    for (int i = 0; i < 2; i++)
+        feed->rs_output[i] = malloc(RS_FEED_OUTPUT_SAMPLES * sizeof (sample_t));
+    if (!(feed->rs_input && feed->rs_interleaved && feed->rs_output[0] && feed->rs_output[1]))
+        {
+        fprintf(stderr, "audio_feed_resampled_subscribe: malloc failure\n");
+        goto failed;
+        }
+    if (!(feed->src_state = src_callback_new(audio_feed_resampled_get_data, resample_mode, channels, &error, feed)))
+        goto failed;
+    src_set_ratio(feed->src_state, feed->ratio);
+    if (!audio_feed_rb_create(&feed->afdata, "encoder_rb_samples", RS_FEED_RB_SAMPLES))
+        goto failed;
+    feed->afdata.jack_dataflow_control = JD_ON;
+    fprintf(stderr, "audio_feed_resampled_subscribe: new %d channel feed at %ld Hz\n", channels, target_samplerate);
+
+    subscribe:
+    pthread_mutex_lock(&feed->mutex);
+    feed->subscriber[feed->n_subscribers++] = afdata;
+    pthread_mutex_unlock(&feed->mutex);
+    return feed;
+
+    failed:
+    audio_feed_resampled_free(feed);
+    return NULL;
+    }
+
+void audio_feed_resampled_unsubscribe(struct audio_feed_resampled *feed, struct audio_feed_data *afdata)
+    {
+    int i;
+
+    pthread_mutex_lock(&feed->mutex);
+    for (i = 0; i < feed->n_subscribers && feed->subscriber[i] != afdata; i++);
+    if (i < feed->n_subscribers)
+        feed->subscriber[i] = feed->subscriber[--feed->n_subscribers];
+    if (!feed->n_subscribers)
+        audio_feed_resampled_free(feed);
+    pthread_mutex_unlock(&feed->mutex);
+    }
+
+/* audio_feed_resampled_pump: convert whatever input is waiting and hand it to every subscriber
+ * subscribers call this before reading, one doing the work on behalf of all the others
+ */
+void audio_feed_resampled_pump(struct audio_feed_resampled *feed)
+    {
+    ssize_t n_samples;
+    size_t qty, bytes;
+    jack_time_t usecs = 0;
+    int i, c;
+
+    if (pthread_mutex_trylock(&feed->mutex))
+        return;
+
+    /* once per pump rather than per chunk so every pass counts the same */
+    for (i = 0; i < feed->n_subscribers; i++)
+        audio_feed_rb_sample(feed->subscriber[i]);
+
+    for (;;)
+        {
+        /* 128 samples are held back to make sure the resampler gives the full number of samples on both reads */
+        n_samples = (ssize_t)(jack_ringbuffer_read_space(feed->afdata.input_rb[1]) / sizeof (sample_t) * feed->ratio) - 128;
+        if (n_samples <= 0)
+            break;
+        if (n_samples > RS_FEED_OUTPUT_SAMPLES)
+            n_samples = RS_FEED_OUTPUT_SAMPLES;
+
+        /* the converted audio is as old as the oldest input read for it */
+        if (audio_feed_latency_probe)
+            usecs = audio_feed_capture_time(&feed->afdata, audio_feed_frames_consumed(&feed->afdata));
+        if ((qty = src_callback_read(feed->src_state, feed->ratio, n_samples, feed->rs_interleaved)) == 0)
+            break;
+        for (c = 0; c < feed->channels; c++)
+            for (size_t j = 0; j < qty; j++)
+                feed->rs_output[c][j] = feed->rs_interleaved[j * feed->channels + c];
+
+        bytes = qty * sizeof (sample_t);
+        for (i = 0; i < feed->n_subscribers; i++)
+            {
+            jack_ringbuffer_t **rb = feed->subscriber[i]->input_rb;
+
+            if (jack_ringbuffer_write_space(rb[0]) < bytes || (feed->channels == 2 && jack_ringbuffer_write_space(rb[1]) < bytes))
+                {
+                feed->subscriber[i]->overruns++;
+                rbstat_overrun(&feed->subscriber[i]->rb_stats);
+                continue;
+                }
+            for (c = 0; c < feed->channels; c++)
+                jack_ringbuffer_write(rb[c], (char *)feed->rs_output[c], bytes);
+            if (usecs)
+                audio_feed_stamp(feed->subscriber[i], qty, usecs);
+            }
+        }
+
+    pthread_mutex_unlock(&feed->mutex);
+    }
@@ -22,20 +22,60 @@
 
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
+#include <pthread.h>
+#include <samplerate.h>
 #include "sourceclient.h"
+#include "rbstat.h"
 
-struct audio_feed
+enum jack_dataflow { JD_OFF, JD_ON, JD_FLUSH };
+
+#define AUDIO_FEED_STAMPS 128
+
+/* for the latency probe, the time a stretch of audio entered the mixer */
+struct audio_feed_stamp
     {
-    struct threads_info *threads_info;
-    jack_nframes_t sample_rate;
+    uint64_t frame;                           /* of the first frame written at the time */
+    jack_time_t usecs;
     };
 
-enum jack_dataflow { JD_OFF, JD_ON, JD_FLUSH };
-
 struct audio_feed_data
     {
     enum jack_dataflow jack_dataflow_control; /* tells the jack callback routine what we want it to do */
     jack_ringbuffer_t *input_rb[2];           /* circular buffer containing pcm audio data */
+    int interleaved;                          /* input_rb[0] alone holds stereo frames */
+    volatile unsigned int overruns;           /* periods dropped by the jack callback on a full ringbuffer */
+    unsigned int overruns_seen;               /* consumer side tally of the above */
+    struct rbstat rb_stats;                   /* input_rb fill as seen by the writer */
+    struct audio_feed_stamp stamp[AUDIO_FEED_STAMPS]; /* the most recent writes when probing latency */
+    unsigned int n_stamps;
+    uint64_t frames_in;                       /* written in total, by the writer */
+    };
+
+/* a sample rate converted copy of the jack feed
+ * one is shared by all the encoders wanting the same conversion
+ */
+struct audio_feed_resampled
+    {
+    struct audio_feed_data afdata;            /* the jack rate input */
+    long target_samplerate;                   /* the conversion: the feed's key */
+    int resample_mode;
+    int channels;                             /* mono feeds are downmixed before conversion */
+    double ratio;
+    SRC_STATE *src_state;                     /* converts all channels in one pass */
+    float *rs_input;                          /* interleaved resampler input */
+    float *rs_interleaved;                    /* interleaved resampler output */
+    float *rs_output[2];                      /* the same split into channels */
+    struct audio_feed_data **subscriber;      /* where the converted audio goes */
+    int n_subscribers;
+    pthread_mutex_t mutex;                    /* guards conversion and the subscriber list */
+    };
+
+struct audio_feed
+    {
+    struct threads_info *threads_info;
+    jack_nframes_t sample_rate;
+    int n_resampled;                          /* enough for every encoder to differ */
+    struct audio_feed_resampled *resampled;
     };
 
 struct universal_vars;
@@ -44,6 +84,19 @@ struct audio_feed *audio_feed_init(struct threads_info *ti);
 void audio_feed_deactivate(struct audio_feed *self);
 void audio_feed_destroy(struct audio_feed *self);
 int audio_feed_jack_samplerate_request(struct threads_info *ti, struct universal_vars *uv, void *param);
+int audio_feed_rb_create(struct audio_feed_data *afdata, const char *env_name, size_t default_samples);
+int audio_feed_rb_create_interleaved(struct audio_feed_data *afdata, const char *env_name, size_t default_frames);
+void audio_feed_rb_free(struct audio_feed_data *afdata);
+unsigned int audio_feed_new_overruns(struct audio_feed_data *afdata);
+void audio_feed_rb_sample(struct audio_feed_data *afdata);
+void audio_feed_stamp(struct audio_feed_data *afdata, size_t n_frames, jack_time_t usecs);
+uint64_t audio_feed_frames_consumed(struct audio_feed_data *afdata);
+jack_time_t audio_feed_capture_time(struct audio_feed_data *afdata, uint64_t frame);
+
+extern int audio_feed_latency_probe;          /* the environment variable latency_probe is set */
 int audio_feed_process_audio(jack_nframes_t n_frames, void *arg);
+struct audio_feed_resampled *audio_feed_resampled_subscribe(struct audio_feed *self, struct audio_feed_data *afdata, long target_samplerate, int resample_mode, int channels);
+void audio_feed_resampled_unsubscribe(struct audio_feed_resampled *feed, struct audio_feed_data *afdata);
+void audio_feed_resampled_pump(struct audio_feed_resampled *feed);
 
 #endif
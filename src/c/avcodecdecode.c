@@ -44,12 +44,33 @@ extern int dynamic_metadata_form[];
 
 static const struct timespec time_delay = { .tv_nsec = 10 };
 
+#if defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE)
+/* reserve_floatsamples: grow the swresample output buffer, it is kept for the life of the track */
+static int reserve_floatsamples(struct xlplayer *xlplayer, int frames)
+    {
+    struct avcodecdecode_vars *self = xlplayer->dec_data;
+
+    if (frames <= self->floatsamples_cap)
+        return TRUE;
+    if (self->floatsamples)
+        av_freep(&self->floatsamples);
+    self->floatsamples_cap = 0;
+    if (av_samples_alloc(&self->floatsamples, NULL, self->channels, frames, AV_SAMPLE_FMT_FLT, 0) < 0)
+        {
+        fprintf(stderr, "avcodecdecode_play: av_samples_alloc failed\n");
+        xlplayer->playmode = PM_EJECTING;
+        return FALSE;
+        }
+    self->floatsamples_cap = frames;
+    return TRUE;
+    }
+#endif
+
 static void write_frame(struct xlplayer *xlplayer, AVFrame *frame)
     {
     struct avcodecdecode_vars *self = xlplayer->dec_data;
     int frames;
     int channels = self->c->channels;
-    SRC_DATA *src_data = &xlplayer->src_data;
 
 #if defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE)
     if (!self->swr)
@@ -93,17 +114,20 @@ static void write_frame(struct xlplayer *xlplayer, AVFrame *frame)
             }
         }
 
-    if (self->floatsamples)
-        av_freep(&self->floatsamples);
+    /* swresample converts to the jack sample rate so the output can outnumber the input */
+    int out_count = av_rescale_rnd(swr_get_delay(self->swr, self->c->sample_rate) + frame->nb_samples,
+                                    xlplayer->samplerate, self->c->sample_rate, AV_ROUND_UP);
+
+    if (!reserve_floatsamples(xlplayer, out_count))
+        return;
 
-    if (av_samples_alloc(&self->floatsamples, NULL, 2, frame->nb_samples, AV_SAMPLE_FMT_FLT, 0) < 0)
+    if ((frames = swr_convert(self->swr, &self->floatsamples, out_count, (const uint8_t **)frame->data, frame->nb_samples)) < 0)
         {
-        fprintf(stderr, "avcodecdecode_play: av_samples_alloc failed\n");
+        fprintf(stderr, "avcodecdecode_play: swr_convert failed\n");
         xlplayer->playmode = PM_EJECTING;
         return;
         }
-
-    swr_convert(self->swr, &self->floatsamples, frame->nb_samples, (const uint8_t **)frame->data, frame->nb_samples);
+    xlplayer_demux_channel_data(xlplayer, (float *)self->floatsamples, frames, self->channels, 1.f);
 #else
 
     if (!(self->floatsamples))
@@ -123,6 +147,7 @@ static void write_frame(struct xlplayer *xlplayer, AVFrame *frame)
             }
         }
 
+    SRC_DATA *src_data = &xlplayer->src_data;
     int buffer_size = av_samples_get_buffer_size(NULL, channels,
                         frame->nb_samples, self->c->sample_fmt, 1);
 
@@ -238,13 +263,11 @@ static void write_frame(struct xlplayer *xlplayer, AVFrame *frame)
             return;
         }
 
-#endif /* defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE) */
-
     if (self->resample)
         {
         src_data->input_frames = frame->nb_samples;
         src_data->data_in = (float *)self->floatsamples;
-        if (src_process(xlplayer->src_state, src_data))
+        if (resampler_process(xlplayer->src_state, src_data))
             {
             fprintf(stderr, "avcodecdecode_play: error occured during resampling\n");
             xlplayer->playmode = PM_EJECTING;
@@ -255,12 +278,53 @@ static void write_frame(struct xlplayer *xlplayer, AVFrame *frame)
     else
         xlplayer_demux_channel_data(xlplayer, (float *)self->floatsamples, frames = frame->nb_samples, self->channels, 1.f);
 
+#endif /* defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE) */
+
     if (self->drop > 0)
         self->drop -= frames / (float)xlplayer->samplerate;
     else
         xlplayer_write_channel_data(xlplayer);
     }
 
+/* flush_resampler: the audio held back by the resampler at the end of the track */
+static int flush_resampler(struct xlplayer *xlplayer)
+    {
+    struct avcodecdecode_vars *self = xlplayer->dec_data;
+
+#if defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE)
+    int frames;
+
+    if (!self->swr || (frames = swr_get_out_samples(self->swr, 0)) <= 0)
+        return TRUE;
+    if (!reserve_floatsamples(xlplayer, frames))
+        return FALSE;
+    if ((frames = swr_convert(self->swr, &self->floatsamples, frames, NULL, 0)) < 0)
+        {
+        fprintf(stderr, "avcodecdecode_play: swr_convert failed\n");
+        xlplayer->playmode = PM_EJECTING;
+        return FALSE;
+        }
+    xlplayer_demux_channel_data(xlplayer, (float *)self->floatsamples, frames, self->channels, 1.f);
+    xlplayer_write_channel_data(xlplayer);
+#else
+    SRC_DATA *src_data = &xlplayer->src_data;
+
+    if (self->resample)
+        {
+        src_data->end_of_input = TRUE;
+        src_data->input_frames = 0;
+        if (resampler_process(xlplayer->src_state, src_data))
+            {
+            fprintf(stderr, "avcodecdecode_play: error occured during resampling\n");
+            xlplayer->playmode = PM_EJECTING;
+            return FALSE;
+            }
+        xlplayer_demux_channel_data(xlplayer, src_data->data_out, src_data->output_frames_gen, self->channels, 1.f);
+        xlplayer_write_channel_data(xlplayer);
+        }
+#endif
+    return TRUE;
+    }
 
 static void avcodecdecode_eject(struct xlplayer *xlplayer)
     {
@@ -271,11 +335,16 @@ static void avcodecdecode_eject(struct xlplayer *xlplayer)
         av_packet_unref(&self->pkt);
     if (self->resample)
         {
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         free(xlplayer->src_data.data_out);
         }
+#if defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE)
+    if (self->floatsamples)
+        av_freep(&self->floatsamples);
+#else
     if (self->floatsamples)
         free(self->floatsamples);
+#endif
 #ifdef HAVE_SWRESAMPLE
     if (self->swr)
         swr_free(&self->swr);
@@ -313,7 +382,13 @@ static void avcodecdecode_init(struct xlplayer *xlplayer)
         }
 
     self->channels = (self->c->channels == 1) ? 1 : 2;
-    if ((self->resample = (self->c->sample_rate != (int)xlplayer->samplerate)))
+#if defined (HAVE_SWRESAMPLE) && defined(USE_SWRESAMPLE)
+    /* swresample does the rate conversion along with the sample format */
+    self->resample = FALSE;
+#else
+    self->resample = (self->c->sample_rate != (int)xlplayer->samplerate);
+#endif
+    if (self->resample)
         {
         fprintf(stderr, "configuring resampler\n");
         xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)self->c->sample_rate;
@@ -331,9 +406,9 @@ static void avcodecdecode_init(struct xlplayer *xlplayer)
             xlplayer->command = CMD_COMPLETE;
             return;
             }
-        if ((xlplayer->src_state = src_new(xlplayer->rsqual, self->channels, &src_error)), src_error)
+        if ((xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, self->channels, &src_error)), src_error)
             {
-            fprintf(stderr, "avcodecdecode_init: src_new reports %s\n", src_strerror(src_error));
+            fprintf(stderr, "avcodecdecode_init: resampler_new reports %s\n", resampler_strerror(src_error));
             free(xlplayer->src_data.data_out);
             self->resample = FALSE;
             avcodecdecode_eject(xlplayer);
@@ -351,8 +426,6 @@ static void avcodecdecode_init(struct xlplayer *xlplayer)
 static void avcodecdecode_play(struct xlplayer *xlplayer)
 {
     struct avcodecdecode_vars *self = xlplayer->dec_data;
-    int channels = self->c->channels;
-    SRC_DATA *src_data = &xlplayer->src_data;
 
     for(;;) {
         switch(avcodec_receive_frame(self->c, &self->af)) {
@@ -415,20 +488,8 @@ cleanup:
     if (self->pkt.data)
         av_packet_unref(&self->pkt);
 
-    if (self->resample)       /* flush the resampler */
-        {
-        src_data->end_of_input = TRUE;
-        src_data->input_frames = 0;
-        if (src_process(xlplayer->src_state, src_data))
-            {
-            fprintf(stderr, "avcodecdecode_play: error occured during resampling\n");
-            xlplayer->playmode = PM_EJECTING;
-            return;
-            }
-        xlplayer_demux_channel_data(xlplayer, src_data->data_out, src_data->output_frames_gen, channels, 1.f);
-        xlplayer_write_channel_data(xlplayer);
-        }
-    xlplayer->playmode = PM_FLUSH;
+    if (flush_resampler(xlplayer))
+        xlplayer->playmode = PM_FLUSH;
 }
 
 #else
@@ -436,8 +497,6 @@ cleanup:
 static void avcodecdecode_play(struct xlplayer *xlplayer)
     {
     struct avcodecdecode_vars *self = xlplayer->dec_data;
-    int channels = self->c->channels;
-    SRC_DATA *src_data = &xlplayer->src_data;
 
     if (self->size <= 0)
         {
@@ -446,20 +505,8 @@ static void avcodecdecode_play(struct xlplayer *xlplayer)
             if (self->pkt.data)
                 av_packet_unref(&self->pkt);
 
-            if (self->resample)       /* flush the resampler */
-                {
-                src_data->end_of_input = TRUE;
-                src_data->input_frames = 0;
-                if (src_process(xlplayer->src_state, src_data))
-                    {
-                    fprintf(stderr, "avcodecdecode_play: error occured during resampling\n");
-                    xlplayer->playmode = PM_EJECTING;
-                    return;
-                    }
-                xlplayer_demux_channel_data(xlplayer, src_data->data_out, src_data->output_frames_gen, channels, 1.f);
-                xlplayer_write_channel_data(xlplayer);
-                }
-            xlplayer->playmode = PM_FLUSH;
+            if (flush_resampler(xlplayer))
+                xlplayer->playmode = PM_FLUSH;
             return;
             }
         self->pktcopy = self->pkt;
@@ -54,6 +54,7 @@ struct avcodecdecode_vars
 #ifdef HAVE_SWRESAMPLE
     SwrContext *swr;
     uint8_t *floatsamples;
+    int floatsamples_cap;   /* in frames, grows to the largest converted frame */
 #else
     float *floatsamples;
 #endif
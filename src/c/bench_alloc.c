@@ -0,0 +1,87 @@
+/*
+#   bench_alloc.c: allocation counting for the benchmarks
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* linked into a benchmark these take the place of the C library allocator
+ * entry points for the whole program, shared libraries included, and pass
+ * each call on to glibc's own functions once it has been counted
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include "bench_alloc.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static unsigned long allocations;
+
+static void count()
+    {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    }
+
+void *malloc(size_t size)
+    {
+    count();
+    return __libc_malloc(size);
+    }
+
+void *calloc(size_t nmemb, size_t size)
+    {
+    count();
+    return __libc_calloc(nmemb, size);
+    }
+
+void *realloc(void *ptr, size_t size)
+    {
+    count();
+    return __libc_realloc(ptr, size);
+    }
+
+void *memalign(size_t alignment, size_t size)
+    {
+    count();
+    return __libc_memalign(alignment, size);
+    }
+
+void *aligned_alloc(size_t alignment, size_t size)
+    {
+    count();
+    return __libc_memalign(alignment, size);
+    }
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+    {
+    void *p;
+
+    if (alignment % sizeof (void *) || alignment & (alignment - 1))
+        return EINVAL;
+    count();
+    if (!(p = __libc_memalign(alignment, size)))
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+    }
+
+unsigned long bench_allocations()
+    {
+    return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    }
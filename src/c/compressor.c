@@ -50,6 +50,41 @@ compaudio_t limiter(struct compressor *self, compaudio_t left, compaudio_t right
     return self->gain_db;
     }
 
+/* limiter_block: the limiter applied in place to a block of stereo audio
+ * most blocks are well below the knee with the gain already back at unity
+ * which is spotted from the block's peak so the audio is left untouched
+ */
+void limiter_block(struct compressor *self, compaudio_t *restrict left, compaudio_t *restrict right, int n)
+    {
+    compaudio_t peak = 0.0F, a, b, gain;
+
+    for (int i = 0; i < n; i++)
+        {
+        a = fabsf(left[i]);
+        b = fabsf(right[i]);
+        a = (a > b) ? a : b;
+        peak = (peak > a) ? peak : a;
+        }
+
+    /* a little margin keeps clear of where level2db's rounding could tip it either way
+     * and a gain this close to unity is too small to hear while it releases
+     */
+    if (peak < powf(10.0F, self->k1 / 20.0F) * 0.999F && self->gain_db > -1.0F / 512.0F)
+        {
+        /* the release of all n samples in one go */
+        if (self->gain_db < -0.0000004F)
+            self->gain_db *= powf(1.0F - self->release, n);
+        return;
+        }
+
+    for (int i = 0; i < n; i++)
+        {
+        gain = db2level(limiter(self, left[i], right[i]));
+        left[i] *= gain;
+        right[i] *= gain;
+        }
+    }
+
 /* the variable maxlevel dictates the amount by which the volume can be turned up */
 /* when the ceiling level is breached the volume level is reduced */
 compaudio_t normalizer(struct normalizer *self, compaudio_t left, compaudio_t right)
@@ -50,4 +50,5 @@ struct normalizer
 
 compaudio_t compressor(struct compressor *self, compaudio_t signal, int skip_rms);
 compaudio_t limiter(struct compressor *self, compaudio_t left, compaudio_t right);
+void limiter_block(struct compressor *self, compaudio_t *left, compaudio_t *right, int n);
 compaudio_t normalizer(struct normalizer *self, compaudio_t left, compaudio_t right);
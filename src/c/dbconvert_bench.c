@@ -0,0 +1,152 @@
+/*
+#   dbconvert_bench.c: timing of the dB conversions against lookup tables and libm
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* built by make bench, it takes no arguments */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "dbconvert.h"
+
+#define N_VALUES (1 << 20)
+#define PASSES 20
+
+/* the tables the mixer used before, for comparison */
+static float dblookup[131072];
+static float signallookup[65536];
+
+static float table_level2db(float signal)
+    {
+    int index;
+    float adjustment = 0.0F;
+
+    if (signal > 1.0F)
+        return ((index = (int)(131072.0005F / signal) - 1) >= 0) ? -dblookup[index] : 102.3501985F;
+    if (signal < 3.16227766e-3F)
+        {
+        signal *= 316.227766;
+        adjustment = -50.0F;
+        }
+    return (((index = (int)(signal * 131072.0005F) - 1) >= 0) ? dblookup[index] : -102.3501985F) + adjustment;
+    }
+
+static float table_db2level(float signal)
+    {
+    int index;
+
+    if (signal < 0.0F)
+        return ((index = signal * (-512.0F)) < 65536) ? signallookup[index] : signallookup[65535];
+    return ((index = signal * 512.0F) < 65536) ? 1.0F / signallookup[index] : 1.0F / signallookup[65535];
+    }
+
+static float libm_level2db(float signal)
+    {
+    return log10f(signal) * 20.0f;
+    }
+
+static float libm_db2level(float signal)
+    {
+    return powf(10.0f, signal * 0.05f);
+    }
+
+static double now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+/* time calls of f over the input and report the worst error against the double precision result */
+static void run(const char *name, float (*f)(float), const float *in, float *out, int is_db, void (*block)(const float *, float *, int))
+    {
+    double start, elapsed, err, worst = 0.0, exact;
+
+    start = now();
+    for (int pass = 0; pass < PASSES; ++pass)
+        {
+        if (block)
+            block(in, out, N_VALUES);
+        else
+            for (int i = 0; i < N_VALUES; ++i)
+                out[i] = f(in[i]);
+        }
+    elapsed = now() - start;
+
+    for (int i = 0; i < N_VALUES; ++i)
+        {
+        if (is_db)
+            {
+            exact = pow(10.0, in[i] / 20.0);
+            err = fabs(out[i] / exact - 1.0);
+            }
+        else
+            {
+            exact = 20.0 * log10(in[i]);
+            err = fabs(out[i] - exact);
+            }
+        if (err > worst)
+            worst = err;
+        }
+    printf("  %-8s %6.2f ns/value  worst error %.3g%s\n", name, elapsed * 1e9 / ((double)N_VALUES * PASSES),
+                                                                    worst, is_db ? "" : " dB");
+    }
+
+int main()
+    {
+    float *levels, *dbs, *out;
+
+    for (int i = 0; i < 131072; i++)
+        dblookup[i] = log10f((i + 1) / 131072.0F) * 20.0F;
+    for (int i = 0; i < 65536; i++)
+        signallookup[i] = 1.0F / powf(10.0F, (float)i / 10240.0F);
+
+    if (!(levels = malloc(N_VALUES * sizeof (float))) || !(dbs = malloc(N_VALUES * sizeof (float)))
+                                            || !(out = malloc(N_VALUES * sizeof (float))))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+
+    /* audio like levels from -100 dB to +20 dB and gains of the limiter's range */
+    srandom(1);
+    for (int i = 0; i < N_VALUES; ++i)
+        {
+        levels[i] = powf(10.0f, (random() / (float)RAND_MAX * 120.0f - 100.0f) / 20.0f);
+        dbs[i] = random() / (float)RAND_MAX * -100.0f;
+        }
+
+    printf("level2db\n");
+    run("table", table_level2db, levels, out, 0, NULL);
+    run("libm", libm_level2db, levels, out, 0, NULL);
+    run("inline", level2db, levels, out, 0, NULL);
+    run("block", NULL, levels, out, 0, level2db_block);
+    printf("db2level\n");
+    run("table", table_db2level, dbs, out, 1, NULL);
+    run("libm", libm_db2level, dbs, out, 1, NULL);
+    run("inline", db2level, dbs, out, 1, NULL);
+    run("block", NULL, dbs, out, 1, db2level_block);
+
+    free(levels);
+    free(dbs);
+    free(out);
+    return 0;
+    }
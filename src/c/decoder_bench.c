@@ -0,0 +1,202 @@
+/*
+#   decoder_bench.c: decoding throughput of the media players without JACK
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* built by make bench and linked against the idjc module
+ *
+ * each file is played through a player of its own in a child process and
+ * drained as fast as the player thread can fill its ringbuffer, so all of the
+ * decoder path is timed: dec_init, dec_play, the conversion to float, the
+ * resampler and the ringbuffer writes
+ *
+ * the real-time factor is of the player thread's cpu time, allocations are
+ * counted in every thread of the process and the peak RSS is that of the child
+ *
+ * usage: decoder_bench [-r rate] [-q resample quality 0-4] [-k resampler] file ...
+ */
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "main.h"
+#include "xlplayer.h"
+#include "bench_alloc.h"
+
+#define READ_FRAMES 4096
+
+static int sample_rate = 48000;
+static int resample_quality = 2;
+static enum resampler_kind resampler = RESAMPLER_LIBSAMPLERATE;
+static int volume = 127;
+
+static double seconds(clockid_t clock)
+    {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+/* peak_rss_reset: start the high water mark of the resident set afresh, where the kernel allows */
+static void peak_rss_reset()
+    {
+    FILE *fp;
+
+    if ((fp = fopen("/proc/self/clear_refs", "w")))
+        {
+        fputs("5", fp);
+        fclose(fp);
+        }
+    }
+
+/* peak_rss: the high water mark of the resident set in KiB */
+static long peak_rss()
+    {
+    FILE *fp;
+    char line[128];
+    long kib = -1;
+
+    if ((fp = fopen("/proc/self/status", "r")))
+        {
+        while (fgets(line, sizeof line, fp))
+            if (sscanf(line, "VmHWM: %ld", &kib) == 1)
+                break;
+        fclose(fp);
+        }
+    return kib;
+    }
+
+static const char *format_of(const char *pathname)
+    {
+    const char *dot = strrchr(pathname, '.');
+
+    return (dot && !strchr(dot, '/')) ? dot + 1 : "?";
+    }
+
+/* bench_file: play one file to the end, run in a child process of its own */
+static int bench_file(char *pathname)
+    {
+    struct xlplayer *player;
+    clockid_t cpu_clock;
+    double wall, cpu, audio;
+    unsigned long allocs;
+    size_t frames = 0, n;
+
+    peak_rss_reset();
+    if (!(player = xlplayer_create(sample_rate, 10.0, "bench", &g.app_shutdown, &volume, 0, NULL, NULL, 0.0f)))
+        return 1;
+    player->rsqual = resample_quality;
+    player->resampler = resampler;
+    xlplayer_buffer_alloc(player, READ_FRAMES);
+    if (pthread_getcpuclockid(player->thread, &cpu_clock))
+        {
+        fprintf(stderr, "decoder_bench: no cpu clock for the player thread\n");
+        return 1;
+        }
+
+    allocs = bench_allocations();
+    wall = seconds(CLOCK_MONOTONIC);
+    cpu = seconds(cpu_clock);
+    if (xlplayer_play(player, pathname, 0, 0, 0.0f, 0) < 0 && player->playmode == PM_STOPPED)
+        {
+        printf("%-6s %-32.32s  no decoder\n", format_of(pathname), pathname);
+        return 1;
+        }
+    while (!xlplayer_idle(player))
+        {
+        if ((n = xlplayer_read_start(player, READ_FRAMES)))
+            frames += n;
+        else
+            usleep(100);
+        }
+    cpu = seconds(cpu_clock) - cpu;
+    wall = seconds(CLOCK_MONOTONIC) - wall;
+    allocs = bench_allocations() - allocs;
+    audio = (double)frames / sample_rate;
+
+    printf("%-6s %-32.32s %9.2f %9.3f %9.1f %9.1f %11.0f %8.1f\n", format_of(pathname), pathname,
+                audio, cpu, cpu > 0.0 ? audio / cpu : 0.0, wall > 0.0 ? audio / wall : 0.0,
+                wall > 0.0 ? allocs / wall : 0.0, peak_rss() / 1024.0);
+    fflush(stdout);
+    xlplayer_destroy(player);
+    return 0;
+    }
+
+static void usage(const char *name)
+    {
+    fprintf(stderr, "usage: %s [-r rate] [-q resample quality 0-4] [-k libsamplerate|swresample|polyphase] file ...\n", name);
+    exit(2);
+    }
+
+int main(int argc, char **argv)
+    {
+    int opt, status, failures = 0;
+    pid_t pid;
+
+    while ((opt = getopt(argc, argv, "r:q:k:")) != -1)
+        switch (opt)
+            {
+            case 'r':
+                sample_rate = atoi(optarg);
+                break;
+            case 'q':
+                resample_quality = atoi(optarg);
+                break;
+            case 'k':
+                if (!resampler_kind_parse(optarg, &resampler))
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+            }
+    if (optind == argc || sample_rate < 8000 || resample_quality < 0 || resample_quality > 4)
+        usage(argv[0]);
+
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    if (!(g.out = fopen("/dev/null", "w")))
+        {
+        perror("/dev/null");
+        exit(5);
+        }
+    xlplayer_mpg123_status();
+
+    printf("%d Hz, resample quality %d, %s\n", sample_rate, resample_quality, resampler_kind_name(resampler));
+    printf("%-6s %-32s %9s %9s %9s %9s %11s %8s\n", "format", "file", "audio s", "cpu s",
+                "rtf cpu", "rtf wall", "allocs/s", "rss MiB");
+    fflush(stdout);
+    for (int i = optind; i < argc; ++i)
+        {
+        if ((pid = fork()) < 0)
+            {
+            perror("fork");
+            exit(5);
+            }
+        if (pid == 0)
+            exit(bench_file(argv[i]));
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+            ++failures;
+        }
+    return failures ? 1 : 0;
+    }
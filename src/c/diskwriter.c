@@ -0,0 +1,444 @@
+/*
+#   diskwriter.c: write-behind file output for recordings
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "sourceclient.h"
+#include "sig.h"
+#include "diskwriter.h"
+
+/* writes are made a chunk at a time, each chunk aligned for direct i/o */
+#define CHUNK_SIZE (256 * 1024)
+#define CHUNK_ALIGN 4096
+
+/* the most chunks the write-behind thread may have queued before the writer waits
+ * amounting to 64MiB which is several minutes of the highest bit rate stream
+ */
+static const int max_chunks = 256;
+
+/* how far ahead of the writes to preallocate the file */
+static const off_t extent_size = 16 << 20;
+
+/* the most queued chunks of one file to go in a single write */
+#define MAX_BATCH 16
+
+struct chunk
+    {
+    struct chunk *next;
+    struct disk_writer *owner;
+    size_t fill;
+    char *data;
+    };
+
+/* a thread that writes the chunks queued to it, either for one writer or shared by all */
+struct disk_io
+    {
+    pthread_t thread_h;
+    pthread_mutex_t mutex;       /* guards the queue and the free lists of its writers */
+    pthread_cond_t cv;
+    struct chunk *queue_head;    /* full chunks waiting to be written, oldest first */
+    struct chunk *queue_tail;
+    int terminate;
+    int started;
+    };
+
+struct disk_writer
+    {
+    int fd;
+    int direct;                  /* O_DIRECT is set on fd */
+    int failed;                  /* a write has failed so the file is incomplete */
+    int can_allocate;            /* fallocate works on this filesystem */
+    off_t size;                  /* bytes accepted so far */
+    off_t write_pos;             /* where the next chunk goes */
+    off_t allocated;             /* preallocated up to here */
+    struct chunk *current;       /* the chunk being filled */
+    struct disk_io *io;          /* what writes the chunks, NULL for the recorder thread */
+    struct disk_io own_io;       /* for when the thread isn't shared */
+    struct chunk *free_chunks;
+    int n_chunks;                /* allocated in total */
+    int pending;                 /* chunks queued or being written */
+    };
+
+/* all the recorders' chunks go through here with $recorder_io_thread set to "shared" */
+static struct disk_io shared_io = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER };
+
+static int env_true(const char *name)
+    {
+    const char *value = getenv(name);
+
+    return value && value[0] && strcmp(value, "0");
+    }
+
+static struct chunk *chunk_new()
+    {
+    struct chunk *chunk;
+
+    if (!(chunk = calloc(1, sizeof (struct chunk))))
+        return NULL;
+    if (posix_memalign((void **)&chunk->data, CHUNK_ALIGN, CHUNK_SIZE))
+        {
+        free(chunk);
+        return NULL;
+        }
+    return chunk;
+    }
+
+static void chunk_free_list(struct chunk *chunk)
+    {
+    struct chunk *next;
+
+    for (; chunk; chunk = next)
+        {
+        next = chunk->next;
+        free(chunk->data);
+        free(chunk);
+        }
+    }
+
+/* disk_writer_preallocate: reserve space ahead of the chunk about to be written */
+static void disk_writer_preallocate(struct disk_writer *self, size_t size)
+    {
+#ifndef USE_BSD_COMPAT
+    if (!self->can_allocate || self->write_pos + (off_t)size <= self->allocated)
+        return;
+    if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, self->allocated, extent_size))
+        {
+        if (errno != EOPNOTSUPP && errno != ENOSYS)
+            perror("disk_writer_preallocate: fallocate");
+        self->can_allocate = FALSE;
+        return;
+        }
+    self->allocated += extent_size;
+#endif
+    }
+
+/* disk_writer_write_chunks: write chunks in order at the next file position, all in one go */
+static void disk_writer_write_chunks(struct disk_writer *self, struct chunk **chunks, int n)
+    {
+    struct iovec iov[MAX_BATCH], *v = iov;
+    size_t remaining = 0;
+    ssize_t done;
+    int i, n_iov = n;
+
+    if (self->failed)
+        return;
+    for (i = 0; i < n; ++i)
+        {
+        iov[i].iov_base = chunks[i]->data;
+        iov[i].iov_len = chunks[i]->fill;
+        remaining += chunks[i]->fill;
+        }
+    disk_writer_preallocate(self, remaining);
+#ifndef USE_BSD_COMPAT
+    /* only the final chunk can be a partial one and direct i/o won't take it */
+    if (self->direct && chunks[n - 1]->fill % CHUNK_ALIGN)
+        {
+        if (fcntl(self->fd, F_SETFL, fcntl(self->fd, F_GETFL) & ~O_DIRECT) < 0)
+            perror("disk_writer_write_chunks: fcntl");
+        self->direct = FALSE;
+        }
+#endif
+    while (remaining)
+        {
+        if ((done = pwritev(self->fd, v, n_iov, self->write_pos)) < 0)
+            {
+            if (errno == EINTR)
+                continue;
+            perror("disk_writer_write_chunks: pwritev");
+            self->failed = TRUE;
+            return;
+            }
+        remaining -= done;
+        self->write_pos += done;
+        /* a short write resumes part way through */
+        while (n_iov && (size_t)done >= v->iov_len)
+            {
+            done -= v->iov_len;
+            ++v;
+            --n_iov;
+            }
+        if (n_iov)
+            {
+            v->iov_base = (char *)v->iov_base + done;
+            v->iov_len -= done;
+            }
+        }
+    for (i = 0; i < n; ++i)
+        chunks[i]->fill = 0;
+    }
+
+/* disk_io_take: unqueue the oldest chunk and any others of the same file
+ * so that each file is written in order and in as few writes as possible
+ */
+static int disk_io_take(struct disk_io *io, struct chunk **batch)
+    {
+    struct disk_writer *owner = io->queue_head->owner;
+    struct chunk **link = &io->queue_head, *chunk, *last = NULL;
+    int n = 0;
+
+    while ((chunk = *link))
+        {
+        if (chunk->owner == owner && n < MAX_BATCH)
+            {
+            batch[n++] = chunk;
+            *link = chunk->next;
+            }
+        else
+            {
+            last = chunk;
+            link = &chunk->next;
+            }
+        }
+    io->queue_tail = last;
+    return n;
+    }
+
+static void *disk_io_main(void *args)
+    {
+    struct disk_io *io = args;
+    struct chunk *batch[MAX_BATCH];
+    struct disk_writer *owner;
+    int n;
+
+    sig_mask_thread();
+    pthread_mutex_lock(&io->mutex);
+    for (;;)
+        {
+        while (!io->queue_head && !io->terminate)
+            pthread_cond_wait(&io->cv, &io->mutex);
+        if (!io->queue_head)
+            break;
+        n = disk_io_take(io, batch);
+        owner = batch[0]->owner;
+        pthread_mutex_unlock(&io->mutex);
+
+        disk_writer_write_chunks(owner, batch, n);
+
+        pthread_mutex_lock(&io->mutex);
+        owner->pending -= n;
+        while (n--)
+            {
+            batch[n]->next = owner->free_chunks;
+            owner->free_chunks = batch[n];
+            }
+        pthread_cond_broadcast(&io->cv);
+        }
+    pthread_mutex_unlock(&io->mutex);
+    return NULL;
+    }
+
+/* disk_writer_hand_over: pass the current chunk on for writing and get an empty one to fill */
+static int disk_writer_hand_over(struct disk_writer *self)
+    {
+    struct chunk *chunk = self->current;
+    struct disk_io *io = self->io;
+
+    if (!io)
+        {
+        disk_writer_write_chunks(self, &chunk, 1);
+        return self->failed ? FAILED : SUCCEEDED;
+        }
+
+    pthread_mutex_lock(&io->mutex);
+    chunk->next = NULL;
+    chunk->owner = self;
+    if (io->queue_tail)
+        io->queue_tail->next = chunk;
+    else
+        io->queue_head = chunk;
+    io->queue_tail = chunk;
+    self->pending++;
+    pthread_cond_broadcast(&io->cv);
+
+    /* a slow disk is soaked up by allocating more chunks, up to a point */
+    while (!self->free_chunks)
+        {
+        if (self->n_chunks < max_chunks && (self->free_chunks = chunk_new()))
+            {
+            self->n_chunks++;
+            break;
+            }
+        pthread_cond_wait(&io->cv, &io->mutex);
+        }
+    self->current = self->free_chunks;
+    self->free_chunks = self->current->next;
+    self->current->next = NULL;
+    self->current->fill = 0;
+    pthread_mutex_unlock(&io->mutex);
+    return self->failed ? FAILED : SUCCEEDED;
+    }
+
+/* disk_writer_shared_io: the thread all writers may share, started when first wanted and kept */
+static struct disk_io *disk_writer_shared_io()
+    {
+    struct disk_io *io = &shared_io;
+    pthread_attr_t attr;
+    int rv;
+
+    pthread_mutex_lock(&io->mutex);
+    if (!io->started)
+        {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if ((rv = pthread_create(&io->thread_h, &attr, disk_io_main, io)))
+            fprintf(stderr, "disk_writer_shared_io: pthread_create failed with error %d\n", rv);
+        else
+            io->started = TRUE;
+        pthread_attr_destroy(&attr);
+        }
+    pthread_mutex_unlock(&io->mutex);
+    return io->started ? io : NULL;
+    }
+
+struct disk_writer *disk_writer_open(const char *pathname)
+    {
+    struct disk_writer *self;
+    const char *mode;
+    int rv;
+
+    if (!(self = calloc(1, sizeof (struct disk_writer))))
+        {
+        fprintf(stderr, "disk_writer_open: malloc failure\n");
+        return NULL;
+        }
+    if (!(self->current = chunk_new()))
+        {
+        fprintf(stderr, "disk_writer_open: malloc failure\n");
+        free(self);
+        return NULL;
+        }
+    self->n_chunks = 1;
+    if ((self->fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+        {
+        fprintf(stderr, "disk_writer_open: failed to open %s: %s\n", pathname, strerror(errno));
+        chunk_free_list(self->current);
+        free(self);
+        return NULL;
+        }
+#ifndef USE_BSD_COMPAT
+    self->can_allocate = TRUE;
+    if (env_true("recorder_direct_io"))
+        {
+        if (fcntl(self->fd, F_SETFL, fcntl(self->fd, F_GETFL) | O_DIRECT) < 0)
+            perror("disk_writer_open: direct i/o unavailable");
+        else
+            self->direct = TRUE;
+        }
+#endif
+
+    if ((mode = getenv("recorder_io_thread")) && !strcmp(mode, "shared"))
+        {
+        if (!(self->io = disk_writer_shared_io()))
+            fprintf(stderr, "disk_writer_open: writing from the recorder thread\n");
+        }
+    else if (env_true("recorder_io_thread"))
+        {
+        struct disk_io *io = &self->own_io;
+
+        pthread_mutex_init(&io->mutex, NULL);
+        pthread_cond_init(&io->cv, NULL);
+        if ((rv = pthread_create(&io->thread_h, NULL, disk_io_main, io)))
+            {
+            fprintf(stderr, "disk_writer_open: pthread_create failed with error %d, writing from the recorder thread\n", rv);
+            pthread_cond_destroy(&io->cv);
+            pthread_mutex_destroy(&io->mutex);
+            }
+        else
+            self->io = io;
+        }
+    return self;
+    }
+
+int disk_writer_write(struct disk_writer *self, const void *data, size_t size)
+    {
+    const char *p = data;
+    size_t n;
+
+    while (size)
+        {
+        if (self->current->fill == CHUNK_SIZE && !disk_writer_hand_over(self))
+            return FAILED;
+        n = CHUNK_SIZE - self->current->fill;
+        if (n > size)
+            n = size;
+        memcpy(self->current->data + self->current->fill, p, n);
+        self->current->fill += n;
+        self->size += n;
+        p += n;
+        size -= n;
+        }
+    return self->failed ? FAILED : SUCCEEDED;
+    }
+
+off_t disk_writer_tell(struct disk_writer *self)
+    {
+    return self->size;
+    }
+
+int disk_writer_close(struct disk_writer *self)
+    {
+    int rv;
+
+    if (self->io == &self->own_io)
+        {
+        pthread_mutex_lock(&self->io->mutex);
+        self->io->terminate = TRUE;
+        pthread_cond_broadcast(&self->io->cv);
+        pthread_mutex_unlock(&self->io->mutex);
+        pthread_join(self->io->thread_h, NULL);
+        pthread_cond_destroy(&self->io->cv);
+        pthread_mutex_destroy(&self->io->mutex);
+        }
+    else if (self->io)
+        {
+        /* the shared thread carries on for the others once this file's chunks are out */
+        pthread_mutex_lock(&self->io->mutex);
+        while (self->pending)
+            pthread_cond_wait(&self->io->cv, &self->io->mutex);
+        pthread_mutex_unlock(&self->io->mutex);
+        }
+    /* the queue is empty now so the partial chunk is the last thing to go */
+    if (self->current->fill)
+        disk_writer_write_chunks(self, &self->current, 1);
+
+    /* preallocated space past the end of the file is handed back */
+    if (self->allocated > self->size && ftruncate(self->fd, self->size) < 0)
+        perror("disk_writer_close: ftruncate");
+    if (close(self->fd) < 0)
+        {
+        perror("disk_writer_close: close");
+        self->failed = TRUE;
+        }
+
+    rv = self->failed ? FAILED : SUCCEEDED;
+    chunk_free_list(self->current);
+    chunk_free_list(self->free_chunks);
+    free(self);
+    return rv;
+    }
@@ -0,0 +1,45 @@
+/*
+#   diskwriter.h: write-behind file output for recordings
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISKWRITER_H
+#define DISKWRITER_H
+
+#include <sys/types.h>
+
+struct disk_writer;
+
+/* disk_writer_open: create or truncate pathname for writing
+ * data is collected into large aligned chunks and written out whole, the file
+ * being preallocated ahead of the writes where the filesystem allows
+ * $recorder_io_thread moves the writes onto a thread of their own, or with the value
+ * "shared" onto one thread for all the recorders so that the disk sees a single ordered
+ * stream of large writes, and $recorder_direct_io has them bypass the page cache
+ */
+struct disk_writer *disk_writer_open(const char *pathname);
+
+/* disk_writer_write: append data, returns FAILED once any write has failed */
+int disk_writer_write(struct disk_writer *self, const void *data, size_t size);
+
+/* disk_writer_tell: the length of the file once everything is written */
+off_t disk_writer_tell(struct disk_writer *self);
+
+/* disk_writer_close: write out what remains, trim the preallocation and free self */
+int disk_writer_close(struct disk_writer *self);
+
+#endif /* DISKWRITER_H */
@@ -49,6 +49,9 @@ static int (*format_none)(mpg123_handle *);
 static int (*param)(mpg123_handle *, int, long, double);
 static int (*init)();
 static int (*decode_frame)(mpg123_handle *, off_t *, unsigned char **, size_t *);
+static int (*index)(mpg123_handle *, off_t **, off_t *, size_t *);
+static int (*set_index)(mpg123_handle *, off_t *, off_t, size_t);
+static int (*scan)(mpg123_handle *);
 
 static void dyn_mpg123_close()
     {
@@ -78,7 +81,10 @@ int dyn_mpg123_init()
                 (format_none = dlsym(handle, "mpg123_format_none")) &&
                 (param = dlsym(handle, "mpg123_param2")) &&
                 (init = dlsym(handle, "mpg123_init")) &&
-                (decode_frame = dlsym(handle, "mpg123_decode_frame"))))
+                (decode_frame = dlsym(handle, "mpg123_decode_frame")) &&
+                (index = dlsym(handle, "mpg123_index")) &&
+                (set_index = dlsym(handle, "mpg123_set_index")) &&
+                (scan = dlsym(handle, "mpg123_scan"))))
         {
         fprintf(stderr, "dyn_mpg123_init: missing symbol in %s: %s\n", libname, dlerror());
         return 0;
@@ -152,5 +158,20 @@ int mpg123_decode_frame(mpg123_handle *mh, off_t *num, unsigned char **audio, si
     {
     return decode_frame(mh, num, audio, bytes);
     }
+
+int mpg123_index(mpg123_handle *mh, off_t **offsets, off_t *step, size_t *fill)
+    {
+    return index(mh, offsets, step, fill);
+    }
+
+int mpg123_set_index(mpg123_handle *mh, off_t *offsets, off_t step, size_t fill)
+    {
+    return set_index(mh, offsets, step, fill);
+    }
+
+int mpg123_scan(mpg123_handle *mh)
+    {
+    return scan(mh);
+    }
     
 #endif /* DYN_MPG123 */
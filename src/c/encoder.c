@@ -23,8 +23,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
 #include <jack/ringbuffer.h>
 #include "sourceclient.h"
 #include "sig.h"
@@ -38,15 +41,20 @@
 #include "live_aac_encoder.h"
 #include "bsdcompat.h"
 #include "main.h"
+#include "evloop.h"
 #ifdef DYN_LAME
 #include "dyn_lame.h"
 #endif
+#include "replay.h"
 
 #define RS_INPUT_SAMPLES 512
+#define RS_OUTPUT_SAMPLES 2048
 
 typedef jack_default_audio_sample_t sample_t;
 
-static const size_t rb_n_samples = 53000;       /* maximum number of samples to hold in the ring buffer */
+static const size_t packet_ring_size = 262144;  /* shared encoder output ring, a power of two */
+static const size_t rb_n_samples = 53000;       /* default number of samples to hold in the ring buffer */
+static const size_t ip_pool_block_samples = 8192;  /* sized for the largest live encoder request */
 static uint32_t encoder_packet_magic_number = 'I' << 24 | 'D' << 16 | 'J' << 8 | 'C';
 static const float fade_floor = 0.0003f;
 
@@ -145,6 +153,12 @@ static void encoder_free_input_ringbuffers(struct encoder *self)
     {
     struct timespec ms10 = { 0, 10000000 };
 
+    if (self->rs_feed)
+        {
+        audio_feed_resampled_unsubscribe(self->rs_feed, &self->afdata);
+        self->rs_feed = NULL;
+        }
+
     if (self->afdata.jack_dataflow_control == JD_ON)
         self->afdata.jack_dataflow_control = JD_FLUSH;
     while (self->afdata.jack_dataflow_control != JD_OFF)
@@ -159,14 +173,8 @@ static void encoder_free_input_ringbuffers(struct encoder *self)
 
 static void encoder_free_resampler(struct encoder *self)
     {
-    int i;
-
-    for (i = 0; i < 2; i++)
-        if (self->src_state[i])
-            {
-            src_delete(self->src_state[i]);
-            self->src_state[i] = NULL;
-            }
+    if (self->src_state)
+        self->src_state = src_delete(self->src_state);
     }
 
 static void encoder_plugin_terminate(struct encoder *self)
@@ -180,11 +188,52 @@ static void encoder_plugin_terminate(struct encoder *self)
         nanosleep(&ms10, NULL);
     }
 
+static void encoder_free_ip_pool(struct encoder *self)
+    {
+    struct encoder_ip_data *id;
+    int i;
+
+    for (id = self->ip_pool; id < self->ip_pool + ENCODER_IP_POOL_SIZE; id++)
+        {
+        if (id->in_use)
+            fprintf(stderr, "encoder_free_ip_pool: input data block still in use\n");
+        for (i = 0; i < 2; i++)
+            if (id->pool_buffer[i])
+                {
+                free(id->pool_buffer[i]);
+                id->pool_buffer[i] = NULL;
+                }
+        id->pooled = id->in_use = FALSE;
+        }
+    }
+
+/* encoder_alloc_ip_pool: preallocate input data blocks so the encode loop needn't */
+static int encoder_alloc_ip_pool(struct encoder *self)
+    {
+    struct encoder_ip_data *id;
+    int i;
+
+    for (id = self->ip_pool; id < self->ip_pool + ENCODER_IP_POOL_SIZE; id++)
+        {
+        for (i = 0; i < self->n_channels; i++)
+            if (!(id->pool_buffer[i] = malloc(ip_pool_block_samples * sizeof (sample_t))))
+                {
+                fprintf(stderr, "encoder_alloc_ip_pool: malloc failure\n");
+                encoder_free_ip_pool(self);
+                return FAILED;
+                }
+        id->pooled = TRUE;
+        id->in_use = FALSE;
+        }
+    return SUCCEEDED;
+    }
+
 static void encoder_unlink(struct encoder *self)
     {
     encoder_plugin_terminate(self);
     encoder_free_input_ringbuffers(self);
     encoder_free_resampler(self);
+    encoder_free_ip_pool(self);
     }
 
 static long encoder_input_rb_mono_downmix(jack_ringbuffer_t **rb, float *bptr, int max_samples)
@@ -215,27 +264,150 @@ static long encoder_input_rb_mono_downmix(jack_ringbuffer_t **rb, float *bptr, i
     return n_samples;
     }
 
-static long encoder_input_rb_stereo(jack_ringbuffer_t **rb, float **dest, long max_samples)
+/* encoder_gain_kernel: dest = a, or the average of a and b, times pregain and a falling fade
+ * the fade recurrence is spread over four lanes so the loop body has no serial dependency
+ * and vectorises, lanes are rotated after a short tail so the next segment carries on from here
+ */
+static void encoder_gain_kernel(float *restrict dest, const sample_t *restrict a, const sample_t *restrict b, long n, float pregain, float *restrict lane, float step)
     {
-    long n_samples;
-    int i;
+    long i = 0, r;
+    float tmp[4];
 
-    n_samples = jack_ringbuffer_read_space(rb[1]) / sizeof (sample_t);
-    if (n_samples > max_samples)
-        n_samples = max_samples;
-    for (i = 0; i < 2; i++, rb++, dest++)
-        jack_ringbuffer_read(*rb, (char *)*dest, n_samples * sizeof (sample_t));
+    if (b)
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                {
+                dest[i + j] = (a[i + j] + b[i + j]) * 0.5F * pregain * lane[j];
+                lane[j] *= step;
+                }
+    else
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                {
+                dest[i + j] = a[i + j] * pregain * lane[j];
+                lane[j] *= step;
+                }
+
+    if ((r = n - i))
+        {
+        for (int j = 0; j < r; j++)
+            {
+            dest[i + j] = (b ? (a[i + j] + b[i + j]) * 0.5F : a[i + j]) * pregain * lane[j];
+            lane[j] *= step;
+            }
+        for (int j = 0; j < 4; j++)
+            tmp[j] = lane[(j + r) & 3];
+        memcpy(lane, tmp, sizeof tmp);
+        }
+    }
+
+/* encoder_rb_vector_at: pointer to sample pos of a ringbuffer read vector, and how many follow it contiguously */
+static const sample_t *encoder_rb_vector_at(jack_ringbuffer_data_t *v, long pos, long *avail)
+    {
+    long len0 = v[0].len / sizeof (sample_t);
+
+    if (pos < len0)
+        {
+        *avail = len0 - pos;
+        return (sample_t *)v[0].buf + pos;
+        }
+    *avail = v[1].len / sizeof (sample_t) - (pos - len0);
+    return (sample_t *)v[1].buf + (pos - len0);
+    }
+
+/* encoder_input_read: ringbuffers to codec ready buffers with the downmix, pregain and fade in one pass
+ * works directly on the ringbuffer segments so there is no intermediate copy
+ */
+static long encoder_input_read(struct encoder *encoder, float **dest, long max_samples, int mono_feed)
+    {
+    jack_ringbuffer_t **rb = encoder->afdata.input_rb;
+    jack_ringbuffer_data_t rbvec[2][2];
+    int downmix = encoder->n_channels == 1 && !mono_feed;
+    int n_src = (encoder->n_channels == 2 || downmix) ? 2 : 1;
+    long n_samples = max_samples, avail, avail_b, seg;
+    float lane0[4], lane[4], step, step4, fgain;
+    const sample_t *a, *b;
+
+    for (int c = 0; c < n_src; c++)
+        {
+        jack_ringbuffer_get_read_vector(rb[c], rbvec[c]);
+        if ((avail = (rbvec[c][0].len + rbvec[c][1].len) / sizeof (sample_t)) < n_samples)
+            n_samples = avail;
+        }
+
+    pthread_mutex_lock(&encoder->fade_mutex);
+    step = encoder->fadescale;
+    step4 = step * step * step * step;
+    lane0[0] = encoder->fadegain * step;
+    for (int j = 1; j < 4; j++)
+        lane0[j] = lane0[j - 1] * step;
+
+    for (int c = 0; c < encoder->n_channels; c++)
+        {
+        jack_ringbuffer_data_t *va = rbvec[downmix ? 0 : c];
+
+        memcpy(lane, lane0, sizeof lane);
+        for (long pos = 0; pos < n_samples; pos += seg)
+            {
+            a = encoder_rb_vector_at(va, pos, &avail);
+            b = downmix ? encoder_rb_vector_at(rbvec[1], pos, &avail_b) : NULL;
+            seg = n_samples - pos;
+            if (seg > avail)
+                seg = avail;
+            if (b && seg > avail_b)
+                seg = avail_b;
+            encoder_gain_kernel(dest[c] + pos, a, b, seg, encoder->pregain, lane, step4);
+            }
+        }
+
+    if (step != 1.0f)
+        {
+        /* lane[0] is one step ahead of the last sample written */
+        fgain = lane[0] / step;
+        if (fgain < fade_floor)
+            encoder->fadegain = encoder->fadescale = 1.0f;
+        else
+            encoder->fadegain = fgain;
+        }
+    pthread_mutex_unlock(&encoder->fade_mutex);
+
+    for (int c = 0; c < n_src; c++)
+        jack_ringbuffer_read_advance(rb[c], n_samples * sizeof (sample_t));
     return n_samples;
     }
 
-static long encoder_input_rb_one_channel(jack_ringbuffer_t **rb, float **dest, long max_samples, int c)
+/* encoder_input_rb_interleave: read from both ringbuffers into one two channel buffer */
+static long encoder_input_rb_interleave(jack_ringbuffer_t **rb, float *dest, long max_samples)
     {
-    long n_samples;
+    jack_ringbuffer_data_t rbvec0[2], rbvec1[2];
+    long n_samples, seg, remaining;
 
-    n_samples = jack_ringbuffer_read_space(rb[c]) / sizeof (sample_t);
-    if (n_samples > max_samples)
+    jack_ringbuffer_get_read_vector(rb[0], rbvec0);
+    jack_ringbuffer_get_read_vector(rb[1], rbvec1);
+    if ((n_samples = (rbvec1[0].len + rbvec1[1].len) / sizeof (sample_t)) > max_samples)
         n_samples = max_samples;
-    jack_ringbuffer_read(rb[c], (char *)dest[c], n_samples * sizeof (sample_t));
+
+    /* the two ringbuffers needn't wrap at the same place */
+    for (int c = 0; c < 2; c++)
+        {
+        jack_ringbuffer_data_t *v = c ? rbvec1 : rbvec0;
+        float *d = dest + c;
+
+        remaining = n_samples;
+        for (int part = 0; part < 2 && remaining; part++)
+            {
+            sample_t *src = (sample_t *)v[part].buf;
+
+            if ((seg = v[part].len / sizeof (sample_t)) > remaining)
+                seg = remaining;
+            for (long i = 0; i < seg; i++, d += 2)
+                *d = src[i];
+            remaining -= seg;
+            }
+        }
+
+    jack_ringbuffer_read_advance(rb[0], n_samples * sizeof (sample_t));
+    jack_ringbuffer_read_advance(rb[1], n_samples * sizeof (sample_t));
     return n_samples;
     }
 
@@ -244,18 +416,67 @@ static long encoder_resampler_get_data(void *cb_data, float **data)
     struct encoder *encoder = cb_data;
     long n_samples;
 
-    if (encoder->rs_channel >= 0)
-        {
-        n_samples = encoder_input_rb_one_channel(encoder->afdata.input_rb, encoder->rs_input, RS_INPUT_SAMPLES, encoder->rs_channel);
-        *data = encoder->rs_input[encoder->rs_channel];
-        }
+    if (encoder->n_channels == 2)
+        n_samples = encoder_input_rb_interleave(encoder->afdata.input_rb, encoder->rs_input, RS_INPUT_SAMPLES);
     else
+        n_samples = encoder_input_rb_mono_downmix(encoder->afdata.input_rb, encoder->rs_input, RS_INPUT_SAMPLES);
+
+    *data = encoder->rs_input;
+    return n_samples;
+    }
+
+/* encoder_resample: resample into separate channel buffers
+ * stereo is converted in one pass so the channels always get the same number of samples
+ */
+static size_t encoder_resample(struct encoder *encoder, float **dest, size_t n_samples)
+    {
+    size_t done = 0;
+    long got, chunk;
+
+    if (encoder->n_channels == 1)
+        return (size_t)src_callback_read(encoder->src_state, encoder->sr_conv_ratio, n_samples, dest[0]);
+
+    while (done < n_samples)
         {
-        n_samples = encoder_input_rb_mono_downmix(encoder->afdata.input_rb, encoder->rs_input[0], RS_INPUT_SAMPLES);
-        *data = encoder->rs_input[0];
+        chunk = (n_samples - done > RS_OUTPUT_SAMPLES) ? RS_OUTPUT_SAMPLES : n_samples - done;
+        if ((got = src_callback_read(encoder->src_state, encoder->sr_conv_ratio, chunk, encoder->rs_output)) <= 0)
+            break;
+        for (long i = 0; i < got; i++)
+            {
+            dest[0][done + i] = encoder->rs_output[2 * i];
+            dest[1][done + i] = encoder->rs_output[2 * i + 1];
+            }
+        done += got;
+        if (got < chunk)
+            break;
         }
 
-    return (long)n_samples;
+    return done;
+    }
+
+/* encoder_apply_gain: pregain and fade for buffers that did not come through encoder_input_read */
+static void encoder_apply_gain(struct encoder *encoder, float **buffer, int channels, size_t qty_samples)
+    {
+    pthread_mutex_lock(&encoder->fade_mutex);
+    if (encoder->pregain != 1.0f || encoder->fadescale != 1.0f)
+        {
+        float pgain = encoder->pregain;
+        float fgain = 1.0f, fscale = encoder->fadescale;
+
+        for (int i = 0; i < channels; ++i)
+            {
+            float *bp = buffer[i];
+            fgain = encoder->fadegain;
+            for (size_t s = qty_samples; s; --s)
+                *bp++ *= pgain * (fgain *= fscale);
+            }
+
+        if (fgain < fade_floor)
+            encoder->fadegain = encoder->fadescale = 1.0f;
+        else
+            encoder->fadegain = fgain;
+        }
+    pthread_mutex_unlock(&encoder->fade_mutex);
     }
 
 struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t min_samples_needed, size_t max_samples, float **caller_supplied_buffer)
@@ -268,11 +489,24 @@ struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t m
     if (max_samples == 0)
         return NULL;
 
-    if (!(id = calloc(1, sizeof (struct encoder_ip_data))))
+    /* try for a recycled block before resorting to the heap */
+    for (id = encoder->ip_pool; id < encoder->ip_pool + ENCODER_IP_POOL_SIZE; id++)
+        if (id->pooled && !id->in_use)
+            break;
+    if (id < encoder->ip_pool + ENCODER_IP_POOL_SIZE && (caller_supplied_buffer || max_samples <= ip_pool_block_samples))
         {
-        fprintf(stderr, "encoder_get_input_data: malloc failure\n");
-        return NULL;
+        id->in_use = TRUE;
+        id->qty_samples = 0;
+        id->caller_supplied_buffer = FALSE;
+        for (i = 0; i < 2; i++)
+            id->buffer[i] = id->pool_buffer[i];
         }
+    else
+        if (!(id = calloc(1, sizeof (struct encoder_ip_data))))
+            {
+            fprintf(stderr, "encoder_get_input_data: malloc failure\n");
+            return NULL;
+            }
     id->channels = encoder->n_channels;
     if (caller_supplied_buffer)
         {
@@ -281,7 +515,7 @@ struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t m
             id->buffer[i] = caller_supplied_buffer[i];
         id->caller_supplied_buffer = TRUE;
         }
-    else
+    else if (!id->pooled)
         {
         /* make our own buffer */
         for (i = 0; i < encoder->n_channels; i++)
@@ -293,12 +527,14 @@ struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t m
         }
     if (!encoder->resample_f)
         {
-        if (jack_ringbuffer_read_space(encoder->afdata.input_rb[1]) / sizeof (sample_t) < min_samples_needed)
+        /* a mono resampled feed is downmixed already and arrives in the first ringbuffer only */
+        int mono_feed = encoder->rs_feed && encoder->n_channels == 1;
+
+        if (encoder->rs_feed)
+            audio_feed_resampled_pump(encoder->rs_feed);
+        if (jack_ringbuffer_read_space(encoder->afdata.input_rb[!mono_feed]) / sizeof (sample_t) < min_samples_needed)
             goto no_data;
-        if (encoder->n_channels == 2)
-            id->qty_samples = encoder_input_rb_stereo(encoder->afdata.input_rb, id->buffer, max_samples);
-        else
-            id->qty_samples = encoder_input_rb_mono_downmix(encoder->afdata.input_rb, id->buffer[0], max_samples);
+        id->qty_samples = encoder_input_read(encoder, id->buffer, max_samples, mono_feed);
         }
     else
         {                 /* handle the resampling condition */
@@ -309,43 +545,14 @@ struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t m
             samples_available = max_samples;
         if (samples_available < min_samples_needed)
             goto no_data;
-        if (encoder->n_channels == 2)
-            {
-            encoder->rs_channel = 0;
-            id->qty_samples = (size_t)src_callback_read(encoder->src_state[0], encoder->sr_conv_ratio, samples_available, id->buffer[0]);
-            encoder->rs_channel = 1;
-            src_callback_read(encoder->src_state[1], encoder->sr_conv_ratio, id->qty_samples, id->buffer[1]);
-            }
-        else
-            {
-            encoder->rs_channel = -1;
-            id->qty_samples = (size_t)src_callback_read(encoder->src_state[0], encoder->sr_conv_ratio, samples_available, id->buffer[0]);
-            }
+        id->qty_samples = encoder_resample(encoder, id->buffer, samples_available);
         if (id->qty_samples == 0)
             goto no_data;
+        /* the fade is timed at the output rate so gain goes on after resampling */
+        encoder_apply_gain(encoder, id->buffer, id->channels, id->qty_samples);
         }
 
-    pthread_mutex_lock(&encoder->fade_mutex);
-    if (encoder->pregain != 1.0f || encoder->fadescale != 1.0f)
-        {
-        float pgain = encoder->pregain;
-        float fgain = 1.0f, fscale = encoder->fadescale;
-
-        for (int i = 0; i < id->channels; ++i)
-            {
-            float *bp = id->buffer[i];
-            fgain = encoder->fadegain;
-            for (size_t s = id->qty_samples; s; --s)
-                *bp++ *= pgain * (fgain *= fscale);
-            }
-
-        if (fgain < fade_floor)
-            encoder->fadegain = encoder->fadescale = 1.0f;
-        else
-            encoder->fadegain = fgain;
-        }
-    pthread_mutex_unlock(&encoder->fade_mutex);
-
+    __atomic_add_fetch(&encoder->stats.samples, id->qty_samples, __ATOMIC_RELAXED);
     return id;
 
     no_data:
@@ -357,6 +564,12 @@ void encoder_ip_data_free(struct encoder_ip_data *id)
     {
     int i;
 
+    if (id->pooled)
+        {
+        id->in_use = FALSE;
+        return;
+        }
+
     if (!id->caller_supplied_buffer)
         for (i = 0; i < id->channels; i++)
             if (id->buffer[i])
@@ -364,92 +577,374 @@ void encoder_ip_data_free(struct encoder_ip_data *id)
     free(id);
     }
 
-/* note encoder.mutex must be locked before helper threads can safely traverse
-    encoder.output_chain to find the op structure to pass to this function */
-size_t encoder_write_packet(struct encoder_op *op, struct encoder_op_packet *packet)
+/* the packet ring is shared by all clients of an encoder
+ * positions are running byte counts, reduced modulo the ring size on access
+ * packet_ring_mutex must be held when calling these helpers
+ */
+static void packet_ring_write(struct encoder *enc, const void *data, size_t n)
     {
-    size_t packet_size, written;
+    size_t offset = enc->packet_ring_head & (packet_ring_size - 1);
+    size_t part = packet_ring_size - offset;
+
+    if (part > n)
+        part = n;
+    memcpy(enc->packet_ring + offset, data, part);
+    memcpy(enc->packet_ring, (const char *)data + part, n - part);
+    enc->packet_ring_head += n;
+    }
 
-    packet->header.magic = encoder_packet_magic_number;
-    packet->header.serial = op->encoder->oggserial;
-    packet_size = sizeof packet->header + packet->header.data_size;
-    while (packet_size > jack_ringbuffer_write_space(op->packet_rb))
+static void packet_ring_read(struct encoder *enc, uint64_t pos, void *data, size_t n)
+    {
+    size_t offset = pos & (packet_ring_size - 1);
+    size_t part = packet_ring_size - offset;
+
+    if (part > n)
+        part = n;
+    memcpy(data, enc->packet_ring + offset, part);
+    memcpy((char *)data + part, enc->packet_ring, n - part);
+    }
+
+/* packet_ring_skip: advance a client cursor past its oldest packet */
+static int packet_ring_skip(struct encoder_op *op)
+    {
+    struct encoder *enc = op->encoder;
+    struct encoder_op_packet_header header;
+
+    if (enc->packet_ring_head - op->read_pos < sizeof header)
+        return FALSE;
+    packet_ring_read(enc, op->read_pos, &header, sizeof header);
+    if (header.magic != encoder_packet_magic_number || enc->packet_ring_head - op->read_pos < sizeof header + header.data_size)
+        {
+        fprintf(stderr, "packet_ring_skip: bad packet, resynchronising\n");
+        op->read_pos = enc->packet_ring_head;
+        }
+    else
+        op->read_pos += sizeof header + header.data_size;
+    return TRUE;
+    }
+
+/* encoder_header_cache: keep a copy of the current serial's header packets */
+static void encoder_header_cache(struct encoder *enc, struct encoder_op_packet *packet, const struct iovec *iov, int iovcnt)
+    {
+    struct encoder_header_buffer *hb = enc->header_buffer;
+    size_t n = sizeof packet->header + packet->header.data_size;
+    char *newbuf;
+
+    if (!hb)
+        return;
+    if (!(packet->header.flags & PF_HEADER))
         {
-        if (jack_ringbuffer_read_space(op->packet_rb) == 0)
+        if (packet->header.flags & PF_FINAL)
+            hb->size = hb->complete = 0;
+        else if (packet->header.serial == hb->serial && hb->size)
+            hb->complete = TRUE;
+        return;
+        }
+
+    if ((packet->header.flags & PF_INITIAL) || packet->header.serial != hb->serial)
+        {
+        hb->size = hb->complete = 0;
+        hb->serial = packet->header.serial;
+        }
+    if (hb->size + n > hb->capacity)
+        {
+        if (!(newbuf = realloc(hb->data, hb->size + n)))
             {
-            fprintf(stderr, "encoder_write_packet: packet too big to fit in the ringbuffer\n");
-            return 0;
+            fprintf(stderr, "encoder_header_cache: malloc failure\n");
+            hb->size = hb->complete = 0;
+            return;
             }
-        encoder_client_free_packet(encoder_client_get_packet(op)); /* flush stale packets */
-        op->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
+        hb->data = newbuf;
+        hb->capacity = hb->size + n;
+        }
+    memcpy(hb->data + hb->size, &packet->header, sizeof packet->header);
+    hb->size += sizeof packet->header;
+    for (int i = 0; i < iovcnt; ++i)
+        {
+        memcpy(hb->data + hb->size, iov[i].iov_base, iov[i].iov_len);
+        hb->size += iov[i].iov_len;
         }
-    pthread_mutex_lock(&op->mutex);
-    written = jack_ringbuffer_write(op->packet_rb, (char *)&packet->header, sizeof packet->header);
-    written += jack_ringbuffer_write(op->packet_rb, (char *)packet->data, packet->header.data_size);
-    pthread_mutex_unlock(&op->mutex);
-    return written;
     }
 
+/* encoder_write_packet_all: append a packet to the ring for all clients to read
+ * clients that have fallen too far behind lose their oldest packets
+ */
 void encoder_write_packet_all(struct encoder *encoder, struct encoder_op_packet *packet)
+    {
+    struct iovec iov = { packet->data, packet->header.data_size };
+
+    encoder_write_packet_allv(encoder, packet, &iov, 1);
+    }
+
+/* encoder_write_packet_allv: as above with the payload gathered from pieces
+ * an Ogg page goes in as its header and body straight from libogg's buffers
+ * the data_size is filled in here from the lengths of the pieces
+ */
+void encoder_write_packet_allv(struct encoder *encoder, struct encoder_op_packet *packet, const struct iovec *iov, int iovcnt)
     {
     struct encoder_op *iter;
-    struct timespec ms10 = { 0, 10000000 };
+    size_t packet_size;
 
-    while (pthread_mutex_trylock(&encoder->mutex))
-        nanosleep(&ms10, NULL);
+    packet->header.data_size = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        packet->header.data_size += iov[i].iov_len;
+    packet->header.magic = encoder_packet_magic_number;
+    packet->header.capture_usecs = 0;
+    if (audio_feed_latency_probe && !(packet->header.flags & (PF_HEADER | PF_METADATA)))
+        {
+        packet->header.capture_usecs = audio_feed_capture_time(&encoder->afdata, encoder->probe_frame);
+        encoder->probe_frame = audio_feed_frames_consumed(&encoder->afdata);
+        }
+    packet->header.serial = encoder->oggserial;
+    packet_size = sizeof packet->header + packet->header.data_size;
+    if (packet_size > packet_ring_size)
+        {
+        fprintf(stderr, "encoder_write_packet_all: packet too big to fit in the ringbuffer\n");
+        return;
+        }
+
+    /* the output chain is only changed with the ring lock held so it is walked under it */
+    pthread_mutex_lock(&encoder->packet_ring_mutex);
     for (iter = encoder->output_chain; iter; iter = iter->next)
-        encoder_write_packet(iter, packet);
-    pthread_mutex_unlock(&encoder->mutex);
+        {
+        rbstat_sample(&iter->rb_stats, encoder->packet_ring_head - iter->read_pos, packet_ring_size);
+        while (encoder->packet_ring_head + packet_size - iter->read_pos > packet_ring_size && packet_ring_skip(iter))
+            {
+            iter->packets_dropped++;
+            iter->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
+            rbstat_overrun(&iter->rb_stats);
+            }
+        }
+    packet_ring_write(encoder, &packet->header, sizeof packet->header);
+    for (int i = 0; i < iovcnt; ++i)
+        packet_ring_write(encoder, iov[i].iov_base, iov[i].iov_len);
+    encoder_header_cache(encoder, packet, iov, iovcnt);
+    pthread_cond_broadcast(&encoder->packet_ring_cv);
+    for (iter = encoder->output_chain; iter; iter = iter->next)
+        if (iter->notify_fd >= 0)
+            {
+            uint64_t one = 1;
+
+            if (write(iter->notify_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+                perror("encoder_write_packet_all: notify");
+            }
+    pthread_mutex_unlock(&encoder->packet_ring_mutex);
+    if (encoder->replay)
+        replay_write(encoder->replay, &packet->header, iov, iovcnt);
+    __atomic_add_fetch(&encoder->stats.packets, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&encoder->stats.bytes, packet->header.data_size, __ATOMIC_RELAXED);
     }
 
-struct encoder_op_packet *encoder_client_get_packet(struct encoder_op *op)
+/* encoder_client_read_header: hand out the next cached header packet after attaching */
+static struct encoder_op_packet *encoder_client_read_header(struct encoder_op *op)
     {
-    struct encoder_op_packet *packet;
+    struct encoder_op_packet *packet = &op->packet;
+    char *newbuf;
 
-    pthread_mutex_lock(&op->mutex);
-    if (jack_ringbuffer_read_space(op->packet_rb) >= sizeof (struct encoder_op_packet_header))
+    memcpy(&packet->header, op->attach_headers + op->attach_pos, sizeof packet->header);
+    op->attach_pos += sizeof packet->header;
+    if (packet->header.data_size > op->packet_buffer_size)
         {
-        if (!(packet = calloc(1, sizeof (struct encoder_op_packet))))
+        if (!(newbuf = realloc(op->packet_buffer, packet->header.data_size)))
             {
-            fprintf(stderr, "encoder_client_get_packet: malloc failure\n");
-            goto unlock;
+            fprintf(stderr, "encoder_client_read_header: malloc failure for data buffer\n");
+            free(op->attach_headers);
+            op->attach_headers = NULL;
+            return NULL;
             }
-        jack_ringbuffer_read(op->packet_rb, (char *)packet, sizeof (struct encoder_op_packet_header));
+        op->packet_buffer = newbuf;
+        op->packet_buffer_size = packet->header.data_size;
+        }
+    memcpy(op->packet_buffer, op->attach_headers + op->attach_pos, packet->header.data_size);
+    op->attach_pos += packet->header.data_size;
+    packet->data = packet->header.data_size ? op->packet_buffer : NULL;
+    if (op->attach_pos >= op->attach_size)
+        {
+        free(op->attach_headers);
+        op->attach_headers = NULL;
+        }
+    return packet;
+    }
+
+/* encoder_packet_boundary: the offset in the packet of the first place a file or listener may start or -1
+ * that is an Ogg page that doesn't continue a packet, a WebM cluster or an mpeg audio or adts frame header
+ * an encoder that knows where its packets start flags them PF_SYNC and the search is skipped
+ */
+ssize_t encoder_packet_boundary(const struct encoder_op_packet *packet)
+    {
+    static const unsigned char cluster_id[] = { 0x1F, 0x43, 0xB6, 0x75 };
+    const unsigned char *p = packet->data;
+    size_t n = packet->header.data_size, i;
+
+    if (!p)
+        return -1;
+    if (packet->header.flags & PF_SYNC)
+        return 0;
+    if (packet->header.flags & PF_OGG)
+        return (n > 5 && !(p[5] & 0x01)) ? 0 : -1;
+    if (packet->header.flags & PF_WEBM)
+        {
+        for (i = 0; i + sizeof cluster_id <= n; i++)
+            if (!memcmp(p + i, cluster_id, sizeof cluster_id))
+                return i;
+        return -1;
+        }
+    for (i = 0; i + 4 <= n; i++)
+        {
+        if (p[i] != 0xFF)
+            continue;
+        /* adts: mpeg-4 or mpeg-2, layer 0, valid sampling frequency index */
+        if ((p[i + 1] & 0xF6) == 0xF0 && ((p[i + 2] >> 2) & 0xF) < 13)
+            return i;
+        /* mpeg audio: version, layer, bitrate and sample rate all valid */
+        if ((p[i + 1] & 0xE0) == 0xE0 && ((p[i + 1] >> 3) & 3) != 1 && ((p[i + 1] >> 1) & 3) != 0 &&
+                    (p[i + 2] >> 4) != 15 && (p[i + 2] >> 4) != 0 && ((p[i + 2] >> 2) & 3) != 3)
+            return i;
+        }
+    return -1;
+    }
+
+/* encoder_client_sync: whether an attached client may start on this packet
+ * Ogg pages that continue a packet are passed over and WebM data is trimmed to start at a cluster
+ */
+static int encoder_client_sync(struct encoder_op *op, struct encoder_op_packet *packet)
+    {
+    ssize_t offset;
+
+    /* a new serial or the end of this one needs nothing before it */
+    if (packet->header.serial != op->attach_serial || (packet->header.flags & (PF_HEADER | PF_FINAL)))
+        return TRUE;
+    if (!(packet->header.flags & (PF_OGG | PF_WEBM)))
+        return TRUE;
+    if ((offset = encoder_packet_boundary(packet)) < 0)
+        return FALSE;
+    packet->data = (char *)packet->data + offset;
+    packet->header.data_size -= offset;
+    return TRUE;
+    }
+
+/* encoder_client_read_packet: take the next packet from the shared ring
+ * the packet returned belongs to op and is only valid until the next call
+ */
+struct encoder_op_packet *encoder_client_read_packet(struct encoder_op *op)
+    {
+    struct encoder *enc = op->encoder;
+    struct encoder_op_packet *packet = &op->packet;
+    struct encoder_op_packet *rv = NULL;
+    char *newbuf;
+
+    pthread_mutex_lock(&enc->packet_ring_mutex);
+    if (op->attach_headers)
+        {
+        rv = encoder_client_read_header(op);
+        goto unlock;
+        }
+    next:
+    if (enc->packet_ring_head - op->read_pos >= sizeof (struct encoder_op_packet_header))
+        {
+        packet_ring_read(enc, op->read_pos, &packet->header, sizeof (struct encoder_op_packet_header));
         if (packet->header.magic != encoder_packet_magic_number)
             {
-            fprintf(stderr, "encoder_client_get_packet: magic number missing\n");
-            free(packet);
+            fprintf(stderr, "encoder_client_read_packet: magic number missing\n");
+            op->read_pos = enc->packet_ring_head;
             goto unlock;
             }
-        if (jack_ringbuffer_read_space(op->packet_rb) < packet->header.data_size)
+        if (enc->packet_ring_head - op->read_pos < sizeof (struct encoder_op_packet_header) + packet->header.data_size)
             {
-            fprintf(stderr, "encoder_client_get_packet: packet header specifying more data than can fit in the buffer\n");
-            free(packet);
+            fprintf(stderr, "encoder_client_read_packet: packet header specifying more data than can fit in the buffer\n");
+            op->read_pos = enc->packet_ring_head;
             goto unlock;
             }
-        if (packet->header.data_size)
+        op->read_pos += sizeof (struct encoder_op_packet_header);
+        if (packet->header.data_size > op->packet_buffer_size)
             {
-            if (!(packet->data = malloc(packet->header.data_size)))
+            /* the buffer only grows so this settles down after the first few packets */
+            if (!(newbuf = realloc(op->packet_buffer, packet->header.data_size)))
                 {
-                fprintf(stderr, "encoder_client_get_packet: malloc failure for data buffer\n");
-                free(packet);
+                fprintf(stderr, "encoder_client_read_packet: malloc failure for data buffer\n");
+                op->read_pos += packet->header.data_size;
                 goto unlock;
                 }
-            jack_ringbuffer_read(op->packet_rb, packet->data, packet->header.data_size);
+            op->packet_buffer = newbuf;
+            op->packet_buffer_size = packet->header.data_size;
+            }
+        if (packet->header.data_size)
+            {
+            packet_ring_read(enc, op->read_pos, op->packet_buffer, packet->header.data_size);
+            op->read_pos += packet->header.data_size;
+            packet->data = op->packet_buffer;
+            }
+        else
+            packet->data = NULL;
+        if (op->attach_sync)
+            {
+            if (!encoder_client_sync(op, packet))
+                goto next;
+            op->attach_sync = FALSE;
             }
-        pthread_mutex_unlock(&op->mutex);
-        return packet;
+        rv = packet;
         }
     unlock:
-    pthread_mutex_unlock(&op->mutex);
-    return NULL;
+    pthread_mutex_unlock(&enc->packet_ring_mutex);
+    return rv;
     }
 
-void encoder_client_free_packet(struct encoder_op_packet *packet)
+/* encoder_client_discard_packet: skip over the oldest packet without reading it out */
+void encoder_client_discard_packet(struct encoder_op *op)
     {
-    if (packet->data)
-        free(packet->data);
-    free(packet);
+    pthread_mutex_lock(&op->encoder->packet_ring_mutex);
+    packet_ring_skip(op);
+    pthread_mutex_unlock(&op->encoder->packet_ring_mutex);
+    }
+
+/* encoder_client_wait_packet: block the client until a packet is ready or timeout_ms elapses
+ * returns TRUE when there is a packet to read
+ */
+int encoder_client_wait_packet(struct encoder_op *op, int timeout_ms)
+    {
+    struct encoder *enc = op->encoder;
+    struct timespec ts;
+    int ready;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    ts.tv_sec += timeout_ms / 1000 + ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+
+    pthread_mutex_lock(&enc->packet_ring_mutex);
+    while (!(ready = (enc->packet_ring_head != op->read_pos)))
+        if (pthread_cond_timedwait(&enc->packet_ring_cv, &enc->packet_ring_mutex, &ts))
+            break;
+    pthread_mutex_unlock(&enc->packet_ring_mutex);
+    return ready;
+    }
+
+/* encoder_client_set_notify: have each new packet also signal an eventfd for clients that poll */
+void encoder_client_set_notify(struct encoder_op *op, int fd)
+    {
+    pthread_mutex_lock(&op->encoder->packet_ring_mutex);
+    op->notify_fd = fd;
+    pthread_mutex_unlock(&op->encoder->packet_ring_mutex);
+    }
+
+/* encoder_client_catch_up: move the read cursor to the newest data, skipping the backlog unread */
+void encoder_client_catch_up(struct encoder_op *op)
+    {
+    pthread_mutex_lock(&op->encoder->packet_ring_mutex);
+    op->read_pos = op->encoder->packet_ring_head;
+    op->attach_sync = FALSE;
+    pthread_mutex_unlock(&op->encoder->packet_ring_mutex);
+    }
+
+/* encoder_client_backlog: the number of bytes of packet data the client has yet to read */
+size_t encoder_client_backlog(struct encoder_op *op)
+    {
+    size_t backlog;
+
+    pthread_mutex_lock(&op->encoder->packet_ring_mutex);
+    backlog = op->encoder->packet_ring_head - op->read_pos;
+    pthread_mutex_unlock(&op->encoder->packet_ring_mutex);
+    return backlog;
     }
 
 int encoder_client_set_flush(struct encoder_op *op)
@@ -466,13 +961,147 @@ int encoder_client_set_flush(struct encoder_op *op)
     return serial;
     }
 
+/* encoder_client_attach: join a running Ogg or WebM stream without flushing the encoder
+ * the client gets the cached headers then the live packets from the next page or cluster
+ * returns the serial the client starts on or -1 when a flush is needed instead
+ */
+int encoder_client_attach(struct encoder_op *op)
+    {
+    struct encoder *enc = op->encoder;
+    struct encoder_header_buffer *hb = enc->header_buffer;
+    int serial = -1;
+
+    if (enc->data_format.family != ENCODER_FAMILY_OGG && enc->data_format.family != ENCODER_FAMILY_WEBM)
+        return -1;
+
+    pthread_mutex_lock(&enc->packet_ring_mutex);
+    if (hb && hb->complete && hb->serial == enc->oggserial && enc->encoder_state == ES_RUNNING)
+        {
+        if ((op->attach_headers = malloc(hb->size)))
+            {
+            memcpy(op->attach_headers, hb->data, hb->size);
+            op->attach_size = hb->size;
+            op->attach_pos = 0;
+            op->attach_serial = serial = hb->serial;
+            op->attach_sync = TRUE;
+            op->read_pos = enc->packet_ring_head;
+            }
+        else
+            fprintf(stderr, "encoder_client_attach: malloc failure\n");
+        }
+    pthread_mutex_unlock(&enc->packet_ring_mutex);
+    return serial;
+    }
+
+/* encoder_config_signature: the encoder_vars that affect the encoded output
+ * in one string, encoders with equal signatures produce identical streams
+ */
+static char *encoder_config_signature(struct encoder_vars *ev)
+    {
+    char *fields[] = { ev->encode_source, ev->samplerate, ev->resample_quality, ev->family,
+                       ev->codec, ev->bitrate, ev->variability, ev->bitwidth, ev->quality,
+                       ev->complexity, ev->framesize, ev->latency_mode, ev->page_duration, ev->aac_encoder,
+                       ev->codec_threads, ev->mode, ev->metadata_mode, ev->standard, ev->pregain, ev->postgain,
+                       ev->filename, ev->offset };
+    size_t n = sizeof fields / sizeof fields[0], size = 1, i;
+    char *sig, *p;
+
+    for (i = 0; i < n; i++)
+        size += (fields[i] ? strlen(fields[i]) : 0) + 1;
+    if (!(sig = malloc(size)))
+        {
+        fprintf(stderr, "encoder_config_signature: malloc failure\n");
+        return NULL;
+        }
+    for (p = sig, i = 0; i < n; i++)
+        p += sprintf(p, "%s\n", fields[i] ? fields[i] : "");
+
+    return sig;
+    }
+
+/* encoder_find_twin: a running encoder configured exactly like sig */
+static struct encoder *encoder_find_twin(struct threads_info *ti, struct encoder *self, const char *sig)
+    {
+    struct encoder *other;
+
+    for (int i = 0; i < ti->n_encoders; i++)
+        {
+        other = ti->encoder[i];
+        if (other != self && !other->sharing && other->config_sig && !strcmp(other->config_sig, sig) &&
+                other->run_request_f && other->encoder_state == ES_RUNNING && other->fadescale == 1.0f)
+            return other;
+        }
+
+    return NULL;
+    }
+
+/* encoder_swap_slots: exchange the encoders behind two numeric ids
+ * the jack thread walks ti->encoder so a whole new array is published in one store
+ * and the old one is kept back as the spare for next time
+ * the spare isn't written until a walk that may have started on it has finished
+ */
+static void encoder_swap_slots(struct threads_info *ti, int a, int b)
+    {
+    struct encoder **old = ti->encoder, **new = ti->encoder_spare;
+    struct timespec us100 = { 0, 100000 };
+    unsigned epoch;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ((epoch = __atomic_load_n(&ti->encoder_walk_epoch, __ATOMIC_ACQUIRE)) & 1)
+        while (__atomic_load_n(&ti->encoder_walk_epoch, __ATOMIC_ACQUIRE) == epoch)
+            nanosleep(&us100, NULL);
+
+    memcpy(new, old, ti->n_encoders * sizeof (struct encoder *));
+    new[a] = old[b];
+    new[b] = old[a];
+    new[a]->numeric_id = a;
+    new[b]->numeric_id = b;
+    __atomic_store_n(&ti->encoder, new, __ATOMIC_RELEASE);
+    ti->encoder_spare = old;
+    }
+
+/* encoder_detach: undo encoder_start for the encoder in a given slot
+ * an encoder that others are sharing keeps running under one of their ids
+ */
+static void encoder_detach(struct threads_info *ti, int tab)
+    {
+    struct encoder *self = ti->encoder[tab];
+
+    if (self->sharing)
+        {
+        self->sharing->n_sharers--;
+        self->sharing = NULL;
+        }
+    else
+        if (self->n_sharers)
+            {
+            for (int i = 0; i < ti->n_encoders; i++)
+                if (ti->encoder[i]->sharing == self)
+                    {
+                    fprintf(stderr, "encoder_detach: encoder %d continues as encoder %d\n", tab, i);
+                    ti->encoder[i]->sharing = NULL;
+                    self->n_sharers--;
+                    encoder_swap_slots(ti, tab, i);
+                    break;
+                    }
+            self = ti->encoder[tab];
+            }
+        else
+            encoder_unlink(self);
+
+    if (self->config_sig)
+        {
+        free(self->config_sig);
+        self->config_sig = NULL;
+        }
+    }
+
 /* this is called from a recipient thread to obtain a handle for getting data */
 /* the numeric_id is the encoder that is requested */
 struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_id)
     {
     struct encoder *enc;
     struct encoder_op *op;
-    struct timespec ms10 = { 0, 10000000 };
 
     if (numeric_id >= ti->n_encoders || numeric_id < 0)
         {
@@ -484,32 +1113,33 @@ struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_
         fprintf(stderr, "encoder_register_client: malloc failure\n");
         return NULL;
         }
-    if (!(op->packet_rb = jack_ringbuffer_create(65536)))
-        {
-        fprintf(stderr, "encoder_register_client: malloc failure\n");
-        free(op);
-        return NULL;
-        }
     enc = ti->encoder[numeric_id];
+    if (enc->sharing)
+        enc = enc->sharing;
     op->encoder = enc;
-    pthread_mutex_init(&op->mutex, NULL);
-    while (pthread_mutex_trylock(&op->encoder->mutex))
-        nanosleep(&ms10, NULL);
+    op->notify_fd = -1;
+    pthread_mutex_lock(&enc->mutex);
+    /* a new client only gets to see packets from now on
+     * it is published under the ring lock so no packet goes by between the two
+     */
+    pthread_mutex_lock(&enc->packet_ring_mutex);
+    op->read_pos = enc->packet_ring_head;
     op->next = enc->output_chain;
     enc->output_chain = op;
+    pthread_mutex_unlock(&enc->packet_ring_mutex);
     enc->client_count++;
-    pthread_mutex_unlock(&op->encoder->mutex);
+    pthread_mutex_unlock(&enc->mutex);
     return op;
     }
 
 void encoder_unregister_client(struct encoder_op *op)
     {
     struct encoder_op *iter;
-    struct timespec ms10 = { 0, 10000000 };      /* ten milliseconds */
 
     fprintf(stderr, "encoder_unregister_client called\n");
-    while (pthread_mutex_trylock(&op->encoder->mutex))
-        nanosleep(&ms10, NULL);
+    pthread_mutex_lock(&op->encoder->mutex);
+    /* unlinked under the ring lock so no packet write can still be on op */
+    pthread_mutex_lock(&op->encoder->packet_ring_mutex);
     if ((iter = op->encoder->output_chain) == op)
         op->encoder->output_chain = op->next;
     else
@@ -518,54 +1148,301 @@ void encoder_unregister_client(struct encoder_op *op)
             iter = iter->next;
         iter->next = op->next;
         }
+    pthread_mutex_unlock(&op->encoder->packet_ring_mutex);
     op->encoder->client_count--;
     pthread_mutex_unlock(&op->encoder->mutex);
-    pthread_mutex_destroy(&op->mutex);
-    jack_ringbuffer_free(op->packet_rb);
+    if (op->packets_dropped)
+        fprintf(stderr, "encoder_unregister_client: client lost %u packets to overflow\n", op->packets_dropped);
+    if (op->packet_buffer)
+        free(op->packet_buffer);
+    if (op->attach_headers)
+        free(op->attach_headers);
     free(op);
     fprintf(stderr, "encoder_unregister_client finished\n");
     }
 
-void *encoder_main(void *args)
+/* the encoder worker pool
+ * every POOL_TICK_NS the encoders that aren't stopped are queued as jobs
+ * and any idle worker takes the next one so the load spreads itself
+ * across the workers, with no encoders running the workers just sleep
+ */
+#define POOL_TICK_NS 10000000
+
+static struct encoder_pool
+    {
+    struct threads_info *threads_info;
+    pthread_t *worker;
+    int n_workers;
+    int max_workers;
+    int terminate;
+    struct encoder **queue;         /* FIFO of ready encoders */
+    int queue_head;
+    int queue_len;
+    struct timespec next_tick;
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    } pool;
+
+static void encoder_run(struct encoder *self)
+    {
+    unsigned int n_overruns;
+    struct timespec t0, t1;
+    struct threadstat_sample usage;
+    enum encoder_state before;
+
+    pthread_mutex_lock(&self->flush_mutex);
+    before = self->encoder_state;
+    switch(self->encoder_state)
+        {
+        case ES_STOPPED:
+            break;
+        case ES_STARTING:
+        case ES_PAUSED:
+        case ES_RUNNING:
+        case ES_STOPPING:
+            threadstat_read(&usage);
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+            self->run_encoder(self);
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+            threadstat_add(&self->threadstat, &usage);
+            __atomic_add_fetch(&self->stats.cpu_ns, (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec, __ATOMIC_RELAXED);
+            break;
+        }
+    /* tell the interface when the encoder has come up or gone down */
+    if (self->encoder_state != before && (self->encoder_state == ES_RUNNING || self->encoder_state == ES_STOPPED))
+        evloop_post(EVLOOP_STATUS);
+    pthread_mutex_unlock(&self->flush_mutex);
+    if ((n_overruns = audio_feed_new_overruns(&self->afdata)))
+        {
+        self->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
+        fprintf(stderr, "encoder_run: encoder %d dropped %u periods of audio\n", self->numeric_id, n_overruns);
+        }
+    }
+
+/* encoder_pool_fill: queue up the encoders with work to do, pool.mutex held
+ * returns the number of encoders needing service
+ */
+static int encoder_pool_fill()
+    {
+    struct threads_info *ti = pool.threads_info;
+    struct encoder **encoder = __atomic_load_n(&ti->encoder, __ATOMIC_ACQUIRE);
+    int n_active = 0;
+
+    for (int i = 0; i < ti->n_encoders; i++)
+        if (encoder[i]->encoder_state != ES_STOPPED)
+            {
+            n_active++;
+            if (!encoder[i]->pool_queued)
+                {
+                encoder[i]->pool_queued = TRUE;
+                pool.queue[(pool.queue_head + pool.queue_len++) % ti->n_encoders] = encoder[i];
+                }
+            }
+
+    return n_active;
+    }
+
+static void *encoder_pool_worker(void *args)
     {
-    struct encoder *self = args;
-    struct timespec ms10 = { 0, 10000000 };      /* ten milliseconds */
+    static int n_named;
+    struct encoder *job;
+    struct timespec now;
+    char id[12];
 
     sig_mask_thread();
-    while(!self->thread_terminate_f)
+    snprintf(id, sizeof id, "pool %d", __atomic_fetch_add(&n_named, 1, __ATOMIC_RELAXED));
+    threadstat_name("encoder", id);
+    pthread_mutex_lock(&pool.mutex);
+    while (!pool.terminate)
         {
-        pthread_mutex_lock(&self->flush_mutex);
-        switch(self->encoder_state)
+        if (pool.queue_len)
             {
-            case ES_STOPPED:
-                break;
-            case ES_STARTING:
-            case ES_PAUSED:
-            case ES_RUNNING:
-            case ES_STOPPING:
-                self->run_encoder(self);
-                break;
+            job = pool.queue[pool.queue_head];
+            pool.queue_head = (pool.queue_head + 1) % pool.threads_info->n_encoders;
+            pool.queue_len--;
+            pthread_mutex_unlock(&pool.mutex);
+            encoder_run(job);
+            pthread_mutex_lock(&pool.mutex);
+            job->pool_queued = FALSE;
+            continue;
             }
-        pthread_mutex_unlock(&self->flush_mutex);
-        nanosleep(&ms10, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > pool.next_tick.tv_sec || (now.tv_sec == pool.next_tick.tv_sec && now.tv_nsec >= pool.next_tick.tv_nsec))
+            {
+            if (!encoder_pool_fill())
+                {
+                /* nothing to do until encoder_pool_wake */
+                pthread_cond_wait(&pool.cv, &pool.mutex);
+                continue;
+                }
+
+            /* don't try to catch up on ticks missed */
+            pool.next_tick = now;
+            if ((pool.next_tick.tv_nsec += POOL_TICK_NS) >= 1000000000)
+                {
+                pool.next_tick.tv_nsec -= 1000000000;
+                pool.next_tick.tv_sec++;
+                }
+            pthread_cond_broadcast(&pool.cv);
+            continue;
+            }
+
+        pthread_cond_timedwait(&pool.cv, &pool.mutex, &pool.next_tick);
         }
+    pthread_mutex_unlock(&pool.mutex);
     return NULL;
     }
 
+/* encoder_pool_wake: have the pool look for work right away */
+static void encoder_pool_wake()
+    {
+    pthread_mutex_lock(&pool.mutex);
+    pool.next_tick.tv_sec = pool.next_tick.tv_nsec = 0;
+    pthread_cond_broadcast(&pool.cv);
+    pthread_mutex_unlock(&pool.mutex);
+    }
+
+/* encoder_pool_pin: bind a worker to one of the CPUs listed in $encoder_cpus */
+static void encoder_pool_pin(pthread_t thread, int index)
+    {
+#ifndef USE_BSD_COMPAT
+    char *list = getenv("encoder_cpus"), *end;
+    int cpus[CPU_SETSIZE], n_cpus = 0;
+    long cpu;
+    cpu_set_t set;
+
+    if (!list)
+        return;
+    while (n_cpus < CPU_SETSIZE && (cpu = strtol(list, &end, 10), end != list))
+        {
+        if (cpu >= 0 && cpu < CPU_SETSIZE)
+            cpus[n_cpus++] = cpu;
+        list = end + strspn(end, ", ");
+        }
+    if (!n_cpus)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index % n_cpus], &set);
+    if (pthread_setaffinity_np(thread, sizeof set, &set))
+        fprintf(stderr, "encoder_pool_pin: failed to pin worker %d to cpu %d\n", index, cpus[index % n_cpus]);
+#endif
+    }
+
+/* encoder_pool_init: set up the pool of workers that run the encoders
+ * $encoder_threads sets how many, by default one per CPU up to the number of encoders
+ * the workers themselves are started when the first encoder is
+ */
+int encoder_pool_init(struct threads_info *ti)
+    {
+    char *env = getenv("encoder_threads");
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = env ? atoi(env) : 0;
+
+    if (n <= 0)
+        n = (n_cpus > 0) ? n_cpus : 1;
+    if (n > ti->n_encoders)
+        n = ti->n_encoders;
+
+    pool.threads_info = ti;
+    pool.terminate = FALSE;
+    pool.queue_head = pool.queue_len = 0;
+    pool.next_tick.tv_sec = pool.next_tick.tv_nsec = 0;
+    pool.queue = NULL;
+    pool.worker = NULL;
+    /* with no encoders configured there is an empty pool and nothing to allocate */
+    if (ti->n_encoders && !((pool.queue = calloc(ti->n_encoders, sizeof (struct encoder *))) &&
+                            (pool.worker = calloc(n, sizeof (pthread_t)))))
+        {
+        fprintf(stderr, "encoder_pool_init: malloc failure\n");
+        return FAILED;
+        }
+
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool.cv, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pool.n_workers = 0;
+    pool.max_workers = n;
+    return SUCCEEDED;
+    }
+
+/* encoder_pool_start: start the workers if this is the first time an encoder is run */
+static int encoder_pool_start()
+    {
+    int n_workers;
+
+    pthread_mutex_lock(&pool.mutex);
+    if (!pool.n_workers)
+        {
+        for (; pool.n_workers < pool.max_workers; pool.n_workers++)
+            {
+            if (pthread_create(&pool.worker[pool.n_workers], NULL, encoder_pool_worker, NULL))
+                {
+                fprintf(stderr, "encoder_pool_start: pthread_create call failed\n");
+                break;
+                }
+            encoder_pool_pin(pool.worker[pool.n_workers], pool.n_workers);
+            }
+        fprintf(stderr, "encoder_pool_start: %d worker threads for %d encoders\n", pool.n_workers, pool.threads_info->n_encoders);
+        }
+    n_workers = pool.n_workers;
+    pthread_mutex_unlock(&pool.mutex);
+    return n_workers ? SUCCEEDED : FAILED;
+    }
+
+void encoder_pool_destroy()
+    {
+    pthread_mutex_lock(&pool.mutex);
+    pool.terminate = TRUE;
+    pthread_cond_broadcast(&pool.cv);
+    pthread_mutex_unlock(&pool.mutex);
+
+    for (int i = 0; i < pool.n_workers; i++)
+        pthread_join(pool.worker[i], NULL);
+
+    pthread_mutex_destroy(&pool.mutex);
+    pthread_cond_destroy(&pool.cv);
+    free(pool.worker);
+    free(pool.queue);
+    }
+
 int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct encoder *self = ti->encoder[uv->tab];
     struct encoder_vars *ev = other;
     struct timespec ms10 = { 0, 10000000 };
     int (*encoder_init)(struct encoder *, struct encoder_vars *) = NULL;
-    int i, resample_mode, error;
+    struct encoder *twin;
+    int resample_mode, error;
 
-    if (self->encoder_state != ES_STOPPED)
+    if (self->encoder_state != ES_STOPPED || self->sharing)
         {
         fprintf(stderr, "encoder_start: encoder state out of control - shouldn't be marked as running\n");
         goto failed;
         }
 
+    if (!(self->config_sig = encoder_config_signature(ev)))
+        goto failed;
+
+    /* encode once for any number of identically configured encoders */
+    if (!strcmp(ev->encode_source, "jack") && (twin = encoder_find_twin(ti, self, self->config_sig)))
+        {
+        self->sharing = twin;
+        twin->n_sharers++;
+        fprintf(stderr, "encoder_start: encoder %d will share the output of encoder %d\n", self->numeric_id, twin->numeric_id);
+        return SUCCEEDED;
+        }
+
+    if (!encoder_pool_start())
+        goto failed;
+
+    if (self->replay)
+        replay_reset(self->replay);
     self->data_format = encoder_lex_format(ev->encode_source, ev->family, ev->codec);
 
     switch (self->data_format.source) {
@@ -673,36 +1550,47 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
     self->n_channels = strcmp(ev->mode, "mono") ? 2 : 1;
     if ((self->use_metadata = (strcmp(ev->metadata_mode, "suppressed") ? 1 : 0)))
         self->new_metadata = TRUE;
-    if (self->resample_f)
-        {
-        fprintf(stderr, "encoder_start: initiating resampler(s)\n");
-        resample_mode = encoder_get_resample_mode(ev->resample_quality);
-        for (i = 0; i < self->n_channels; i++)
-            {
-            if (!(self->src_state[i] = src_callback_new(encoder_resampler_get_data, resample_mode, 1, &error, self)))
-                goto failed;
-            src_set_ratio(self->src_state[i], self->sr_conv_ratio);
-            }
-        }
-    else
-        fprintf(stderr, "encoder_start: resampler will not be used\n");
+    if (!encoder_alloc_ip_pool(self))
+        goto failed;
 
     if (encoder_init && encoder_init(self, ev))
         {
         if (self->data_format.source == ENCODER_SOURCE_JACK)
             {
-            self->afdata.input_rb[0] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-            self->afdata.input_rb[1] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-            if (!(self->afdata.input_rb[0] && self->afdata.input_rb[1]))
+            if (!audio_feed_rb_create(&self->afdata, "encoder_rb_samples", rb_n_samples))
                 {
                 fprintf(stderr, "encoder_start: jack ringbuffer creation failure\n");
                 goto failed;
                 }
-            self->afdata.jack_dataflow_control = JD_ON;
+            self->probe_frame = 0;
+
+            if (self->resample_f)
+                {
+                resample_mode = encoder_get_resample_mode(ev->resample_quality);
+                /* encoders wanting the same conversion share it */
+                if ((self->rs_feed = audio_feed_resampled_subscribe(ti->audio_feed, &self->afdata, self->target_samplerate, resample_mode, self->n_channels)))
+                    {
+                    fprintf(stderr, "encoder_start: using a shared resampled feed\n");
+                    self->resample_f = FALSE;
+                    }
+                else
+                    {
+                    fprintf(stderr, "encoder_start: initiating resampler(s)\n");
+                    if (!(self->src_state = src_callback_new(encoder_resampler_get_data, resample_mode, self->n_channels, &error, self)))
+                        goto failed;
+                    src_set_ratio(self->src_state, self->sr_conv_ratio);
+                    }
+                }
+            else
+                fprintf(stderr, "encoder_start: resampler will not be used\n");
+
+            if (!self->rs_feed)
+                self->afdata.jack_dataflow_control = JD_ON;
             }
 
         self->run_request_f = TRUE;
         self->encoder_state = ES_STARTING;
+        encoder_pool_wake();
         while (self->encoder_state == ES_STARTING)
             nanosleep(&ms10, NULL);
         while (self->encoder_state == ES_STOPPING)
@@ -717,6 +1605,11 @@ int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *othe
         }
     failed:
     encoder_unlink(self);
+    if (self->config_sig)
+        {
+        free(self->config_sig);
+        self->config_sig = NULL;
+        }
     fprintf(stderr, "encoder_start: failed to start the encoder\n");
     return FAILED;
     }
@@ -725,25 +1618,87 @@ int encoder_stop(struct threads_info *ti, struct universal_vars *uv, void *other
     {
     struct encoder *self = ti->encoder[uv->tab];
 
-    encoder_unlink(self);
-    if (self->output_chain)
+    if (self->output_chain && !self->n_sharers)
         fprintf(stderr, "encoder_stop: function has been called with encoder_op objects still attached\n");
+    encoder_detach(ti, uv->tab);
     fprintf(stderr, "encoder_stop: encoder is stopped\n");
     return SUCCEEDED;
     }
 
 int encoder_update(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
-    struct encoder *self = ti->encoder[uv->tab];
-
-    encoder_unlink(self);
+    encoder_detach(ti, uv->tab);
     return encoder_start(ti, uv, other);
     }
 
+/* encoder_make_report: performance figures since the last report
+ * state:real time factor %:input ringbuffer fill %:packets/s:bytes/s:per client list:thread stats:input ringbuffer stats
+ * the real time factor is encoder cpu time as a percentage of the audio duration encoded
+ * each client is backlog/dropped/min/avg/max/high water mark/underruns/overruns of its place in the packet ring
+ * the thread stats are the pool workers' cpu%:voluntary/s:involuntary/s:jobs/s while running this encoder
+ * the input ringbuffer stats are min:avg:max:high water mark:underruns:overruns
+ */
+int encoder_make_report(struct encoder *self)
+    {
+    struct encoder *src = self->sharing ? self->sharing : self;
+    struct encoder_stats now, *prev = &self->stats_reported;
+    struct encoder_op *op;
+    struct timespec t;
+    jack_ringbuffer_t *rb = src->afdata.input_rb[0];
+    double interval, audio_s, rtf_pc = 0.0, packet_rate = 0.0, byte_rate = 0.0;
+    int fill_pc = 0;
+    char thread_stats[64], rb_stats[64];
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    now.cpu_ns = __atomic_load_n(&src->stats.cpu_ns, __ATOMIC_RELAXED);
+    now.samples = __atomic_load_n(&src->stats.samples, __ATOMIC_RELAXED);
+    now.packets = __atomic_load_n(&src->stats.packets, __ATOMIC_RELAXED);
+    now.bytes = __atomic_load_n(&src->stats.bytes, __ATOMIC_RELAXED);
+
+    /* a sharer's figures are relative to the last report made of it, or start afresh */
+    if (now.samples < prev->samples || now.packets < prev->packets)
+        memset(prev, 0, sizeof *prev);
+
+    interval = (t.tv_sec - self->report_time.tv_sec) + (t.tv_nsec - self->report_time.tv_nsec) / 1e9;
+    if (self->report_time.tv_sec && interval > 0.0)
+        {
+        if (src->target_samplerate && (audio_s = (double)(now.samples - prev->samples) / src->target_samplerate) > 0.0)
+            rtf_pc = (now.cpu_ns - prev->cpu_ns) / (audio_s * 1e7);
+        packet_rate = (now.packets - prev->packets) / interval;
+        byte_rate = (now.bytes - prev->bytes) / interval;
+        }
+    if (rb && src->encoder_state != ES_STOPPED)
+        fill_pc = (int)(jack_ringbuffer_read_space(rb) * 100 / rb->size);
+
+    fprintf(g.out, "idjcsc: encoder%dreport=%d:%.1f:%d:%.1f:%.0f:", self->numeric_id,
+                (int)src->encoder_state, rtf_pc, fill_pc, packet_rate, byte_rate);
+    pthread_mutex_lock(&src->mutex);
+    for (op = src->output_chain; op; op = op->next)
+        {
+        rbstat_format(&op->rb_stats, '/', rb_stats, sizeof rb_stats);
+        fprintf(g.out, "%s%zu/%u/%s", op == src->output_chain ? "" : ",", encoder_client_backlog(op), op->packets_dropped, rb_stats);
+        }
+    pthread_mutex_unlock(&src->mutex);
+    threadstat_format(&src->threadstat, &self->threadstat_reported, thread_stats, sizeof thread_stats);
+    rbstat_format(&src->afdata.rb_stats, ':', rb_stats, sizeof rb_stats);
+    fprintf(g.out, ":%s:%s\n", thread_stats, rb_stats);
+    fflush(g.out);
+
+    if (rtf_pc > 80.0)
+        fprintf(stderr, "encoder_make_report: encoder %d is using %.0f%% of real time\n", self->numeric_id, rtf_pc);
+    *prev = now;
+    self->report_time = t;
+    return SUCCEEDED;
+    }
+
 int encoder_initiate_fade(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct encoder *self = ti->encoder[uv->tab];
 
+    /* fading shared output would fade the other users' streams too */
+    if (self->sharing || self->n_sharers)
+        return SUCCEEDED;
+
     pthread_mutex_lock(&self->fade_mutex);
     if (self->fadescale == 1.0f)
         self->fadescale = powf(fade_floor, 1.f / (6.f * self->target_samplerate));
@@ -752,6 +1707,52 @@ int encoder_initiate_fade(struct threads_info *ti, struct universal_vars *uv, vo
     return SUCCEEDED;
     }
 
+/* encoder_replay_dump: save the last replay_seconds of output to replay_filename
+ * the file is written by a thread of its own so this returns straight away
+ */
+int encoder_replay_dump(struct threads_info *ti, struct universal_vars *uv, void *other)
+    {
+    struct encoder *self = ti->encoder[uv->tab];
+    struct encoder_vars *ev = other;
+    struct encoder_header_buffer *hb;
+    char *headers = NULL;
+    size_t headers_size = 0;
+    int headers_serial = -1, ok;
+
+    /* a sharing encoder's output is its twin's */
+    if (self->sharing)
+        self = self->sharing;
+    if (!self->replay)
+        {
+        fprintf(stderr, "encoder_replay_dump: no replay buffer, replay_buffer_s is not set\n");
+        return FAILED;
+        }
+    if (!ev->replay_filename || !*ev->replay_filename)
+        {
+        fprintf(stderr, "encoder_replay_dump: no filename given\n");
+        return FAILED;
+        }
+
+    pthread_mutex_lock(&self->packet_ring_mutex);
+    if ((hb = self->header_buffer) && hb->complete && hb->size)
+        {
+        if ((headers = malloc(hb->size)))
+            {
+            memcpy(headers, hb->data, hb->size);
+            headers_size = hb->size;
+            headers_serial = hb->serial;
+            }
+        else
+            fprintf(stderr, "encoder_replay_dump: malloc failure\n");
+        }
+    pthread_mutex_unlock(&self->packet_ring_mutex);
+
+    ok = replay_dump(self->replay, headers, headers_size, headers_serial,
+                (ev->replay_seconds && atof(ev->replay_seconds) > 0.0) ? atof(ev->replay_seconds) : 90.0, ev->replay_filename);
+    free(headers);
+    return ok ? SUCCEEDED : FAILED;
+    }
+
 int encoder_new_song_metadata(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct encoder *self;
@@ -830,9 +1831,11 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id)
         fprintf(stderr, "encoder_init: malloc failure\n");
         return NULL;
         }
-    self->rs_input[0] = malloc(RS_INPUT_SAMPLES * sizeof (sample_t));
-    self->rs_input[1] = malloc(RS_INPUT_SAMPLES * sizeof (sample_t));
-    if (!(self->rs_input[0] && self->rs_input[1]))
+    self->rs_input = malloc(2 * RS_INPUT_SAMPLES * sizeof (sample_t));
+    self->rs_output = malloc(2 * RS_OUTPUT_SAMPLES * sizeof (sample_t));
+    self->packet_ring = malloc(packet_ring_size);
+    self->header_buffer = calloc(1, sizeof (struct encoder_header_buffer));
+    if (!(self->rs_input && self->rs_output && self->packet_ring && self->header_buffer))
         {
         fprintf(stderr, "encoder_init: malloc failure\n");
         free(self);
@@ -849,27 +1852,33 @@ struct encoder *encoder_init(struct threads_info *ti, int numeric_id)
     pthread_mutex_init(&self->metadata_mutex, NULL);
     pthread_mutex_init(&self->flush_mutex, NULL);
     pthread_mutex_init(&self->fade_mutex, NULL);
-    if (pthread_create(&self->thread_h, NULL, encoder_main, self))
-        {
-        fprintf(stderr, "encoder_init: pthread_create call failed\n");
-        return NULL;
-        }
+    pthread_mutex_init(&self->packet_ring_mutex, NULL);
+    pthread_cond_init(&self->packet_ring_cv, NULL);
+    self->replay = replay_create(getenv("replay_buffer_s") ? atoi(getenv("replay_buffer_s")) : 0);
     /* the input ringbuffer will be allocated when the encoder is started */
     return self;
     }
 
 void encoder_destroy(struct encoder *self)
     {
-    self->thread_terminate_f = TRUE;
-    pthread_join(self->thread_h, NULL);
     pthread_mutex_destroy(&self->mutex);
     pthread_mutex_destroy(&self->metadata_mutex);
     pthread_mutex_destroy(&self->flush_mutex);
     pthread_mutex_destroy(&self->fade_mutex);
-    if (self->rs_input[0])
-        free(self->rs_input[0]);
-    if (self->rs_input[1])
-        free(self->rs_input[1]);
+    pthread_mutex_destroy(&self->packet_ring_mutex);
+    pthread_cond_destroy(&self->packet_ring_cv);
+    replay_destroy(self->replay);
+    if (self->packet_ring)
+        free(self->packet_ring);
+    if (self->header_buffer)
+        {
+        free(self->header_buffer->data);
+        free(self->header_buffer);
+        }
+    if (self->rs_input)
+        free(self->rs_input);
+    if (self->rs_output)
+        free(self->rs_output);
     if (self->custom_meta)
         free(self->custom_meta);
     if (self->artist)
@@ -878,5 +1887,7 @@ void encoder_destroy(struct encoder *self)
         free(self->title);
     if (self->album)
         free(self->album);
+    if (self->config_sig)
+        free(self->config_sig);
     free(self);
     }
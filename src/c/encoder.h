@@ -22,10 +22,14 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <samplerate.h>
 #include <jack/ringbuffer.h>
 #include <pthread.h>
 #include "sourceclient.h"
+#include "threadstat.h"
+#include "rbstat.h"
 
 enum performance_warning { PW_OK, PW_AUDIO_DATA_DROPPED };
 enum encoder_source {ENCODER_SOURCE_UNHANDLED, ENCODER_SOURCE_JACK, ENCODER_SOURCE_FILE};
@@ -42,7 +46,8 @@ enum packet_flags {     PF_UNSET    = 0x00,
                                 PF_MP2      = 0x40,
                                 PF_AAC      = 0x80,
                                 PF_AACP2    = 0x100,
-                                PF_WEBM     = 0x200 };
+                                PF_WEBM     = 0x200,
+                                PF_SYNC     = 0x400 };  /* starts where a listener may start, no search needed */
 
 struct encoder_vars
     {
@@ -57,6 +62,10 @@ struct encoder_vars
     char *quality;
     char *complexity;
     char *framesize;
+    char *latency_mode;          /* "low" for talkback use */
+    char *page_duration;         /* longest ogg page in ms, 0 for a page per packet */
+    char *aac_encoder;           /* libavcodec encoder name e.g. libfdk_aac, default picks one */
+    char *codec_threads;         /* libavcodec thread_count, 0 for automatic */
     char *mode;
     char *metadata_mode;
     char *standard;
@@ -68,6 +77,8 @@ struct encoder_vars
     char *artist;                /* used for ogg metadata - always utf-8 */
     char *title;
     char *album;
+    char *replay_seconds;        /* how much of the replay buffer to save, default 90 */
+    char *replay_filename;       /* where to save it */
     };
 
 struct encoder_data_format
@@ -83,8 +94,14 @@ struct encoder_ip_data
     int channels;
     size_t qty_samples;
     float *buffer[2];
+    int pooled;                   /* belongs to the encoder's input data pool */
+    int in_use;
+    float *pool_buffer[2];        /* the pool entry's own sample storage */
     };
 
+/* number of input data blocks preallocated per encoder */
+#define ENCODER_IP_POOL_SIZE 4
+
 struct encoder_op_packet_header
     {
     uint32_t magic;                      /* the magic number to check packet sync with */
@@ -95,6 +112,7 @@ struct encoder_op_packet_header
     enum packet_flags flags;             /* first, last, metadata, mp3, ogg, etc */
     int serial;                          /* the ogg serial number */
     double timestamp;                    /* time in seconds for this serial */
+    uint64_t capture_usecs;              /* jack time the oldest audio in it entered the mixer, 0 if not probing */
     size_t data_size;                    /* how much data follows in bytes */
     };
 
@@ -108,24 +126,47 @@ struct encoder_op                       /* encoder output object */
     {
     struct encoder *encoder;             /* parent encoder */
     struct encoder_op *next;             /* the next encoder output object */
-    jack_ringbuffer_t *packet_rb;        /* ringbuffer containing ogg or mp3 packets */
+    uint64_t read_pos;                   /* read cursor into the encoder packet ring */
+    unsigned int packets_dropped;        /* packets lost due to this client falling behind */
+    struct rbstat rb_stats;              /* its backlog in the packet ring as each packet is written */
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
-    pthread_mutex_t mutex;               /* this enables the encoder to expire old output packets safely */
+    struct encoder_op_packet packet;     /* reusable packet for encoder_client_read_packet */
+    char *packet_buffer;                 /* its data storage which grows as needed */
+    size_t packet_buffer_size;
+    char *attach_headers;                /* cached header packets yet to be read after attaching */
+    size_t attach_size;
+    size_t attach_pos;
+    int attach_serial;                   /* the serial joined mid-stream */
+    int attach_sync;                     /* skipping packets until a page or cluster boundary */
+    int notify_fd;                       /* eventfd to signal on each new packet or -1 */
+    };
+
+/* running totals for working out the real time factor and throughput */
+struct encoder_stats
+    {
+    uint64_t cpu_ns;                     /* thread cpu time spent in run_encoder */
+    uint64_t samples;                    /* input samples consumed */
+    uint64_t packets;                    /* packets written to the packet ring */
+    uint64_t bytes;                      /* packet payload bytes written */
     };
 
+/* the header packets of the current serial, kept in packet ring format
+ * so clients can join a running stream, guarded by packet_ring_mutex
+ */
 struct encoder_header_buffer
     {
     char *data;
-    size_t size;
-    pthread_mutex_t mutex;
+    size_t size;                         /* bytes in use */
+    size_t capacity;
+    int serial;                          /* the serial the headers belong to */
+    int complete;                        /* audio has followed the headers */
     };
 
 struct encoder
     {
     struct threads_info *threads_info;   /* link to the global data structure */
     int numeric_id;                      /* identitity of this encoder from 0 */
-    pthread_t thread_h;                  /* this encoder's pthread handle */
-    int thread_terminate_f;              /* signal the encoder thread to exit */
+    int pool_queued;                     /* waiting for or being run by a pool worker */
     int run_request_f;                   /* to run or not to run... */
     enum encoder_state encoder_state;    /* indicate what the encoder should be doing */
     struct audio_feed_data afdata;
@@ -138,17 +179,24 @@ struct encoder
     long samplerate;
     long target_samplerate;
     double sr_conv_ratio;
-    SRC_STATE *src_state[2];     /* resampler variables */
-    float *rs_input[2];          /* buffer used by resampler input callback */
-    int rs_channel;              /* resampler callback channel control */
+    SRC_STATE *src_state;        /* resampler for all channels at once */
+    float *rs_input;             /* interleaved buffer used by resampler input callback */
+    float *rs_output;            /* interleaved resampler output awaiting deinterleave */
     int resample_f;              /* true or false to resampling required */
+    struct audio_feed_resampled *rs_feed; /* shared resampled input, replaces the above when set */
     int client_count;            /* number of streamers/recorders connected */
     pthread_mutex_t flush_mutex; /* to block encoder so it's in a known state before flush */
-    pthread_mutex_t mutex;/* for blocking encoder_unregister_client while the encoder is writing out data */
+    pthread_mutex_t mutex;       /* serialises changes to output_chain */
     pthread_mutex_t metadata_mutex;      /* used when metadata is read or written */
     pthread_mutex_t fade_mutex;     /* for blocking fade initiate while fade being processed */
-    struct encoder_op *output_chain;     /* one output buffer per client connection */
+    struct encoder_op *output_chain;     /* one read cursor per client connection, changed under both locks */
+    char *packet_ring;                   /* ogg or mp3 packets shared by all the clients */
+    uint64_t packet_ring_head;           /* write position in packet_ring */
+    pthread_mutex_t packet_ring_mutex;   /* guards packet_ring and the client read cursors */
+    pthread_cond_t packet_ring_cv;       /* signalled when a packet is added to the ring */
     struct encoder_header_buffer *header_buffer; /* point to needed headers or NULL */
+    struct replay *replay;               /* the last $replay_buffer_s seconds of output or NULL */
+    struct encoder_ip_data ip_pool[ENCODER_IP_POOL_SIZE]; /* recycled by encoder_get_input_data */
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
     char *custom_meta;           /* when this is set it is used for stream metadata - in the title tag of ogg streams */
     char *artist;                /* used for recordings' metadata - always utf-8 */
@@ -161,16 +209,33 @@ struct encoder
     double timestamp;            /* running counter in seconds for current serial */
     void (*run_encoder)(struct encoder *);       /* pointer to the encoder in use */
     void *encoder_private;               /* used by the specific encoder */
+    char *config_sig;            /* the encoder_vars in canonical form when started */
+    struct encoder *sharing;     /* the running encoder whose output is used instead, or NULL */
+    int n_sharers;               /* number of stopped encoders that use this one's output */
+    struct encoder_stats stats;          /* updated by the pool worker running the encoder */
+    struct encoder_stats stats_reported; /* as they were at the last report */
+    struct timespec report_time;         /* when the last report was made */
+    struct threadstat threadstat;        /* pool worker usage while running the encoder */
+    uint64_t probe_frame;                /* the first input frame not in a packet yet, for the latency probe */
+    struct threadstat_report threadstat_reported;
     };
 
+int encoder_pool_init(struct threads_info *ti);
+void encoder_pool_destroy();
 struct encoder *encoder_init(struct threads_info *ti, int numeric_id);
 int encoder_init_lame(struct threads_info *ti, struct universal_vars *uv, void *param);
 void encoder_destroy(struct encoder *self);
-struct encoder_op_packet *encoder_client_get_packet(struct encoder_op *op);
-void encoder_client_free_packet(struct encoder_op_packet *packet);
+struct encoder_op_packet *encoder_client_read_packet(struct encoder_op *op);
+void encoder_client_discard_packet(struct encoder_op *op);
+int encoder_client_wait_packet(struct encoder_op *op, int timeout_ms);
+size_t encoder_client_backlog(struct encoder_op *op);
 int encoder_client_set_flush(struct encoder_op *op);
-size_t encoder_write_packet(struct encoder_op *op, struct encoder_op_packet *packet);
+int encoder_client_attach(struct encoder_op *op);
+void encoder_client_set_notify(struct encoder_op *op, int fd);
+void encoder_client_catch_up(struct encoder_op *op);
+ssize_t encoder_packet_boundary(const struct encoder_op_packet *packet);
 void encoder_write_packet_all(struct encoder *enc, struct encoder_op_packet *packet);
+void encoder_write_packet_allv(struct encoder *enc, struct encoder_op_packet *packet, const struct iovec *iov, int iovcnt);
 struct encoder_op *encoder_register_client(struct threads_info *ti, int numeric_id);
 void encoder_unregister_client(struct encoder_op *op);
 int encoder_start(struct threads_info *ti, struct universal_vars *uv, void *other);
@@ -178,8 +243,10 @@ int encoder_stop(struct threads_info *ti, struct universal_vars *uv, void *other
 int encoder_initiate_fade(struct threads_info *ti, struct universal_vars *uv, void *other);
 int encoder_update(struct threads_info *ti, struct universal_vars *uv, void *other);
 int encoder_new_song_metadata(struct threads_info *ti, struct universal_vars *uv, void *other);
+int encoder_replay_dump(struct threads_info *ti, struct universal_vars *uv, void *other);
 int encoder_new_custom_metadata(struct threads_info *ti, struct universal_vars *uv, void *other);
 void encoder_src_data_cleanup(struct encoder *self);
+int encoder_make_report(struct encoder *self);
 struct encoder_ip_data *encoder_get_input_data(struct encoder *encoder, size_t min_samples_needed, size_t max_samples, float **caller_supplied_buffer);
 void encoder_ip_data_free(struct encoder_ip_data *id);
 #endif
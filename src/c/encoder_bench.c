@@ -0,0 +1,357 @@
+/*
+#   encoder_bench.c: throughput and latency of the live encoders without a JACK server
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* built by make bench and linked against the idjc module
+ *
+ * each encoder is started in turn as the user interface would start it and
+ * fed through audio_feed_process_audio from port buffers of our own, paced
+ * at the -x multiple of real time, while a client thread takes its packets
+ *
+ * the real-time factor comes from the encoder's own cpu time accounting so
+ * it is the number of such streams one cpu could carry, the latency is from
+ * the time the last sample a packet covers was fed to the time the client
+ * had the packet, and allocations are counted in every thread
+ *
+ * usage: encoder_bench [-r rate] [-s seconds] [-p period] [-x speed] [codec ...]
+ */
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <jack/jack.h>
+
+#include "sourceclient.h"
+#include "main.h"
+#include "bench_alloc.h"
+
+#define MAX_PERIOD 4096
+#define WARMUP_SECONDS 1.0
+#define MAX_PACKETS 65536
+
+typedef jack_default_audio_sample_t sample_t;
+
+/* a configuration of the encoder settings fixed at what we stream with */
+struct config
+    {
+    const char *name;
+    const char *family;
+    const char *codec;
+    const char *samplerate;     /* NULL for the jack rate */
+    const char *bitrate;
+    const char *mode;
+    const char *quality;
+    const char *variability;
+    const char *bitwidth;
+    const char *complexity;
+    const char *framesize;
+    const char *standard;
+    };
+
+static const struct config configs[] = {
+    { "mp3",      "mpeg", "mp3",    "44100", "128", "jointstereo", "2",  NULL,       NULL, NULL, NULL, NULL },
+    { "mp2",      "mpeg", "mp2",    NULL,    "192", "jointstereo", NULL, NULL,       NULL, NULL, NULL, "1" },
+    { "aac",      "mpeg", "aac",    "44100", "128", "stereo",      NULL, NULL,       NULL, NULL, NULL, NULL },
+    { "aacpv2",   "mpeg", "aacpv2", "44100", "48",  "stereo",      NULL, NULL,       NULL, NULL, NULL, NULL },
+    { "vorbis",   "ogg",  "vorbis", NULL,    "128", "stereo",      NULL, "constant", NULL, NULL, NULL, NULL },
+    { "oggflac",  "ogg",  "flac",   NULL,    "0",   "stereo",      NULL, NULL,       "16", NULL, NULL, NULL },
+    { "speex",    "ogg",  "speex",  "32000", "0",   "stereo",      "8",  NULL,       NULL, "3",  NULL, NULL },
+    { "opus",     "ogg",  "opus",   NULL,    "96",  "stereo",      NULL, "vbr",      NULL, "10", "20", NULL },
+    { "webm",     "webm", "vorbis", NULL,    "128", "stereo",      NULL, NULL,       NULL, NULL, NULL, NULL },
+    { "webmopus", "webm", "opus",   NULL,    "96",  "stereo",      NULL, NULL,       NULL, NULL, NULL, NULL },
+    };
+
+/* what the port handles given to the audio feed point to */
+struct bench_port
+    {
+    sample_t buffer[MAX_PERIOD];
+    };
+
+static jack_nframes_t sample_rate = 48000;
+static double run_seconds = 10.0;
+static int period_frames = 256;
+static double speed = 1.0;
+
+/* the feeding and reading sides of a run */
+static double *feed_time;           /* when each period was fed */
+static int n_fed;                   /* periods fed, published after feed_time */
+static double latency[MAX_PACKETS];
+static int n_latency;
+static unsigned long packets;
+static volatile int reader_stop;
+
+/* the JACK API as far as the audio feed uses it */
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client)
+    {
+    return sample_rate;
+    }
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes)
+    {
+    return ((struct bench_port *)port)->buffer;
+    }
+
+static double now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+/* fill_ports: music-like material, two tones with a little noise so the encoders have work to do */
+static void fill_ports(struct bench_port *l, struct bench_port *r, uint64_t position)
+    {
+    for (int i = 0; i < period_frames; ++i)
+        {
+        double t = (double)(position + i) / sample_rate;
+        float noise = (random() / (float)RAND_MAX - 0.5f) * 0.02f;
+
+        l->buffer[i] = 0.3f * sin(2.0 * M_PI * 440.0 * t) + 0.1f * sin(2.0 * M_PI * 3520.0 * t) + noise;
+        r->buffer[i] = 0.3f * sin(2.0 * M_PI * 554.37 * t) + 0.1f * sin(2.0 * M_PI * 2217.5 * t) - noise;
+        }
+    }
+
+/* reader: the client side, timing each packet against when its audio was fed */
+static void *reader(void *args)
+    {
+    const struct config *config = ((void **)args)[1];
+    struct encoder_op *op = ((void **)args)[0];
+    struct encoder_op_packet *packet;
+    double target_rate = config->samplerate ? atof(config->samplerate) : sample_rate;
+    double granule_rate = !strcmp(config->codec, "opus") ? 48000.0 : target_rate;
+    double audio, t;
+    long period, fed;
+
+    while (!reader_stop)
+        {
+        if (!encoder_client_wait_packet(op, 50))
+            continue;
+        while ((packet = encoder_client_read_packet(op)))
+            {
+            t = now();
+            ++packets;
+            if (packet->header.flags & (PF_HEADER | PF_METADATA) || packet->header.timestamp <= 0.0)
+                continue;
+            /* ogg page timestamps are granule positions over the jack rate */
+            audio = packet->header.timestamp;
+            if (packet->header.flags & PF_OGG)
+                audio *= sample_rate / granule_rate;
+            if (audio < WARMUP_SECONDS || n_latency == MAX_PACKETS)
+                continue;
+            fed = __atomic_load_n(&n_fed, __ATOMIC_ACQUIRE);
+            if ((period = (long)ceil(audio * sample_rate / period_frames) - 1) >= fed)
+                period = fed - 1;
+            if (period >= 0)
+                latency[n_latency++] = t - feed_time[period];
+            }
+        }
+    return NULL;
+    }
+
+static int compare_double(const void *a, const void *b)
+    {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+    }
+
+static void run(struct threads_info *ti, const struct config *config, struct bench_port *l, struct bench_port *r)
+    {
+    struct encoder *encoder = ti->encoder[0];
+    struct universal_vars uv = { .tab = 0 };
+    struct encoder_vars ev = {
+        .encode_source = "jack",
+        .resample_quality = "medium",
+        .family = (char *)config->family,
+        .codec = (char *)config->codec,
+        .bitrate = (char *)config->bitrate,
+        .mode = (char *)config->mode,
+        .quality = (char *)config->quality,
+        .variability = (char *)config->variability,
+        .bitwidth = (char *)config->bitwidth,
+        .complexity = (char *)config->complexity,
+        .framesize = (char *)config->framesize,
+        .standard = (char *)config->standard,
+        .metadata_mode = "suppressed",
+        .pregain = "1.0",
+        .postgain = "0",
+        };
+    char rate[12];
+    struct encoder_op *op;
+    pthread_t reader_thread;
+    void *reader_args[2];
+    struct timespec next;
+    int n_periods = (run_seconds + WARMUP_SECONDS) * sample_rate / period_frames;
+    unsigned long allocs;
+    uint64_t samples, cpu_ns;
+    double audio, cpu, p50, p99, worst;
+
+    snprintf(rate, sizeof rate, "%u", sample_rate);
+    /* encoder_start may replace this one */
+    if (!(ev.samplerate = strdup(config->samplerate ? config->samplerate : rate)))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+    if (!encoder_start(ti, &uv, &ev))
+        {
+        printf("%-9s not available\n", config->name);
+        free(ev.samplerate);
+        return;
+        }
+    if (!(op = encoder_register_client(ti, 0)))
+        exit(5);
+
+    samples = __atomic_load_n(&encoder->stats.samples, __ATOMIC_RELAXED);
+    cpu_ns = __atomic_load_n(&encoder->stats.cpu_ns, __ATOMIC_RELAXED);
+    n_fed = n_latency = 0;
+    packets = 0;
+    reader_stop = FALSE;
+    reader_args[0] = op;
+    reader_args[1] = (void *)config;
+    if (pthread_create(&reader_thread, NULL, reader, reader_args))
+        {
+        fprintf(stderr, "pthread_create failed\n");
+        exit(5);
+        }
+
+    allocs = bench_allocations();
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int i = 0; i < n_periods; ++i)
+        {
+        fill_ports(l, r, (uint64_t)i * period_frames);
+        if ((next.tv_nsec += (long)(1e9 * period_frames / sample_rate / speed)) >= 1000000000)
+            {
+            next.tv_nsec -= 1000000000;
+            ++next.tv_sec;
+            }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        feed_time[i] = now();
+        audio_feed_process_audio(period_frames, NULL);
+        __atomic_store_n(&n_fed, i + 1, __ATOMIC_RELEASE);
+        }
+    /* time for the last packets to come through */
+    usleep(500000);
+    reader_stop = TRUE;
+    pthread_join(reader_thread, NULL);
+    allocs = bench_allocations() - allocs;
+
+    audio = (__atomic_load_n(&encoder->stats.samples, __ATOMIC_RELAXED) - samples) / (double)encoder->target_samplerate;
+    cpu = (__atomic_load_n(&encoder->stats.cpu_ns, __ATOMIC_RELAXED) - cpu_ns) * 1e-9;
+    qsort(latency, n_latency, sizeof latency[0], compare_double);
+    p50 = n_latency ? latency[n_latency / 2] : 0.0;
+    p99 = n_latency ? latency[(int)((n_latency - 1) * 0.99)] : 0.0;
+    worst = n_latency ? latency[n_latency - 1] : 0.0;
+    printf("%-9s %6ld %5s %8.1f %8lu %8.1f %8.1f %8.1f %9.1f", config->name, encoder->target_samplerate, config->bitrate,
+                cpu > 0.0 ? audio / cpu : 0.0, packets, p50 * 1e3, p99 * 1e3, worst * 1e3, packets ? (double)allocs / packets : 0.0);
+    if (encoder->performance_warning_indicator == PW_AUDIO_DATA_DROPPED)
+        printf("  audio dropped");
+    putchar('\n');
+    fflush(stdout);
+
+    encoder_unregister_client(op);
+    encoder_stop(ti, &uv, NULL);
+    free(ev.samplerate);
+    }
+
+static void usage(const char *name)
+    {
+    fprintf(stderr, "usage: %s [-r rate] [-s seconds] [-p period] [-x speed] [codec ...]\ncodecs:", name);
+    for (size_t i = 0; i < sizeof configs / sizeof configs[0]; ++i)
+        fprintf(stderr, " %s", configs[i].name);
+    fputc('\n', stderr);
+    exit(2);
+    }
+
+int main(int argc, char **argv)
+    {
+    struct threads_info ti = { .n_encoders = 1 };
+    struct encoder *encoders[1], *spare[1];
+    struct bench_port *left, *right;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:p:x:")) != -1)
+        switch (opt)
+            {
+            case 'r':
+                sample_rate = atoi(optarg);
+                break;
+            case 's':
+                run_seconds = atof(optarg);
+                break;
+            case 'p':
+                period_frames = atoi(optarg);
+                break;
+            case 'x':
+                speed = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+            }
+    if (sample_rate < 8000 || run_seconds <= 0.0 || period_frames < 16 || period_frames > MAX_PERIOD || speed <= 0.0)
+        usage(argv[0]);
+
+    if (!(left = calloc(1, sizeof *left)) || !(right = calloc(1, sizeof *right))
+                || !(feed_time = malloc((size_t)((run_seconds + WARMUP_SECONDS) * sample_rate / period_frames + 1) * sizeof *feed_time)))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+    g.client = (jack_client_t *)&g;
+    g.port.output_in_l = (jack_port_t *)left;
+    g.port.output_in_r = (jack_port_t *)right;
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    if (!(g.out = fopen("/dev/null", "w")))
+        {
+        perror("/dev/null");
+        exit(5);
+        }
+
+    /* one encoder slot, started with each configuration in turn */
+    ti.encoder = encoders;
+    ti.encoder_spare = spare;
+    if (!(encoders[0] = encoder_init(&ti, 0)) || !(ti.audio_feed = audio_feed_init(&ti)) || !encoder_pool_init(&ti))
+        exit(5);
+    encoder_init_lame(&ti, NULL, NULL);
+
+    printf("%u Hz input, %d frame periods at %gx real time, %g seconds a run\n", sample_rate, period_frames, speed, run_seconds);
+    printf("%-9s %6s %5s %8s %8s %8s %8s %8s %9s\n", "codec", "rate", "kb/s", "rtf cpu", "packets",
+                "p50 ms", "p99 ms", "worst ms", "allocs/pk");
+    for (size_t i = 0; i < sizeof configs / sizeof configs[0]; ++i)
+        {
+        int wanted = optind == argc;
+
+        for (int j = optind; j < argc; ++j)
+            wanted |= !strcmp(argv[j], configs[i].name);
+        if (wanted)
+            run(&ti, &configs[i], left, right);
+        }
+
+    encoder_pool_destroy();
+    encoder_destroy(encoders[0]);
+    audio_feed_destroy(ti.audio_feed);
+    return 0;
+    }
@@ -0,0 +1,248 @@
+/*
+#   evloop.c: the backend control thread's event loop
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+#include "sourceclient.h"
+#include "evloop.h"
+
+#define MAX_FDS 8
+#define MAX_TIMERS 8
+
+/* how often to try connecting to the notification fifo */
+#define NOTIFY_RETRY_MS 500
+
+struct watch
+    {
+    int fd;
+    evloop_fd_handler handler;
+    void *data;
+    };
+
+struct timer
+    {
+    int interval_ms;
+    long long due_ms;
+    evloop_handler handler;
+    void *data;
+    };
+
+struct event_handler
+    {
+    evloop_handler handler;
+    void *data;
+    };
+
+static struct watch watches[MAX_FDS];
+static int n_watches;
+static struct timer timers[MAX_TIMERS];
+static int n_timers;
+static struct event_handler event_handlers[EVLOOP_N_EVENTS];
+static volatile sig_atomic_t pending[EVLOOP_N_EVENTS];
+static int wake_fd[2] = { -1, -1 };
+static int running;
+
+static char *notify_pathname;
+static int notify_fd = -1;
+
+static long long now_ms()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+    }
+
+static int set_flags(int fd)
+    {
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0 ||
+                fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ? FAILED : SUCCEEDED;
+    }
+
+int evloop_init()
+    {
+    if (pipe(wake_fd) || !set_flags(wake_fd[0]) || !set_flags(wake_fd[1]))
+        {
+        perror("evloop_init: wakeup pipe");
+        return FAILED;
+        }
+    return SUCCEEDED;
+    }
+
+int evloop_add_fd(int fd, evloop_fd_handler handler, void *data)
+    {
+    if (n_watches == MAX_FDS)
+        {
+        fprintf(stderr, "evloop_add_fd: too many file descriptors\n");
+        return FAILED;
+        }
+    watches[n_watches++] = (struct watch){ fd, handler, data };
+    return SUCCEEDED;
+    }
+
+void evloop_remove_fd(int fd)
+    {
+    for (int i = 0; i < n_watches; ++i)
+        if (watches[i].fd == fd)
+            {
+            watches[i] = watches[--n_watches];
+            return;
+            }
+    }
+
+int evloop_add_timer(int interval_ms, evloop_handler handler, void *data)
+    {
+    if (n_timers == MAX_TIMERS)
+        {
+        fprintf(stderr, "evloop_add_timer: too many timers\n");
+        return FAILED;
+        }
+    timers[n_timers++] = (struct timer){ interval_ms, now_ms() + interval_ms, handler, data };
+    return SUCCEEDED;
+    }
+
+void evloop_on_event(enum evloop_event event, evloop_handler handler, void *data)
+    {
+    event_handlers[event] = (struct event_handler){ handler, data };
+    }
+
+void evloop_post(enum evloop_event event)
+    {
+    int saved_errno = errno;
+
+    pending[event] = TRUE;
+    /* a full pipe already has a wakeup in it */
+    if (write(wake_fd[1], "", 1) < 0 && errno != EAGAIN)
+        perror("evloop_post: write");
+    errno = saved_errno;
+    }
+
+static void dispatch_events()
+    {
+    char buffer[64];
+
+    while (read(wake_fd[0], buffer, sizeof buffer) > 0);
+    for (int i = 0; i < EVLOOP_N_EVENTS; ++i)
+        if (pending[i])
+            {
+            pending[i] = FALSE;
+            if (event_handlers[i].handler)
+                event_handlers[i].handler(event_handlers[i].data);
+            }
+    }
+
+static void notify_connect(void *data)
+    {
+    /* this fails with ENXIO until the reader is there */
+    if (notify_fd < 0 && notify_pathname)
+        notify_fd = open(notify_pathname, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+
+void evloop_notify_open(const char *pathname)
+    {
+    if (!(notify_pathname = strdup(pathname)))
+        {
+        fprintf(stderr, "evloop_notify_open: malloc failure\n");
+        exit(5);
+        }
+    notify_connect(NULL);
+    evloop_add_timer(NOTIFY_RETRY_MS, notify_connect, NULL);
+    }
+
+void evloop_notify(const char *name)
+    {
+    char line[64];
+    int n;
+
+    if (notify_fd < 0)
+        return;
+    n = snprintf(line, sizeof line, "%s\n", name);
+    /* the names are short enough to be written atomically or not at all */
+    if (write(notify_fd, line, n) < 0 && errno != EAGAIN)
+        {
+        close(notify_fd);
+        notify_fd = -1;
+        }
+    }
+
+void evloop_run()
+    {
+    struct pollfd pfds[MAX_FDS + 1];
+    struct watch ready[MAX_FDS];
+    long long now, soonest;
+    int n_ready, timeout, i, n;
+
+    running = TRUE;
+    while (running)
+        {
+        now = now_ms();
+        soonest = -1;
+        for (i = 0; i < n_timers; ++i)
+            {
+            if (timers[i].due_ms <= now)
+                {
+                timers[i].due_ms = now + timers[i].interval_ms;
+                timers[i].handler(timers[i].data);
+                if (!running)
+                    return;
+                }
+            if (soonest < 0 || timers[i].due_ms < soonest)
+                soonest = timers[i].due_ms;
+            }
+        timeout = (soonest < 0) ? -1 : (int)(soonest - now);
+
+        pfds[0] = (struct pollfd){ .fd = wake_fd[0], .events = POLLIN };
+        for (i = 0; i < n_watches; ++i)
+            pfds[i + 1] = (struct pollfd){ .fd = watches[i].fd, .events = POLLIN };
+        n = n_watches;
+
+        if (poll(pfds, n + 1, timeout) < 0)
+            {
+            if (errno != EINTR)
+                {
+                perror("evloop_run: poll");
+                return;
+                }
+            continue;
+            }
+
+        if (pfds[0].revents)
+            dispatch_events();
+        /* handlers may add or remove watches so the ready ones are copied out first */
+        for (i = 0, n_ready = 0; i < n; ++i)
+            if (pfds[i + 1].revents)
+                ready[n_ready++] = watches[i];
+        for (i = 0; i < n_ready && running; ++i)
+            ready[i].handler(ready[i].fd, ready[i].data);
+        }
+    }
+
+void evloop_quit()
+    {
+    running = FALSE;
+    }
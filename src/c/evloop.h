@@ -0,0 +1,60 @@
+/*
+#   evloop.h: the backend control thread's event loop
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+/* events that other threads and signal handlers hand to the main thread */
+enum evloop_event { EVLOOP_SESSION, EVLOOP_SHUTDOWN, EVLOOP_STATUS, EVLOOP_N_EVENTS };
+
+typedef void (*evloop_fd_handler)(int fd, void *data);
+typedef void (*evloop_handler)(void *data);
+
+/* evloop_init: set up the wakeup pipe, FAILED if it couldn't be made */
+int evloop_init();
+
+/* evloop_add_fd: call handler on the main thread whenever fd is readable or has hung up */
+int evloop_add_fd(int fd, evloop_fd_handler handler, void *data);
+void evloop_remove_fd(int fd);
+
+/* evloop_add_timer: call handler every interval_ms milliseconds */
+int evloop_add_timer(int interval_ms, evloop_handler handler, void *data);
+
+/* evloop_on_event: the handler for events that are posted */
+void evloop_on_event(enum evloop_event event, evloop_handler handler, void *data);
+
+/* evloop_post: have the event handled on the main thread as soon as possible
+ * this may be called from any thread or from a signal handler
+ * events of the same kind that arrive before their handler has run are merged
+ */
+void evloop_post(enum evloop_event event);
+
+/* evloop_notify_open: the fifo the user interface listens to for pushed events
+ * the interface may not have the other end open yet so connecting is retried
+ */
+void evloop_notify_open(const char *pathname);
+
+/* evloop_notify: tell the user interface of an event by name, dropped if nobody is listening */
+void evloop_notify(const char *name);
+
+/* evloop_run: dispatch until evloop_quit is called */
+void evloop_run();
+void evloop_quit();
+
+#endif /* EVLOOP_H */
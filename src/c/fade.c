@@ -66,51 +66,91 @@ void fade_set(struct fade *s, enum fade_startpos sp, float t, enum fade_directio
     pthread_mutex_unlock(&s->mutex);
     }
     
-float fade_get(struct fade *s)
+/* take on new fade settings - called with the lock held */
+static void fade_latch(struct fade *s)
     {
-    if (s->newdata)   
+    if (s->startpos == FADE_SET_HIGH)
+        s->level = 1.0f;
+    if (s->startpos == FADE_SET_LOW)
+        s->level = 0.0f;
+    if ((s->direction = s->newdirection) == FADE_IN)
+        s->rate = powf(s->baselevel, -1.0f / s->samples);
+    else
+        s->rate = powf(s->baselevel, 1.0f / s->samples);
+    
+    s->moving = 1;
+    s->newdata = 0;
+    }
+
+/* advance a moving fade by one sample */
+static void fade_step(struct fade *s)
+    {
+    if (s->direction == FADE_IN)
         {
-        pthread_mutex_lock(&s->mutex);
-        
-        if (s->startpos == FADE_SET_HIGH)
-            s->level = 1.0f;
-        if (s->startpos == FADE_SET_LOW)
-            s->level = 0.0f;
-        if ((s->direction = s->newdirection) == FADE_IN)
-            s->rate = powf(s->baselevel, -1.0f / s->samples);
+        if (s->level < s->baselevel)
+            s->level = s->baselevel;
         else
-            s->rate = powf(s->baselevel, 1.0f / s->samples);
-        
-        s->moving = 1;
-        s->newdata = 0;
-        pthread_mutex_unlock(&s->mutex);
+            if ((s->level *= s->rate) >= 1.0f)
+                {
+                s->level = 1.0f;
+                s->moving = 0;
+                }
         }
         
-    if (s->moving)
+    if (s->direction == FADE_OUT)
         {
-        if (s->direction == FADE_IN)
-            {
-            if (s->level < s->baselevel)
-                s->level = s->baselevel;
-            else
-                if ((s->level *= s->rate) >= 1.0f)
-                    {
-                    s->level = 1.0f;
-                    s->moving = 0;
-                    }
-            }
-            
-        if (s->direction == FADE_OUT)
+        if (s->level > s->baselevel)
+            s->level *= s->rate;
+        else
             {
-            if (s->level > s->baselevel)
-                s->level *= s->rate;
-            else
-                {
-                s->level = 0.0f;
-                s->moving = 0;
-                }
+            s->level = 0.0f;
+            s->moving = 0;
             }
         }
+    }
+
+float fade_get(struct fade *s)
+    {
+    if (s->newdata)   
+        {
+        pthread_mutex_lock(&s->mutex);
+        fade_latch(s);
+        pthread_mutex_unlock(&s->mutex);
+        }
+        
+    if (s->moving)
+        fade_step(s);
         
     return s->level;
     }
+
+void fade_get_block(struct fade *s, float *out, int n)
+    {
+    int i = 0;
+
+    if (s->newdata)
+        {
+        pthread_mutex_lock(&s->mutex);
+        fade_latch(s);
+        pthread_mutex_unlock(&s->mutex);
+        }
+
+    for (; i < n && s->moving; ++i)
+        {
+        fade_step(s);
+        out[i] = s->level;
+        }
+
+    /* the remainder is at a constant level */
+    for (const float level = s->level; i < n; ++i)
+        out[i] = level;
+    }
+
+int fade_idle(struct fade *s, float *level)
+    {
+    if (s->newdata || s->moving)
+        return 0;
+
+    *level = s->level;
+    return 1;
+    }
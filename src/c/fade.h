@@ -49,4 +49,10 @@ void fade_set(struct fade *s, enum fade_startpos, float t, enum fade_direction);
 /* obtain the next fade value */
 float fade_get(struct fade *s);
 
+/* obtain the next n fade values */
+void fade_get_block(struct fade *s, float *out, int n);
+
+/* true when no fade is in progress, the constant fade value goes in level */
+int fade_idle(struct fade *s, float *level);
+
 #endif /* FADE_H */
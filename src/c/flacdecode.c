@@ -32,78 +32,92 @@
 #define ACCEPTED 1
 #define REJECTED 0
 
+/* frames decoded per call of flacdecode_play, a few frames at typical blocksizes */
+#define FLAC_BATCH_FRAMES 8192
+
+/* make_flac_audio_to_float: interleave and scale the decoded channels
+ * the mono and stereo cases are kept as simple loops so they vectorise
+ */
 void make_flac_audio_to_float(struct xlplayer *self, float *flbuf, const FLAC__int32 * const inputbuffer[], unsigned int numsamples, unsigned int bits_per_sample, unsigned int numchannels)
     {
-    int shiftvalue = 32 - bits_per_sample;
+    const float scale = 1.0F / (float)(1U << (bits_per_sample - 1));
+    float *restrict fptr = flbuf;
     unsigned sample, channel;
-    const float half_randmax = (float)(RAND_MAX >> 1);
-    float dither;
-    float dscale;
-    
-    if (!self->dither || bits_per_sample >= 20)
-        {
-        for (sample = 0; sample < numsamples; sample++)
-            for (channel = 0; channel < numchannels; channel++)
-                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F;
-        }
-    else
+
+    switch (numchannels)
         {
-        dscale = 0.25F / (half_randmax * powf(2.0F, (float)bits_per_sample));
-        for (sample = 0; sample < numsamples; sample++)
+        case 1:
+            {
+            const FLAC__int32 *restrict m = inputbuffer[0];
+
+            for (sample = 0; sample < numsamples; sample++)
+                fptr[sample] = (float)m[sample] * scale;
+            }
+            break;
+        case 2:
+            {
+            const FLAC__int32 *restrict l = inputbuffer[0];
+            const FLAC__int32 *restrict r = inputbuffer[1];
+
+            for (sample = 0; sample < numsamples; sample++)
+                {
+                fptr[2 * sample] = (float)l[sample] * scale;
+                fptr[2 * sample + 1] = (float)r[sample] * scale;
+                }
+            }
+            break;
+        default:
             for (channel = 0; channel < numchannels; channel++)
                 {
-                dither = ((((float)rand_r(&self->seed)) - half_randmax) +
-                            (((float)rand_r(&self->seed)) - half_randmax)) * dscale;
-                *flbuf++ = ((float)(inputbuffer[channel][sample] << shiftvalue)) / 2147483648.0F + dither;
+                const FLAC__int32 *restrict c = inputbuffer[channel];
+
+                for (sample = 0; sample < numsamples; sample++)
+                    fptr[sample * numchannels + channel] = (float)c[sample] * scale;
                 }
         }
+
+    if (self->dither && bits_per_sample < 20)
+        xlplayer_add_dither(self, flbuf, numsamples * numchannels, 1.0F / powf(2.0F, (float)bits_per_sample));
     }
 
+/* flac_writer_callback: append the frame to the batch which flacdecode_play hands on */
 static FLAC__StreamDecoderWriteStatus flac_writer_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const inputbuffer[], void *client_data)
     {
     struct xlplayer *xlplayer = client_data;
     struct flacdecode_vars *self = xlplayer->dec_data;
-    SRC_DATA *src_data = &(xlplayer->src_data);
-    int src_error;
+    unsigned channels = frame->header.channels;
 
     if (self->suppress_audio_output == FALSE)
         {
-        if (xlplayer->src_state)
+        if (channels != self->channels)
             {
-            if (frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER && frame->header.number.frame_number == 0)
-                {
-                fprintf(stderr, "flac_writer_callback: performance warning -- can't determine if a block is the last one or not for this file\n");
-                }
-            else
-                {
-                if (frame->header.number.sample_number + frame->header.blocksize == self->totalsamples)
-                    src_data->end_of_input = TRUE;
-                }
-            src_data->input_frames = frame->header.blocksize;
-            src_data->data_in = realloc((void *)src_data->data_in, src_data->input_frames * frame->header.channels * sizeof (float));
-            src_data->output_frames = (int)(src_data->input_frames * src_data->src_ratio) + 2 + (512 * src_data->end_of_input);
-            src_data->data_out = realloc(src_data->data_out, src_data->output_frames * frame->header.channels * sizeof (float));
-            make_flac_audio_to_float(xlplayer, (float *)src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
-            if ((src_error = src_process(xlplayer->src_state, src_data)))
-                {
-                fprintf(stderr, "flac_writer_callback: src_process reports %s\n", src_strerror(src_error));
-                xlplayer->playmode = PM_EJECTING;
-                return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-                }
-            xlplayer_demux_channel_data(xlplayer, src_data->data_out, src_data->output_frames_gen, frame->header.channels, 1.f);
+            fprintf(stderr, "flac_writer_callback: channel count changed mid stream\n");
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
             }
-        else
+        /* the streaminfo max blocksize should make this unreachable */
+        if (self->batch_frames + frame->header.blocksize > self->batch_cap)
             {
-            if ((self->flbuf = realloc(self->flbuf, sizeof (float) * frame->header.blocksize * frame->header.channels)) == NULL)
+            self->batch_cap = self->batch_frames + frame->header.blocksize;
+            if (!(self->flbuf = realloc(self->flbuf, sizeof (float) * self->batch_cap * channels)))
                 {
                 fprintf(stderr, "flac_writer_callback: malloc failure\n");
-                xlplayer->playmode = PM_EJECTING;
-                return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+                exit(5);
+                }
+            /* the resampler has to follow the batch to its new home and have room for it */
+            if (xlplayer->src_state)
+                {
+                xlplayer->src_data.data_in = self->flbuf;
+                self->out_cap = (long)(self->batch_cap * xlplayer->src_data.src_ratio) + 514;
+                if (!(self->outbuf = realloc(self->outbuf, sizeof (float) * self->out_cap * channels)))
+                    {
+                    fprintf(stderr, "flac_writer_callback: malloc failure\n");
+                    exit(5);
+                    }
+                xlplayer->src_data.data_out = self->outbuf;
                 }
-            make_flac_audio_to_float(xlplayer, self->flbuf, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
-            xlplayer_demux_channel_data(xlplayer, self->flbuf, frame->header.blocksize, frame->header.channels, 1.f);
             }
-        xlplayer_write_channel_data(xlplayer);
+        make_flac_audio_to_float(xlplayer, self->flbuf + self->batch_frames * channels, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, channels);
+        self->batch_frames += frame->header.blocksize;
         }
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
     }
@@ -150,26 +164,43 @@ static void flacdecode_init(struct xlplayer *xlplayer)
         FLAC__stream_decoder_seek_absolute(self->decoder, ((FLAC__uint64)xlplayer->seek_s) * ((FLAC__uint64)self->metainfo.data.stream_info.sample_rate));
         self->suppress_audio_output = FALSE;
         }
+    self->channels = self->metainfo.data.stream_info.channels;
+    self->batch_cap = FLAC_BATCH_FRAMES + self->metainfo.data.stream_info.max_blocksize;
+    self->batch_frames = 0;
+    if (!(self->flbuf = malloc(sizeof (float) * self->batch_cap * self->channels)))
+        {
+        fprintf(stderr, "flacdecode_init: malloc failure\n");
+        exit(5);
+        }
     if ((self->resample_f = (self->metainfo.data.stream_info.sample_rate != xlplayer->samplerate)))
         {
         fprintf(stderr, "flacdecode_init: %s configuring resampler\n", xlplayer->playername);
-        xlplayer->src_state = src_new(xlplayer->rsqual, self->metainfo.data.stream_info.channels, &src_error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, self->channels, &src_error);
         if (src_error)
             {
-            fprintf(stderr, "flacdecode_init: %s src_new reports - %s\n", xlplayer->playername, src_strerror(src_error));
+            fprintf(stderr, "flacdecode_init: %s resampler_new reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
             FLAC__stream_decoder_delete(self->decoder);
+            free(self->flbuf);
             goto cleanup;
             }
-        xlplayer->src_data.output_frames = 0;
-        xlplayer->src_data.data_in = xlplayer->src_data.data_out = NULL;
         xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)self->metainfo.data.stream_info.sample_rate;
         xlplayer->src_data.end_of_input = 0;
-        self->totalsamples = self->metainfo.data.stream_info.total_samples; 
+        xlplayer->src_data.data_in = self->flbuf;
+        /* sized for a full batch plus the resampler's tail at end of input */
+        self->out_cap = (long)(self->batch_cap * xlplayer->src_data.src_ratio) + 514;
+        if (!(self->outbuf = malloc(sizeof (float) * self->out_cap * self->channels)))
+            {
+            fprintf(stderr, "flacdecode_init: malloc failure\n");
+            exit(5);
+            }
+        xlplayer->src_data.data_out = self->outbuf;
         }
     else
+        {
         xlplayer->src_state = NULL;
+        self->outbuf = NULL;
+        }
     self->suppress_audio_output = FALSE;
-    self->flbuf = NULL;
     return;
 cleanup:
     free(self);
@@ -177,13 +208,48 @@ cleanup:
     xlplayer->command = CMD_COMPLETE;
     }
 
+/* flacdecode_play: decode a batch of frames and pass them on in one go
+ * this amortises the resampler and ringbuffer overhead across several frames
+ */
 static void flacdecode_play(struct xlplayer *xlplayer)
     {
     struct flacdecode_vars *self = xlplayer->dec_data;
+    SRC_DATA *src_data = &xlplayer->src_data;
+    FLAC__StreamDecoderState state;
+    int src_error;
+
+    self->batch_frames = 0;
+    do {
+        if (!FLAC__stream_decoder_process_single(self->decoder))
+            break;
+        state = FLAC__stream_decoder_get_state(self->decoder);
+        } while (self->batch_frames < FLAC_BATCH_FRAMES && state != FLAC__STREAM_DECODER_END_OF_STREAM);
+    state = FLAC__stream_decoder_get_state(self->decoder);
 
-    FLAC__stream_decoder_process_single(self->decoder);
-    if (FLAC__stream_decoder_get_state(self->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+    if (xlplayer->src_state)
+        {
+        src_data->input_frames = self->batch_frames;
+        src_data->output_frames = self->out_cap;
+        src_data->end_of_input = (state == FLAC__STREAM_DECODER_END_OF_STREAM);
+        if ((src_error = resampler_process(xlplayer->src_state, src_data)))
+            {
+            fprintf(stderr, "flacdecode_play: resampler_process reports %s\n", resampler_strerror(src_error));
+            xlplayer->playmode = PM_EJECTING;
+            return;
+            }
+        xlplayer_demux_channel_data(xlplayer, self->outbuf, src_data->output_frames_gen, self->channels, 1.f);
+        }
+    else
+        xlplayer_demux_channel_data(xlplayer, self->flbuf, self->batch_frames, self->channels, 1.f);
+    xlplayer_write_channel_data(xlplayer);
+
+    if (state == FLAC__STREAM_DECODER_END_OF_STREAM)
         xlplayer->playmode = PM_FLUSH;
+    else if (state >= FLAC__STREAM_DECODER_OGG_ERROR)
+        {
+        fprintf(stderr, "flacdecode_play: %s decoder state %s\n", xlplayer->playername, FLAC__StreamDecoderStateString[state]);
+        xlplayer->playmode = PM_EJECTING;
+        }
     }
 
 static void flacdecode_eject(struct xlplayer *xlplayer)
@@ -192,13 +258,11 @@ static void flacdecode_eject(struct xlplayer *xlplayer)
 
     FLAC__stream_decoder_finish(self->decoder);
     FLAC__stream_decoder_delete(self->decoder);
-    if (self->flbuf)
-        free(self->flbuf);
+    free(self->flbuf);
     if (self->resample_f)
         {
-        free((void *)xlplayer->src_data.data_in);
-        free(xlplayer->src_data.data_out);
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        free(self->outbuf);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         }
     free(self);
     }
@@ -29,8 +29,12 @@ struct flacdecode_vars
     int decoderstate;
     int resample_f;
     int suppress_audio_output;
-    FLAC__uint64 totalsamples;
-    float *flbuf;
+    unsigned channels;
+    float *flbuf;           /* interleaved batch of decoded frames */
+    unsigned batch_frames;  /* frames in flbuf */
+    unsigned batch_cap;     /* flbuf capacity in frames */
+    float *outbuf;          /* resampler output for one batch */
+    long out_cap;           /* outbuf capacity in frames */
     };
 
 int flacdecode_reg(struct xlplayer *xlplayer);
@@ -0,0 +1,424 @@
+/*
+#   hlssink.c: cuts an encoder's output into segments with a rolling playlist
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "sourceclient.h"
+#include "hlssink.h"
+#include "sig.h"
+#include "main.h"
+
+static const int packet_wait_ms = 100;          /* the longest time to wait for an encoded packet */
+
+/* segments that have left the playlist are kept this much longer for clients still fetching them */
+static const unsigned retire_lag = 2;
+
+/* hlssink_path: folder/name-seq.ext or with seq < 0 the pathname of the playlist */
+static char *hlssink_path(struct hlssink *self, long seq, const char *suffix)
+    {
+    size_t size = strlen(self->folder) + strlen(self->name) + strlen(suffix) + 16;
+    char *path;
+
+    if (!(path = malloc(size)))
+        {
+        fprintf(stderr, "hlssink_path: malloc failure\n");
+        return NULL;
+        }
+    if (seq >= 0)
+        snprintf(path, size, "%s/%s-%ld%s", self->folder, self->name, seq, suffix);
+    else
+        snprintf(path, size, "%s/%s%s", self->folder, self->name, suffix);
+    return path;
+    }
+
+/* hlssink_write_playlist: replace the playlist in one rename so a client never reads half of it */
+static int hlssink_write_playlist(struct hlssink *self, int final)
+    {
+    char *tmp = hlssink_path(self, -1, ".m3u8.tmp"), *path = hlssink_path(self, -1, ".m3u8");
+    double longest = self->target_s;
+    FILE *fp;
+    int ok = FALSE;
+
+    if (tmp && path && (fp = fopen(tmp, "w")))
+        {
+        for (int i = 0; i < self->n_listed; ++i)
+            if (self->list[i].duration > longest)
+                longest = self->list[i].duration;
+        fprintf(fp, "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%d\n#EXT-X-MEDIA-SEQUENCE:%u\n",
+                    (int)ceil(longest), self->n_listed ? self->list[0].seq : self->seq);
+        for (int i = 0; i < self->n_listed; ++i)
+            fprintf(fp, "#EXTINF:%.3f,\n%s-%u%s\n", self->list[i].duration, self->name, self->list[i].seq, self->ext);
+        if (final)
+            fputs("#EXT-X-ENDLIST\n", fp);
+        if (fclose(fp) == 0 && rename(tmp, path) == 0)
+            ok = TRUE;
+        }
+    if (!ok)
+        fprintf(stderr, "hlssink_write_playlist: failed to write %s\n", path ? path : "the playlist");
+    free(tmp);
+    free(path);
+    return ok;
+    }
+
+/* hlssink_segment_open: the next segment, which starts with the stream headers if there are any */
+static int hlssink_segment_open(struct hlssink *self)
+    {
+    char *path;
+
+    if (!(path = hlssink_path(self, self->seq, self->ext)))
+        return FALSE;
+    if (!(self->fp = fopen(path, "w")))
+        {
+        fprintf(stderr, "hlssink_segment_open: failed to open %s\n", path);
+        free(path);
+        return FALSE;
+        }
+    free(path);
+    self->seg_duration = 0.0;
+    return !self->headers_size || fwrite(self->headers, 1, self->headers_size, self->fp) == self->headers_size;
+    }
+
+/* hlssink_segment_close: finish the segment, list it and retire the one that fell out of the list long enough ago */
+static int hlssink_segment_close(struct hlssink *self, int final)
+    {
+    char *path;
+    int ok = fclose(self->fp) == 0;
+
+    self->fp = NULL;
+    if (!ok)
+        {
+        fprintf(stderr, "hlssink_segment_close: failed writing segment %u\n", self->seq);
+        return FALSE;
+        }
+    if (self->n_listed == self->window)
+        {
+        if (self->list[0].seq >= retire_lag && (path = hlssink_path(self, self->list[0].seq - retire_lag, self->ext)))
+            {
+            unlink(path);
+            free(path);
+            }
+        memmove(self->list, self->list + 1, (self->window - 1) * sizeof self->list[0]);
+        self->n_listed--;
+        }
+    self->list[self->n_listed].seq = self->seq++;
+    self->list[self->n_listed++].duration = self->seg_duration;
+    self->segments_written++;
+    return hlssink_write_playlist(self, final);
+    }
+
+/* hlssink_cache_headers: keep the ogg or webm headers of the current stream to start each segment */
+static void hlssink_cache_headers(struct hlssink *self, struct encoder_op_packet *packet)
+    {
+    char *p;
+
+    if (packet->header.serial != self->headers_serial)
+        {
+        self->headers_size = 0;
+        self->headers_serial = packet->header.serial;
+        }
+    if (!(p = realloc(self->headers, self->headers_size + packet->header.data_size)))
+        {
+        fprintf(stderr, "hlssink_cache_headers: malloc failure\n");
+        return;
+        }
+    self->headers = p;
+    memcpy(p + self->headers_size, packet->data, packet->header.data_size);
+    self->headers_size += packet->header.data_size;
+    }
+
+static int hlssink_write(struct hlssink *self, const void *data, size_t n)
+    {
+    return fwrite(data, 1, n, self->fp) == n;
+    }
+
+/* hlssink_packet: add a packet to the current segment, cutting a new one where one is due and may start */
+static int hlssink_packet(struct hlssink *self, struct encoder_op_packet *packet)
+    {
+    const int framed = packet->header.flags & (PF_OGG | PF_WEBM);
+    double duration;
+    ssize_t offset;
+
+    if ((packet->header.flags & PF_METADATA) || packet->header.serial < self->initial_serial || !packet->data)
+        return TRUE;
+
+    if (framed && (packet->header.flags & PF_HEADER))
+        {
+        hlssink_cache_headers(self, packet);
+        /* a new stream in the middle of a segment is chained on */
+        return !self->fp || hlssink_write(self, packet->data, packet->header.data_size);
+        }
+
+    /* a new serial counts its time from zero, the very first packet has no previous one to go by */
+    if (packet->header.serial == self->last_serial)
+        duration = packet->header.timestamp - self->last_timestamp;
+    else if (self->last_serial == -1)
+        duration = 0.0;
+    else
+        duration = packet->header.timestamp;
+    self->last_serial = packet->header.serial;
+    self->last_timestamp = packet->header.timestamp;
+
+    if (!self->synced || self->seg_duration >= self->target_s)
+        {
+        /* ogg and webm can only start where the headers are to hand */
+        if ((offset = encoder_packet_boundary(packet)) >= 0 && (!framed || self->headers_serial == packet->header.serial))
+            {
+            if (self->fp && (!hlssink_write(self, packet->data, offset) || !hlssink_segment_close(self, FALSE)))
+                return FALSE;
+            if (!hlssink_segment_open(self))
+                return FALSE;
+            self->synced = TRUE;
+            packet->data = (char *)packet->data + offset;
+            packet->header.data_size -= offset;
+            }
+        else if (!self->synced)
+            return TRUE;
+        }
+
+    self->seg_duration += duration;
+    return hlssink_write(self, packet->data, packet->header.data_size);
+    }
+
+/* hlssink_finish: the last segment goes on the playlist which is marked as ended */
+static void hlssink_finish(struct hlssink *self)
+    {
+    if (self->fp)
+        hlssink_segment_close(self, TRUE);
+    else if (self->n_listed)
+        hlssink_write_playlist(self, TRUE);
+    encoder_unregister_client(self->encoder_op);
+    self->encoder_op = NULL;
+    free(self->folder);
+    free(self->name);
+    free(self->headers);
+    self->folder = self->name = self->headers = NULL;
+    self->headers_size = 0;
+    fprintf(stderr, "hlssink_finish: %d stopped after %u segments\n", self->numeric_id, self->segments_written);
+    }
+
+static void *hlssink_main(void *args)
+    {
+    struct hlssink *self = args;
+    struct encoder_op_packet *packet;
+    char id[12];
+
+    sig_mask_thread();
+    snprintf(id, sizeof id, "%d", self->numeric_id);
+    threadstat_name("hls", id);
+    while (!self->thread_terminate_f)
+        {
+        threadstat_sample(&self->threadstat);
+        switch (self->mode)
+            {
+            case HM_STOPPED:
+                pthread_mutex_lock(&self->mode_mutex);
+                while (self->mode == HM_STOPPED && !self->thread_terminate_f)
+                    pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+                pthread_mutex_unlock(&self->mode_mutex);
+                break;
+            case HM_RUNNING:
+                encoder_client_wait_packet(self->encoder_op, packet_wait_ms);
+                while ((packet = encoder_client_read_packet(self->encoder_op)))
+                    if (!hlssink_packet(self, packet))
+                        {
+                        fprintf(stderr, "hlssink_main: giving up on %s/%s\n", self->folder, self->name);
+                        self->stop_request = TRUE;
+                        break;
+                        }
+                if (self->stop_request)
+                    self->mode = HM_STOPPING;
+                break;
+            case HM_STOPPING:
+                hlssink_finish(self);
+                self->stop_request = FALSE;
+                self->mode = HM_STOPPED;
+                break;
+            }
+        }
+    if (self->encoder_op)
+        hlssink_finish(self);
+    return NULL;
+    }
+
+int hlssink_start(struct threads_info *ti, struct universal_vars *uv, void *other)
+    {
+    struct hlssink_vars *hv = other;
+    struct hlssink *self;
+    struct encoder_data_format *df;
+
+    if (uv->tab < 0 || uv->tab >= ti->n_hlssinks || !(self = ti->hlssink[uv->tab]))
+        {
+        fprintf(stderr, "hlssink_start: there is no hls sink %d\n", uv->tab);
+        return FAILED;
+        }
+    if (self->mode != HM_STOPPED)
+        {
+        fprintf(stderr, "hlssink_start: %d is already running\n", self->numeric_id);
+        return FAILED;
+        }
+    if (!hv->hls_source || !hv->hls_folder || !*hv->hls_folder || !hv->hls_name || !*hv->hls_name)
+        {
+        fprintf(stderr, "hlssink_start: hls_source, hls_folder and hls_name are needed\n");
+        return FAILED;
+        }
+
+    /* the thread is left until it is needed */
+    if (!self->thread_started)
+        {
+        if (pthread_create(&self->thread_h, NULL, hlssink_main, self))
+            {
+            fprintf(stderr, "hlssink_start: failed to start thread\n");
+            return FAILED;
+            }
+        self->thread_started = TRUE;
+        }
+
+    if (!(self->encoder_op = encoder_register_client(ti, atoi(hv->hls_source))))
+        {
+        fprintf(stderr, "hlssink_start: failed to register with encoder\n");
+        return FAILED;
+        }
+    if (!self->encoder_op->encoder->run_request_f)
+        {
+        fprintf(stderr, "hlssink_start: encoder is not running\n");
+        encoder_unregister_client(self->encoder_op);
+        self->encoder_op = NULL;
+        return FAILED;
+        }
+
+    df = &self->encoder_op->encoder->data_format;
+    switch (df->family)
+        {
+        case ENCODER_FAMILY_OGG:
+            self->ext = (df->codec == ENCODER_CODEC_OPUS) ? ".opus" : ".oga";
+            break;
+        case ENCODER_FAMILY_WEBM:
+            self->ext = ".webm";
+            break;
+        case ENCODER_FAMILY_MPEG:
+            self->ext = (df->codec == ENCODER_CODEC_MP3) ? ".mp3" : (df->codec == ENCODER_CODEC_MP2) ? ".mp2" : ".aac";
+            break;
+        default:
+            fprintf(stderr, "hlssink_start: unhandled stream format\n");
+            encoder_unregister_client(self->encoder_op);
+            self->encoder_op = NULL;
+            return FAILED;
+        }
+
+    if (!(self->folder = strdup(hv->hls_folder)) || !(self->name = strdup(hv->hls_name)))
+        {
+        fprintf(stderr, "hlssink_start: malloc failure\n");
+        free(self->folder);
+        self->folder = NULL;
+        encoder_unregister_client(self->encoder_op);
+        self->encoder_op = NULL;
+        return FAILED;
+        }
+    self->target_s = (hv->hls_segment_s && atof(hv->hls_segment_s) > 0.0) ? atof(hv->hls_segment_s) : 6.0;
+    self->window = (hv->hls_window && atoi(hv->hls_window) > 0) ? atoi(hv->hls_window) : 6;
+    if (self->window > HLSSINK_MAX_WINDOW)
+        self->window = HLSSINK_MAX_WINDOW;
+    self->seq = 0;
+    self->n_listed = 0;
+    self->segments_written = 0;
+    self->synced = FALSE;
+    self->seg_duration = 0.0;
+    self->last_serial = -1;
+    self->headers_serial = -1;
+
+    /* join a running ogg or webm stream with its cached headers, other formats start at the next frame */
+    if (df->family == ENCODER_FAMILY_MPEG)
+        self->initial_serial = 0;
+    else if ((self->initial_serial = encoder_client_attach(self->encoder_op)) < 0)
+        self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
+
+    pthread_mutex_lock(&self->mode_mutex);
+    self->mode = HM_RUNNING;
+    pthread_cond_signal(&self->mode_cv);
+    pthread_mutex_unlock(&self->mode_mutex);
+    fprintf(stderr, "hlssink_start: %d writing %s/%s.m3u8 in %g second segments\n", self->numeric_id, self->folder, self->name, self->target_s);
+    return SUCCEEDED;
+    }
+
+int hlssink_stop(struct threads_info *ti, struct universal_vars *uv, void *other)
+    {
+    struct hlssink *self;
+    struct timespec ms10 = { 0, 10000000 };
+
+    if (uv->tab < 0 || uv->tab >= ti->n_hlssinks || !(self = ti->hlssink[uv->tab]))
+        {
+        fprintf(stderr, "hlssink_stop: there is no hls sink %d\n", uv->tab);
+        return FAILED;
+        }
+    if (self->mode == HM_STOPPED)
+        {
+        fprintf(stderr, "hlssink_stop: %d is already stopped\n", self->numeric_id);
+        return FAILED;
+        }
+    self->stop_request = TRUE;
+    while (self->mode != HM_STOPPED)
+        nanosleep(&ms10, NULL);
+    return SUCCEEDED;
+    }
+
+int hlssink_make_report(struct hlssink *self)
+    {
+    char thread_stats[64];
+
+    threadstat_format(&self->threadstat, &self->threadstat_reported, thread_stats, sizeof thread_stats);
+    fprintf(g.out, "idjcsc: hls%dreport=%d:%u:%s\n", self->numeric_id, self->mode, self->segments_written, thread_stats);
+    fflush(g.out);
+    return SUCCEEDED;
+    }
+
+struct hlssink *hlssink_init(struct threads_info *ti, int numeric_id)
+    {
+    struct hlssink *self;
+
+    if (!(self = calloc(1, sizeof (struct hlssink))))
+        {
+        fprintf(stderr, "hlssink_init: malloc failure\n");
+        return NULL;
+        }
+    self->threads_info = ti;
+    self->numeric_id = numeric_id;
+    pthread_mutex_init(&self->mode_mutex, NULL);
+    pthread_cond_init(&self->mode_cv, NULL);
+    return self;
+    }
+
+void hlssink_destroy(struct hlssink *self)
+    {
+    if (self->thread_started)
+        {
+        pthread_mutex_lock(&self->mode_mutex);
+        self->thread_terminate_f = TRUE;
+        pthread_cond_signal(&self->mode_cv);
+        pthread_mutex_unlock(&self->mode_mutex);
+        pthread_join(self->thread_h, NULL);
+        }
+    pthread_cond_destroy(&self->mode_cv);
+    pthread_mutex_destroy(&self->mode_mutex);
+    free(self);
+    }
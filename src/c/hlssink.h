@@ -0,0 +1,88 @@
+/*
+#   hlssink.h: cuts an encoder's output into segments with a rolling playlist
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HLSSINK_H
+#define HLSSINK_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "sourceclient.h"
+#include "threadstat.h"
+
+/* the most segments a playlist may list */
+#define HLSSINK_MAX_WINDOW 64
+
+enum hls_mode { HM_STOPPED, HM_RUNNING, HM_STOPPING };
+
+struct hlssink_vars
+    {
+    char *hls_source;            /* the encoder to take packets from */
+    char *hls_folder;            /* where the segments and playlist go, served by the web server */
+    char *hls_name;              /* the playlist is <name>.m3u8, the segments <name>-<n>.<ext> */
+    char *hls_segment_s;         /* target segment duration, default 6 */
+    char *hls_window;            /* segments in the playlist, default 6 */
+    };
+
+struct hlssink_segment
+    {
+    unsigned seq;                /* media sequence number */
+    double duration;
+    };
+
+struct hlssink
+    {
+    struct threads_info *threads_info;
+    int numeric_id;
+    pthread_t thread_h;
+    int thread_started;          /* the thread is made on the first start */
+    struct threadstat threadstat;
+    struct threadstat_report threadstat_reported;
+    pthread_mutex_t mode_mutex;
+    pthread_cond_t mode_cv;      /* wakes the thread from HM_STOPPED */
+    int thread_terminate_f;
+    int stop_request;
+    enum hls_mode mode;
+    struct encoder_op *encoder_op;
+    int initial_serial;          /* packets of earlier serials are passed over */
+    int synced;                  /* found a place the output may start */
+    char *folder;
+    char *name;
+    const char *ext;             /* segment file extension */
+    double target_s;
+    int window;
+    FILE *fp;                    /* the segment being written */
+    unsigned seq;                /* its media sequence number */
+    double seg_duration;         /* how much it holds */
+    int last_serial;             /* for the segment duration across a change of serial */
+    double last_timestamp;
+    char *headers;               /* ogg or webm headers that start each segment */
+    size_t headers_size;
+    int headers_serial;
+    struct hlssink_segment list[HLSSINK_MAX_WINDOW]; /* the playlist, oldest first */
+    int n_listed;
+    unsigned segments_written;
+    };
+
+struct hlssink *hlssink_init(struct threads_info *ti, int numeric_id);
+void hlssink_destroy(struct hlssink *self);
+int hlssink_start(struct threads_info *ti, struct universal_vars *uv, void *other);
+int hlssink_stop(struct threads_info *ti, struct universal_vars *uv, void *other);
+int hlssink_make_report(struct hlssink *self);
+
+#endif /* HLSSINK_H */
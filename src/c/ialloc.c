@@ -22,9 +22,13 @@
 #include <jack/jack.h>
 #include <stdio.h>
 #include <assert.h>
+#include "rtarena.h"
 
 typedef jack_default_audio_sample_t sample_t;
 
+/* the period buffers are used in the process callback so they are faulted in and locked
+ * freed ones go back to the heap still resident, which is no bad thing
+ */
 sample_t *ialloc(jack_nframes_t size)
     {
     sample_t *buf;
@@ -34,6 +38,7 @@ sample_t *ialloc(jack_nframes_t size)
         fprintf(stderr, "ialloc: malloc failure\n");
         exit(5);
         }
+    rtarena_lock(buf, sizeof (sample_t) * size);
 
     return buf;
     }
@@ -252,6 +252,30 @@ void id3_compile(struct id3_tag *tag)
     id3_collect_frame_data(tag->first_frame, &wp);
     }
 
+/* id3_pad_to: extend the padding of a compiled tag so it is exactly size bytes long
+ * returns 0 if the tag is already bigger than that
+ */
+int id3_pad_to(struct id3_tag *tag, size_t size)
+    {
+    char *newdata;
+    uint32_t ssint;
+
+    if (!tag->tag_data || tag->tag_data_size > size)
+        return 0;
+    if (!(newdata = realloc(tag->tag_data, size)))
+        {
+        fprintf(stderr, "id3_pad_to: malloc failure\n");
+        return 0;
+        }
+    memset(newdata + tag->tag_data_size, 0, size - tag->tag_data_size);
+    tag->padding += size - tag->tag_data_size;
+    tag->tag_data = newdata;
+    tag->tag_data_size = size;
+    id3_syncsafe_int(size - 10, &ssint);
+    memcpy(newdata + 6, &ssint, 4);
+    return 1;
+    }
+
 void id3_embed_frame(struct id3_frame *parent, struct id3_frame *child)
     {
     child->next = parent->first_embedded_frame;
@@ -88,6 +88,7 @@ void   id3_add_frame(struct id3_tag *tag, struct id3_frame *frame);
 void   id3_embed_frame(struct id3_frame *parent, struct id3_frame *child);
 struct id3_frame *id3_chap_frame_new(char *unique_id, uint32_t start_ms, uint32_t end_ms, uint32_t start_byte, uint32_t end_byte);
 void id3_compile(struct id3_tag *tag);
+int id3_pad_to(struct id3_tag *tag, size_t size);
 void id3_decompile(struct id3_tag *tag);
 void id3_remove_frame(struct id3_frame *frame);
 void id3_frame_destroy(struct id3_frame *frame);
@@ -0,0 +1,189 @@
+/*
+#   indexcache.c: on-disk cache of per media file indexes
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "indexcache.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* indexcache_dir: where the cache files go
+ * $index_cache_dir overrides the XDG location and an empty value turns caching off
+ */
+static char *indexcache_dir(const char *kind)
+    {
+    char *env, *dir;
+    int rv;
+
+    if ((env = getenv("index_cache_dir")))
+        rv = env[0] ? asprintf(&dir, "%s/%s", env, kind) : -1;
+    else
+        if ((env = getenv("XDG_CACHE_HOME")) && env[0])
+            rv = asprintf(&dir, "%s/idjc/%s", env, kind);
+        else
+            rv = (env = getenv("HOME")) ? asprintf(&dir, "%s/.cache/idjc/%s", env, kind) : -1;
+
+    return (rv < 0) ? NULL : dir;
+    }
+
+static int mkdir_parents(char *dir)
+    {
+    char *p;
+
+    for (p = dir + 1; *p; ++p)
+        if (*p == '/')
+            {
+            *p = '\0';
+            if (mkdir(dir, 0700) && errno != EEXIST)
+                {
+                *p = '/';
+                return FALSE;
+                }
+            *p = '/';
+            }
+
+    return !mkdir(dir, 0700) || errno == EEXIST;
+    }
+
+/* one cache file per media pathname, named after its FNV-1a hash */
+static uint64_t path_hash(const char *s)
+    {
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*s)
+        {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+        }
+    return h;
+    }
+
+int indexcache_key_init(struct indexcache_key *key, const char *kind, const char *pathname)
+    {
+    struct stat st;
+    char *dir;
+
+    /* a newline would make the pathname line of the cache file ambiguous */
+    if (strchr(pathname, '\n') || stat(pathname, &st) || !S_ISREG(st.st_mode) || !(dir = indexcache_dir(kind)))
+        return FALSE;
+
+    key->size = st.st_size;
+    key->mtime = st.st_mtime;
+    if (!(key->pathname = strdup(pathname)) || asprintf(&key->cache_pathname, "%s/%016llx", dir, (unsigned long long)path_hash(pathname)) < 0)
+        {
+        fprintf(stderr, "indexcache_key_init: malloc failure\n");
+        free(key->pathname);
+        free(dir);
+        return FALSE;
+        }
+
+    free(dir);
+    return TRUE;
+    }
+
+void indexcache_key_free(struct indexcache_key *key)
+    {
+    free(key->cache_pathname);
+    free(key->pathname);
+    }
+
+FILE *indexcache_read_open(struct indexcache_key *key, const char *magic)
+    {
+    FILE *fp;
+    char *line = NULL;
+    size_t linesize = 0;
+    ssize_t len;
+    long long size, mtime;
+
+    if (!(fp = fopen(key->cache_pathname, "r")))
+        return NULL;
+
+    if ((len = getline(&line, &linesize, fp)) < 1 || line[len - 1] != '\n')
+        goto fail;
+    line[len - 1] = '\0';
+    if (strcmp(line, magic))
+        goto fail;
+
+    /* the pathname is stored too as hashes can collide */
+    if ((len = getline(&line, &linesize, fp)) < 1 || line[len - 1] != '\n')
+        goto fail;
+    line[len - 1] = '\0';
+    if (strcmp(line, key->pathname))
+        goto fail;
+
+    if (fscanf(fp, "%lld %lld", &size, &mtime) != 2 || size != key->size || mtime != key->mtime)
+        goto fail;
+
+    free(line);
+    return fp;
+
+    fail:
+    free(line);
+    fclose(fp);
+    return NULL;
+    }
+
+FILE *indexcache_write_open(struct indexcache_key *key, const char *magic, char **tmp)
+    {
+    FILE *fp;
+    char *dir;
+    int ok;
+
+    if (!(dir = strdup(key->cache_pathname)))
+        return NULL;
+    *strrchr(dir, '/') = '\0';
+    ok = mkdir_parents(dir);
+    free(dir);
+    if (!ok)
+        {
+        fprintf(stderr, "indexcache_write_open: unable to create the cache directory for %s\n", key->cache_pathname);
+        return NULL;
+        }
+
+    /* write then rename so concurrent readers only ever see a whole file */
+    if (asprintf(tmp, "%s.%d.%lx", key->cache_pathname, (int)getpid(), (unsigned long)pthread_self()) < 0)
+        return NULL;
+
+    if (!(fp = fopen(*tmp, "w")))
+        {
+        free(*tmp);
+        return NULL;
+        }
+
+    fprintf(fp, "%s\n%s\n%lld %lld\n", magic, key->pathname, (long long)key->size, (long long)key->mtime);
+    return fp;
+    }
+
+void indexcache_write_close(struct indexcache_key *key, FILE *fp, char *tmp)
+    {
+    int ok = !ferror(fp);
+
+    if (fclose(fp) || !ok || rename(tmp, key->cache_pathname))
+        unlink(tmp);
+    free(tmp);
+    }
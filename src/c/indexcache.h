@@ -0,0 +1,53 @@
+/*
+#   indexcache.h: on-disk cache of per media file indexes
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INDEXCACHE_H
+#define INDEXCACHE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* a media file's identity, cache entries are void once any of this changes */
+struct indexcache_key
+    {
+    char *pathname;             /* the media file */
+    char *cache_pathname;       /* where its index lives on disk */
+    off_t size;
+    time_t mtime;
+    };
+
+/* indexcache_key_init: identify a media file for an index of the given kind
+ * fails for anything but regular files or when $index_cache_dir is empty
+ */
+int indexcache_key_init(struct indexcache_key *key, const char *kind, const char *pathname);
+void indexcache_key_free(struct indexcache_key *key);
+
+/* indexcache_read_open: open a cache entry positioned after its header
+ * returns NULL if there isn't one or it belongs to a different file
+ */
+FILE *indexcache_read_open(struct indexcache_key *key, const char *magic);
+
+/* indexcache_write_open: start a replacement entry, header written
+ * the entry only becomes visible once indexcache_write_close succeeds
+ */
+FILE *indexcache_write_open(struct indexcache_key *key, const char *magic, char **tmp);
+void indexcache_write_close(struct indexcache_key *key, FILE *fp, char *tmp);
+
+#endif /* INDEXCACHE_H */
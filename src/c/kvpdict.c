@@ -22,76 +22,248 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <glib.h>
 #include "kvpdict.h"
 #include "bsdcompat.h"
 
-/* kvp_extract_value: extract the value of a key value pair from a string. The value is a copy of the orignial and is allocated on the heap.  The returned "value" should be destroyed with free() when no longer needed.  The string supplied is truncated at the = sign */
+/* kvp_extract_value: find the value of a key value pair in a string.  The string supplied is truncated at the = sign and at the newline so the value returned points into it and is not a copy */
 char *kvp_extract_value(char *pair)
     {
-    char *part2, *value;
+    char *part2, *nl;
     
     if (!(part2 = strchr(pair, '=')))    /* calling program must supply a Key Value Pair */
         {
         fprintf(stderr, "kvp_extract_value: not a key=value pair: %s\n", pair);
-        return strdup("");
+        return "";
         }
     *part2++ = '\0';     /* point to the second half of the KVP and terminate the 1st also removing the \n character */
-    *strchr(part2, '\n') = '\0';
-    if (!(value = strdup(part2)))        /* make a separate copy of the value */
+    if ((nl = strchr(part2, '\n')))
+        *nl = '\0';
+    return part2;
+    }
+
+/* values that don't persist are carved out of an arena which is emptied as each message begins
+ * once the arena has grown to fit the largest message parsing needs no further allocations
+ */
+struct kvp_arena_chunk
+    {
+    struct kvp_arena_chunk *next;
+    size_t size;
+    size_t used;
+    char data[];
+    };
+
+/* the length and capacity of each value are kept so that "+" appends take amortised linear time */
+struct kvp_slot
+    {
+    char *value;         /* what the target was last set to, it may have been changed since if persistent */
+    size_t length;
+    size_t capacity;
+    };
+
+/* each dictionary gets a hash table of its keys the first time it is used, an arena and a slot per entry
+ * these are themselves kept in a table keyed on the address of the dictionary
+ */
+struct kvp_dict_state
+    {
+    GHashTable *index;
+    struct kvp_arena_chunk *arena;
+    struct kvp_slot *slots;
+    };
+
+static GHashTable *dict_indexes;
+static pthread_mutex_t dict_indexes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void kvp_dict_state_destroy(struct kvp_dict_state *state)
+    {
+    struct kvp_arena_chunk *chunk, *next;
+
+    for (chunk = state->arena; chunk; chunk = next)
         {
-        fprintf(stderr, "kvp_extract_value: malloc failure\n");
-        exit(-5);
+        next = chunk->next;
+        free(chunk);
         }
-    return value;
+    g_hash_table_destroy(state->index);
+    free(state->slots);
+    free(state);
     }
 
-/* dict_apply_to_target: sets a pointers object listed in a kvpdict to point to target when its key matches the one supplied to the function.  Target is not made a member of the dictionary, but rather one of the dictionary members, which is itself a pointer is set to point to target.  The memory used by the old target is freed */
-int kvp_apply_to_dict(struct kvpdict *dp, char *key, char *target)
+/* kvp_dict_state: the key lookup table and value storage for dictionary dp, built on first use */
+static struct kvp_dict_state *kvp_dict_state(struct kvpdict *dp)
     {
-    int append;
-    size_t origtext_siz, newtext_siz;
+    struct kvp_dict_state *state;
+    struct kvpdict *entry;
 
-    if ((append = (key[0] == '+')))      /* If key starts with a plus we will not replace -- we will append */
-        ++key;
+    pthread_mutex_lock(&dict_indexes_mutex);
+    if (!dict_indexes)
+        dict_indexes = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)kvp_dict_state_destroy);
+    if (!(state = g_hash_table_lookup(dict_indexes, dp)))
+        {
+        for (entry = dp; entry->target; entry++);
+        if (!(state = calloc(1, sizeof (struct kvp_dict_state))) ||
+                    !(state->slots = calloc(entry - dp + 1, sizeof (struct kvp_slot))))
+            {
+            fprintf(stderr, "kvp_dict_state: malloc failure\n");
+            exit(5);
+            }
+        state->index = g_hash_table_new(g_str_hash, g_str_equal);
+        for (entry = dp; entry->target; entry++)
+            if (!g_hash_table_lookup(state->index, entry->key))    /* the first of any duplicates wins as before */
+                g_hash_table_insert(state->index, entry->key, entry);
+        g_hash_table_insert(dict_indexes, dp, state);
+        }
+    pthread_mutex_unlock(&dict_indexes_mutex);
+    return state;
+    }
+
+/* kvp_arena_alloc: space for a value that lasts until the next message */
+static char *kvp_arena_alloc(struct kvp_dict_state *state, size_t size)
+    {
+    struct kvp_arena_chunk *chunk = state->arena, *newchunk;
+    size_t chunk_size;
+    char *p;
+
+    if (!chunk || chunk->size - chunk->used < size)
+        {
+        chunk_size = chunk ? chunk->size * 2 : 4096;
+        if (chunk_size < size)
+            chunk_size = size;
+        if (!(newchunk = malloc(sizeof (struct kvp_arena_chunk) + chunk_size)))
+            {
+            fprintf(stderr, "kvp_arena_alloc: malloc failure\n");
+            exit(5);
+            }
+        newchunk->next = chunk;
+        newchunk->size = chunk_size;
+        newchunk->used = 0;
+        state->arena = chunk = newchunk;
+        }
+    p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+    }
+
+/* kvp_begin_message: values from the last message that were not persistent are dropped and their space reused
+ * only the largest chunk of the arena is kept so it soon settles at a size that fits every message
+ */
+void kvp_begin_message(struct kvpdict *dp)
+    {
+    struct kvp_dict_state *state = kvp_dict_state(dp);
+    struct kvp_arena_chunk *chunk, *next;
+    struct kvpdict *entry;
+
+    for (entry = dp; entry->target; entry++)
+        if (!entry->persist && *entry->target)
+            {
+            if (entry->pm)
+                pthread_mutex_lock(entry->pm);
+            *entry->target = NULL;
+            if (entry->pm)
+                pthread_mutex_unlock(entry->pm);
+            }
+
+    if (state->arena)
+        {
+        for (chunk = state->arena->next; chunk; chunk = next)
+            {
+            next = chunk->next;
+            free(chunk);
+            }
+        state->arena->next = NULL;
+        state->arena->used = 0;
+        }
+    }
 
-    for (; dp->target; dp++)             /* Iterate over NULL terminated dictionary */
+/* kvp_set_value: replace or append to the value of one entry of the dictionary */
+static void kvp_set_value(struct kvp_dict_state *state, struct kvpdict *entry, struct kvp_slot *slot, const char *value, size_t length, int append)
+    {
+    size_t capacity;
+    char *newvalue;
+
+    if (append && *entry->target)
         {
-        if (!strcmp(key, dp->key))        /* If the key matches */
+        /* a persistent value may have been replaced by its owner since it was last set here */
+        if (*entry->target != slot->value)
+            {
+            slot->value = *entry->target;
+            slot->capacity = (slot->length = strlen(slot->value)) + 1;
+            }
+        /* the extra two bytes are for the newline that separates appends and the terminator */
+        if (slot->length + length + 2 > slot->capacity)
             {
-            if (dp->pm)                    /* If a pthread mutex is supplied then use it */
-                pthread_mutex_lock(dp->pm);
-            if (!append)
+            for (capacity = slot->capacity * 2; capacity < slot->length + length + 2; capacity *= 2);
+            if (entry->persist)
+                newvalue = realloc(slot->value, capacity);
+            else if ((newvalue = kvp_arena_alloc(state, capacity)))
+                memcpy(newvalue, slot->value, slot->length);
+            if (!newvalue)
                 {
-                if (*(dp->target))          /* Conditionally free the old target buffer */
-                    free(*(dp->target));
-                *(dp->target) = target;     /* Dictionary member's pointer gets a new target */
+                fprintf(stderr, "malloc failure\n");
+                exit(5);
                 }
-            else
+            slot->value = newvalue;
+            slot->capacity = capacity;
+            }
+        memcpy(slot->value + slot->length, value, length);
+        memcpy(slot->value + slot->length + length, "\n", 2);
+        slot->length += length + 1;
+        }
+    else
+        {
+        if (entry->persist)
+            {
+            if (*entry->target)         /* Conditionally free the old target buffer */
+                free(*entry->target);
+            if (!(newvalue = malloc(length + 2)))
                 {
-                /* append mode -- multiple appends separated by a newline character */
-                *(dp->target) = realloc(*(dp->target), (origtext_siz = strlen(*(dp->target))) + (newtext_siz = strlen(target)) + 2);
-                if (!(*(dp->target)))
-                    {
-                    fprintf(stderr, "malloc failure\n");
-                    exit(5);
-                    }
-                memcpy(*(dp->target) + origtext_siz, target, newtext_siz);
-                memcpy(*(dp->target) + origtext_siz + newtext_siz, "\n", 2);
-                free(target);
+                fprintf(stderr, "malloc failure\n");
+                exit(5);
                 }
-            if (dp->pm)                    /* Unlock the pthread mutex if one was specified */
-                pthread_mutex_unlock(dp->pm);
-            return 1;                      /* We have a match so return 1 */
             }
+        else
+            newvalue = kvp_arena_alloc(state, length + 2);
+        memcpy(newvalue, value, length);
+        newvalue[length] = '\0';
+        if (append)                     /* appending to nothing yields the value and a newline */
+            memcpy(newvalue + length++, "\n", 2);
+        slot->value = newvalue;
+        slot->length = length;
+        slot->capacity = length + 2 - append;
+        }
+    *entry->target = slot->value;       /* Dictionary member's pointer gets a new target */
+    }
+
+/* kvp_apply_to_dict: sets a pointer object listed in a kvpdict to point to a copy of value when its key matches the one supplied to the function.  The copy is not made a member of the dictionary, but rather one of the dictionary members, which is itself a pointer is set to point to it.  The space used by the old value is reused or freed */
+int kvp_apply_to_dict(struct kvpdict *dp, char *key, const char *value, size_t length)
+    {
+    struct kvp_dict_state *state = kvp_dict_state(dp);
+    struct kvpdict *entry;
+    int append;
+
+    if ((append = (key[0] == '+')))      /* If key starts with a plus we will not replace -- we will append */
+        ++key;
+
+    if ((entry = g_hash_table_lookup(state->index, key)))   /* If the key matches */
+        {
+        if (entry->pm)                 /* If a pthread mutex is supplied then use it */
+            pthread_mutex_lock(entry->pm);
+        kvp_set_value(state, entry, state->slots + (entry - dp), value, length, append);
+        if (entry->pm)                 /* Unlock the pthread mutex if one was specified */
+            pthread_mutex_unlock(entry->pm);
+        return 1;                      /* We have a match so return 1 */
         }
     return 0;                            /* No matches */
     }
 
 void kvp_free_dict(struct kvpdict *dp)
     {
+    pthread_mutex_lock(&dict_indexes_mutex);
+    if (dict_indexes)
+        g_hash_table_remove(dict_indexes, dp);
+    pthread_mutex_unlock(&dict_indexes_mutex);
     while (dp->key)
         {
-        if (*(dp->target))
+        if (dp->persist && *(dp->target))
             free(*(dp->target));
         *dp->target = NULL;
         dp++;
@@ -19,6 +19,7 @@
 #ifndef KVPDICT_H
 #define KVPDICT_H
 
+#include <stddef.h>
 #include <pthread.h>
 
 struct kvpdict
@@ -27,10 +28,15 @@ struct kvpdict
     char **target;       /* the aim here is to set another pointer to the new value
                                 rather than to make the new value a member of the dictionary */
     pthread_mutex_t *pm; /* if a lock is supplied here it will be used */
+    int persist;         /* the value is on the heap and outlives the message, otherwise
+                                it is gone when the next message begins */
     };
+
+#define KVP_PERSIST 1
     
 char *kvp_extract_value(char *keyvaluepair);
-int kvp_apply_to_dict(struct kvpdict *kvpdict, char *key, char *newtarget);
+void kvp_begin_message(struct kvpdict *kvpdict);
+int kvp_apply_to_dict(struct kvpdict *kvpdict, char *key, const char *value, size_t length);
 void kvp_free_dict(struct kvpdict *dp);
 
 #endif
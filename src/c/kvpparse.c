@@ -21,15 +21,74 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "kvpparse.h"
 #include "bsdcompat.h"
 
 static char *buffer;
 
+/* the last message parsed in frame form, kept when recording */
+static int keep_messages;
+static unsigned char *kept;
+static size_t kept_length, kept_size;
+
 static void kvp_cleanup()
     {
     if (buffer)
         free(buffer);
+    free(kept);
+    }
+
+static void kvp_keep(const void *data, size_t length)
+    {
+    unsigned char *newkept;
+    size_t newsize;
+
+    if (kept_length + length > kept_size)
+        {
+        for (newsize = kept_size ? kept_size : 4096; newsize < kept_length + length; newsize *= 2);
+        if (!(newkept = realloc(kept, newsize)))
+            {
+            fprintf(stderr, "kvp_keep: malloc failure\n");
+            exit(5);
+            }
+        kept = newkept;
+        kept_size = newsize;
+        }
+    memcpy(kept + kept_length, data, length);
+    kept_length += length;
+    }
+
+/* kvp_keep_pair: a text mode key value pair as a frame record */
+static void kvp_keep_pair(const char *key, const char *value)
+    {
+    size_t key_length = strlen(key), length = strlen(value);
+    unsigned char key_length8 = key_length;
+    uint16_t value_length = length;
+
+    if (key_length > 255 || length > UINT16_MAX)
+        {
+        fprintf(stderr, "kvp_keep_pair: %s is too long to record\n", key);
+        return;
+        }
+    kvp_keep(&key_length8, 1);
+    kvp_keep(key, key_length);
+    kvp_keep(&value_length, sizeof value_length);
+    kvp_keep(value, length);
+    }
+
+void kvp_keep_messages(int keep)
+    {
+    keep_messages = keep;
+    kept_length = 0;
+    }
+
+int kvp_write_message(FILE *fp)
+    {
+    uint32_t length = kept_length;
+
+    return fwrite(&length, sizeof length, 1, fp) == 1 && (!length || fwrite(kept, length, 1, fp) == 1);
     }
 
 int kvp_parse(struct kvpdict *kvpdict, FILE *fp)
@@ -48,12 +107,16 @@ int kvp_parse(struct kvpdict *kvpdict, FILE *fp)
         atexit(kvp_cleanup);
         } 
 
+    kvp_begin_message(kvpdict);
+    kept_length = 0;
     while (rv = getline(&buffer, &n, fp), rv > 0 && strcmp(buffer, "end\n"))
         {
         /* the following function is fed a key value pair e.g. key=value */
         value = kvp_extract_value(buffer); /* key is truncated at the = */
-        /* value = a pointer to a copy of the value part after the '=' allocated on the heap */
-        if(!(kvp_apply_to_dict(kvpdict, buffer, value)))
+        if (keep_messages)
+            kvp_keep_pair(buffer, value);
+        /* value = a pointer to the value part after the '=' which the dictionary will copy */
+        if(!(kvp_apply_to_dict(kvpdict, buffer, value, strlen(value))))
             fprintf(stderr, "kvp_parse: %s=%s, key missing from dictionary\n", buffer, value);
         /* assuming the error message wasn't printed the associated pointer in the dictionary will have been updated */
         }
@@ -62,3 +125,61 @@ int kvp_parse(struct kvpdict *kvpdict, FILE *fp)
         fprintf(stderr, "getline failed to allocate a buffer in function kvp_parse\n");
     return rv > 0;
     }
+
+/* kvp_parse_frame: the binary counterpart of kvp_parse
+ * a 32 bit length in native byte order is followed by that many bytes of records
+ * each made of an 8 bit key length, the key, a 16 bit value length and the value
+ * values may contain any byte including newlines so need no escaping
+ */
+int kvp_parse_frame(struct kvpdict *kvpdict, FILE *fp)
+    {
+    static unsigned char *frame;
+    static size_t frame_size;
+    unsigned char *p, *end, *newframe;
+    uint32_t length;
+    uint16_t value_length;
+    char key[256];
+    size_t key_length;
+
+    if (fread(&length, sizeof length, 1, fp) != 1)
+        return 0;
+    if (length > frame_size)
+        {
+        if (!(newframe = realloc(frame, length)))
+            {
+            fprintf(stderr, "kvp_parse_frame: malloc failure\n");
+            exit(5);
+            }
+        frame = newframe;
+        frame_size = length;
+        }
+    if (length && fread(frame, length, 1, fp) != 1)
+        return 0;
+
+    kvp_begin_message(kvpdict);
+    kept_length = 0;
+    if (keep_messages)
+        kvp_keep(frame, length);
+    for (p = frame, end = frame + length; p < end; p += value_length)
+        {
+        key_length = *p++;
+        if (end - p < (ptrdiff_t)(key_length + sizeof value_length))
+            {
+            fprintf(stderr, "kvp_parse_frame: truncated record\n");
+            return 0;
+            }
+        memcpy(key, p, key_length);
+        key[key_length] = '\0';
+        p += key_length;
+        memcpy(&value_length, p, sizeof value_length);
+        p += sizeof value_length;
+        if (end - p < value_length)
+            {
+            fprintf(stderr, "kvp_parse_frame: truncated record\n");
+            return 0;
+            }
+        if (!(kvp_apply_to_dict(kvpdict, key, (char *)p, value_length)))
+            fprintf(stderr, "kvp_parse_frame: %s=%.*s, key missing from dictionary\n", key, (int)value_length, p);
+        }
+    return 1;
+    }
@@ -20,3 +20,10 @@
 #include "kvpdict.h"
 
 int kvp_parse(struct kvpdict *kvpdict, FILE *fp);
+int kvp_parse_frame(struct kvpdict *kvpdict, FILE *fp);
+
+/* kvp_keep_messages: have the parsers keep each message, text or framed, for kvp_write_message */
+void kvp_keep_messages(int keep);
+
+/* kvp_write_message: the last message parsed as a frame kvp_parse_frame can read back */
+int kvp_write_message(FILE *fp);
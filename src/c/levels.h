@@ -0,0 +1,69 @@
+/*
+#   levels.h: the fixed layout binary meter report sent to the user interface
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include <stdint.h>
+
+/* a report is the header followed by n_players player records then n_mics mic records
+ * all fields are in native byte order as both ends run on the same machine
+ * the user interface unpacks these with the struct formats given alongside
+ */
+#define LEVELS_MAGIC 0x4C564C53
+#define LEVELS_VERSION 1
+#define LEVELS_NAME_SIZE 16
+
+struct levels_header                     /* "=IHHHH7i" */
+    {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t n_players;
+    uint16_t n_mics;
+    uint16_t reserved;
+    int32_t str_l_peak;
+    int32_t str_r_peak;
+    int32_t str_l_rms;
+    int32_t str_r_rms;
+    int32_t ports_connections_changed;
+    int32_t effects_playing;
+    int32_t freewheel_mode;
+    };
+
+struct levels_player                     /* "=16s5if" */
+    {
+    char name[LEVELS_NAME_SIZE];         /* the key prefix of the text report */
+    int32_t elapsed;
+    int32_t playing;
+    int32_t signal;
+    int32_t cid;
+    int32_t audio_runout;
+    float silence;
+    };
+
+struct levels_mic                        /* "=5i" */
+    {
+    int32_t id;
+    int32_t peak;
+    int32_t red;
+    int32_t yellow;
+    int32_t green;
+    };
+
+#endif /* LEVELS_H */
@@ -37,6 +37,7 @@
 #include <libswresample/swresample.h>
 
 #include "main.h"
+#include "sig.h"
 #include "sourceclient.h"
 #include "live_aac_encoder.h"
 
@@ -60,8 +61,13 @@ typedef struct State {
     size_t buf_size;
     int sri;
     AVPacket *pkt;
+    char *encoder_name;         /* preferred libavcodec encoder or NULL */
+    int thread_count;
 } State;
 
+/* seconds of audio encoded for each benchmark result */
+#define BENCHMARK_SECONDS 10
+
 
 static void avcodec_safe_close(AVCodecContext **c)
 {
@@ -72,11 +78,52 @@ static void avcodec_safe_close(AVCodecContext **c)
 }
 
 
+/* find_encoder: the named encoder or failing that the best one available for the profile */
+static const AVCodec *find_encoder(const char *name, enum AVCodecID codec_id, int profile)
+{
+    const AVCodec *codec;
+
+    if (name && name[0]) {
+        if ((codec = avcodec_find_encoder_by_name(name)) && codec->id == codec_id)
+            return codec;
+        fprintf(stderr, "encoder '%s' is not available, using the default\n", name);
+    }
+
+    /* the native encoder doesn't do HE-AAC */
+    if (profile == FF_PROFILE_AAC_HE_V2 && (codec = avcodec_find_encoder_by_name("libfdk_aac")))
+        return codec;
+    return avcodec_find_encoder(codec_id);
+}
+
+
+/* set_threads: use the codec's own threading where it has any, 0 threads means automatic */
+static void set_threads(AVCodecContext *c, const AVCodec *codec, int threads)
+{
+    if (threads == 1)
+        return;
+
+    if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)
+        c->thread_type = FF_THREAD_FRAME;
+    else if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
+        c->thread_type = FF_THREAD_SLICE;
+#ifdef AV_CODEC_CAP_OTHER_THREADS
+    else if (!(codec->capabilities & AV_CODEC_CAP_OTHER_THREADS))
+#else
+    else
+#endif
+    {
+        fprintf(stderr, "encoder '%s' is single threaded\n", codec->name);
+        return;
+    }
+    c->thread_count = threads;
+}
+
+
 static const AVCodec *add_stream(State *self, enum AVCodecID codec_id,
                            int profile, int br, int sr, int ch)
 {
     AVCodecContext *c;
-    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    const AVCodec *codec = find_encoder(self->encoder_name, codec_id, profile);
 
     if (!codec) {
         fprintf(stderr, "could not find encoder for '%s'\n",
@@ -106,6 +153,8 @@ static const AVCodec *add_stream(State *self, enum AVCodecID codec_id,
     c->channels    = ch;
     c->channel_layout = (ch == 2) ? AV_CH_LAYOUT_STEREO : AV_CH_LAYOUT_MONO;
     c->profile = profile;
+    set_threads(c, codec, self->thread_count);
+    fprintf(stderr, "using encoder '%s'\n", codec->name);
     self->st->id = 0;
     self->st->time_base = (AVRational){ 1, sr };
 
@@ -531,6 +580,9 @@ fail1:
 
 static void teardown(State *self)
 {
+    char *encoder_name = self->encoder_name;
+    int thread_count = self->thread_count;
+
     close_stream(self);
     av_freep(&self->avio_ctx->buffer);
     av_freep(&self->avio_ctx);
@@ -540,6 +592,8 @@ static void teardown(State *self)
     if (self->buf)
         free(self->buf);
     memset(self, '\0', sizeof (State));
+    self->encoder_name = encoder_name;
+    self->thread_count = thread_count;
 }
 
 
@@ -594,6 +648,7 @@ bailout:
     encoder->run_encoder = NULL;
     encoder->flush = FALSE;
     encoder->encoder_private = NULL;
+    free(self->encoder_name);
     free(self);
     fprintf(stderr, "live_aac_encoder_main: finished cleanup\n");
 }
@@ -608,9 +663,210 @@ int live_aac_encoder_init(struct encoder *encoder, struct encoder_vars *ev)
         return FAILED;
     }
 
+    if (ev->aac_encoder && ev->aac_encoder[0] && !(self->encoder_name = strdup(ev->aac_encoder))) {
+        fprintf(stderr, "malloc failure\n");
+        free(self);
+        return FAILED;
+    }
+    self->thread_count = ev->codec_threads ? atoi(ev->codec_threads) : 1;
+
     encoder->encoder_private = self;
     encoder->run_encoder = live_aac_encoder_main;
     return SUCCEEDED;
 }
 
+
+/* benchmark_fill: a tone with some noise so the encoder has real work to do */
+static void benchmark_fill(AVFrame *frame, int ch, double *phase)
+{
+    for (int i = 0; i < frame->nb_samples; i++) {
+        float v = 0.5f * sinf(*phase) + 0.1f * ((float)rand() / RAND_MAX - 0.5f);
+
+        if ((*phase += 2.0 * M_PI * 440.0 / frame->sample_rate) > 2.0 * M_PI)
+            *phase -= 2.0 * M_PI;
+        for (int j = 0; j < ch; j++)
+            switch (frame->format) {
+                case AV_SAMPLE_FMT_FLTP:
+                    ((float *)frame->data[j])[i] = v;
+                    break;
+                case AV_SAMPLE_FMT_FLT:
+                    ((float *)frame->data[0])[i * ch + j] = v;
+                    break;
+                case AV_SAMPLE_FMT_S16P:
+                    ((int16_t *)frame->data[j])[i] = (int16_t)(v * 32767.0f);
+                    break;
+                case AV_SAMPLE_FMT_S16:
+                    ((int16_t *)frame->data[0])[i * ch + j] = (int16_t)(v * 32767.0f);
+                    break;
+                default:
+                    break;
+            }
+    }
+}
+
+
+/* benchmark_run: encode generated stereo audio, returns the speed as a multiple of real time */
+static double benchmark_run(const AVCodec *codec, int profile, int br, int threads)
+{
+    const int sr = 44100, ch = 2;
+    const int64_t total = (int64_t)sr * BENCHMARK_SECONDS;
+    AVCodecContext *c;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
+    struct timespec t0, t1;
+    double elapsed, speed = 0.0, phase = 0.0;
+    int64_t done = 0;
+    int ret;
+
+    if (!(c = avcodec_alloc_context3(codec)))
+        return 0.0;
+    c->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    c->bit_rate = br * 1000;
+    c->sample_rate = sr;
+    c->channels = ch;
+    c->channel_layout = AV_CH_LAYOUT_STEREO;
+    c->profile = profile;
+    c->time_base = (AVRational){ 1, sr };
+    set_threads(c, codec, threads);
+
+    while (pthread_mutex_trylock(&g.avc_mutex))
+        nanosleep(&time_delay, NULL);
+    ret = avcodec_open2(c, codec, NULL);
+    pthread_mutex_unlock(&g.avc_mutex);
+    if (ret < 0)
+        goto cleanup;
+
+    if (!(frame = alloc_audio_frame(c->sample_fmt, c->channel_layout, sr, c->frame_size ? c->frame_size : 1024)) || !(pkt = av_packet_alloc()))
+        goto cleanup;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (done < total) {
+        if (av_frame_make_writable(frame) < 0)
+            goto cleanup;
+        benchmark_fill(frame, ch, &phase);
+        frame->pts = done;
+        done += frame->nb_samples;
+#ifdef HAVE_AVCODEC_RECEIVE_PACKET
+        if (avcodec_send_frame(c, frame) < 0)
+            goto cleanup;
+        while (!avcodec_receive_packet(c, pkt))
+            av_packet_unref(pkt);
+#else
+        int got_packet;
+
+        if (avcodec_encode_audio2(c, pkt, frame, &got_packet) < 0)
+            goto cleanup;
+        if (got_packet)
+            av_packet_unref(pkt);
+#endif
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if ((elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9) > 0.0)
+        speed = BENCHMARK_SECONDS / elapsed;
+
+cleanup:
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_safe_close(&c);
+    return speed;
+}
+
+
+/* results of the benchmark running in the background, collected until the next report */
+static struct {
+    pthread_mutex_t mutex;
+    int running;
+    int threads;
+    char *results;
+    size_t length;
+} bench = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+
+static void benchmark_result(const char *name, const char *label, int br, double speed)
+{
+    char line[80];
+    int n = snprintf(line, sizeof line, "idjcsc: aac_benchmark=%s:%s:%d:%.1f\n", name, label, br, speed);
+
+    pthread_mutex_lock(&bench.mutex);
+    if (!(bench.results = realloc(bench.results, bench.length + n + 1))) {
+        fprintf(stderr, "benchmark_result: malloc failure\n");
+        exit(5);
+    }
+    memcpy(bench.results + bench.length, line, n + 1);
+    bench.length += n;
+    pthread_mutex_unlock(&bench.mutex);
+}
+
+
+/* benchmark_main: time each AAC encoder present at the bitrates offered, away from the command thread */
+static void *benchmark_main(void *args)
+{
+    static const char *names[] = { "aac", "libfdk_aac", "aac_at", "aac_mf", NULL };
+    static const struct {
+        int profile;
+        const char *label;
+        int bitrates[7];
+    } tests[] = {
+        { FF_PROFILE_AAC_LOW, "aac", { 32, 64, 96, 128, 192, 256, 0 } },
+        { FF_PROFILE_AAC_HE_V2, "aacpv2", { 24, 32, 48, 64, 0 } } };
+    const AVCodec *codec;
+
+    sig_mask_thread();
+    for (const char **name = names; *name && !g.app_shutdown; name++) {
+        if (!(codec = avcodec_find_encoder_by_name(*name)) || codec->id != AV_CODEC_ID_AAC)
+            continue;
+        for (size_t t = 0; t < sizeof tests / sizeof tests[0]; t++)
+            for (const int *br = tests[t].bitrates; *br && !g.app_shutdown; br++)
+                benchmark_result(*name, tests[t].label, *br, benchmark_run(codec, tests[t].profile, *br, bench.threads));
+    }
+    __atomic_store_n(&bench.running, FALSE, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+
+/* live_aac_encoder_benchmark: start timing the AAC encoders on a background thread
+ * a run takes minutes so the results are collected with aac_benchmark_report
+ */
+int live_aac_encoder_benchmark(struct threads_info *ti, struct universal_vars *uv, void *other)
+{
+    struct encoder_vars *ev = other;
+    pthread_attr_t attr;
+    pthread_t thread_h;
+    int rv;
+
+    if (__atomic_load_n(&bench.running, __ATOMIC_ACQUIRE)) {
+        fprintf(stderr, "live_aac_encoder_benchmark: a benchmark is already running\n");
+        return FAILED;
+    }
+    bench.threads = (ev && ev->codec_threads) ? atoi(ev->codec_threads) : 1;
+    __atomic_store_n(&bench.running, TRUE, __ATOMIC_RELEASE);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ((rv = pthread_create(&thread_h, &attr, benchmark_main, NULL))) {
+        fprintf(stderr, "live_aac_encoder_benchmark: pthread_create failed with error %d\n", rv);
+        __atomic_store_n(&bench.running, FALSE, __ATOMIC_RELEASE);
+    }
+    pthread_attr_destroy(&attr);
+    return rv ? FAILED : SUCCEEDED;
+}
+
+
+/* live_aac_encoder_benchmark_report: the results that came in since the last report
+ * one line per test of aac_benchmark=encoder:profile:kbps:times real time, 0.0 when unsupported
+ * then aac_benchmark_running=1 while there are more to come
+ */
+int live_aac_encoder_benchmark_report(struct threads_info *ti, struct universal_vars *uv, void *other)
+{
+    pthread_mutex_lock(&bench.mutex);
+    if (bench.length)
+        fputs(bench.results, g.out);
+    free(bench.results);
+    bench.results = NULL;
+    bench.length = 0;
+    pthread_mutex_unlock(&bench.mutex);
+    fprintf(g.out, "idjcsc: aac_benchmark_running=%d\n", __atomic_load_n(&bench.running, __ATOMIC_ACQUIRE));
+    fflush(g.out);
+    return SUCCEEDED;
+}
+
 #endif /* HAVE_AVCODEC */
@@ -24,5 +24,7 @@
 #include "encoder.h"
 
 int live_aac_encoder_init(struct encoder *encoder, struct encoder_vars *ev);
+int live_aac_encoder_benchmark(struct threads_info *ti, struct universal_vars *uv, void *other);
+int live_aac_encoder_benchmark_report(struct threads_info *ti, struct universal_vars *uv, void *other);
 
 #endif /* HAVE_AVCODEC */
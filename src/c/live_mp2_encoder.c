@@ -69,6 +69,17 @@ static int write_packet(struct encoder *encoder, struct lm2e_data *s, unsigned c
     return 1;
     }
 
+static void free_buffers(struct lm2e_data * const s)
+    {
+    free(s->mp2buf);
+    s->mp2buf = NULL;
+    for (int i = 0; i < 2; i++)
+        {
+        free(s->pcm[i]);
+        s->pcm[i] = NULL;
+        }
+    }
+
 static void encoder_main(struct encoder *encoder)
     {
     struct lm2e_data * const s = encoder->encoder_private;
@@ -77,15 +88,18 @@ static void encoder_main(struct encoder *encoder)
 
     if (encoder->encoder_state == ES_STARTING)
         {
-        if (!(s->mp2buf = malloc(s->mp2bufsize = (int)(1.25 * 8192.0 + 7200.0))))
+        if (!(s->mp2buf = malloc(s->mp2bufsize = (int)(1.25 * 8192.0 + 7200.0))) ||
+                    !(s->pcm[0] = malloc(LM2E_INPUT_SAMPLES * sizeof (float))) ||
+                    !(s->pcm[1] = malloc(LM2E_INPUT_SAMPLES * sizeof (float))))
             {
             fprintf(stderr, "live_mp2_encoder_main: malloc failure\n");
+            free_buffers(s);
             goto bailout;
             }
         if (!(s->gfp = twolame_init()))
             {
             fprintf(stderr, "live_mp2_encoder_main: failed to initialise twolame\n");
-            free(s->mp2buf);
+            free_buffers(s);
             goto bailout;
             }
         twolame_set_num_channels(s->gfp, encoder->n_channels);
@@ -98,7 +112,7 @@ static void encoder_main(struct encoder *encoder)
             {
             fprintf(stderr, "live_mp2_encoder_main: twolame rejected the parameters given\n");
             twolame_close(&s->gfp);
-            free(s->mp2buf);
+            free_buffers(s);
             goto bailout;
             }
 
@@ -123,11 +137,11 @@ static void encoder_main(struct encoder *encoder)
             }
         else
             {
-            if ((id = encoder_get_input_data(encoder, 1024, 8192, NULL)))
+            if ((id = encoder_get_input_data(encoder, 1152, LM2E_INPUT_SAMPLES, s->pcm)))
                 {
                 mp2bytes = twolame_encode_buffer_float32(s->gfp, id->buffer[0], id->buffer[1], id->qty_samples, s->mp2buf, s->mp2bufsize);
-                encoder_ip_data_free(id);
                 s->twolame_samples += id->qty_samples;
+                encoder_ip_data_free(id);
                 write_packet(encoder, s, s->mp2buf, mp2bytes, PF_MP2 | s->packetflags);
                 s->packetflags = PF_UNSET;
                 }
@@ -144,7 +158,7 @@ static void encoder_main(struct encoder *encoder)
     if (encoder->encoder_state == ES_STOPPING)
         {
         twolame_close(&s->gfp);
-        free(s->mp2buf);
+        free_buffers(s);
         if (encoder->run_request_f)
             {
             encoder->encoder_state = ES_STARTING;
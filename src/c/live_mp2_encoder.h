@@ -24,6 +24,9 @@
 #include "twolame.h"
 #include "sourceclient.h"
 
+/* input is taken in whole MPEG audio frames of 1152 samples */
+#define LM2E_INPUT_SAMPLES (1152 * 7)
+
 struct lm2e_data
     {
     twolame_options *gfp;
@@ -33,6 +36,7 @@ struct lm2e_data
     int twolame_samples;
     unsigned char *mp2buf;
     size_t mp2bufsize;
+    float *pcm[2];              /* persistent input buffers handed to encoder_get_input_data */
     enum packet_flags packetflags;
     };
 
@@ -67,6 +67,17 @@ static int live_mp3_write_packet(struct encoder *encoder, struct lm3e_data *s, u
     return 1;
     }
 
+static void live_mp3_free_buffers(struct lm3e_data * const s)
+    {
+    free(s->mp3buf);
+    s->mp3buf = NULL;
+    for (int i = 0; i < 2; i++)
+        {
+        free(s->pcm[i]);
+        s->pcm[i] = NULL;
+        }
+    }
+
 static void live_mp3_encoder_main(struct encoder *encoder)
     {
     struct lm3e_data * const s = encoder->encoder_private;
@@ -75,16 +86,19 @@ static void live_mp3_encoder_main(struct encoder *encoder)
 
     if (encoder->encoder_state == ES_STARTING)
         {
-        if (!(s->mp3buf = malloc(s->mp3bufsize = (int)(1.25 * 8192.0 + 7200.0))))
+        if (!(s->mp3buf = malloc(s->mp3bufsize = (int)(1.25 * 8192.0 + 7200.0))) ||
+                    !(s->pcm[0] = malloc(LM3E_INPUT_SAMPLES * sizeof (float))) ||
+                    !(s->pcm[1] = malloc(LM3E_INPUT_SAMPLES * sizeof (float))))
             {
             fprintf(stderr, "live_mp3_encoder_main: malloc failure\n");
+            live_mp3_free_buffers(s);
             goto bailout;
             }
             
         if (!(s->gfp = lame_init()))
             {
             fprintf(stderr, "live_mp3_encoder_main: failed to initialise LAME\n");
-            free(s->mp3buf);
+            live_mp3_free_buffers(s);
             goto bailout;
             }
 
@@ -100,7 +114,7 @@ static void live_mp3_encoder_main(struct encoder *encoder)
             {
             fprintf(stderr, "live_mp3_encoder_main: LAME rejected the parameters given\n");
             lame_close(s->gfp);
-            free(s->mp3buf);
+            live_mp3_free_buffers(s);
             goto bailout;
             }
 
@@ -125,7 +139,7 @@ static void live_mp3_encoder_main(struct encoder *encoder)
             }
         else
             {
-            if ((id = encoder_get_input_data(encoder, 1024, 8192, NULL)))
+            if ((id = encoder_get_input_data(encoder, 1152, LM3E_INPUT_SAMPLES, s->pcm)))
                 {
                 mp3bytes = lame_encode_buffer_float(s->gfp, id->buffer[0], id->buffer[1], id->qty_samples, s->mp3buf, s->mp3bufsize);
                 s->lame_samples += id->qty_samples;
@@ -145,7 +159,7 @@ static void live_mp3_encoder_main(struct encoder *encoder)
     if (encoder->encoder_state == ES_STOPPING)
         {
         lame_close(s->gfp);
-        free(s->mp3buf);
+        live_mp3_free_buffers(s);
         if (encoder->run_request_f)
             {
             encoder->encoder_state = ES_STARTING;
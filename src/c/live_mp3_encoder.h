@@ -27,6 +27,9 @@
 
 #include "sourceclient.h"
 
+/* input is taken in whole MPEG audio frames of 1152 samples */
+#define LM3E_INPUT_SAMPLES (1152 * 7)
+
 struct lm3e_data
     {
     lame_global_flags *gfp;
@@ -37,6 +40,7 @@ struct lm3e_data
     int lame_samples;
     unsigned char *mp3buf;
     size_t mp3bufsize;
+    float *pcm[2];              /* persistent input buffers handed to encoder_get_input_data */
     enum packet_flags packetflags;
     };
 
@@ -76,24 +76,15 @@ void live_ogg_free_metadata(struct ogg_tag_data *t)
 int live_ogg_write_packet(struct encoder *encoder, ogg_page *op, int flags)
     {
     struct encoder_op_packet packet;
-    char *buffer;
+    struct iovec iov[2] = { { op->header, op->header_len }, { op->body, op->body_len } };
 
-    if (!(buffer = malloc(op->header_len + op->body_len)))
-        {
-        fprintf(stderr, "live_ogg_write_packet: malloc failure\n");
-        return 0;
-        }
-    memcpy(buffer, op->header, op->header_len);
-    memcpy(buffer + op->header_len, op->body, op->body_len);
     packet.header.bit_rate = encoder->bitrate;
     packet.header.sample_rate = encoder->target_samplerate;
     packet.header.n_channels = encoder->n_channels;
     packet.header.flags = flags;
-    packet.header.data_size = op->header_len + op->body_len;
     packet.header.timestamp = encoder->timestamp = (double)ogg_page_granulepos(op) / (double)encoder->samplerate;
-    packet.data = buffer;
-    encoder_write_packet_all(encoder, &packet);
-    free(buffer);
+    packet.data = NULL;
+    encoder_write_packet_allv(encoder, &packet, iov, 2);
     return 1;
     }
 
@@ -139,24 +139,16 @@ static FLAC__StreamEncoderWriteStatus live_oggflac_encoder_write_cb(const FLAC__
         }
     else
         {
-        /* writing ogg body */
-        if (s->pab_size < (s->pab_rqd += bytes))
-            if (!(s->pab = realloc(s->pab, s->pab_size = s->pab_rqd)))
-                {
-                fprintf(stderr, "live_oggflac_encoder_write_cb: malloc failure\n");
-                return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
-                }
-        
-        memcpy(s->pab + s->pab_head_size, buffer, bytes);
-        
+        /* writing ogg body, which goes out with the saved header without being copied */
+        struct iovec iov[2] = { { s->pab, s->pab_head_size }, { (void *)buffer, bytes } };
+
         packet.header.bit_rate = encoder->bitrate;
         packet.header.sample_rate = encoder->target_samplerate;
         packet.header.n_channels = encoder->n_channels;
         packet.header.flags = s->flags;
-        packet.header.data_size = s->pab_rqd;
         packet.header.timestamp = encoder->timestamp = (double)s->samples / (double)encoder->samplerate;
-        packet.data = s->pab;
-        encoder_write_packet_all(encoder, &packet);
+        packet.data = NULL;
+        encoder_write_packet_allv(encoder, &packet, iov, 2);
         }
         
     s->n_writes++;
@@ -39,6 +39,8 @@ struct local_data {
     int complexity;
     int postgain;
     int framesamples;
+    int frames_per_run;
+    int low_latency;
     int lookahead;
     int vbr;
     int vbr_constraint;
@@ -81,7 +83,8 @@ static void live_oggopus_encoder_main(struct encoder *encoder)
         encoder->timestamp = 0.0;
         ogg_stream_init(&s->os, ++encoder->oggserial);
        
-        if (!(s->enc_st = opus_encoder_create(48000, encoder->n_channels, OPUS_APPLICATION_AUDIO, &error)))
+        if (!(s->enc_st = opus_encoder_create(48000, encoder->n_channels, s->low_latency ?
+                        OPUS_APPLICATION_RESTRICTED_LOWDELAY : OPUS_APPLICATION_AUDIO, &error)))
             {
             fprintf(stderr, "live_oggopus_encoder_main: failure: encoder_create: %s\n", opus_strerror(error));
             goto bailout;
@@ -114,6 +117,11 @@ static void live_oggopus_encoder_main(struct encoder *encoder)
             s->lookahead = la_fallback;
             }
 
+        /* what the encoder adds to the end to end delay before any network buffering */
+        fprintf(stderr, "live_oggopus_encoder_main: info: latency %.1f ms: frame %.1f, lookahead %.1f, paging %.1f\n",
+                    (s->framesamples * s->pagepackets_max + s->lookahead) / 48.0, s->framesamples / 48.0,
+                    s->lookahead / 48.0, s->framesamples * (s->pagepackets_max - 1) / 48.0);
+
         char header_packet_data[20];
         size_t header_packet_size = snprintf(header_packet_data, sizeof header_packet_data,
             "OpusHead\x1%c%c%c\x80\xbb%c%c%c%c%c",
@@ -235,7 +243,8 @@ static void live_oggopus_encoder_main(struct encoder *encoder)
             return;
             }
 
-        if((id = encoder_get_input_data(encoder, s->framesamples, s->framesamples, NULL)))
+        /* the pool visits every few ms so short frames have to be taken several at a time */
+        for (int n = 0; n < s->frames_per_run && (id = encoder_get_input_data(encoder, s->framesamples, s->framesamples, NULL)); n++)
             {
             if (encoder->n_channels == 2)
                 stereomix(id->buffer[0], id->buffer[1], inbuf = s->inbuf, s->framesamples);
@@ -391,8 +400,27 @@ int live_oggopus_encoder_init(struct encoder *encoder, struct encoder_vars *ev)
 
     s->complexity = atoi(ev->complexity);
     s->postgain = atoi(ev->postgain);
-    s->framesamples = atoi(ev->framesize) * 48;
-    s->pagepackets_max = 48000 / s->framesamples / 5;
+    s->framesamples = (int)(atof(ev->framesize) * 48.0 + 0.5);
+    switch (s->framesamples)
+        {
+        case 120:
+        case 240:
+        case 480:
+        case 960:
+        case 1920:
+        case 2880:
+            break;
+        default:
+            fprintf(stderr, "live_oggopus_encoder: bad frame size %s\n", ev->framesize);
+            free(s);
+            return FAILED;
+        }
+    s->frames_per_run = 9600 / s->framesamples;
+    s->low_latency = ev->latency_mode && !strcmp(ev->latency_mode, "low");
+    /* pages of 200 ms unless specified, low latency defaults to a page per packet */
+    if ((s->pagepackets_max = ((ev->page_duration && strcmp(ev->page_duration, "default")) ?
+                atoi(ev->page_duration) : (s->low_latency ? 0 : 200)) * 48 / s->framesamples) < 1)
+        s->pagepackets_max = 1;
     if (!strcmp(ev->variability, "cbr"))
         s->vbr = 0;
     else
@@ -420,6 +448,8 @@ int live_oggopus_encoder_init(struct encoder *encoder, struct encoder_vars *ev)
         }
 
     s->outbuf_siz = encoder->bitrate * s->framesamples / 174;
+    if (s->outbuf_siz < 256)
+        s->outbuf_siz = 256;    /* room for the short frames at low bit rates */
     if (!(s->outbuf = malloc(s->outbuf_siz)))
         {
         fprintf(stderr, "live_oggopus_encoder: malloc failure\n");
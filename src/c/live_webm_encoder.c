@@ -310,6 +310,24 @@ static void close_stream(WebMState *self)
 }
 
 
+/* cluster_start: whether the muxer output begins with a Cluster element, ID then size */
+static int cluster_start(const uint8_t *buf, int buf_size)
+{
+    static const uint8_t cluster_id[] = { 0x1F, 0x43, 0xB6, 0x75 };
+    int len;
+
+    if (buf_size <= (int)sizeof cluster_id || memcmp(buf, cluster_id, sizeof cluster_id))
+        return 0;
+    /* the length of the size field is given by the leading zero bits of its first byte */
+    for (len = 1; len <= 8 && !(buf[sizeof cluster_id] & (0x100 >> len)); ++len);
+    return len <= 8 && (int)sizeof cluster_id + len <= buf_size;
+}
+
+
+/* write_packet: muxer output goes straight from libavformat's buffers into the shared ring
+ * with the avio context in direct mode a finished cluster comes through as its element header
+ * then its body from the muxer's own buffer, and the header is flagged for listeners to start on
+ */
 static int write_packet(void *opaque, uint8_t *buf, int buf_size)
 {
     struct encoder *encoder = opaque;
@@ -320,6 +338,8 @@ static int write_packet(void *opaque, uint8_t *buf, int buf_size)
     packet.header.sample_rate = encoder->target_samplerate;
     packet.header.n_channels = encoder->n_channels;
     packet.header.flags = PF_WEBM | self->packet_flags;
+    if (!(self->packet_flags & PF_HEADER) && buf && cluster_start(buf, buf_size))
+        packet.header.flags |= PF_SYNC;
     packet.header.data_size = buf_size;
     packet.header.serial = encoder->oggserial;
     packet.header.timestamp = encoder->timestamp = self->serial_samples / (double)encoder->target_samplerate;
@@ -339,6 +359,8 @@ static int write_header(struct encoder *encoder)
     self->serial_samples = 0;
     self->packet_flags = PF_HEADER | PF_INITIAL;
     ret = avformat_write_header(self->oc, NULL);
+    /* push the header out now so it is flagged as such for clients attaching later */
+    avio_flush(self->oc->pb);
     self->packet_flags &= ~PF_HEADER;
     return ret;
 }
@@ -396,6 +418,8 @@ static int setup(struct encoder *encoder)
         goto fail3;
     }
 
+    /* writes bypass the avio buffer and the muxer's clusters aren't cut at its size */
+    self->avio_ctx->direct = 1;
     self->oc->pb = self->avio_ctx;
 
     const AVCodec *codec = add_stream(self, codec_id, encoder->bitrate,
@@ -0,0 +1,399 @@
+/*
+#   loudness.c: EBU R128 integrated loudness of media files, worked out in the background
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sourceclient.h"
+#include "xlplayer.h"
+#include "indexcache.h"
+#include "sig.h"
+#include "loudness.h"
+
+#define LOUDNESS_CACHE_MAGIC "idjc loudness 1"
+#define MAX_THREADS 8
+#define READ_FRAMES 4096
+
+/* BS.1770 gating, the blocks are four 100ms sub-blocks long so they overlap by 75% */
+#define SUB_BLOCKS 4
+#define ABSOLUTE_GATE_LUFS -70.0
+#define RELATIVE_GATE_LU -10.0
+
+struct biquad
+    {
+    double b0, b1, b2, a1, a2;
+    };
+
+/* the K-weighting filter, a high shelf then a high pass, run on both channels in step */
+struct kweight
+    {
+    struct biquad shelf, highpass;
+    double z[2][4];                 /* per channel transposed direct form II state, two per stage */
+    };
+
+struct loudness_meter
+    {
+    struct kweight kw;
+    unsigned sub_block_frames;
+    unsigned frames;                /* into the current sub-block */
+    double sum[2];                  /* of the squares of the weighted samples of the current sub-block */
+    double sub_blocks[SUB_BLOCKS];  /* mean squares of the last four */
+    unsigned long n_sub_blocks;
+    double *blocks;                 /* mean square of every 400ms block, the stuff of gating */
+    size_t n_blocks, blocks_size;
+    float peak;
+    };
+
+/* the files waiting on the background threads, added to while they run */
+struct loudness_queue
+    {
+    pthread_mutex_t mutex;
+    char **pathnames;
+    int n, next, size;
+    int n_workers;
+    int samplerate;
+    sig_atomic_t *shutdown_f;
+    };
+
+static struct loudness_queue queue = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static int loudness_volume = 127;
+
+/* kweight_init: the BS.1770 filter designed afresh for the sample rate as done by libebur128 */
+static void kweight_init(struct kweight *kw, int samplerate)
+    {
+    double f0 = 1681.974450955533, gain_db = 3.999843853973347, q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / samplerate);
+    double vh = pow(10.0, gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+
+    kw->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    kw->shelf.b1 = 2.0 * (k * k - vh) / a0;
+    kw->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    kw->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    kw->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / samplerate);
+    a0 = 1.0 + k / q + k * k;
+    kw->highpass.b0 = 1.0;
+    kw->highpass.b1 = -2.0;
+    kw->highpass.b2 = 1.0;
+    kw->highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+    kw->highpass.a2 = (1.0 - k / q + k * k) / a0;
+
+    memset(kw->z, 0, sizeof kw->z);
+    }
+
+/* loudness_meter_run: weight a stretch of audio no longer than what's left of the sub-block
+ * the filter is serial in time so the channels are what go side by side, the same arithmetic
+ * on the pair of them at each step for the compiler to put into one vector
+ */
+static void loudness_meter_run(struct loudness_meter *m, const float *restrict lc, const float *restrict rc, size_t n)
+    {
+    const struct biquad s = m->kw.shelf, h = m->kw.highpass;
+    double z[2][4], sum[2] = { m->sum[0], m->sum[1] };
+    float peak = m->peak;
+
+    memcpy(z, m->kw.z, sizeof z);
+    for (size_t i = 0; i < n; ++i)
+        {
+        const double in[2] = { lc[i], rc[i] };
+
+        for (int c = 0; c < 2; ++c)
+            {
+            double x = in[c];
+            double y = s.b0 * x + z[c][0];
+
+            z[c][0] = s.b1 * x - s.a1 * y + z[c][1];
+            z[c][1] = s.b2 * x - s.a2 * y;
+            x = y;
+            y = h.b0 * x + z[c][2];
+            z[c][2] = h.b1 * x - h.a1 * y + z[c][3];
+            z[c][3] = h.b2 * x - h.a2 * y;
+            sum[c] += y * y;
+            }
+        peak = fmaxf(peak, fmaxf(fabsf(lc[i]), fabsf(rc[i])));
+        }
+    memcpy(m->kw.z, z, sizeof z);
+    m->sum[0] = sum[0];
+    m->sum[1] = sum[1];
+    m->peak = peak;
+    }
+
+static void loudness_meter_sub_block(struct loudness_meter *m)
+    {
+    double block = 0.0;
+
+    m->sub_blocks[m->n_sub_blocks++ % SUB_BLOCKS] = (m->sum[0] + m->sum[1]) / m->sub_block_frames;
+    m->sum[0] = m->sum[1] = 0.0;
+    m->frames = 0;
+    if (m->n_sub_blocks < SUB_BLOCKS)
+        return;
+
+    for (int i = 0; i < SUB_BLOCKS; ++i)
+        block += m->sub_blocks[i];
+    if (m->n_blocks == m->blocks_size && !(m->blocks = realloc(m->blocks,
+                (m->blocks_size = m->blocks_size ? m->blocks_size * 2 : 4096) * sizeof (double))))
+        {
+        fprintf(stderr, "loudness_meter_sub_block: malloc failure\n");
+        exit(5);
+        }
+    m->blocks[m->n_blocks++] = block / SUB_BLOCKS;
+    }
+
+static void loudness_meter_add(struct loudness_meter *m, const float *lc, const float *rc, size_t n)
+    {
+    while (n)
+        {
+        size_t todo = m->sub_block_frames - m->frames;
+
+        if (todo > n)
+            todo = n;
+        loudness_meter_run(m, lc, rc, todo);
+        lc += todo;
+        rc += todo;
+        n -= todo;
+        if ((m->frames += todo) == m->sub_block_frames)
+            loudness_meter_sub_block(m);
+        }
+    }
+
+static double loudness_of(double mean_square)
+    {
+    return -0.691 + 10.0 * log10(mean_square);
+    }
+
+/* loudness_meter_integrated: the gated loudness or FALSE for a track that's silent or too short */
+static int loudness_meter_integrated(struct loudness_meter *m, double *lufs)
+    {
+    const double absolute = pow(10.0, (ABSOLUTE_GATE_LUFS + 0.691) / 10.0);
+    double sum = 0.0, relative;
+    size_t i, n = 0;
+
+    for (i = 0; i < m->n_blocks; ++i)
+        if (m->blocks[i] > absolute)
+            {
+            sum += m->blocks[i];
+            ++n;
+            }
+    if (!n)
+        return FALSE;
+
+    relative = sum / n * pow(10.0, RELATIVE_GATE_LU / 10.0);
+    sum = 0.0;
+    n = 0;
+    for (i = 0; i < m->n_blocks; ++i)
+        if (m->blocks[i] > absolute && m->blocks[i] > relative)
+            {
+            sum += m->blocks[i];
+            ++n;
+            }
+    *lufs = loudness_of(sum / n);
+    return TRUE;
+    }
+
+static int loudness_cache_read(struct indexcache_key *key, int *valid, double *lufs, double *peak_db)
+    {
+    FILE *fp;
+    int ok;
+
+    if (!(fp = indexcache_read_open(key, LOUDNESS_CACHE_MAGIC)))
+        return FALSE;
+    ok = fscanf(fp, "%d %lf %lf", valid, lufs, peak_db) == 3;
+    fclose(fp);
+    return ok;
+    }
+
+static void loudness_cache_write(struct indexcache_key *key, int valid, double lufs, double peak_db)
+    {
+    FILE *fp;
+    char *tmp;
+
+    if ((fp = indexcache_write_open(key, LOUDNESS_CACHE_MAGIC, &tmp)))
+        {
+        fprintf(fp, "\n%d %.17g %.17g\n", valid, lufs, peak_db);
+        indexcache_write_close(key, fp, tmp);
+        }
+    }
+
+int loudness_lookup(const char *pathname, double *lufs, double *peak_db)
+    {
+    struct indexcache_key key;
+    int valid = FALSE;
+
+    if (indexcache_key_init(&key, "loudness", pathname))
+        {
+        if (!loudness_cache_read(&key, &valid, lufs, peak_db))
+            valid = FALSE;
+        indexcache_key_free(&key);
+        }
+    return valid;
+    }
+
+/* loudness_analyse: decode the whole of a file with the player and meter what comes out */
+static void loudness_analyse(struct xlplayer *player, char *pathname, int samplerate, sig_atomic_t *shutdown_f)
+    {
+    struct loudness_meter m = { .sub_block_frames = samplerate / 10 };
+    struct indexcache_key key;
+    double lufs = 0.0, peak_db = -HUGE_VAL;
+    int valid, dummy;
+    size_t n;
+
+    if (!indexcache_key_init(&key, "loudness", pathname))
+        return;
+    if (loudness_cache_read(&key, &dummy, &lufs, &peak_db))
+        {
+        indexcache_key_free(&key);
+        return;
+        }
+
+    kweight_init(&m.kw, samplerate);
+    if (xlplayer_play(player, pathname, 0, 0, 0.0f, 0) < 0 && player->playmode == PM_STOPPED)
+        valid = FALSE;
+    else
+        {
+        while (!xlplayer_idle(player))
+            {
+            if (*shutdown_f)
+                {
+                xlplayer_eject(player);
+                free(m.blocks);
+                indexcache_key_free(&key);
+                return;
+                }
+            if ((n = xlplayer_read_start(player, READ_FRAMES)))
+                loudness_meter_add(&m, player->lcb, player->rcb, n);
+            else
+                usleep(100);
+            }
+        if ((valid = loudness_meter_integrated(&m, &lufs)))
+            peak_db = 20.0 * log10(m.peak);
+        }
+
+    /* files that can't be measured are remembered too so a rescan skips them */
+    loudness_cache_write(&key, valid, lufs, valid ? peak_db : 0.0);
+    if (valid)
+        fprintf(stderr, "loudness_analyse: %s %.2f LUFS, peak %.2f dBFS\n", pathname, lufs, peak_db);
+    free(m.blocks);
+    indexcache_key_free(&key);
+    }
+
+static void *loudness_worker(void *args)
+    {
+    struct loudness_queue *q = args;
+    struct xlplayer *player;
+    char *pathname;
+
+    sig_mask_thread();
+    if ((player = xlplayer_create(q->samplerate, 10.0, "loudness", q->shutdown_f, &loudness_volume, 0, NULL, NULL, 0.0f)))
+        xlplayer_buffer_alloc(player, READ_FRAMES);
+
+    for (;;)
+        {
+        pthread_mutex_lock(&q->mutex);
+        if (!player || q->next == q->n || *q->shutdown_f)
+            {
+            /* the last one out empties the queue for the next scan */
+            if (!--q->n_workers)
+                {
+                while (q->next < q->n)
+                    free(q->pathnames[q->next++]);
+                free(q->pathnames);
+                q->pathnames = NULL;
+                q->n = q->next = q->size = 0;
+                }
+            pthread_mutex_unlock(&q->mutex);
+            break;
+            }
+        pathname = q->pathnames[q->next];
+        q->pathnames[q->next++] = NULL;
+        pthread_mutex_unlock(&q->mutex);
+
+        loudness_analyse(player, pathname, q->samplerate, q->shutdown_f);
+        free(pathname);
+        }
+
+    if (player)
+        xlplayer_destroy(player);
+    return NULL;
+    }
+
+static int loudness_thread_count()
+    {
+    char *env = getenv("loudness_threads");
+    long count = (env && env[0]) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+    return (count < 1) ? 1 : count;
+    }
+
+int loudness_scan(char **pathnames, int n, int samplerate, sig_atomic_t *shutdown_f)
+    {
+    struct loudness_queue *q = &queue;
+    pthread_attr_t attr;
+    pthread_t thread_h;
+    int pending, n_wanted, rv;
+
+    pthread_mutex_lock(&q->mutex);
+    if (!q->n_workers)
+        {
+        q->samplerate = samplerate;
+        q->shutdown_f = shutdown_f;
+        }
+    for (int i = 0; i < n; ++i)
+        {
+        if (q->n == q->size && !(q->pathnames = realloc(q->pathnames, (q->size = q->size ? q->size * 2 : 64) * sizeof (char *))))
+            {
+            fprintf(stderr, "loudness_scan: malloc failure\n");
+            exit(5);
+            }
+        if (!(q->pathnames[q->n++] = strdup(pathnames[i])))
+            {
+            fprintf(stderr, "loudness_scan: malloc failure\n");
+            exit(5);
+            }
+        }
+
+    pending = q->n - q->next;
+    if ((n_wanted = loudness_thread_count()) > pending)
+        n_wanted = pending;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (q->n_workers < n_wanted)
+        {
+        if ((rv = pthread_create(&thread_h, &attr, loudness_worker, q)))
+            {
+            fprintf(stderr, "loudness_scan: pthread_create failed with error %d\n", rv);
+            break;
+            }
+        ++q->n_workers;
+        }
+    pthread_attr_destroy(&attr);
+    pthread_mutex_unlock(&q->mutex);
+    return pending;
+    }
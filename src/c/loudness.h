@@ -0,0 +1,39 @@
+/*
+#   loudness.h: EBU R128 integrated loudness of media files, worked out in the background
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <signal.h>
+
+/* the ReplayGain 2 reference level the suggested gain brings a track to */
+#define LOUDNESS_REFERENCE_LUFS -18.0
+
+/* loudness_scan: queue files for analysis on a pool of background threads
+ * files already in the cache are passed over, results only go to the cache
+ * returns the number of files still waiting to be analysed
+ */
+int loudness_scan(char **pathnames, int n, int samplerate, sig_atomic_t *shutdown_f);
+
+/* loudness_lookup: the integrated loudness in LUFS and the sample peak in dBFS from the cache
+ * returns FALSE when the file has yet to be analysed or couldn't be decoded
+ */
+int loudness_lookup(const char *pathname, double *lufs, double *peak_db);
+
+#endif /* LOUDNESS_H */
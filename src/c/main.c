@@ -23,11 +23,13 @@
 #include <stdlib.h>
 #include <locale.h>
 #include <string.h>
+#include <strings.h>
 #include <signal.h>
 #include <unistd.h>
 #include <jack/session.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 
 #ifdef HAVE_LIBAV
 #include <libavcodec/avcodec.h>
@@ -35,20 +37,50 @@
 #endif /* HAVE_LIBAV */
 
 #include "sig.h"
+#include "evloop.h"
 #include "mixer.h"
+#include "rttime.h"
+#include "allocaudit.h"
+#include "rtarena.h"
 #include "sourceclient.h"
 #include "main.h"
 
 #define FALSE 0
 #define TRUE (!FALSE)
 
+/* How long the event loop may go without getting back to the watchdog. */
+#define STALL_TIMEOUT 10
+
 struct globs g;
 
+static char *command_buffer;
+static size_t command_buffer_size = 10;
+
+/* where the time goes between the fork and the backend being ready */
+#define STARTUP_MAX_PHASES 16
+
+static struct
+    {
+    struct timespec last;
+    int n;
+    const char *phase[STARTUP_MAX_PHASES];
+    long ms[STARTUP_MAX_PHASES];
+    } startup;
+
+/* Only goes off when the event loop has stopped turning over. */
 static void alarm_handler(int sig)
     {
     if (g.app_shutdown)
         exit(5);
 
+    g.app_shutdown = TRUE;
+
+    /* One second grace to shut down naturally. */
+    alarm(1);
+    }
+
+static void watchdog(void *data)
+    {
     if (g.mixer_up && !mixer_healthcheck())
         g.app_shutdown = TRUE;
 
@@ -58,8 +90,132 @@ static void alarm_handler(int sig)
     if (g.has_head && g.main_timeout++ > 9)
         g.app_shutdown = TRUE;
 
-    /* One second grace to shut down naturally. */
-    alarm(1);
+    if (g.app_shutdown)
+        {
+        evloop_quit();
+        alarm(1);
+        }
+    else
+        alarm(STALL_TIMEOUT);
+    }
+
+static void shutdown_event(void *data)
+    {
+    evloop_quit();
+    }
+
+/* The interface picks the session details up on its next poll, which it makes straight away. */
+static void session_event(void *data)
+    {
+    evloop_notify("session");
+    }
+
+/* An encoder or streamer started or stopped so the interface refreshes its indicators now. */
+static void status_event(void *data)
+    {
+    evloop_notify("status");
+    }
+
+/* input_buffered: whether stdio holds more input than the descriptor would show to poll */
+static int input_buffered()
+    {
+    int fd = fileno(g.in), flags = fcntl(fd, F_GETFL), c;
+
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    c = getc(g.in);
+    fcntl(fd, F_SETFL, flags);
+    if (c == EOF)
+        {
+        clearerr(g.in);
+        return FALSE;
+        }
+    ungetc(c, g.in);
+    return TRUE;
+    }
+
+static void command_handler(int fd, void *data)
+    {
+    int keep_running;
+
+    do  {
+        if (getline(&command_buffer, &command_buffer_size, g.in) <= 0 || g.app_shutdown)
+            {
+            evloop_quit();
+            return;
+            }
+
+        /* Filter commands to submodules. */
+        /* upper case module names are followed by a binary frame */
+        g.framed_input = !strcmp(command_buffer, "MX\n") || !strcmp(command_buffer, "SC\n");
+        if (!strcasecmp(command_buffer, "mx\n"))
+            keep_running = mixer_main();
+        else
+            {
+            if (!strcasecmp(command_buffer, "sc\n"))
+                keep_running = sourceclient_main();
+            else
+                {
+                fprintf(stderr, "main.c: expected module name, got: %s", command_buffer);
+                exit(5);
+                }
+            }
+
+        g.main_timeout = 0;
+        if (!keep_running)
+            {
+            evloop_quit();
+            return;
+            }
+        } while (input_buffered());
+    }
+
+static long startup_elapsed_ms(struct timespec *since)
+    {
+    struct timespec now;
+    long ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+    *since = now;
+    return ms;
+    }
+
+void startup_mark(const char *phase)
+    {
+    long ms;
+
+    /* marks after the report has been made are of no interest */
+    if (startup.n < 0)
+        return;
+    ms = startup_elapsed_ms(&startup.last);
+    if (startup.n < STARTUP_MAX_PHASES)
+        {
+        startup.phase[startup.n] = phase;
+        startup.ms[startup.n++] = ms;
+        }
+    }
+
+/* startup_report: the breakdown of the startup time, slowest phase last so it stands out */
+static void startup_report()
+    {
+    long total = 0, slowest = 0;
+    int slow_i = 0;
+
+    for (int i = 0; i < startup.n; i++)
+        {
+        total += startup.ms[i];
+        if (startup.ms[i] > slowest)
+            {
+            slowest = startup.ms[i];
+            slow_i = i;
+            }
+        }
+    fprintf(stderr, "main.c: backend startup took %ld ms\n", total);
+    for (int i = 0; i < startup.n; i++)
+        fprintf(stderr, "main.c:   %-24s %6ld ms\n", startup.phase[i], startup.ms[i]);
+    if (startup.n)
+        fprintf(stderr, "main.c: slowest startup phase is %s\n", startup.phase[slow_i]);
+    startup.n = -1;
     }
 
 static void custom_jack_error_callback(const char *message)
@@ -75,6 +231,7 @@ static void custom_jack_info_callback(const char *message)
 static void custom_jack_on_shutdown_callback()
     {
     g.app_shutdown = TRUE;
+    evloop_post(EVLOOP_SHUTDOWN);
     }
 
 static void session_callback(jack_session_event_t *event, void *arg)
@@ -90,6 +247,7 @@ static void session_callback(jack_session_event_t *event, void *arg)
                     "main.c: session event ringbuffer is stuffed -- exiting\n");
         exit(5);
         }
+    evloop_post(EVLOOP_SESSION);
     }
 
 static int buffer_size_callback(jack_nframes_t n_frames, void *arg)
@@ -102,6 +260,12 @@ static void freewheel_callback(int starting, void *arg)
     g.freewheel = starting;
     }
 
+static int xrun_callback(void *arg)
+    {
+    rttime_xrun();
+    return 0;
+    }
+
 static void cleanup_jack()
     {
     if (g.client)
@@ -115,7 +279,15 @@ static int main_process_audio(jack_nframes_t n_frames, void *arg)
     {
     int rv;
 
-    rv =  mixer_process_audio(n_frames, arg) || audio_feed_process_audio(n_frames, arg);
+    allocaudit_rt_enter();
+    rttime_period_start(n_frames);
+    if (!(rv = mixer_process_audio(n_frames, arg)))
+        {
+        rv = audio_feed_process_audio(n_frames, arg);
+        rttime_mark(RTTIME_FEED);
+        }
+    rttime_period_end();
+    allocaudit_rt_leave();
 
     if (rv == 0)
         g.jack_timeout = 0;
@@ -125,11 +297,10 @@ static int main_process_audio(jack_nframes_t n_frames, void *arg)
 
 static int backend_main()
     {
-    char *buffer = NULL;
-    size_t n = 10;
-    int keep_running = TRUE;
     jack_options_t options = 0;
 
+    clock_gettime(CLOCK_MONOTONIC, &startup.last);
+
     /* Without these being set the backend will segfault. */
         {
         int o = FALSE;    /* Overwrite flag */
@@ -140,6 +311,9 @@ static int backend_main()
                 setenv("num_encoders", "6", o) ||
                 setenv("num_recorders", "2", o) ||
                 setenv("num_effects", "24", o) ||
+                setenv("mixer_engine", "sample", o) ||
+                setenv("encoder_rb_samples", "53000", o) ||
+                setenv("recorder_rb_samples", "10000", o) ||
                 setenv("jack_parameter", "default", o) ||
                 setenv("has_head", "0", o) ||
                 /* C locale required for . as radix character. */
@@ -157,6 +331,12 @@ static int backend_main()
     /* Signal handling. */
     sig_init();
 
+    if (!evloop_init())
+        exit(5);
+    evloop_on_event(EVLOOP_SESSION, session_event, NULL);
+    evloop_on_event(EVLOOP_SHUTDOWN, shutdown_event, NULL);
+    evloop_on_event(EVLOOP_STATUS, status_event, NULL);
+
     if (!(strcmp(getenv("session_type"), "JACK")))
         {
         options = JackSessionID;
@@ -166,11 +346,13 @@ static int backend_main()
     else
         options = JackUseExactName | JackServerName;
 
+    startup_mark("environment");
     if ((g.client = jack_client_open(getenv("client_id"), options, NULL, getenv("jack_parameter"))) == 0)
         {
         fprintf(stderr, "main.c: jack_client_open failed");
         exit(5);
         }
+    startup_mark("jack_client_open");
 
 #ifdef HAVE_LIBAV
     if (pthread_mutex_init(&g.avc_mutex, NULL))
@@ -187,7 +369,9 @@ static int backend_main()
     jack_on_shutdown(g.client, custom_jack_on_shutdown_callback, NULL);
 
     jack_set_freewheel_callback(g.client, freewheel_callback, NULL);
+    jack_set_xrun_callback(g.client, xrun_callback, NULL);
     jack_set_session_callback(g.client, session_callback, NULL);
+    rttime_init(jack_get_sample_rate(g.client));
     jack_set_process_callback(g.client, main_process_audio, NULL);
     jack_set_buffer_size_callback(g.client, buffer_size_callback, NULL);
 
@@ -242,9 +426,17 @@ static int backend_main()
 
     #undef MK_AUDIO_INPUT
     #undef MK_AUDIO_OUTPUT
+    startup_mark("port registration");
+
+    /* What the process callback uses is made from memory that can't page fault.
+     * $rt_arena_kb sets the size.
+     */
+    rtarena_init((getenv("rt_arena_kb") ? atol(getenv("rt_arena_kb")) : 1024) * (size_t)1024);
+    startup_mark("rt arena");
 
     /* Submodule initialization. */
     mixer_init();
+    startup_mark("mixer remainder");
     sourceclient_init();
 
     if (jack_activate(g.client))
@@ -255,30 +447,19 @@ static int backend_main()
         exit(5);
         }
     atexit(cleanup_jack);
+    startup_mark("jack_activate");
+    startup_report();
+    rtarena_report();
 
     fprintf(g.out, "idjc backend ready\n");
     fflush(g.out);
 
-    alarm(1);
+    alarm(STALL_TIMEOUT);
 
-    while (keep_running && getline(&buffer, &n, g.in) > 0 && !g.app_shutdown)
-        {
-        /* Filter commands to submodules. */
-        if (!strcmp(buffer, "mx\n"))
-            keep_running = mixer_main();
-        else
-            {
-            if (!strcmp(buffer, "sc\n"))
-                keep_running = sourceclient_main();
-            else
-                {
-                fprintf(stderr, "main.c: expected module name, got: %s", buffer);
-                exit(5);
-                }
-            }
-
-        g.main_timeout = 0;
-        }
+    if (getenv("be2ui_events"))
+        evloop_notify_open(getenv("be2ui_events"));
+    if (evloop_add_fd(fileno(g.in), command_handler, NULL) && evloop_add_timer(1000, watchdog, NULL) && !g.app_shutdown)
+        evloop_run();
 
     jack_deactivate(g.client);
     jack_client_close(g.client);
@@ -286,8 +467,8 @@ static int backend_main()
 
     alarm(0);
 
-    if (buffer)
-        free(buffer);
+    if (command_buffer)
+        free(command_buffer);
 
     if (g.session_event_rb)
         jack_ringbuffer_free(g.session_event_rb);
@@ -299,6 +480,7 @@ int init_backend(int *read_pipe, int *write_pipe)
     {
     char *ui2be = getenv("ui2be");
     char *be2ui = getenv("be2ui");
+    char *events = getenv("be2ui_events");
     pid_t pid;
 
     unlink(ui2be);
@@ -308,6 +490,13 @@ int init_backend(int *read_pipe, int *write_pipe)
         fprintf(stderr, "init_backend: failed to make fifo\n");
         return -1;
         }
+    /* Optional so the interface carries on polling without it. */
+    if (events)
+        {
+        unlink(events);
+        if (mkfifo(events, S_IWUSR | S_IRUSR))
+            fprintf(stderr, "init_backend: failed to make event fifo\n");
+        }
 
     if (!(pid = fork()))
         {
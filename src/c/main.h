@@ -79,7 +79,11 @@ struct globs
     pthread_mutex_t avc_mutex;   /* lock for avcodec */
     FILE *in;                   /* comms stream with user interface */
     FILE *out;
+    int framed_input;          /* the current message is a binary frame rather than text lines */
     int freewheel;
     };
 
 extern struct globs g;
+
+/* startup_mark: time since the last mark is put down to phase in the startup report */
+void startup_mark(const char *phase);
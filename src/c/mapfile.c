@@ -0,0 +1,144 @@
+/*
+#   mapfile.c: memory mapped read-only file streams
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "mapfile.h"
+
+/* how much of the start and end of the file to ask the kernel to fetch
+ * ahead of time - the headers and the final ogg pages live there
+ */
+static const off_t willneed_head = 1 << 20;
+static const off_t willneed_tail = 1 << 16;
+
+struct mapfile
+    {
+    unsigned char *addr;
+    off_t length;
+    off_t pos;
+    };
+
+static ssize_t mapfile_read(void *cookie, char *buf, size_t size)
+    {
+    struct mapfile *self = cookie;
+    off_t remaining = self->length - self->pos;
+
+    if ((off_t)size > remaining)
+        size = remaining;
+    memcpy(buf, self->addr + self->pos, size);
+    self->pos += size;
+    return size;
+    }
+
+static int mapfile_seek(void *cookie, off64_t *offset, int whence)
+    {
+    struct mapfile *self = cookie;
+    off64_t pos;
+
+    switch (whence)
+        {
+        case SEEK_SET:
+            pos = *offset;
+            break;
+        case SEEK_CUR:
+            pos = self->pos + *offset;
+            break;
+        case SEEK_END:
+            pos = self->length + *offset;
+            break;
+        default:
+            return -1;
+        }
+
+    if (pos < 0)
+        return -1;
+    *offset = self->pos = pos;
+    return 0;
+    }
+
+static int mapfile_close(void *cookie)
+    {
+    struct mapfile *self = cookie;
+
+    munmap(self->addr, self->length);
+    free(self);
+    return 0;
+    }
+
+FILE *mapfile_fopen(const char *pathname)
+    {
+    static const cookie_io_functions_t io = { mapfile_read, NULL, mapfile_seek, mapfile_close };
+    struct mapfile *self;
+    struct stat st;
+    FILE *fp;
+    void *addr;
+    int fd;
+
+    if ((fd = open(pathname, O_RDONLY)) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0 || (off_t)(size_t)st.st_size != st.st_size)
+        goto fallback;
+
+    if ((addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        goto fallback;
+    close(fd);
+
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    madvise(addr, (st.st_size < willneed_head) ? st.st_size : willneed_head, MADV_WILLNEED);
+    if (st.st_size > willneed_tail)
+        {
+        /* madvise wants a page aligned start address */
+        off_t tail = (st.st_size - willneed_tail) & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+
+        madvise((unsigned char *)addr + tail, st.st_size - tail, MADV_WILLNEED);
+        }
+
+    if (!(self = malloc(sizeof (struct mapfile))))
+        {
+        fprintf(stderr, "mapfile_fopen: malloc failure\n");
+        munmap(addr, st.st_size);
+        return fopen(pathname, "r");
+        }
+    self->addr = addr;
+    self->length = st.st_size;
+    self->pos = 0;
+
+    if (!(fp = fopencookie(self, "r", io)))
+        {
+        mapfile_close(self);
+        return fopen(pathname, "r");
+        }
+
+    /* reads already come from memory so stdio buffering would only add a copy */
+    setvbuf(fp, NULL, _IONBF, 0);
+    return fp;
+
+    fallback:
+    close(fd);
+    return fopen(pathname, "r");
+    }
@@ -0,0 +1,32 @@
+/*
+#   mapfile.h: memory mapped read-only file streams
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdio.h>
+
+/* mapfile_fopen: open a file for reading as a stdio stream
+ * regular files are memory mapped so that fread, fgetc and fseeko are
+ * served from the mapping with no system calls, anything that can't be
+ * mapped is opened with fopen instead - either way close with fclose
+ */
+FILE *mapfile_fopen(const char *pathname);
+
+#endif /* MAPFILE_H */
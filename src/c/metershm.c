@@ -0,0 +1,98 @@
+/*
+#   metershm.c: the meter report published in shared memory
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "metershm.h"
+
+struct metershm
+    {
+    struct metershm_region *region;
+    size_t map_size;
+    };
+
+struct metershm *metershm_create(const char *pathname, size_t report_size)
+    {
+    struct metershm *self;
+    int fd;
+
+    if (!(self = calloc(1, sizeof (struct metershm))))
+        {
+        fprintf(stderr, "metershm_create: malloc failure\n");
+        return NULL;
+        }
+    self->map_size = sizeof (struct metershm_region) + report_size;
+
+    if ((fd = open(pathname, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+        {
+        fprintf(stderr, "metershm_create: failed to open %s: %s\n", pathname, strerror(errno));
+        free(self);
+        return NULL;
+        }
+    if (ftruncate(fd, self->map_size) < 0)
+        {
+        perror("metershm_create: ftruncate");
+        close(fd);
+        unlink(pathname);
+        free(self);
+        return NULL;
+        }
+    self->region = mmap(NULL, self->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (self->region == MAP_FAILED)
+        {
+        perror("metershm_create: mmap");
+        unlink(pathname);
+        free(self);
+        return NULL;
+        }
+    /* the pages are touched now rather than faulted in by the real time thread */
+    memset(self->region, 0, self->map_size);
+    self->region->size = report_size;
+    return self;
+    }
+
+void metershm_destroy(struct metershm *self)
+    {
+    munmap(self->region, self->map_size);
+    free(self);
+    }
+
+void *metershm_begin(struct metershm *self)
+    {
+    __atomic_store_n(&self->region->seq, self->region->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return self->region + 1;
+    }
+
+void metershm_end(struct metershm *self)
+    {
+    __atomic_store_n(&self->region->seq, self->region->seq + 1, __ATOMIC_RELEASE);
+    }
+
+int metershm_consumed(struct metershm *self)
+    {
+    return __atomic_load_n(&self->region->consumed, __ATOMIC_ACQUIRE) == self->region->seq;
+    }
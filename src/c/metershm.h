@@ -0,0 +1,52 @@
+/*
+#   metershm.h: the meter report published in shared memory
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METERSHM_H
+#define METERSHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "levels.h"
+
+/* the file starts with this and the report in the levels.h layout follows
+ * the sequence number is odd while an update is in progress so a reader
+ * copies the report out and retries if the number was odd or has changed
+ * the reader then stores the number it got in consumed so peaks can be held until seen
+ */
+struct metershm_region                   /* "=III" */
+    {
+    uint32_t seq;
+    uint32_t size;                       /* of the report that follows */
+    uint32_t consumed;                   /* written by the reader */
+    };
+
+struct metershm;
+
+/* metershm_create: map a file of the given report size for publishing, NULL on failure */
+struct metershm *metershm_create(const char *pathname, size_t report_size);
+void metershm_destroy(struct metershm *self);
+
+/* metershm_begin: the report to be filled in, which readers will ignore until metershm_end */
+void *metershm_begin(struct metershm *self);
+void metershm_end(struct metershm *self);
+
+/* metershm_consumed: whether the reader has taken the latest report */
+int metershm_consumed(struct metershm *self);
+
+#endif /* METERSHM_H */
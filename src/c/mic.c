@@ -25,12 +25,16 @@
 #include "mic.h"
 #include "dbconvert.h"
 #include "main.h"
+#include "rtarena.h"
 
 #define FALSE 0
 #define TRUE (!FALSE)
 
 static const float peak_init = 4.46e-7f; /* -127dB */
 
+/* position within the block of agc filtered audio */
+static jack_nframes_t agc_block_pos, agc_block_fill, agc_frames_left;
+
 static void calculate_gain_values(struct mic *self)
     {
     self->mgain = powf(10.0f, self->gain / 20.0f);
@@ -94,10 +98,105 @@ static void mic_process_start(struct mic *self, jack_nframes_t nframes)
         }
     }
 
-void mic_process_start_all(struct mic **mics, jack_nframes_t nframes)
+/* mic_can_idle: closed with the mute tail finished */
+static int mic_can_idle(struct mic *self, int keep_closed)
     {
-    while (*mics)
-        mic_process_start(*mics++, nframes);
+    return self && self->mode && !self->open && self->mute == 0.0f && !keep_closed;
+    }
+
+/* mic_idle_start: skip the per sample processing for the period
+ * the outputs are silenced and the peak meter is fed from the raw input
+ */
+static void mic_idle_start(struct mic *self, int keep_closed)
+    {
+    int paired = self->mode == 3 || (self->partner && self->partner->mode == 3);
+    int idle = mic_can_idle(self, keep_closed) && (!paired || mic_can_idle(self->partner, keep_closed));
+    float peak = 0.0f, a;
+
+    if (idle && !self->idle)
+        {
+        self->unp = self->unpm = self->unpmdj = 0.0f;
+        self->lrc = self->lc = self->rc = self->lcm = self->rcm = 0.0f;
+        self->munp = self->munpm = self->munpmdj = 0.0f;
+        self->mlrc = self->mlc = self->mrc = self->mlcm = self->mrcm = 0.0f;
+        self->lmunpm = self->rmunpm = self->lmunpmdj = self->rmunpmdj = 0.0f;
+        self->alrc = self->alc = self->arc = self->alcm = self->arcm = self->alcmdj = self->arcmdj = 0.0f;
+        /* the agc starts afresh on opening, the mute fade in covering its settling */
+        if (self->mode == 2)
+            agc_reset(self->agc);
+        }
+    self->idle = idle;
+
+    if (idle)
+        {
+        for (jack_nframes_t i = 0; i < self->nframes; i++)
+            {
+            a = fabsf(self->jadp[i]);
+            peak = (a > peak) ? a : peak;
+            }
+        a = peak * fabsf(self->host->mgain);
+        /* a NaN input is ignored as it is by the processing */
+        if (a > self->peak)
+            self->peak = a;
+        }
+    }
+
+void mic_process_start_all(struct mic **mics, jack_nframes_t nframes, int keep_closed)
+    {
+    for (struct mic **mp = mics; *mp; mp++)
+        mic_process_start(*mp, nframes);
+    for (struct mic **mp = mics; *mp; mp++)
+        if ((*mp)->mode)
+            mic_idle_start(*mp, keep_closed);
+
+    agc_block_pos = agc_block_fill = 0;
+    agc_frames_left = nframes;
+    }
+
+/* the agc filter cascades of all the fully processed mics are run
+ * together a block at a time ahead of the per sample processing
+ */
+static void mic_agc_block_prepare(struct mic **mics)
+    {
+    struct mic **mp;
+    int n = 0;
+
+    for (mp = mics; *mp; mp++)
+        n++;
+
+    struct agc *agcs[n];
+    float *io[n];
+
+    agc_block_fill = (agc_frames_left < MIC_AGC_BLOCK) ? agc_frames_left : MIC_AGC_BLOCK;
+    agc_frames_left -= agc_block_fill;
+    agc_block_pos = 0;
+
+    for (n = 0, mp = mics; *mp; mp++)
+        {
+        struct mic *self = *mp;
+        struct mic *host = self->host;
+
+        if (!self->mode || self->idle || host->mode != 2)
+            continue;
+
+        /* the same input as mic_process_stage1 and mic_process_stage2 */
+        for (jack_nframes_t i = 0; i < agc_block_fill; i++)
+            {
+            float sample = self->jadp[i];
+
+            if (isunordered(sample, sample))
+                sample = 0.0f;
+
+            if (self->mode == 3)
+                sample *= self->rel_igain * self->rel_gain;
+            self->agc_block[i] = sample * host->igain;
+            }
+
+        agcs[n] = self->agc;
+        io[n++] = self->agc_block;
+        }
+
+    agc_process_stage1_block(agcs, io, n, agc_block_fill);
     }
 
 static void mic_process_stage1(struct mic *self)
@@ -133,7 +232,12 @@ static void mic_process_stage2(struct mic *self)
     self->unpmdj = self->unpm * host->djmute;
 
     if (host->mode == 2)
-        agc_process_stage1(self->agc, sample);
+        {
+        if (agc_block_pos < agc_block_fill)
+            agc_process_stage1_filtered(self->agc, self->agc_block[agc_block_pos]);
+        else
+            agc_process_stage1(self->agc, sample);
+        }
     }
 
 static void mic_process_stage3(struct mic *self)
@@ -196,14 +300,20 @@ float mic_process_all(struct mic **mics)
     struct mic **mp;
     float df, agcdf;
 
+    if (agc_block_pos == agc_block_fill && agc_frames_left)
+        mic_agc_block_prepare(mics);
+
     /* processing broken up into stages to allow state sharing between
      * stereo pairs of microphones
      */
     for (mpp = mic_process; *mpp; mpp++)
         for (mp = mics; *mp; mp++)
-            if ((*mp)->mode)
+            if ((*mp)->mode && !(*mp)->idle)
                 (*mpp)(*mp);
 
+    if (agc_block_pos < agc_block_fill)
+        agc_block_pos++;
+
     /* ducking factor tally - lowest wins */
     for (df = 1.0f, mp = mics; *mp; mp++)
         df = (df > (agcdf = agc_get_ducking_factor((*mp)->agc))) ? agcdf : df;
@@ -211,6 +321,62 @@ float mic_process_all(struct mic **mics)
     return df;
     }
 
+void mic_process_block(struct mic **mics, struct mic_bus *bus, int n, int unmuted)
+    {
+    struct mic **mp, *m;
+    int i, k;
+
+    /* the stages run sample by sample as the agc state is shared between stereo pairs
+     * but each mic's contribution goes to planes of its own
+     */
+    for (i = 0; i < n; i++)
+        {
+        bus->df[i] = mic_process_all(mics);
+        for (mp = mics; *mp; mp++)
+            {
+            if (!(m = *mp)->mode || m->idle)
+                continue;
+            if (unmuted)
+                {
+                m->bus_out[MIC_BUS_STR_MIC_L][i] = m->mlc;
+                m->bus_out[MIC_BUS_STR_MIC_R][i] = m->mrc;
+                m->bus_out[MIC_BUS_DJ_MIC_L][i] = m->lmunpm;
+                m->bus_out[MIC_BUS_DJ_MIC_R][i] = m->rmunpm;
+                m->bus_out[MIC_BUS_DJ_AUX_L][i] = 0.0f;
+                m->bus_out[MIC_BUS_DJ_AUX_R][i] = 0.0f;
+                }
+            else
+                {
+                m->bus_out[MIC_BUS_STR_MIC_L][i] = m->mlcm;
+                m->bus_out[MIC_BUS_STR_MIC_R][i] = m->mrcm;
+                m->bus_out[MIC_BUS_DJ_MIC_L][i] = m->lmunpmdj;
+                m->bus_out[MIC_BUS_DJ_MIC_R][i] = m->rmunpmdj;
+                m->bus_out[MIC_BUS_DJ_AUX_L][i] = m->alcmdj;
+                m->bus_out[MIC_BUS_DJ_AUX_R][i] = m->arcmdj;
+                }
+            m->bus_out[MIC_BUS_STR_AUX_L][i] = m->alcm;
+            m->bus_out[MIC_BUS_STR_AUX_R][i] = m->arcm;
+            }
+        }
+
+    /* the mix is then vector adds over contiguous planes */
+    for (k = 0; k < MIC_BUS_PLANES; k++)
+        memset(bus->plane[k], 0, n * sizeof (float));
+    for (mp = mics; *mp; mp++)
+        {
+        if (!(m = *mp)->mode || m->idle)
+            continue;
+        for (k = 0; k < MIC_BUS_PLANES; k++)
+            {
+            float *restrict out = bus->plane[k];
+            const float *restrict in = m->bus_out[k];
+
+            for (i = 0; i < n; i++)
+                out[i] += in[i];
+            }
+        }
+    }
+
 static int mic_getpeak(struct mic *self)
     {
     int peakdb;
@@ -220,19 +386,46 @@ static int mic_getpeak(struct mic *self)
     return (peakdb < 0) ? peakdb : 0;
     }
 
-static void mic_stats(struct mic *self)
+/* mic_stats: append the levels to out unless delta is set and they are the same as last time */
+static void mic_stats(struct mic *self, GString *out, int delta)
     {
-    int red, yellow, green;
-
-    agc_get_meter_levels(self->host->agc, &red, &yellow, &green);
-    fprintf(g.out, "mic_%d_levels=%d,%d,%d,%d\n", self->id,
-                                    mic_getpeak(self), red, yellow, green);
+    struct levels_mic lm, *last = &self->stats_sent;
+
+    lm.id = self->id;
+    lm.peak = mic_getpeak(self);
+    agc_get_meter_levels(self->host->agc, &lm.red, &lm.yellow, &lm.green);
+    if (delta && self->stats_sent_valid && !memcmp(&lm, last, sizeof lm))
+        return;
+    g_string_append_printf(out, "mic_%d_levels=%d,%d,%d,%d\n", lm.id,
+                                    lm.peak, lm.red, lm.yellow, lm.green);
+    *last = lm;
+    self->stats_sent_valid = TRUE;
     }
 
-void mic_stats_all(struct mic **mics)
+void mic_stats_all(struct mic **mics, GString *out, int delta)
     {
     while (*mics)
-        mic_stats(*mics++);
+        mic_stats(*mics++, out, delta);
+    }
+
+/* mic_stats_binary_all: the meter levels of every mic in the binary report layout, returning how many
+ * with hold set the peaks already in lm are kept where they are higher
+ */
+int mic_stats_binary_all(struct mic **mics, struct levels_mic *lm, int hold)
+    {
+    int red, yellow, green, peak, n;
+
+    for (n = 0; mics[n]; n++, lm++)
+        {
+        agc_get_meter_levels(mics[n]->host->agc, &red, &yellow, &green);
+        lm->id = mics[n]->id;
+        peak = mic_getpeak(mics[n]);
+        lm->peak = (hold && lm->peak > peak) ? lm->peak : peak;
+        lm->red = red;
+        lm->yellow = yellow;
+        lm->green = green;
+        }
+    return n;
     }
 
 static void mic_set_role(struct mic *self, int role)
@@ -260,7 +453,7 @@ static struct mic *mic_init(jack_client_t *client, int sample_rate, int id)
     struct mic *self;
     char port_name[10];
 
-    if (!(self = calloc(1, sizeof (struct mic))))
+    if (!(self = rtarena_calloc(1, sizeof (struct mic))))
         {
         fprintf(stderr, "mic_init: malloc failure\n");
         return NULL;
@@ -275,7 +468,7 @@ static struct mic *mic_init(jack_client_t *client, int sample_rate, int id)
     if (!(self->agc = agc_init(sample_rate, 0.01161f, id)))
         {
         fprintf(stderr, "mic_init: agc_init failed\n");
-        free(self);
+        rtarena_free(self);
         return NULL;
         }
     snprintf(port_name, 10, "ch_in_%hhu", (uint8_t)id);
@@ -293,7 +486,7 @@ struct mic **mic_init_all(int n_mics, jack_client_t *client)
     /* used to map suitable port names from the audio back-end as default connection targets */
     const char **defaults, **dp;
 
-    if (!(mics = calloc(n_mics + 1, sizeof (struct mic *))))
+    if (!(mics = rtarena_calloc(n_mics + 1, sizeof (struct mic *))))
         {
         fprintf(stderr, "malloc failure\n");
         exit(5);
@@ -334,7 +527,7 @@ static void mic_free(struct mic *self)
         free(self->default_mapped_port_name);
         self->default_mapped_port_name = NULL;
         }
-    free(self);
+    rtarena_free(self);
     }
 
 void mic_free_all(struct mic **mics)
@@ -346,7 +539,7 @@ void mic_free_all(struct mic **mics)
         mic_free(*mp);
         *mp++ = NULL;
         }
-    free(mics);
+    rtarena_free(mics);
     }
 
 void mic_valueparse(struct mic *self, char *param)
@@ -18,7 +18,31 @@
 */
 
 #include <jack/jack.h>
+#include <glib.h>
 #include "agc.h"
+#include "levels.h"
+
+/* the number of samples run through the agc filters in one go */
+#define MIC_AGC_BLOCK 64
+
+/* the most frames mic_process_block will take */
+#define MIC_BUS_BLOCK 64
+
+/* the mic mixes, one plane of samples each */
+enum mic_bus_plane
+    {
+    MIC_BUS_STR_MIC_L, MIC_BUS_STR_MIC_R,       /* mics for the stream */
+    MIC_BUS_STR_AUX_L, MIC_BUS_STR_AUX_R,       /* aux inputs for the stream */
+    MIC_BUS_DJ_MIC_L, MIC_BUS_DJ_MIC_R,         /* mics for the dj mix */
+    MIC_BUS_DJ_AUX_L, MIC_BUS_DJ_AUX_R,         /* aux inputs for the dj mix */
+    MIC_BUS_PLANES
+    };
+
+struct mic_bus
+    {
+    float plane[MIC_BUS_PLANES][MIC_BUS_BLOCK];
+    float df[MIC_BUS_BLOCK];                    /* the ducking factor, lowest of all the mics */
+    };
 
 struct mic
     {
@@ -86,11 +110,25 @@ struct mic
     jack_default_audio_sample_t *jadp; /* jack audio data pointer */
     jack_nframes_t nframes; /* jack buffer size */
     char *default_mapped_port_name; /* the natural partner port or NULL*/
+    float agc_block[MIC_AGC_BLOCK]; /* agc stage1 filtered audio */
+    struct levels_mic stats_sent; /* the levels as last reported, for delta encoding */
+    int stats_sent_valid;
+    int idle;        /* closed and silent so processing is skipped this period */
+    float bus_out[MIC_BUS_PLANES][MIC_BUS_BLOCK]; /* this mic's share of the bus */
     };
 
-void mic_process_start_all(struct mic **mics, jack_nframes_t nframes);
+/* mic_process_start_all: keep_closed keeps closed mics processing
+ * for when their unmuted feed is in use
+ */
+void mic_process_start_all(struct mic **mics, jack_nframes_t nframes, int keep_closed);
 float mic_process_all(struct mic **mics);
-void mic_stats_all(struct mic **mics);
+/* mic_process_block: process n frames and mix them to bus
+ * with unmuted the stream planes carry the mics regardless of open state
+ * as heard by voip callers in private phone mode
+ */
+void mic_process_block(struct mic **mics, struct mic_bus *bus, int n, int unmuted);
+void mic_stats_all(struct mic **mics, GString *out, int delta);
+int mic_stats_binary_all(struct mic **mics, struct levels_mic *lm, int hold);
 struct mic **mic_init_all(int n_mics, jack_client_t *client);
 void mic_free_all(struct mic **self);
 void mic_valueparse(struct mic *s, char *param);
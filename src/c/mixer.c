@@ -29,6 +29,8 @@
 #include <jack/statistics.h>
 #include <jack/midiport.h>
 #include <jack/session.h>
+#include <jack/thread.h>
+#include <semaphore.h>
 #include <getopt.h>
 #include <string.h>
 #include <fcntl.h>
@@ -37,6 +39,7 @@
 #include <signal.h>
 #include <locale.h>
 #include <limits.h>
+#include <glib.h>
 
 #include "kvpparse.h"
 #include "dbconvert.h"
@@ -45,11 +48,20 @@
 #include "mp3dec.h"
 #include "speextag.h"
 #include "sndfileinfo.h"
+#include "probe.h"
+#include "loudness.h"
 #include "avcodecdecode.h"
 #include "oggdec.h"
 #include "mic.h"
 #include "bsdcompat.h"
 #include "peakfilter.h"
+#include "levels.h"
+#include "metershm.h"
+#include "truepeak.h"
+#include "rttime.h"
+#include "pcmcache.h"
+#include "rtarena.h"
+#include "mixer.h"
 #include "sig.h"
 #include "main.h"
 
@@ -58,9 +70,12 @@
 
 /* playlength of ring buffer contents in seconds */
 #define MAIN_RB_SIZE 10.0
-/* number of bytes in the MIDI queue buffer */
+/* number of bytes in the MIDI text buffer and events in the MIDI queue */
 #define MIDI_QUEUE_SIZE 1024
 
+/* the most effects players, one bit each of a long long */
+#define MAX_EFFECTS 62
+
 /* the different VOIP modes */
 #define NO_PHONE 0
 #define PHONE_PUBLIC 1
@@ -99,13 +114,18 @@ static int main_play;
 /* flag to indicate whether to use the player reading function which supports speed variance */
 static int speed_variance;
 /* flags indicating play status of effects players lsb = first effect player */
-static int effects_active;
+static long long effects_active;
+/* effects players per bank, the rest go to the second bank */
+static int effects_bank_size = 12;
+/* bumped after each effects player command so the jack callback relists them */
+static int effects_commands, effects_commands_seen;
 /* flag to indicate if audio is routed via dsp interface */
 static int using_dsp;
 /* handles for microphone */
 static struct mic **mics;
 /* peakfilter handles for stream peak */
 static struct peakfilter *str_pf_l, *str_pf_r;
+static struct truepeak_limiter *str_limiter;   /* brickwall on the stream output, off by default */
 /* counts the number of times port connections have changed */
 static unsigned int port_connection_count;
 /* counts the number of times port connection counts have been reported */
@@ -115,6 +135,12 @@ static int voip_pan_f;
 static float voip_pan_l, voip_pan_r;
 
 static jack_nframes_t alarm_size;
+/* index value for reading from the alarm wave table */
+static jack_nframes_t alarm_index;
+/* a counter variable used to trigger the volume smoothing on a regular basis */
+static unsigned vol_smooth_count;
+/* when set the mixer processes audio a block at a time rather than by sample */
+static int use_block_engine;
 
 static float headroom_db;                      /* player muting level when mic is open */
 static float str_l_tally, str_r_tally;  /* used to calculate rms value */
@@ -148,14 +174,22 @@ static sample_t mb_lc_aud = 1.0, mb_rc_aud = 1.0;
 static sample_t voip_lc_aud = 1.0, voip_rc_aud = 1.0;
 static sample_t current_headroom;      /* the amount of mic headroom being applied */
 static sample_t *eot_alarm_table;      /* the wave table for the DJ alarm */
+#define CROSSFADE_PATTERNS 3
+static float crossfade_table[CROSSFADE_PATTERNS][101][2]; /* left and right player gains by position */
             
-static char midi_queue[MIDI_QUEUE_SIZE];
-static size_t midi_nqueued= 0;
-static pthread_mutex_t midi_mutex;
+/* midi events in their raw form as passed from the jack callback to the gui thread */
+struct midi_raw_event
+    {
+    unsigned char data[3];
+    };
+
+static jack_ringbuffer_t *midi_rb;
+static unsigned int midi_events_lost, midi_read_errors;  /* written only by the jack callback */
 
 static struct xlplayer *plr_l, *plr_r, *plr_i; /* player instance stuctures */
 static struct xlplayer **plr_j;
 static struct xlplayer **plr_j_roster;
+static struct xlplayer **plr_j_active;          /* those that may sound, kept by the jack callback */
 static struct xlplayer *players[4];
 static struct xlplayer *players_roster[4];
 
@@ -166,26 +200,50 @@ static char *midi, *audl, *audr, *strl, *strr, *action;
 static char *target_port_name;
 static char *dol, *dor, *dil, *dir;
 static char *oggpathname, *sndfilepathname, *avformatpathname, *speexpathname, *speextaglist, *speexcreatedby;
-static char *playerpathname, *seek_s, *size, *playerplaylist, *loop, *resamplequality;
-static char *mic_param, *fade_mode;
+static char *playerpathname, *seek_s, *size, *playerplaylist, *loop, *resamplequality, *probe_list, *probe_mode;
+static char *mic_param, *fade_mode, *silence_db;
 static char *rg_db, *headroom;
+static char *tp_lookahead, *tp_ceiling;
 static char *flag;
 static char *channel_mode_string;
 static char *use_jingles_vol_2;
 static char *jackport, *jackport2, *jackfilter;
 static char *effect_ix, *voip_pan;
 static char *session_event_string, *session_commandline;
+static char *report_format, *report_rate;
+
+static GString *stats_out;                     /* the text stats are gathered here and written at once */
+static char *subscribed_format;                /* the report format when requestlevels doesn't say */
+static gint64 subscribed_interval;             /* microseconds between player stats reports */
+static gint64 players_reported;                /* when the player stats were last sent */
+static int stats_full_due = TRUE;              /* the next delta report must be complete */
+
+static struct metershm *levels_shm;            /* the meter report mapped for the UI to read */
+static int levels_shm_active;                  /* the UI is reading it so the mixer keeps it current */
+static size_t levels_shm_size;
 
 static struct smoothing_volume jingles_headroom_smoothing;
 static int jingles_headroom_control;
 
+static struct xlplayer_pool *effects_pool;     /* the decoding threads of the effects players */
+
+static FILE *kvp_record_fp;                    /* $kvp_record, the commands handled as timestamped frames */
+static gint64 kvp_record_start;
+
+/* the actions that act on the JACK server rather than the mix are left out of recordings */
+static const char * const kvp_record_skip[] = {
+    "jackportread", "freewheel_toggle", "freewheel_on", "freewheel_off",
+    "jackconnect", "jackdisconnect", "session_reply", NULL };
+
 /* dictionary look-up type thing used by the parse routine */
 static struct kvpdict kvpdict[] = {
-            { "PLRP", &playerpathname, NULL },   /* The media-file pathname for playback */
-            { "RGDB", &rg_db, NULL },            /* ReplayGain volume level controlled at the player end */
+            { "PLRP", &playerpathname, NULL, KVP_PERSIST },  /* The media-file pathname for playback, kept by the player */
+            { "RGDB", &rg_db, NULL, KVP_PERSIST },   /* ReplayGain volume level controlled at the player end, not resent on restart */
             { "SEEK", &seek_s, NULL },           /* Playback initial seek time in seconds */
-            { "SIZE", &size, NULL },             /* Size of the file in seconds */
+            { "SIZE", &size, NULL, KVP_PERSIST },    /* Size of the file in seconds, not resent on restart */
             { "PLPL", &playerplaylist, NULL },   /* A playlist for the media players */
+            { "PRBL", &probe_list, NULL },       /* Files to read the metadata of or analyse, one per "+PRBL" line */
+            { "PRBM", &probe_mode, NULL },       /* "exact" when playing times mustn't be estimated */
             { "LOOP", &loop, NULL },             /* play in a loop */
             { "MIXR", &mixer_string, NULL },     /* Control strings */
             { "COMP", &compressor_string, NULL },/* packed full of data */
@@ -205,6 +263,7 @@ static struct kvpdict kvpdict[] = {
             { "DIR", &dir, NULL   },
             { "VOL2", &use_jingles_vol_2, NULL },
             { "FADE", &fade_mode, NULL },
+            { "SLNC", &silence_db, NULL },       /* Trailing silence threshold in dBFS, 0 for the default */
             { "OGGP", &oggpathname, NULL },
             { "SPXP", &speexpathname, NULL },
             { "SNDP", &sndfilepathname, NULL },
@@ -214,6 +273,8 @@ static struct kvpdict kvpdict[] = {
             { "RSQT", &resamplequality, NULL },
             { "AGCP", &mic_param, NULL },
             { "HEAD", &headroom, NULL },
+            { "TPLA", &tp_lookahead, NULL },
+            { "TPCL", &tp_ceiling, NULL },
             { "FLAG", &flag, NULL },
             { "CMOD", &channel_mode_string, NULL },
             { "JFIL", &jackfilter, NULL },
@@ -222,10 +283,62 @@ static struct kvpdict kvpdict[] = {
             { "EFCT", &effect_ix, NULL },
             { "VPAN", &voip_pan, NULL },
             { "ACTN", &action, NULL },                   /* Action to take */
+            { "FRMT", &report_format, NULL },            /* "binary" for the fixed layout meter report, "shm" for shared memory, "delta" for changes only */
+            { "RATE", &report_rate, NULL },              /* milliseconds between player stats in a subscription */
             { "session_event", &session_event_string, NULL },
-            { "session_command", &session_commandline, NULL },
+            { "session_command", &session_commandline, NULL, KVP_PERSIST },   /* handed over to JACK */
             { "", NULL, NULL }};
 
+/* midi_format_queued: render queued midi events as text for the user interface
+ * events that do not fit are left in the queue for the next time around
+ */
+static void midi_format_queued(char *out, size_t out_size)
+    {
+    static unsigned int lost_reported, errors_reported;
+    struct midi_raw_event raw;
+    size_t used = 0;
+    int command_type, channel_id, pitch_wheel;
+    unsigned int lost = midi_events_lost, errors = midi_read_errors;
+
+    if (lost != lost_reported)
+        {
+        fprintf(stderr, "MIDI queue overflow, %u events lost\n", lost - lost_reported);
+        lost_reported = lost;
+        }
+    if (errors != errors_reported)
+        {
+        fprintf(stderr, "Error reading %u MIDI events from JACK\n", errors - errors_reported);
+        errors_reported = errors;
+        }
+
+    out[0] = '\0';
+    while (used + 12 < out_size && jack_ringbuffer_read(midi_rb, (char *)&raw, sizeof raw) == sizeof raw)
+        {
+        const char *sep = used ? "," : "";
+
+        command_type = raw.data[0] & 0xF0;
+        channel_id = raw.data[0] & 0x0F;
+        switch (command_type)
+            {
+            case 0xB0: /* MIDI_COMMAND_CHANGE */
+                used += snprintf(out + used, out_size - used, "%sc%x.%x:%x", sep, channel_id, raw.data[1], raw.data[2]);
+                break;
+            case 0x80: /* MIDI_NOTE_OFF */
+                used += snprintf(out + used, out_size - used, "%sn%x.%x:0", sep, channel_id, raw.data[1]);
+                break;
+            case 0x90: /* MIDI_NOTE_ON */
+                used += snprintf(out + used, out_size - used, "%sn%x.%x:7F", sep, channel_id, raw.data[1]);
+                break;
+            case 0xFE: /* MIDI_PITCH_WHEEL_CHANGE */
+                pitch_wheel = 0x2040 - raw.data[2] - raw.data[1] * 128;
+                if (pitch_wheel < 0) pitch_wheel = 0;
+                if (pitch_wheel > 0x7F) pitch_wheel = 0x7F;
+                used += snprintf(out + used, out_size - used, "%sp%x.0:%x", sep, channel_id, pitch_wheel);
+                break;
+            }
+        }
+    }
+
 static void custom_jack_port_connect_callback(jack_port_id_t a, jack_port_id_t b, int connect, void *arg)
     {
     ++port_connection_count;
@@ -233,11 +346,80 @@ static void custom_jack_port_connect_callback(jack_port_id_t a, jack_port_id_t b
 
 void mixer_stop_players()
     {
-    plr_l->command = CMD_COMPLETE;
-    plr_r->command = CMD_COMPLETE;
+    xlplayer_command_cancel(plr_l);
+    xlplayer_command_cancel(plr_r);
     for (struct xlplayer **p = plr_j; *p; ++p)
-        (*p)->command = CMD_COMPLETE;
-    plr_i->command = CMD_COMPLETE;
+        xlplayer_command_cancel(*p);
+    xlplayer_command_cancel(plr_i);
+    }
+
+/* crossfade_gains: the gain of each player at a crossfader position of 0 to 100 */
+static void crossfade_gains(int pattern, int position, float *left, float *right)
+    {
+    float xprop, yprop;
+    const float bias = 0.35386f;
+    const float pat3 = 0.9504953575f;
+
+    if (pattern == 0)
+        {
+        xprop = position * 0.01F;
+        yprop = -xprop + 1.0F;
+        *left = yprop / ((xprop * bias) / (xprop + bias) + yprop);
+        *right = xprop / ((yprop * bias) / (yprop + bias) + xprop); 
+        
+        /* Okay, but now for stage 2 to add a steep slope. */
+        if (xprop >= 0.5F)
+            *left /= 1 + (xprop - 0.5) * 8.0F;
+        else
+            *right /= 1 + (yprop - 0.5) * 8.0F;
+        }
+    else if (pattern == 1)
+        {
+        if (position > 55) 
+            {
+            if (position < 100)
+                {
+                yprop = -position + 55;
+                *left = db2level(0.8f * yprop);
+                }
+            else
+                *left = 0.0f;
+            *right = 1.0;
+            }
+        else if (position < 45)
+            {
+            if (position > 0)
+                {
+                yprop = position - 45;
+                *right = db2level(0.8f * yprop);
+                }
+            else
+                *right = 0.0f;
+            *left = 1.0;
+            }
+        else
+            *left = *right = 1.0;
+        }
+    else if (pattern == 2)
+        {
+        if (position == 100)
+            *left = 0.0f;
+        else
+            *left = powf(pat3, position);
+            
+        if (position == 0)
+            *right = 0.0f;
+        else
+            *right = powf(pat3, 100 - position);
+        }
+    }
+
+/* crossfade_init: tabulate the crossfader curves */
+static void crossfade_init()
+    {
+    for (int p = 0; p < CROSSFADE_PATTERNS; ++p)
+        for (int i = 0; i <= 100; ++i)
+            crossfade_gains(p, i, &crossfade_table[p][i][0], &crossfade_table[p][i][1]);
     }
 
 /* update_smoothed_volumes: stuff that gets run once every 32 samples */
@@ -246,19 +428,16 @@ static void update_smoothed_volumes()
     static sample_t cross_left = 1.0F, cross_right = 0.0F;
     sample_t mic_target, diff;
     static float interlude_autovol = -128.0F;
-    float xprop, yprop;
-    const float bias = 0.35386f;
-    const float pat3 = 0.9504953575f;
     int hr[2] = {127, 127};
 
     xlplayer_smoothing_process_all(players);
-    xlplayer_smoothing_process_all(plr_j);
+    xlplayer_smoothing_process_all(plr_j_active);
 
-    for (struct xlplayer **p = plr_j; *p; ++p)
+    for (struct xlplayer **p = plr_j_active; *p; ++p)
         {
         if ((*p)->have_data_f)
             {
-            int i = (p - plr_j) / 12;
+            int i = (*p)->effect_bank;
             
             hr[i] = i ? jinglesheadroom2 : jinglesheadroom1;
             }
@@ -288,59 +467,12 @@ static void update_smoothed_volumes()
         else
             current_crossfade--;
 
-        if (current_crosspattern == 0)
-            {
-            xprop = current_crossfade * 0.01F;
-            yprop = -xprop + 1.0F;
-            cross_left = yprop / ((xprop * bias) / (xprop + bias) + yprop);
-            cross_right = xprop / ((yprop * bias) / (yprop + bias) + xprop); 
-            
-            /* Okay, but now for stage 2 to add a steep slope. */
-            if (xprop >= 0.5F)
-                cross_left /= 1 + (xprop - 0.5) * 8.0F;
-            else
-                cross_right /= 1 + (yprop - 0.5) * 8.0F;
-            }
-        else if (current_crosspattern == 1)
-            {
-            if (current_crossfade > 55) 
-                {
-                if (current_crossfade < 100)
-                    {
-                    yprop = -current_crossfade + 55;
-                    cross_left = db2level(0.8f * yprop);
-                    }
-                else
-                    cross_left = 0.0f;
-                cross_right = 1.0;
-                }
-            else if (current_crossfade < 45)
-                {
-                if (current_crossfade > 0)
-                    {
-                    yprop = current_crossfade - 45;
-                    cross_right = db2level(0.8f * yprop);
-                    }
-                else
-                    cross_right = 0.0f;
-                cross_left = 1.0;
-                }
-            else
-                cross_left = cross_right = 1.0;
-            }
-        else if (current_crosspattern == 2)
+        if (current_crosspattern >= 0 && current_crosspattern < CROSSFADE_PATTERNS
+                                && current_crossfade >= 0 && current_crossfade <= 100)
             {
-            if (current_crossfade == 100)
-                cross_left = 0.0f;
-            else
-                cross_left = powf(pat3, current_crossfade);
-                
-            if (current_crossfade == 0)
-                cross_right = 0.0f;
-            else
-                cross_right = powf(pat3, 100 - current_crossfade);
+            cross_left = crossfade_table[current_crosspattern][current_crossfade][0];
+            cross_right = crossfade_table[current_crosspattern][current_crossfade][1];
             }
-
         }
 
     plr_l->cf_l_gain = cross_left;
@@ -404,10 +536,10 @@ static void update_smoothed_volumes()
         
         if (effects_active)
             {
-            if (effects_active & ((0x1 << 12) - 1))
+            if (effects_active & ((1LL << effects_bank_size) - 1))
                 lev1 = plr_j[0]->volume.level;
-            if (effects_active & (((0x1 << 12) - 1) << 12))
-                lev2 = plr_j[12]->volume.level;
+            if (effects_active & ~((1LL << effects_bank_size) - 1))
+                lev2 = plr_j[effects_bank_size]->volume.level;
             lev = (lev2 > lev1) ? lev2 : lev1;
             }
         else
@@ -428,225 +560,704 @@ static void update_smoothed_volumes()
         else
             dfmod -= 0.01;
         }
+
+    /* the players' combined gains for the levels stage until the next update */
+    xlplayer_gains_update_all(players);
+    xlplayer_gains_update_all(plr_j_active);
     }
 
-/* process_audio: the JACK callback routine */
-int mixer_process_audio(jack_nframes_t nframes, void *arg)
+/* the block engine: each stage of the mix runs over a sub-block of frames */
+#define MIXER_BLOCK_SIZE MIC_BUS_BLOCK
+
+struct mixer_buffers
     {
-    int samples_todo;   /* The samples remaining counter in the main loop */
-    float df;           /* main player ducking factor */
-    float idf;          /* interlude player ducking factor */
-    /* the following are used to calculate the microphone mix */
-    sample_t lc_s_micmix, rc_s_micmix, dl_micmix, dr_micmix;
-    sample_t lc_s_auxmix, rc_s_auxmix, dl_auxmix, dr_auxmix;
-    /* the following are used to apply the output of the compressor code to the audio levels */
-    sample_t compressor_gain = 1.0;
-    /* a counter variable used to trigger the volume smoothing on a regular basis */
-    static unsigned vol_smooth_count = 0;
-    /* index values for reading from a table of fade gain values */
-    static jack_nframes_t alarm_index = 0;
-    /* pointers to buffers provided by JACK */
-    sample_t *aap, *lap, *rap, *lsp, *rsp, *lpsp, *rpsp, *lprp, *rprp;
-    sample_t *al_buffer, *la_buffer, *ra_buffer, *ls_buffer, *rs_buffer, *lps_buffer, *rps_buffer;
-    sample_t *dolp, *dorp, *dilp, *dirp;
-    sample_t *plolp, *plorp, *prolp, *prorp, *piolp, *piorp, *pe1olp, *pe1orp, *pe2olp, *pe2orp;
-    sample_t *plilp, *plirp, *prilp, *prirp, *piilp, *piirp, *peilp, *peirp;
-    /* midi_control */
-    void *midi_buffer;
-    jack_midi_event_t midi_event;
-    jack_nframes_t midi_nevents, midi_eventi;
-    int midi_command_type, midi_channel_id;
-    int pitch_wheel;
-    struct mic **micp;
-    float * const jh = &jingles_headroom_smoothing.level;
-    float * const jhi = inter_force ? jh : &((struct {float a;}){1.0f}).a;
-    float e_ls, e_rs, e1_ls, e1_rs, e2_ls, e2_rs;
+    sample_t *al, *la, *ra, *ls, *rs, *lps, *rps, *lpr, *rpr;
+    sample_t *dol, *dor, *dil, *dir;
+    sample_t *plol, *plor, *prol, *pror, *piol, *pior, *pe1ol, *pe1or, *pe2ol, *pe2or;
+    sample_t *plil, *plir, *pril, *prir, *piil, *piir, *peil, *peir;
+    };
 
-    /* midi_control. read incoming commands forward to gui */
-    midi_buffer = jack_port_get_buffer(g.port.midi_port, nframes);
-    midi_nevents = jack_midi_get_event_count(midi_buffer);
-    if (midi_nevents!=0)
+/* the parallel block engine, $mixer_threads=2
+ * the mic stage for the whole period runs on a helper thread while the callback
+ * thread reads out the main players, the two joining before the mix proper
+ */
+static struct
+    {
+    int enabled;
+    jack_native_thread_t thread;
+    sem_t start_sem;            /* posted by the callback, one per period */
+    sem_t done_sem;             /* posted by the helper when the mics are done */
+    int terminate;
+    struct mic_bus *blocks;     /* the mic bus for a period, one entry per block */
+    jack_nframes_t max_frames;
+    jack_nframes_t nframes;     /* the job in hand */
+    int unmuted;
+    } mixpar;
+
+static void *mixer_helper_main(void *arg)
+    {
+    jack_nframes_t done, n;
+
+    sig_mask_thread();
+    for (;;)
         {
-        pthread_mutex_lock(&midi_mutex);
-        for (midi_eventi = 0; midi_eventi < midi_nevents; midi_eventi++)
+        while (sem_wait(&mixpar.start_sem) && errno == EINTR);
+        if (mixpar.terminate)
+            break;
+        for (done = 0; done < mixpar.nframes; done += n)
             {
-            if (jack_midi_event_get(&midi_event, midi_buffer, midi_eventi) != 0)
-                {
-                fprintf(stderr, "Error reading MIDI event from JACK\n");
-                continue;
-                }
-            if  (midi_nqueued+12 > MIDI_QUEUE_SIZE) /* max length of command */
-                {
-                fprintf(stderr, "MIDI queue overflow, event lost\n");
-                continue;
-                }
-            midi_command_type= midi_event.buffer[0] & 0xF0;
-            midi_channel_id= midi_event.buffer[0] & 0x0F;
-            switch (midi_command_type)
-                {
-                case 0xB0: /* MIDI_COMMAND_CHANGE */
-                    midi_nqueued+= snprintf(
-                        midi_queue+midi_nqueued, MIDI_QUEUE_SIZE-midi_nqueued,
-                        ",c%x.%x:%x", midi_channel_id, midi_event.buffer[1], midi_event.buffer[2]
-                    );
-                    break;
-                case 0x80: /* MIDI_NOTE_OFF */
-                    midi_nqueued+= snprintf(
-                        midi_queue+midi_nqueued, MIDI_QUEUE_SIZE-midi_nqueued,
-                        ",n%x.%x:0", midi_channel_id, midi_event.buffer[1]
-                    );
-                    break;
-                case 0x90: /* MIDI_NOTE_ON */
-                    midi_nqueued+= snprintf(
-                        midi_queue+midi_nqueued, MIDI_QUEUE_SIZE-midi_nqueued,
-                        ",n%x.%x:7F", midi_channel_id, midi_event.buffer[1]
-                    );
-                    break;
-                case 0xFE: /* MIDI_PITCH_WHEEL_CHANGE */
-                    pitch_wheel= 0x2040 - midi_event.buffer[2] - midi_event.buffer[1]*128;
-                    if (pitch_wheel < 0) pitch_wheel = 0;
-                    if (pitch_wheel > 0x7F) pitch_wheel = 0x7F;
-                    midi_nqueued+= snprintf(
-                        midi_queue+midi_nqueued, MIDI_QUEUE_SIZE-midi_nqueued,
-                        ",p%x.0:%x", midi_channel_id, pitch_wheel
-                    );
-                    break;
-                }
+            n = (mixpar.nframes - done > MIXER_BLOCK_SIZE) ? MIXER_BLOCK_SIZE : mixpar.nframes - done;
+            mic_process_block(mics, &mixpar.blocks[done / MIXER_BLOCK_SIZE], n, mixpar.unmuted);
             }
-        pthread_mutex_unlock(&midi_mutex);
+        sem_post(&mixpar.done_sem);
         }
+    return NULL;
+    }
 
-    /* get the data pointers for the jack ports */
+/* mixer_parallel_init: start the helper at the same realtime priority as the callback */
+static void mixer_parallel_init(jack_nframes_t max_frames)
     {
-        struct jack_ports *p = &g.port;
-        
-        al_buffer = aap = (sample_t *) jack_port_get_buffer(p->alarm_out, nframes);
-        la_buffer = lap = (sample_t *) jack_port_get_buffer(p->dj_out_l, nframes);
-        ra_buffer = rap = (sample_t *) jack_port_get_buffer(p->dj_out_r, nframes);
-        ls_buffer = lsp = (sample_t *) jack_port_get_buffer(p->str_out_l, nframes);
-        rs_buffer = rsp = (sample_t *) jack_port_get_buffer(p->str_out_r, nframes);
-        lps_buffer = lpsp = (sample_t *) jack_port_get_buffer(p->voip_out_l, nframes);
-        rps_buffer = rpsp = (sample_t *) jack_port_get_buffer(p->voip_out_r, nframes);
-        lprp = (sample_t *) jack_port_get_buffer(p->voip_in_l, nframes);
-        rprp = (sample_t *) jack_port_get_buffer(p->voip_in_r, nframes);
-        dolp = (sample_t *) jack_port_get_buffer(p->dsp_out_l, nframes);
-        dorp = (sample_t *) jack_port_get_buffer(p->dsp_out_r, nframes);
-        dilp = (sample_t *) jack_port_get_buffer(p->dsp_in_l, nframes);
-        dirp = (sample_t *) jack_port_get_buffer(p->dsp_in_r, nframes);
-        plolp = (sample_t *) jack_port_get_buffer(p->pl_out_l, nframes);
-        plorp = (sample_t *) jack_port_get_buffer(p->pl_out_r, nframes);
-        prolp = (sample_t *) jack_port_get_buffer(p->pr_out_l, nframes);
-        prorp = (sample_t *) jack_port_get_buffer(p->pr_out_r, nframes);
-        piolp = (sample_t *) jack_port_get_buffer(p->pi_out_l, nframes);
-        piorp = (sample_t *) jack_port_get_buffer(p->pi_out_r, nframes);
-        pe1olp = (sample_t *) jack_port_get_buffer(p->pe1_out_l, nframes);
-        pe1orp = (sample_t *) jack_port_get_buffer(p->pe1_out_r, nframes);
-        pe2olp = (sample_t *) jack_port_get_buffer(p->pe2_out_l, nframes);
-        pe2orp = (sample_t *) jack_port_get_buffer(p->pe2_out_r, nframes);
-        plilp = (sample_t *) jack_port_get_buffer(p->pl_in_l, nframes);
-        plirp = (sample_t *) jack_port_get_buffer(p->pl_in_r, nframes);
-        prilp = (sample_t *) jack_port_get_buffer(p->pr_in_l, nframes);
-        prirp = (sample_t *) jack_port_get_buffer(p->pr_in_r, nframes);
-        piilp = (sample_t *) jack_port_get_buffer(p->pi_in_l, nframes);
-        piirp = (sample_t *) jack_port_get_buffer(p->pi_in_r, nframes);
-        peilp = (sample_t *) jack_port_get_buffer(p->pe_in_l, nframes);
-        peirp = (sample_t *) jack_port_get_buffer(p->pe_in_r, nframes);
+    int n_threads = getenv("mixer_threads") ? atoi(getenv("mixer_threads")) : 1;
+
+    if (n_threads < 2)
+        return;
+    if (!use_block_engine)
+        {
+        fprintf(stderr, "mixer_parallel_init: $mixer_threads needs the block engine, mixing on one thread\n");
+        return;
+        }
+    if (n_threads > 2)
+        fprintf(stderr, "mixer_parallel_init: the mic stage is one job, using 2 threads not %d\n", n_threads);
+
+    mixpar.max_frames = (max_frames + MIXER_BLOCK_SIZE - 1) / MIXER_BLOCK_SIZE * MIXER_BLOCK_SIZE;
+    if (!(mixpar.blocks = rtarena_calloc(mixpar.max_frames / MIXER_BLOCK_SIZE, sizeof (struct mic_bus))))
+        {
+        fprintf(stderr, "mixer_parallel_init: malloc failure\n");
+        exit(5);
+        }
+    sem_init(&mixpar.start_sem, 0, 0);
+    sem_init(&mixpar.done_sem, 0, 0);
+    if (jack_client_create_thread(g.client, &mixpar.thread, jack_client_real_time_priority(g.client),
+                                    jack_is_realtime(g.client), mixer_helper_main, NULL))
+        {
+        fprintf(stderr, "mixer_parallel_init: failed to start the helper thread, mixing on one thread\n");
+        return;
+        }
+    mixpar.enabled = TRUE;
+    fprintf(stderr, "mixer_parallel_init: mic stage on a helper thread for periods up to %u frames\n", (unsigned)mixpar.max_frames);
     }
 
-    /* resets the running totals for the vu meter stats */      
-    if (reset_vu_stats_f)
+static void mixer_parallel_cleanup()
+    {
+    if (mixpar.enabled)
         {
-        str_l_tally = str_r_tally = 0.0;
-        rms_tally_count = 0;
-        reset_vu_stats_f = FALSE;
+        mixpar.terminate = TRUE;
+        sem_post(&mixpar.start_sem);
+        jack_client_stop_thread(g.client, mixpar.thread);
+        mixpar.enabled = FALSE;
         }
+    }
 
-    mic_process_start_all(mics, nframes);
-    xlplayer_read_start_all(players, nframes, players_roster);
-    xlplayer_read_start_all(plr_j, nframes, plr_j_roster);
-    
-    /* there are four mixer modes with a lot of shared code */
-    /* to keep things smaller and more maintainable macros have been used */
-    if (simple_mixer == FALSE && mixermode == NO_PHONE)  /* Fully featured mixer code */
+static void mixer_buffers_advance(struct mixer_buffers *b, int n)
+    {
+    b->al += n; b->la += n; b->ra += n; b->ls += n; b->rs += n;
+    b->lps += n; b->rps += n; b->lpr += n; b->rpr += n;
+    b->dol += n; b->dor += n; b->dil += n; b->dir += n;
+    b->plol += n; b->plor += n; b->prol += n; b->pror += n; b->piol += n; b->pior += n;
+    b->pe1ol += n; b->pe1or += n; b->pe2ol += n; b->pe2or += n;
+    b->plil += n; b->plir += n; b->pril += n; b->prir += n;
+    b->piil += n; b->piir += n; b->peil += n; b->peir += n;
+    }
+
+/* mixer_alarm_block: the end-of-track alarm tone, a block at a time
+ * one pass of the wave table is played each time the alarm is set
+ */
+static void mixer_alarm_block(sample_t *out, jack_nframes_t n)
+    {
+    jack_nframes_t todo;
+
+    while (eot_alarm_f && n)
         {
-        memset(lps_buffer, 0, nframes * sizeof (sample_t)); /* send silence to VOIP */
-        memset(rps_buffer, 0, nframes * sizeof (sample_t));
-        for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++,
-                    dilp++, dirp++, dolp++, dorp++, aap++,
-                    plolp++, plorp++, prolp++, prorp++, piolp++, piorp++, pe1olp++, pe1orp++, pe2olp++, pe2orp++,
-                    plilp++, plirp++, prilp++, prirp++, piilp++, piirp++, peilp++, peirp++)
-            {       
-            if (vol_smooth_count++ % 100 == 0) /* Can change volume level every so many samples */
-                update_smoothed_volumes();
-                
-            df = powf(mic_process_all(mics), dfmod);
-            for (micp = mics, lc_s_micmix = rc_s_micmix = lc_s_auxmix =
-                 rc_s_auxmix = dl_micmix = dr_micmix = dl_auxmix = dr_auxmix =
-                 0.0f; *micp; micp++)
-                {
-                lc_s_micmix += (*micp)->mlcm;
-                rc_s_micmix += (*micp)->mrcm;
-                lc_s_auxmix += (*micp)->alcm;
-                rc_s_auxmix += (*micp)->arcm;
-                dl_micmix += (*micp)->lmunpmdj;
-                dr_micmix += (*micp)->rmunpmdj;
-                dl_auxmix += (*micp)->alcmdj;
-                dr_auxmix += (*micp)->arcmdj;
-                }
-         
-            /* ducking calculation */
+        if (alarm_index >= alarm_size)
             {
-                 float hr = db2level(current_headroom);
-                 df = (df < hr) ? df : hr;
+            alarm_index = 0;
+            eot_alarm_f = 0;
+            break;
             }
-            idf = inter_force ? df : 1.0;
+        todo = alarm_size - alarm_index;
+        if (todo > n)
+            todo = n;
+        for (jack_nframes_t i = 0; i < todo; i++)
+            out[i] = eot_alarm_table[alarm_index + i] * alarm_audio_gain;
+        alarm_index += todo;
+        out += todo;
+        n -= todo;
+        }
+    memset(out, 0, n * sizeof (sample_t));
+    }
 
-            #define COMMON_MIX() \
-                do { \
-                xlplayer_read_next_all(players); \
-                xlplayer_read_next_all(plr_j_roster); \
-                \
-                /* player audio routing through jack ports */ \
-                *plolp = plr_l->ls; \
-                *plorp = plr_l->rs; \
-                *prolp = plr_r->ls; \
-                *prorp = plr_r->rs; \
-                *piolp = plr_i->ls; \
-                *piorp = plr_i->rs; \
-                plr_l->ls = *plilp; \
-                plr_l->rs = *plirp; \
-                plr_r->ls = *prilp; \
-                plr_r->rs = *prirp; \
-                plr_i->ls = *piilp; \
-                plr_i->rs = *piirp; \
-                xlplayer_levels_all(players); \
-                xlplayer_levels_all(plr_j); \
-                e1_ls = e1_rs = e2_ls = e2_rs = 0.0f; \
-                for (struct xlplayer **p = plr_j_roster; *p; ++p) { \
-                    if ((*p)->id < (1 << 12)) \
-                        { \
-                        e1_ls += (*p)->ls_str; \
-                        e1_rs += (*p)->rs_str; \
-                        } \
-                    else \
-                        { \
-                        e2_ls += (*p)->ls_str; \
-                        e2_rs += (*p)->rs_str; \
-                        } \
-                    } \
-                /* effects audio from multiple players goes out on one port */ \
-                /* a stream-audio-only effect */ \
-                *pe1olp = e1_ls; \
-                *pe1orp = e1_rs; \
-                *pe2olp = e2_ls; \
-                *pe2orp = e2_rs; \
-                e_ls = *peilp; \
-                e_rs = *peirp; \
-                } while(0)
-                
-            COMMON_MIX();
-            
-            /* the stream mix */
+/* the block engine builds each output bus as a weighted sum of sub-mixes
+ * the sub-mixes, the stems, are made once per block and shared by every bus that takes them
+ * a bus's output is itself a stem so later buses may take it in
+ */
+enum mix_stem {
+    STEM_PLAYERS_STR, STEM_PLAYERS_AUD,         /* main players with ducking and headroom */
+    STEM_INTER_STR, STEM_INTER_AUD,             /* interlude player, ducked when forced */
+    STEM_EFFECTS, STEM_EFFECTS_DUCKED,          /* the effects return */
+    STEM_MIC_STR, STEM_MIC_DJ,                  /* the mic sums */
+    STEM_AUX_STR, STEM_AUX_DJ,                  /* the aux sums */
+    STEM_VOIP_RX,                               /* from the voip callers after level and pan */
+    STEM_VOIP_TX, STEM_STREAM_MIX,              /* bus outputs */
+    STEM_STREAM,                                /* the stream mix or its return from the dsp interface */
+    STEM_DJ,
+    MIX_STEMS };
+
+#define MIX_BUS_TERMS 6
+#define MIX_GRAPH_BUSES 3
+
+struct mix_term
+    {
+    enum mix_stem in;
+    float wl, wr;
+    };
+
+struct mix_bus
+    {
+    enum mix_stem out;
+    struct compressor *limiter;                 /* NULL for none */
+    int n_terms;
+    struct mix_term term[MIX_BUS_TERMS];
+    };
+
+struct mix_graph
+    {
+    int n_buses;                                /* evaluated in order */
+    struct mix_bus bus[MIX_GRAPH_BUSES];
+    unsigned uses;                              /* bit per stem taken in by any bus */
+    int voip_rx;                                /* the voip return is levelled and panned first */
+    };
+
+static struct mix_bus *mix_graph_bus(struct mix_graph *g, enum mix_stem out, struct compressor *limiter)
+    {
+    struct mix_bus *bus = &g->bus[g->n_buses++];
+
+    bus->out = out;
+    bus->limiter = limiter;
+    bus->n_terms = 0;
+    return bus;
+    }
+
+static void mix_bus_take(struct mix_graph *g, struct mix_bus *bus, enum mix_stem in, float wl, float wr)
+    {
+    bus->term[bus->n_terms++] = (struct mix_term){ in, wl, wr };
+    g->uses |= 1U << in;
+    }
+
+/* mixer_mix_graph: the buses for the mixer mode, the weights are held for the period */
+static void mixer_mix_graph(struct mix_graph *g, int private_mic_off)
+    {
+    struct mix_bus *bus;
+
+    g->n_buses = 0;
+    g->uses = 0;
+    g->voip_rx = (mixermode == PHONE_PUBLIC || private_mic_off);
+
+    if (mixermode == PHONE_PUBLIC)
+        {
+        /* the callers hear the mics and effects and the stream carries what they hear */
+        bus = mix_graph_bus(g, STEM_VOIP_TX, &phone_limiter);
+        mix_bus_take(g, bus, STEM_MIC_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_EFFECTS, 1.0f, 1.0f);
+        bus = mix_graph_bus(g, STEM_STREAM_MIX, &stream_limiter);
+        mix_bus_take(g, bus, STEM_PLAYERS_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_VOIP_RX, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_VOIP_TX, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_AUX_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_INTER_STR, 1.0f, 1.0f);
+        }
+    else if (private_mic_off)
+        {
+        /* no ducking, the callers get the stream mix back with the mics and effects */
+        bus = mix_graph_bus(g, STEM_STREAM_MIX, &stream_limiter);
+        mix_bus_take(g, bus, STEM_PLAYERS_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_AUX_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_INTER_STR, 1.0f, 1.0f);
+        bus = mix_graph_bus(g, STEM_VOIP_TX, &phone_limiter);
+        mix_bus_take(g, bus, STEM_STREAM_MIX, mb_lc_aud, mb_rc_aud);
+        mix_bus_take(g, bus, STEM_EFFECTS, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_MIC_STR, 1.0f, 1.0f);
+        }
+    else
+        {
+        bus = mix_graph_bus(g, STEM_STREAM_MIX, &stream_limiter);
+        mix_bus_take(g, bus, STEM_PLAYERS_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_EFFECTS_DUCKED, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_MIC_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_AUX_STR, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_INTER_STR, 1.0f, 1.0f);
+        if (mixermode == PHONE_PRIVATE)
+            {
+            /* voip callers get stream mix at a certain volume */
+            bus = mix_graph_bus(g, STEM_VOIP_TX, NULL);
+            mix_bus_take(g, bus, STEM_STREAM_MIX, mb_lc_aud, mb_rc_aud);
+            }
+        }
+
+    /* the dj mix */
+    if (stream_monitor)
+        {
+        /* allow the DJ to hear the mix that the listeners are hearing */
+        bus = mix_graph_bus(g, STEM_DJ, NULL);
+        mix_bus_take(g, bus, STEM_STREAM, 1.0f, 1.0f);
+        }
+    else if (private_mic_off)
+        {
+        /* the DJ can hear the VOIP phone call */
+        bus = mix_graph_bus(g, STEM_DJ, &audio_limiter);
+        mix_bus_take(g, bus, STEM_STREAM, mb_lc_aud, mb_rc_aud);
+        mix_bus_take(g, bus, STEM_EFFECTS, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_MIC_DJ, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_VOIP_RX, 1.0f, 1.0f);
+        }
+    else
+        {
+        bus = mix_graph_bus(g, STEM_DJ, &audio_limiter);
+        mix_bus_take(g, bus, STEM_PLAYERS_AUD, 1.0f, 1.0f);
+        if (mixermode == PHONE_PUBLIC)
+            {
+            mix_bus_take(g, bus, STEM_VOIP_RX, 1.0f, 1.0f);
+            mix_bus_take(g, bus, STEM_EFFECTS, 1.0f, 1.0f);
+            }
+        else
+            mix_bus_take(g, bus, STEM_EFFECTS_DUCKED, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_MIC_DJ, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_AUX_DJ, 1.0f, 1.0f);
+        mix_bus_take(g, bus, STEM_INTER_AUD, 1.0f, 1.0f);
+        }
+    }
+
+/* mix_bus_eval: one bus for a block, a pass over the block per term */
+static void mix_bus_eval(const struct mix_bus *bus, sample_t *const stem[MIX_STEMS][2], int n)
+    {
+    for (int c = 0; c < 2; c++)
+        {
+        sample_t *restrict out = stem[bus->out][c];
+        const struct mix_term *t = bus->term;
+        const sample_t *restrict in = stem[t->in][c];
+        float w = c ? t->wr : t->wl;
+
+        for (int i = 0; i < n; i++)
+            out[i] = in[i] * w;
+        for (++t; t < bus->term + bus->n_terms; ++t)
+            {
+            in = stem[t->in][c];
+            w = c ? t->wr : t->wl;
+            for (int i = 0; i < n; i++)
+                out[i] += in[i] * w;
+            }
+        }
+    if (bus->limiter)
+        limiter_block(bus->limiter, stem[bus->out][0], stem[bus->out][1], n);
+    }
+
+/* mix_stem_sum: in place, a and b summed and ducked */
+static void mix_stem_sum(sample_t *restrict a, const sample_t *restrict b, const float *restrict df, int n)
+    {
+    for (int i = 0; i < n; i++)
+        a[i] = (a[i] + b[i]) * df[i];
+    }
+
+/* mix_stem_scale: out may be in */
+static void mix_stem_scale(sample_t *out, const sample_t *in, const float *restrict df, int n)
+    {
+    for (int i = 0; i < n; i++)
+        out[i] = in[i] * df[i];
+    }
+
+/* mixer_process_block_engine: alternative to the sample by sample mixer loops
+ * the same mix save that smoothed gains ramp across each block where the sample mixer steps them
+ */
+static void mixer_process_block_engine(jack_nframes_t nframes, struct mixer_buffers *buffers)
+    {
+    struct mixer_buffers b = *buffers;
+    const int private_mic_off = (mixermode == PHONE_PRIVATE && mic_on == 0);
+    const int ducking = (mixermode == NO_PHONE || (mixermode == PHONE_PRIVATE && mic_on));
+    /* per frame microphone totals and ducking factors */
+    static struct mic_bus serial_bus;
+    struct mic_bus *bus = &serial_bus;
+    const int parallel = mixpar.enabled && nframes <= mixpar.max_frames;
+    float df[MIXER_BLOCK_SIZE], idf[MIXER_BLOCK_SIZE];
+    /* smoothed gains ramped across the block */
+    float hr[MIXER_BLOCK_SIZE];
+    static float hr_from = 1.0f;
+    /* per frame player levels: main players, interlude, effects */
+    sample_t l_ls_str[MIXER_BLOCK_SIZE], l_rs_str[MIXER_BLOCK_SIZE], l_ls_aud[MIXER_BLOCK_SIZE], l_rs_aud[MIXER_BLOCK_SIZE];
+    sample_t r_ls_str[MIXER_BLOCK_SIZE], r_rs_str[MIXER_BLOCK_SIZE], r_ls_aud[MIXER_BLOCK_SIZE], r_rs_aud[MIXER_BLOCK_SIZE];
+    sample_t i_ls_str[MIXER_BLOCK_SIZE], i_rs_str[MIXER_BLOCK_SIZE], i_ls_aud[MIXER_BLOCK_SIZE], i_rs_aud[MIXER_BLOCK_SIZE];
+    sample_t j_ls[MIXER_BLOCK_SIZE], j_rs[MIXER_BLOCK_SIZE], j_ls_str[MIXER_BLOCK_SIZE], j_rs_str[MIXER_BLOCK_SIZE];
+    sample_t e_l_ducked[MIXER_BLOCK_SIZE], e_r_ducked[MIXER_BLOCK_SIZE];
+    struct mix_graph graph;
+    int todo, n, i;
+
+    mixer_mix_graph(&graph, private_mic_off);
+
+    if (mixermode == NO_PHONE)
+        {
+        memset(b.lps, 0, nframes * sizeof (sample_t)); /* send silence to VOIP */
+        memset(b.rps, 0, nframes * sizeof (sample_t));
+        }
+
+    /* fork: the mics go to the helper, the main players are read out here, then join */
+    if (parallel)
+        {
+        rttime_mark(RTTIME_MIX);
+        mixpar.nframes = nframes;
+        mixpar.unmuted = private_mic_off;
+        sem_post(&mixpar.start_sem);
+        xlplayer_read_next_block(plr_l, b.plol, b.plor, nframes);
+        xlplayer_read_next_block(plr_r, b.prol, b.pror, nframes);
+        xlplayer_read_next_block(plr_i, b.piol, b.pior, nframes);
+        while (sem_wait(&mixpar.done_sem) && errno == EINTR);
+        rttime_mark(RTTIME_MICS);
+        }
+
+    for (todo = nframes; todo; todo -= n, mixer_buffers_advance(&b, n))
+        {
+        n = (todo > MIXER_BLOCK_SIZE) ? MIXER_BLOCK_SIZE : todo;
+        if (parallel)
+            bus = &mixpar.blocks[(nframes - todo) / MIXER_BLOCK_SIZE];
+
+        /* the smoothed volumes step every 100 samples as in the sample mixer
+         * and the gains ramp from one block's end value to the next
+         * so a step is spread over the block in which it falls
+         */
+        if ((100 - vol_smooth_count % 100) % 100 < n)
+            update_smoothed_volumes();
+        vol_smooth_count += n;
+
+        smoothing_ramp(hr, &hr_from, db2level(current_headroom), n);
+
+        /* the effects headroom goes in with the player gains, not in private phone mode with the mic off */
+        const float jh = private_mic_off ? 1.0f : jingles_headroom_smoothing.level;
+        const float jhi = inter_force ? jh : 1.0f;
+
+        /* microphone stage */
+        if (!parallel)
+            {
+            rttime_mark(RTTIME_MIX);
+            mic_process_block(mics, bus, n, private_mic_off);
+            rttime_mark(RTTIME_MICS);
+            }
+        for (i = 0; i < n; i++)
+            {
+            /* ducking calculation, in phone public mode only headroom applies
+             * and in private phone mode with the mic off neither does
+             */
+            if (ducking)
+                {
+                df[i] = powf(bus->df[i], dfmod);
+                df[i] = (df[i] < hr[i]) ? df[i] : hr[i];
+                }
+            else
+                df[i] = private_mic_off ? 1.0f : hr[i];
+            idf[i] = inter_force ? df[i] : 1.0f;
+            }
+
+        /* player stage: audio is routed out and back in through jack ports */
+        if (!parallel)
+            {
+            xlplayer_read_next_block(plr_l, b.plol, b.plor, n);
+            xlplayer_read_next_block(plr_r, b.prol, b.pror, n);
+            xlplayer_read_next_block(plr_i, b.piol, b.pior, n);
+            }
+        xlplayer_levels_block(plr_l, b.plil, b.plir, n, jh, l_ls_aud, l_rs_aud, l_ls_str, l_rs_str);
+        xlplayer_levels_block(plr_r, b.pril, b.prir, n, jh, r_ls_aud, r_rs_aud, r_ls_str, r_rs_str);
+        xlplayer_levels_block(plr_i, b.piil, b.piir, n, jhi, i_ls_aud, i_rs_aud, i_ls_str, i_rs_str);
+
+        /* effects audio from multiple players goes out on one port per bank */
+        memset(b.pe1ol, 0, n * sizeof (sample_t));
+        memset(b.pe1or, 0, n * sizeof (sample_t));
+        memset(b.pe2ol, 0, n * sizeof (sample_t));
+        memset(b.pe2or, 0, n * sizeof (sample_t));
+        for (struct xlplayer **p = plr_j_roster; *p; ++p)
+            {
+            sample_t *el, *er;
+
+            xlplayer_read_next_block(*p, j_ls, j_rs, n);
+            xlplayer_levels_block(*p, j_ls, j_rs, n, 1.0f, NULL, NULL, j_ls_str, j_rs_str);
+            if ((*p)->effect_bank == 0)
+                el = b.pe1ol, er = b.pe1or;
+            else
+                el = b.pe2ol, er = b.pe2or;
+            for (i = 0; i < n; i++)
+                {
+                el[i] += j_ls_str[i];
+                er[i] += j_rs_str[i];
+                }
+            }
+
+        /* the voip return is levelled and panned before any bus takes it in */
+        if (graph.voip_rx)
+            {
+            for (i = 0; i < n; i++)
+                {
+                b.lpr[i] *= voip_lc_aud;
+                b.rpr[i] *= voip_rc_aud;
+                }
+            limiter_block(&incoming_phone_limiter, b.lpr, b.rpr, n);
+            if (voip_pan_f)
+                for (i = 0; i < n; i++)
+                    {
+                    float dnmix = (b.lpr[i] + b.rpr[i]) / 2.0f;
+
+                    b.lpr[i] = dnmix * voip_pan_l;
+                    b.rpr[i] = dnmix * voip_pan_r;
+                    }
+            }
+
+        /* the shared sub-mixes, each made once for all the buses that take it */
+        if (graph.uses & (1U << STEM_PLAYERS_STR))
+            {
+            mix_stem_sum(l_ls_str, r_ls_str, df, n);
+            mix_stem_sum(l_rs_str, r_rs_str, df, n);
+            }
+        if (graph.uses & (1U << STEM_PLAYERS_AUD))
+            {
+            mix_stem_sum(l_ls_aud, r_ls_aud, df, n);
+            mix_stem_sum(l_rs_aud, r_rs_aud, df, n);
+            }
+        if (graph.uses & (1U << STEM_INTER_STR))
+            {
+            mix_stem_scale(i_ls_str, i_ls_str, idf, n);
+            mix_stem_scale(i_rs_str, i_rs_str, idf, n);
+            }
+        if (graph.uses & (1U << STEM_INTER_AUD))
+            {
+            mix_stem_scale(i_ls_aud, i_ls_aud, idf, n);
+            mix_stem_scale(i_rs_aud, i_rs_aud, idf, n);
+            }
+        if (graph.uses & (1U << STEM_EFFECTS_DUCKED))
+            {
+            mix_stem_scale(e_l_ducked, b.peil, df, n);
+            mix_stem_scale(e_r_ducked, b.peir, df, n);
+            }
+
+        sample_t *const stem[MIX_STEMS][2] = {
+            [STEM_PLAYERS_STR] = { l_ls_str, l_rs_str },
+            [STEM_PLAYERS_AUD] = { l_ls_aud, l_rs_aud },
+            [STEM_INTER_STR] = { i_ls_str, i_rs_str },
+            [STEM_INTER_AUD] = { i_ls_aud, i_rs_aud },
+            [STEM_EFFECTS] = { b.peil, b.peir },
+            [STEM_EFFECTS_DUCKED] = { e_l_ducked, e_r_ducked },
+            [STEM_MIC_STR] = { bus->plane[MIC_BUS_STR_MIC_L], bus->plane[MIC_BUS_STR_MIC_R] },
+            [STEM_MIC_DJ] = { bus->plane[MIC_BUS_DJ_MIC_L], bus->plane[MIC_BUS_DJ_MIC_R] },
+            [STEM_AUX_STR] = { bus->plane[MIC_BUS_STR_AUX_L], bus->plane[MIC_BUS_STR_AUX_R] },
+            [STEM_AUX_DJ] = { bus->plane[MIC_BUS_DJ_AUX_L], bus->plane[MIC_BUS_DJ_AUX_R] },
+            [STEM_VOIP_RX] = { b.lpr, b.rpr },
+            [STEM_VOIP_TX] = { b.lps, b.rps },
+            [STEM_STREAM_MIX] = { b.dol, b.dor },
+            /* take the stream from the dsp interface when in use */
+            [STEM_STREAM] = { using_dsp ? b.dil : b.dol, using_dsp ? b.dir : b.dor },
+            [STEM_DJ] = { b.la, b.ra } };
+
+        for (int k = 0; k < graph.n_buses; k++)
+            mix_bus_eval(&graph.bus[k], stem, n);
+        memcpy(b.ls, stem[STEM_STREAM][0], n * sizeof (sample_t));
+        memcpy(b.rs, stem[STEM_STREAM][1], n * sizeof (sample_t));
+
+        /* apply dj audio sound level and make the rms tally */
+        for (i = 0; i < n; i++)
+            {
+            b.la[i] *= dj_audio_gain;
+            b.ra[i] *= dj_audio_gain;
+            str_l_tally += b.ls[i] * b.ls[i];
+            str_r_tally += b.rs[i] * b.rs[i];
+            }
+        rms_tally_count += n;
+
+        mixer_alarm_block(b.al, n);
+        }
+
+    /* make note of the peak volume levels */
+    peakfilter_process_block(str_pf_l, buffers->ls, nframes);
+    peakfilter_process_block(str_pf_r, buffers->rs, nframes);
+    str_l_meansqrd = str_l_tally/rms_tally_count;
+    str_r_meansqrd = str_r_tally/rms_tally_count;
+    }
+
+/* mixer_effects_list_update: relist the effects players that may sound
+ * done after commands to them so per sample work is for those playing
+ */
+static void mixer_effects_list_update()
+    {
+    int commands = __atomic_load_n(&effects_commands, __ATOMIC_ACQUIRE);
+    struct xlplayer **w = plr_j_active;
+
+    if (commands == effects_commands_seen)
+        return;
+    effects_commands_seen = commands;
+
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        {
+        if (xlplayer_idle(*p))
+            {
+            (*p)->effect_listed = FALSE;
+            continue;
+            }
+        /* the smoothed levels didn't follow the controls while off the list */
+        if (!(*p)->effect_listed)
+            {
+            xlplayer_smoothing_settle(*p);
+            (*p)->effect_listed = TRUE;
+            }
+        *w++ = *p;
+        }
+    *w = NULL;
+    }
+
+/* mixer_effects_list_prune: the players that have finished come off the list */
+static void mixer_effects_list_prune()
+    {
+    struct xlplayer **w = plr_j_active;
+
+    for (struct xlplayer **p = plr_j_active; *p; ++p)
+        {
+        if (xlplayer_idle(*p))
+            (*p)->effect_listed = FALSE;
+        else
+            *w++ = *p;
+        }
+    *w = NULL;
+    }
+
+/* mixer_effects_command: tell the jack callback an effects player was sent a command */
+static void mixer_effects_command()
+    {
+    __atomic_add_fetch(&effects_commands, 1, __ATOMIC_RELEASE);
+    }
+
+/* the per sample engine comes in compile time specialised variants
+ * mixer_sample_loop is expanded once for each mode and combination of the per period flags
+ * so the per frame code carries no tests of using_dsp, stream_monitor, voip_pan_f or inter_force
+ * the variants a mode doesn't distinguish come out identical and the compiler is free to fold them
+ */
+#define PHONE_PRIVATE_MIC_OFF 3
+
+#define SAMPLE_DSP 0x1
+#define SAMPLE_MONITOR 0x2
+#define SAMPLE_VOIP_PAN 0x4
+#define SAMPLE_INTER 0x8
+
+static inline __attribute__((always_inline)) void mixer_sample_loop(jack_nframes_t nframes,
+            const struct mixer_buffers *b, const int k_mode, const int k_dsp,
+            const int k_monitor, const int k_voip_pan, const int k_inter)
+    {
+    static const float unity = 1.0f;
+    int samples_todo;   /* The samples remaining counter in the main loop */
+    float df;           /* main player ducking factor */
+    float idf;          /* interlude player ducking factor */
+    /* the following are used to calculate the microphone mix */
+    sample_t lc_s_micmix, rc_s_micmix, dl_micmix, dr_micmix;
+    sample_t lc_s_auxmix, rc_s_auxmix, dl_auxmix, dr_auxmix;
+    /* the following are used to apply the output of the compressor code to the audio levels */
+    sample_t compressor_gain = 1.0;
+    sample_t * const ls_buffer = b->ls, * const rs_buffer = b->rs;
+    sample_t * const lps_buffer = b->lps, * const rps_buffer = b->rps;
+    sample_t *lap = b->la, *rap = b->ra, *lsp = b->ls, *rsp = b->rs;
+    sample_t *lpsp = b->lps, *rpsp = b->rps, *lprp = b->lpr, *rprp = b->rpr;
+    sample_t *dolp = b->dol, *dorp = b->dor, *dilp = b->dil, *dirp = b->dir;
+    sample_t *plolp = b->plol, *plorp = b->plor, *prolp = b->prol, *prorp = b->pror;
+    sample_t *piolp = b->piol, *piorp = b->pior;
+    sample_t *pe1olp = b->pe1ol, *pe1orp = b->pe1or, *pe2olp = b->pe2ol, *pe2orp = b->pe2or;
+    sample_t *plilp = b->plil, *plirp = b->plir, *prilp = b->pril, *prirp = b->prir;
+    sample_t *piilp = b->piil, *piirp = b->piir, *peilp = b->peil, *peirp = b->peir;
+    struct mic **micp;
+    float * const jh = &jingles_headroom_smoothing.level;
+    const float * const jhi = k_inter ? jh : &unity;
+    float e_ls, e_rs, e1_ls, e1_rs, e2_ls, e2_rs;
+
+    /* there are four mixer modes with a lot of shared code */
+    /* to keep things smaller and more maintainable macros have been used */
+    if (k_mode == NO_PHONE)  /* Fully featured mixer code */
+        {
+        memset(lps_buffer, 0, nframes * sizeof (sample_t)); /* send silence to VOIP */
+        memset(rps_buffer, 0, nframes * sizeof (sample_t));
+        for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++,
+                    dilp++, dirp++, dolp++, dorp++,
+                    plolp++, plorp++, prolp++, prorp++, piolp++, piorp++, pe1olp++, pe1orp++, pe2olp++, pe2orp++,
+                    plilp++, plirp++, prilp++, prirp++, piilp++, piirp++, peilp++, peirp++)
+            {       
+            if (vol_smooth_count++ % 100 == 0) /* Can change volume level every so many samples */
+                update_smoothed_volumes();
+                
+            df = powf(mic_process_all(mics), dfmod);
+            for (micp = mics, lc_s_micmix = rc_s_micmix = lc_s_auxmix =
+                 rc_s_auxmix = dl_micmix = dr_micmix = dl_auxmix = dr_auxmix =
+                 0.0f; *micp; micp++)
+                {
+                lc_s_micmix += (*micp)->mlcm;
+                rc_s_micmix += (*micp)->mrcm;
+                lc_s_auxmix += (*micp)->alcm;
+                rc_s_auxmix += (*micp)->arcm;
+                dl_micmix += (*micp)->lmunpmdj;
+                dr_micmix += (*micp)->rmunpmdj;
+                dl_auxmix += (*micp)->alcmdj;
+                dr_auxmix += (*micp)->arcmdj;
+                }
+         
+            /* ducking calculation */
+            {
+                 float hr = db2level(current_headroom);
+                 df = (df < hr) ? df : hr;
+            }
+            idf = k_inter ? df : 1.0;
+
+            #define COMMON_MIX() \
+                do { \
+                xlplayer_read_next_all(players); \
+                xlplayer_read_next_all(plr_j_roster); \
+                \
+                /* player audio routing through jack ports */ \
+                *plolp = plr_l->ls; \
+                *plorp = plr_l->rs; \
+                *prolp = plr_r->ls; \
+                *prorp = plr_r->rs; \
+                *piolp = plr_i->ls; \
+                *piorp = plr_i->rs; \
+                plr_l->ls = *plilp; \
+                plr_l->rs = *plirp; \
+                plr_r->ls = *prilp; \
+                plr_r->rs = *prirp; \
+                plr_i->ls = *piilp; \
+                plr_i->rs = *piirp; \
+                xlplayer_levels_all(players); \
+                xlplayer_levels_all(plr_j_roster); \
+                e1_ls = e1_rs = e2_ls = e2_rs = 0.0f; \
+                for (struct xlplayer **p = plr_j_roster; *p; ++p) { \
+                    if ((*p)->effect_bank == 0) \
+                        { \
+                        e1_ls += (*p)->ls_str; \
+                        e1_rs += (*p)->rs_str; \
+                        } \
+                    else \
+                        { \
+                        e2_ls += (*p)->ls_str; \
+                        e2_rs += (*p)->rs_str; \
+                        } \
+                    } \
+                /* effects audio from multiple players goes out on one port */ \
+                /* a stream-audio-only effect */ \
+                *pe1olp = e1_ls; \
+                *pe1orp = e1_rs; \
+                *pe2olp = e2_ls; \
+                *pe2orp = e2_rs; \
+                e_ls = *peilp; \
+                e_rs = *peirp; \
+                } while(0)
+                
+            COMMON_MIX();
+            
+            /* the stream mix */
             *dolp = ((plr_l->ls_str + plr_r->ls_str) * *jh + e_ls) * df + lc_s_micmix + lc_s_auxmix + plr_i->ls_str * idf * *jhi;
             *dorp = ((plr_l->rs_str + plr_r->rs_str) * *jh + e_rs) * df + rc_s_micmix + rc_s_auxmix + plr_i->rs_str * idf * *jhi;
             
@@ -658,7 +1269,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
 
             #define COMMON_MIX2() \
                 do  { \
-                    if (using_dsp) \
+                    if (k_dsp) \
                         { \
                         *lsp = *dilp; \
                         *rsp = *dirp; \
@@ -672,7 +1283,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                 
             COMMON_MIX2();
 
-            if (stream_monitor == FALSE)
+            if (k_monitor == FALSE)
                 {
                 *lap = ((plr_l->ls_aud + plr_r->ls_aud) * *jh + e_ls) * df + dl_micmix + dl_auxmix + plr_i->ls_aud * idf * *jhi;
                 *rap = ((plr_l->rs_aud + plr_r->rs_aud) * *jh + e_rs) * df + dr_micmix + dr_auxmix + plr_i->rs_aud * idf * *jhi;
@@ -692,42 +1303,24 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                     *lap *= dj_audio_gain; \
                     *rap *= dj_audio_gain; \
                     \
-                    /* make note of the peak volume levels */ \
-                    peakfilter_process(str_pf_l, *lsp); \
-                    peakfilter_process(str_pf_r, *rsp); \
-                    \
                     /* used for rms calculation */ \
                     str_l_tally += *lsp * *lsp; \
                     str_r_tally += *rsp * *rsp; \
                     rms_tally_count++; \
-                    \
-                    if (eot_alarm_f) /* end-of-track alarm tone */ \
-                        { \
-                        if (alarm_index >= alarm_size) \
-                            { \
-                            alarm_index = 0; \
-                            eot_alarm_f = 0; \
-                            } \
-                        else \
-                            { \
-                            *aap = eot_alarm_table[alarm_index] * alarm_audio_gain; \
-                            alarm_index++; \
-                            } \
-                        } \
-                    else \
-                        *aap = 0.0f; \
-                    \
                 } while(0)
                 
             COMMON_MIX3();
             }
+        /* make note of the peak volume levels */
+        peakfilter_process_block(str_pf_l, ls_buffer, nframes);
+        peakfilter_process_block(str_pf_r, rs_buffer, nframes);
         str_l_meansqrd = str_l_tally/rms_tally_count;
         str_r_meansqrd = str_r_tally/rms_tally_count;
         }
     else
-        if (simple_mixer == FALSE && mixermode == PHONE_PUBLIC)
+        if (k_mode == PHONE_PUBLIC)
             {
-            for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++, aap++,
+            for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++,
                     lpsp++, rpsp++, lprp++, rprp++, dilp++, dirp++, dolp++, dorp++,
                     plolp++, plorp++, prolp++, prorp++, piolp++, piorp++, pe1olp++, pe1orp++, pe2olp++, pe2orp++,
                     plilp++, plirp++, prilp++, prirp++, piilp++, piirp++, peilp++, peirp++)
@@ -754,7 +1347,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
 
                 /* No ducking but headroom still must apply */
                 df = db2level(current_headroom);
-                idf = inter_force ? df : 1.0;
+                idf = k_inter ? df : 1.0;
 
                 COMMON_MIX();
 
@@ -767,7 +1360,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                 compressor_gain = db2level(limiter(&incoming_phone_limiter, *lprp *= voip_lc_aud, *rprp *= voip_rc_aud));
                 *lprp *= compressor_gain;
                 *rprp *= compressor_gain;
-                if (voip_pan_f)
+                if (k_voip_pan)
                     {
                     float dnmix = (*lprp + *rprp) / 2.0f;
                     
@@ -787,7 +1380,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
 
                 COMMON_MIX2();
 
-                if (stream_monitor == FALSE)
+                if (k_monitor == FALSE)
                     {
                     *lap = (plr_l->ls_aud + plr_r->ls_aud) * *jh * df + *lprp + dl_auxmix + plr_i->ls_aud * idf * *jhi + dl_micmix + e_ls;
                     *rap = (plr_l->rs_aud + plr_r->rs_aud) * *jh * df + *rprp + dr_auxmix + plr_i->rs_aud * idf * *jhi + dr_micmix + e_rs;
@@ -803,14 +1396,17 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                     
                 COMMON_MIX3();
                 }
+            /* make note of the peak volume levels */
+            peakfilter_process_block(str_pf_l, ls_buffer, nframes);
+            peakfilter_process_block(str_pf_r, rs_buffer, nframes);
             str_l_meansqrd = str_l_tally/rms_tally_count;
             str_r_meansqrd = str_r_tally/rms_tally_count;
             }
         else
-            if (simple_mixer == FALSE && mixermode == PHONE_PRIVATE && mic_on == 0)
+            if (k_mode == PHONE_PRIVATE_MIC_OFF)
                 {
                 for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++,
-                    lpsp++, rpsp++, lprp++, rprp++, dilp++, dirp++, dolp++, dorp++, aap++,
+                    lpsp++, rpsp++, lprp++, rprp++, dilp++, dirp++, dolp++, dorp++,
                     plolp++, plorp++, prolp++, prorp++, piolp++, piorp++, pe1olp++, pe1orp++, pe2olp++, pe2orp++,
                     plilp++, plirp++, prilp++, prirp++, piilp++, piirp++, peilp++, peirp++)
                     {         
@@ -852,7 +1448,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                     compressor_gain = db2level(limiter(&incoming_phone_limiter, *lprp *= voip_lc_aud, *rprp *= voip_rc_aud));
                     *lprp *= compressor_gain;
                     *rprp *= compressor_gain;
-                    if (voip_pan_f)
+                    if (k_voip_pan)
                         {
                         float dnmix = (*lprp + *rprp) / 2.0f;
                         
@@ -862,7 +1458,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                     
                     COMMON_MIX2();
 
-                    if (stream_monitor == FALSE) /* the DJ can hear the VOIP phone call */
+                    if (k_monitor == FALSE) /* the DJ can hear the VOIP phone call */
                         {
                         *lap = (*lsp * mb_lc_aud) + e_ls + dl_micmix + *lprp;
                         *rap = (*rsp * mb_rc_aud) + e_rs + dr_micmix + *rprp;
@@ -878,14 +1474,17 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                         
                     COMMON_MIX3();
                     }
+                /* make note of the peak volume levels */
+                peakfilter_process_block(str_pf_l, ls_buffer, nframes);
+                peakfilter_process_block(str_pf_r, rs_buffer, nframes);
                 str_l_meansqrd = str_l_tally/rms_tally_count;
                 str_r_meansqrd = str_r_tally/rms_tally_count;
                 }
             else
-                if (simple_mixer == FALSE && mixermode == PHONE_PRIVATE) /* note: mic is on */
+                if (k_mode == PHONE_PRIVATE) /* note: mic is on */
                     {
                     for(samples_todo = nframes; samples_todo--; lap++, rap++, lsp++, rsp++, 
-                            lpsp++, rpsp++, dilp++, dirp++, dolp++, dorp++, aap++,
+                            lpsp++, rpsp++, dilp++, dirp++, dolp++, dorp++,
                             plolp++, plorp++, prolp++, prorp++, piolp++, piorp++, pe1olp++, pe1orp++, pe2olp++, pe2orp++,
                             plilp++, plirp++, prilp++, prirp++, piilp++, piirp++, peilp++, peirp++)
                         {
@@ -912,7 +1511,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                              float hr = db2level(current_headroom);
                              df = (df < hr) ? df : hr;
                         }
-                        idf = inter_force ? df : 1.0;
+                        idf = k_inter ? df : 1.0;
 
                         COMMON_MIX();
 
@@ -931,7 +1530,7 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
 
                         COMMON_MIX2();
 
-                        if (stream_monitor == FALSE)
+                        if (k_monitor == FALSE)
                             {
                             *lap = ((plr_l->ls_aud + plr_r->ls_aud) * *jh + e_ls) * df + dl_micmix + dl_auxmix + plr_i->ls_aud * idf * *jhi;
                             *rap = ((plr_l->rs_aud + plr_r->rs_aud) * *jh + e_ls) * df + dr_micmix + dr_auxmix + plr_i->rs_aud * idf * *jhi;
@@ -947,71 +1546,289 @@ int mixer_process_audio(jack_nframes_t nframes, void *arg)
                             
                         COMMON_MIX3();
                         }
+                    /* make note of the peak volume levels */
+                    peakfilter_process_block(str_pf_l, ls_buffer, nframes);
+                    peakfilter_process_block(str_pf_r, rs_buffer, nframes);
                     str_l_meansqrd = str_l_tally/rms_tally_count;
                     str_r_meansqrd = str_r_tally/rms_tally_count;
                     }
-                else
-                    if (simple_mixer == TRUE)
-                        {
-                        int la = left_audio;
-                        int ls = left_stream;
-
-                        if (dj_audio_level != current_dj_audio_level)
-                            {
-                            current_dj_audio_level = dj_audio_level;
-                            dj_audio_gain = db2level(dj_audio_level);
-                            }
-                        
-                        if (la || ls)
-                            {
-                            samples_todo = nframes;
-                            while (samples_todo--)
-                                {
-                                xlplayer_read_next(plr_l);                                    
-                                if (la)
-                                    {
-                                    *lap++ = plr_l->ls * dj_audio_gain;
-                                    *rap++ = plr_l->rs * dj_audio_gain;
-                                    }
-                                if (ls)
-                                    {
-                                    *lsp++ = plr_l->ls;
-                                    *rsp++ = plr_l->rs;
-                                    }
-                                }
-                            }
-                            
-                        memset(al_buffer, 0, nframes * sizeof (sample_t));
-                            
-                        if (!la)
-                            {
-                            memset(la_buffer, 0, nframes * sizeof (sample_t));
-                            memset(ra_buffer, 0, nframes * sizeof (sample_t));
-                            }
-                        if (!ls)
-                            {
-                            memset(ls_buffer, 0, nframes * sizeof (sample_t));
-                            memset(rs_buffer, 0, nframes * sizeof (sample_t));
-                            }
-                        }
-                    else
-                        fprintf(stderr,"Error: no mixer mode was chosen\n");
-                        
-    return 0;
-    }
- 
-static int peak_to_log(float peak)
-    {
-    if (peak <= 0.0)
-        return -127;
-    if (peak >= 1.0)
-        return 0;
-    return (int)level2db(peak);
     }
 
-int mixer_healthcheck()
-    { 
-    const int limit = 15;
+#define MIXER_SAMPLE_VARIANT(m, f) \
+    static void mixer_sample_##m##_##f(jack_nframes_t nframes, const struct mixer_buffers *b) \
+        { \
+        mixer_sample_loop(nframes, b, m, (f) & SAMPLE_DSP, (f) & SAMPLE_MONITOR, \
+                          (f) & SAMPLE_VOIP_PAN, (f) & SAMPLE_INTER); \
+        }
+
+#define MIXER_SAMPLE_VARIANTS(m) \
+    MIXER_SAMPLE_VARIANT(m, 0) MIXER_SAMPLE_VARIANT(m, 1) MIXER_SAMPLE_VARIANT(m, 2) MIXER_SAMPLE_VARIANT(m, 3) \
+    MIXER_SAMPLE_VARIANT(m, 4) MIXER_SAMPLE_VARIANT(m, 5) MIXER_SAMPLE_VARIANT(m, 6) MIXER_SAMPLE_VARIANT(m, 7) \
+    MIXER_SAMPLE_VARIANT(m, 8) MIXER_SAMPLE_VARIANT(m, 9) MIXER_SAMPLE_VARIANT(m, 10) MIXER_SAMPLE_VARIANT(m, 11) \
+    MIXER_SAMPLE_VARIANT(m, 12) MIXER_SAMPLE_VARIANT(m, 13) MIXER_SAMPLE_VARIANT(m, 14) MIXER_SAMPLE_VARIANT(m, 15)
+
+/* the mode names expand to their numbers on the way through MIXER_SAMPLE_VARIANTS so the same is done here */
+#define MIXER_SAMPLE_ROW(m) MIXER_SAMPLE_ROW_N(m)
+#define MIXER_SAMPLE_ROW_N(m) { \
+    mixer_sample_##m##_0, mixer_sample_##m##_1, mixer_sample_##m##_2, mixer_sample_##m##_3, \
+    mixer_sample_##m##_4, mixer_sample_##m##_5, mixer_sample_##m##_6, mixer_sample_##m##_7, \
+    mixer_sample_##m##_8, mixer_sample_##m##_9, mixer_sample_##m##_10, mixer_sample_##m##_11, \
+    mixer_sample_##m##_12, mixer_sample_##m##_13, mixer_sample_##m##_14, mixer_sample_##m##_15 }
+
+MIXER_SAMPLE_VARIANTS(NO_PHONE)
+MIXER_SAMPLE_VARIANTS(PHONE_PUBLIC)
+MIXER_SAMPLE_VARIANTS(PHONE_PRIVATE)
+MIXER_SAMPLE_VARIANTS(PHONE_PRIVATE_MIC_OFF)
+
+/* indexed by mode then by the flag bits */
+static void (* const mixer_sample_variants[4][16])(jack_nframes_t, const struct mixer_buffers *) = {
+    MIXER_SAMPLE_ROW(NO_PHONE),
+    MIXER_SAMPLE_ROW(PHONE_PUBLIC),
+    MIXER_SAMPLE_ROW(PHONE_PRIVATE),
+    MIXER_SAMPLE_ROW(PHONE_PRIVATE_MIC_OFF) };
+
+/* mixer_sample_engine: pick the loop variant for this period */
+static void mixer_sample_engine(jack_nframes_t nframes, const struct mixer_buffers *b)
+    {
+    int mode, flags;
+
+    switch (mixermode)
+        {
+        case NO_PHONE:
+        case PHONE_PUBLIC:
+            mode = mixermode;
+            break;
+        case PHONE_PRIVATE:
+            mode = mic_on ? PHONE_PRIVATE : PHONE_PRIVATE_MIC_OFF;
+            break;
+        default:
+            fprintf(stderr,"Error: no mixer mode was chosen\n");
+            return;
+        }
+
+    flags = (using_dsp ? SAMPLE_DSP : 0) | (stream_monitor ? SAMPLE_MONITOR : 0) |
+            (voip_pan_f ? SAMPLE_VOIP_PAN : 0) | (inter_force ? SAMPLE_INTER : 0);
+    mixer_sample_variants[mode][flags](nframes, b);
+    }
+
+/* process_audio: the JACK callback routine */
+static void mixer_publish_levels();
+
+int mixer_process_audio(jack_nframes_t nframes, void *arg)
+    {
+    int samples_todo;   /* The samples remaining counter in the simple mixer loop */
+    /* pointers to buffers provided by JACK */
+    sample_t *lap, *rap, *lsp, *rsp, *lpsp, *rpsp, *lprp, *rprp;
+    sample_t *al_buffer, *la_buffer, *ra_buffer, *ls_buffer, *rs_buffer, *lps_buffer, *rps_buffer;
+    sample_t *dolp, *dorp, *dilp, *dirp;
+    sample_t *plolp, *plorp, *prolp, *prorp, *piolp, *piorp, *pe1olp, *pe1orp, *pe2olp, *pe2orp;
+    sample_t *plilp, *plirp, *prilp, *prirp, *piilp, *piirp, *peilp, *peirp;
+    /* midi_control */
+    void *midi_buffer;
+    jack_midi_event_t midi_event;
+    jack_nframes_t midi_nevents, midi_eventi;
+
+    /* midi_control. queue incoming events raw for the gui thread to format */
+    midi_buffer = jack_port_get_buffer(g.port.midi_port, nframes);
+    midi_nevents = jack_midi_get_event_count(midi_buffer);
+    for (midi_eventi = 0; midi_eventi < midi_nevents; midi_eventi++)
+        {
+        struct midi_raw_event raw = { { 0, 0, 0 } };
+
+        if (jack_midi_event_get(&midi_event, midi_buffer, midi_eventi) != 0 || midi_event.size == 0)
+            {
+            midi_read_errors++;
+            continue;
+            }
+        if (jack_ringbuffer_write_space(midi_rb) < sizeof raw)
+            {
+            midi_events_lost++;
+            continue;
+            }
+        memcpy(raw.data, midi_event.buffer, (midi_event.size < sizeof raw.data) ? midi_event.size : sizeof raw.data);
+        jack_ringbuffer_write(midi_rb, (char *)&raw, sizeof raw);
+        }
+    rttime_mark(RTTIME_MIDI);
+
+    /* get the data pointers for the jack ports */
+    {
+        struct jack_ports *p = &g.port;
+        
+        al_buffer = (sample_t *) jack_port_get_buffer(p->alarm_out, nframes);
+        la_buffer = lap = (sample_t *) jack_port_get_buffer(p->dj_out_l, nframes);
+        ra_buffer = rap = (sample_t *) jack_port_get_buffer(p->dj_out_r, nframes);
+        ls_buffer = lsp = (sample_t *) jack_port_get_buffer(p->str_out_l, nframes);
+        rs_buffer = rsp = (sample_t *) jack_port_get_buffer(p->str_out_r, nframes);
+        lps_buffer = lpsp = (sample_t *) jack_port_get_buffer(p->voip_out_l, nframes);
+        rps_buffer = rpsp = (sample_t *) jack_port_get_buffer(p->voip_out_r, nframes);
+        lprp = (sample_t *) jack_port_get_buffer(p->voip_in_l, nframes);
+        rprp = (sample_t *) jack_port_get_buffer(p->voip_in_r, nframes);
+        dolp = (sample_t *) jack_port_get_buffer(p->dsp_out_l, nframes);
+        dorp = (sample_t *) jack_port_get_buffer(p->dsp_out_r, nframes);
+        dilp = (sample_t *) jack_port_get_buffer(p->dsp_in_l, nframes);
+        dirp = (sample_t *) jack_port_get_buffer(p->dsp_in_r, nframes);
+        plolp = (sample_t *) jack_port_get_buffer(p->pl_out_l, nframes);
+        plorp = (sample_t *) jack_port_get_buffer(p->pl_out_r, nframes);
+        prolp = (sample_t *) jack_port_get_buffer(p->pr_out_l, nframes);
+        prorp = (sample_t *) jack_port_get_buffer(p->pr_out_r, nframes);
+        piolp = (sample_t *) jack_port_get_buffer(p->pi_out_l, nframes);
+        piorp = (sample_t *) jack_port_get_buffer(p->pi_out_r, nframes);
+        pe1olp = (sample_t *) jack_port_get_buffer(p->pe1_out_l, nframes);
+        pe1orp = (sample_t *) jack_port_get_buffer(p->pe1_out_r, nframes);
+        pe2olp = (sample_t *) jack_port_get_buffer(p->pe2_out_l, nframes);
+        pe2orp = (sample_t *) jack_port_get_buffer(p->pe2_out_r, nframes);
+        plilp = (sample_t *) jack_port_get_buffer(p->pl_in_l, nframes);
+        plirp = (sample_t *) jack_port_get_buffer(p->pl_in_r, nframes);
+        prilp = (sample_t *) jack_port_get_buffer(p->pr_in_l, nframes);
+        prirp = (sample_t *) jack_port_get_buffer(p->pr_in_r, nframes);
+        piilp = (sample_t *) jack_port_get_buffer(p->pi_in_l, nframes);
+        piirp = (sample_t *) jack_port_get_buffer(p->pi_in_r, nframes);
+        peilp = (sample_t *) jack_port_get_buffer(p->pe_in_l, nframes);
+        peirp = (sample_t *) jack_port_get_buffer(p->pe_in_r, nframes);
+    }
+
+    /* resets the running totals for the vu meter stats */      
+    if (reset_vu_stats_f)
+        {
+        str_l_tally = str_r_tally = 0.0;
+        rms_tally_count = 0;
+        reset_vu_stats_f = FALSE;
+        }
+
+    /* in private phone mode the voip callers hear the closed mics */
+    mic_process_start_all(mics, nframes, mixermode == PHONE_PRIVATE);
+    rttime_mark(RTTIME_MICS);
+    xlplayer_read_start_all(players, nframes, players_roster);
+    mixer_effects_list_update();
+    xlplayer_read_start_all(plr_j_active, nframes, plr_j_roster);
+    mixer_effects_list_prune();
+    rttime_mark(RTTIME_PLAYERS);
+
+    if (simple_mixer == FALSE)
+        {
+        struct mixer_buffers b = {
+            al_buffer, la_buffer, ra_buffer, ls_buffer, rs_buffer, lps_buffer, rps_buffer, lprp, rprp,
+            dolp, dorp, dilp, dirp,
+            plolp, plorp, prolp, prorp, piolp, piorp, pe1olp, pe1orp, pe2olp, pe2orp,
+            plilp, plirp, prilp, prirp, piilp, piirp, peilp, peirp };
+
+        if (use_block_engine)
+            {
+            mixer_process_block_engine(nframes, &b);
+            rttime_mark(RTTIME_MIX);
+            truepeak_limiter_process(str_limiter, ls_buffer, rs_buffer, nframes);
+            mixer_publish_levels();
+            rttime_mark(RTTIME_OUTPUT);
+            return 0;
+            }
+        mixer_sample_engine(nframes, &b);
+        }
+    else
+        {
+        int la = left_audio;
+        int ls = left_stream;
+
+        if (dj_audio_level != current_dj_audio_level)
+            {
+            current_dj_audio_level = dj_audio_level;
+            dj_audio_gain = db2level(dj_audio_level);
+            }
+        
+        if (la || ls)
+            {
+            samples_todo = nframes;
+            while (samples_todo--)
+                {
+                xlplayer_read_next(plr_l);                                    
+                if (la)
+                    {
+                    *lap++ = plr_l->ls * dj_audio_gain;
+                    *rap++ = plr_l->rs * dj_audio_gain;
+                    }
+                if (ls)
+                    {
+                    *lsp++ = plr_l->ls;
+                    *rsp++ = plr_l->rs;
+                    }
+                }
+            }
+            
+        memset(al_buffer, 0, nframes * sizeof (sample_t));
+            
+        if (!la)
+            {
+            memset(la_buffer, 0, nframes * sizeof (sample_t));
+            memset(ra_buffer, 0, nframes * sizeof (sample_t));
+            }
+        if (!ls)
+            {
+            memset(ls_buffer, 0, nframes * sizeof (sample_t));
+            memset(rs_buffer, 0, nframes * sizeof (sample_t));
+            }
+        }
+
+    rttime_mark(RTTIME_MIX);
+
+    /* end-of-track alarm tone */
+    if (simple_mixer == FALSE)
+        mixer_alarm_block(al_buffer, nframes);
+    truepeak_limiter_process(str_limiter, ls_buffer, rs_buffer, nframes);
+    mixer_publish_levels();
+    rttime_mark(RTTIME_OUTPUT);
+    return 0;
+    }
+ 
+static int peak_to_log(float peak)
+    {
+    if (peak <= 0.0)
+        return -127;
+    if (peak >= 1.0)
+        return 0;
+    return (int)level2db(peak);
+    }
+
+/* mixer_publish_levels: refresh the shared memory meter report at the end of every period
+ * while the UI has yet to read the last report its peaks are carried into this one
+ * so they are held for however long the UI takes to look
+ */
+static void mixer_publish_levels()
+    {
+    struct levels_header *hdr;
+    struct levels_player *lp;
+    int hold, peak;
+
+    if (!__atomic_load_n(&levels_shm_active, __ATOMIC_ACQUIRE))
+        return;
+
+    hold = !metershm_consumed(levels_shm);
+    hdr = metershm_begin(levels_shm);
+    hdr->magic = LEVELS_MAGIC;
+    hdr->version = LEVELS_VERSION;
+    hdr->reserved = 0;
+    peak = peak_to_log(peakfilter_read(str_pf_l));
+    hdr->str_l_peak = (hold && hdr->str_l_peak > peak) ? hdr->str_l_peak : peak;
+    peak = peak_to_log(peakfilter_read(str_pf_r));
+    hdr->str_r_peak = (hold && hdr->str_r_peak > peak) ? hdr->str_r_peak : peak;
+    hdr->str_l_rms = str_l_meansqrd ? (int) level2db(sqrtf(str_l_meansqrd)) : -120;
+    hdr->str_r_rms = str_r_meansqrd ? (int) level2db(sqrtf(str_r_meansqrd)) : -120;
+    /* these remain in the text reply since they need acknowledging */
+    hdr->ports_connections_changed = 0;
+    hdr->effects_playing = -1;
+    hdr->freewheel_mode = g.freewheel;
+    lp = (struct levels_player *)(hdr + 1);
+    hdr->n_players = xlplayer_stats_binary_all(players, lp, hold);
+    hdr->n_players += xlplayer_stats_binary_all(plr_j, lp + hdr->n_players, hold);
+    hdr->n_mics = mic_stats_binary_all(mics, (struct levels_mic *)(lp + hdr->n_players), hold);
+    metershm_end(levels_shm);
+
+    /* the rms is averaged over what the UI gets to see */
+    if (!hold)
+        reset_vu_stats_f = TRUE;
+    }
+
+int mixer_healthcheck()
+    { 
+    const int limit = 15;
 
     for (struct xlplayer **p = plr_j_roster; *p; ++p)
         {
@@ -1118,432 +1935,525 @@ static struct mixer {
     char *sc_client_name;
     } s;
 
-static void mixer_cleanup()
-    {
-    free(eot_alarm_table);
-    free_signallookup_table();
-    free_dblookup_table();
-    if (s.outport)
-        jack_free(s.outport);
-    free(s.our_sc_str_in_l);
-    free(s.our_sc_str_in_r);
-    mic_free_all(mics);
-    peakfilter_destroy(str_pf_l);
-    peakfilter_destroy(str_pf_r);
-    xlplayer_destroy(plr_l);
-    xlplayer_destroy(plr_r);
-    xlplayer_destroy(plr_i);
-    for (struct xlplayer **p = plr_j; *p; ++p)
-        xlplayer_destroy(*p);
-    free(plr_j);
-    free(plr_j_roster);
-    }
-
-int mixer_new_buffer_size(jack_nframes_t n_frames)
-    {
-    fprintf(stderr, "player read buffer allocated for %ld frames\n", (long)n_frames);
-    xlplayer_buffer_alloc_all(players, n_frames);
-    xlplayer_buffer_alloc_all(plr_j, n_frames);
-    return 0;
-    }
-
-void mixer_init(void)
+/* mixer_dis_connect: connect or disconnect the named ports, a disconnect with no second port
+ * takes the first as a regular expression and disconnects everything that matches
+ */
+static void mixer_dis_connect(int (*fn)(jack_client_t *, const char *, const char *), int disconnect)
     {
-    sr = jack_get_sample_rate(g.client);
-    jingles_samples_cutoff = sr / 12;            /* A twelfth of a second early */
-    player_samples_cutoff = sr * 0.25;           /* for gapless playback */
-    int n = 0;
-    int ne = atoi(getenv("num_effects"));
+    const char **jackports, **jp;
+    jack_port_t *port;
 
-    if(! ((players[n++] = plr_l = xlplayer_create(sr, MAIN_RB_SIZE, "left", &g.app_shutdown, &volume, 0, &left_stream, &left_audio, 0.3f)) &&
-            (players[n++] = plr_r = xlplayer_create(sr, MAIN_RB_SIZE, "right", &g.app_shutdown, &volume2, 0, &right_stream, &right_audio, 0.3f))))
-        {
-        fprintf(stderr, "failed to create main player modules\n");
-        exit(5);
-        }
-    
-    if (!(plr_j = (struct xlplayer **)calloc(ne + 1, sizeof (struct xlplayer *))))
-        {
-        fprintf(stderr, "malloc failure\n");
-        exit(5);
-        }
-    
-    if (!(plr_j_roster = (struct xlplayer **)calloc(ne + 1, sizeof (struct xlplayer *))))
-        {
-        fprintf(stderr, "malloc failure\n");
-        exit(5);
-        }
-    
-    for (int i = 0; i < ne; ++i)
+    if (strlen(jackport2))
         {
-        int *volct = (i < 12) ? &jinglesvolume1 : &jinglesvolume2;
-
-        if (!(plr_j[i] = xlplayer_create(sr, 0.15f, "jingles", &g.app_shutdown, volct, 0, NULL, NULL, 0.0f)))
+        if ((port = jack_port_by_name(g.client, jackport)))
             {
-            fprintf(stderr, "failed to create jingles player module\n");
-            exit(5);
+            if (jack_port_flags(port) & JackPortIsOutput)
+                fn(g.client, jackport, jackport2);
+            else
+                fn(g.client, jackport2, jackport);
             }
-        plr_j[i]->fade_mode = 3;
-        }
-    
-    if (!(players[n++] = plr_i = xlplayer_create(sr, MAIN_RB_SIZE, "interlude", &g.app_shutdown, &interludevol, 0, &inter_stream, &inter_audio, 0.3f)))
-        {
-        fprintf(stderr, "failed to create interlude player module\n");
-        exit(5);
-        }
-    plr_i->cf_aud = 1;  /* crossfader values to apply in dj audio -- the crossfader interface is used to implement the soft fade in/out */
-
-    players[n++] = NULL;
-    if (n != sizeof players / sizeof players[0])
-        {
-        fprintf(stderr, "players array is the wrong size\n");
-        exit(5);
-        }
-
-    smoothing_volume_init(&jingles_headroom_smoothing, &jingles_headroom_control, 0.0f);
-
-    if (!init_dblookup_table())
-        {
-        fprintf(stderr, "failed to allocate space for signal to db lookup table\n");
-        exit(5);
-        }
-
-    if (!init_signallookup_table())
-        {
-        fprintf(stderr, "failed to allocate space for db to signal lookup table\n");
-        exit(5);
-        } 
-
-    /* generate the wave table for the DJ alarm */
-    if (!(eot_alarm_table = calloc(sizeof (sample_t), sr)))
-        {
-        fprintf(stderr, "failed to allocate space for end of track alarm wave table\n");
-        exit(5);
+        else
+            fprintf(stderr, "port %s does not exist\n", jackport);
         }
     else
         {
-        alarm_size = (sr / 900) * 900;    /* builds the alarm tone wave table */
-        for (unsigned i = 0; i < alarm_size ; i++)
+        /* do regular expression lookup of ports then disconnect them */
+        if (disconnect)
             {
-            eot_alarm_table[i] = 0.83F * sinf((i % (sr/900)) * 6.283185307F / (sr/900));
-            eot_alarm_table[i] += 0.024F * sinf((i % (sr/900)) * 12.56637061F / (sr/900) + 3.141592654F / 4.0F);
+            if ((jackports = jack_get_ports(g.client, jackport, NULL, 0L)))
+                {
+                for (jp = jackports; *jp; ++jp)
+                    {
+                    if ((port = jack_port_by_name(g.client, *jp)))
+                        jack_port_disconnect(g.client, port);
+                    else
+                        fprintf(stderr, "port %s does not exist\n", jackport);
+                    }
+
+                jack_free(jackports);
+                }
             }
         }
-            
-    str_pf_l = peakfilter_create(115e-6f, sr);
-    str_pf_r = peakfilter_create(115e-6f, sr);
+    }
 
-    /* allocate microphone resources */
-    mics = mic_init_all(atoi(getenv("mic_qty")), g.client);
-        
-    jack_set_port_connect_callback(g.client, custom_jack_port_connect_callback, NULL);
-                
-    atexit(mixer_cleanup);
-    g.mixer_up = TRUE;
+static void mixer_action_ping()
+    {
+    fprintf(g.out, "pong\n");
+    fflush(g.out);
     }
-        
-int mixer_main()
+
+static void mixer_action_mp3_getstatus()
     {
-    unsigned int lead, ports_diff;
-    jack_session_event_t *session_event;
-    
-    if (!(kvp_parse(kvpdict, g.in)))
-        {
-        fprintf(stderr, "kvp_parse returned false\n");
-        return FALSE;
-        }
+    xlplayer_mpg123_status();
+    }
 
-    if (!strcmp(action, "ping"))
-        {
-        fprintf(g.out, "pong\n");
-        fflush(g.out);
-        }
+static void mixer_action_jackportread()
+    {
+    jackportread(jackport, jackfilter);
+    }
 
-    if (!strcmp(action, "mp3_getstatus"))
-        xlplayer_mpg123_status();
+static void mixer_action_freewheel_toggle()
+    {
+    jack_set_freewheel(g.client, !g.freewheel);
+    }
 
-    if (!strcmp(action, "jackportread"))
-        jackportread(jackport, jackfilter);
-        
-    if (!strcmp(action, "freewheel_toggle"))
-        jack_set_freewheel(g.client, !g.freewheel);
+static void mixer_action_freewheel_on()
+    {
+    jack_set_freewheel(g.client, 1);
+    }
 
-    if (!strcmp(action, "freewheel_on"))
-        jack_set_freewheel(g.client, 1);
+static void mixer_action_freewheel_off()
+    {
+    jack_set_freewheel(g.client, 0);
+    }
 
-    if (!strcmp(action, "freewheel_off"))
-        jack_set_freewheel(g.client, 0);
+static void mixer_action_jackconnect()
+    {
+    mixer_dis_connect(jack_connect, FALSE);
+    }
 
-    void dis_connect(char *str, int (*fn)(jack_client_t *, const char *, const char *))
-        {
-        const char **jackports, **jp;
-        jack_port_t *port;
-        
-        if (!strcmp(action, str))
-            {
-            if (strlen(jackport2))
-                {
-                if ((port = jack_port_by_name(g.client, jackport)))
-                    {
-                    if (jack_port_flags(port) & JackPortIsOutput)
-                        fn(g.client, jackport, jackport2);
-	            else
-	                fn(g.client, jackport2, jackport);
-                    }
-                else
-                    fprintf(stderr, "port %s does not exist\n", jackport);
-                }
-            else
-                {
-                /* do regular expression lookup of ports then disconnect them */
-                if (!strcmp(str, "jackdisconnect"))
-                    {
-                    if ((jackports = jack_get_ports(g.client, jackport, NULL, 0L)))
-                        {
-                        for (jp = jackports; *jp; ++jp)
-                            {
-                            if ((port = jack_port_by_name(g.client, *jp)))
-                                jack_port_disconnect(g.client, port);
-                            else
-                                fprintf(stderr, "port %s does not exist\n", jackport);
-                            }
+static void mixer_action_jackdisconnect()
+    {
+    mixer_dis_connect(jack_disconnect, TRUE);
+    }
 
-                        jack_free(jackports);
-                        }
-                    }
-                }
-            }
-        }
-    dis_connect("jackconnect", jack_connect);
-    dis_connect("jackdisconnect", jack_disconnect);
+static void mixer_action_session_reply()
+    {
+    jack_session_event_t *session_event;
 
-    if (!strcmp(action, "session_reply"))
-        {
-        sscanf(session_event_string, "%p", &session_event);
-        session_event->command_line = session_commandline;
-        /* Transfer of ownership of heap allocated string. */
-        session_commandline = NULL;
-        jack_session_reply(g.client, session_event);
-        jack_session_event_free(session_event);
-        /* Unblock the user interface which is waiting on a reply. */
-        fprintf(g.out, "session event handled\n");
-        fflush(g.out);
-        }
+    sscanf(session_event_string, "%p", &session_event);
+    session_event->command_line = session_commandline;
+    /* Transfer of ownership of heap allocated string. */
+    session_commandline = NULL;
+    jack_session_reply(g.client, session_event);
+    jack_session_event_free(session_event);
+    /* Unblock the user interface which is waiting on a reply. */
+    fprintf(g.out, "session event handled\n");
+    fflush(g.out);
+    }
 
-    if (!strcmp(action, "playeffect"))
-        {
-        int i = atoi(effect_ix);
+static void mixer_action_playeffect()
+    {
+    int i = atoi(effect_ix);
 
-        xlplayer_play(plr_j[i], playerpathname, 0, 0, atoi(rg_db), i);
-        }
+    xlplayer_play_async(plr_j[i], playerpathname, 0, 0, atoi(rg_db), i);
+    mixer_effects_command();
+    }
 
-    if (!strcmp(action, "stopeffect"))
-        {
-        int i = atoi(effect_ix);
-        
-        if (1 << i == plr_j[i]->id)
-            xlplayer_eject(plr_j[i]);
-        }
+static void mixer_action_stopeffect()
+    {
+    int i = atoi(effect_ix);
 
-    if (!strcmp(action, "mic_control"))
+    if (1ULL << i == plr_j[i]->id)
         {
-        mic_valueparse(mics[atoi(item_index)], mic_param);
+        mixer_effects_command();
+        xlplayer_eject(plr_j[i]);
         }
+    }
 
-    if (!strcmp(action, "new_channel_mode_string"))
-        {
-        mic_set_role_all(mics, channel_mode_string);
-        }
+static void mixer_action_mic_control()
+    {
+    mic_valueparse(mics[atoi(item_index)], mic_param);
+    }
 
-    if (!strcmp(action, "headroom"))
-        {
-        headroom_db = strtof(headroom, NULL);
-        }
+static void mixer_action_new_channel_mode_string()
+    {
+    mic_set_role_all(mics, channel_mode_string);
+    }
 
-    if (!strcmp(action, "anymic"))
-        {
-        mic_on = (flag[0] == '1') ? 1 : 0;
-        }
+static void mixer_action_headroom()
+    {
+    headroom_db = strtof(headroom, NULL);
+    }
 
-    if (!strcmp(action, "fademode_left"))
-        plr_l->fade_mode = atoi(fade_mode);
-        
-    if (!strcmp(action, "fademode_right"))
-        plr_r->fade_mode = atoi(fade_mode);
+static void mixer_action_truepeaklimiter()
+    {
+    truepeak_limiter_configure(str_limiter, strtof(tp_lookahead, NULL), tp_ceiling ? strtof(tp_ceiling, NULL) : -1.0f);
+    }
 
-    if (!strcmp(action, "fademode_interlude"))
-        plr_i->fade_mode = atoi(fade_mode);
+static void mixer_action_anymic()
+    {
+    mic_on = (flag[0] == '1') ? 1 : 0;
+    }
 
-    if (!strcmp(action, "playleft"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playright"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playinterlude"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playnoflushleft"))
-        {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
-        fflush(g.out);
-        }
-    if (!strcmp(action, "playnoflushright"))
+static void mixer_action_fademode_left()
+    {
+    plr_l->fade_mode = atoi(fade_mode);
+    }
+
+static void mixer_action_fademode_right()
+    {
+    plr_r->fade_mode = atoi(fade_mode);
+    }
+
+static void mixer_action_fademode_interlude()
+    {
+    plr_i->fade_mode = atoi(fade_mode);
+    }
+
+/* mixer_silence_threshold: the threshold that was sent, 0 for the default if none was */
+static float mixer_silence_threshold()
+    {
+    return silence_db ? strtof(silence_db, NULL) : 0.0f;
+    }
+
+static void mixer_action_silencethreshold_left()
+    {
+    xlplayer_set_silence_threshold(plr_l, mixer_silence_threshold());
+    }
+
+static void mixer_action_silencethreshold_right()
+    {
+    xlplayer_set_silence_threshold(plr_r, mixer_silence_threshold());
+    }
+
+static void mixer_action_silencethreshold_interlude()
+    {
+    xlplayer_set_silence_threshold(plr_i, mixer_silence_threshold());
+    }
+
+static void mixer_action_playleft()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_playright()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_playinterlude()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_playnoflushleft()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_playnoflushright()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_playnoflushinterlude()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+    fflush(g.out);
+    }
+
+static void mixer_action_preloadleft()
+    {
+    xlplayer_preload(plr_l, playerpathname, atoi(seek_s), atoi(size), atof(rg_db));
+    }
+
+static void mixer_action_preloadright()
+    {
+    xlplayer_preload(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db));
+    }
+
+static void mixer_action_preloadinterlude()
+    {
+    xlplayer_preload(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db));
+    }
+
+#if 0
+static void mixer_action_playmanyjingles()
+    {
+    fprintf(g.out, "context_id=%d\n", xlplayer_playmany(plr_j, playerplaylist, loop[0]=='1'));
+    fflush(g.out);
+    }
+#endif
+
+static void mixer_action_stopleft()
+    {
+    xlplayer_eject(plr_l);
+    }
+
+static void mixer_action_stopright()
+    {
+    xlplayer_eject(plr_r);
+    }
+
+static void mixer_action_stopjingles()
+    {
+    mixer_effects_command();
+    xlplayer_eject(plr_j[atoi(effect_ix)]);
+    }
+
+static void mixer_action_stopinterlude()
+    {
+    xlplayer_eject(plr_i);
+    }
+
+static void mixer_action_dither()
+    {
+    xlplayer_dither(plr_l, TRUE);
+    xlplayer_dither(plr_r, TRUE);
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        xlplayer_dither(*p, TRUE);
+    xlplayer_dither(plr_i, TRUE);
+    }
+
+static void mixer_action_dontdither()
+    {
+    xlplayer_dither(plr_l, FALSE);
+    xlplayer_dither(plr_r, FALSE);
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        xlplayer_dither(*p, FALSE);
+    xlplayer_dither(plr_i, FALSE);
+    }
+
+static void mixer_action_resamplequality()
+    {
+    for (struct xlplayer **p = players; *p; ++p)
+        (*p)->rsqual = resamplequality[0] - '0';
+
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        (*p)->rsqual = resamplequality[0] - '0';
+    }
+
+static void mixer_action_ogginforequest()
+    {
+    if (oggdecode_get_metainfo(oggpathname, &s.artist, &s.title, &s.album, &s.length, &s.replaygain, &s.rgloudness))
         {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_r, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+        fprintf(g.out, "OIR:ARTIST=%s\nOIR:TITLE=%s\nOIR:ALBUM=%s\nOIR:LENGTH=%f\nOIR:REPLAYGAIN_TRACK_GAIN=%s\nOIR:REPLAYGAIN_REFERENCE_LOUDNESS=%s\nOIR:end\n", s.artist, s.title, s.album, s.length, s.replaygain, s.rgloudness);
         fflush(g.out);
         }
-    if (!strcmp(action, "playnoflushinterlude"))
+    else
         {
-        fprintf(g.out, "context_id=%d\n", xlplayer_play_noflush(plr_i, playerpathname, atoi(seek_s), atoi(size), atof(rg_db), 0));
+        fprintf(g.out, "OIR:NOT VALID\n");
         fflush(g.out);
         }
+    }
+
+static void mixer_action_sndfileinforequest()
+    {
+    sndfileinfo(sndfilepathname);
+    }
+
+/* mixer_probe_pathnames: split the +PRBL lines into an array that must be freed */
+static char **mixer_probe_pathnames(int *n)
+    {
+    char **pathnames = NULL, *p, *nl;
+    int size = 0;
 
-#if 0 
-    if (!strcmp(action, "playmanyjingles"))
+    *n = 0;
+    for (p = probe_list; p && *p; p = nl + 1)
         {
-        fprintf(g.out, "context_id=%d\n", xlplayer_playmany(plr_j, playerplaylist, loop[0]=='1'));
-        fflush(g.out);
+        if (!(nl = strchr(p, '\n')))
+            break;
+        *nl = '\0';
+        if (*n == size && !(pathnames = realloc(pathnames, (size = size ? size * 2 : 64) * sizeof (char *))))
+            {
+            fprintf(stderr, "mixer_probe_pathnames: malloc failure\n");
+            exit(5);
+            }
+        pathnames[(*n)++] = p;
         }
+    return pathnames;
+    }
+
+static void mixer_action_probemany()
+    {
+    int n;
+    char **pathnames = mixer_probe_pathnames(&n);
+
+    probe_many(pathnames, n, probe_mode && !strcmp(probe_mode, "exact"), g.out);
+    free(pathnames);
+    }
+
+static void mixer_action_loudnessscan()
+    {
+    int n;
+    char **pathnames = mixer_probe_pathnames(&n);
+
+    fprintf(g.out, "loudness_pending=%d\n", loudness_scan(pathnames, n, sr, &g.app_shutdown));
+    fflush(g.out);
+    free(pathnames);
+    }
+
+#ifdef HAVE_SPEEX
+static void mixer_action_speexreadtagrequest()
+    {
+    speex_tag_read(speexpathname);
+    }
 #endif
 
-    if (!strcmp(action, "stopleft"))
-        xlplayer_eject(plr_l);
-    if (!strcmp(action, "stopright"))
-        xlplayer_eject(plr_r);
-    if (!strcmp(action, "stopjingles"))
-        xlplayer_eject(plr_j[atoi(effect_ix)]);
-    if (!strcmp(action, "stopinterlude"))
-        xlplayer_eject(plr_i);
+#ifdef HAVE_SPEEX
+static void mixer_action_speexwritetagrequest()
+    {
+    speex_tag_write(speexpathname, speexcreatedby, speextaglist);
+    }
+#endif
 
-    if (!strcmp(action, "dither"))
+static void mixer_action_voippan()
+    {
+    int voippanval = atoi(voip_pan);
+
+    if (voippanval == -1)
+        voip_pan_f = 0;
+    else
         {
-        xlplayer_dither(plr_l, TRUE);
-        xlplayer_dither(plr_r, TRUE);
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            xlplayer_dither(*p, TRUE);
-        xlplayer_dither(plr_i, TRUE);
+        double x = voippanval * M_PI_2 / 100.0;
+
+        voip_pan_l = (float)cos(x);
+        voip_pan_r = (float)sin(x);
+
+        voip_pan_f = 1;
         }
+    }
 
-    if (!strcmp(action, "dontdither"))
+static void mixer_action_mixstats()
+    {
+    if(sscanf(mixer_string,
+             ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%d:%1d%1d%1d"
+             "%1d%1d:%1d%1d:%1d%1d%1d%1d:%1d:%1d:%1d:%1d:%1d:%f:%f:%1d:%f"
+             ":%d:%d:%d:%1d:%1d:%1d:%f:%03d:%f:",
+             &volume, &volume2, &crossfade, &jinglesvolume1, &jinglesheadroom1,
+             &jinglesvolume2, &jinglesheadroom2 ,&interludevol, &mixbackvol, &jingles_playing,
+             &left_stream, &left_audio, &right_stream, &right_audio, &stream_monitor,
+             &s.new_left_pause, &s.new_right_pause, &s.flush_left, &s.flush_right, &s.flush_jingles, &s.flush_interlude,
+             &simple_mixer, &eot_alarm_set, &mixermode, &s.fadeout_f, &main_play, &(plr_l->newpbspeed), &(plr_r->newpbspeed),
+             &speed_variance, &dj_audio_level, &crosspattern, &s.use_dsp, &s.new_inter_pause,
+             &inter_stream, &inter_audio, &inter_force, &alarm_audio_level, &voipvol, &(plr_i->newpbspeed)) !=39)
         {
-        xlplayer_dither(plr_l, FALSE);
-        xlplayer_dither(plr_r, FALSE);
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            xlplayer_dither(*p, FALSE);
-        xlplayer_dither(plr_i, FALSE);
+        fprintf(stderr, "mixer got bad mixer string\n");
+        return;
         }
-    
-    if (!strcmp(action, "resamplequality"))
+    eot_alarm_f |= eot_alarm_set;
+
+    plr_l->fadeout_f = plr_r->fadeout_f = plr_i->fadeout_f = s.fadeout_f;
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        (*p)->fadeout_f = s.fadeout_f;
+
+    plr_l->use_sv = plr_r->use_sv = plr_i->use_sv = speed_variance;
+
+    if (s.use_dsp != using_dsp)
+        using_dsp = s.use_dsp;
+
+    if (s.new_left_pause != plr_l->pause)
         {
-        for (struct xlplayer **p = players; *p; ++p)
-            (*p)->rsqual = resamplequality[0] - '0';
-            
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            (*p)->rsqual = resamplequality[0] - '0';
+        if (s.new_left_pause)
+            xlplayer_pause(plr_l);
+        else
+            xlplayer_unpause(plr_l);
         }
-    
-    if (!strcmp(action, "ogginforequest"))
+
+    if (s.new_right_pause != plr_r->pause)
         {
-        if (oggdecode_get_metainfo(oggpathname, &s.artist, &s.title, &s.album, &s.length, &s.replaygain, &s.rgloudness))
-            {
-            fprintf(g.out, "OIR:ARTIST=%s\nOIR:TITLE=%s\nOIR:ALBUM=%s\nOIR:LENGTH=%f\nOIR:REPLAYGAIN_TRACK_GAIN=%s\nOIR:REPLAYGAIN_REFERENCE_LOUDNESS=%s\nOIR:end\n", s.artist, s.title, s.album, s.length, s.replaygain, s.rgloudness);
-            fflush(g.out);
-            }
+        if (s.new_right_pause)
+            xlplayer_pause(plr_r);
         else
-            {
-            fprintf(g.out, "OIR:NOT VALID\n");
-            fflush(g.out);
-            }
+            xlplayer_unpause(plr_r);
         }
-    
-    if (!strcmp(action, "sndfileinforequest"))
-        sndfileinfo(sndfilepathname);
-
-#ifdef HAVE_SPEEX
-    if (!(strcmp(action, "speexreadtagrequest")))
-        speex_tag_read(speexpathname);
-    if (!(strcmp(action, "speexwritetagrequest")))
-        speex_tag_write(speexpathname, speexcreatedby, speextaglist);
-#endif
 
-    if (!strcmp(action, "voippan"))
+    if (s.new_inter_pause != plr_i->pause)
         {
-        int voippanval = atoi(voip_pan);
-        
-        if (voippanval == -1)
-            voip_pan_f = 0;
+        if (s.new_inter_pause)
+            xlplayer_pause(plr_i);
         else
-            {
-            double x = voippanval * M_PI_2 / 100.0;
-            
-            voip_pan_l = (float)cos(x);
-            voip_pan_r = (float)sin(x);
-            
-            voip_pan_f = 1;
-            }
+            xlplayer_unpause(plr_i);
         }
+    }
 
-    if (!strcmp(action, "mixstats"))
+/* mixer_write_levels: the meter report as a single binary frame announced by a text line */
+static void mixer_write_levels(unsigned int ports_diff, long long effects)
+    {
+    static char *frame;
+    static size_t frame_size;
+    struct levels_header *hdr;
+    struct levels_player *lp;
+    struct levels_mic *lm;
+    size_t n_players = 0, n_mics = 0, size;
+    char *newframe;
+
+    for (struct xlplayer **p = players; *p; ++p)
+        n_players++;
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        n_players++;
+    for (struct mic **m = mics; *m; ++m)
+        n_mics++;
+    size = sizeof (struct levels_header) + n_players * sizeof (struct levels_player) + n_mics * sizeof (struct levels_mic);
+    if (size > frame_size)
         {
-        if(sscanf(mixer_string,
-                 ":%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%03d:%d:%1d%1d%1d"
-                 "%1d%1d:%1d%1d:%1d%1d%1d%1d:%1d:%1d:%1d:%1d:%1d:%f:%f:%1d:%f"
-                 ":%d:%d:%d:%1d:%1d:%1d:%f:%03d:%f:",
-                 &volume, &volume2, &crossfade, &jinglesvolume1, &jinglesheadroom1,
-                 &jinglesvolume2, &jinglesheadroom2 ,&interludevol, &mixbackvol, &jingles_playing,
-                 &left_stream, &left_audio, &right_stream, &right_audio, &stream_monitor,
-                 &s.new_left_pause, &s.new_right_pause, &s.flush_left, &s.flush_right, &s.flush_jingles, &s.flush_interlude,
-                 &simple_mixer, &eot_alarm_set, &mixermode, &s.fadeout_f, &main_play, &(plr_l->newpbspeed), &(plr_r->newpbspeed),
-                 &speed_variance, &dj_audio_level, &crosspattern, &s.use_dsp, &s.new_inter_pause,
-                 &inter_stream, &inter_audio, &inter_force, &alarm_audio_level, &voipvol, &(plr_i->newpbspeed)) !=39)
+        if (!(newframe = realloc(frame, size)))
             {
-            fprintf(stderr, "mixer got bad mixer string\n");
-            return TRUE;
+            fprintf(stderr, "mixer_write_levels: malloc failure\n");
+            exit(5);
             }
-        eot_alarm_f |= eot_alarm_set;
-
-        plr_l->fadeout_f = plr_r->fadeout_f = plr_i->fadeout_f = s.fadeout_f;
-        for (struct xlplayer **p = plr_j; *p; ++p)
-            (*p)->fadeout_f = s.fadeout_f;
-            
-        plr_l->use_sv = plr_r->use_sv = plr_i->use_sv = speed_variance;
+        frame = newframe;
+        frame_size = size;
+        }
 
-        if (s.use_dsp != using_dsp)
-            using_dsp = s.use_dsp;
+    hdr = (struct levels_header *)frame;
+    lp = (struct levels_player *)(hdr + 1);
+    hdr->n_players = xlplayer_stats_binary_all(players, lp, FALSE);
+    hdr->n_players += xlplayer_stats_binary_all(plr_j, lp + hdr->n_players, FALSE);
+    lm = (struct levels_mic *)(lp + hdr->n_players);
+    hdr->n_mics = mic_stats_binary_all(mics, lm, FALSE);
+    hdr->magic = LEVELS_MAGIC;
+    hdr->version = LEVELS_VERSION;
+    hdr->reserved = 0;
+    hdr->str_l_peak = s.str_l_peak_db;
+    hdr->str_r_peak = s.str_r_peak_db;
+    hdr->str_l_rms = s.str_l_rms_db;
+    hdr->str_r_rms = s.str_r_rms_db;
+    hdr->ports_connections_changed = ports_diff;
+    /* the binary report has room for the first 31 */
+    hdr->effects_playing = (effects < 0) ? -1 : (int32_t)(effects & 0x7FFFFFFF);
+    hdr->freewheel_mode = g.freewheel;
+
+    fprintf(g.out, "frame=%zu\n", size);
+    fwrite(frame, size, 1, g.out);
+    }
 
-        if (s.new_left_pause != plr_l->pause)
-            {
-            if (s.new_left_pause)
-                xlplayer_pause(plr_l);
-            else
-                xlplayer_unpause(plr_l);
-            }
-            
-        if (s.new_right_pause != plr_r->pause)
-            {
-            if (s.new_right_pause)
-                xlplayer_pause(plr_r);
-            else
-                xlplayer_unpause(plr_r);
-            }
+/* mixer_action_subscribelevels: settle the report format so that requestlevels needn't specify it
+ * player stats may also be limited to one report in so many milliseconds
+ */
+static void mixer_action_subscribelevels()
+    {
+    free(subscribed_format);
+    subscribed_format = report_format ? strdup(report_format) : NULL;
+    subscribed_interval = report_rate ? atoi(report_rate) * (gint64)1000 : 0;
+    players_reported = 0;
+    stats_full_due = TRUE;
+    }
 
-        if (s.new_inter_pause != plr_i->pause)
-            {
-            if (s.new_inter_pause)
-                xlplayer_pause(plr_i);
-            else
-                xlplayer_unpause(plr_i);
-            }
-        }
+/* mixer_action_rttiming: report the jack callback timings and the player threads, FLAG=1 starts the timings afresh */
+static void mixer_action_rttiming()
+    {
+    g_string_truncate(stats_out, 0);
+    rttime_report(stats_out, flag && flag[0] == '1');
+    xlplayer_make_report_all(players, stats_out);
+    xlplayer_make_report_all(plr_j, stats_out);
+    g_string_append(stats_out, "end\n");
+    fwrite(stats_out->str, stats_out->len, 1, g.out);
+    fflush(g.out);
+    }
 
-    if (!strcmp(action, "requestlevels"))
+static void mixer_action_requestlevels()
+    {
+    unsigned int lead, ports_diff;
+    jack_session_event_t *session_event;
+    const char *format = report_format ? report_format : subscribed_format;
+    int binary = format && !strcmp(format, "binary");
+    int shm = levels_shm && format && !strcmp(format, "shm");
+    int delta = format && !strcmp(format, "delta") && !stats_full_due;
+    gint64 now = g_get_monotonic_time();
+
+    /* a UI without the mapping gets the meters in the reply instead */
+    if (format && !strcmp(format, "shm") && !levels_shm)
+        binary = TRUE;
+    __atomic_store_n(&levels_shm_active, shm, __ATOMIC_RELEASE);
+
+    if (!shm)
         {
         /* make logarithmic values for the peak levels */
         s.str_l_peak_db = peak_to_log(peakfilter_read(str_pf_l));
@@ -1555,72 +2465,93 @@ int mixer_main()
             s.str_l_rms_db = (int) level2db(sqrt(str_l_meansqrd));
         if (str_r_meansqrd)
             s.str_r_rms_db = (int) level2db(sqrt(str_r_meansqrd));
-            
-        /* send the meter and other stats to the main app */
-        mic_stats_all(mics);
-
-        /* forward any MIDI commands that have been queued since last time */
-        pthread_mutex_lock(&midi_mutex);
-        s.midi_output[0]= '\0';
-        if (midi_nqueued>0) /* exclude leading `,`, include trailing `\0` */
-            memcpy(s.midi_output, midi_queue+1, midi_nqueued*sizeof(char));
-        midi_queue[0]= '\0';
-        midi_nqueued= 0;
-        pthread_mutex_unlock(&midi_mutex);
-
-        if (sig_recent_usr1())
-            s.session_command = "save_L1";
-        else
-            {
-            if (g.session_event_rb && jack_ringbuffer_read_space(g.session_event_rb) >= sizeof session_event)
-                {
-                jack_ringbuffer_read(g.session_event_rb, (char *)&session_event, sizeof session_event);
-                switch (session_event->type) {
-                    case JackSessionSave:
-                        s.session_command = "save_JACK";
-                        break;
-                    case JackSessionSaveAndQuit:
-                        s.session_command = "saveandquit_JACK";
-                        break;
-                    case JackSessionSaveTemplate:
-                        s.session_command = "savetemplate_JACK";
-                    }
+        }
 
-                fprintf(g.out, "session_event=%p\n"
-                                "session_directory=%s\n"
-                                "session_uuid=%s\n",
-                                 session_event,
-                                 session_event->session_dir,
-                                 session_event->client_uuid);
+    /* send the meter and other stats to the main app */
+    g_string_truncate(stats_out, 0);
+    if (!binary && !shm)
+        mic_stats_all(mics, stats_out, delta);
+
+    /* forward any MIDI commands that have been queued since last time */
+    midi_format_queued(s.midi_output, sizeof s.midi_output);
+
+    if (sig_recent_usr1())
+        s.session_command = "save_L1";
+    else
+        {
+        if (g.session_event_rb && jack_ringbuffer_read_space(g.session_event_rb) >= sizeof session_event)
+            {
+            jack_ringbuffer_read(g.session_event_rb, (char *)&session_event, sizeof session_event);
+            switch (session_event->type) {
+                case JackSessionSave:
+                    s.session_command = "save_JACK";
+                    break;
+                case JackSessionSaveAndQuit:
+                    s.session_command = "saveandquit_JACK";
+                    break;
+                case JackSessionSaveTemplate:
+                    s.session_command = "savetemplate_JACK";
                 }
-            else
-                s.session_command = "";
-            }
 
-        lead = port_connection_count;
-        if (lead - port_reports > UINT_MAX << 1)
-            ports_diff = UINT_MAX - lead + port_reports + 1;    /* handle wrap */
+            fprintf(g.out, "session_event=%p\n"
+                            "session_directory=%s\n"
+                            "session_uuid=%s\n",
+                             session_event,
+                             session_event->session_dir,
+                             session_event->client_uuid);
+            }
         else
-            ports_diff = lead - port_reports;
+            s.session_command = "";
+        }
 
-        xlplayer_stats_all(players);
-        xlplayer_stats_all(plr_j);
+    lead = port_connection_count;
+    if (lead - port_reports > UINT_MAX << 1)
+        ports_diff = UINT_MAX - lead + port_reports + 1;    /* handle wrap */
+    else
+        ports_diff = lead - port_reports;
 
-        int effects = 0;
-        for (struct xlplayer **p = plr_j_roster; *p; ++p)
-            effects |= (*p)->id;
-        if (effects == effects_active)
-            effects = -1;   // -1 for no change, UI can skip updating indicators
-        else
-            effects_active = effects;
+    long long effects = 0;
+    for (struct xlplayer **p = plr_j_roster; *p; ++p)
+        effects |= (*p)->id;
+    if (effects == effects_active)
+        effects = -1;   // -1 for no change, UI can skip updating indicators
+    else
+        effects_active = effects;
+
+    if (shm)
+        {
+        xlplayer_stats_metadata_all(players);
+        xlplayer_stats_metadata_all(plr_j);
+        fprintf(g.out, "midi=%s\n"
+                       "session_command=%s\n"
+                       "ports_connections_changed=%d\n"
+                       "effects_playing=%lld\n"
+                       "end\n",
+                       s.midi_output, s.session_command, ports_diff, effects);
+        }
+    else if (binary)
+        {
+        xlplayer_stats_metadata_all(players);
+        xlplayer_stats_metadata_all(plr_j);
+        mixer_write_levels(ports_diff, effects);
+        fprintf(g.out, "midi=%s\nsession_command=%s\nend\n", s.midi_output, s.session_command);
+        }
+    else
+        {
+        if (!delta || now - players_reported >= subscribed_interval)
+            {
+            xlplayer_stats_all(players, stats_out, delta);
+            xlplayer_stats_all(plr_j, stats_out, delta);
+            players_reported = now;
+            }
 
-        fprintf(g.out, 
+        g_string_append_printf(stats_out,
                     "str_l_peak=%d\nstr_r_peak=%d\n"
                     "str_l_rms=%d\nstr_r_rms=%d\n"
                     "midi=%s\n"
                     "session_command=%s\n"
                     "ports_connections_changed=%d\n"
-                    "effects_playing=%d\n"
+                    "effects_playing=%lld\n"
                     "freewheel_mode=%d\n"
                     "end\n",
                     s.str_l_peak_db, s.str_r_peak_db,
@@ -1631,17 +2562,392 @@ int mixer_main()
                     effects,
                     g.freewheel
                     );
+        fwrite(stats_out->str, stats_out->len, 1, g.out);
+        stats_full_due = FALSE;
+        }
+
+    if (ports_diff)
+        {
+        port_reports += ports_diff;
+        fprintf(stderr, "%d JACK port connection(s) changed\n", ports_diff);
+        }
+
+    /* tell the jack mixer it can reset its vu stats now */
+    if (!shm)
+        reset_vu_stats_f = TRUE;
+    fflush(g.out);
+    }
+
+/* the handlers for each action the user interface may request, found by hashing the action name */
+static GHashTable *action_ht;
+
+static void mixer_setup_action_table()
+    {
+    struct
+    {
+    char *key;
+    void (*value)();
+    } *htdp, htdata[] = {
+        {"ping", mixer_action_ping},
+        {"mp3_getstatus", mixer_action_mp3_getstatus},
+        {"jackportread", mixer_action_jackportread},
+        {"freewheel_toggle", mixer_action_freewheel_toggle},
+        {"freewheel_on", mixer_action_freewheel_on},
+        {"freewheel_off", mixer_action_freewheel_off},
+        {"jackconnect", mixer_action_jackconnect},
+        {"jackdisconnect", mixer_action_jackdisconnect},
+        {"session_reply", mixer_action_session_reply},
+        {"playeffect", mixer_action_playeffect},
+        {"stopeffect", mixer_action_stopeffect},
+        {"mic_control", mixer_action_mic_control},
+        {"new_channel_mode_string", mixer_action_new_channel_mode_string},
+        {"headroom", mixer_action_headroom},
+        {"truepeaklimiter", mixer_action_truepeaklimiter},
+        {"anymic", mixer_action_anymic},
+        {"fademode_left", mixer_action_fademode_left},
+        {"fademode_right", mixer_action_fademode_right},
+        {"fademode_interlude", mixer_action_fademode_interlude},
+        {"silencethreshold_left", mixer_action_silencethreshold_left},
+        {"silencethreshold_right", mixer_action_silencethreshold_right},
+        {"silencethreshold_interlude", mixer_action_silencethreshold_interlude},
+        {"playleft", mixer_action_playleft},
+        {"playright", mixer_action_playright},
+        {"playinterlude", mixer_action_playinterlude},
+        {"playnoflushleft", mixer_action_playnoflushleft},
+        {"playnoflushright", mixer_action_playnoflushright},
+        {"playnoflushinterlude", mixer_action_playnoflushinterlude},
+        {"preloadleft", mixer_action_preloadleft},
+        {"preloadright", mixer_action_preloadright},
+        {"preloadinterlude", mixer_action_preloadinterlude},
+#if 0
+        {"playmanyjingles", mixer_action_playmanyjingles},
+#endif
+        {"stopleft", mixer_action_stopleft},
+        {"stopright", mixer_action_stopright},
+        {"stopjingles", mixer_action_stopjingles},
+        {"stopinterlude", mixer_action_stopinterlude},
+        {"dither", mixer_action_dither},
+        {"dontdither", mixer_action_dontdither},
+        {"resamplequality", mixer_action_resamplequality},
+        {"ogginforequest", mixer_action_ogginforequest},
+        {"sndfileinforequest", mixer_action_sndfileinforequest},
+        {"probemany", mixer_action_probemany},
+        {"loudnessscan", mixer_action_loudnessscan},
+#ifdef HAVE_SPEEX
+        {"speexreadtagrequest", mixer_action_speexreadtagrequest},
+#endif
+#ifdef HAVE_SPEEX
+        {"speexwritetagrequest", mixer_action_speexwritetagrequest},
+#endif
+        {"voippan", mixer_action_voippan},
+        {"mixstats", mixer_action_mixstats},
+        {"requestlevels", mixer_action_requestlevels},
+        {"subscribelevels", mixer_action_subscribelevels},
+        {"rttiming", mixer_action_rttiming},
+        {NULL, NULL}};
+
+    if (!(action_ht = g_hash_table_new(g_str_hash, g_str_equal)))
+        {
+        fprintf(stderr, "mixer_setup_action_table: malloc failure\n");
+        exit(5);
+        }
 
-        if (ports_diff)
+    for (htdp = htdata; htdp->key; ++htdp)
+        g_hash_table_insert(action_ht, htdp->key, htdp->value);
+    }
+
+static void mixer_cleanup()
+    {
+    mixer_parallel_cleanup();
+    rtarena_free(eot_alarm_table);
+    if (s.outport)
+        jack_free(s.outport);
+    free(s.our_sc_str_in_l);
+    free(s.our_sc_str_in_r);
+    mic_free_all(mics);
+    peakfilter_destroy(str_pf_l);
+    truepeak_limiter_destroy(str_limiter);
+    peakfilter_destroy(str_pf_r);
+    jack_ringbuffer_free(midi_rb);
+    xlplayer_destroy(plr_l);
+    xlplayer_destroy(plr_r);
+    xlplayer_destroy(plr_i);
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        xlplayer_destroy(*p);
+    xlplayer_pool_destroy(effects_pool);
+    pcmcache_cleanup();
+    free(plr_j);
+    free(plr_j_roster);
+    free(plr_j_active);
+    g_hash_table_destroy(action_ht);
+    g_string_free(stats_out, TRUE);
+    free(subscribed_format);
+    if (levels_shm)
+        metershm_destroy(levels_shm);
+    if (kvp_record_fp)
+        fclose(kvp_record_fp);
+    }
+
+/* mixer_record_open: start a recording of the commands for mixer_bench -R to replay
+ * the file starts with MIXER_RECORD_MAGIC after which each message is a double
+ * of seconds since the recording began followed by the message as a frame
+ */
+static void mixer_record_open(const char *pathname)
+    {
+    if (!(kvp_record_fp = fopen(pathname, "w")))
+        {
+        perror("mixer_record_open");
+        return;
+        }
+    fputs(MIXER_RECORD_MAGIC, kvp_record_fp);
+    kvp_record_start = g_get_monotonic_time();
+    kvp_keep_messages(TRUE);
+    fprintf(stderr, "recording the mixer commands to %s\n", pathname);
+    }
+
+static void mixer_record_message()
+    {
+    double t = (g_get_monotonic_time() - kvp_record_start) / 1e6;
+
+    if (action)
+        for (const char * const *skip = kvp_record_skip; *skip; ++skip)
+            if (!strcmp(action, *skip))
+                return;
+
+    if (fwrite(&t, sizeof t, 1, kvp_record_fp) != 1 || !kvp_write_message(kvp_record_fp) || fflush(kvp_record_fp))
+        {
+        perror("mixer_record_message");
+        fclose(kvp_record_fp);
+        kvp_record_fp = NULL;
+        kvp_keep_messages(FALSE);
+        }
+    }
+
+/* mixer_choose_resampler: the converter a player's decoders use
+ * $resampler_<playername> e.g. resampler_jingles, otherwise $resampler, libsamplerate by default
+ */
+static void mixer_choose_resampler(struct xlplayer *p)
+    {
+    char name[64];
+    const char *value;
+
+    snprintf(name, sizeof name, "resampler_%s", p->playername);
+    if (!(value = getenv(name)) || !*value)
+        value = getenv("resampler");
+    if (value && *value && !resampler_kind_parse(value, &p->resampler))
+        fprintf(stderr, "mixer_choose_resampler: unknown resampler %s\n", value);
+    }
+
+/* mixer_new_buffer_size: the buffers were reserved by mixer_init for periods up to $max_period_frames
+ * a change within that only changes how much of them is used
+ */
+int mixer_new_buffer_size(jack_nframes_t n_frames)
+    {
+    fprintf(stderr, "player read buffer set to %ld frames\n", (long)n_frames);
+    xlplayer_buffer_alloc_all(players, n_frames);
+    xlplayer_buffer_alloc_all(plr_j, n_frames);
+    return 0;
+    }
+
+/* mixer_stream_latency: how many samples the stream output lags the mix, the limiter's lookahead */
+jack_nframes_t mixer_stream_latency()
+    {
+    return str_limiter ? truepeak_limiter_latency(str_limiter) : 0;
+    }
+
+/* mixer_players_buffered: whether the players can fill the next period, for running offline */
+int mixer_players_buffered(jack_nframes_t n_frames)
+    {
+    for (struct xlplayer **p = players; *p; ++p)
+        if (!xlplayer_buffered(*p, n_frames))
+            return FALSE;
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        if (!xlplayer_buffered(*p, n_frames))
+            return FALSE;
+    return TRUE;
+    }
+
+void mixer_init(void)
+    {
+    sr = jack_get_sample_rate(g.client);
+    jingles_samples_cutoff = sr / 12;            /* A twelfth of a second early */
+    player_samples_cutoff = sr * 0.25;           /* for gapless playback */
+    int n = 0;
+    int ne = atoi(getenv("num_effects"));
+    jack_nframes_t max_period;
+
+    /* the effects playing are reported as bits of a long long */
+    if (ne > MAX_EFFECTS)
+        {
+        fprintf(stderr, "limiting the effects players to %d\n", MAX_EFFECTS);
+        ne = MAX_EFFECTS;
+        }
+    if (getenv("effects_bank_size") && atoi(getenv("effects_bank_size")) > 0)
+        effects_bank_size = atoi(getenv("effects_bank_size"));
+    if (effects_bank_size > ne)
+        effects_bank_size = ne;
+
+    if(! ((players[n++] = plr_l = xlplayer_create(sr, MAIN_RB_SIZE, "left", &g.app_shutdown, &volume, 0, &left_stream, &left_audio, 0.3f)) &&
+            (players[n++] = plr_r = xlplayer_create(sr, MAIN_RB_SIZE, "right", &g.app_shutdown, &volume2, 0, &right_stream, &right_audio, 0.3f))))
+        {
+        fprintf(stderr, "failed to create main player modules\n");
+        exit(5);
+        }
+    
+    if (!(plr_j = (struct xlplayer **)calloc(ne + 1, sizeof (struct xlplayer *))))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+    
+    if (!(plr_j_roster = (struct xlplayer **)calloc(ne + 1, sizeof (struct xlplayer *))) ||
+                !(plr_j_active = (struct xlplayer **)calloc(ne + 1, sizeof (struct xlplayer *))))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+    
+    /* the effects share a few decoding threads, most of them being idle most of the time
+     * $effect_threads sets how many
+     */
+    if (ne)
+        {
+        int n_threads = getenv("effect_threads") ? atoi(getenv("effect_threads")) : 2;
+
+        if (n_threads < 1)
+            n_threads = 1;
+        if (n_threads > ne)
+            n_threads = ne;
+        effects_pool = xlplayer_pool_create("jingles", n_threads, ne);
+        }
+
+    /* the effects are played from memory after the first time, $effect_cache_mb limits how much */
+    pcmcache_init((getenv("effect_cache_mb") ? atoi(getenv("effect_cache_mb")) : 64) * (size_t)1048576);
+
+    for (int i = 0; i < ne; ++i)
+        {
+        int *volct = (i < effects_bank_size) ? &jinglesvolume1 : &jinglesvolume2;
+
+        if (!(plr_j[i] = xlplayer_create_pooled(effects_pool, sr, 0.15f, "jingles", &g.app_shutdown, volct, 0, NULL, NULL, 0.0f)))
             {
-            port_reports += ports_diff;
-            fprintf(stderr, "%d JACK port connection(s) changed\n", ports_diff);
+            fprintf(stderr, "failed to create jingles player module\n");
+            exit(5);
             }
+        plr_j[i]->fade_mode = 3;
+        plr_j[i]->effect_bank = (i >= effects_bank_size);
+        plr_j[i]->use_pcmcache = TRUE;
+        }
+    startup_mark("effects players");
+    
+    if (!(players[n++] = plr_i = xlplayer_create(sr, MAIN_RB_SIZE, "interlude", &g.app_shutdown, &interludevol, 0, &inter_stream, &inter_audio, 0.3f)))
+        {
+        fprintf(stderr, "failed to create interlude player module\n");
+        exit(5);
+        }
+    plr_i->cf_aud = 1;  /* crossfader values to apply in dj audio -- the crossfader interface is used to implement the soft fade in/out */
+
+    players[n++] = NULL;
+    if (n != sizeof players / sizeof players[0])
+        {
+        fprintf(stderr, "players array is the wrong size\n");
+        exit(5);
+        }
+    for (struct xlplayer **p = players; *p; ++p)
+        mixer_choose_resampler(*p);
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        mixer_choose_resampler(*p);
+
+    /* reserve for the longest period likely so a period size change doesn't allocate */
+    if ((max_period = getenv("max_period_frames") ? atoi(getenv("max_period_frames")) : 4096) < jack_get_buffer_size(g.client))
+        max_period = jack_get_buffer_size(g.client);
+    xlplayer_buffer_reserve_all(players, max_period);
+    xlplayer_buffer_reserve_all(plr_j, max_period);
+
+    /* the callback reads the ringbuffers so they are faulted in and locked now */
+    for (struct xlplayer **p = players; *p; ++p)
+        {
+        rtarena_lock_ringbuffer((*p)->main_rb);
+        rtarena_lock_ringbuffer((*p)->fade_rb);
+        }
+    for (struct xlplayer **p = plr_j; *p; ++p)
+        {
+        rtarena_lock_ringbuffer((*p)->main_rb);
+        rtarena_lock_ringbuffer((*p)->fade_rb);
+        }
+
+    smoothing_volume_init(&jingles_headroom_smoothing, &jingles_headroom_control, 0.0f);
+    crossfade_init();
+
+    /* generate the wave table for the DJ alarm */
+    if (!(eot_alarm_table = rtarena_calloc(sr, sizeof (sample_t))))
+        {
+        fprintf(stderr, "failed to allocate space for end of track alarm wave table\n");
+        exit(5);
+        }
+    else
+        {
+        alarm_size = (sr / 900) * 900;    /* builds the alarm tone wave table */
+        for (unsigned i = 0; i < alarm_size ; i++)
+            {
+            eot_alarm_table[i] = 0.83F * sinf((i % (sr/900)) * 6.283185307F / (sr/900));
+            eot_alarm_table[i] += 0.024F * sinf((i % (sr/900)) * 12.56637061F / (sr/900) + 3.141592654F / 4.0F);
+            }
+        }
             
-        /* tell the jack mixer it can reset its vu stats now */
-        reset_vu_stats_f = TRUE;
-        fflush(g.out);
+    use_block_engine = !strcmp(getenv("mixer_engine"), "block");
+    fprintf(stderr, "mixer engine: %s\n", use_block_engine ? "block" : "sample");
+
+    if (!(midi_rb = jack_ringbuffer_create(MIDI_QUEUE_SIZE * sizeof (struct midi_raw_event))))
+        {
+        fprintf(stderr, "failed to allocate the midi event queue\n");
+        exit(5);
+        }
+
+    str_pf_l = peakfilter_create(115e-6f, sr);
+    str_pf_r = peakfilter_create(115e-6f, sr);
+    if (!(str_limiter = truepeak_limiter_new(sr, -1.0f, 80.0f)))
+        exit(5);
+
+    /* allocate microphone resources */
+    startup_mark("mixer setup");
+    mics = mic_init_all(atoi(getenv("mic_qty")), g.client);
+    startup_mark("microphones");
+    mixer_parallel_init(max_period);
+
+    /* the meter report is sized now since the players and mics are fixed from here on */
+    if (getenv("meters"))
+        {
+        levels_shm_size = sizeof (struct levels_header) + (n - 1 + ne) * sizeof (struct levels_player)
+                                + atoi(getenv("mic_qty")) * sizeof (struct levels_mic);
+        if (!(levels_shm = metershm_create(getenv("meters"), levels_shm_size)))
+            fprintf(stderr, "meters will be sent through the pipe\n");
         }
         
+    jack_set_port_connect_callback(g.client, custom_jack_port_connect_callback, NULL);
+
+    mixer_setup_action_table();
+    stats_out = g_string_sized_new(4096);
+    if (getenv("kvp_record") && *getenv("kvp_record"))
+        mixer_record_open(getenv("kvp_record"));
+    atexit(mixer_cleanup);
+    g.mixer_up = TRUE;
+    }
+        
+int mixer_main()
+    {
+    void (*fn)();
+
+    if (!(g.framed_input ? kvp_parse_frame(kvpdict, g.in) : kvp_parse(kvpdict, g.in)))
+        {
+        fprintf(stderr, "kvp_parse returned false\n");
+        return FALSE;
+        }
+
+    if (kvp_record_fp)
+        mixer_record_message();
+
+    if (action && (fn = g_hash_table_lookup(action_ht, action)))
+        fn();
+
     return TRUE;
     }
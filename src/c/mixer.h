@@ -19,6 +19,9 @@
 
 #include <jack/jack.h>
 
+/* the first line of a $kvp_record command recording */
+#define MIXER_RECORD_MAGIC "idjc mixer record 1\n"
+
 void mixer_init();
 int mixer_main();
 int mixer_control(char *command);
@@ -26,3 +29,5 @@ int mixer_healthcheck();
 int mixer_process_audio(jack_nframes_t n_frames, void *arg);
 void mixer_stop_players();
 int mixer_new_buffer_size(jack_nframes_t n_frames);
+int mixer_players_buffered(jack_nframes_t n_frames);
+jack_nframes_t mixer_stream_latency();
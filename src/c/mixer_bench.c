@@ -0,0 +1,521 @@
+/*
+#   mixer_bench.c: timing of the mixer jack callback without a JACK server
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* built by make bench and linked against the idjc module
+ *
+ * the JACK functions the mixer needs a server for are defined here instead
+ * and take precedence over those of libjack, so the port buffers are ours
+ * and the jack callback is called from a loop as fast as the players can
+ * keep up
+ *
+ * usage: mixer_bench [-e sample|block] [-m mics] [-j effects] [-r rate] [-s seconds] [-H]
+ *                    [-R recording [-p frames]]
+ *
+ * -R replays the commands the backend recorded to $kvp_record in show time
+ * rather than running the usual matrix, so a whole show can be timed in a
+ * fraction of its length, the files it played being where they were
+ */
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+#include "main.h"
+#include "mixer.h"
+
+#define MAX_FRAMES 1024
+#define WARMUP_SECONDS 0.5
+#define HISTOGRAM_BINS 24
+
+typedef jack_default_audio_sample_t sample_t;
+
+/* what the opaque port handles given to the mixer point to */
+struct bench_port
+    {
+    sample_t buffer[MAX_FRAMES];
+    };
+
+struct mode
+    {
+    const char *name;
+    int simple_mixer;
+    int mixermode;
+    };
+
+static const struct mode modes[] = {
+    { "simple",         1, 0 },
+    { "full",           0, 0 },
+    { "full+phone",     0, 1 },
+    { "full+private",   0, 2 },
+    };
+
+static const int period_sizes[] = { 64, 128, 256, 1024 };
+
+static jack_nframes_t sample_rate = 48000;
+static int n_mics = 4;
+static int n_effects = 4;
+static double run_seconds = 10.0;
+static int show_histogram;
+static int glitches;
+static const char *replay_pathname;
+static jack_nframes_t replay_frames = 256;
+
+/* the JACK API as far as the mixer uses it */
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client)
+    {
+    return sample_rate;
+    }
+
+jack_port_t *jack_port_register(jack_client_t *client, const char *port_name, const char *port_type,
+                                                unsigned long flags, unsigned long buffer_size)
+    {
+    struct bench_port *port;
+
+    if (!(port = calloc(1, sizeof (struct bench_port))))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+    /* inputs carry a quiet tone so that nothing is working on silence */
+    if (flags & JackPortIsInput)
+        for (int i = 0; i < MAX_FRAMES; ++i)
+            port->buffer[i] = 0.1f * sinf(i * 6.283185307f * 15.0f / MAX_FRAMES);
+    return (jack_port_t *)port;
+    }
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes)
+    {
+    return ((struct bench_port *)port)->buffer;
+    }
+
+const char **jack_get_ports(jack_client_t *client, const char *port_name_pattern,
+                                                const char *type_name_pattern, unsigned long flags)
+    {
+    return NULL;
+    }
+
+int jack_set_port_connect_callback(jack_client_t *client, JackPortConnectCallback connect_callback, void *arg)
+    {
+    return 0;
+    }
+
+uint32_t jack_midi_get_event_count(void *port_buffer)
+    {
+    return 0;
+    }
+
+int jack_midi_event_get(jack_midi_event_t *event, void *port_buffer, uint32_t event_index)
+    {
+    return ENODATA;
+    }
+
+static double now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+/* command: hand the mixer a message as the user interface would send it */
+static void command(const char *fmt, ...)
+    {
+    char message[1024];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof message, fmt, ap);
+    va_end(ap);
+    if (!(g.in = fmemopen(message, strlen(message), "r")))
+        {
+        perror("fmemopen");
+        exit(5);
+        }
+    mixer_main();
+    fclose(g.in);
+    g.in = NULL;
+    }
+
+static void put_le(FILE *fp, uint32_t value, int bytes)
+    {
+    while (bytes--)
+        {
+        fputc(value & 0xFF, fp);
+        value >>= 8;
+        }
+    }
+
+/* make_tone: write a stereo wav file of two tones for the players to play */
+static void make_tone(char *pathname, double seconds)
+    {
+    FILE *fp;
+    int fd;
+    uint32_t frames = seconds * sample_rate;
+
+    if ((fd = mkstemps(pathname, 4)) < 0 || !(fp = fdopen(fd, "w")))
+        {
+        perror("make_tone");
+        exit(5);
+        }
+    fputs("RIFF", fp);
+    put_le(fp, 36 + frames * 4, 4);
+    fputs("WAVEfmt ", fp);
+    put_le(fp, 16, 4);
+    put_le(fp, 1, 2);                    /* PCM */
+    put_le(fp, 2, 2);
+    put_le(fp, sample_rate, 4);
+    put_le(fp, sample_rate * 4, 4);
+    put_le(fp, 4, 2);
+    put_le(fp, 16, 2);
+    fputs("data", fp);
+    put_le(fp, frames * 4, 4);
+    for (uint32_t i = 0; i < frames; ++i)
+        {
+        double t = (double)i / sample_rate;
+
+        put_le(fp, (uint16_t)(int16_t)(8000.0 * sin(t * 2.0 * M_PI * 440.0)), 2);
+        put_le(fp, (uint16_t)(int16_t)(8000.0 * sin(t * 2.0 * M_PI * 554.37)), 2);
+        }
+    if (fclose(fp))
+        {
+        perror("make_tone");
+        exit(5);
+        }
+    }
+
+static void set_mode(const struct mode *mode)
+    {
+    command("MIXR=:127:127:050:127:000:127:000:127:064:%d:11111:00:0000:%d:0:%d:1:1:1.000000:1.000000:0:0.000000:"
+                "0:0:0:1:1:0:0.000000:064:1.000000:\nACTN=mixstats\nend\n", n_effects > 0, mode->simple_mixer, mode->mixermode);
+    }
+
+/* start_players: play the tone from the top on every player so a run can't reach the end */
+static void start_players(const char *pathname, int size)
+    {
+    command("PLRP=%s\nSEEK=0\nSIZE=%d\nRGDB=0\nACTN=playleft\nend\n", pathname, size);
+    command("PLRP=%s\nSEEK=0\nSIZE=%d\nRGDB=0\nACTN=playright\nend\n", pathname, size);
+    command("PLRP=%s\nSEEK=0\nSIZE=%d\nRGDB=0\nACTN=playinterlude\nend\n", pathname, size);
+    for (int i = 0; i < n_effects; ++i)
+        command("PLRP=%s\nEFCT=%d\nRGDB=-12\nACTN=playeffect\nend\n", pathname, i);
+    }
+
+/* period: wait for the players to have the audio to hand then time one jack callback */
+static double period(jack_nframes_t nframes)
+    {
+    double start, limit = now() + 0.05;
+
+    while (!mixer_players_buffered(nframes))
+        {
+        if (now() > limit)
+            {
+            ++glitches;
+            break;
+            }
+        usleep(50);
+        }
+    start = now();
+    mixer_process_audio(nframes, NULL);
+    return now() - start;
+    }
+
+static int compare_double(const void *a, const void *b)
+    {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+    }
+
+static double percentile(const double *sorted, int n, double p)
+    {
+    return sorted[(int)((n - 1) * p / 100.0 + 0.5)];
+    }
+
+/* histogram: period times in bins of powers of two microseconds */
+static void histogram(const double *times, int n)
+    {
+    int bins[HISTOGRAM_BINS] = { 0 };
+
+    for (int i = 0; i < n; ++i)
+        {
+        int b = 0;
+
+        for (double us = times[i] * 1e6; us >= 1.0 && b < HISTOGRAM_BINS - 1; us /= 2.0)
+            ++b;
+        ++bins[b];
+        }
+    for (int b = 0; b < HISTOGRAM_BINS; ++b)
+        if (bins[b])
+            printf("        < %8.0f us %8d  %6.2f%%\n", ldexp(1.0, b), bins[b], bins[b] * 100.0 / n);
+    }
+
+static void run(const struct mode *mode, jack_nframes_t nframes, const char *pathname, int size, double *times)
+    {
+    int n_periods = run_seconds * sample_rate / nframes;
+    double total = 0.0, budget = (double)nframes / sample_rate;
+
+    mixer_new_buffer_size(nframes);
+    set_mode(mode);
+    start_players(pathname, size);
+    usleep(200000);
+    for (int i = WARMUP_SECONDS * sample_rate / nframes; i; --i)
+        period(nframes);
+
+    glitches = 0;
+    for (int i = 0; i < n_periods; ++i)
+        total += times[i] = period(nframes);
+    qsort(times, n_periods, sizeof *times, compare_double);
+
+    printf("%-13s %5u %9.2f %8.2f %8.2f %8.2f %8.2f %9.2f %7.2f%%", mode->name, nframes,
+                total * 1e9 / ((double)n_periods * nframes), percentile(times, n_periods, 50.0) * 1e6,
+                percentile(times, n_periods, 90.0) * 1e6, percentile(times, n_periods, 99.0) * 1e6,
+                percentile(times, n_periods, 99.9) * 1e6, times[n_periods - 1] * 1e6,
+                times[n_periods - 1] * 100.0 / budget);
+    if (glitches)
+        printf("  %d underruns", glitches);
+    putchar('\n');
+    if (show_histogram)
+        histogram(times, n_periods);
+    }
+
+/* replay_message: hand the mixer the next recorded frame */
+static void replay_message(FILE *fp)
+    {
+    static char *message;
+    static size_t message_size;
+    uint32_t length;
+    char *newmessage;
+
+    if (fread(&length, sizeof length, 1, fp) != 1)
+        {
+        fprintf(stderr, "replay_message: truncated recording\n");
+        exit(5);
+        }
+    if (sizeof length + length > message_size)
+        {
+        if (!(newmessage = realloc(message, sizeof length + length)))
+            {
+            fprintf(stderr, "malloc failure\n");
+            exit(5);
+            }
+        message = newmessage;
+        message_size = sizeof length + length;
+        }
+    memcpy(message, &length, sizeof length);
+    if (length && fread(message + sizeof length, length, 1, fp) != 1)
+        {
+        fprintf(stderr, "replay_message: truncated recording\n");
+        exit(5);
+        }
+    if (!(g.in = fmemopen(message, sizeof length + length, "r")))
+        {
+        perror("fmemopen");
+        exit(5);
+        }
+    g.framed_input = 1;
+    mixer_main();
+    g.framed_input = 0;
+    fclose(g.in);
+    g.in = NULL;
+    }
+
+/* replay: each message goes in ahead of the first period to start after it was recorded */
+static void replay(const char *pathname, jack_nframes_t nframes)
+    {
+    char magic[sizeof MIXER_RECORD_MAGIC];
+    double t, start, wall, total = 0.0, budget = (double)nframes / sample_rate, *times = NULL, *newtimes;
+    size_t n_periods = 0, times_size = 0;
+    int n_messages = 0, more;
+    FILE *fp;
+
+    if (!(fp = fopen(pathname, "r")) || !fgets(magic, sizeof magic, fp) || strcmp(magic, MIXER_RECORD_MAGIC))
+        {
+        fprintf(stderr, "%s: not a mixer command recording\n", pathname);
+        exit(5);
+        }
+
+    mixer_new_buffer_size(nframes);
+    glitches = 0;
+    more = fread(&t, sizeof t, 1, fp) == 1;
+    start = now();
+    while (more)
+        {
+        for (double show_time = (double)n_periods * nframes / sample_rate; more && t <= show_time; ++n_messages)
+            {
+            replay_message(fp);
+            more = fread(&t, sizeof t, 1, fp) == 1;
+            }
+        if (n_periods == times_size)
+            {
+            times_size = times_size ? times_size * 2 : 65536;
+            if (!(newtimes = realloc(times, times_size * sizeof *times)))
+                {
+                fprintf(stderr, "malloc failure\n");
+                exit(5);
+                }
+            times = newtimes;
+            }
+        total += times[n_periods++] = period(nframes);
+        }
+    wall = now() - start;
+    fclose(fp);
+    if (!n_periods)
+        {
+        fprintf(stderr, "%s: no commands recorded\n", pathname);
+        exit(5);
+        }
+    qsort(times, n_periods, sizeof *times, compare_double);
+
+    printf("%d messages, %.1f seconds of show replayed in %.1f seconds, %.1f times real time\n", n_messages,
+                (double)n_periods * nframes / sample_rate, wall, wall > 0.0 ? n_periods * budget / wall : 0.0);
+    printf("%-13s %5s %9s %8s %8s %8s %8s %9s %8s\n", "mode", "frames", "ns/frame",
+                "p50 us", "p90 us", "p99 us", "p99.9 us", "worst us", "of period");
+    printf("%-13s %5u %9.2f %8.2f %8.2f %8.2f %8.2f %9.2f %7.2f%%", "replay", nframes,
+                total * 1e9 / ((double)n_periods * nframes), percentile(times, n_periods, 50.0) * 1e6,
+                percentile(times, n_periods, 90.0) * 1e6, percentile(times, n_periods, 99.0) * 1e6,
+                percentile(times, n_periods, 99.9) * 1e6, times[n_periods - 1] * 1e6,
+                times[n_periods - 1] * 100.0 / budget);
+    if (glitches)
+        printf("  %d underruns", glitches);
+    putchar('\n');
+    if (show_histogram)
+        histogram(times, n_periods);
+    free(times);
+    }
+
+static void usage(const char *name)
+    {
+    fprintf(stderr, "usage: %s [-e sample|block] [-m mics] [-j effects] [-r rate] [-s seconds] [-H] [-R recording [-p frames]]\n", name);
+    exit(2);
+    }
+
+int main(int argc, char **argv)
+    {
+    const char *engine = "sample";
+    char pathname[] = "/tmp/mixer_bench_XXXXXX.wav", number[12];
+    jack_port_t **ports = (jack_port_t **)&g.port;
+    double *times;
+    int opt, size;
+
+    while ((opt = getopt(argc, argv, "e:m:j:r:s:HR:p:")) != -1)
+        switch (opt)
+            {
+            case 'e':
+                engine = optarg;
+                break;
+            case 'm':
+                n_mics = atoi(optarg) & ~1;     /* mics are made in pairs */
+                break;
+            case 'j':
+                n_effects = atoi(optarg);
+                break;
+            case 'r':
+                sample_rate = atoi(optarg);
+                break;
+            case 's':
+                run_seconds = atof(optarg);
+                break;
+            case 'H':
+                show_histogram = 1;
+                break;
+            case 'R':
+                replay_pathname = optarg;
+                break;
+            case 'p':
+                replay_frames = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+            }
+    if (n_mics < 0 || n_effects < 0 || sample_rate < 8000 || run_seconds <= 0.0
+                || replay_frames < 16 || replay_frames > MAX_FRAMES)
+        usage(argv[0]);
+
+    /* the environment the user interface would set up */
+    snprintf(number, sizeof number, "%d", n_mics);
+    setenv("mic_qty", number, 1);
+    snprintf(number, sizeof number, "%d", n_effects);
+    setenv("num_effects", number, 1);
+    setenv("mixer_engine", engine, 1);
+    unsetenv("meters");
+    unsetenv("kvp_record");
+
+    /* every port of the mixer gets a buffer */
+    g.client = (jack_client_t *)&g;
+    for (size_t i = 0; i < sizeof g.port / sizeof (jack_port_t *); ++i)
+        ports[i] = jack_port_register(g.client, "", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    pthread_mutex_init(&g.avc_mutex, NULL);
+    if (!(g.out = fopen("/dev/null", "w")))
+        {
+        perror("/dev/null");
+        exit(5);
+        }
+
+    size = run_seconds + WARMUP_SECONDS + 5.0;
+    make_tone(pathname, size);
+    if (!(times = malloc((size_t)(run_seconds * sample_rate / period_sizes[0] + 1) * sizeof *times)))
+        {
+        fprintf(stderr, "malloc failure\n");
+        exit(5);
+        }
+
+    mixer_init();
+    for (int i = 0; i < n_mics; ++i)
+        {
+        command("INDX=%d\nAGCP=mode=2\nACTN=mic_control\nend\n", i);
+        command("INDX=%d\nAGCP=open=1\nACTN=mic_control\nend\n", i);
+        }
+    char roles[n_mics + 1];
+
+    memset(roles, 'm', n_mics);
+    roles[n_mics] = '\0';
+    command("CMOD=%s\nACTN=new_channel_mode_string\nend\n", roles);
+    command("FLAG=%d\nACTN=anymic\nend\n", n_mics > 0);
+
+    if (replay_pathname)
+        {
+        printf("%s engine, %d mics, %d effects, %u Hz, replaying %s\n", engine, n_mics, n_effects, sample_rate, replay_pathname);
+        replay(replay_pathname, replay_frames);
+        g.app_shutdown = 1;
+        unlink(pathname);
+        free(times);
+        return 0;
+        }
+
+    printf("%s engine, %d mics, %d effects, %u Hz, %g seconds a run\n", engine, n_mics, n_effects, sample_rate, run_seconds);
+    printf("%-13s %5s %9s %8s %8s %8s %8s %9s %8s\n", "mode", "frames", "ns/frame",
+                "p50 us", "p90 us", "p99 us", "p99.9 us", "worst us", "of period");
+    for (size_t m = 0; m < sizeof modes / sizeof modes[0]; ++m)
+        for (size_t p = 0; p < sizeof period_sizes / sizeof period_sizes[0]; ++p)
+            run(&modes[m], period_sizes[p], pathname, size, times);
+
+    g.app_shutdown = 1;
+    unlink(pathname);
+    free(times);
+    return 0;
+    }
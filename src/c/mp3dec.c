@@ -26,19 +26,136 @@
 #include <jack/jack.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include "xlplayer.h"
 #include "mp3dec.h"
 #include "bsdcompat.h"
+#include "mapfile.h"
 
 #define TRUE 1
 #define FALSE 0
 #define ACCEPTED 1
 #define REJECTED 0
 
+#define MP3INDEX_MAGIC "idjc-mp3index 1"
+
 static int decoder_library_ok;
 
 int dynamic_metadata_form[4] = { DM_SPLIT_L1, DM_NOTAG, DM_NOTAG, DM_SPLIT_U8 };
 
+/* mp3decode_index_write: the frame index libmpg123 has so far, when it is more than was cached */
+static void mp3decode_index_write(struct indexcache_key *key, mpg123_handle *mh, size_t cached_fill)
+    {
+    FILE *fp;
+    char *tmp;
+    off_t *offsets, step;
+    size_t fill, i;
+
+    if (mpg123_index(mh, &offsets, &step, &fill) == MPG123_OK && fill > cached_fill &&
+                            (fp = indexcache_write_open(key, MP3INDEX_MAGIC, &tmp)))
+        {
+        fprintf(fp, "%lld %zu\n", (long long)step, fill);
+        for (i = 0; i < fill; ++i)
+            fprintf(fp, "%lld\n", (long long)offsets[i]);
+        indexcache_write_close(key, fp, tmp);
+        }
+    }
+
+/* mp3decode_index_scan: build the whole index of a file for next time on a thread of its own */
+static void *mp3decode_index_scan(void *args)
+    {
+    char *pathname = args;
+    struct indexcache_key key;
+    mpg123_handle *mh;
+
+    if (indexcache_key_init(&key, "mp3index", pathname))
+        {
+        if ((mh = mpg123_new(NULL, NULL)))
+            {
+            if (mpg123_open(mh, pathname) == MPG123_OK)
+                {
+                if (mpg123_scan(mh) == MPG123_OK)
+                    mp3decode_index_write(&key, mh, 0);
+                else
+                    fprintf(stderr, "mp3decode_index_scan: mpg123_scan failed\n");
+                mpg123_close(mh);
+                }
+            mpg123_delete(mh);
+            }
+        indexcache_key_free(&key);
+        }
+    free(pathname);
+    return NULL;
+    }
+
+/* mp3decode_index_load: give libmpg123 the frame index from an earlier play
+ * VBR files lacking one make every deep seek a linear parse of the file
+ * so in that case the seek is made a fuzzy one and the index is built in the background for next time
+ */
+static void mp3decode_index_load(struct mp3decode_vars *self, const char *pathname, int seeking)
+    {
+    FILE *fp;
+    off_t *offsets;
+    long long step, offset;
+    size_t fill, i;
+    pthread_attr_t attr;
+    pthread_t thread;
+    char *copy;
+
+    if (!(self->have_index_key = indexcache_key_init(&self->index_key, "mp3index", pathname)))
+        return;
+
+    if ((fp = indexcache_read_open(&self->index_key, MP3INDEX_MAGIC)))
+        {
+        if (fscanf(fp, "%lld %zu", &step, &fill) == 2 && step > 0 && fill && (offsets = malloc(fill * sizeof (off_t))))
+            {
+            for (i = 0; i < fill && fscanf(fp, "%lld", &offset) == 1; ++i)
+                offsets[i] = offset;
+
+            /* libmpg123 takes a copy */
+            if (i == fill && mpg123_set_index(self->mh, offsets, step, fill) == MPG123_OK)
+                self->index_fill = fill;
+            free(offsets);
+            }
+        fclose(fp);
+        }
+
+    if (self->index_fill || !seeking)
+        return;
+
+    if (mpg123_param(self->mh, MPG123_ADD_FLAGS, MPG123_FUZZY, 0.0) != MPG123_OK)
+        fprintf(stderr, "mp3decode_index_load: failed to allow fuzzy seeks\n");
+
+    /* the partial index of this play is not saved over the whole one */
+    indexcache_key_free(&self->index_key);
+    self->have_index_key = FALSE;
+
+    if (!(copy = strdup(pathname)))
+        {
+        fprintf(stderr, "mp3decode_index_load: malloc failure\n");
+        return;
+        }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, mp3decode_index_scan, copy))
+        {
+        fprintf(stderr, "mp3decode_index_load: failed to start the index scan\n");
+        free(copy);
+        }
+    pthread_attr_destroy(&attr);
+    }
+
+/* mp3decode_index_save: keep the frame index if it grew during playback */
+static void mp3decode_index_save(struct mp3decode_vars *self)
+    {
+    if (!self->have_index_key)
+        return;
+
+    mp3decode_index_write(&self->index_key, self->mh, self->index_fill);
+    indexcache_key_free(&self->index_key);
+    self->have_index_key = FALSE;
+    }
+
 static void mp3decode_eject(struct xlplayer *xlplayer)
     {
     struct mp3decode_vars *self = xlplayer->dec_data;
@@ -47,12 +164,14 @@ static void mp3decode_eject(struct xlplayer *xlplayer)
         {
         if (xlplayer->src_data.data_out)
             free(xlplayer->src_data.data_out);
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         }
 
     mp3_tag_cleanup(&self->taginfo);
+    mp3decode_index_save(self);
     mpg123_close(self->mh);
     mpg123_delete(self->mh);
+    close(self->fd);
     fclose(self->fp);
     free(self);
     fprintf(stderr, "finished eject\n");
@@ -82,8 +201,8 @@ static void mp3decode_play(struct xlplayer *xlplayer)
                 {
                 xlplayer->src_data.input_frames = 0;
                 xlplayer->src_data.end_of_input = 1;
-                if ((src_error = src_process(xlplayer->src_state, &xlplayer->src_data)))
-                    fprintf(stderr, "mp3decode_play: %s src_process reports - %s\n", xlplayer->playername, src_strerror(src_error));
+                if ((src_error = resampler_process(xlplayer->src_state, &xlplayer->src_data)))
+                    fprintf(stderr, "mp3decode_play: %s resampler_process reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
                 
                 xlplayer_demux_channel_data(xlplayer, xlplayer->src_data.data_out, xlplayer->src_data.output_frames_gen, 2, 1.f);
                 xlplayer_write_channel_data(xlplayer);
@@ -111,9 +230,9 @@ static void mp3decode_play(struct xlplayer *xlplayer)
                     xlplayer->src_data.data_in = fppcm;
                     xlplayer->src_data.input_frames = samples;
 
-                    if ((src_error = src_process(xlplayer->src_state, &xlplayer->src_data)))
+                    if ((src_error = resampler_process(xlplayer->src_state, &xlplayer->src_data)))
                         {
-                        fprintf(stderr, "mp3decode_play: %s src_process reports - %s\n", xlplayer->playername, src_strerror(src_error));
+                        fprintf(stderr, "mp3decode_play: %s resampler_process reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
                         break;
                         }
                         
@@ -214,14 +333,26 @@ int mp3decode_reg(struct xlplayer *xlplayer)
     mpg123_format(self->mh, 11025, MPG123_STEREO, MPG123_ENC_FLOAT_32);
     mpg123_format(self->mh, 8000, MPG123_STEREO, MPG123_ENC_FLOAT_32);
 
-    if (!(self->fp = fopen(xlplayer->pathname, "r")))
+    /* the tag reader gets a mapped stream, libmpg123 wants a descriptor */
+    if (!(self->fp = mapfile_fopen(xlplayer->pathname)))
         {
         fprintf(stderr, "mp3decode_reg: failed to open %s\n", xlplayer->pathname);
         goto rej_;
         }
 
     mp3_tag_read(&self->taginfo, self->fp);
-    lseek(fd = fileno(self->fp), 0, SEEK_SET);
+
+    if ((self->fd = fd = open(xlplayer->pathname, O_RDONLY)) < 0)
+        {
+        fprintf(stderr, "mp3decode_reg: failed to open %s\n", xlplayer->pathname);
+        mp3_tag_cleanup(&self->taginfo);
+        fclose(self->fp);
+        goto rej_;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 1 << 20, POSIX_FADV_WILLNEED);
+#endif
 
     if ((rv = mpg123_open_fd(self->mh, fd)) != MPG123_OK)
         {
@@ -239,10 +370,10 @@ int mp3decode_reg(struct xlplayer *xlplayer)
         {
         fprintf(stderr, "mp3decode_reg: configuring resampler\n");
 
-        xlplayer->src_state = src_new(xlplayer->rsqual, channels, &src_error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, channels, &src_error);
         if (src_error)
             {
-            fprintf(stderr, "mp3decode_reg: src_new reports %s\n", src_strerror(src_error));
+            fprintf(stderr, "mp3decode_reg: resampler_new reports %s\n", resampler_strerror(src_error));
             goto rej___;
             }
 
@@ -271,6 +402,8 @@ int mp3decode_reg(struct xlplayer *xlplayer)
         xlplayer_set_dynamic_metadata(xlplayer, dynamic_metadata_form[chapter->title.encoding], chapter->artist.text, chapter->title.text, chapter->album.text, 0);
         }
 
+    mp3decode_index_load(self, xlplayer->pathname, xlplayer->seek_s > 0);
+
     if (xlplayer->seek_s)
         if (mpg123_seek(self->mh, (off_t)rate * xlplayer->seek_s, SEEK_SET) < 0)
             {
@@ -283,11 +416,12 @@ int mp3decode_reg(struct xlplayer *xlplayer)
     return ACCEPTED;
 
     rej____:
-    xlplayer->src_state = src_delete(xlplayer->src_state);
+    xlplayer->src_state = resampler_delete(xlplayer->src_state);
     rej___:
     mpg123_delete(self->mh);
     rej__:
     mp3_tag_cleanup(&self->taginfo);
+    close(self->fd);
     fclose(self->fp);
     rej_:
     free(self);
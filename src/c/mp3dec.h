@@ -29,14 +29,19 @@
 
 #include "xlplayer.h"
 #include "mp3tagread.h"
+#include "indexcache.h"
 
 struct mp3decode_vars
    {
    FILE *fp;
+   int fd;
    mpg123_handle *mh;
    struct mp3taginfo taginfo;
    struct chapter *current_chapter;
    int resample;
+   int have_index_key;
+   struct indexcache_key index_key;  /* identifies the cached seek index */
+   size_t index_fill;                /* how much of it was already cached */
    };
 
 int mp3decode_reg(struct xlplayer *xlplayer);
@@ -322,15 +322,17 @@ static void decode_tlen(struct mp3taginfo *ti, unsigned char *start)
     fprintf(stderr, "Track length according to TLEN: %dms\n\n", ti->tlen);
     }
 
+/* the only frames of interest, all others are passed over */
+static struct tag_lookup lu[] =
+    {{ "TLEN", decode_tlen },
+     { "CHAP", decode_chap },
+     { NULL, NULL }};
+
 static void decode_id3_frames(struct mp3taginfo *ti, struct id3data *d)
     {
     unsigned char *start, *end;
     unsigned int adv;
     struct tag_lookup *lup;
-    static struct tag_lookup lu[] =
-        {{ "TLEN", decode_tlen },
-         { "CHAP", decode_chap },
-         { NULL, NULL }};
 
     for (start = d->data, end = d->data + d->size; start < end && *start; start += adv)
         {
@@ -346,6 +348,53 @@ static void decode_id3_frames(struct mp3taginfo *ti, struct id3data *d)
         }
     }
 
+/* decode_id3_frames_stream: like decode_id3_frames but reading frame by frame from the file
+ * only the frames in the lookup table are read in full, artwork and the like are seeked past
+ * which makes this unsuitable for tags with unsynchronisation applied to the whole tag
+ */
+static void decode_id3_frames_stream(struct mp3taginfo *ti, FILE *fp, long frames_end)
+    {
+    unsigned char header[10], *frame;
+    long pos, size;
+    struct tag_lookup *lup;
+
+    for (pos = ftell(fp); pos + 10 <= frames_end; pos += 10 + size)
+        {
+        if (fread(header, sizeof header, 1, fp) != 1 || !header[0])
+            return;                       /* reached the padding */
+        if ((size = get_frame_size(header, ti->version)) > frames_end - pos - 10)
+            {
+            fprintf(stderr, "decode_id3_frames_stream: defective frame size discovered in tag\n");
+            mp3_tag_cleanup(ti);
+            return;
+            }
+
+        for (lup = lu; lup->id && memcmp(lup->id, header, 4); lup++);
+        if (!lup->id)
+            {
+            if (fseek(fp, size, SEEK_CUR))
+                return;
+            continue;
+            }
+
+        /* the frame handlers expect the header too */
+        if (!(frame = malloc(10 + size)))
+            {
+            fprintf(stderr, "decode_id3_frames_stream: malloc failure\n");
+            return;
+            }
+        memcpy(frame, header, sizeof header);
+        if (size && fread(frame + 10, size, 1, fp) != 1)
+            {
+            fprintf(stderr, "decode_id3_frames_stream: failed to read frame data\n");
+            free(frame);
+            return;
+            }
+        lup->fn(ti, frame);
+        free(frame);
+        }
+    }
+
 static int id3_tag_read(struct mp3taginfo *ti, FILE *fp, int skip)
     {
     long start = ftell(fp);
@@ -394,6 +443,29 @@ static int id3_tag_read(struct mp3taginfo *ti, FILE *fp, int skip)
                 return TRUE;
             }
 
+        /* without whole tag unsynchronisation the frames are read selectively */
+        if (ti->version == 4 || !(flags & 0x80))
+            {
+            if (ti->version == 3 && (flags & 0x40))
+                {
+                unsigned char ehsize_be[4];
+
+                if (fread(ehsize_be, sizeof ehsize_be, 1, fp) != 1 ||
+                            (ehsize = bigendianint(ehsize_be)) < 4 || ehsize > frames_end - ftell(fp) + 4)
+                    {
+                    fprintf(stderr, "read_id3_tag: error, tag size not large enough for extended header\n");
+                    fseek(fp, start + 10 + tagsize, SEEK_SET);
+                    return TRUE;
+                    }
+                fseek(fp, ehsize - 4, SEEK_CUR);
+                }
+            decode_id3_frames_stream(ti, fp, frames_end);
+            fseek(fp, frames_end, SEEK_SET);
+            if (flags & 0x10)             /* skip over the footer if present */
+                fseek(fp, 10, SEEK_CUR);
+            return TRUE;
+            }
+
         if ((id.data = malloc(id.size = frames_end - ftell(fp))) == NULL || (!fread(id.data, id.size, 1, fp)))
             {
             fprintf(stderr, "read_id3_v2_tag: failed to read tag data\n");
@@ -446,6 +518,17 @@ static int be32bitread(FILE *fp)
     return rv;
     }
 
+/* layer III frame header lookups shared by the Xing reader and the frame scanner */
+static const int side_info_table[2][2] = { { 17, 9 } , { 32, 17 } };
+static const int bitrate_table[2][15] = {
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 } };
+static const int samplerate_table[4][4] = {
+    { 11025, 12000,  8000, 0 },
+    { 0,         0,     0, 0 },
+    { 22050, 24000, 16000, 0 },
+    { 44100, 48000, 32000, 0 } };
+
 static void xing_tag_read(struct mp3taginfo *ti, FILE *fp)
     {
     unsigned char a, b, c;
@@ -456,15 +539,6 @@ static void xing_tag_read(struct mp3taginfo *ti, FILE *fp)
     int flags, b1, b2, b3;
     char xing_intro[4];
     char lame_intro[4];
-    static int side_info_table[2][2] = { { 17, 9 } , { 32, 17 } };
-    static int bitrate_table[2][15] = {
-        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
-        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 } };
-    static int samplerate_table[4][4] = {
-        { 11025, 12000,  8000, 0 },
-        { 0,         0,     0, 0 },
-        { 22050, 24000, 16000, 0 },
-        { 44100, 48000, 32000, 0 } };
     
     initial_offset = ftell(fp);
 
@@ -497,6 +571,9 @@ static void xing_tag_read(struct mp3taginfo *ti, FILE *fp)
                 frame_length = 0;
             else
                 frame_length = samples_per_frame / 8 * bit_rate * 1000 / sample_rate + padding;
+            ti->sample_rate = sample_rate;
+            ti->samples_per_frame = samples_per_frame;
+            ti->bit_rate = bit_rate;
  
             while (xing_offset--)  /* check side info is 100% blank */
                 if (fgetc(fp) || feof(fp) || ferror(fp))
@@ -585,6 +662,53 @@ static void xing_tag_read(struct mp3taginfo *ti, FILE *fp)
     fseek(fp, initial_offset, SEEK_SET);
     }
 
+/* mp3_scan_duration: the exact playing time found by walking every frame header from the current position
+ * a Xing or Info frame met first holds no audio and the encoder delay and padding from the LAME tag are taken off
+ * returns FALSE when no frames were found
+ */
+int mp3_scan_duration(FILE *fp, const struct mp3taginfo *ti, double *duration)
+    {
+    unsigned char h[4];
+    char intro[4];
+    int mpeg_ix, mpeg1_f, bit_rate, sample_rate = 0, frame_length, first_f = TRUE;
+    long samples = 0, pos;
+
+    while (fread(h, 4, 1, fp) == 1)
+        {
+        if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0 || (h[1] & 0x6) != 0x2 ||
+                    (mpeg_ix = (h[1] & 0x18) >> 3) == 1 || (h[2] >> 4) == 0xF)
+            {
+            /* lost sync so look for it one byte further on */
+            fseek(fp, -3, SEEK_CUR);
+            continue;
+            }
+        mpeg1_f = mpeg_ix == 0x3;
+        bit_rate = bitrate_table[mpeg1_f][h[2] >> 4];
+        if (!bit_rate || !(sample_rate = samplerate_table[mpeg_ix][(h[2] >> 2) & 0x3]))
+            break;              /* free format can't be walked */
+        frame_length = (mpeg1_f ? 1152 : 576) / 8 * bit_rate * 1000 / sample_rate + ((h[2] & 0x2) ? 1 : 0);
+        if (first_f)
+            {
+            first_f = FALSE;
+            pos = ftell(fp);
+            if (!fseek(fp, side_info_table[mpeg1_f][(h[3] & 0xC0) == 0xC0], SEEK_CUR) && fread(intro, 4, 1, fp) == 1
+                        && (!memcmp(intro, "Xing", 4) || !memcmp(intro, "Info", 4)))
+                samples -= mpeg1_f ? 1152 : 576;
+            fseek(fp, pos, SEEK_SET);
+            }
+        samples += mpeg1_f ? 1152 : 576;
+        if (fseek(fp, frame_length - 4, SEEK_CUR))
+            break;
+        }
+
+    if (samples <= 0 || !sample_rate)
+        return FALSE;
+    if ((samples -= ti->start_frames_drop + ti->end_frames_drop) < 0)
+        samples = 0;
+    *duration = (double)samples / sample_rate;
+    return TRUE;
+    }
+
 /********************************************************************************/
 
 void mp3_tag_read(struct mp3taginfo *ti, FILE *fp)
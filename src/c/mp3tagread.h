@@ -67,6 +67,10 @@ struct mp3taginfo
     int first_byte;
     int start_frames_drop;
     int end_frames_drop;
+    /* from the first frame header */
+    int sample_rate;
+    int samples_per_frame;
+    int bit_rate;
     };
 
 struct tag_lookup
@@ -78,5 +82,6 @@ struct tag_lookup
 void mp3_tag_read(struct mp3taginfo *ti, FILE *fp);
 void mp3_tag_cleanup(struct mp3taginfo *ti);
 struct chapter *mp3_tag_chapter_scan(struct mp3taginfo *ti, unsigned time_ms);
+int mp3_scan_duration(FILE *fp, const struct mp3taginfo *ti, double *duration);
 
 #endif /* MP3TAGREAD_H */
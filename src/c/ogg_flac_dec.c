@@ -45,7 +45,7 @@ static void ogg_flacdec_cleanup(struct xlplayer *xlplayer)
             free((void *)xlplayer->src_data.data_in);
         if (xlplayer->src_data.data_out)
             free((void *)xlplayer->src_data.data_out);
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         }
 
     FLAC__stream_decoder_delete(self->dec);
@@ -73,7 +73,7 @@ ogg_flacdec_write_resample_callback(const FLAC__StreamDecoder *dec, const FLAC__
             }
         else
             {
-            if (frame->header.number.sample_number + frame->header.blocksize == od->final_granulepos[od->ix])
+            if (frame->header.number.sample_number + frame->header.blocksize == od->stream[od->ix].final_granulepos)
                 src_data->end_of_input = TRUE;
             }
 
@@ -83,9 +83,9 @@ ogg_flacdec_write_resample_callback(const FLAC__StreamDecoder *dec, const FLAC__
         src_data->data_out = realloc(src_data->data_out, src_data->output_frames * frame->header.channels * sizeof (float));
         make_flac_audio_to_float(xlplayer, (float *)src_data->data_in, inputbuffer, frame->header.blocksize, frame->header.bits_per_sample, frame->header.channels);
 
-        if ((src_error = src_process(xlplayer->src_state, src_data)))
+        if ((src_error = resampler_process(xlplayer->src_state, src_data)))
             {
-            fprintf(stderr, "flac_writer_callback: src_process reports %s\n", src_strerror(src_error));
+            fprintf(stderr, "flac_writer_callback: resampler_process reports %s\n", resampler_strerror(src_error));
             return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
             }
 
@@ -154,7 +154,7 @@ int ogg_flacdec_init(struct xlplayer *xlplayer)
         return REJECTED;
         }
 
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    fseeko(od->fp, od->stream[od->ix].bos_offset, SEEK_SET);
 
     if (!(self->dec = FLAC__stream_decoder_new()))
         {
@@ -162,7 +162,7 @@ int ogg_flacdec_init(struct xlplayer *xlplayer)
         return REJECTED;
         }
 
-    if (od->samplerate[od->ix] != xlplayer->samplerate)
+    if (od->stream[od->ix].samplerate != xlplayer->samplerate)
         {
         self->resample = TRUE;
 
@@ -192,24 +192,24 @@ int ogg_flacdec_init(struct xlplayer *xlplayer)
         {
         fprintf(stderr, "ogg_flacdec_init: configuring resampler\n");
 
-        xlplayer->src_state = src_new(xlplayer->rsqual, (od->channels[od->ix] > 1) ? 2 : 1, &src_error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, (od->stream[od->ix].channels > 1) ? 2 : 1, &src_error);
         if (src_error)
             {
-            fprintf(stderr, "ogg_flacdec_init: src_new reports %s\n", src_strerror(src_error));
+            fprintf(stderr, "ogg_flacdec_init: resampler_new reports %s\n", resampler_strerror(src_error));
             FLAC__stream_decoder_delete(self->dec);
             return REJECTED;
             }
             
         xlplayer->src_data.output_frames = 0;
         xlplayer->src_data.data_in = xlplayer->src_data.data_out = NULL;
-        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double) od->samplerate[od->ix];
+        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double) od->stream[od->ix].samplerate;
         xlplayer->src_data.end_of_input = 0;
         }
 
     if (!(FLAC__stream_decoder_process_until_end_of_metadata(self->dec)))
         {
         if (self->resample)
-            src_delete(xlplayer->src_state);
+            resampler_delete(xlplayer->src_state);
         FLAC__stream_decoder_delete(self->dec);
         return REJECTED;
         }
@@ -221,7 +221,7 @@ int ogg_flacdec_init(struct xlplayer *xlplayer)
     if (od->seek_s)
         {
         self->suppress_audio_output = TRUE;
-        if (!(FLAC__stream_decoder_seek_absolute(self->dec, (FLAC__uint64)od->seek_s * od->samplerate[od->ix])))
+        if (!(FLAC__stream_decoder_seek_absolute(self->dec, (FLAC__uint64)od->seek_s * od->stream[od->ix].samplerate)))
             fprintf(stderr, "ogg_flacdec_init: seek failed\n");
         self->suppress_audio_output = FALSE;
         }
@@ -48,7 +48,7 @@ static void ogg_opusdec_cleanup(struct xlplayer *xlplayer)
 
     fprintf(stderr, "ogg_opusdec_cleanup was called\n");
     if (self->resample)
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         
     free(self);
     /* prevent double free or continued codec use */
@@ -156,17 +156,17 @@ static void ogg_opusdec_play(struct xlplayer *xlplayer)
             {
             xlplayer->src_data.input_frames = samples;
             xlplayer->src_data.end_of_input = od->op.e_o_s;
-            if ((error = src_process(xlplayer->src_state, &xlplayer->src_data)))
+            if ((error = resampler_process(xlplayer->src_state, &xlplayer->src_data)))
                 {
-                fprintf(stderr, "ogg_opusdec_play: %s src_process reports - %s\n", xlplayer->playername, src_strerror(error));
+                fprintf(stderr, "ogg_opusdec_play: %s resampler_process reports - %s\n", xlplayer->playername, resampler_strerror(error));
                 oggdecode_playnext(xlplayer);
                 return;
                 }
 
-            xlplayer_demux_channel_data(xlplayer, xlplayer->src_data.data_out, xlplayer->src_data.output_frames_gen, od->channels[od->ix], self->opgain);
+            xlplayer_demux_channel_data(xlplayer, xlplayer->src_data.data_out, xlplayer->src_data.output_frames_gen, od->stream[od->ix].channels, self->opgain);
             }
         else
-            xlplayer_demux_channel_data(xlplayer, self->down, samples, od->channels[od->ix], self->opgain);
+            xlplayer_demux_channel_data(xlplayer, self->down, samples, od->stream[od->ix].channels, self->opgain);
             
         xlplayer_write_channel_data(xlplayer);
         }
@@ -185,12 +185,12 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
     unsigned char *pkt;
     float opgain_db;
     int error;
-    size_t down_siz = MAX_FRAME_SIZE * sizeof (float) * od->channels[od->ix];
+    size_t down_siz = MAX_FRAME_SIZE * sizeof (float) * od->stream[od->ix].channels;
         
     fprintf(stderr, "ogg_opusdec_init was called\n");
 
-    ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    ogg_stream_reset_serialno(&od->os, od->stream[od->ix].serial);
+    fseeko(od->fp, od->stream[od->ix].bos_offset, SEEK_SET);
     ogg_sync_reset(&od->oy);
 
     /* sanity checking was pre-done in opus_get_samplerate() */
@@ -240,7 +240,7 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
 
     if (od->seek_s)
         {
-        if (od->seek_s > (od->duration[od->ix] - 0.5))
+        if (od->seek_s > (od->stream[od->ix].duration - 0.5))
             {
             fprintf(stderr, "ogg_opusdec_init: seeked stream virtually over - skipping\n");
             goto cleanup2;
@@ -249,7 +249,7 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
         oggdecode_seek_to_packet(od);
         }
     else
-        self->gf_gp = self->f_gp = self->gp = od->initial_granulepos[od->ix];
+        self->gf_gp = self->f_gp = self->gp = od->stream[od->ix].initial_granulepos;
 
     if (!(self->odms = opus_multistream_decoder_create(48000, self->channel_count,
                     self->stream_count, self->stream_count_2c, self->channel_map, &error)))
@@ -264,7 +264,7 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
         goto cleanup3;
         }
 
-    if ((self->do_down = od->channels[od->ix] != self->channel_count))
+    if ((self->do_down = od->stream[od->ix].channels != self->channel_count))
         {
         if (!(self->down = malloc(down_siz)))
             {
@@ -275,25 +275,25 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
     else
         self->down = self->pcm;     /* no need to downmix for mono/stereo */
 
-    if (od->samplerate[od->ix] != xlplayer->samplerate)
+    if (od->stream[od->ix].samplerate != xlplayer->samplerate)
         {
         fprintf(stderr, "ogg_opusdec_init: configuring resampler\n");
         self->resample = TRUE;
-        xlplayer->src_state = src_new(xlplayer->rsqual, od->channels[od->ix], &error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, od->stream[od->ix].channels, &error);
         if (error)
             {
-            fprintf(stderr, "ogg_opusdec_init: src_new reports %s\n", src_strerror(error));
+            fprintf(stderr, "ogg_opusdec_init: resampler_new reports %s\n", resampler_strerror(error));
             goto cleanup5;
             }
 
         xlplayer->src_data.data_in = self->down;
-        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->samplerate[od->ix];
+        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->stream[od->ix].samplerate;
         xlplayer->src_data.end_of_input = 0;
         
         size_t opframes = MAX_FRAME_SIZE * xlplayer->src_data.src_ratio + 4096;
         
         xlplayer->src_data.output_frames = opframes;
-        if (!(xlplayer->src_data.data_out = malloc(opframes * sizeof (float) * od->channels[od->ix])))
+        if (!(xlplayer->src_data.data_out = malloc(opframes * sizeof (float) * od->stream[od->ix].channels)))
             {
             fprintf(stderr, "ogg_opusdec_init: malloc failure -- data_out\n");
             goto cleanup6;
@@ -308,7 +308,7 @@ int ogg_opusdec_init(struct xlplayer *xlplayer)
 
     cleanup6:
         if (self->resample)
-            xlplayer->src_state = src_delete(xlplayer->src_state);
+            xlplayer->src_state = resampler_delete(xlplayer->src_state);
     cleanup5:
         if (self->do_down)
             free(self->down);
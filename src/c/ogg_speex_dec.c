@@ -40,7 +40,7 @@ static void ogg_speexdec_cleanup(struct xlplayer *xlplayer)
     
     fprintf(stderr, "ogg_speexdec_cleanup was called\n");
     oggdecode_remove_new_oggpage_callback(od);
-    src_delete(xlplayer->src_state);
+    resampler_delete(xlplayer->src_state);
     free(self->frame);
     free(xlplayer->src_data.data_out);
     speex_bits_destroy(&self->bits);
@@ -131,9 +131,9 @@ static void ogg_speexdec_play(struct xlplayer *xlplayer)
                             xlplayer->src_data.data_in = self->frame + frame_offset * self->channels;
                             xlplayer->src_data.input_frames = new_frame_size;
     
-                            if ((src_error = src_process(xlplayer->src_state, &xlplayer->src_data)))
+                            if ((src_error = resampler_process(xlplayer->src_state, &xlplayer->src_data)))
                                 {
-                                fprintf(stderr, "ogg_speexdec_play: %s src_process reports - %s\n", xlplayer->playername, src_strerror(src_error));
+                                fprintf(stderr, "ogg_speexdec_play: %s resampler_process reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
                                 oggdecode_playnext(xlplayer);
                                 return;
                                 }
@@ -191,8 +191,8 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
         goto cleanup3;
         }
 
-    ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    ogg_stream_reset_serialno(&od->os, od->stream[od->ix].serial);
+    fseeko(od->fp, od->stream[od->ix].bos_offset, SEEK_SET);
     ogg_sync_reset(&od->oy);
 
     if (!(oggdec_get_next_packet(od) && ogg_stream_packetout(&od->os, &od->op) == 0 && (self->header = speex_packet_to_header((char *)od->op.packet, od->op.bytes))))
@@ -272,17 +272,17 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
             goto cleanupA;
             }
 
-    xlplayer->src_state = src_new(xlplayer->rsqual, self->header->nb_channels, &src_error);
+    xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, self->header->nb_channels, &src_error);
     if (src_error)
         {
-        fprintf(stderr, "ogg_speexdec_init: src_new reports %s\n", src_strerror(src_error));
+        fprintf(stderr, "ogg_speexdec_init: resampler_new reports %s\n", resampler_strerror(src_error));
         goto cleanupA;
         }
         
     xlplayer->src_data.end_of_input = 0;
     xlplayer->src_data.input_frames = self->frame_size;
     xlplayer->src_data.data_in = self->frame;
-    xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->samplerate[od->ix];
+    xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->stream[od->ix].samplerate;
     xlplayer->src_data.output_frames = self->frame_size * self->header->nb_channels * xlplayer->src_data.src_ratio + 512;
     if (!(xlplayer->src_data.data_out = malloc(xlplayer->src_data.output_frames * sizeof (float))))
         {
@@ -295,7 +295,7 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
     if (od->seek_s)
         {
         /* seeked streams with less than 0.1 seconds left to be skipped */
-        if (od->seek_s > (od->duration[od->ix] - 0.5))
+        if (od->seek_s > (od->stream[od->ix].duration - 0.5))
             {
             fprintf(stderr, "ogg_speexdec_init: seeked stream virtually over - skipping\n");
             goto cleanupB;
@@ -304,7 +304,7 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
         oggdecode_seek_to_packet(od);
 
         /* calculate how many samples we need to drop for accurate seeking */
-        t_granule = od->seek_s * od->samplerate[od->ix];
+        t_granule = od->seek_s * od->stream[od->ix].samplerate;
         e_granule = ogg_page_granulepos(&od->og);
         p_granule = self->frame_size * self->nframes;
         if ((s_granule = e_granule - (ogg_page_packets(&od->og) - ogg_page_continued(&od->og)) * p_granule) < 0)
@@ -322,7 +322,7 @@ int ogg_speexdec_init(struct xlplayer *xlplayer)
     return ACCEPTED;
 
     cleanupB:
-        src_delete(xlplayer->src_state);
+        resampler_delete(xlplayer->src_state);
     cleanupA:
         free(self->frame);
     cleanup0:
@@ -23,6 +23,7 @@
 
 #include "oggdec.h"
 #include "ogg_vorbis_dec.h"
+#include "peaks.h"
 
 #define ACCEPTED 1
 #define REJECTED 0
@@ -41,7 +42,7 @@ static void ogg_vorbisdec_cleanup(struct xlplayer *xlplayer)
             free((void *)xlplayer->src_data.data_in);
         if (xlplayer->src_data.data_out)
             free(xlplayer->src_data.data_out);
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         }
         
     vorbis_block_clear(&self->vb);
@@ -60,9 +61,9 @@ static void ogg_vorbisdec_play(struct xlplayer *xlplayer)
     struct vorbisdec_vars *self = od->dec_data;
     int samples, i, wi = 0;
     size_t bsiz = 8192, block = 4096, bytes = 0;
-    float **pcm, *li, *lo, *ri, *ro, *out, gain;
+    float **pcm, *li, *lo, *ri, *ro, *out, *g;
     int vorbis_retcode, src_error;
-    int channels = (od->channels[od->ix] > 1) ? 2 : 1;
+    int channels = (od->stream[od->ix].channels > 1) ? 2 : 1;
 
     if (!(oggdec_get_next_packet(od)))
         {
@@ -112,9 +113,9 @@ static void ogg_vorbisdec_play(struct xlplayer *xlplayer)
         xlplayer->src_data.data_out = realloc(xlplayer->src_data.data_out, xlplayer->src_data.output_frames * channels * sizeof (float));
         xlplayer->src_data.end_of_input = od->op.e_o_s;
         
-        if ((src_error = src_process(xlplayer->src_state, &xlplayer->src_data)))
+        if ((src_error = resampler_process(xlplayer->src_state, &xlplayer->src_data)))
             {
-            fprintf(stderr, "ogg_vorbisdec_play: %s src_process reports - %s\n", xlplayer->playername, src_strerror(src_error));
+            fprintf(stderr, "ogg_vorbisdec_play: %s resampler_process reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
             oggdecode_playnext(xlplayer);
             return;
             }
@@ -123,8 +124,9 @@ static void ogg_vorbisdec_play(struct xlplayer *xlplayer)
         }
     else
         {
-        xlplayer->leftbuffer = lo = realloc(xlplayer->leftbuffer, bsiz);
-        xlplayer->rightbuffer = ro = realloc(xlplayer->rightbuffer, bsiz);
+        xlplayer_reserve_output(xlplayer, bsiz / sizeof (float));
+        lo = xlplayer->leftbuffer;
+        ro = xlplayer->rightbuffer;
     
         while ((samples = vorbis_synthesis_pcmout(&self->v, &pcm)) > 0)
             {
@@ -132,22 +134,24 @@ static void ogg_vorbisdec_play(struct xlplayer *xlplayer)
             if (bytes > bsiz)
                 {
                 bsiz += ((bytes - bsiz) / block + 1) * block;
-                xlplayer->leftbuffer = realloc(xlplayer->leftbuffer, bsiz);
+                xlplayer_reserve_output(xlplayer, bsiz / sizeof (float));
                 lo = xlplayer->leftbuffer + wi;
-                xlplayer->rightbuffer = realloc(xlplayer->rightbuffer, bsiz);
                 ro = xlplayer->rightbuffer + wi;
                 }
                 
             li = pcm[0];
-            if (od->channels[od->ix] > 1)
+            if (od->stream[od->ix].channels > 1)
                 ri = pcm[1];
             else
                 ri = pcm[0];
+            if (xlplayer->peaks_capture)
+                peaks_capture_append(xlplayer->peaks_capture, li, ri, samples);
+            g = xlplayer->gainbuffer + wi;
+            xlplayer_get_gain_block(xlplayer, g, samples, 1.0f);
             for (i = 0; i < samples; i++)
                 {
-                gain = xlplayer_get_next_gain(xlplayer);
-                *lo++ = *li++ * gain;
-                *ro++ = *ri++ * gain;
+                *lo++ = *li++ * g[i];
+                *ro++ = *ri++ * g[i];
                 }
     
             wi += samples;
@@ -155,7 +159,7 @@ static void ogg_vorbisdec_play(struct xlplayer *xlplayer)
             }
     
         xlplayer->op_buffersize = bytes;
-        if (od->channels[od->ix] == 1)
+        if (od->stream[od->ix].channels == 1)
             memcpy(xlplayer->rightbuffer, xlplayer->leftbuffer, bytes);
         }
         
@@ -180,8 +184,8 @@ int ogg_vorbisdec_init(struct xlplayer *xlplayer)
         return REJECTED;
         }
 
-    ogg_stream_reset_serialno(&od->os, od->serial[od->ix]);
-    fseeko(od->fp, od->bos_offset[od->ix], SEEK_SET);
+    ogg_stream_reset_serialno(&od->os, od->stream[od->ix].serial);
+    fseeko(od->fp, od->stream[od->ix].bos_offset, SEEK_SET);
     ogg_sync_reset(&od->oy);
     
     vorbis_info_init(&self->vi);
@@ -211,7 +215,7 @@ int ogg_vorbisdec_init(struct xlplayer *xlplayer)
     if (od->seek_s)
         {
         /* seeked streams with less than 0.1 seconds left to be skipped */
-        if (od->seek_s > (od->duration[od->ix] - 0.5))
+        if (od->seek_s > (od->stream[od->ix].duration - 0.5))
             {
             fprintf(stderr, "ogg_vorbisdec_init: seeked stream virtually over - skipping\n");
             goto cleanup0;
@@ -220,19 +224,19 @@ int ogg_vorbisdec_init(struct xlplayer *xlplayer)
         oggdecode_seek_to_packet(od);
         }
 
-    if (od->samplerate[od->ix] != xlplayer->samplerate)
+    if (od->stream[od->ix].samplerate != xlplayer->samplerate)
         {
         fprintf(stderr, "ogg_vorbisdec_init: configuring resampler\n");
-        xlplayer->src_state = src_new(xlplayer->rsqual, (od->channels[od->ix] > 1) ? 2 : 1, &src_error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, (od->stream[od->ix].channels > 1) ? 2 : 1, &src_error);
         if (src_error)
             {
-            fprintf(stderr, "ogg_vorbisdec_init: src_new reports %s\n", src_strerror(src_error));
+            fprintf(stderr, "ogg_vorbisdec_init: resampler_new reports %s\n", resampler_strerror(src_error));
             goto cleanup0;
             }
 
         xlplayer->src_data.output_frames = 0;
         xlplayer->src_data.data_in = xlplayer->src_data.data_out = NULL;
-        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->samplerate[od->ix];
+        xlplayer->src_data.src_ratio = (double)xlplayer->samplerate / (double)od->stream[od->ix].samplerate;
         xlplayer->src_data.end_of_input = 0;
         self->resample = TRUE;
         }
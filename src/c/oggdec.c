@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "xlplayer.h"
 #include "oggdec.h"
@@ -30,6 +32,8 @@
 #include "ogg_flac_dec.h"
 #include "ogg_speex_dec.h"
 #include "vorbistagparse.h"
+#include "mapfile.h"
+#include "sig.h"
 
 #define ACCEPTED 1
 #define REJECTED 0
@@ -134,31 +138,31 @@ static unsigned vorbis_get_samplerate(struct oggdec_vars *self)  /* attempt to g
          self->op.granulepos == 0 && ogg_stream_packetout(&self->os, &self->op) == 0  &&
          oggdec_get_next_packet(self) && ogg_page_continued(&self->og) == 0)
         {
-        samplerate = self->samplerate[self->ix] = vi.rate;
-        self->channels[self->ix] = vi.channels;
+        samplerate = self->stream[self->ix].samplerate = vi.rate;
+        self->stream[self->ix].channels = vi.channels;
         
         if (vorbis_comment_query_count(&vc, "trk-title"))
             {
-            obtain_tag_info("trk-artist", &self->artist[self->ix], TRUE);
-            obtain_tag_info("trk-title", &self->title[self->ix], TRUE);
-            obtain_tag_info("trk-album", &self->album[self->ix], TRUE);
+            obtain_tag_info("trk-artist", &self->stream[self->ix].artist, TRUE);
+            obtain_tag_info("trk-title", &self->stream[self->ix].title, TRUE);
+            obtain_tag_info("trk-album", &self->stream[self->ix].album, TRUE);
             }
         else
             {
-            obtain_tag_info("artist", &self->artist[self->ix], TRUE);
-            obtain_tag_info("title", &self->title[self->ix], TRUE);
-            obtain_tag_info("album", &self->album[self->ix], TRUE);
+            obtain_tag_info("artist", &self->stream[self->ix].artist, TRUE);
+            obtain_tag_info("title", &self->stream[self->ix].title, TRUE);
+            obtain_tag_info("album", &self->stream[self->ix].album, TRUE);
             }
       
-        obtain_tag_info("replaygain_track_gain", &self->replaygain[self->ix], FALSE);
-        obtain_tag_info("replaygain_reference_loudness", &self->rgloudness[self->ix], FALSE);
+        obtain_tag_info("replaygain_track_gain", &self->stream[self->ix].replaygain, FALSE);
+        obtain_tag_info("replaygain_reference_loudness", &self->stream[self->ix].rgloudness, FALSE);
 
         }
     else
         {
         fprintf(stderr, "vorbis_get_samplerate: non standard ogg/vorbis header found\n");
         samplerate = 0;
-        self->channels[self->ix] = 0;
+        self->stream[self->ix].channels = 0;
         }
     
     vorbis_comment_clear(&vc);
@@ -177,7 +181,7 @@ FLAC__StreamDecoderReadStatus oggflac_read_callback(const FLAC__StreamDecoder *d
     if (self->ix == self->n_streams - 1)
         bytes_remaining = self->eos_offset - ftello(self->fp);
     else
-        bytes_remaining = self->bos_offset[self->ix + 1] - ftello(self->fp);
+        bytes_remaining = self->stream[self->ix + 1].bos_offset - ftello(self->fp);
 
     if (bytes_remaining < 0 || *bytes <= 0)
         return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
@@ -201,12 +205,12 @@ FLAC__StreamDecoderSeekStatus oggflac_seek_callback(const FLAC__StreamDecoder *d
     struct oggdec_vars *self = client_data;
     off_t start_bound, end_bound;
 
-    start_bound = self->bos_offset[self->ix];
+    start_bound = self->stream[self->ix].bos_offset;
     
     if (self->ix == self->n_streams - 1)
         end_bound = self->eos_offset - start_bound;
     else
-        end_bound = self->bos_offset[self->ix + 1] - start_bound;
+        end_bound = self->stream[self->ix + 1].bos_offset - start_bound;
 
     if (absolute_byte_offset > (FLAC__uint64)(end_bound - start_bound))
         {
@@ -230,12 +234,12 @@ FLAC__StreamDecoderTellStatus oggflac_tell_callback(const FLAC__StreamDecoder *d
     
     where = ftello(self->fp);
     
-    if (where < self->bos_offset[self->ix])
+    if (where < self->stream[self->ix].bos_offset)
         return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
     
     if (self->ix != self->n_streams - 1)
         {
-        if (where > self->bos_offset[self->ix + 1])
+        if (where > self->stream[self->ix + 1].bos_offset)
             return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
         }
     else
@@ -244,7 +248,7 @@ FLAC__StreamDecoderTellStatus oggflac_tell_callback(const FLAC__StreamDecoder *d
             return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
         }
     
-    *absolute_byte_offset = (FLAC__uint64)(where - self->bos_offset[self->ix]);
+    *absolute_byte_offset = (FLAC__uint64)(where - self->stream[self->ix].bos_offset);
     return FLAC__STREAM_DECODER_TELL_STATUS_OK;
     }
 
@@ -253,9 +257,9 @@ FLAC__StreamDecoderLengthStatus oggflac_length_callback(const FLAC__StreamDecode
     struct oggdec_vars *self = client_data;
     
     if (self->ix == self->n_streams - 1)
-        *stream_length = self->eos_offset - self->bos_offset[self->ix];
+        *stream_length = self->eos_offset - self->stream[self->ix].bos_offset;
     else
-        *stream_length = self->bos_offset[self->ix + 1] - self->bos_offset[self->ix];
+        *stream_length = self->stream[self->ix + 1].bos_offset - self->stream[self->ix].bos_offset;
         
     return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
     }
@@ -265,11 +269,11 @@ FLAC__bool oggflac_eof_callback(const FLAC__StreamDecoder *decoder, void *client
     struct oggdec_vars *self = client_data;
     off_t offset;
 
-    offset = ftello(self->fp) + self->bos_offset[self->ix];
+    offset = ftello(self->fp) + self->stream[self->ix].bos_offset;
     if (self->ix == self->n_streams - 1)
         return offset >= self->eos_offset;
     else
-        return offset >= self->bos_offset[self->ix + 1];
+        return offset >= self->stream[self->ix + 1].bos_offset;
     }
 
 static void oggflac_metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
@@ -297,26 +301,49 @@ static void oggflac_metadata_callback(const FLAC__StreamDecoder *decoder, const
         return t;
         }
 
+    /* the values point into the comment block so only the result is allocated */
     void copy_tag(char *t, char **target, int multiple)
         {
-        char *old, *new;
-        
+        char *value, *last = NULL, *joined, *p;
+        size_t size = (*target) ? strlen(*target) + 1 : 1;
+
         for (unsigned j = 0; j < vc->num_comments; j++)
-            {
             if (match(t, (char *)vc->comments[j].entry))
                 {
-                old = strdup(*target);
-                new = end((char *)vc->comments[j].entry);
-                *target = realloc(*target, strlen(old) + strlen(new) + 2);
-                if (old[0] && multiple)
-                    sprintf(*target, "%s/%s", old, new);
-                else
-                    strcpy(*target, new);
-                free(old);
+                last = end((char *)vc->comments[j].entry);
+                size += strlen(last) + 1;
                 }
+        if (!last)
+            {
+            if (*target == NULL)
+                *target = strdup("");
+            return;
             }
-        if (*target == NULL)
-            *target = strdup("");
+        if (!multiple)
+            {
+            free(*target);
+            *target = strdup(last);
+            return;
+            }
+
+        if (!(p = joined = malloc(size)))
+            {
+            fprintf(stderr, "oggflac_metadata_callback: malloc failure\n");
+            return;
+            }
+        *p = '\0';
+        if (*target)
+            p = stpcpy(p, *target);
+        for (unsigned j = 0; j < vc->num_comments; j++)
+            if (match(t, (char *)vc->comments[j].entry))
+                {
+                value = end((char *)vc->comments[j].entry);
+                if (p != joined)
+                    *p++ = '/';
+                p = stpcpy(p, value);
+                }
+        free(*target);
+        *target = joined;
         }
     
     if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
@@ -325,8 +352,8 @@ static void oggflac_metadata_callback(const FLAC__StreamDecoder *decoder, const
         si = &metadata->data.stream_info;
         fprintf(stderr, "Sample rate in comment block is %u\n", si->sample_rate);
         fprintf(stderr, "Number of channels in comment block is %u\n", si->channels);
-        self->samplerate[self->ix] = si->sample_rate;
-        self->channels[self->ix] = si->channels;
+        self->stream[self->ix].samplerate = si->sample_rate;
+        self->stream[self->ix].channels = si->channels;
         }
     else
         if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
@@ -344,18 +371,18 @@ static void oggflac_metadata_callback(const FLAC__StreamDecoder *decoder, const
 
             if (use_alt_tags)
                 {
-                copy_tag("trk-artist=", &self->artist[self->ix], TRUE);
-                copy_tag("trk-title=", &self->title[self->ix], TRUE);
-                copy_tag("trk-album=", &self->album[self->ix], TRUE);
+                copy_tag("trk-artist=", &self->stream[self->ix].artist, TRUE);
+                copy_tag("trk-title=", &self->stream[self->ix].title, TRUE);
+                copy_tag("trk-album=", &self->stream[self->ix].album, TRUE);
                 }
             else
                 {
-                copy_tag("artist=", &self->artist[self->ix], TRUE);
-                copy_tag("title=", &self->title[self->ix], TRUE);
-                copy_tag("album=", &self->album[self->ix], TRUE);
+                copy_tag("artist=", &self->stream[self->ix].artist, TRUE);
+                copy_tag("title=", &self->stream[self->ix].title, TRUE);
+                copy_tag("album=", &self->stream[self->ix].album, TRUE);
                 }
-            copy_tag("replaygain_track_gain=", &self->replaygain[self->ix], FALSE);
-            copy_tag("replaygain_reference_loudness=", &self->rgloudness[self->ix], FALSE);
+            copy_tag("replaygain_track_gain=", &self->stream[self->ix].replaygain, FALSE);
+            copy_tag("replaygain_reference_loudness=", &self->stream[self->ix].rgloudness, FALSE);
             }
         else
             fprintf(stderr, "oggflac_metadata_callback: unhandled FLAC metadata type\n");
@@ -412,7 +439,7 @@ static int flac_get_samplerate(struct oggdec_vars *self)
     FLAC__stream_decoder_process_until_end_of_metadata(decoder);
     FLAC__stream_decoder_delete(decoder);
 
-    return self->samplerate[self->ix];
+    return self->stream[self->ix].samplerate;
     }
 #endif /* HAVE_OGGFLAC */
 
@@ -425,32 +452,30 @@ static int speex_get_samplerate(struct oggdec_vars *self)
     /* enforce that the speex header packet be in it's own ogg page */
     if (oggdec_get_next_packet(self) && ogg_stream_packetout(&self->os, &self->op) == 0 && (h = speex_packet_to_header((char *)self->op.packet, self->op.bytes)))
         {
-        switch (self->channels[self->ix] = h->nb_channels)
+        switch (self->stream[self->ix].channels = h->nb_channels)
             {
             case 1:
             case 2:
-                self->samplerate[self->ix] = h->rate;
+                self->stream[self->ix].samplerate = h->rate;
                 speex_header_free(h);
                 if (oggdec_get_next_packet(self) && ogg_stream_packetout(&self->os, &self->op) == 0)
                     {
-                    struct vtag *tag;
+                    struct vtag_view tag;
                     int error;
 
-                    if ((tag = vtag_parse((char *)self->op.packet, self->op.bytes, &error)))
+                    if ((error = vtag_view_init(&tag, self->op.packet, self->op.bytes)) == VE_OK)
                         {
-                        if (!(self->artist[self->ix] = vtag_lookup(tag, "trk-author", VLM_MERGE, "/")))
-                            if (!(self->artist[self->ix] = vtag_lookup(tag, "trk-artist", VLM_MERGE, "/")))
-                                if (!(self->artist[self->ix] = vtag_lookup(tag, "author", VLM_MERGE, "/")))
-                                    if (!(self->artist[self->ix] = vtag_lookup(tag, "artist", VLM_MERGE, "/")))
-                                        self->artist[self->ix] = strdup("");
-                        if (!(self->title[self->ix] = vtag_lookup(tag, "trk-title", VLM_MERGE, "/")))
-                            if (!(self->title[self->ix] = vtag_lookup(tag, "title", VLM_MERGE, "/")))
-                                self->title[self->ix] = strdup("");
-                        if (!(self->album[self->ix] = vtag_lookup(tag, "trk-album", VLM_MERGE, "/")))
-                            if (!(self->album[self->ix] = vtag_lookup(tag, "album", VLM_MERGE, "/")))
-                                self->album[self->ix] = strdup("");
-
-                        vtag_cleanup(tag);
+                        if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "trk-author", VLM_MERGE, "/")))
+                            if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "trk-artist", VLM_MERGE, "/")))
+                                if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "author", VLM_MERGE, "/")))
+                                    if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "artist", VLM_MERGE, "/")))
+                                        self->stream[self->ix].artist = strdup("");
+                        if (!(self->stream[self->ix].title = vtag_view_lookup(&tag, "trk-title", VLM_MERGE, "/")))
+                            if (!(self->stream[self->ix].title = vtag_view_lookup(&tag, "title", VLM_MERGE, "/")))
+                                self->stream[self->ix].title = strdup("");
+                        if (!(self->stream[self->ix].album = vtag_view_lookup(&tag, "trk-album", VLM_MERGE, "/")))
+                            if (!(self->stream[self->ix].album = vtag_view_lookup(&tag, "album", VLM_MERGE, "/")))
+                                self->stream[self->ix].album = strdup("");
                         }
                     else
                         {
@@ -461,7 +486,7 @@ static int speex_get_samplerate(struct oggdec_vars *self)
                 else
                     return 0;
                 
-                return self->samplerate[self->ix];
+                return self->stream[self->ix].samplerate;
             default:
                 speex_header_free(h);
                 fprintf(stderr, "speex_get_samplerate: header indicates an unsupported number of audio channels\n");
@@ -489,7 +514,7 @@ static int opus_get_samplerate(struct oggdec_vars *self)
     #define FAIL(x) do {reason = x; goto fail_point;} while(0)
     #define WARN(x) do {fprintf(stderr, "opus_get_samplerate: warning: %s\n", x);} while (0)
 
-    if ((final_granulepos = self->final_granulepos[self->ix]) == 0)
+    if ((final_granulepos = self->stream[self->ix].final_granulepos) == 0)
         FAIL("stream final packet granule count is zero");
 
     if (oggdec_get_next_packet(self) && ogg_stream_packetout(&self->os, &self->op) == 0)
@@ -509,7 +534,7 @@ static int opus_get_samplerate(struct oggdec_vars *self)
         if ((channels = ((unsigned char *)self->op.packet)[9]) == 0)
             FAIL("number of channels is zero");
         
-        self->channels[self->ix] = (channels == 1) ? 1 : 2;
+        self->stream[self->ix].channels = (channels == 1) ? 1 : 2;
         chanmap = ((unsigned char *)self->op.packet)[18];
 
         if (chanmap > 1)
@@ -559,29 +584,28 @@ static int opus_get_samplerate(struct oggdec_vars *self)
 
             if (self->op.bytes >= 8 && !memcmp(self->op.packet, "OpusTags", 8))
                 {
-                struct vtag *tag;
+                struct vtag_view tag;
                 int error;
 
-                if ((tag = vtag_parse((char *)self->op.packet + 8, self->op.bytes - 8, &error)))
+                if ((error = vtag_view_init(&tag, self->op.packet + 8, self->op.bytes - 8)) == VE_OK)
                     {
-                    if (!(self->artist[self->ix] = vtag_lookup(tag, "trk-author", VLM_MERGE, "/")))
-                        if (!(self->artist[self->ix] = vtag_lookup(tag, "trk-artist", VLM_MERGE, "/")))
-                            if (!(self->artist[self->ix] = vtag_lookup(tag, "author", VLM_MERGE, "/")))
-                                if (!(self->artist[self->ix] = vtag_lookup(tag, "artist", VLM_MERGE, "/")))
-                                    self->artist[self->ix] = strdup("");
-                    if (!(self->title[self->ix] = vtag_lookup(tag, "trk-title", VLM_MERGE, "/")))
-                        if (!(self->title[self->ix] = vtag_lookup(tag, "title", VLM_MERGE, "/")))
-                            self->title[self->ix] = strdup("");
-                    if (!(self->album[self->ix] = vtag_lookup(tag, "trk-album", VLM_MERGE, "/")))
-                        if (!(self->album[self->ix] = vtag_lookup(tag, "album", VLM_MERGE, "/")))
-                            self->album[self->ix] = strdup("");
-
-                    if (!(self->artist || self->title || self->album))
+                    if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "trk-author", VLM_MERGE, "/")))
+                        if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "trk-artist", VLM_MERGE, "/")))
+                            if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "author", VLM_MERGE, "/")))
+                                if (!(self->stream[self->ix].artist = vtag_view_lookup(&tag, "artist", VLM_MERGE, "/")))
+                                    self->stream[self->ix].artist = strdup("");
+                    if (!(self->stream[self->ix].title = vtag_view_lookup(&tag, "trk-title", VLM_MERGE, "/")))
+                        if (!(self->stream[self->ix].title = vtag_view_lookup(&tag, "title", VLM_MERGE, "/")))
+                            self->stream[self->ix].title = strdup("");
+                    if (!(self->stream[self->ix].album = vtag_view_lookup(&tag, "trk-album", VLM_MERGE, "/")))
+                        if (!(self->stream[self->ix].album = vtag_view_lookup(&tag, "album", VLM_MERGE, "/")))
+                            self->stream[self->ix].album = strdup("");
+
+                    if (!(self->stream[self->ix].artist && self->stream[self->ix].title && self->stream[self->ix].album))
                         FAIL("malloc failure");
 
-                    int track_gain_tags = vtag_comment_count(tag, "R128_TRACK_GAIN");
-                    char *track_gain_text = vtag_lookup(tag, "R128_TRACK_GAIN", VLM_FIRST, NULL);
-                    vtag_cleanup(tag);
+                    int track_gain_tags = vtag_view_count(&tag, "R128_TRACK_GAIN");
+                    char *track_gain_text = vtag_view_lookup(&tag, "R128_TRACK_GAIN", VLM_FIRST, NULL);
                     
                     switch (track_gain_tags)
                         {
@@ -645,7 +669,7 @@ static int opus_get_samplerate(struct oggdec_vars *self)
                 if (self->op.granulepos < samples)
                     FAIL("first page granule position less than number of samples, end of stream not set");
 
-                if ((initial_granulepos = self->initial_granulepos[self->ix] = self->op.granulepos - samples))
+                if ((initial_granulepos = self->stream[self->ix].initial_granulepos = self->op.granulepos - samples))
                     {
                     if (preskip >= final_granulepos - initial_granulepos)
                         FAIL("no samples to decode after accounting for initial granulepos");
@@ -672,7 +696,7 @@ static int opus_get_samplerate(struct oggdec_vars *self)
     else
         FAIL("failed to get OpusHead packet");
 
-    return self->samplerate[self->ix] = 48000;  /* Opus always uses this rate */
+    return self->stream[self->ix].samplerate = 48000;  /* Opus always uses this rate */
 
     #undef FAIL
     #undef WARN
@@ -684,6 +708,40 @@ static int opus_get_samplerate(struct oggdec_vars *self)
 
 #endif /* HAVE_OPUS */
 
+/* oggdec_append_stream: make space for data about another logical stream */
+static int oggdec_append_stream(struct oggdec_vars *self, int serial, unsigned final_granulepos)
+    {
+    struct oggdec_stream *st;
+
+    if (self->n_streams == self->streams_size)
+        {
+        if (!(st = realloc(self->stream, (self->streams_size ? self->streams_size * 2 : 4) * sizeof (struct oggdec_stream))))
+            {
+            fprintf(stderr, "oggdec_append_stream: malloc failure\n");
+            return FALSE;
+            }
+        self->stream = st;
+        self->streams_size = self->streams_size ? self->streams_size * 2 : 4;
+        }
+
+    st = self->stream + self->n_streams;
+    memset(st, 0, sizeof (struct oggdec_stream));
+    if (!(st->artist = strdup("")) || !(st->title = strdup("")) || !(st->album = strdup(""))
+                || !(st->replaygain = strdup("")) || !(st->rgloudness = strdup("")))
+        {
+        fprintf(stderr, "oggdec_append_stream: malloc failure\n");
+        free(st->artist);
+        free(st->title);
+        free(st->album);
+        free(st->replaygain);
+        return FALSE;
+        }
+    st->final_granulepos = final_granulepos;
+    st->serial = serial;
+    self->n_streams++;
+    return TRUE;
+    }
+
 /* oggscan_eos: perform a binary search on the ogg file for the e_o_s page
  * and log details of the current logical stream when it is found */
 static off_t oggscan_eos(struct oggdec_vars *self, off_t offset, off_t offset_end, int serial, int depth)
@@ -735,37 +793,8 @@ static off_t oggscan_eos(struct oggdec_vars *self, off_t offset, off_t offset_en
         if (terminate || (eos = ogg_page_eos(&self->og)) || offset + 1 >= offset_end)
             {
             /* we have found the last packet in the logical stream */
-            /* make space for data about this logical stream */
-            self->n_streams++;
-            self->bos_offset = realloc(self->bos_offset, self->n_streams * sizeof (off_t));
-            self->initial_granulepos = realloc(self->initial_granulepos, self->n_streams * sizeof (unsigned));
-            self->final_granulepos = realloc(self->final_granulepos, self->n_streams * sizeof (unsigned));
-            self->samplerate = realloc(self->samplerate, self->n_streams * sizeof (int));
-            self->channels = realloc(self->channels, self->n_streams * sizeof (int));
-            self->serial = realloc(self->serial, self->n_streams * sizeof (int));
-            self->artist = realloc(self->artist, self->n_streams * sizeof (char *));
-            self->artist[self->n_streams - 1] = strdup("");
-            self->title  = realloc(self->title,  self->n_streams * sizeof (char *));
-            self->title[self->n_streams - 1] = strdup("");
-            self->album  = realloc(self->album,  self->n_streams * sizeof (char *));
-            self->album[self->n_streams - 1] = strdup("");
-            self->replaygain = realloc(self->replaygain, self->n_streams * sizeof (char *));
-            self->replaygain[self->n_streams - 1] = strdup("");
-            self->rgloudness = realloc(self->rgloudness, self->n_streams * sizeof (char *));
-            self->rgloudness[self->n_streams - 1] = strdup("");
-            self->streamtype = realloc(self->streamtype, self->n_streams * sizeof (enum streamtype_t));
-            self->start_time = realloc(self->start_time, self->n_streams * sizeof (double));
-            self->duration = realloc(self->duration, self->n_streams * sizeof (double));
-            if (!(self->bos_offset && self->initial_granulepos && self->final_granulepos && self->serial))
-                {
-                fprintf(stderr, "oggscan_eos: malloc failure\n");
-                self->n_streams = 0;
+            if (!oggdec_append_stream(self, serial, ogg_page_granulepos(&self->og)))
                 return -1;
-                }
-          
-            self->initial_granulepos[self->n_streams - 1] = 0;
-            self->final_granulepos[self->n_streams - 1] = ogg_page_granulepos(&self->og);
-            self->serial[self->n_streams - 1] = serial; 
             if (!eos)
                 fprintf(stderr, "oggscan_eos: an unterminated stream was detected\n");
             return midpoint + retval;
@@ -818,16 +847,187 @@ static off_t oggscan(struct oggdec_vars *self, off_t *offset, off_t offset_end)
     return oggscan_eos(self, *offset, offset_end, serial, 0);
     }
 
-static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
+/* oggdec_probe_stream: read the headers of the first stream yet to be probed
+ * io supplies the file handle and ogg state to do it with, the prefetch has its own
+ */
+static void oggdec_probe_stream(struct oggdec_vars *io, struct oggdec_vars *self)
+    {
+    struct oggdec_stream *st = self->stream + self->n_probed;
+    unsigned samplerate = 0;
+    size_t bytes;
+    char  *buffer;
+
+    io->ix = self->n_probed;
+    ogg_stream_reset_serialno(&io->os, st->serial);
+    fseeko(io->fp, st->bos_offset, SEEK_SET);
+    ogg_sync_reset(&io->oy);
+    while (ogg_sync_pageout(&io->oy, &io->og) != 1)
+        {
+        buffer = ogg_sync_buffer(&io->oy, 8192);
+        bytes = fread(buffer, 1, 8192, io->fp);
+        ogg_sync_wrote(&io->oy, bytes);
+        }
+
+    ogg_stream_pagein(&io->os, &io->og);
+    ogg_stream_packetpeek(&io->os, &io->op);
+
+    do {
+        if (io->op.bytes >= 7 && !memcmp(io->op.packet, "\x01vorbis", 7))
+            {
+            st->streamtype = ST_VORBIS;
+            samplerate = vorbis_get_samplerate(io);
+            break;
+            }
+
+#ifdef HAVE_OGGFLAC
+        if (io->op.bytes >= 5 && !memcmp(io->op.packet, "\x7F""FLAC", 5))
+            {
+            st->streamtype = ST_FLAC;
+            fseeko(io->fp, st->bos_offset, SEEK_SET);
+            samplerate = flac_get_samplerate(io);
+            break;
+            }
+#endif /* HAVE_OGGFLAC */
+#ifdef HAVE_SPEEX
+        if (io->op.bytes >= 5 && !memcmp(io->op.packet, "Speex", 5))
+            {
+            st->streamtype = ST_SPEEX;
+            samplerate = speex_get_samplerate(io);
+            break;
+            }
+#endif /* HAVE_SPEEX */
+#ifdef HAVE_OPUS
+        if (io->op.bytes >= 8 && !memcmp(io->op.packet, "OpusHead", 8))
+            {
+            st->streamtype = ST_OPUS;
+            samplerate = opus_get_samplerate(io);
+            break;
+            }
+#endif /* HAVE_OPUS */
+
+        st->streamtype = ST_UNHANDLED;
+        fprintf(stderr, "??? unhandled ogg stream type ???\n");
+        } while (0);
+
+    st->start_time = self->n_probed ? st[-1].start_time + st[-1].duration : 0.0;
+    if (samplerate == 0)
+        {
+        st->streamtype = ST_UNHANDLED;
+        st->duration = 0;
+        }
+    else
+        {
+        st->duration = (st->final_granulepos - st->initial_granulepos) / (double)samplerate;
+        self->total_duration += st->duration;
+        }
+#if 0
+    fprintf(stderr,
+        "#####################\n"
+        "beginning offset %d\n"
+        "initial_granulepos    %d\n"
+        "final_granulepos    %d\n"
+        "serial number    %d\n"
+        "artist           %s\n"
+        "title            %s\n"
+        "album            %s\n"
+        "samplerate       %d\n"
+        "channels         %d\n"
+        "start time (s)   %lf\n"
+        "duration (s)     %lf\n",
+        (int)st->bos_offset,
+        st->initial_granulepos,
+        st->final_granulepos,
+        st->serial, st->artist, st->title, st->album, samplerate,
+        st->channels, st->start_time, st->duration);
+#endif
+    ++self->n_probed;
+    }
+
+/* oggdec_probe_through: the decoder needs the headers of every stream up to and including last */
+static void oggdec_probe_through(struct oggdec_vars *self, int last)
+    {
+    int ix = self->ix;
+
+    pthread_mutex_lock(&self->probe_mutex);
+    while (self->n_probed <= last && self->n_probed < self->n_streams)
+        oggdec_probe_stream(self, self);
+    pthread_mutex_unlock(&self->probe_mutex);
+    self->ix = ix;
+    }
+
+static void *oggdec_prefetch_main(void *args)
+    {
+    struct oggdec_vars *io = args, *self = io->owner;
+
+    sig_mask_thread();
+    for (;;)
+        {
+        pthread_mutex_lock(&self->probe_mutex);
+        if (self->n_probed == self->n_streams || __atomic_load_n(&self->prefetch_cancel, __ATOMIC_RELAXED))
+            {
+            pthread_mutex_unlock(&self->probe_mutex);
+            break;
+            }
+        oggdec_probe_stream(io, self);
+        pthread_mutex_unlock(&self->probe_mutex);
+        }
+
+    ogg_stream_clear(&io->os);
+    ogg_sync_clear(&io->oy);
+    fclose(io->fp);
+    free(io);
+    return NULL;
+    }
+
+/* oggdec_prefetch: read the headers of the streams still to come on a thread of its own
+ * with a file handle of its own, failing that the decoder reads each as it gets to it
+ */
+static void oggdec_prefetch(struct oggdec_vars *self, char *pathname)
+    {
+    struct oggdec_vars *io;
+    int rv;
+
+    if (self->n_probed == self->n_streams)
+        return;
+    if (!(io = calloc(1, sizeof (struct oggdec_vars))))
+        {
+        fprintf(stderr, "oggdec_prefetch: malloc failure\n");
+        return;
+        }
+    if (!(io->fp = mapfile_fopen(pathname)))
+        {
+        free(io);
+        return;
+        }
+    ogg_sync_init(&io->oy);
+    ogg_stream_init(&io->os, 0);
+    io->magic = self->magic;
+    io->owner = self;
+    io->stream = self->stream;
+    io->n_streams = self->n_streams;
+    io->eos_offset = self->eos_offset;
+
+    if ((rv = pthread_create(&self->prefetch_thread, NULL, oggdec_prefetch_main, io)))
+        {
+        fprintf(stderr, "oggdec_prefetch: pthread_create failed with error %d\n", rv);
+        ogg_stream_clear(&io->os);
+        ogg_sync_clear(&io->oy);
+        fclose(io->fp);
+        free(io);
+        }
+    else
+        self->prefetch_started = TRUE;
+    }
+
+/* oggdecode_get_metadata: find the chain layout and read the headers of the streams up to
+ * the one seek_s falls in, the rest are left for oggdec_prefetch or to be read on demand
+ */
+static struct oggdec_vars *oggdecode_get_metadata(char *pathname, double seek_s)
     {
     struct oggdec_vars *self;
     long   id3size = 0;
     off_t  offset = 0, offset_end, offset_new;
-    size_t bytes;
-    char  *buffer;
     int i;
-    unsigned samplerate = 0;
-    double start_time = 0.0;
     
     /* allocate storage space */
     if (!(self = calloc(1, sizeof (struct oggdec_vars))))
@@ -839,7 +1039,7 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
     self->magic = 4747;
     
     /* open the media file */
-    if (!(self->fp = fopen(pathname, "r")))
+    if (!(self->fp = mapfile_fopen(pathname)))
         {
         fprintf(stderr, "oggdecode_reg: unable to open media file %s\n", pathname);
         free(self);
@@ -881,102 +1081,39 @@ static struct oggdec_vars *oggdecode_get_metadata(char *pathname)
     fseek(self->fp, 0, SEEK_END);
     offset_end = self->eos_offset = ftello(self->fp);
 
-    while (offset < offset_end)
-        {
-        offset_new = oggscan(self, &offset, offset_end);
-        
-        if (offset_new == -1)
-            break;
-        self->bos_offset[self->n_streams -1] = offset;
-        offset = offset_new;
-        }
-
-    for (self->ix = i = 0; i < self->n_streams; i++, self->ix++)
+    /* the chain layout is expensive to find so reuse an earlier scan if the file is unchanged */
+    if ((self->index = oggindex_load(pathname)) && self->index->valid)
         {
-        ogg_stream_reset_serialno(&self->os, self->serial[i]);
-        fseeko(self->fp, self->bos_offset[i], SEEK_SET);
-        ogg_sync_reset(&self->oy);
-        while (ogg_sync_pageout(&self->oy, &self->og) != 1)
+        for (i = 0; i < self->index->n_streams; i++)
             {
-            buffer = ogg_sync_buffer(&self->oy, 8192);
-            bytes = fread(buffer, 1, 8192, self->fp);
-            ogg_sync_wrote(&self->oy, bytes);
-            }
-
-        ogg_stream_pagein(&self->os, &self->og);
-        ogg_stream_packetpeek(&self->os, &self->op);
-
-        do {
-            if (self->op.bytes >= 7 && !memcmp(self->op.packet, "\x01vorbis", 7))
-                {
-                self->streamtype[i] = ST_VORBIS;
-                samplerate = vorbis_get_samplerate(self);
+            if (!oggdec_append_stream(self, self->index->stream[i].serial, self->index->stream[i].final_granulepos))
                 break;
-                }
-
-#ifdef HAVE_OGGFLAC
-            if (self->op.bytes >= 5 && !memcmp(self->op.packet, "\x7F""FLAC", 5))
-                {
-                self->streamtype[i] = ST_FLAC;
-                fseeko(self->fp, self->bos_offset[i], SEEK_SET);
-                samplerate = flac_get_samplerate(self);
-                break;
-                }
-#endif /* HAVE_OGGFLAC */
-#ifdef HAVE_SPEEX
-            if (self->op.bytes >= 5 && !memcmp(self->op.packet, "Speex", 5))
-                {
-                self->streamtype[i] = ST_SPEEX;
-                samplerate = speex_get_samplerate(self);
-                break;
-                }
-#endif /* HAVE_SPEEX */
-#ifdef HAVE_OPUS
-            if (self->op.bytes >= 8 && !memcmp(self->op.packet, "OpusHead", 8))
-                {
-                self->streamtype[i] = ST_OPUS;
-                samplerate = opus_get_samplerate(self);
-                break;
-                }
-#endif /* HAVE_OPUS */
-
-            self->streamtype[i] = ST_UNHANDLED;
-            fprintf(stderr, "??? unhandled ogg stream type ???\n");
-            } while (0);
-
-        self->start_time[i] = start_time;
-        if (samplerate == 0)
-            {
-            self->streamtype[i] = ST_UNHANDLED;
-            self->duration[i] = 0;
+            self->stream[i].bos_offset = self->index->stream[i].bos_offset;
             }
-        else
+        }
+    else
+        {
+        while (offset < offset_end)
             {
-            start_time += self->duration[i] = (self->final_granulepos[i] - self->initial_granulepos[i]) / (double)samplerate;
-            self->total_duration += self->duration[i];
+            offset_new = oggscan(self, &offset, offset_end);
+            
+            if (offset_new == -1)
+                break;
+            self->stream[self->n_streams -1].bos_offset = offset;
+            offset = offset_new;
             }
-#if 0
-        fprintf(stderr,
-            "#####################\n"
-            "beginning offset %d\n"
-            "initial_granulepos    %d\n"
-            "final_granulepos    %d\n"
-            "serial number    %d\n"
-            "artist           %s\n"
-            "title            %s\n"
-            "album            %s\n"
-            "samplerate       %d\n"
-            "channels         %d\n"
-            "start time (s)   %lf\n"
-            "duration (s)     %lf\n",
-            (int)self->bos_offset[i],
-            self->initial_granulepos[i],
-            self->final_granulepos[i],
-            self->serial[i], self->artist[i], self->title[i], self->album[i], samplerate,
-            self->channels[i], self->start_time[i], self->duration[i]);
-#endif
+
+        if (self->index && oggindex_set_chain(self->index, self->n_streams))
+            for (i = 0; i < self->n_streams; i++)
+                oggindex_set_stream(self->index, i, self->stream[i].bos_offset, self->stream[i].serial, self->stream[i].final_granulepos);
         }
-    fprintf(stderr, "total_duration   %lf\n", self->total_duration);
+
+    /* only as far as the stream to be played first */
+    pthread_mutex_init(&self->probe_mutex, NULL);
+    while (self->n_probed < self->n_streams && self->total_duration <= seek_s)
+        oggdec_probe_stream(self, self);
+    if (self->n_probed == self->n_streams)
+        fprintf(stderr, "total_duration   %lf\n", self->total_duration);
     return self;
     }
 
@@ -984,33 +1121,25 @@ static void oggdecode_free_metadata(struct oggdec_vars *self)
     {
     int i;
     
+    if (self->prefetch_started)
+        {
+        __atomic_store_n(&self->prefetch_cancel, TRUE, __ATOMIC_RELAXED);
+        pthread_join(self->prefetch_thread, NULL);
+        }
+    pthread_mutex_destroy(&self->probe_mutex);
     ogg_stream_clear(&self->os);
     ogg_sync_clear(&self->oy);
     fclose(self->fp);
-    if (self->n_streams)
+    oggindex_close(self->index);
+    for (i = 0; i < self->n_streams; i++)
         {
-        for (i = 0; i < self->n_streams; i++)
-            {
-            if (self->artist[i])
-                free(self->artist[i]);
-            if (self->title[i])
-                free(self->title[i]);
-            if (self->album[i])
-                free(self->album[i]);
-            }
-            
-        free(self->bos_offset);
-        free(self->initial_granulepos);
-        free(self->final_granulepos);
-        free(self->serial);
-        free(self->artist);
-        free(self->title);
-        free(self->album);
-        free(self->streamtype);
-        free(self->start_time);
-        free(self->duration);
+        free(self->stream[i].artist);
+        free(self->stream[i].title);
+        free(self->stream[i].album);
+        free(self->stream[i].replaygain);
+        free(self->stream[i].rgloudness);
         }
-    
+    free(self->stream);
     free(self);
     }
 
@@ -1023,12 +1152,13 @@ void oggdecode_seek_to_packet(struct oggdec_vars *self)
     char *buffer;
     size_t bytes;
      
-    start = self->bos_offset[self->ix];
+    start = self->stream[self->ix].bos_offset;
     if (self->ix == self->n_streams - 1)
         end = self->eos_offset;
     else
-        end = self->bos_offset[self->ix + 1];
-    target = self->seek_s * self->samplerate[self->ix];
+        end = self->stream[self->ix + 1].bos_offset;
+    target = self->seek_s * self->stream[self->ix].samplerate;
+    oggindex_narrow(self->index, self->ix, target, &start, &end);
 
     while (start + 1 < end)
         {
@@ -1061,9 +1191,10 @@ void oggdecode_seek_to_packet(struct oggdec_vars *self)
                     }
                 }
 
-            if ((granulepos = ogg_page_granulepos(&self->og) - self->initial_granulepos[self->ix]) >= 0)
+            if ((granulepos = ogg_page_granulepos(&self->og) - self->stream[self->ix].initial_granulepos) >= 0)
                 break;
             }
+        oggindex_add_seekpoint(self->index, self->ix, mid, granulepos);
 
         if (granulepos < target)
             start = mid + retval;
@@ -1087,13 +1218,18 @@ void oggdecode_dynamic_dispatcher(struct xlplayer *xlplayer)
     
     while (s->ix < s->n_streams)
         {
+        /* the prefetch may not have got this far */
+        oggdec_probe_through(s, s->ix);
+
         /* skip over empty (read unplayable) streams */
-        while (s->duration[s->ix] == 0.0)
-            if (++(s->ix) >= s->n_streams)
-                goto bugout;
+        if (s->stream[s->ix].duration == 0.0)
+            {
+            s->ix++;
+            continue;
+            }
 
         /* choose our decoder */
-        switch (s->streamtype[s->ix])
+        switch (s->stream[s->ix].streamtype)
             {
             case ST_VORBIS:
                 success = ogg_vorbisdec_init(xlplayer);
@@ -1125,8 +1261,8 @@ void oggdecode_dynamic_dispatcher(struct xlplayer *xlplayer)
             else
                 delay = 0;
             
-            if (s->artist[s->ix][0] || s->title[s->ix][0])
-                xlplayer_set_dynamic_metadata(xlplayer, DM_SPLIT_U8, s->artist[s->ix], s->title[s->ix], s->album[s->ix], delay);
+            if (s->stream[s->ix].artist[0] || s->stream[s->ix].title[0])
+                xlplayer_set_dynamic_metadata(xlplayer, DM_SPLIT_U8, s->stream[s->ix].artist, s->stream[s->ix].title, s->stream[s->ix].album, delay);
             else
                 {
                 fprintf(stderr, "oggdecode_dynamic_dispatcher: insufficient metadata\n");
@@ -1138,13 +1274,12 @@ void oggdecode_dynamic_dispatcher(struct xlplayer *xlplayer)
             }
         else
             {
-            xlplayer->play_progress_ms += 1000 * (int32_t)(s->duration[s->ix] - s->seek_s);
+            xlplayer->play_progress_ms += 1000 * (int32_t)(s->stream[s->ix].duration - s->seek_s);
             s->seek_s = 0.0;
             s->ix++;
             }
         }
  
-    bugout:
     xlplayer->playmode = PM_EJECTING;
     }
 
@@ -1163,19 +1298,21 @@ static void oggdecode_init(struct xlplayer *xlplayer)
     struct oggdec_vars *self = xlplayer->dec_data;
     int i;
     
-    /* calculate where we seek to */
-    for (i = 0; i < self->n_streams; i++)
+    /* calculate where we seek to, only so many streams have been probed */
+    for (i = 0; i < self->n_probed; i++)
         {
-        if (self->start_time[i] <= xlplayer->seek_s && xlplayer->seek_s < self->start_time[i] + self->duration[i])
+        if (self->stream[i].start_time <= xlplayer->seek_s && xlplayer->seek_s < self->stream[i].start_time + self->stream[i].duration)
             {
             /* note which stream to play first and the time offset within */
             self->ix = i;
-            self->seek_s = xlplayer->seek_s - self->start_time[i];
+            self->seek_s = xlplayer->seek_s - self->stream[i].start_time;
             break;
             }
-        if (i + 1 >= self->n_streams)
+        if (i + 1 >= self->n_probed)
             xlplayer->playmode = PM_FLUSH;
         }
+    if (xlplayer->playmode != PM_FLUSH)
+        oggdec_prefetch(self, xlplayer->pathname);
     }
 
 void oggdecode_set_new_oggpage_callback(struct oggdec_vars *self, void (*cb)(struct oggdec_vars *, void *), void *user_data)
@@ -1205,7 +1342,7 @@ int oggdecode_reg(struct xlplayer *xlplayer)
     {
     struct oggdec_vars *self;
 
-    if (!(self = oggdecode_get_metadata(xlplayer->pathname)))
+    if (!(self = oggdecode_get_metadata(xlplayer->pathname, xlplayer->seek_s)))
         return REJECTED;
     else
         {
@@ -1224,7 +1361,7 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
     struct oggdec_vars *self;
     int has_pbtime;
     
-    if(!(self = oggdecode_get_metadata(pathname)))
+    if(!(self = oggdecode_get_metadata(pathname, HUGE_VAL)))
         {
         fprintf(stderr, "call to oggdecode_get_metadata failed for %s\n", pathname);
         return REJECTED;
@@ -1232,7 +1369,7 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
         
     if ((has_pbtime = (*length = self->total_duration)))
         {
-        if (self->n_streams > 1 && self->duration[0] > 0.1)
+        if (self->n_streams > 1 && self->stream[0].duration > 0.1)
             {
             /* only read the initial tags of chained ogg streams when they
              * possess a metaheader */
@@ -1245,11 +1382,11 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
             }
         else
             {
-            if (self->artist[0])
+            if (self->stream[0].artist)
                 {
                 if (*artist)
                     free(*artist);
-                *artist = strdup(self->artist[0]);
+                *artist = strdup(self->stream[0].artist);
                 }
             else
                 {
@@ -1257,11 +1394,11 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
                 *artist[0] = '\0';
                 }
         
-            if (self->title[0])
+            if (self->stream[0].title)
                 { 
                 if (*title)
                     free(*title);
-                *title = strdup(self->title[0]);
+                *title = strdup(self->stream[0].title);
                 }
             else
                 {
@@ -1269,11 +1406,11 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
                 *title[0] = '\0';
                 }
 
-            if (self->album[0])
+            if (self->stream[0].album)
                 { 
                 if (*album)
                     free(*album);
-                *album = strdup(self->album[0]);
+                *album = strdup(self->stream[0].album);
                 }
             else
                 {
@@ -1281,11 +1418,11 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
                 *album[0] = '\0';
                 }
 
-            if (self->replaygain[0])
+            if (self->stream[0].replaygain)
                 {
                 if (*replaygain)
                     free(*replaygain);
-                *replaygain = strdup(self->replaygain[0]);
+                *replaygain = strdup(self->stream[0].replaygain);
                 }
             else
                 {
@@ -1293,11 +1430,11 @@ int oggdecode_get_metainfo(char *pathname, char **artist, char **title, char **a
                 *replaygain[0] = '\0';
                 }
 
-            if (self->rgloudness[0])
+            if (self->stream[0].rgloudness)
                 {
                 if (*rgloudness)
                     free(*rgloudness);
-                *rgloudness = strdup(self->rgloudness[0]);
+                *rgloudness = strdup(self->stream[0].rgloudness);
                 }
             else
                 {
@@ -18,11 +18,31 @@
 */
 
 #include "../config.h"
+#include <pthread.h>
 #include <ogg/ogg.h>
 #include "xlplayer.h"
+#include "oggindex.h"
 
 enum streamtype_t { ST_UNHANDLED, ST_VORBIS, ST_FLAC, ST_SPEEX, ST_OPUS };
 
+struct oggdec_stream
+    {
+    off_t  bos_offset;       /* file position where the stream starts */
+    unsigned initial_granulepos;
+    unsigned final_granulepos;
+    int    serial;           /* the ogg serial number */
+    unsigned samplerate;     /* sample rate per channel */
+    int    channels;         /* number of audio channels */
+    char  *artist;           /* artist and title metadata */
+    char  *title;
+    char  *album;
+    char  *replaygain;       /* specifically replaygain_track_gain */
+    char  *rgloudness;       /* specifically replaygain_reference_loudness */
+    enum streamtype_t streamtype;    /* indicate which type ie vorbis, flac */
+    double start_time;       /* the time when the stream starts */
+    double duration;         /* playback time */
+    };
+
 struct oggdec_vars
     {
     int magic;              /* 4545 */
@@ -41,26 +61,23 @@ struct oggdec_vars
     void (*new_oggpage_callback)(struct oggdec_vars *self, void *cb_userdata);
     void *new_oggpage_cb_userdata;
 
-    /* stream info */
-
-    off_t  *bos_offset;      /* file position where each stream starts */
-    unsigned *initial_granulepos;
-    unsigned *final_granulepos;
-    int    *serial;          /* the ogg serial numbers */
-    unsigned *samplerate;    /* sample rate per channel */
-    int    *channels;        /* number of audio channels */
-    char  **artist;          /* artist and title metadata */
-    char  **title;
-    char  **album;
-    char  **replaygain;      /* specifically replaygain_track_gain */
-    char  **rgloudness;      /* specifically replaygain_reference_loudness */
-    enum streamtype_t *streamtype;    /* indicate which type ie vorbis, flac */
-    double *start_time;      /* the time when each stream starts */
-    double *duration;        /* playback time */
+    /* stream info, the first n_probed have had their headers read */
+
+    struct oggdec_stream *stream;
     int     n_streams;       /* number of logical streams found */
+    int     streams_size;    /* room in stream */
+    int     n_probed;        /* guarded by probe_mutex once the prefetch is running */
     int     ix;              /* index of the stream of interest */
     off_t   eos_offset;      /* offset to the end of file */
-    double  total_duration;  /* sum total playback time */
+    double  total_duration;  /* sum total playback time of the streams probed */
+    struct oggindex *index;  /* cached chain layout and seek table */
+
+    /* the rest of the chain's headers are read in the background */
+    struct oggdec_vars *owner;      /* of the prefetch, the decoder it reads for */
+    pthread_mutex_t probe_mutex;    /* held while a stream's headers are read */
+    pthread_t prefetch_thread;
+    int prefetch_started;
+    int prefetch_cancel;
     };
 
 int oggdecode_reg(struct xlplayer *xlplayer);
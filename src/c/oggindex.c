@@ -0,0 +1,235 @@
+/*
+#   oggindex.c: persistent ogg chain layout and seek table cache
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oggindex.h"
+
+#define TRUE 1
+#define FALSE 0
+
+#define OGGINDEX_MAGIC "idjc-oggindex 1"
+
+static int oggindex_read(struct oggindex *self)
+    {
+    FILE *fp;
+    long long offset, granulepos;
+    unsigned final_granulepos;
+    int n_streams, n_seekpoints, serial, i, j;
+    struct oggindex_stream *stream = NULL;
+
+    if (!(fp = indexcache_read_open(&self->key, OGGINDEX_MAGIC)))
+        return FALSE;
+
+    if (fscanf(fp, "%d", &n_streams) != 1 || n_streams < 0)
+        goto fail;
+
+    if (n_streams && !(stream = calloc(n_streams, sizeof (struct oggindex_stream))))
+        goto fail;
+
+    for (i = 0; i < n_streams; ++i)
+        {
+        if (fscanf(fp, "%lld %d %u %d", &offset, &serial, &final_granulepos, &n_seekpoints) != 4 || n_seekpoints < 0 || n_seekpoints > OGGINDEX_SEEKPOINTS)
+            goto fail;
+        stream[i].bos_offset = offset;
+        stream[i].serial = serial;
+        stream[i].final_granulepos = final_granulepos;
+        stream[i].n_seekpoints = n_seekpoints;
+
+        for (j = 0; j < n_seekpoints; ++j)
+            {
+            if (fscanf(fp, "%lld %lld", &offset, &granulepos) != 2)
+                goto fail;
+            stream[i].seekpoint[j].offset = offset;
+            stream[i].seekpoint[j].granulepos = granulepos;
+            }
+        }
+
+    self->n_streams = n_streams;
+    self->stream = stream;
+    self->valid = TRUE;
+    fclose(fp);
+    return TRUE;
+
+    fail:
+    free(stream);
+    fclose(fp);
+    return FALSE;
+    }
+
+static void oggindex_write(struct oggindex *self)
+    {
+    FILE *fp;
+    char *tmp;
+    int i, j;
+
+    if (!(fp = indexcache_write_open(&self->key, OGGINDEX_MAGIC, &tmp)))
+        return;
+
+    fprintf(fp, "%d\n", self->n_streams);
+    for (i = 0; i < self->n_streams; ++i)
+        {
+        struct oggindex_stream *s = &self->stream[i];
+
+        fprintf(fp, "%lld %d %u %d\n", (long long)s->bos_offset, s->serial, s->final_granulepos, s->n_seekpoints);
+        for (j = 0; j < s->n_seekpoints; ++j)
+            fprintf(fp, "%lld %lld\n", (long long)s->seekpoint[j].offset, (long long)s->seekpoint[j].granulepos);
+        }
+
+    indexcache_write_close(&self->key, fp, tmp);
+    }
+
+struct oggindex *oggindex_load(const char *pathname)
+    {
+    struct oggindex *self;
+
+    if (!(self = calloc(1, sizeof (struct oggindex))))
+        {
+        fprintf(stderr, "oggindex_load: malloc failure\n");
+        return NULL;
+        }
+
+    if (!indexcache_key_init(&self->key, "oggindex", pathname))
+        {
+        free(self);
+        return NULL;
+        }
+
+    oggindex_read(self);
+    return self;
+    }
+
+int oggindex_set_chain(struct oggindex *self, int n_streams)
+    {
+    struct oggindex_stream *stream = NULL;
+
+    if (n_streams && !(stream = calloc(n_streams, sizeof (struct oggindex_stream))))
+        {
+        fprintf(stderr, "oggindex_set_chain: malloc failure\n");
+        return FALSE;
+        }
+
+    free(self->stream);
+    self->stream = stream;
+    self->n_streams = n_streams;
+    self->valid = self->dirty = TRUE;
+    return TRUE;
+    }
+
+void oggindex_set_stream(struct oggindex *self, int ix, off_t bos_offset, int serial, unsigned final_granulepos)
+    {
+    self->stream[ix].bos_offset = bos_offset;
+    self->stream[ix].serial = serial;
+    self->stream[ix].final_granulepos = final_granulepos;
+    }
+
+void oggindex_add_seekpoint(struct oggindex *self, int ix, off_t offset, ogg_int64_t granulepos)
+    {
+    struct oggindex_stream *s;
+    int i, n, victim;
+    off_t gap, smallest;
+
+    if (!self || ix >= self->n_streams)
+        return;
+    s = &self->stream[ix];
+    n = s->n_seekpoints;
+
+    for (i = 0; i < n && s->seekpoint[i].offset < offset; ++i);
+    if (i < n && s->seekpoint[i].offset == offset)
+        {
+        if (s->seekpoint[i].granulepos != granulepos)
+            {
+            s->seekpoint[i].granulepos = granulepos;
+            self->dirty = TRUE;
+            }
+        return;
+        }
+
+    if (n == OGGINDEX_SEEKPOINTS)
+        {
+        /* keep the table coarse and even by dropping the most redundant entry */
+        victim = 1;
+        smallest = s->seekpoint[1].offset - s->seekpoint[0].offset;
+        for (int j = 2; j < n; ++j)
+            if ((gap = s->seekpoint[j].offset - s->seekpoint[j - 1].offset) < smallest)
+                {
+                smallest = gap;
+                victim = j;
+                }
+
+        /* the newcomer is more redundant still */
+        if ((i > 0 && offset - s->seekpoint[i - 1].offset < smallest) || (i < n && s->seekpoint[i].offset - offset < smallest))
+            return;
+
+        memmove(s->seekpoint + victim, s->seekpoint + victim + 1, (n - victim - 1) * sizeof (struct oggindex_seekpoint));
+        if (victim < i)
+            --i;
+        --n;
+        }
+
+    memmove(s->seekpoint + i + 1, s->seekpoint + i, (n - i) * sizeof (struct oggindex_seekpoint));
+    s->seekpoint[i].offset = offset;
+    s->seekpoint[i].granulepos = granulepos;
+    s->n_seekpoints = n + 1;
+    self->dirty = TRUE;
+    }
+
+void oggindex_narrow(struct oggindex *self, int ix, ogg_int64_t target, off_t *start, off_t *end)
+    {
+    struct oggindex_stream *s;
+    off_t new_start = *start, new_end = *end;
+
+    if (!self || ix >= self->n_streams)
+        return;
+    s = &self->stream[ix];
+
+    for (int i = 0; i < s->n_seekpoints; ++i)
+        {
+        struct oggindex_seekpoint *sp = &s->seekpoint[i];
+
+        if (sp->offset <= new_start || sp->offset >= new_end)
+            continue;
+        if (sp->granulepos < target)
+            new_start = sp->offset;
+        else
+            new_end = sp->offset;
+        }
+
+    /* the caller relies on at least one probe being made */
+    if (new_start + 1 < new_end)
+        {
+        *start = new_start;
+        *end = new_end;
+        }
+    }
+
+void oggindex_close(struct oggindex *self)
+    {
+    if (!self)
+        return;
+
+    if (self->dirty && self->valid)
+        oggindex_write(self);
+    free(self->stream);
+    indexcache_key_free(&self->key);
+    free(self);
+    }
@@ -0,0 +1,76 @@
+/*
+#   oggindex.h: persistent ogg chain layout and seek table cache
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OGGINDEX_H
+#define OGGINDEX_H
+
+#include <sys/types.h>
+#include <time.h>
+#include <ogg/ogg.h>
+#include "indexcache.h"
+
+#define OGGINDEX_SEEKPOINTS 64      /* per logical stream */
+
+struct oggindex_seekpoint
+    {
+    off_t offset;                   /* the first page at or after here... */
+    ogg_int64_t granulepos;         /* ...has this stream relative granulepos */
+    };
+
+struct oggindex_stream
+    {
+    off_t bos_offset;
+    int serial;
+    unsigned final_granulepos;
+    int n_seekpoints;
+    struct oggindex_seekpoint seekpoint[OGGINDEX_SEEKPOINTS];  /* sorted by offset */
+    };
+
+struct oggindex
+    {
+    struct indexcache_key key;
+    int valid;                      /* the chain layout is known */
+    int dirty;                      /* needs writing back */
+    int n_streams;
+    struct oggindex_stream *stream;
+    };
+
+/* oggindex_load: look up the cached index for a media file
+ * returns NULL if the file can't be identified or caching is disabled,
+ * otherwise an index which is either valid or empty and awaiting
+ * oggindex_set_chain
+ */
+struct oggindex *oggindex_load(const char *pathname);
+
+/* oggindex_set_chain: make room for the logical stream layout found by a scan
+ * each stream of which is then recorded with oggindex_set_stream
+ */
+int oggindex_set_chain(struct oggindex *self, int n_streams);
+void oggindex_set_stream(struct oggindex *self, int ix, off_t bos_offset, int serial, unsigned final_granulepos);
+
+/* oggindex_add_seekpoint: remember the result of a bisection probe */
+void oggindex_add_seekpoint(struct oggindex *self, int ix, off_t offset, ogg_int64_t granulepos);
+
+/* oggindex_narrow: tighten the byte range in which to bisect for target */
+void oggindex_narrow(struct oggindex *self, int ix, ogg_int64_t target, off_t *start, off_t *end);
+
+/* oggindex_close: write back the index if it changed and free it */
+void oggindex_close(struct oggindex *self);
+
+#endif /* OGGINDEX_H */
@@ -0,0 +1,317 @@
+/*
+#   pcmcache.c: decoded audio of the effects held in memory
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "xlplayer.h"
+#include "pcmcache.h"
+
+#define TRUE 1
+#define FALSE 0
+#define ACCEPTED 1
+#define REJECTED 0
+
+static const size_t pcmcache_frameqty = 4096;
+
+struct pcmcache_entry
+    {
+    char *pathname;
+    struct timespec mtime;
+    float gain;
+    int fade_mode;
+    unsigned samplerate;
+    float *left;                /* the audio as it went into the ringbuffer */
+    float *right;
+    size_t frames;
+    size_t capacity;
+    int refs;                   /* players reading it, the entry outlives eviction until zero */
+    int cached;                 /* on the list */
+    struct pcmcache_entry *prev;/* the list, most recently used first */
+    struct pcmcache_entry *next;
+    };
+
+struct pcmcache_play
+    {
+    struct pcmcache_entry *entry;
+    size_t pos;
+    };
+
+static struct pcmcache
+    {
+    pthread_mutex_t mutex;
+    struct pcmcache_entry *head;
+    struct pcmcache_entry *tail;
+    size_t cap;                 /* bytes the cached entries may take up */
+    size_t used;
+    } cache = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static size_t pcmcache_entry_bytes(struct pcmcache_entry *entry)
+    {
+    return entry->capacity * 2 * sizeof (float);
+    }
+
+static void pcmcache_entry_free(struct pcmcache_entry *entry)
+    {
+    free(entry->pathname);
+    free(entry->left);
+    free(entry->right);
+    free(entry);
+    }
+
+/* with the mutex held */
+static void pcmcache_unlink(struct pcmcache_entry *entry)
+    {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        cache.head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        cache.tail = entry->prev;
+    entry->prev = entry->next = NULL;
+    entry->cached = FALSE;
+    cache.used -= pcmcache_entry_bytes(entry);
+    if (!entry->refs)
+        pcmcache_entry_free(entry);
+    }
+
+/* with the mutex held */
+static void pcmcache_push_front(struct pcmcache_entry *entry)
+    {
+    entry->prev = NULL;
+    entry->next = cache.head;
+    if (cache.head)
+        cache.head->prev = entry;
+    else
+        cache.tail = entry;
+    cache.head = entry;
+    }
+
+/* pcmcache_key: what the decoded audio of a player's current track depends on */
+static int pcmcache_key(struct pcmcache_entry *key, struct xlplayer *xlplayer)
+    {
+    struct stat st;
+
+    if (stat(xlplayer->pathname, &st) || !S_ISREG(st.st_mode))
+        return FALSE;
+    *key = (struct pcmcache_entry){ .pathname = xlplayer->pathname, .mtime = st.st_mtim, .gain = xlplayer->gain,
+                        .fade_mode = xlplayer->fade_mode, .samplerate = xlplayer->samplerate };
+    return TRUE;
+    }
+
+static int pcmcache_key_match(struct pcmcache_entry *a, struct pcmcache_entry *b)
+    {
+    return a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec
+                && a->gain == b->gain && a->fade_mode == b->fade_mode
+                && a->samplerate == b->samplerate && !strcmp(a->pathname, b->pathname);
+    }
+
+static void pcmcache_release(struct pcmcache_entry *entry)
+    {
+    pthread_mutex_lock(&cache.mutex);
+    if (!--entry->refs && !entry->cached)
+        pcmcache_entry_free(entry);
+    pthread_mutex_unlock(&cache.mutex);
+    }
+
+void pcmcache_init(size_t cap_bytes)
+    {
+    pthread_mutex_lock(&cache.mutex);
+    cache.cap = cap_bytes;
+    while (cache.tail && cache.used > cache.cap)
+        pcmcache_unlink(cache.tail);
+    pthread_mutex_unlock(&cache.mutex);
+    }
+
+void pcmcache_cleanup()
+    {
+    pcmcache_init(0);
+    }
+
+static void pcmcache_init_play(struct xlplayer *xlplayer)
+    {
+    }
+
+static void pcmcache_play(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_play *self = xlplayer->dec_data;
+    size_t n = self->entry->frames - self->pos;
+
+    if (n > pcmcache_frameqty)
+        n = pcmcache_frameqty;
+    xlplayer_reserve_output(xlplayer, n);
+    memcpy(xlplayer->leftbuffer, self->entry->left + self->pos, n * sizeof (float));
+    memcpy(xlplayer->rightbuffer, self->entry->right + self->pos, n * sizeof (float));
+    xlplayer->op_buffersize = n * sizeof (float);
+    self->pos += n;
+    xlplayer_write_channel_data(xlplayer);
+    if (n == 0)
+        xlplayer->playmode = PM_FLUSH;
+    }
+
+static void pcmcache_eject(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_play *self = xlplayer->dec_data;
+
+    pcmcache_release(self->entry);
+    free(self);
+    }
+
+int pcmcache_reg(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_play *self;
+    struct pcmcache_entry *entry, key;
+
+    if (!cache.cap || !pcmcache_key(&key, xlplayer))
+        return REJECTED;
+    pthread_mutex_lock(&cache.mutex);
+    for (entry = cache.head; entry; entry = entry->next)
+        if (pcmcache_key_match(entry, &key))
+            break;
+    if (entry)
+        {
+        ++entry->refs;
+        if (entry != cache.head)
+            {
+            entry->prev->next = entry->next;
+            if (entry->next)
+                entry->next->prev = entry->prev;
+            else
+                cache.tail = entry->prev;
+            pcmcache_push_front(entry);
+            }
+        }
+    pthread_mutex_unlock(&cache.mutex);
+    if (!entry)
+        return REJECTED;
+
+    if (!(self = xlplayer->dec_data = malloc(sizeof (struct pcmcache_play))))
+        {
+        fprintf(stderr, "pcmcache_reg: malloc failure\n");
+        pcmcache_release(entry);
+        return REJECTED;
+        }
+    self->entry = entry;
+    self->pos = 0;
+    xlplayer->dec_init = pcmcache_init_play;
+    xlplayer->dec_play = pcmcache_play;
+    xlplayer->dec_eject = pcmcache_eject;
+    return ACCEPTED;
+    }
+
+struct pcmcache_entry *pcmcache_capture_begin(struct xlplayer *xlplayer)
+    {
+    struct pcmcache_entry *entry, key;
+
+    /* a track started part way through can't stand in for the whole thing */
+    if (!cache.cap || xlplayer->seek_s || !pcmcache_key(&key, xlplayer))
+        return NULL;
+    if (!(entry = calloc(1, sizeof (struct pcmcache_entry))))
+        {
+        fprintf(stderr, "pcmcache_capture_begin: malloc failure\n");
+        exit(5);
+        }
+    *entry = key;
+    if (!(entry->pathname = strdup(key.pathname)))
+        {
+        fprintf(stderr, "pcmcache_capture_begin: malloc failure\n");
+        exit(5);
+        }
+    return entry;
+    }
+
+void pcmcache_capture_append(struct pcmcache_entry **entry, const float *left, const float *right, size_t frames)
+    {
+    struct pcmcache_entry *e = *entry;
+    size_t capacity;
+
+    if (e->frames + frames > e->capacity)
+        {
+        capacity = e->capacity ? e->capacity * 2 : e->samplerate * 4;
+        while (capacity < e->frames + frames)
+            capacity *= 2;
+        /* a single entry is allowed a quarter of the cache so it can't flush out all the rest */
+        if ((e->frames + frames) * 2 * sizeof (float) > cache.cap / 4)
+            {
+            pcmcache_capture_abandon(e);
+            *entry = NULL;
+            return;
+            }
+        if (capacity * 2 * sizeof (float) > cache.cap / 4)
+            capacity = cache.cap / 4 / (2 * sizeof (float));
+        if (!(e->left = realloc(e->left, capacity * sizeof (float))) || !(e->right = realloc(e->right, capacity * sizeof (float))))
+            {
+            fprintf(stderr, "pcmcache_capture_append: malloc failure\n");
+            exit(5);
+            }
+        e->capacity = capacity;
+        }
+    memcpy(e->left + e->frames, left, frames * sizeof (float));
+    memcpy(e->right + e->frames, right, frames * sizeof (float));
+    e->frames += frames;
+    }
+
+void pcmcache_capture_commit(struct pcmcache_entry *entry)
+    {
+    struct pcmcache_entry *other;
+    float *p;
+
+    if (!entry->frames)
+        {
+        pcmcache_capture_abandon(entry);
+        return;
+        }
+    /* give back the growth headroom */
+    if (entry->capacity > entry->frames)
+        {
+        if ((p = realloc(entry->left, entry->frames * sizeof (float))))
+            entry->left = p;
+        if ((p = realloc(entry->right, entry->frames * sizeof (float))))
+            entry->right = p;
+        entry->capacity = entry->frames;
+        }
+
+    pthread_mutex_lock(&cache.mutex);
+    for (other = cache.head; other; other = other->next)
+        if (pcmcache_key_match(other, entry))
+            break;
+    if (other || pcmcache_entry_bytes(entry) > cache.cap / 4)
+        {
+        /* another player got there first or the cap was lowered in the meantime */
+        pthread_mutex_unlock(&cache.mutex);
+        pcmcache_entry_free(entry);
+        return;
+        }
+    while (cache.tail && cache.used + pcmcache_entry_bytes(entry) > cache.cap)
+        pcmcache_unlink(cache.tail);
+    pcmcache_push_front(entry);
+    entry->cached = TRUE;
+    cache.used += pcmcache_entry_bytes(entry);
+    pthread_mutex_unlock(&cache.mutex);
+    }
+
+void pcmcache_capture_abandon(struct pcmcache_entry *entry)
+    {
+    pcmcache_entry_free(entry);
+    }
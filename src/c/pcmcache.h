@@ -0,0 +1,46 @@
+/*
+#   pcmcache.h: decoded audio of the effects held in memory
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <stddef.h>
+#include "xlplayer.h"
+
+struct pcmcache_entry;
+
+/* pcmcache_init: set the memory the cache may use, zero disables it */
+void pcmcache_init(size_t cap_bytes);
+void pcmcache_cleanup();
+
+/* pcmcache_reg: decoder that plays back from the cache
+ * only succeeds when the file is cached as it would decode now
+ * i.e. same modification time, gain, fade mode and sample rate
+ */
+int pcmcache_reg(struct xlplayer *xlplayer);
+
+/* the real decoders' output is captured as it goes into the ringbuffer
+ * and only enters the cache once the track has played through to its end
+ */
+struct pcmcache_entry *pcmcache_capture_begin(struct xlplayer *xlplayer);
+void pcmcache_capture_append(struct pcmcache_entry **entry, const float *left, const float *right, size_t frames);
+void pcmcache_capture_commit(struct pcmcache_entry *entry);
+void pcmcache_capture_abandon(struct pcmcache_entry *entry);
+
+#endif /* PCMCACHE_H */
@@ -24,13 +24,14 @@
 #include <math.h>
 #include "peakfilter.h"
 #include "dbconvert.h"
+#include "rtarena.h"
 
 struct peakfilter *peakfilter_create(float window, int sample_rate)
     {
     struct peakfilter *self;
     int n_stages;
     
-    if (!(self = malloc(sizeof (struct peakfilter))))
+    if (!(self = rtarena_calloc(1, sizeof (struct peakfilter))))
         {
         fprintf(stderr, "malloc failure\n");
         exit(-5);
@@ -39,13 +40,21 @@ struct peakfilter *peakfilter_create(float window, int sample_rate)
     if ((n_stages = (int)(window * sample_rate)) < 1)
         n_stages = 1;
     
-    if (!(self->ptr = self->start = calloc(n_stages, sizeof (float))))
+    if (!(self->start = rtarena_calloc(n_stages, sizeof (struct peakfilter_entry))))
         {
         fprintf(stderr, "malloc failure\n");
         exit(-5);
         }
         
-    self->end = self->start + n_stages;   
+    self->end = self->start + n_stages;
+    self->n_stages = n_stages;
+    self->now = 0;
+    
+    /* the window starts out full of silence, which reduces to a single
+     * zero valued entry that arrived on the previous sample */
+    self->head = self->tail = self->start;
+    self->head->value = 0.0f;
+    self->head->when = self->now - 1;
     self->peak = 0.0f;
     
     return self;
@@ -53,25 +62,58 @@ struct peakfilter *peakfilter_create(float window, int sample_rate)
 
 void peakfilter_destroy(struct peakfilter *self)
     {
-    free(self->start);
-    free(self);
+    rtarena_free(self->start);
+    rtarena_free(self);
     }
 
+/* peakfilter_process: the peak is the greatest of the window minimums
+ * the minimum is tracked with a monotonic deque for amortised O(1) cost
+ */
 void peakfilter_process(struct peakfilter *self, float sample)
     {
-    float least;
-    float *p;
+    float value = fabsf(sample);
+    unsigned int now = self->now++;
     
-    *self->ptr++ = fabsf(sample);
-    if (self->ptr == self->end)
-        self->ptr = self->start;
-        
-    for (p = self->start, least = HUGE_VALF; p < self->end; p++)
-        if (*p < least)
-            least = *p;
+    /* the head entry falls out of the window once it is n_stages old */
+    if (now - self->head->when >= self->n_stages)
+        {
+        if (self->head == self->tail)
+            self->head = self->tail = NULL;
+        else
+            if (++self->head == self->end)
+                self->head = self->start;
+        }
     
-    if (least > self->peak)
-        self->peak = least;
+    /* entries no smaller than the new value can never be the minimum again */
+    while (self->tail && self->tail->value >= value)
+        {
+        if (self->tail == self->head)
+            self->head = self->tail = NULL;
+        else
+            if (self->tail-- == self->start)
+                self->tail = self->end - 1;
+        }
+    
+    if (self->tail)
+        {
+        if (++self->tail == self->end)
+            self->tail = self->start;
+        }
+    else
+        self->head = self->tail = self->start;
+    
+    self->tail->value = value;
+    self->tail->when = now;
+    
+    if (self->head->value > self->peak)
+        self->peak = self->head->value;
+    }
+
+/* peakfilter_process_block: feed in a whole buffer of samples in one go */
+void peakfilter_process_block(struct peakfilter *self, const float *samples, int n_samples)
+    {
+    while (n_samples-- > 0)
+        peakfilter_process(self, *samples++);
     }
 
 float peakfilter_read(struct peakfilter *self)
@@ -82,4 +124,3 @@ float peakfilter_read(struct peakfilter *self)
     self->peak = 0.0f;
     return ret;
     }
-
@@ -17,16 +17,32 @@
 #   If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef PEAKFILTER_H
+#define PEAKFILTER_H
+
+/* monotonic deque element: a candidate window minimum and when it arrived */
+struct peakfilter_entry
+    {
+    float value;
+    unsigned int when;
+    };
+
 struct peakfilter
     {
-    float *start;
-    float *end;
-    float *ptr;
+    struct peakfilter_entry *start; /* deque storage, one slot per stage */
+    struct peakfilter_entry *end;
+    struct peakfilter_entry *head;  /* oldest entry = window minimum */
+    struct peakfilter_entry *tail;  /* newest entry */
+    unsigned int n_stages;          /* window length in samples */
+    unsigned int now;               /* running sample count */
     float peak;
     };
 
 struct peakfilter *peakfilter_create(float window, int sample_rate);
 void peakfilter_destroy(struct peakfilter *self);
 void peakfilter_process(struct peakfilter *self, float sample);
+void peakfilter_process_block(struct peakfilter *self, const float *samples, int n_samples);
 float peakfilter_read(struct peakfilter *self);
 
+#endif /* PEAKFILTER_H */
+
@@ -0,0 +1,207 @@
+/*
+#   peaks.c: waveform overviews of tracks kept on disk for the user interface
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "xlplayer.h"
+#include "indexcache.h"
+#include "peaks.h"
+
+#define PEAKS_CACHE_MAGIC "idjc peaks 1"
+#define PEAKS_ALIGN 16
+
+struct peaks
+    {
+    struct indexcache_key key;
+    int samplerate;
+    unsigned long long frames;
+    unsigned fill;                  /* frames in the bucket being made */
+    float lmin, lmax, rmin, rmax;
+    int8_t *buckets;                /* the finest level, four to a bucket */
+    size_t n_buckets, size;
+    };
+
+static int8_t peaks_scale(float v)
+    {
+    v = roundf(v * 127.0f);
+    return (v > 127.0f) ? 127 : (v < -127.0f) ? -127 : (int8_t)v;
+    }
+
+static void peaks_bucket_close(struct peaks *self)
+    {
+    int8_t *b;
+
+    if (self->n_buckets == self->size && !(self->buckets = realloc(self->buckets,
+                (self->size = self->size ? self->size * 2 : 4096) * 4)))
+        {
+        fprintf(stderr, "peaks_bucket_close: malloc failure\n");
+        exit(5);
+        }
+    b = self->buckets + self->n_buckets++ * 4;
+    b[0] = peaks_scale(self->lmin);
+    b[1] = peaks_scale(self->lmax);
+    b[2] = peaks_scale(self->rmin);
+    b[3] = peaks_scale(self->rmax);
+    self->lmin = self->lmax = self->rmin = self->rmax = 0.0f;
+    self->fill = 0;
+    }
+
+struct peaks *peaks_capture_begin(struct xlplayer *xlplayer)
+    {
+    struct peaks *self;
+    FILE *fp;
+
+    /* a track started part way through can't stand in for the whole thing */
+    if (xlplayer->seek_s)
+        return NULL;
+    if (!(self = calloc(1, sizeof (struct peaks))))
+        {
+        fprintf(stderr, "peaks_capture_begin: malloc failure\n");
+        exit(5);
+        }
+    if (!indexcache_key_init(&self->key, "peaks", xlplayer->pathname))
+        {
+        free(self);
+        return NULL;
+        }
+    if ((fp = indexcache_read_open(&self->key, PEAKS_CACHE_MAGIC)))
+        {
+        fclose(fp);
+        indexcache_key_free(&self->key);
+        free(self);
+        return NULL;
+        }
+    self->samplerate = xlplayer->samplerate;
+    return self;
+    }
+
+void peaks_capture_append(struct peaks *self, const float *left, const float *right, size_t frames)
+    {
+    self->frames += frames;
+    while (frames)
+        {
+        size_t todo = PEAKS_BUCKET_FRAMES - self->fill;
+        float lmin = self->lmin, lmax = self->lmax, rmin = self->rmin, rmax = self->rmax;
+
+        if (todo > frames)
+            todo = frames;
+        for (size_t i = 0; i < todo; ++i)
+            {
+            lmin = fminf(lmin, left[i]);
+            lmax = fmaxf(lmax, left[i]);
+            rmin = fminf(rmin, right[i]);
+            rmax = fmaxf(rmax, right[i]);
+            }
+        self->lmin = lmin;
+        self->lmax = lmax;
+        self->rmin = rmin;
+        self->rmax = rmax;
+        left += todo;
+        right += todo;
+        frames -= todo;
+        if ((self->fill += todo) == PEAKS_BUCKET_FRAMES)
+            peaks_bucket_close(self);
+        }
+    }
+
+/* peaks_coarsen: make a level from the one before, which it follows in the buffer */
+static void peaks_coarsen(const int8_t *in, size_t n_in, int8_t *out, size_t n_out)
+    {
+    for (size_t i = 0; i < n_out; ++i)
+        {
+        const int8_t *b = in + i * PEAKS_LEVEL_RATIO * 4;
+        size_t n = (n_in - i * PEAKS_LEVEL_RATIO < PEAKS_LEVEL_RATIO) ? n_in - i * PEAKS_LEVEL_RATIO : PEAKS_LEVEL_RATIO;
+        int8_t *o = out + i * 4;
+
+        memcpy(o, b, 4);
+        for (size_t j = 1; j < n; ++j)
+            {
+            const int8_t *c = b + j * 4;
+
+            o[0] = (c[0] < o[0]) ? c[0] : o[0];
+            o[1] = (c[1] > o[1]) ? c[1] : o[1];
+            o[2] = (c[2] < o[2]) ? c[2] : o[2];
+            o[3] = (c[3] > o[3]) ? c[3] : o[3];
+            }
+        }
+    }
+
+void peaks_capture_commit(struct peaks *self)
+    {
+    size_t counts[PEAKS_MAX_LEVELS], total;
+    int8_t *data, *p;
+    int levels = 1, i;
+    long pos;
+    FILE *fp;
+    char *tmp;
+
+    if (self->fill)
+        peaks_bucket_close(self);
+    if (!self->n_buckets)
+        {
+        peaks_capture_abandon(self);
+        return;
+        }
+
+    /* the levels are made in one buffer in the order they're written */
+    counts[0] = total = self->n_buckets;
+    while (levels < PEAKS_MAX_LEVELS && counts[levels - 1] > 1)
+        {
+        counts[levels] = (counts[levels - 1] + PEAKS_LEVEL_RATIO - 1) / PEAKS_LEVEL_RATIO;
+        total += counts[levels++];
+        }
+    if (!(data = realloc(self->buckets, total * 4)))
+        {
+        fprintf(stderr, "peaks_capture_commit: malloc failure\n");
+        exit(5);
+        }
+    self->buckets = data;
+    for (p = data, i = 1; i < levels; ++i)
+        {
+        peaks_coarsen(p, counts[i - 1], p + counts[i - 1] * 4, counts[i]);
+        p += counts[i - 1] * 4;
+        }
+
+    if ((fp = indexcache_write_open(&self->key, PEAKS_CACHE_MAGIC, &tmp)))
+        {
+        unsigned long frames_per_bucket = PEAKS_BUCKET_FRAMES;
+
+        fprintf(fp, "\npeaks %d %llu %d\n", self->samplerate, self->frames, levels);
+        for (i = 0; i < levels; ++i, frames_per_bucket *= PEAKS_LEVEL_RATIO)
+            fprintf(fp, "%lu %zu\n", frames_per_bucket, counts[i]);
+        fputs("data\n", fp);
+        for (pos = ftell(fp); pos % PEAKS_ALIGN; ++pos)
+            fputc('\0', fp);
+        fwrite(data, 4, total, fp);
+        indexcache_write_close(&self->key, fp, tmp);
+        }
+    peaks_capture_abandon(self);
+    }
+
+void peaks_capture_abandon(struct peaks *self)
+    {
+    indexcache_key_free(&self->key);
+    free(self->buckets);
+    free(self);
+    }
@@ -0,0 +1,55 @@
+/*
+#   peaks.h: waveform overviews of tracks kept on disk for the user interface
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PEAKS_H
+#define PEAKS_H
+
+#include <stddef.h>
+
+struct xlplayer;
+struct peaks;
+
+/* frames to a bucket of the finest level, each level after is this many times coarser */
+#define PEAKS_BUCKET_FRAMES 256
+#define PEAKS_LEVEL_RATIO 4
+#define PEAKS_MAX_LEVELS 6
+
+/* The overview is made as a side effect of decoding a track from start to end, be that
+ * for play or for a loudness scan, and goes in the index cache under "peaks" with the
+ * media pathname hashed for the file name as for any other cache entry.
+ *
+ * After the usual cache header come the lines
+ *     peaks <sample rate> <frames> <levels>
+ *     <frames per bucket> <buckets>        one line per level, finest first
+ *     data
+ * then zero padding to a multiple of 16 bytes from the start of the file, from where
+ * the levels follow each other with four signed bytes to a bucket, being the minimum
+ * and maximum of the left channel then of the right scaled so that 127 is full scale.
+ * The file is written whole and renamed into place so it can be mapped and read at any time.
+ */
+
+/* peaks_capture_begin: NULL if the track has an overview already or one can't be made */
+struct peaks *peaks_capture_begin(struct xlplayer *xlplayer);
+void peaks_capture_append(struct peaks *self, const float *left, const float *right, size_t frames);
+
+/* peaks_capture_commit: the track was decoded to the end so write out the overview */
+void peaks_capture_commit(struct peaks *self);
+void peaks_capture_abandon(struct peaks *self);
+
+#endif /* PEAKS_H */
@@ -0,0 +1,492 @@
+/*
+#   probe.c: metadata for many media files at a time
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBAV
+#include <libavformat/avformat.h>
+#endif
+
+#include "main.h"
+#include "sourceclient.h"
+#include "oggdec.h"
+#include "sndfileinfo.h"
+#include "indexcache.h"
+#include "mp3tagread.h"
+#include "sig.h"
+#include "loudness.h"
+#include "probe.h"
+
+#define PROBE_CACHE_MAGIC "idjc probe 3"
+#define MAX_THREADS 8
+
+#ifdef HAVE_LIBAV
+static const struct timespec time_delay = { .tv_nsec = 10 };
+#endif
+
+/* how the length was arrived at, in increasing order of trust */
+enum probe_accuracy { PROBE_ESTIMATE, PROBE_HEADER, PROBE_EXACT };
+
+static const char *const accuracy_names[] = { "estimate", "header", "exact" };
+
+/* the tags are never NULL and don't contain newlines */
+struct probe_result
+    {
+    int valid;
+    int accuracy;
+    double length;
+    char *artist, *title, *album, *replaygain, *rgloudness;
+    int analysed;                   /* from the loudness cache, not kept in this one */
+    double lufs, peak_db;
+    };
+
+struct probe_batch
+    {
+    char **pathnames;
+    int n;
+    int next;                       /* the next pathname for a worker to claim */
+    struct probe_result *results;
+    int *done;                      /* result indices in the order they were finished */
+    int n_done;
+    int exact;                      /* lengths must not be estimated */
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    };
+
+/* the pathnames awaiting exact lengths from the background pass */
+struct probe_refinement
+    {
+    char **pathnames;
+    int n;
+    };
+
+static int refining;                /* a background pass is under way */
+
+static int has_extension(const char *pathname, const char *const *extensions)
+    {
+    const char *ext;
+
+    if (!(ext = strrchr(pathname, '.')))
+        return FALSE;
+    for (; *extensions; ++extensions)
+        if (!strcasecmp(ext, *extensions))
+            return TRUE;
+    return FALSE;
+    }
+
+/* probe_tidy: make a tag fit on one line of the reply, a missing tag becomes empty */
+static char *probe_tidy(char *tag)
+    {
+    char *p;
+
+    if (!tag && !(tag = strdup("")))
+        {
+        fprintf(stderr, "probe_tidy: malloc failure\n");
+        exit(5);
+        }
+    for (p = tag; (p = strpbrk(p, "\r\n")); )
+        *p = ' ';
+    return tag;
+    }
+
+static void probe_result_free(struct probe_result *r)
+    {
+    free(r->artist);
+    free(r->title);
+    free(r->album);
+    free(r->replaygain);
+    free(r->rgloudness);
+    }
+
+static int probe_cache_read(struct indexcache_key *key, struct probe_result *r)
+    {
+    FILE *fp;
+    char **tags[] = { &r->artist, &r->title, &r->album, &r->replaygain, &r->rgloudness };
+    size_t size;
+    ssize_t len;
+    unsigned i;
+
+    if (!(fp = indexcache_read_open(key, PROBE_CACHE_MAGIC)))
+        return FALSE;
+    if (fscanf(fp, "%d %d %lf", &r->valid, &r->accuracy, &r->length) != 3 || fgetc(fp) != '\n' ||
+                                    r->accuracy < PROBE_ESTIMATE || r->accuracy > PROBE_EXACT)
+        {
+        fclose(fp);
+        return FALSE;
+        }
+    for (i = 0; i < sizeof tags / sizeof tags[0]; ++i)
+        {
+        size = 0;
+        if ((len = getline(tags[i], &size, fp)) < 1 || (*tags[i])[len - 1] != '\n')
+            {
+            fclose(fp);
+            probe_result_free(r);
+            memset(r, 0, sizeof (struct probe_result));
+            return FALSE;
+            }
+        (*tags[i])[len - 1] = '\0';
+        }
+    fclose(fp);
+    return TRUE;
+    }
+
+static void probe_cache_write(struct indexcache_key *key, struct probe_result *r)
+    {
+    FILE *fp;
+    char *tmp;
+
+    if ((fp = indexcache_write_open(key, PROBE_CACHE_MAGIC, &tmp)))
+        {
+        fprintf(fp, "\n%d %d %.17g\n%s\n%s\n%s\n%s\n%s\n", r->valid, r->accuracy, r->length,
+                    r->artist, r->title, r->album, r->replaygain, r->rgloudness);
+        indexcache_write_close(key, fp, tmp);
+        }
+    }
+
+/* probe_mp3: the length from the Xing or ID3 TLEN information, else from the bit rate of the first frame
+ * when exact is set and that isn't good enough every frame is visited
+ */
+static int probe_mp3(char *pathname, struct probe_result *r, int exact)
+    {
+    struct mp3taginfo ti;
+    struct stat st;
+    FILE *fp;
+    long frames;
+
+    if (!(fp = fopen(pathname, "r")))
+        return FALSE;
+    memset(&ti, 0, sizeof ti);
+    mp3_tag_read(&ti, fp);
+
+    if (ti.have_frames && ti.sample_rate)
+        {
+        frames = (long)ti.frames * ti.samples_per_frame - ti.start_frames_drop - ti.end_frames_drop;
+        r->length = (frames > 0) ? (double)frames / ti.sample_rate : 0.0;
+        r->accuracy = PROBE_HEADER;
+        }
+    else if (ti.tlen > 0)
+        {
+        r->length = ti.tlen / 1000.0;
+        r->accuracy = PROBE_HEADER;
+        }
+    else if (ti.bit_rate && !fstat(fileno(fp), &st))
+        {
+        r->length = (st.st_size - ftell(fp)) * 8.0 / (ti.bit_rate * 1000.0);
+        r->accuracy = PROBE_ESTIMATE;
+        }
+    else
+        exact = TRUE;
+
+    if (exact && r->accuracy != PROBE_EXACT)
+        {
+        if (mp3_scan_duration(fp, &ti, &r->length))
+            r->accuracy = PROBE_EXACT;
+        else if (!ti.bit_rate)
+            {
+            mp3_tag_cleanup(&ti);
+            fclose(fp);
+            return FALSE;
+            }
+        }
+    mp3_tag_cleanup(&ti);
+    fclose(fp);
+    return TRUE;
+    }
+
+#ifdef HAVE_LIBAV
+static char *probe_av_tag(AVDictionary *metadata, const char *key)
+    {
+    AVDictionaryEntry *e;
+
+    return (e = av_dict_get(metadata, key, NULL, 0)) ? strdup(e->value) : NULL;
+    }
+
+/* probe_av: the container's idea of the length, or the packet durations added up if exact */
+static int probe_av(char *pathname, struct probe_result *r, int exact)
+    {
+    AVFormatContext *ic = NULL;
+    AVPacket *pkt;
+    AVStream *st;
+    int64_t ts = 0;
+    int si = -1, ret = 0;
+
+    if (avformat_open_input(&ic, pathname, NULL, NULL) < 0)
+        return FALSE;
+    while (pthread_mutex_trylock(&g.avc_mutex))
+        nanosleep(&time_delay, NULL);
+    if (exact || ic->duration == AV_NOPTS_VALUE)
+        ret = avformat_find_stream_info(ic, NULL);
+    if (ret >= 0 && exact)
+        si = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    pthread_mutex_unlock(&g.avc_mutex);
+    if (ret < 0)
+        {
+        avformat_close_input(&ic);
+        return FALSE;
+        }
+    if (ic->duration != AV_NOPTS_VALUE)
+        {
+        r->length = (double)ic->duration / AV_TIME_BASE;
+        r->accuracy = (ic->duration_estimation_method == AVFMT_DURATION_FROM_BITRATE) ? PROBE_ESTIMATE : PROBE_HEADER;
+        }
+
+    if (si >= 0 && (pkt = av_packet_alloc()))
+        {
+        st = ic->streams[si];
+        while (av_read_frame(ic, pkt) >= 0)
+            {
+            if (pkt->stream_index == si && pkt->pts != AV_NOPTS_VALUE && pkt->pts + pkt->duration > ts)
+                ts = pkt->pts + pkt->duration;
+            av_packet_unref(pkt);
+            }
+        av_packet_free(&pkt);
+        if (ts > 0)
+            {
+            if (st->start_time != AV_NOPTS_VALUE)
+                ts -= st->start_time;
+            r->length = ts * av_q2d(st->time_base);
+            r->accuracy = PROBE_EXACT;
+            }
+        }
+
+    r->artist = probe_av_tag(ic->metadata, "artist");
+    r->title = probe_av_tag(ic->metadata, "title");
+    r->album = probe_av_tag(ic->metadata, "album");
+    r->replaygain = probe_av_tag(ic->metadata, "REPLAYGAIN_TRACK_GAIN");
+    r->rgloudness = probe_av_tag(ic->metadata, "REPLAYGAIN_REFERENCE_LOUDNESS");
+    avformat_close_input(&ic);
+    return r->length > 0.0;
+    }
+#endif
+
+/* probe_file: the tags and length of one file from the cache or by reading it
+ * a cached result that is less than exact is only used when exact isn't asked for
+ */
+static void probe_file(char *pathname, struct probe_result *r, int exact)
+    {
+    static const char *const sndfile_exts[] = { ".wav", ".aiff", ".au", NULL };
+    static const char *const ogg_exts[] = { ".ogg", ".oga", ".spx", NULL };
+    static const char *const mp3_exts[] = { ".mp3", ".mp2", NULL };
+    struct indexcache_key key;
+    int have_key;
+
+    memset(r, 0, sizeof (struct probe_result));
+    if ((have_key = indexcache_key_init(&key, "probe", pathname)) && probe_cache_read(&key, r))
+        {
+        if (!exact || !r->valid || r->accuracy == PROBE_EXACT)
+            {
+            indexcache_key_free(&key);
+            return;
+            }
+        probe_result_free(r);
+        memset(r, 0, sizeof (struct probe_result));
+        }
+
+    /* these two read the whole stream anyway */
+    r->accuracy = PROBE_EXACT;
+    if (has_extension(pathname, sndfile_exts))
+        r->valid = sndfileinfo_read(pathname, &r->length, &r->artist, &r->title, &r->album);
+    else if (has_extension(pathname, ogg_exts))
+        r->valid = oggdecode_get_metainfo(pathname, &r->artist, &r->title, &r->album, &r->length, &r->replaygain, &r->rgloudness) == 1;
+    else if (has_extension(pathname, mp3_exts))
+        r->valid = probe_mp3(pathname, r, exact);
+#ifdef HAVE_LIBAV
+    else
+        r->valid = probe_av(pathname, r, exact);
+#endif
+
+    r->artist = probe_tidy(r->artist);
+    r->title = probe_tidy(r->title);
+    r->album = probe_tidy(r->album);
+    r->replaygain = probe_tidy(r->replaygain);
+    r->rgloudness = probe_tidy(r->rgloudness);
+
+    /* files that can't be read are remembered too so a rescan skips them */
+    if (have_key)
+        {
+        probe_cache_write(&key, r);
+        indexcache_key_free(&key);
+        }
+    }
+
+/* probe_refine_main: go over files whose lengths were estimated so the cache ends up with exact ones */
+static void *probe_refine_main(void *args)
+    {
+    struct probe_refinement *pr = args;
+    struct probe_result r;
+
+    sig_mask_thread();
+    for (int i = 0; i < pr->n; ++i)
+        {
+        probe_file(pr->pathnames[i], &r, TRUE);
+        probe_result_free(&r);
+        free(pr->pathnames[i]);
+        }
+    free(pr->pathnames);
+    free(pr);
+    __atomic_store_n(&refining, FALSE, __ATOMIC_RELEASE);
+    return NULL;
+    }
+
+/* probe_refine: start the background pass over the inexact results of a batch
+ * should one already be running these are left for the next batch to pick up
+ */
+static void probe_refine(struct probe_batch *batch)
+    {
+    struct probe_refinement *pr;
+    pthread_attr_t attr;
+    pthread_t thread_h;
+    int i, rv;
+
+    for (i = 0; i < batch->n && !(batch->results[i].valid && batch->results[i].accuracy != PROBE_EXACT); ++i);
+    if (i == batch->n || __atomic_exchange_n(&refining, TRUE, __ATOMIC_ACQ_REL))
+        return;
+
+    if (!(pr = calloc(1, sizeof (struct probe_refinement))) || !(pr->pathnames = calloc(batch->n, sizeof (char *))))
+        {
+        fprintf(stderr, "probe_refine: malloc failure\n");
+        exit(5);
+        }
+    for (; i < batch->n; ++i)
+        if (batch->results[i].valid && batch->results[i].accuracy != PROBE_EXACT)
+            if (!(pr->pathnames[pr->n++] = strdup(batch->pathnames[i])))
+                {
+                fprintf(stderr, "probe_refine: malloc failure\n");
+                exit(5);
+                }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ((rv = pthread_create(&thread_h, &attr, probe_refine_main, pr)))
+        {
+        fprintf(stderr, "probe_refine: pthread_create failed with error %d\n", rv);
+        while (pr->n)
+            free(pr->pathnames[--pr->n]);
+        free(pr->pathnames);
+        free(pr);
+        __atomic_store_n(&refining, FALSE, __ATOMIC_RELEASE);
+        }
+    pthread_attr_destroy(&attr);
+    }
+
+static void *probe_worker(void *args)
+    {
+    struct probe_batch *batch = args;
+    int i;
+
+    sig_mask_thread();
+    while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->n)
+        {
+        probe_file(batch->pathnames[i], batch->results + i, batch->exact);
+        if (batch->results[i].valid)
+            batch->results[i].analysed = loudness_lookup(batch->pathnames[i], &batch->results[i].lufs, &batch->results[i].peak_db);
+        pthread_mutex_lock(&batch->mutex);
+        batch->done[batch->n_done++] = i;
+        pthread_cond_signal(&batch->cv);
+        pthread_mutex_unlock(&batch->mutex);
+        }
+    return NULL;
+    }
+
+static int probe_thread_count(int n)
+    {
+    char *env = getenv("probe_threads");
+    long count = (env && env[0]) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count > MAX_THREADS)
+        count = MAX_THREADS;
+    if (count > n)
+        count = n;
+    return (count < 1) ? 1 : count;
+    }
+
+void probe_many(char **pathnames, int n, int exact, FILE *fp)
+    {
+    struct probe_batch batch = { .pathnames = pathnames, .n = n, .exact = exact };
+    pthread_t threads[MAX_THREADS];
+    struct probe_result *r;
+    int n_threads = 0, n_wanted, written, rv;
+
+    if (n > 0)
+        {
+        if (!(batch.results = calloc(n, sizeof (struct probe_result))) || !(batch.done = calloc(n, sizeof (int))))
+            {
+            fprintf(stderr, "probe_many: malloc failure\n");
+            exit(5);
+            }
+        pthread_mutex_init(&batch.mutex, NULL);
+        pthread_cond_init(&batch.cv, NULL);
+
+        for (n_wanted = probe_thread_count(n); n_threads < n_wanted; ++n_threads)
+            if ((rv = pthread_create(threads + n_threads, NULL, probe_worker, &batch)))
+                {
+                fprintf(stderr, "probe_many: pthread_create failed with error %d\n", rv);
+                break;
+                }
+        /* with no threads at all this one does the work */
+        if (!n_threads)
+            probe_worker(&batch);
+
+        for (written = 0; written < n; ++written)
+            {
+            pthread_mutex_lock(&batch.mutex);
+            while (batch.n_done == written)
+                pthread_cond_wait(&batch.cv, &batch.mutex);
+            r = batch.results + batch.done[written];
+            pthread_mutex_unlock(&batch.mutex);
+
+            fprintf(fp, "PRB:ITEM=%d\n", batch.done[written]);
+            if (r->valid)
+                {
+                fprintf(fp, "PRB:LENGTH=%f\nPRB:ACCURACY=%s\nPRB:ARTIST=%s\nPRB:TITLE=%s\nPRB:ALBUM=%s\n"
+                            "PRB:REPLAYGAIN_TRACK_GAIN=%s\nPRB:REPLAYGAIN_REFERENCE_LOUDNESS=%s\n",
+                            r->length, accuracy_names[r->accuracy], r->artist, r->title, r->album, r->replaygain, r->rgloudness);
+                if (r->analysed)
+                    fprintf(fp, "PRB:LOUDNESS=%.2f\nPRB:LOUDNESS_GAIN=%.2f\nPRB:PEAK=%.2f\n",
+                                r->lufs, LOUDNESS_REFERENCE_LUFS - r->lufs, r->peak_db);
+                fputs("PRB:DONE\n", fp);
+                }
+            else
+                fputs("PRB:NOT VALID\n", fp);
+            fflush(fp);
+            }
+
+        while (n_threads)
+            pthread_join(threads[--n_threads], NULL);
+        if (!exact)
+            probe_refine(&batch);
+        for (written = 0; written < n; ++written)
+            probe_result_free(batch.results + written);
+        pthread_cond_destroy(&batch.cv);
+        pthread_mutex_destroy(&batch.mutex);
+        free(batch.done);
+        free(batch.results);
+        }
+
+    fputs("PRB:end\n", fp);
+    fflush(fp);
+    }
@@ -0,0 +1,34 @@
+/*
+#   probe.h: metadata for many media files at a time
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdio.h>
+
+/* probe_many: read the tags and length of each file on a pool of threads
+ * results are written to fp as they come in, each one opened by PRB:ITEM=<index>
+ * and closed by PRB:DONE or PRB:NOT VALID with a final PRB:end after the last
+ * unless exact is set lengths may come from headers or be estimated, as told by PRB:ACCURACY,
+ * in which case a background pass puts exact ones in the cache for next time
+ * files the loudness scan has been over also get PRB:LOUDNESS, PRB:LOUDNESS_GAIN and PRB:PEAK
+ */
+void probe_many(char **pathnames, int n, int exact, FILE *fp);
+
+#endif /* PROBE_H */
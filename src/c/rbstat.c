@@ -0,0 +1,89 @@
+/*
+#   rbstat.c: occupancy figures of a ringbuffer
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <time.h>
+#include "rbstat.h"
+
+static int64_t rbstat_second()
+    {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+    return t.tv_sec;
+    }
+
+void rbstat_sample(struct rbstat *self, size_t fill, size_t capacity)
+    {
+    uint32_t pm = capacity ? (uint32_t)((uint64_t)fill * 1000 / capacity) : 0;
+    int64_t second = rbstat_second();
+    int i = second % RBSTAT_SLOTS;
+
+    if (__atomic_load_n(&self->reset_due, __ATOMIC_RELAXED) && __atomic_exchange_n(&self->reset_due, 0, __ATOMIC_ACQUIRE))
+        {
+        __atomic_store_n(&self->n, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&self->sum, 0, __ATOMIC_RELAXED);
+        }
+    if (self->n == 0 || pm < self->min)
+        __atomic_store_n(&self->min, pm, __ATOMIC_RELAXED);
+    if (self->n == 0 || pm > self->max)
+        __atomic_store_n(&self->max, pm, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->sum, self->sum + pm, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->n, self->n + 1, __ATOMIC_RELAXED);
+
+    if (self->slot[i].second != second)
+        {
+        __atomic_store_n(&self->slot[i].max, pm, __ATOMIC_RELAXED);
+        __atomic_store_n(&self->slot[i].second, second, __ATOMIC_RELEASE);
+        }
+    else if (pm > self->slot[i].max)
+        __atomic_store_n(&self->slot[i].max, pm, __ATOMIC_RELAXED);
+    }
+
+void rbstat_underrun(struct rbstat *self)
+    {
+    __atomic_add_fetch(&self->underruns, 1, __ATOMIC_RELAXED);
+    }
+
+void rbstat_overrun(struct rbstat *self)
+    {
+    __atomic_add_fetch(&self->overruns, 1, __ATOMIC_RELAXED);
+    }
+
+void rbstat_format(struct rbstat *self, char sep, char *buf, size_t size)
+    {
+    uint32_t n = __atomic_load_n(&self->n, __ATOMIC_RELAXED), hwm = 0, max;
+    uint64_t sum = __atomic_load_n(&self->sum, __ATOMIC_RELAXED);
+    int64_t second = rbstat_second();
+
+    for (int i = 0; i < RBSTAT_SLOTS; ++i)
+        if (second - __atomic_load_n(&self->slot[i].second, __ATOMIC_ACQUIRE) < RBSTAT_SLOTS
+                    && (max = __atomic_load_n(&self->slot[i].max, __ATOMIC_RELAXED)) > hwm)
+            hwm = max;
+
+    if (n)
+        snprintf(buf, size, "%u%c%u%c%u%c%u%c%u%c%u", __atomic_load_n(&self->min, __ATOMIC_RELAXED), sep, (unsigned)(sum / n), sep,
+                    __atomic_load_n(&self->max, __ATOMIC_RELAXED), sep, hwm, sep,
+                    __atomic_load_n(&self->underruns, __ATOMIC_RELAXED), sep, __atomic_load_n(&self->overruns, __ATOMIC_RELAXED));
+    else
+        snprintf(buf, size, "0%c0%c0%c%u%c%u%c%u", sep, sep, sep, hwm, sep,
+                    __atomic_load_n(&self->underruns, __ATOMIC_RELAXED), sep, __atomic_load_n(&self->overruns, __ATOMIC_RELAXED));
+    __atomic_store_n(&self->reset_due, 1, __ATOMIC_RELEASE);
+    }
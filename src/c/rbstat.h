@@ -0,0 +1,60 @@
+/*
+#   rbstat.h: occupancy figures of a ringbuffer
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RBSTAT_H
+#define RBSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RBSTAT_SLOTS 10          /* seconds of the rolling high water mark */
+
+/* the fill is sampled by one thread at either end of the ringbuffer, cheaply
+ * enough for the jack callback to do so every period
+ * figures are in per mille of the capacity so buffers of any size compare
+ */
+struct rbstat
+    {
+    uint32_t min, max;           /* since the last report */
+    uint64_t sum;
+    uint32_t n;
+    uint32_t underruns;          /* reads that found less than they wanted */
+    uint32_t overruns;           /* writes dropped for want of space */
+    int reset_due;               /* the reporter asks the sampler to start a new window */
+    struct
+        {
+        int64_t second;
+        uint32_t max;
+        } slot[RBSTAT_SLOTS];
+    };
+
+/* rbstat_sample: note the fill, in the same units as the capacity */
+void rbstat_sample(struct rbstat *self, size_t fill, size_t capacity);
+
+/* rbstat_underrun and rbstat_overrun: by the thread that finds it */
+void rbstat_underrun(struct rbstat *self);
+void rbstat_overrun(struct rbstat *self);
+
+/* rbstat_format: min:avg:max:high water mark over RBSTAT_SLOTS seconds:underruns:overruns
+ * the first three are for the time since the last call, the counts are running totals
+ * sep is the character to put between the fields in place of the colons
+ */
+void rbstat_format(struct rbstat *self, char sep, char *buf, size_t size);
+
+#endif /* RBSTAT_H */
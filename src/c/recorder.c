@@ -31,8 +31,16 @@
 
 typedef jack_default_audio_sample_t sample_t;
 
-static const size_t rb_n_samples = 10000;       /* maximum number of samples to hold in the ring buffer */
-static const size_t audio_buffer_elements = 256;
+static const int packet_wait_ms = 100;          /* the longest time to wait for an encoded packet */
+static const size_t rb_n_samples = 10000;       /* default number of samples to hold in the ring buffer */
+
+/* room left at the start of tagged recordings so the tags can be written in place
+ * each chapter takes about a hundred bytes so this is plenty for a long show
+ */
+static const int id3_reserve_size = 65536;
+
+/* the offset of the xing tag within its frame [mpeg1][mono] */
+static const int side_info_table[2][2] = { { 17, 9 } , { 32, 17 } };
 
 #if 0
 static void recorder_write_ogg_metaheader(struct recorder *self)
@@ -121,14 +129,21 @@ static void recorder_write_ogg_metaheader(struct recorder *self)
     }
 #endif /* recorder_write_ogg_metaheader */
 
-static int recorder_write_id3_tag(struct recorder *self, FILE *fp)
+/* recorder_segment_ms: the length of the current file, which is the whole recording unless it is segmented */
+static int recorder_segment_ms(struct recorder *self)
+    {
+    return self->recording_length_ms - self->segment_start_ms;
+    }
+
+/* recorder_make_id3_tag: a compiled tag with the chapters logged so far */
+static struct id3_tag *recorder_make_id3_tag(struct recorder *self, int padding)
     {
     struct metadata_item *mi;
     struct id3_tag *tag;
     struct id3_frame *chap;
 
-    tag = id3_tag_new(0, 512);
-    id3_add_frame(tag, id3_numeric_string_frame_new("TLEN", self->recording_length_ms));
+    tag = id3_tag_new(0, padding);
+    id3_add_frame(tag, id3_numeric_string_frame_new("TLEN", recorder_segment_ms(self)));
     for (mi = self->mi_first; mi; mi = mi->next)
         {
         chap = id3_chap_frame_new("", mi->time_offset, mi->time_offset_end, mi->byte_offset, mi->byte_offset_end);
@@ -140,6 +155,14 @@ static int recorder_write_id3_tag(struct recorder *self, FILE *fp)
         id3_add_frame(tag, chap);
         }
     id3_compile(tag);
+    return tag;
+    }
+
+static int recorder_write_id3_tag(struct recorder *self, FILE *fp)
+    {
+    struct id3_tag *tag;
+
+    tag = recorder_make_id3_tag(self, 512);
     if (fwrite(tag->tag_data, 1, tag->tag_data_size, fp) != tag->tag_data_size)
         {
         fprintf(stderr, "recorder_write_id3_tag: error writing to file\n");
@@ -196,16 +219,15 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
     {
     int mpeg1_f, mono_f;
     int xing_offset, initial_offset;
-    int side_info_table[2][2] = { { 17, 9 } , { 32, 17 } };
-    int i, total_frames, samples_per_frame, framelength, padding, frame_fill;
-    double seek, look_ms, seg_prop;
-    unsigned char seek_table[100], *ptr;
-    struct metadata_item2 *mi2;
+    int i, seg, end_ms, end_bytes, total_frames, samples_per_frame, framelength, padding, frame_fill;
+    double look_ms, seg_prop;
+    unsigned char seek_table[100];
+    struct recorder_toc *toc = &self->toc;
 
     if (!self->include_xing_tag)
         return SUCCEEDED;
 
-    if (self->mi2_first == NULL)
+    if (!toc->n_points || !toc->sample_rate)
         {
         fprintf(stderr, "recorder_write_xing_tag: no metadata collected, skipping vbr tag\n");
         return SUCCEEDED;
@@ -216,7 +238,7 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
     mpeg1_f = ((self->first_mp3_header[1] & 0x18) == 0x18) ? 1 : 0;
     mono_f = ((self->first_mp3_header[3] & 0xC0) == 0xC0) ? 1 : 0;
     samples_per_frame = mpeg1_f ? 1152 : 576;
-    framelength = samples_per_frame / 8 * self->mi2_first->bit_rate * 1000 / self->mi2_first->sample_rate + padding;
+    framelength = samples_per_frame / 8 * toc->bit_rate * 1000 / toc->sample_rate + padding;
     xing_offset = side_info_table[mpeg1_f][mono_f];
     if (!fwrite(self->first_mp3_header, 4, 1, fp))
         return FAILED;
@@ -238,7 +260,7 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
     /* the following calculation is fake for files with varying sample rates
      * however the players which use this value will probably only use it
      * for calclulating the play duration which will yield the intended result */
-    total_frames = (int)(self->mi2_first->sample_rate * (double)self->recording_length_ms / (samples_per_frame * 1000.0) + 0.5);
+    total_frames = (int)(toc->sample_rate * (double)recorder_segment_ms(self) / (samples_per_frame * 1000.0) + 0.5);
     fputc((total_frames >> 24) & 0xFF, fp);
     fputc((total_frames >> 16) & 0xFF, fp);
     fputc((total_frames >> 8 ) & 0xFF, fp);
@@ -251,20 +273,18 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
         {
         fprintf(stderr, "recorder_write_xing_tag: creating a seek table\n");
         /* generate a vbr seek table with 100 entries in it */
-        for (seek = 0.0, ptr = seek_table, mi2 = self->mi2_first; seek < 1.0; seek += 0.01, ptr++)
+        for (i = 0, seg = 0; i < 100; i++)
             {
-            look_ms = seek * self->recording_length_ms;
-            while (look_ms > mi2->finish_offset_ms)
-                {
-                mi2 = mi2->next;
-                if (mi2 == NULL)    /* this should never ever happen */
-                    {
-                    fprintf(stderr, "recorder_write_xing_tag: WARNING: bad metadata, failed creation of seek table\n");
-                    return FAILED;
-                    }
-                }
-            seg_prop = (look_ms - mi2->start_offset_ms) / (double)(mi2->finish_offset_ms - mi2->start_offset_ms);
-            *ptr = (((seg_prop * mi2->size_bytes) + mi2->byte_offset) / self->bytes_written * 255);
+            look_ms = i * 0.01 * recorder_segment_ms(self);
+            while (seg + 1 < toc->n_points && toc->ms[seg + 1] <= look_ms)
+                seg++;
+            /* interpolate between samples, the last one runs to the end of the recording */
+            if (seg + 1 < toc->n_points)
+                end_ms = toc->ms[seg + 1], end_bytes = toc->bytes[seg + 1];
+            else
+                end_ms = recorder_segment_ms(self), end_bytes = self->bytes_written;
+            seg_prop = (end_ms > toc->ms[seg]) ? (look_ms - toc->ms[seg]) / (end_ms - toc->ms[seg]) : 0.0;
+            seek_table[i] = (toc->bytes[seg] + seg_prop * (end_bytes - toc->bytes[seg])) / self->bytes_written * 255;
             }
         if (!(fwrite(seek_table, 100, 1, fp)))
             return FAILED;
@@ -279,6 +299,87 @@ static int recorder_write_xing_tag(struct recorder *self, FILE *fp)
     return SUCCEEDED;
     }
 
+/* recorder_reserve_tags: hold space for the tags ahead of the first audio packet
+ * a placeholder id3 tag fills it so a recording that never finishes is still valid
+ */
+static int recorder_reserve_tags(struct recorder *self, struct encoder_op_packet *packet)
+    {
+    unsigned char *h = packet->data;
+    struct id3_tag *tag;
+    char *zeros;
+    int rv;
+
+    self->xing_reserve = 0;
+    if (self->include_xing_tag)
+        {
+        if (packet->header.data_size >= 4 && h[0] == 0xFF && (h[1] & 0xE0) == 0xE0 && packet->header.sample_rate)
+            {
+            int mpeg1_f = ((h[1] & 0x18) == 0x18) ? 1 : 0;
+            int mono_f = ((h[3] & 0xC0) == 0xC0) ? 1 : 0;
+            int framelength = (mpeg1_f ? 1152 : 576) / 8 * packet->header.bit_rate * 1000 / packet->header.sample_rate + ((h[2] & 0x2) ? 1 : 0);
+            /* frame header, side info, tag, frame and byte counts, seek table and its terminator */
+            int content = 4 + side_info_table[mpeg1_f][mono_f] + 8 + 8 + 101;
+
+            memcpy(self->first_mp3_header, h, 4);
+            self->xing_reserve = (framelength > content) ? framelength : content;
+            }
+        else
+            {
+            fprintf(stderr, "recorder_reserve_tags: no frame header at the start of the stream, skipping vbr tag\n");
+            self->include_xing_tag = FALSE;
+            }
+        }
+
+    tag = recorder_make_id3_tag(self, 0);
+    if (!id3_pad_to(tag, id3_reserve_size) || !(zeros = calloc(1, self->xing_reserve + 1)))
+        {
+        fprintf(stderr, "recorder_reserve_tags: failed to make the placeholder, tagging will rewrite the file\n");
+        id3_tag_destroy(tag);
+        self->xing_reserve = 0;
+        return SUCCEEDED;
+        }
+    self->id3_reserve = id3_reserve_size;
+    rv = disk_writer_write(self->dw, tag->tag_data, tag->tag_data_size) && disk_writer_write(self->dw, zeros, self->xing_reserve);
+    id3_tag_destroy(tag);
+    free(zeros);
+    return rv ? SUCCEEDED : FAILED;
+    }
+
+/* recorder_patch_mp3_tags: overwrite the reserved space at the head of the file with the final tags */
+static int recorder_patch_mp3_tags(struct recorder *self)
+    {
+    struct id3_tag *tag;
+    FILE *fp;
+    long pos;
+    int rv = FAILED;
+
+    tag = recorder_make_id3_tag(self, 0);
+    if (!id3_pad_to(tag, self->id3_reserve))
+        {
+        fprintf(stderr, "recorder_patch_mp3_tags: the id3 tag outgrew its reserved space\n");
+        id3_tag_destroy(tag);
+        return FAILED;
+        }
+    if (!(fp = fopen(self->pathname, "r+")))
+        {
+        fprintf(stderr, "recorder_patch_mp3_tags: failed to open the mp3 file\n");
+        id3_tag_destroy(tag);
+        return FAILED;
+        }
+    if (fwrite(tag->tag_data, 1, tag->tag_data_size, fp) == tag->tag_data_size && recorder_write_xing_tag(self, fp))
+        {
+        /* what the xing frame didn't use is left as padding ahead of the audio */
+        for (pos = ftell(fp); pos < self->id3_reserve + self->xing_reserve; pos++)
+            fputc('\0', fp);
+        if (!ferror(fp))
+            rv = SUCCEEDED;
+        }
+    if (fclose(fp))
+        rv = FAILED;
+    id3_tag_destroy(tag);
+    return rv;
+    }
+
 static void recorder_apply_mp3_tags(struct recorder *self)
     {
     char *tmpname;
@@ -291,6 +392,12 @@ static void recorder_apply_mp3_tags(struct recorder *self)
         fprintf(stderr, "recorder_apply_mp3_tags: malloc failure\n");
         return;
         }
+    if (self->id3_reserve && recorder_patch_mp3_tags(self))
+        {
+        free(tmpname);
+        fprintf(stderr, "recorder_apply_mp3_tags: successfully tagged the mp3 file in place\n");
+        return;
+        }
     strcpy(tmpname, self->pathname);
     strcat(tmpname, ".tmp");
     if (!(fpw = fopen(tmpname, "w+")))
@@ -308,7 +415,8 @@ static void recorder_apply_mp3_tags(struct recorder *self)
         return;
         }
 
-    if (!fread(self->first_mp3_header, 4, 1, fpr))
+    /* the audio follows whatever space was reserved for the tags */
+    if (fseek(fpr, self->id3_reserve + self->xing_reserve, SEEK_SET) || !fread(self->first_mp3_header, 4, 1, fpr))
         {
         fprintf(stderr, "failed to obtain the first four bytes of the recording\n");
         fclose(fpr);
@@ -317,7 +425,7 @@ static void recorder_apply_mp3_tags(struct recorder *self)
         free(tmpname);
         return;
         }
-    rewind(fpr);
+    fseek(fpr, self->id3_reserve + self->xing_reserve, SEEK_SET);
 
     if (!(recorder_write_id3_tag(self, fpw) && recorder_write_xing_tag(self, fpw)))
         {
@@ -355,81 +463,65 @@ static void recorder_apply_mp3_tags(struct recorder *self)
     fprintf(stderr, "recorder_apply_mp3_tags: successfully tagged the mp3 file\n");
     }
 
-static void recorder_append_metadata2(struct recorder *self, struct encoder_op_packet *packet)
+/* recorder_toc_add: sample the file position for the seek table
+ * the samples are evenly spaced in time, when the table fills every other one
+ * goes and the spacing doubles so memory use stays the same however long the recording
+ */
+static void recorder_toc_add(struct recorder *self)
     {
-    struct metadata_item2 *mi2;
+    struct recorder_toc *toc = &self->toc;
+    int i;
 
-    if (!(mi2 = calloc(1, sizeof (struct metadata_item2))))
+    if (!toc->n_points)
         {
-        fprintf(stderr, "recorder_append_metadata2: malloc failure\n");
-        return;
+        /* the recording starts at the start of the audio */
+        toc->ms[0] = toc->bytes[0] = 0;
+        toc->n_points = 1;
+        toc->interval_ms = toc->next_ms = 1000;
         }
-    if (!(self->mi2_first))
+    if (recorder_segment_ms(self) < toc->next_ms)
+        return;
+    if (toc->n_points == RECORDER_TOC_POINTS)
         {
-        mi2->start_offset_ms = 0;
-        mi2->byte_offset = 0;
-        if (packet)
+        for (i = 0; i < RECORDER_TOC_POINTS / 2; i++)
             {
-            mi2->bit_rate = packet->header.bit_rate;
-            mi2->sample_rate = packet->header.sample_rate;
+            toc->ms[i] = toc->ms[i * 2];
+            toc->bytes[i] = toc->bytes[i * 2];
             }
-        self->mi2_first = mi2;
-        self->mi2_last = mi2;
+        toc->n_points = RECORDER_TOC_POINTS / 2;
+        toc->interval_ms *= 2;
         }
-    else
+    toc->ms[toc->n_points] = recorder_segment_ms(self);
+    toc->bytes[toc->n_points++] = self->bytes_written;
+    toc->next_ms = toc->ms[toc->n_points - 1] + toc->interval_ms;
+    }
+
+/* recorder_toc_new_stream: note the frame format at the start of each stream */
+static void recorder_toc_new_stream(struct recorder *self, struct encoder_op_packet *packet)
+    {
+    if (!self->toc.sample_rate)
         {
-        mi2->start_offset_ms = self->recording_length_ms;
-        mi2->byte_offset = self->bytes_written;
-        if (packet)
-            {
-            mi2->bit_rate = packet->header.bit_rate;
-            mi2->sample_rate = packet->header.sample_rate;
-            }
-        self->mi2_last->finish_offset_ms = mi2->start_offset_ms;
-        self->mi2_last->size_bytes = mi2->byte_offset - self->mi2_last->byte_offset;
-        if (packet)
-            {
-            self->mi2_last->next = mi2;
-            self->mi2_last = mi2;
-            }
-        else
-            free(mi2);
+        self->toc.bit_rate = packet->header.bit_rate;
+        self->toc.sample_rate = packet->header.sample_rate;
         }
-    if (packet && (packet->header.bit_rate != self->oldbitrate || packet->header.sample_rate != self->oldsamplerate) && (packet->header.flags & (PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2)))
+    if ((packet->header.bit_rate != self->oldbitrate || packet->header.sample_rate != self->oldsamplerate) && (packet->header.flags & (PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2)))
         {
         if (self->oldbitrate && self->oldsamplerate)
             {
             self->is_vbr = TRUE;
-            fprintf(stderr, "recorder_append_metadata2: the mp3 frame length altered\n");
+            fprintf(stderr, "recorder_toc_new_stream: the mp3 frame length altered\n");
             }
         self->oldbitrate = packet->header.bit_rate;
         self->oldsamplerate = packet->header.sample_rate;
         }
     }
 
-static void recorder_free_metadata2(struct recorder *self)
+static void recorder_display_toc(struct recorder *self)
     {
-    struct metadata_item2 *mi2, *oldmi2;
-
-    for (mi2 = self->mi2_first; mi2;)
-        {
-        oldmi2 = mi2;
-        mi2 = mi2->next;
-        free(oldmi2);
-        }
-    self->mi2_first = NULL;
-    self->mi2_last = NULL;
-    }
+    struct recorder_toc *toc = &self->toc;
 
-static void recorder_display_logged_metadata2(struct metadata_item2 *mi2)
-    {
-    if (mi2)
-        {
-        fprintf(stderr, "The following metadata was also logged.\n");
-        do {
-            fprintf(stderr, "Start(ms): %06d  Finish(ms): %06d  Byte offset: %06d  Size(bytes): %06d\n", mi2->start_offset_ms, mi2->finish_offset_ms, mi2->byte_offset, mi2->size_bytes);
-            } while ((mi2 = mi2->next));
-        }
+    if (toc->n_points)
+        fprintf(stderr, "The file position was also logged %d times at %d ms intervals.\n", toc->n_points, toc->interval_ms);
     else
         fprintf(stderr, "No start position for the stream was logged!\n");
     }
@@ -467,7 +559,7 @@ static void recorder_append_metadata(struct recorder *self, struct encoder_op_pa
     mi->artist = strdup(artist);
     mi->title = strdup(title);
     mi->album = strdup(album);
-    mi->time_offset = self->recording_length_ms;
+    mi->time_offset = recorder_segment_ms(self);
     mi->byte_offset = self->bytes_written;
     if (!(self->mi_first))
         {
@@ -524,19 +616,321 @@ static void recorder_display_logged_metadata(struct metadata_item *mi)
         fprintf(stderr, "No metadata was logged for the recording.\n");
     }
 
+/* recorder_meta_event_new: a copy of a song change in a single allocation */
+static struct recorder_meta_event *recorder_meta_event_new(const char *artist, const char *title, const char *album)
+    {
+    struct recorder_meta_event *ev;
+    size_t la = strlen(artist) + 1, lt = strlen(title) + 1, lb = strlen(album) + 1;
+
+    if (!(ev = malloc(sizeof (struct recorder_meta_event) + la + lt + lb)))
+        {
+        fprintf(stderr, "recorder_meta_event_new: malloc failure\n");
+        return NULL;
+        }
+    ev->artist = memcpy((char *)(ev + 1), artist, la);
+    ev->title = memcpy(ev->artist + la, title, lt);
+    ev->album = memcpy(ev->title + lt, album, lb);
+    return ev;
+    }
+
+/* recorder_meta_push: queue a song change for the cue sheet, FAILED when the queue is full */
+static int recorder_meta_push(struct recorder *self, struct recorder_meta_event *ev)
+    {
+    unsigned head = self->meta_head;
+
+    if (head - __atomic_load_n(&self->meta_tail, __ATOMIC_ACQUIRE) == RECORDER_META_QUEUE)
+        return FAILED;
+    self->meta_queue[head % RECORDER_META_QUEUE] = ev;
+    __atomic_store_n(&self->meta_head, head + 1, __ATOMIC_RELEASE);
+    return SUCCEEDED;
+    }
+
+/* recorder_meta_pop: the oldest queued song change or NULL, which the caller frees */
+static struct recorder_meta_event *recorder_meta_pop(struct recorder *self)
+    {
+    unsigned tail = self->meta_tail;
+    struct recorder_meta_event *ev;
+
+    if (tail == __atomic_load_n(&self->meta_head, __ATOMIC_ACQUIRE))
+        return NULL;
+    ev = self->meta_queue[tail % RECORDER_META_QUEUE];
+    __atomic_store_n(&self->meta_tail, tail + 1, __ATOMIC_RELEASE);
+    return ev;
+    }
+
+/* recorder_meta_drain: discard whatever is queued, only while no recording is consuming */
+static void recorder_meta_drain(struct recorder *self)
+    {
+    struct recorder_meta_event *ev;
+
+    while ((ev = recorder_meta_pop(self)))
+        free(ev);
+    }
+
+/* how long before a file switch the next file is opened */
+static const int segment_lead_s = 10;
+
+/* recorder_segment_deadline: the next multiple of the period by the local clock
+ * so hourly files start on the hour, one that would be very short is skipped
+ */
+static time_t recorder_segment_deadline(int period_s)
+    {
+    time_t t = time(NULL), due;
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    due = t - (t + tm.tm_gmtoff) % period_s + period_s;
+    if (due - t < period_s / 10)
+        due += period_s;
+    return due;
+    }
+
+/* recorder_segment_name: pathname of segment n with the given extension, the first has no number */
+static char *recorder_segment_name(struct recorder *self, int n, const char *ext)
+    {
+    char *name;
+    size_t size = strlen(self->segment_base) + strlen(ext) + 16;
+
+    if (!(name = malloc(size)))
+        {
+        fprintf(stderr, "recorder_segment_name: malloc failure\n");
+        return NULL;
+        }
+    if (n > 1)
+        snprintf(name, size, "%s-%03d%s", self->segment_base, n, ext);
+    else
+        snprintf(name, size, "%s%s", self->segment_base, ext);
+    return name;
+    }
+
+/* recorder_segment_prepare: open the next file ahead of time so the switch costs nothing */
+static void recorder_segment_prepare(struct recorder *self)
+    {
+    if (self->next_dw || time(NULL) < self->segment_due - segment_lead_s)
+        return;
+    if (!(self->next_pathname = recorder_segment_name(self, self->segment_n + 1, self->segment_ext)))
+        {
+        self->segment_due += self->segment_s;
+        return;
+        }
+    if (!(self->next_dw = disk_writer_open(self->next_pathname)))
+        {
+        fprintf(stderr, "recorder_segment_prepare: carrying on with %s\n", self->pathname);
+        free(self->next_pathname);
+        self->next_pathname = NULL;
+        self->segment_due += self->segment_s;
+        }
+    }
+
+/* recorder_segment_discard: drop a next file that was opened but never used */
+static void recorder_segment_discard(struct recorder *self)
+    {
+    if (self->next_dw)
+        {
+        disk_writer_close(self->next_dw);
+        unlink(self->next_pathname);
+        free(self->next_pathname);
+        self->next_dw = NULL;
+        self->next_pathname = NULL;
+        }
+    }
+
+/* recorder_segment_finalise: complete a finished file, the recorder is a copy owned by the caller */
+static void recorder_segment_finalise(struct recorder *job)
+    {
+    if (!disk_writer_close(job->dw))
+        fprintf(stderr, "recorder_segment_finalise: failed writing to file %s\n", job->pathname);
+    if (job->id3_mode)
+        {
+        recorder_display_logged_metadata(job->mi_first);
+        recorder_display_toc(job);
+        recorder_apply_mp3_tags(job);
+        recorder_create_mp3_cuesheet(job);
+        recorder_free_metadata(job);
+        }
+    fprintf(stderr, "recorder_segment_finalise: finished with %s\n", job->pathname);
+    free(job->pathname);
+    free(job->cuepathname);
+    free(job->timestamp);
+    }
+
+static void *recorder_segment_main(void *args)
+    {
+    struct recorder *job = args;
+    struct recorder *owner = job->segment_owner;
+
+    sig_mask_thread();
+    recorder_segment_finalise(job);
+    free(job);
+    __atomic_sub_fetch(&owner->finalisers, 1, __ATOMIC_RELEASE);
+    return NULL;
+    }
+
+/* recorder_segment_continue: the song playing across the switch is the first chapter of the new file */
+static void recorder_segment_continue(struct recorder *self, struct metadata_item *last)
+    {
+    struct metadata_item *mi;
+
+    if (!last || !(mi = calloc(1, sizeof (struct metadata_item))))
+        return;
+    if (!(mi->artist = strdup(last->artist)) || !(mi->title = strdup(last->title)) || !(mi->album = strdup(last->album)))
+        {
+        fprintf(stderr, "recorder_segment_continue: malloc failure\n");
+        free(mi->artist);
+        free(mi->title);
+        free(mi);
+        return;
+        }
+    self->mi_first = self->mi_last = mi;
+    }
+
+/* recorder_segment_switch: hand the current file to a finaliser thread and carry on into the next one */
+static void recorder_segment_switch(struct recorder *self)
+    {
+    struct recorder *job, local;
+    pthread_attr_t attr;
+    pthread_t thread_h;
+    char *cuepathname;
+
+    if (self->id3_mode)
+        recorder_append_metadata(self, NULL);
+    /* the finaliser works on a shallow copy, everything it touches is handed over to it */
+    if ((job = malloc(sizeof (struct recorder))))
+        *job = *self;
+    else
+        {
+        fprintf(stderr, "recorder_segment_switch: malloc failure, finishing %s here\n", self->pathname);
+        local = *self;
+        }
+    if (!(cuepathname = recorder_segment_name(self, self->segment_n + 1, ".cue")) || !(self->timestamp = strdup(self->timestamp)))
+        {
+        fprintf(stderr, "recorder_segment_switch: malloc failure\n");
+        exit(5);
+        }
+
+    self->dw = self->next_dw;
+    self->pathname = self->next_pathname;
+    self->cuepathname = cuepathname;
+    self->next_dw = NULL;
+    self->next_pathname = NULL;
+    self->mi_first = self->mi_last = NULL;
+    if (self->id3_mode)
+        recorder_segment_continue(self, job ? job->mi_last : local.mi_last);
+    memset(&self->toc, 0, sizeof self->toc);
+    self->toc.bit_rate = self->oldbitrate;
+    self->toc.sample_rate = self->oldsamplerate;
+    memset(self->first_mp3_header, 0x00, 4);
+    self->id3_reserve = 0;
+    self->xing_reserve = 0;
+    self->is_vbr = FALSE;
+    self->bytes_written = 0;
+    self->segment_start_ms = self->recording_length_ms;
+    self->segment_n++;
+    self->segment_due = recorder_segment_deadline(self->segment_s);
+    fprintf(stderr, "recorder_segment_switch: now recording to %s\n", self->pathname);
+
+    if (!job)
+        {
+        recorder_segment_finalise(&local);
+        return;
+        }
+    job->segment_owner = self;
+    __atomic_add_fetch(&self->finalisers, 1, __ATOMIC_ACQUIRE);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread_h, &attr, recorder_segment_main, job))
+        {
+        fprintf(stderr, "recorder_segment_switch: pthread_create failed, finishing the file here\n");
+        recorder_segment_main(job);
+        }
+    pthread_attr_destroy(&attr);
+    }
+
+/* recorder_segment_cache_headers: keep a copy of the ogg or webm headers of the current stream */
+static void recorder_segment_cache_headers(struct recorder *self, struct encoder_op_packet *packet)
+    {
+    char *p;
+
+    if (packet->header.serial != self->segment_headers_serial)
+        {
+        self->segment_headers_size = 0;
+        self->segment_headers_serial = packet->header.serial;
+        }
+    if (!(p = realloc(self->segment_headers, self->segment_headers_size + packet->header.data_size)))
+        {
+        fprintf(stderr, "recorder_segment_cache_headers: malloc failure\n");
+        return;
+        }
+    memcpy(p + self->segment_headers_size, packet->data, packet->header.data_size);
+    self->segment_headers = p;
+    self->segment_headers_size += packet->header.data_size;
+    }
+
+/* recorder_segment_split: switch files at the first boundary in this packet once the deadline has passed
+ * what precedes the boundary finishes the old file and the packet is trimmed to the remainder
+ */
+static int recorder_segment_split(struct recorder *self, struct encoder_op_packet *packet)
+    {
+    ssize_t offset;
+    int repeat_headers;
+
+    if (!self->next_dw || time(NULL) < self->segment_due)
+        return SUCCEEDED;
+    if (packet->header.flags & PF_HEADER)
+        {
+        /* a new stream carries its own headers so that is a boundary, the rest of them aren't */
+        if (!(packet->header.flags & PF_INITIAL))
+            return SUCCEEDED;
+        offset = 0;
+        repeat_headers = FALSE;
+        }
+    else
+        {
+        if ((packet->header.flags & PF_FINAL) || (offset = encoder_packet_boundary(packet)) < 0)
+            return SUCCEEDED;
+        repeat_headers = (packet->header.flags & (PF_OGG | PF_WEBM)) && packet->header.serial == self->segment_headers_serial;
+        }
+
+    if (offset && !disk_writer_write(self->dw, packet->data, offset))
+        return FAILED;
+    self->bytes_written = disk_writer_tell(self->dw) - self->id3_reserve - self->xing_reserve;
+    recorder_segment_switch(self);
+    packet->data = (char *)packet->data + offset;
+    packet->header.data_size -= offset;
+    if (repeat_headers && !disk_writer_write(self->dw, self->segment_headers, self->segment_headers_size))
+        return FAILED;
+    return SUCCEEDED;
+    }
+
 static void *recorder_main(void *args)
     {
     struct recorder *self = args;
     struct timespec ms10 = { 0, 10000000 };
     struct encoder_op_packet *packet;
-    char *rl, *rr, *w, *endp;
-    size_t nbytes;
+    struct recorder_meta_event *ev;
+    jack_ringbuffer_data_t vec[2];
+    size_t n_frames;
     int m, s, f;
+    unsigned int n_overruns;
+    char id[12];
 
     sig_mask_thread();
+    snprintf(id, sizeof id, "%d", self->numeric_id);
+    threadstat_name("recorder", id);
     while (!self->thread_terminate_f)
         {
-        nanosleep(&ms10, NULL);
+        threadstat_sample(&self->threadstat);
+        /* encoded recordings sleep until the encoder has something for us */
+        if (self->record_mode == RM_RECORDING && self->initial_serial != -1)
+            encoder_client_wait_packet(self->encoder_op, packet_wait_ms);
+        else
+            nanosleep(&ms10, NULL);
+
+        if ((n_overruns = audio_feed_new_overruns(&self->afdata)))
+            {
+            self->performance_warning_indicator = PW_AUDIO_DATA_DROPPED;
+            fprintf(stderr, "recorder_main: recorder %d dropped %u periods of audio\n", self->numeric_id, n_overruns);
+            }
 
         switch (self->record_mode)
             {
@@ -549,25 +943,15 @@ static void *recorder_main(void *args)
             case RM_RECORDING:
                 if (self->initial_serial == -1)
                     {
-                    while ((nbytes = jack_ringbuffer_read(self->afdata.input_rb[1], self->right, audio_buffer_elements * sizeof (sample_t))))
-                        {
-                        jack_ringbuffer_read(self->afdata.input_rb[0], self->left, nbytes);
-                        rl = self->left;
-                        rr = self->right;
-                        endp = rl + nbytes;
-                        w = self->combined;
-                        while (rl != endp)
+                    /* the frames are already interleaved so libsndfile takes them from the ringbuffer in place */
+                    jack_ringbuffer_get_read_vector(self->afdata.input_rb[0], vec);
+                    for (int r = 0; r < 2; r++)
+                        if ((n_frames = vec[r].len / (2 * sizeof (sample_t))))
                             {
-                            for (unsigned i = 0; i < sizeof (sample_t); i++)
-                                *w++ = *rl++;
-                            for (unsigned i = 0; i < sizeof (sample_t); i++)
-                                *w++ = *rr++;
+                            sf_writef_float(self->sf, (float *)vec[r].buf, n_frames);
+                            jack_ringbuffer_read_advance(self->afdata.input_rb[0], n_frames * 2 * sizeof (sample_t));
+                            self->sf_samples += n_frames;
                             }
-                        sf_writef_float(self->sf, (float *)self->combined, nbytes / sizeof (sample_t));
-                        self->sf_samples += nbytes / sizeof (sample_t);
-                        if (self->stop_request || self->pause_request)
-                            break;
-                        }
                     self->recording_length_s = self->sf_samples / self->sfinfo.samplerate;
                     self->recording_length_ms = self->sf_samples * 1000 / self->sfinfo.samplerate;
 
@@ -582,16 +966,13 @@ static void *recorder_main(void *args)
                         self->record_mode = RM_PAUSED;
                         }
 
-                    if (self->new_artist_title)
+                    while ((ev = recorder_meta_pop(self)))
                         {
                         fprintf(self->fpcue, "  TRACK %02d AUDIO\r\n", ++self->artist_title_writes);
-
-                        pthread_mutex_lock(&self->artist_title_mutex);
-                        self->new_artist_title = FALSE;
-                        fprintf(self->fpcue, "    TITLE \"%s\"\r\n", self->title);
-                        fprintf(self->fpcue, "    PERFORMER \"%s\"\r\n", self->artist);
-                        fprintf(self->fpcue, "    REM ALBUM \"%s\"\r\n", self->album);
-                        pthread_mutex_unlock(&self->artist_title_mutex);
+                        fprintf(self->fpcue, "    TITLE \"%s\"\r\n", ev->title);
+                        fprintf(self->fpcue, "    PERFORMER \"%s\"\r\n", ev->artist);
+                        fprintf(self->fpcue, "    REM ALBUM \"%s\"\r\n", ev->album);
+                        free(ev);
 
                         if (self->artist_title_writes > 1) {
                             s = self->recording_length_s % 60;
@@ -606,15 +987,29 @@ static void *recorder_main(void *args)
                     }
                 else
                     {
-                    if ((packet = encoder_client_get_packet(self->encoder_op)))
+                    if (self->segment_s)
+                        recorder_segment_prepare(self);
+                    if ((packet = encoder_client_read_packet(self->encoder_op)))
                         {
                         if (packet->header.serial >= self->initial_serial)
                             {
                             if ((packet->header.flags & PF_INITIAL) && self->id3_mode)
-                                recorder_append_metadata2(self, packet);
+                                recorder_toc_new_stream(self, packet);
                             if (packet->header.flags & (PF_WEBM | PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
                                 {
-                                if (packet->header.data_size != fwrite(packet->data, 1, packet->header.data_size, self->fp))
+                                if (self->segment_s && (packet->header.flags & PF_HEADER) && (packet->header.flags & (PF_OGG | PF_WEBM)))
+                                    recorder_segment_cache_headers(self, packet);
+                                if (self->segment_s && !recorder_segment_split(self, packet))
+                                    {
+                                    fprintf(stderr, "recorder_main: failed writing to file %s\n", self->pathname);
+                                    self->record_mode = RM_STOPPING;
+                                    }
+                                else if (self->id3_mode && disk_writer_tell(self->dw) == 0 && packet->header.data_size && !recorder_reserve_tags(self, packet))
+                                    {
+                                    fprintf(stderr, "recorder_main: failed writing to file %s\n", self->pathname);
+                                    self->record_mode = RM_STOPPING;
+                                    }
+                                else if (!disk_writer_write(self->dw, packet->data, packet->header.data_size))
                                     {
                                     fprintf(stderr, "recorder_main: failed writing to file %s\n", self->pathname);
                                     self->record_mode = RM_STOPPING;
@@ -623,7 +1018,9 @@ static void *recorder_main(void *args)
                                     {
                                     self->recording_length_s = (int)(self->accumulated_time + packet->header.timestamp);
                                     self->recording_length_ms = (int)((self->accumulated_time + packet->header.timestamp) * 1000.0);
-                                    self->bytes_written = ftell(self->fp);
+                                    self->bytes_written = disk_writer_tell(self->dw) - self->id3_reserve - self->xing_reserve;
+                                    if (self->id3_mode)
+                                        recorder_toc_add(self);
                                     }
                                 }
                             if (packet->header.flags & PF_FINAL)
@@ -639,7 +1036,6 @@ static void *recorder_main(void *args)
                             }
                         if (packet->header.flags & PF_METADATA)
                             recorder_append_metadata(self, packet);
-                        encoder_client_free_packet(packet);
                         }
                     if (self->stop_request)
                         {
@@ -660,10 +1056,7 @@ static void *recorder_main(void *args)
                     self->record_mode = RM_STOPPING;
                 else
                     {
-                    while ((nbytes = jack_ringbuffer_read(self->afdata.input_rb[1], self->right, audio_buffer_elements * sizeof (sample_t))))
-                        {
-                        jack_ringbuffer_read(self->afdata.input_rb[0], self->left, nbytes);
-                        }
+                    jack_ringbuffer_read_advance(self->afdata.input_rb[0], jack_ringbuffer_read_space(self->afdata.input_rb[0]));
 
                     if (self->unpause_request)
                         {
@@ -683,35 +1076,44 @@ static void *recorder_main(void *args)
                     while (self->afdata.jack_dataflow_control != JD_OFF) {
                         nanosleep(&ms10, NULL);
                     }
-                    jack_ringbuffer_free(self->afdata.input_rb[0]);
-                    jack_ringbuffer_free(self->afdata.input_rb[1]);
-                    free(self->left);
-                    free(self->right);
-                    free(self->combined);
-                    self->left = self->right = self->combined = NULL;
+                    audio_feed_rb_free(&self->afdata);
                     self->sf_samples = 0;
                     }
                 else
                     {
+                    recorder_segment_discard(self);
+                    /* everything has to be on disk before the tagging reads it back */
+                    if (!disk_writer_close(self->dw))
+                        fprintf(stderr, "recorder_main: failed writing to file %s\n", self->pathname);
+                    self->dw = NULL;
                     if (self->id3_mode)
                         {
                         recorder_append_metadata(self, NULL);
-                        recorder_append_metadata2(self, NULL);
                         recorder_display_logged_metadata(self->mi_first);
-                        recorder_display_logged_metadata2(self->mi2_first);
+                        recorder_display_toc(self);
                         recorder_apply_mp3_tags(self);
                         recorder_create_mp3_cuesheet(self);
                         recorder_free_metadata(self);
-                        recorder_free_metadata2(self);
+                        memset(&self->toc, 0, sizeof self->toc);
                         }
                     encoder_unregister_client(self->encoder_op);
                     }
 
-                fclose(self->fp);
+                if (self->fp)
+                    fclose(self->fp);
                 free(self->pathname);
                 free(self->cuepathname);
                 free(self->timestamp);
+                free(self->segment_base);
+                free(self->segment_ext);
+                free(self->segment_headers);
+                self->segment_base = self->segment_ext = self->segment_headers = NULL;
+                self->segment_headers_size = 0;
+                self->segment_s = 0;
+                self->segment_start_ms = 0;
                 memset(self->first_mp3_header, 0x00, 4);
+                self->id3_reserve = 0;
+                self->xing_reserve = 0;
                 self->oldbitrate = 0;
                 self->oldsamplerate = 0;
                 self->id3_mode = FALSE;
@@ -739,9 +1141,17 @@ static void *recorder_main(void *args)
     return NULL;
     }
 
+/* recorder_make_report: record mode:seconds recorded:thread cpu%:voluntary/s:involuntary/s:wakeups/s
+ * followed by the input ringbuffer's min:avg:max:high water mark:underruns:overruns
+ */
 int recorder_make_report(struct recorder *self)
     {
-    fprintf(g.out, "idjcsc: recorder%dreport=%d:%d\n", self->numeric_id, self->record_mode, self->recording_length_s);
+    char thread_stats[64], rb_stats[64];
+
+    threadstat_format(&self->threadstat, &self->threadstat_reported, thread_stats, sizeof thread_stats);
+    rbstat_format(&self->afdata.rb_stats, ':', rb_stats, sizeof rb_stats);
+    fprintf(g.out, "idjcsc: recorder%dreport=%d:%d:%s:%s\n", self->numeric_id, self->record_mode,
+                self->recording_length_s, thread_stats, rb_stats);
     fflush(g.out);
     return SUCCEEDED;
     }
@@ -756,7 +1166,7 @@ char *recorder_default_dup(char *orig)
 int recorder_new_metadata(struct recorder *self, char *artist, char *title, char *album)
     {
     char *new_artist, *new_title, *new_album;
-    char *old_artist, *old_title, *old_album;
+    struct recorder_meta_event *ev;
 
     new_artist = recorder_default_dup(artist);
     new_title = recorder_default_dup(title);
@@ -765,22 +1175,24 @@ int recorder_new_metadata(struct recorder *self, char *artist, char *title, char
     if (!new_artist || !new_title || !new_album)
         {
         fprintf(stderr, "recorder_new_metadata: malloc failure\n");
+        free(new_artist);
+        free(new_title);
+        free(new_album);
         return FAILED;
         }
-    old_artist = self->artist;
-    old_title = self->title;
-    old_album = self->album;
-
-    pthread_mutex_lock(&self->artist_title_mutex);
+    free(self->artist);
+    free(self->title);
+    free(self->album);
     self->artist = new_artist;
     self->title = new_title;
     self->album = new_album;
-    self->new_artist_title = TRUE;
-    pthread_mutex_unlock(&self->artist_title_mutex);
 
-    free(old_artist);
-    free(old_title);
-    free(old_album);
+    /* the recorder thread picks this up without either side taking a lock */
+    if (self->cue_active && (ev = recorder_meta_event_new(new_artist, new_title, new_album)) && !recorder_meta_push(self, ev))
+        {
+        fprintf(stderr, "recorder_new_metadata: recorder %d metadata queue is full\n", self->numeric_id);
+        free(ev);
+        }
 
     return SUCCEEDED;
     }
@@ -796,18 +1208,22 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
     char timestamp[TIMESTAMP_SIZ];
     size_t base;
 
-    if (!strcmp(rv->record_source, "-1"))
+    /* the thread is left until a recording is made */
+    if (!self->thread_started)
         {
-        file_extension = ".flac";
-        self->encoder_op = NULL;
-        self->left = malloc(audio_buffer_elements * sizeof (sample_t));
-        self->right = malloc(audio_buffer_elements * sizeof (sample_t));
-        self->combined = malloc(audio_buffer_elements * sizeof (sample_t) * 2);
-        if (!self->left || !self->right || !self->combined)
+        if (pthread_create(&self->thread_h, NULL, recorder_main, self))
             {
-            fprintf(stderr, "recorder_start: malloc failure\n");
+            fprintf(stderr, "recorder_start: failed to start thread\n");
             return FAILED;
             }
+        self->thread_started = TRUE;
+        }
+
+    self->cue_active = FALSE;
+    if (!strcmp(rv->record_source, "-1"))
+        {
+        file_extension = ".flac";
+        self->encoder_op = NULL;
         }
     else
         {
@@ -908,7 +1324,7 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
     memcpy(self->cuepathname, self->pathname, base);
     memcpy(self->cuepathname + base, ".cue", 5);
 
-    if (!(self->fp = fopen(self->pathname, "w")))
+    if (self->encoder_op ? !(self->dw = disk_writer_open(self->pathname)) : !(self->fp = fopen(self->pathname, "w")))
         {
         fprintf(stderr, "recorder_start: failed to open file %s\nuser should check file permissions on the particular directory\n", rv->record_folder);
         free(self->pathname);
@@ -919,6 +1335,19 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
         }
     if (self->encoder_op)
         {
+        if (rv->segment_minutes && atoi(rv->segment_minutes) > 0)
+            {
+            if ((self->segment_base = strndup(self->pathname, base)) && (self->segment_ext = strdup(file_extension)))
+                {
+                self->segment_s = atoi(rv->segment_minutes) * 60;
+                self->segment_n = 1;
+                self->segment_headers_serial = -1;
+                self->segment_due = recorder_segment_deadline(self->segment_s);
+                fprintf(stderr, "recorder_start: a new file every %d minutes\n", self->segment_s / 60);
+                }
+            else
+                fprintf(stderr, "recorder_start: malloc failure, recording to one file\n");
+            }
         self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
         fprintf(stderr, "recorder_start: awaiting serial %d to commence\n", self->initial_serial);
         }
@@ -935,6 +1364,8 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
             }
         else
             {
+            /* a buffer this size keeps cue writing off the disk until the recording ends */
+            setvbuf(self->fpcue, NULL, _IOFBF, 65536);
             fprintf(self->fpcue, "TITLE \"%s\"\r\n", self->timestamp);
             fprintf(self->fpcue, "PERFORMER \"Recorded with IDJC\"\r\n");
             fprintf(self->fpcue, "FILE \"%s\" WAVE\r\n", strrchr(self->pathname, '/') + 1);
@@ -953,9 +1384,7 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
             return FAILED;
             }
 
-        self->afdata.input_rb[0] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-        self->afdata.input_rb[1] = jack_ringbuffer_create(rb_n_samples * sizeof (sample_t));
-        if (!(self->afdata.input_rb[0] && self->afdata.input_rb[1]))
+        if (!audio_feed_rb_create_interleaved(&self->afdata, "recorder_rb_samples", rb_n_samples))
             {
             fprintf(stderr, "encoder_start: jack ringbuffer creation failure\n");
             free(self->pathname);
@@ -967,7 +1396,15 @@ int recorder_start(struct threads_info *ti, struct universal_vars *uv, void *oth
             }
         self->afdata.jack_dataflow_control = JD_ON;
         self->initial_serial = -1;
-        self->new_artist_title = TRUE; /* risk inheriting old metadata rather than start with empty */
+        /* risk inheriting old metadata rather than start with empty */
+        recorder_meta_drain(self);
+        {
+            struct recorder_meta_event *ev = recorder_meta_event_new(self->artist, self->title, self->album);
+
+            if (ev)
+                recorder_meta_push(self, ev);
+        }
+        self->cue_active = TRUE;
         fprintf(stderr, "recorder_start: in FLAC mode\n");
         }
     //if (file_extension == ".oga")
@@ -993,6 +1430,7 @@ int recorder_stop(struct threads_info *ti, struct universal_vars *uv, void *othe
         fprintf(stderr, "recorder_stop: device %d is already stopped\n", self->numeric_id);
         return FAILED;
         }
+    self->cue_active = FALSE;
     self->stop_request = TRUE;
     while (self->record_mode != RM_STOPPED)
         nanosleep(&ms10, NULL);
@@ -1063,23 +1501,29 @@ struct recorder *recorder_init(struct threads_info *ti, int numeric_id)
     self->artist = strdup("no data");
     self->title = strdup("no data");
     self->album = strdup("no data");
-    pthread_mutex_init(&self->artist_title_mutex, NULL);
     pthread_mutex_init(&self->mode_mutex, NULL);
     pthread_cond_init(&self->mode_cv, NULL);
-    pthread_create(&self->thread_h, NULL, recorder_main, self);
     return self;
     }
 
 void recorder_destroy(struct recorder *self)
     {
-    pthread_mutex_lock(&self->mode_mutex);
-    self->thread_terminate_f = TRUE;
-    pthread_cond_signal(&self->mode_cv);
-    pthread_mutex_unlock(&self->mode_mutex);
-    pthread_join(self->thread_h, NULL);
+    struct timespec ms10 = { 0, 10000000 };
+
+    if (self->thread_started)
+        {
+        pthread_mutex_lock(&self->mode_mutex);
+        self->thread_terminate_f = TRUE;
+        pthread_cond_signal(&self->mode_cv);
+        pthread_mutex_unlock(&self->mode_mutex);
+        pthread_join(self->thread_h, NULL);
+        }
+    /* files from a segmented recording may still be getting their tags */
+    while (__atomic_load_n(&self->finalisers, __ATOMIC_ACQUIRE))
+        nanosleep(&ms10, NULL);
     pthread_cond_destroy(&self->mode_cv);
     pthread_mutex_destroy(&self->mode_mutex);
-    pthread_mutex_destroy(&self->artist_title_mutex);
+    recorder_meta_drain(self);
     free(self->artist);
     free(self->title);
     free(self->album);
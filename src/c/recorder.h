@@ -21,8 +21,11 @@
 #define RECORDER_H
 
 #include <stdio.h>
+#include <time.h>
 #include <sndfile.h>
 #include "sourceclient.h"
+#include "diskwriter.h"
+#include "threadstat.h"
 
 enum record_mode { RM_STOPPED, RM_RECORDING, RM_PAUSED, RM_STOPPING };
 
@@ -33,11 +36,13 @@ struct recorder_vars
     char *record_filename;
     char *pause_button;
     char *auto_pause_button;
+    char *segment_minutes;       /* start a new file this often, zero or absent for one file */
     };
 
-/* metadata logging (mp3 only): while the first structure logs title changes for
- * creating a table of contents in the id3 tag, the second logs changes to the
- * compression ratio to provide for the creation of a seek table in the Xing tag */
+/* metadata logging (mp3 only): the first structure logs title changes for
+ * creating a table of contents in the id3 tag, the second samples the
+ * position in the file over time to provide for the creation of a seek
+ * table in the Xing tag */
 struct metadata_item
     {
     char *artist;
@@ -50,15 +55,28 @@ struct metadata_item
     struct metadata_item *next;
     };
 
-struct metadata_item2
+/* the number of time/position samples kept however long the recording */
+#define RECORDER_TOC_POINTS 512
+
+struct recorder_toc
     {
-    int start_offset_ms;
-    int byte_offset;
-    int finish_offset_ms;
-    int size_bytes;
-    int bit_rate;
+    int ms[RECORDER_TOC_POINTS];
+    int bytes[RECORDER_TOC_POINTS];
+    int n_points;
+    int interval_ms;             /* between samples, doubled each time the table fills */
+    int next_ms;                 /* when the next sample is due */
+    int bit_rate;                /* of the first stream, to size the xing frame */
     int sample_rate;
-    struct metadata_item2 *next;
+    };
+
+/* song changes on their way from the command thread to the cue sheet */
+#define RECORDER_META_QUEUE 64
+
+struct recorder_meta_event
+    {
+    char *artist;                /* all three point into the same allocation */
+    char *title;
+    char *album;
     };
 
 struct recorder
@@ -66,6 +84,9 @@ struct recorder
     struct threads_info *threads_info;
     int numeric_id;              /* the identity of this recorder */
     pthread_t thread_h;          /* pthread handle for the recorder */
+    int thread_started;          /* the thread is made on the first start */
+    struct threadstat threadstat;
+    struct threadstat_report threadstat_reported;
     int thread_terminate_f;      /* set this to cause the thread to exit */
     int stop_request;            /* control variables for various obvious things */
     int stop_pending;
@@ -80,36 +101,50 @@ struct recorder
     double accumulated_time;     /* prior stream lengths are accumulated here */
     int bytes_written;           /* logs the current file size */
     struct encoder_op *encoder_op;       /* handle for getting input data */
-    FILE *fp;
+    FILE *fp;                    /* for the flac recordings made here */
+    struct disk_writer *dw;      /* for the encoded recordings */
     char *pathname;              /* /path/to/filebeingsaved.[ogg/mp3] */
     char *cuepathname;            /* pathname of cue file */
     char *timestamp;             /* just the timestamp from the filename */
     enum record_mode record_mode;
     struct metadata_item *mi_first;      /* log mp3 song title changes */
     struct metadata_item *mi_last;
-    struct metadata_item2 *mi2_first;    /* log mp3 block sizes and durations */
-    struct metadata_item2 *mi2_last;
+    struct recorder_toc toc;     /* log mp3 file position against time */
     int id3_mode;                /* when set applies an id3 tag */
     int include_xing_tag;        /* if true a xing/info tag is to be written */
     int is_vbr;                  /* frame length changed */
     unsigned oldbitrate;
     unsigned oldsamplerate;
     char first_mp3_header[4];
+    int id3_reserve;             /* bytes at the head of the file held for the id3 tag */
+    int xing_reserve;            /* and what follows it for the xing frame */
     SNDFILE *sf;                 /* support for recording with libsndfile */
     SF_INFO sfinfo;
     struct audio_feed_data afdata;
     enum performance_warning performance_warning_indicator; /* indicates ringbuffer overflow condition */
-    char *left;
-    char *right;
-    char *combined;
     size_t sf_samples;
     FILE *fpcue;
-    char *artist;
+    char *artist;                /* the latest song, used only by the command thread */
     char *title;
     char *album;
     int artist_title_writes;
-    pthread_mutex_t artist_title_mutex;
-    int new_artist_title;
+    int cue_active;              /* a flac recording is consuming the metadata queue */
+    struct recorder_meta_event *meta_queue[RECORDER_META_QUEUE]; /* single producer single consumer */
+    unsigned meta_head;          /* written by the command thread */
+    unsigned meta_tail;          /* written by the consumer */
+    int segment_s;               /* the file rotation period or zero */
+    time_t segment_due;          /* when the next file takes over */
+    int segment_start_ms;        /* recording_length_ms at the start of the current file */
+    int segment_n;               /* the number of the current file, the first is 1 */
+    char *segment_base;          /* the pathname less its extension */
+    char *segment_ext;
+    struct disk_writer *next_dw; /* the next file, opened ahead of the switch */
+    char *next_pathname;
+    char *segment_headers;       /* ogg and webm stream headers repeated at the start of each file */
+    size_t segment_headers_size;
+    int segment_headers_serial;
+    int finalisers;              /* finished files still being tagged in the background */
+    struct recorder *segment_owner;      /* set in the copy a finaliser works on */
     pthread_mutex_t mode_mutex;
     pthread_cond_t mode_cv;
     };
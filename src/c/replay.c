@@ -0,0 +1,343 @@
+/*
+#   replay.c: an in-memory rolling buffer of an encoder's recent output
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sourceclient.h"
+#include "replay.h"
+
+/* sized for the highest bitrate in use, 384 kb/s, with the index allowing 10ms pages */
+#define REPLAY_BYTES_PER_S 48000
+#define REPLAY_ENTRIES_PER_S 100
+
+/* a snapshot leaves this share of the ring alone as the writer may be about to reuse it */
+#define REPLAY_SLACK_SHIFT 3
+
+struct replay_job
+    {
+    struct replay *replay;
+    char *headers;
+    size_t headers_size;
+    int headers_serial;
+    double seconds;
+    char *pathname;
+    };
+
+static double replay_now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+static size_t replay_pow2(size_t n)
+    {
+    size_t p = 1;
+
+    while (p < n)
+        p <<= 1;
+    return p;
+    }
+
+struct replay *replay_create(int seconds)
+    {
+    struct replay *self;
+
+    if (seconds <= 0 || !(self = calloc(1, sizeof (struct replay))))
+        return NULL;
+    self->refs = 1;
+    self->size = replay_pow2((size_t)seconds * REPLAY_BYTES_PER_S);
+    self->index_size = replay_pow2((size_t)seconds * REPLAY_ENTRIES_PER_S);
+    if (!(self->ring = malloc(self->size)) || !(self->index = malloc(self->index_size * sizeof (struct replay_entry))))
+        {
+        fprintf(stderr, "replay_create: malloc failure\n");
+        replay_destroy(self);
+        return NULL;
+        }
+    fprintf(stderr, "replay_create: keeping %d seconds in %zu KiB\n", seconds, self->size / 1024);
+    return self;
+    }
+
+void replay_destroy(struct replay *self)
+    {
+    if (self && !__atomic_sub_fetch(&self->refs, 1, __ATOMIC_ACQ_REL))
+        {
+        free(self->ring);
+        free(self->index);
+        free(self);
+        }
+    }
+
+void replay_reset(struct replay *self)
+    {
+    __atomic_store_n(&self->first_entry, __atomic_load_n(&self->n_entries, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+    }
+
+static void replay_ring_write(struct replay *self, uint64_t pos, const void *data, size_t n)
+    {
+    size_t offset = pos & (self->size - 1);
+    size_t part = self->size - offset;
+
+    if (part > n)
+        part = n;
+    memcpy(self->ring + offset, data, part);
+    memcpy(self->ring, (const char *)data + part, n - part);
+    }
+
+static void replay_ring_read(const struct replay *self, uint64_t pos, void *data, size_t n)
+    {
+    size_t offset = pos & (self->size - 1);
+    size_t part = self->size - offset;
+
+    if (part > n)
+        part = n;
+    memcpy(data, self->ring + offset, part);
+    memcpy((char *)data + part, self->ring, n - part);
+    }
+
+void replay_write(struct replay *self, const struct encoder_op_packet_header *header, const struct iovec *iov, int iovcnt)
+    {
+    uint64_t pos = self->head, n = self->n_entries;
+    size_t len = sizeof *header + header->data_size;
+    struct replay_entry *e;
+
+    if (len > self->size >> REPLAY_SLACK_SHIFT)
+        return;
+    replay_ring_write(self, pos, header, sizeof *header);
+    pos += sizeof *header;
+    for (int i = 0; i < iovcnt; ++i)
+        {
+        replay_ring_write(self, pos, iov[i].iov_base, iov[i].iov_len);
+        pos += iov[i].iov_len;
+        }
+    e = &self->index[n & (self->index_size - 1)];
+    e->pos = self->head;
+    e->when = replay_now();
+    __atomic_store_n(&self->head, pos, __ATOMIC_RELEASE);
+    __atomic_store_n(&self->n_entries, n + 1, __ATOMIC_RELEASE);
+    }
+
+/* replay_snapshot: copy out the packets of the last so many seconds
+ * the copy is made without stopping the writer and is retried if the writer caught up with it
+ */
+static char *replay_snapshot(struct replay *self, double seconds, size_t *size)
+    {
+    for (int attempt = 0; attempt < 4; ++attempt)
+        {
+        uint64_t n = __atomic_load_n(&self->n_entries, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+        uint64_t lo = __atomic_load_n(&self->first_entry, __ATOMIC_ACQUIRE);
+        uint64_t oldest = (head > self->size) ? head - self->size + (self->size >> REPLAY_SLACK_SHIFT) : 0;
+        double cutoff = replay_now() - seconds;
+        struct replay_entry start = { head, 0.0 };
+        uint64_t i;
+        char *buffer;
+
+        if (n > self->index_size && n - self->index_size > lo)
+            lo = n - self->index_size;
+        for (i = n; i > lo; --i)
+            {
+            struct replay_entry e = self->index[(i - 1) & (self->index_size - 1)];
+
+            if (e.when < cutoff || e.pos < oldest)
+                break;
+            start = e;
+            }
+        if (start.pos == head)
+            return NULL;
+        *size = head - start.pos;
+        if (!(buffer = malloc(*size)))
+            {
+            fprintf(stderr, "replay_snapshot: malloc failure\n");
+            return NULL;
+            }
+        replay_ring_read(self, start.pos, buffer, *size);
+
+        /* nothing copied counts unless the writer is still behind it
+         * a write in progress runs up to the slack ahead of the head it has yet to publish
+         */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&self->n_entries, __ATOMIC_RELAXED) - i < self->index_size &&
+                    __atomic_load_n(&self->head, __ATOMIC_RELAXED) + (self->size >> REPLAY_SLACK_SHIFT) - start.pos <= self->size)
+            return buffer;
+        free(buffer);
+        }
+    fprintf(stderr, "replay_snapshot: the encoder kept overtaking the copy\n");
+    return NULL;
+    }
+
+/* replay_write_headers: the data of each cached header packet, the cache being in packet ring format */
+static int replay_write_headers(struct replay_job *job, FILE *fp)
+    {
+    struct encoder_op_packet_header header;
+    size_t pos = 0;
+
+    while (pos + sizeof header <= job->headers_size)
+        {
+        memcpy(&header, job->headers + pos, sizeof header);
+        pos += sizeof header;
+        if (pos + header.data_size > job->headers_size)
+            {
+            fprintf(stderr, "replay_write_headers: bad packet\n");
+            return FALSE;
+            }
+        if (fwrite(job->headers + pos, 1, header.data_size, fp) != header.data_size)
+            return FALSE;
+        pos += header.data_size;
+        }
+    return TRUE;
+    }
+
+/* replay_write_out: the headers and packets to the file, starting each stream where it may start
+ * an Ogg or WebM stream whose headers are neither cached nor wholly in the snapshot is left out
+ */
+static int replay_write_out(struct replay_job *job, const char *buffer, size_t size, FILE *fp)
+    {
+    int live_serial = -1, headers_done = FALSE, synced = FALSE;
+    size_t pos = 0;
+
+    while (pos + sizeof (struct encoder_op_packet_header) <= size)
+        {
+        struct encoder_op_packet packet;
+        ssize_t offset;
+
+        memcpy(&packet.header, buffer + pos, sizeof packet.header);
+        pos += sizeof packet.header;
+        if (pos + packet.header.data_size > size)
+            {
+            fprintf(stderr, "replay_write_out: bad packet\n");
+            return FALSE;
+            }
+        packet.data = (char *)buffer + pos;
+        pos += packet.header.data_size;
+        if (packet.header.flags & PF_METADATA)
+            continue;
+
+        if (packet.header.flags & (PF_OGG | PF_WEBM))
+            {
+            if (packet.header.flags & PF_HEADER)
+                {
+                /* a whole new set of headers starts a link of the chain */
+                if (packet.header.flags & PF_INITIAL)
+                    {
+                    live_serial = packet.header.serial;
+                    synced = TRUE;
+                    }
+                if (packet.header.serial != live_serial)
+                    continue;
+                }
+            else if (packet.header.serial != live_serial)
+                {
+                if (!job->headers || headers_done || packet.header.serial != job->headers_serial)
+                    continue;
+                if (!replay_write_headers(job, fp))
+                    return FALSE;
+                headers_done = TRUE;
+                live_serial = packet.header.serial;
+                synced = FALSE;
+                }
+            }
+
+        offset = 0;
+        if (!synced)
+            {
+            if ((offset = encoder_packet_boundary(&packet)) < 0)
+                continue;
+            synced = TRUE;
+            }
+        if (fwrite((char *)packet.data + offset, 1, packet.header.data_size - offset, fp) != packet.header.data_size - offset)
+            return FALSE;
+        }
+    return TRUE;
+    }
+
+static void *replay_dump_main(void *args)
+    {
+    struct replay_job *job = args;
+    char *buffer;
+    size_t size;
+    FILE *fp;
+
+    if ((buffer = replay_snapshot(job->replay, job->seconds, &size)))
+        {
+        if ((fp = fopen(job->pathname, "w")))
+            {
+            int ok = replay_write_out(job, buffer, size, fp);
+
+            if (fclose(fp) || !ok)
+                fprintf(stderr, "replay_dump_main: error writing %s\n", job->pathname);
+            else
+                fprintf(stderr, "replay_dump_main: wrote the last %g seconds to %s\n", job->seconds, job->pathname);
+            }
+        else
+            perror("replay_dump_main: fopen");
+        free(buffer);
+        }
+    else
+        fprintf(stderr, "replay_dump_main: nothing to write\n");
+
+    replay_destroy(job->replay);
+    free(job->headers);
+    free(job->pathname);
+    free(job);
+    return NULL;
+    }
+
+int replay_dump(struct replay *self, const char *headers, size_t headers_size, int headers_serial, double seconds, const char *pathname)
+    {
+    struct replay_job *job;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ok;
+
+    if (!(job = calloc(1, sizeof (struct replay_job))) || !(job->pathname = strdup(pathname)) ||
+                (headers && !(job->headers = malloc(headers_size))))
+        {
+        fprintf(stderr, "replay_dump: malloc failure\n");
+        if (job)
+            free(job->pathname);
+        free(job);
+        return FALSE;
+        }
+    if (headers)
+        memcpy(job->headers, headers, headers_size);
+    __atomic_add_fetch(&self->refs, 1, __ATOMIC_RELAXED);
+    job->replay = self;
+    job->headers_size = headers_size;
+    job->headers_serial = headers_serial;
+    job->seconds = seconds;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (!(ok = !pthread_create(&thread, &attr, replay_dump_main, job)))
+        {
+        fprintf(stderr, "replay_dump: failed to start a thread\n");
+        replay_destroy(self);
+        free(job->headers);
+        free(job->pathname);
+        free(job);
+        }
+    pthread_attr_destroy(&attr);
+    return ok;
+    }
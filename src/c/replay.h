@@ -0,0 +1,66 @@
+/*
+#   replay.h: an in-memory rolling buffer of an encoder's recent output
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+struct encoder_op_packet_header;
+
+struct replay_entry
+    {
+    uint64_t pos;                        /* where the packet starts in the ring */
+    double when;                         /* monotonic clock time it was written */
+    };
+
+/* one writer, the encoder, and any number of readers that copy optimistically
+ * and check afterwards that the writer hasn't overtaken what they copied
+ */
+struct replay
+    {
+    char *ring;                          /* packets in packet ring format, header then data */
+    size_t size;                         /* a power of two */
+    struct replay_entry *index;          /* the start of each packet */
+    size_t index_size;                   /* a power of two */
+    uint64_t head;                       /* ring write position */
+    uint64_t n_entries;                  /* packets ever written */
+    uint64_t first_entry;                /* packets before this belong to an earlier run of the encoder */
+    int refs;                            /* the encoder's and one for each dump in progress */
+    };
+
+/* replay_create: a buffer for about the given number of seconds of output or NULL */
+struct replay *replay_create(int seconds);
+/* replay_destroy: drop a reference, the buffer is freed once no dump is still reading it */
+void replay_destroy(struct replay *self);
+
+/* replay_reset: forget what has been kept, for when the encoder starts afresh */
+void replay_reset(struct replay *self);
+
+/* replay_write: keep a packet, called only from the encoder */
+void replay_write(struct replay *self, const struct encoder_op_packet_header *header, const struct iovec *iov, int iovcnt);
+
+/* replay_dump: write the last so many seconds to a file from a background thread
+ * headers are the encoder's cached header packets in packet ring format, NULL for none
+ */
+int replay_dump(struct replay *self, const char *headers, size_t headers_size, int headers_serial, double seconds, const char *pathname);
+
+#endif /* REPLAY_H */
@@ -0,0 +1,456 @@
+/*
+#   resampler.c: sample rate conversion for the decoders with a choice of backend
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../config.h"
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(HAVE_LIBAV) && defined(HAVE_SWRESAMPLE)
+#define USE_SWR
+#include <libavutil/opt.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+#endif
+#include "resampler.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* the most phases the polyphase filter will have, 147:160 being typical */
+#define MAX_PHASES 1024
+/* the dot products are summed across this many lanes so they vectorise without -ffast-math */
+#define LANES 8
+
+/* error codes of our own come after those of libsamplerate */
+enum
+    {
+    RESAMPLER_ERR_BASE = 1000,
+    RESAMPLER_ERR_MALLOC = RESAMPLER_ERR_BASE,
+    RESAMPLER_ERR_CHANNELS,
+    RESAMPLER_ERR_SWRESAMPLE,
+    RESAMPLER_ERR_END
+    };
+
+static const char *const error_text[] =
+    {
+    "malloc failure",
+    "unsupported number of channels",
+    "swresample failure",
+    };
+
+static const char *const kind_names[RESAMPLER_N_KINDS] = { "libsamplerate", "swresample", "polyphase" };
+
+struct polyphase
+    {
+    int up, down;               /* the conversion ratio as up / down */
+    int taps;                   /* per phase, a multiple of LANES */
+    float *coef;                /* phase p at coef + p * taps, the first tap being for the oldest sample */
+    int channels;
+    float **buf;                /* per channel, the input still to be used */
+    size_t have;                /* frames in the above */
+    size_t cap;
+    size_t pos;                 /* start of the window of the next output frame */
+    int phase;
+    int ended;                  /* the tail has gone in */
+    };
+
+struct resampler
+    {
+    enum resampler_kind kind;
+    int quality;                /* libsamplerate converter type */
+    int channels;
+    double ratio;               /* of the current polyphase or swresample state */
+    SRC_STATE *src;
+    struct polyphase *poly;
+#ifdef USE_SWR
+    SwrContext *swr;
+#endif
+    };
+
+int resampler_kind_parse(const char *name, enum resampler_kind *kind)
+    {
+    for (int i = 0; i < RESAMPLER_N_KINDS; ++i)
+        if (!strcmp(name, kind_names[i]))
+            {
+#ifndef USE_SWR
+            if (i == RESAMPLER_SWRESAMPLE)
+                {
+                fprintf(stderr, "resampler_kind_parse: swresample is not built in, using libsamplerate\n");
+                i = RESAMPLER_LIBSAMPLERATE;
+                }
+#endif
+            *kind = i;
+            return TRUE;
+            }
+    return FALSE;
+    }
+
+const char *resampler_kind_name(enum resampler_kind kind)
+    {
+    return (kind >= 0 && kind < RESAMPLER_N_KINDS) ? kind_names[kind] : "?";
+    }
+
+const char *resampler_strerror(int error)
+    {
+    if (error >= RESAMPLER_ERR_BASE && error < RESAMPLER_ERR_END)
+        return error_text[error - RESAMPLER_ERR_BASE];
+    return src_strerror(error);
+    }
+
+/* filter length and shape for each libsamplerate quality setting */
+static void quality_params(int quality, int *taps, double *rolloff, double *beta)
+    {
+    switch (quality)
+        {
+        case SRC_SINC_BEST_QUALITY:
+            *taps = 64;
+            *rolloff = 0.95;
+            *beta = 10.0;
+            break;
+        case SRC_SINC_MEDIUM_QUALITY:
+            *taps = 32;
+            *rolloff = 0.92;
+            *beta = 8.0;
+            break;
+        default:
+            *taps = 16;
+            *rolloff = 0.86;
+            *beta = 6.0;
+        }
+    }
+
+/* rational: the ratio as up / down with neither more than MAX_PHASES */
+static int rational(double ratio, int *up, int *down)
+    {
+    for (int d = 1; d <= MAX_PHASES; ++d)
+        {
+        double u = floor(ratio * d + 0.5);
+
+        if (u >= 1.0 && u <= MAX_PHASES && fabs(u / d - ratio) < ratio * 1e-9)
+            {
+            *up = (int)u;
+            *down = d;
+            return TRUE;
+            }
+        }
+    return FALSE;
+    }
+
+static double bessel_i0(double x)
+    {
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+        {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        }
+    return sum;
+    }
+
+static void polyphase_delete(struct polyphase *self)
+    {
+    if (self)
+        {
+        if (self->buf)
+            for (int c = 0; c < self->channels; ++c)
+                free(self->buf[c]);
+        free(self->buf);
+        free(self->coef);
+        free(self);
+        }
+    }
+
+static int polyphase_reserve(struct polyphase *self, size_t frames)
+    {
+    size_t cap;
+    float *p;
+
+    if (frames <= self->cap)
+        return TRUE;
+    for (cap = self->cap ? self->cap : 4096; cap < frames; cap *= 2);
+    for (int c = 0; c < self->channels; ++c)
+        {
+        if (!(p = realloc(self->buf[c], cap * sizeof (float))))
+            return FALSE;
+        self->buf[c] = p;
+        }
+    self->cap = cap;
+    return TRUE;
+    }
+
+/* polyphase_new: a Kaiser windowed sinc at up times the input rate, split into its phases */
+static struct polyphase *polyphase_new(int up, int down, int quality, int channels)
+    {
+    struct polyphase *self;
+    double rolloff, beta, fc, centre, t, x, sum;
+    int n;
+
+    if (!(self = calloc(1, sizeof (struct polyphase))))
+        return NULL;
+    quality_params(quality, &self->taps, &rolloff, &beta);
+    self->up = up;
+    self->down = down;
+    self->channels = channels;
+    if (!(self->coef = malloc(up * self->taps * sizeof (float))) || !(self->buf = calloc(channels, sizeof (float *))))
+        {
+        polyphase_delete(self);
+        return NULL;
+        }
+
+    /* the cutoff in cycles per sample at the upsampled rate, under the lower of the two nyquists */
+    n = self->taps * up;
+    fc = 0.5 * rolloff / ((up > down) ? up : down);
+    centre = (n - 1) / 2.0;
+    for (int p = 0; p < up; ++p)
+        {
+        float *c = self->coef + p * self->taps;
+
+        sum = 0.0;
+        for (int j = 0; j < self->taps; ++j)
+            {
+            t = p + (self->taps - 1 - j) * up - centre;
+            x = 2.0 * t / (n - 1);
+            c[j] = ((t == 0.0) ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t))
+                        * bessel_i0(beta * sqrt(fmax(0.0, 1.0 - x * x))) / bessel_i0(beta);
+            sum += c[j];
+            }
+        /* unity gain at DC in each phase */
+        for (int j = 0; j < self->taps; ++j)
+            c[j] /= sum;
+        }
+
+    /* lead in with silence so the output lines up with the input to within half an input sample */
+    if (!polyphase_reserve(self, self->taps))
+        {
+        polyphase_delete(self);
+        return NULL;
+        }
+    self->have = self->taps / 2 - 1;
+    for (int c = 0; c < channels; ++c)
+        memset(self->buf[c], 0, self->have * sizeof (float));
+    return self;
+    }
+
+static inline float dot(const float *restrict c, const float *restrict x, int n)
+    {
+    float acc[LANES] = { 0.0f }, sum = 0.0f;
+
+    for (int j = 0; j < n; j += LANES)
+        for (int l = 0; l < LANES; ++l)
+            acc[l] += c[j + l] * x[j + l];
+    for (int l = 0; l < LANES; ++l)
+        sum += acc[l];
+    return sum;
+    }
+
+static int polyphase_process(struct polyphase *self, SRC_DATA *data)
+    {
+    long in = self->ended ? 0 : data->input_frames, out;
+    size_t pad = (data->end_of_input && !self->ended) ? self->taps / 2 + 1 : 0;
+    size_t done;
+
+    /* all the input is taken in, what isn't used yet stays for the next call */
+    if (!polyphase_reserve(self, self->have + in + pad))
+        return RESAMPLER_ERR_MALLOC;
+    for (int c = 0; c < self->channels; ++c)
+        {
+        float *restrict d = self->buf[c] + self->have;
+        const float *restrict s = data->data_in + c;
+
+        for (long i = 0; i < in; ++i)
+            d[i] = s[i * self->channels];
+        memset(d + in, 0, pad * sizeof (float));
+        }
+    self->have += in + pad;
+    if (pad)
+        self->ended = TRUE;
+
+    for (out = 0; out < data->output_frames && self->pos + self->taps <= self->have; ++out)
+        {
+        const float *restrict coef = self->coef + self->phase * self->taps;
+
+        for (int c = 0; c < self->channels; ++c)
+            data->data_out[out * self->channels + c] = dot(coef, self->buf[c] + self->pos, self->taps);
+        self->phase += self->down;
+        self->pos += self->phase / self->up;
+        self->phase %= self->up;
+        }
+
+    /* drop what comes before the next window */
+    done = (self->pos < self->have) ? self->pos : self->have;
+    for (int c = 0; c < self->channels; ++c)
+        memmove(self->buf[c], self->buf[c] + done, (self->have - done) * sizeof (float));
+    self->have -= done;
+    self->pos -= done;
+
+    data->input_frames_used = data->input_frames;
+    data->output_frames_gen = out;
+    return 0;
+    }
+
+#ifdef USE_SWR
+static int swr_setup(struct resampler *self, double ratio)
+    {
+    int64_t layout = av_get_default_channel_layout(self->channels);
+    int up, down, taps;
+    double rolloff, beta;
+
+    if (!layout)
+        return RESAMPLER_ERR_CHANNELS;
+    /* only the ratio of the two rates matters */
+    if (!rational(ratio, &up, &down))
+        {
+        down = 1000000;
+        up = (int)(ratio * down + 0.5);
+        }
+    if (!(self->swr = swr_alloc()))
+        return RESAMPLER_ERR_MALLOC;
+    quality_params(self->quality, &taps, &rolloff, &beta);
+    av_opt_set_int(self->swr, "in_channel_layout", layout, 0);
+    av_opt_set_int(self->swr, "out_channel_layout", layout, 0);
+    av_opt_set_sample_fmt(self->swr, "in_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+    av_opt_set_sample_fmt(self->swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+    av_opt_set_int(self->swr, "in_sample_rate", down, 0);
+    av_opt_set_int(self->swr, "out_sample_rate", up, 0);
+    av_opt_set_int(self->swr, "filter_size", taps, 0);
+    if (swr_init(self->swr) < 0)
+        {
+        swr_free(&self->swr);
+        return RESAMPLER_ERR_SWRESAMPLE;
+        }
+    return 0;
+    }
+
+static int swr_process(struct resampler *self, SRC_DATA *data)
+    {
+    const uint8_t *in = (const uint8_t *)data->data_in;
+    uint8_t *out = (uint8_t *)data->data_out;
+    int n, m;
+
+    if ((n = swr_convert(self->swr, &out, data->output_frames, data->input_frames ? &in : NULL, data->input_frames)) < 0)
+        return RESAMPLER_ERR_SWRESAMPLE;
+    /* drain what swresample holds back, the rest comes with the next call */
+    if (data->end_of_input && n < data->output_frames)
+        {
+        out += n * self->channels * sizeof (float);
+        if ((m = swr_convert(self->swr, &out, data->output_frames - n, NULL, 0)) < 0)
+            return RESAMPLER_ERR_SWRESAMPLE;
+        n += m;
+        }
+    data->input_frames_used = data->input_frames;
+    data->output_frames_gen = n;
+    return 0;
+    }
+#endif /* USE_SWR */
+
+/* resampler_setup: a fresh backend for the ratio, libsamplerate where no other is suitable */
+static int resampler_setup(struct resampler *self, double ratio)
+    {
+    int up, down, error = 0;
+
+    polyphase_delete(self->poly);
+    self->poly = NULL;
+    if (self->src)
+        self->src = src_delete(self->src);
+#ifdef USE_SWR
+    if (self->swr)
+        swr_free(&self->swr);
+#endif
+    self->ratio = ratio;
+
+    switch (self->kind)
+        {
+        case RESAMPLER_POLYPHASE:
+            if (rational(ratio, &up, &down))
+                {
+                if (!(self->poly = polyphase_new(up, down, self->quality, self->channels)))
+                    return RESAMPLER_ERR_MALLOC;
+                return 0;
+                }
+            fprintf(stderr, "resampler_setup: no polyphase filter for a ratio of %f, using libsamplerate\n", ratio);
+            break;
+#ifdef USE_SWR
+        case RESAMPLER_SWRESAMPLE:
+            return swr_setup(self, ratio);
+#endif
+        default:
+            break;
+        }
+    self->src = src_new(self->quality, self->channels, &error);
+    return error;
+    }
+
+struct resampler *resampler_new(enum resampler_kind kind, int quality, int channels, int *error)
+    {
+    struct resampler *self;
+
+    if (!(self = calloc(1, sizeof (struct resampler))))
+        {
+        *error = RESAMPLER_ERR_MALLOC;
+        return NULL;
+        }
+    self->kind = kind;
+    self->quality = quality;
+    self->channels = channels;
+    /* the others wait on the ratio, which comes with the first audio */
+    if (kind == RESAMPLER_LIBSAMPLERATE && !(self->src = src_new(quality, channels, error)))
+        {
+        free(self);
+        return NULL;
+        }
+    *error = 0;
+    return self;
+    }
+
+struct resampler *resampler_delete(struct resampler *self)
+    {
+    if (self)
+        {
+        if (self->src)
+            src_delete(self->src);
+        polyphase_delete(self->poly);
+#ifdef USE_SWR
+        if (self->swr)
+            swr_free(&self->swr);
+#endif
+        free(self);
+        }
+    return NULL;
+    }
+
+int resampler_process(struct resampler *self, SRC_DATA *data)
+    {
+    int error;
+
+    /* a new ratio starts the filter afresh, libsamplerate can change ratio by itself */
+    if (self->kind != RESAMPLER_LIBSAMPLERATE && data->src_ratio != self->ratio)
+        if ((error = resampler_setup(self, data->src_ratio)))
+            return error;
+    if (self->poly)
+        return polyphase_process(self->poly, data);
+#ifdef USE_SWR
+    if (self->swr)
+        return swr_process(self, data);
+#endif
+    return src_process(self->src, data);
+    }
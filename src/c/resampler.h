@@ -0,0 +1,52 @@
+/*
+#   resampler.h: sample rate conversion for the decoders with a choice of backend
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <samplerate.h>
+
+enum resampler_kind
+    {
+    RESAMPLER_LIBSAMPLERATE,    /* the sinc converters of libsamplerate */
+    RESAMPLER_SWRESAMPLE,       /* libswresample where it was built in */
+    RESAMPLER_POLYPHASE,        /* fixed ratio polyphase filter e.g. 44.1k <-> 48k */
+    RESAMPLER_N_KINDS
+    };
+
+struct resampler;
+
+/* resampler_kind_parse: "libsamplerate", "swresample" or "polyphase", FALSE for anything else
+ * swresample becomes libsamplerate when it isn't built in
+ */
+int resampler_kind_parse(const char *name, enum resampler_kind *kind);
+const char *resampler_kind_name(enum resampler_kind kind);
+
+/* resampler_new: drop-in for src_new, quality being the libsamplerate converter type
+ * the polyphase filter is used where the ratio set in the SRC_DATA is that of two small
+ * integers, libsamplerate otherwise, so it suits any pair of rates
+ */
+struct resampler *resampler_new(enum resampler_kind kind, int quality, int channels, int *error);
+struct resampler *resampler_delete(struct resampler *self);
+
+/* resampler_process: as src_process, the ratio may not change once audio has gone in */
+int resampler_process(struct resampler *self, SRC_DATA *data);
+const char *resampler_strerror(int error);
+
+#endif /* RESAMPLER_H */
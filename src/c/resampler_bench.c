@@ -0,0 +1,202 @@
+/*
+#   resampler_bench.c: speed and quality of the resampler backends at each quality setting
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* built by make bench and linked against the idjc module
+ *
+ * stereo sine tones are converted in chunks the size the decoders use and
+ * the cpu time is taken as a real-time factor, quality is THD+N, which is
+ * what remains of the output once a sine at the tone's frequency is fitted
+ * to it, so the delay through the filter doesn't matter
+ *
+ * usage: resampler_bench [-s seconds] [input rate output rate] ...
+ * the default is 44100 to 48000 and back
+ */
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "resampler.h"
+
+#define CHUNK 4096
+#define N_TONES 3
+
+static const double tones[N_TONES] = { 1000.0, 10000.0, 18000.0 };
+
+/* the libsamplerate converter types the quality setting selects */
+static const char *const quality_names[] = { "sinc best", "sinc medium", "sinc fastest", "zero order", "linear" };
+
+static double seconds = 5.0;
+
+static double cpu_now()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+/* thd_n: fit a sine of frequency f to the middle of the output, the residual against it in dB
+ * the gain of the fitted sine is returned through gain_db
+ */
+static double thd_n(const float *y, long n, double f, double rate, double amplitude, double *gain_db)
+    {
+    double ss = 0.0, cc = 0.0, sc = 0.0, ys = 0.0, yc = 0.0, yy = 0.0, det, a, b, fit;
+
+    for (long i = n / 8; i < n - n / 8; ++i)
+        {
+        double s = sin(2.0 * M_PI * f * i / rate), c = cos(2.0 * M_PI * f * i / rate);
+
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += y[i * 2] * s;
+        yc += y[i * 2] * c;
+        yy += (double)y[i * 2] * y[i * 2];
+        }
+    det = ss * cc - sc * sc;
+    a = (ys * cc - yc * sc) / det;
+    b = (yc * ss - ys * sc) / det;
+    fit = a * ys + b * yc;
+    *gain_db = 20.0 * log10(hypot(a, b) / amplitude);
+    /* float rounding sets the floor */
+    return (yy - fit > fit * 1e-16) ? 10.0 * log10((yy - fit) / fit) : -160.0;
+    }
+
+/* run: convert each tone, FALSE when the backend can't be set up */
+static int run(enum resampler_kind kind, int quality, int in_rate, int out_rate, float *in, float *out)
+    {
+    const double amplitude = 0.5;
+    long n_in = (long)(seconds * in_rate), n_out;
+    double cpu = 0.0, t, result[N_TONES], gain = 0.0;
+    struct resampler *r;
+    SRC_DATA data;
+    int error;
+
+    for (int k = 0; k < N_TONES; ++k)
+        {
+        if (tones[k] >= 0.5 * ((in_rate < out_rate) ? in_rate : out_rate))
+            {
+            result[k] = NAN;
+            continue;
+            }
+        for (long i = 0; i < n_in; ++i)
+            in[i * 2] = in[i * 2 + 1] = amplitude * sin(2.0 * M_PI * tones[k] * i / in_rate);
+        if (!(r = resampler_new(kind, quality, 2, &error)))
+            {
+            fprintf(stderr, "resampler_new: %s\n", resampler_strerror(error));
+            return 0;
+            }
+
+        data.src_ratio = (double)out_rate / in_rate;
+        n_out = 0;
+        t = cpu_now();
+        for (long i = 0; i < n_in; i += data.input_frames_used)
+            {
+            data.data_in = in + i * 2;
+            data.input_frames = (n_in - i < CHUNK) ? n_in - i : CHUNK;
+            data.end_of_input = (i + data.input_frames == n_in);
+            data.data_out = out + n_out * 2;
+            data.output_frames = (long)(data.input_frames * data.src_ratio) + 512;
+            if ((error = resampler_process(r, &data)))
+                {
+                fprintf(stderr, "resampler_process: %s\n", resampler_strerror(error));
+                resampler_delete(r);
+                return 0;
+                }
+            n_out += data.output_frames_gen;
+            }
+        cpu += cpu_now() - t;
+        resampler_delete(r);
+        result[k] = thd_n(out, n_out, tones[k], out_rate, amplitude, &gain);
+        }
+
+    printf("%-14s %-13s %9.1f", resampler_kind_name(kind), quality_names[quality], cpu > 0.0 ? N_TONES * seconds / cpu : 0.0);
+    for (int k = 0; k < N_TONES; ++k)
+        printf(" %9.1f", result[k]);
+    printf(" %9.2f\n", gain);
+    return 1;
+    }
+
+static void usage(const char *name)
+    {
+    fprintf(stderr, "usage: %s [-s seconds] [input rate output rate] ...\n", name);
+    exit(2);
+    }
+
+int main(int argc, char **argv)
+    {
+    int default_rates[] = { 44100, 48000, 48000, 44100 };
+    int *rates = default_rates, n_rates = 4, opt;
+    float *in, *out;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1)
+        switch (opt)
+            {
+            case 's':
+                seconds = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+            }
+    if (seconds < 0.1 || (argc - optind) % 2)
+        usage(argv[0]);
+    if (optind < argc)
+        {
+        n_rates = argc - optind;
+        if (!(rates = malloc(n_rates * sizeof (int))))
+            exit(5);
+        for (int i = 0; i < n_rates; ++i)
+            if ((rates[i] = atoi(argv[optind + i])) < 8000)
+                usage(argv[0]);
+        }
+
+    for (int p = 0; p < n_rates; p += 2)
+        {
+        long n_in = (long)(seconds * rates[p]) + 1;
+        long n_out = (long)(n_in * (double)rates[p + 1] / rates[p]) + 4096;
+
+        if (!(in = malloc(n_in * 2 * sizeof (float))) || !(out = malloc(n_out * 2 * sizeof (float))))
+            {
+            fprintf(stderr, "resampler_bench: malloc failure\n");
+            exit(5);
+            }
+        printf("\n%d Hz to %d Hz, stereo, THD+N in dB\n", rates[p], rates[p + 1]);
+        printf("%-14s %-13s %9s %9s %9s %9s %9s\n", "resampler", "quality", "rtf cpu", "1 kHz", "10 kHz", "18 kHz", "18k gain");
+        /* the rsqual settings of the libsamplerate converter as used until now, then the others */
+        for (int q = 0; q <= SRC_LINEAR; ++q)
+            run(RESAMPLER_LIBSAMPLERATE, q, rates[p], rates[p + 1], in, out);
+        for (enum resampler_kind kind = RESAMPLER_SWRESAMPLE; kind < RESAMPLER_N_KINDS; ++kind)
+            {
+            enum resampler_kind parsed;
+
+            /* swresample isn't always built in */
+            if (!resampler_kind_parse(resampler_kind_name(kind), &parsed) || parsed != kind)
+                continue;
+            for (int q = 0; q <= SRC_SINC_FASTEST; ++q)
+                if (!run(kind, q, rates[p], rates[p + 1], in, out))
+                    break;
+            }
+        free(in);
+        free(out);
+        }
+    return 0;
+    }
@@ -0,0 +1,142 @@
+/*
+#   rtarena.c: memory the jack process callback touches, faulted in and locked at startup
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "rtarena.h"
+
+#define TRUE 1
+#define FALSE 0
+
+/* allocations start on a cache line */
+#define RTARENA_ALIGN 64
+
+static struct
+    {
+    pthread_mutex_t mutex;
+    char *base;
+    size_t size;
+    size_t used;
+    size_t n_heap;              /* allocations that didn't fit */
+    size_t heap_bytes;
+    int locked;
+    } arena = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+int rtarena_lock(void *ptr, size_t len)
+    {
+    static int warned;
+    volatile char *p = ptr;
+    long page = sysconf(_SC_PAGESIZE);
+
+    if (!len)
+        return TRUE;
+
+    /* a write to each page has the kernel back it now rather than in the callback */
+    for (size_t i = 0; i < len; i += page)
+        p[i] = p[i];
+    p[len - 1] = p[len - 1];
+
+    if (mlock(ptr, len))
+        {
+        if (!warned)
+            {
+            fprintf(stderr, "rtarena_lock: mlock failed, %s -- raise the memlock limit to keep the audio memory resident\n", strerror(errno));
+            warned = TRUE;
+            }
+        return FALSE;
+        }
+    return TRUE;
+    }
+
+void rtarena_lock_ringbuffer(jack_ringbuffer_t *rb)
+    {
+    rtarena_lock(rb->buf, rb->size);
+    }
+
+int rtarena_init(size_t size)
+    {
+    void *base;
+
+    if (!size)
+        return FALSE;
+    if ((base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        {
+        perror("rtarena_init: mmap");
+        return FALSE;
+        }
+    pthread_mutex_lock(&arena.mutex);
+    arena.base = base;
+    arena.size = size;
+    arena.used = 0;
+    arena.locked = rtarena_lock(base, size);
+    pthread_mutex_unlock(&arena.mutex);
+    return TRUE;
+    }
+
+void *rtarena_calloc(size_t nmemb, size_t size)
+    {
+    size_t bytes, rounded;
+    void *p = NULL;
+
+    if (size && nmemb > SIZE_MAX / size)
+        return NULL;
+    bytes = nmemb * size;
+    rounded = (bytes + RTARENA_ALIGN - 1) & ~(size_t)(RTARENA_ALIGN - 1);
+
+    pthread_mutex_lock(&arena.mutex);
+    if (arena.base && rounded <= arena.size - arena.used)
+        {
+        p = arena.base + arena.used;
+        arena.used += rounded;
+        }
+    else
+        {
+        arena.n_heap++;
+        arena.heap_bytes += bytes;
+        }
+    pthread_mutex_unlock(&arena.mutex);
+
+    /* the arena comes zeroed from mmap and is never handed out twice */
+    return p ? p : calloc(nmemb, size);
+    }
+
+void rtarena_free(void *ptr)
+    {
+    char *p = ptr;
+
+    if (arena.base && p >= arena.base && p < arena.base + arena.size)
+        return;
+    free(ptr);
+    }
+
+void rtarena_report()
+    {
+    pthread_mutex_lock(&arena.mutex);
+    fprintf(stderr, "rtarena: %zu of %zu KiB used, %s\n", arena.used / 1024, arena.size / 1024, arena.locked ? "locked" : "not locked");
+    if (arena.n_heap)
+        fprintf(stderr, "rtarena: %zu allocations, %zu KiB, didn't fit and came from the heap -- raise $rt_arena_kb\n", arena.n_heap, arena.heap_bytes / 1024);
+    pthread_mutex_unlock(&arena.mutex);
+    }
@@ -0,0 +1,44 @@
+/*
+#   rtarena.h: memory the jack process callback touches, faulted in and locked at startup
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RTARENA_H
+#define RTARENA_H
+
+#include <stddef.h>
+#include <jack/ringbuffer.h>
+
+/* rtarena_init: map, fault in and mlock the arena
+ * without it, or once it is used up, allocations come from the heap
+ */
+int rtarena_init(size_t size);
+
+/* rtarena_calloc: zeroed memory for objects made once and kept until exit
+ * the arena is never reused so rtarena_free of arena memory does nothing
+ */
+void *rtarena_calloc(size_t nmemb, size_t size);
+void rtarena_free(void *ptr);
+
+/* rtarena_lock: fault in and mlock memory the arena couldn't hold e.g. ringbuffers */
+int rtarena_lock(void *ptr, size_t len);
+void rtarena_lock_ringbuffer(jack_ringbuffer_t *rb);
+
+/* rtarena_report: to stderr, how much of the arena is used */
+void rtarena_report();
+
+#endif /* RTARENA_H */
@@ -0,0 +1,205 @@
+/*
+#   rttime.c: timing of the stages of the jack process callback
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* the jack callback is the only writer of the stats so it needs no locks
+ * it stores with relaxed atomics and a report may mix values either side of
+ * a period, which for counts running into the thousands is neither here nor there
+ */
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "main.h"
+#include "rttime.h"
+
+#define RTTIME_BUCKETS 16       /* bucket 0 is under 1us, bucket n from 2^(n-1)us, the last open ended */
+
+struct rttime_hist
+    {
+    uint32_t bucket[RTTIME_BUCKETS];
+    uint32_t count;
+    uint32_t max_ns;
+    uint64_t total_ns;
+    };
+
+static const char * const stage_names[RTTIME_STAGES] = {
+    "midi", "mics", "players", "mix", "output", "feed" };
+
+/* written only by the jack callback */
+static struct
+    {
+    struct rttime_hist stage[RTTIME_STAGES];
+    struct rttime_hist period;
+    uint32_t over[3];                   /* periods taking over 50%, 80% and 100% of the budget */
+    uint32_t late[RTTIME_STAGES];       /* the longest stage of each period over budget */
+    } stats;
+
+static uint32_t period_ns[RTTIME_STAGES];       /* this period so far */
+static uint32_t last_ns[RTTIME_STAGES];         /* the last complete period, for the xrun callback */
+static uint64_t period_from, mark_from;
+static int timing;                              /* not while freewheeling */
+static int reset_due;
+static double ns_per_frame;
+static uint32_t budget_ns;
+
+/* written only by the xrun callback */
+static uint32_t xruns, xrun_blame[RTTIME_STAGES];
+
+static inline uint64_t now_ns()
+    {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+    }
+
+static inline void bump(uint32_t *p, uint32_t n)
+    {
+    __atomic_store_n(p, *p + n, __ATOMIC_RELAXED);
+    }
+
+static void hist_add(struct rttime_hist *h, uint32_t ns)
+    {
+    uint32_t us = ns / 1000;
+    int i = us ? 32 - __builtin_clz(us) : 0;
+
+    bump(&h->bucket[i < RTTIME_BUCKETS ? i : RTTIME_BUCKETS - 1], 1);
+    bump(&h->count, 1);
+    if (ns > h->max_ns)
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->total_ns, h->total_ns + ns, __ATOMIC_RELAXED);
+    }
+
+static enum rttime_stage longest(const uint32_t *ns)
+    {
+    enum rttime_stage worst = 0;
+
+    for (int i = 1; i < RTTIME_STAGES; ++i)
+        if (ns[i] > ns[worst])
+            worst = i;
+    return worst;
+    }
+
+void rttime_init(jack_nframes_t sample_rate)
+    {
+    ns_per_frame = 1e9 / sample_rate;
+    }
+
+void rttime_period_start(jack_nframes_t n_frames)
+    {
+    if (!(timing = !g.freewheel && ns_per_frame > 0.0))
+        return;
+    if (__atomic_exchange_n(&reset_due, 0, __ATOMIC_ACQUIRE))
+        memset(&stats, 0, sizeof stats);
+    budget_ns = n_frames * ns_per_frame;
+    memset(period_ns, 0, sizeof period_ns);
+    period_from = mark_from = now_ns();
+    }
+
+void rttime_mark(enum rttime_stage stage)
+    {
+    uint64_t now;
+
+    if (!timing)
+        return;
+    now = now_ns();
+    period_ns[stage] += now - mark_from;
+    mark_from = now;
+    }
+
+void rttime_period_end()
+    {
+    uint32_t ns;
+
+    if (!timing)
+        return;
+    ns = now_ns() - period_from;
+
+    for (int i = 0; i < RTTIME_STAGES; ++i)
+        {
+        if (period_ns[i])
+            hist_add(&stats.stage[i], period_ns[i]);
+        __atomic_store_n(&last_ns[i], period_ns[i], __ATOMIC_RELAXED);
+        }
+    hist_add(&stats.period, ns);
+
+    if (ns > budget_ns / 2)
+        {
+        bump(&stats.over[0], 1);
+        if (ns > budget_ns / 5 * 4)
+            {
+            bump(&stats.over[1], 1);
+            if (ns > budget_ns)
+                {
+                bump(&stats.over[2], 1);
+                bump(&stats.late[longest(period_ns)], 1);
+                }
+            }
+        }
+    }
+
+void rttime_xrun()
+    {
+    uint32_t ns[RTTIME_STAGES];
+
+    for (int i = 0; i < RTTIME_STAGES; ++i)
+        ns[i] = __atomic_load_n(&last_ns[i], __ATOMIC_RELAXED);
+    __atomic_fetch_add(&xrun_blame[longest(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&xruns, 1, __ATOMIC_RELAXED);
+    }
+
+static void hist_report(GString *out, const char *name, const struct rttime_hist *h)
+    {
+    uint32_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_load_n(&h->total_ns, __ATOMIC_RELAXED);
+
+    g_string_append_printf(out, "rt_%s_count=%u\nrt_%s_mean_us=%.1f\nrt_%s_max_us=%.1f\nrt_%s_hist=", name, count,
+                name, count ? total / 1000.0 / count : 0.0, name, __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED) / 1000.0, name);
+    for (int i = 0; i < RTTIME_BUCKETS; ++i)
+        g_string_append_printf(out, i ? ",%u" : "%u", __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED));
+    g_string_append_c(out, '\n');
+    }
+
+void rttime_report(GString *out, int reset)
+    {
+    char key[32];
+
+    g_string_append_printf(out, "rt_budget_us=%.1f\nrt_over_50=%u\nrt_over_80=%u\nrt_over_100=%u\nrt_xruns=%u\n",
+                __atomic_load_n(&budget_ns, __ATOMIC_RELAXED) / 1000.0,
+                __atomic_load_n(&stats.over[0], __ATOMIC_RELAXED),
+                __atomic_load_n(&stats.over[1], __ATOMIC_RELAXED),
+                __atomic_load_n(&stats.over[2], __ATOMIC_RELAXED),
+                reset ? __atomic_exchange_n(&xruns, 0, __ATOMIC_RELAXED) : __atomic_load_n(&xruns, __ATOMIC_RELAXED));
+    hist_report(out, "period", &stats.period);
+
+    for (int i = 0; i < RTTIME_STAGES; ++i)
+        {
+        snprintf(key, sizeof key, "stage_%s", stage_names[i]);
+        hist_report(out, key, &stats.stage[i]);
+        g_string_append_printf(out, "rt_%s_late=%u\nrt_%s_xruns=%u\n",
+                key, __atomic_load_n(&stats.late[i], __ATOMIC_RELAXED), key,
+                reset ? __atomic_exchange_n(&xrun_blame[i], 0, __ATOMIC_RELAXED) : __atomic_load_n(&xrun_blame[i], __ATOMIC_RELAXED));
+        }
+
+    /* the jack callback clears its own stats at the start of the next period */
+    if (reset)
+        __atomic_store_n(&reset_due, 1, __ATOMIC_RELEASE);
+    }
@@ -0,0 +1,54 @@
+/*
+#   rttime.h: timing of the stages of the jack process callback
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RTTIME_H
+#define RTTIME_H
+
+#include <jack/jack.h>
+#include <glib.h>
+
+/* the stages in the order the callback runs them
+ * a mark charges the time since the previous mark to the stage named
+ * so a stage may be marked more than once in a period and its times add up
+ */
+enum rttime_stage {
+    RTTIME_MIDI,            /* queueing the midi events */
+    RTTIME_MICS,            /* the channel strips */
+    RTTIME_PLAYERS,         /* player and jingle ringbuffer reads */
+    RTTIME_MIX,             /* the mixing loop, including the per-sample limiters */
+    RTTIME_OUTPUT,          /* alarm tone, true peak limiter and the meters */
+    RTTIME_FEED,            /* audio feed to the encoders and recorders */
+    RTTIME_STAGES
+    };
+
+/* rttime_init: the sample rate the period budget is worked out from */
+void rttime_init(jack_nframes_t sample_rate);
+
+/* called in the jack callback only */
+void rttime_period_start(jack_nframes_t n_frames);
+void rttime_mark(enum rttime_stage stage);
+void rttime_period_end();
+
+/* rttime_xrun: for the jack xrun callback, blames the stage that took longest last period */
+void rttime_xrun();
+
+/* rttime_report: append the counts so far as key=value lines, optionally starting afresh */
+void rttime_report(GString *out, int reset);
+
+#endif /* RTTIME_H */
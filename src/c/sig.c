@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include "evloop.h"
 
 static sigset_t mask;
 static int working;
@@ -35,6 +36,7 @@ static void usr1_handler(int sig)
     {
     ++sigusr1count;
     signal(sig, usr1_handler);
+    evloop_post(EVLOOP_SESSION);
     }
 
 #define A(s) && sigaddset(&mask, s)
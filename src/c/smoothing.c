@@ -50,6 +50,11 @@ void smoothing_mute_process(struct smoothing_mute *self)
         }
     }
 
+void smoothing_mute_settle(struct smoothing_mute *self)
+    {
+    self->level = (!self->control || *self->control) ? 1.0f : 0.0f;
+    }
+
 void smoothing_volume_init(struct smoothing_volume *self, int *control, float scale)
     {
     static int nullcontrol = 0;
@@ -70,3 +75,19 @@ void smoothing_volume_process(struct smoothing_volume *self)
         self->level = powf(10.0f, (self->tracking - 127) * self->scale);
         }
     }
+
+void smoothing_volume_settle(struct smoothing_volume *self)
+    {
+    self->tracking = *self->control;
+    self->level = powf(10.0f, (self->tracking - 127) * self->scale);
+    }
+
+void smoothing_ramp(float *restrict out, float *from, float target, int n)
+    {
+    const float start = *from;
+    const float step = (target - start) / n;
+
+    for (int i = 0; i < n; ++i)
+        out[i] = start + step * (i + 1);
+    *from = target;
+    }
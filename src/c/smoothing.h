@@ -28,6 +28,8 @@ struct smoothing_mute
 
 void smoothing_mute_init(struct smoothing_mute *, int *control);
 void smoothing_mute_process(struct smoothing_mute *);
+/* smoothing_mute_settle: jump to where processing would eventually take it */
+void smoothing_mute_settle(struct smoothing_mute *);
 
 struct smoothing_volume
     {
@@ -39,5 +41,9 @@ struct smoothing_volume
     
 void smoothing_volume_init(struct smoothing_volume *self, int *control, float scale);
 void smoothing_volume_process(struct smoothing_volume *self);
+void smoothing_volume_settle(struct smoothing_volume *self);
+
+/* smoothing_ramp: a linear ramp across a block, from the value where the last one ended to target */
+void smoothing_ramp(float *restrict out, float *from, float target, int n);
 
 #endif /* SMOOTHING_H */
@@ -46,10 +46,10 @@ static void sndfiledecode_init(struct xlplayer *xlplayer)
     if (self->sf_info.samplerate != (int)xlplayer->samplerate)
         {
         fprintf(stderr, "sndfiledecode_init: configuring resampler\n");
-        xlplayer->src_state = src_new(xlplayer->rsqual, self->sf_info.channels, &src_error);
+        xlplayer->src_state = resampler_new(xlplayer->resampler, xlplayer->rsqual, self->sf_info.channels, &src_error);
         if (src_error)
             {
-            fprintf(stderr, "sndfiledecode_init: %s src_new reports - %s\n", xlplayer->playername, src_strerror(src_error));
+            fprintf(stderr, "sndfiledecode_init: %s resampler_new reports - %s\n", xlplayer->playername, resampler_strerror(src_error));
             sf_close(self->sndfile);
             xlplayer->playmode = PM_STOPPED;
             xlplayer->command = CMD_COMPLETE;
@@ -80,9 +80,9 @@ static void sndfiledecode_play(struct xlplayer *xlplayer)
         xlplayer->src_data.input_frames = sf_count;
         xlplayer->src_data.output_frames = (int)(xlplayer->src_data.input_frames * xlplayer->src_data.src_ratio) + 2 + (512 * xlplayer->src_data.end_of_input);
         xlplayer->src_data.data_out = realloc(xlplayer->src_data.data_out, xlplayer->src_data.output_frames * self->sf_info.channels * sizeof (float));
-        if ((src_error = src_process(xlplayer->src_state, &(xlplayer->src_data))))
+        if ((src_error = resampler_process(xlplayer->src_state, &(xlplayer->src_data))))
             {
-            fprintf(stderr, "sndfiledecode_play: %s\n", src_strerror(src_error));
+            fprintf(stderr, "sndfiledecode_play: %s\n", resampler_strerror(src_error));
             xlplayer->playmode = PM_EJECTING;
             return;
             }
@@ -107,7 +107,7 @@ static void sndfiledecode_eject(struct xlplayer *xlplayer)
         {
         if (xlplayer->src_data.data_out)
             free(xlplayer->src_data.data_out);
-        xlplayer->src_state = src_delete(xlplayer->src_state);
+        xlplayer->src_state = resampler_delete(xlplayer->src_state);
         }
     free(self->flbuf);
     free(self);
@@ -18,26 +18,52 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sndfile.h>
 #include "sndfileinfo.h"
 #include "main.h"
 
-int sndfileinfo(char *pathname)
+/* sndfileinfo_read: the length and tags of a file, artist and title are only given as a pair
+ * the tags are allocated on the heap and are NULL when absent
+ */
+int sndfileinfo_read(const char *pathname, double *length, char **artist, char **title, char **album)
     {
     SF_INFO sfinfo;
     SNDFILE *handle;
-    const char *artist, *title, *album;
+    const char *a, *t, *al;
 
+    *artist = *title = *album = NULL;
     if (!(handle = sf_open(pathname, SFM_READ, &sfinfo)))
         {
         fprintf(stderr, "sndfileinfo failed to open file %s\n", pathname);
         return 0;
         }
-    artist = sf_get_string(handle, SF_STR_ARTIST);
-    title = sf_get_string(handle, SF_STR_TITLE);
-    album = sf_get_string(handle, SF_STR_ALBUM);
+    a = sf_get_string(handle, SF_STR_ARTIST);
+    t = sf_get_string(handle, SF_STR_TITLE);
+    al = sf_get_string(handle, SF_STR_ALBUM);
+
+    *length = (double)sfinfo.frames / sfinfo.samplerate;
+    if (a && t)
+        {
+        *artist = strdup(a);
+        *title = strdup(t);
+        if (al)
+            *album = strdup(al);
+        }
+    sf_close(handle);
+    return 1;
+    }
+
+int sndfileinfo(char *pathname)
+    {
+    double length;
+    char *artist, *title, *album;
+
+    if (!sndfileinfo_read(pathname, &length, &artist, &title, &album))
+        return 0;
  
-    fprintf(g.out, "idjcmixer: sndfileinfo length=%f\n", (float)sfinfo.frames / sfinfo.samplerate);
+    fprintf(g.out, "idjcmixer: sndfileinfo length=%f\n", (float)length);
     if (artist && title)
         {
         fprintf(g.out, "idjcmixer: sndfileinfo artist=%s\n", artist);
@@ -46,7 +72,9 @@ int sndfileinfo(char *pathname)
             fprintf(g.out, "idjcmixer: sndfileinfo album=%s\n", album);
         }
     fprintf(g.out, "idjcmixer: sndfileinfo end\n");
-    sf_close(handle);
     fflush(g.out);
+    free(artist);
+    free(title);
+    free(album);
     return 1;
     }
@@ -18,3 +18,4 @@
 */
 
 int sndfileinfo(char *pathname);
+int sndfileinfo_read(const char *pathname, double *length, char **artist, char **title, char **album);
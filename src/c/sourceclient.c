@@ -42,10 +42,13 @@ static void threads_init(struct threads_info *ti)
     ti->n_encoders = atoi(getenv("num_encoders"));
     ti->n_streamers = atoi(getenv("num_streamers"));
     ti->n_recorders = atoi(getenv("num_recorders"));
+    ti->n_hlssinks = getenv("num_hls_sinks") ? atoi(getenv("num_hls_sinks")) : 0;
     ti->encoder = calloc(ti->n_encoders, sizeof (struct encoder *));
+    ti->encoder_spare = calloc(ti->n_encoders, sizeof (struct encoder *));
     ti->streamer = calloc(ti->n_streamers, sizeof (struct streamer *));
     ti->recorder = calloc(ti->n_recorders, sizeof (struct recorder *));
-    if (!(ti->encoder && ti->streamer && ti->recorder))
+    ti->hlssink = calloc(ti->n_hlssinks ? ti->n_hlssinks : 1, sizeof (struct hlssink *));
+    if (!(ti->encoder && ti->encoder_spare && ti->streamer && ti->recorder && ti->hlssink))
         {
         fprintf(stderr, "threads_init: malloc failure\n");
         exit(5);
@@ -56,24 +59,40 @@ static void threads_init(struct threads_info *ti)
             fprintf(stderr, "threads_init: encoder initialisation failed\n");
             exit(5);
             }
+    startup_mark("encoders");
+    if (!encoder_pool_init(ti))
+        {
+        fprintf(stderr, "threads_init: encoder worker pool initialisation failed\n");
+        exit(5);
+        }
     for (i = 0; i < ti->n_streamers; i++)
         if (!(ti->streamer[i] = streamer_init(ti, i)))
             {
             fprintf(stderr, "threads_init: streamer initialisation failed\n");
             exit(5);
             }
+    startup_mark("streamers");
     for (i = 0; i < ti->n_recorders; i++)
         if (!(ti->recorder[i] = recorder_init(ti, i)))
             {
             fprintf(stderr, "threads_init: recorder initialisation failed\n");
             exit(5);
             }
+    startup_mark("recorders");
+    for (i = 0; i < ti->n_hlssinks; i++)
+        if (!(ti->hlssink[i] = hlssink_init(ti, i)))
+            {
+            fprintf(stderr, "threads_init: hls sink initialisation failed\n");
+            exit(5);
+            }
     if (!(ti->audio_feed = audio_feed_init(ti)))
         {
         fprintf(stderr, "threads_init: audio feed initialisation failed\n");
         exit(5);
         }
-    fprintf(stderr, "started %d encoders, %d streamers, %d recorders\n", ti->n_encoders, ti->n_streamers, ti->n_recorders);
+    startup_mark("audio feed");
+    /* their threads are started on first use */
+    fprintf(stderr, "set up %d encoders, %d streamers, %d recorders, %d hls sinks\n", ti->n_encoders, ti->n_streamers, ti->n_recorders, ti->n_hlssinks);
     threads_up = TRUE;
     }
 
@@ -83,15 +102,20 @@ static void threads_shutdown(struct threads_info *ti)
     
     if (threads_up)
         {
+        for (i = 0; i < ti->n_hlssinks; i++)
+            hlssink_destroy(ti->hlssink[i]);
         for (i = 0; i < ti->n_recorders; i++)
             recorder_destroy(ti->recorder[i]);
         for (i = 0; i < ti->n_streamers; i++)
             streamer_destroy(ti->streamer[i]);
+        encoder_pool_destroy();
         for (i = 0; i < ti->n_encoders; i++)
             encoder_destroy(ti->encoder[i]);
         free(ti->recorder);
+        free(ti->hlssink);
         free(ti->streamer);
         free(ti->encoder);
+        free(ti->encoder_spare);
         audio_feed_destroy(ti->audio_feed);
         }
     }
@@ -113,7 +137,19 @@ static int get_report(struct threads_info *ti, struct universal_vars *uv, void *
         return FAILED;
         }
     if (!strcmp(uv->dev_type, "encoder"))
+        {
+        if (uv->tab >= 0 && uv->tab < ti->n_encoders)
+            return encoder_make_report(ti->encoder[uv->tab]);
+        fprintf(stderr, "get_report: encoder %s does not exist\n", uv->tab_id);
         return FAILED;
+        }
+    if (!strcmp(uv->dev_type, "hls"))
+        {
+        if (uv->tab >= 0 && uv->tab < ti->n_hlssinks)
+            return hlssink_make_report(ti->hlssink[uv->tab]);
+        fprintf(stderr, "get_report: hls sink %s does not exist\n", uv->tab_id);
+        return FAILED;
+        }
     fprintf(stderr, "get_report: unhandled dev_type %s\n", uv->dev_type);
     return FAILED;
     }
@@ -141,58 +177,76 @@ static struct threads_info ti;
 static struct encoder_vars ev;
 static struct streamer_vars sv;
 static struct recorder_vars rv;
+static struct hlssink_vars hv;
 static struct universal_vars uv;
 
+/* the encoder, streamer and recorder settings are kept between commands so all values persist */
 static struct kvpdict kvpdict[] = {
-    { "encode_source",    &ev.encode_source, NULL },        /* encoder_vars */
-    { "samplerate",       &ev.samplerate, NULL },
-    { "resample_quality", &ev.resample_quality, NULL },
-    { "family",           &ev.family, NULL },
-    { "codec",            &ev.codec, NULL },
-    { "bitrate",          &ev.bitrate, NULL },
-    { "variability",      &ev.variability, NULL },
-    { "bitwidth",         &ev.bitwidth, NULL },
-    { "mode",             &ev.mode, NULL },
-    { "metadata_mode",    &ev.metadata_mode, NULL },
-    { "standard",         &ev.standard, NULL },
-    { "pregain",          &ev.pregain, NULL },
-    { "postgain",         &ev.postgain, NULL },
-    { "quality",          &ev.quality, NULL },
-    { "complexity",       &ev.complexity, NULL },
-    { "framesize",        &ev.framesize, NULL },
-    { "filename",         &ev.filename, NULL },
-    { "offset",           &ev.offset, NULL },
-    { "custom_meta",      &ev.custom_meta, NULL },
-    { "artist",           &ev.artist, NULL },
-    { "title",            &ev.title, NULL },
-    { "album",            &ev.album, NULL },
-    { "stream_source",    &sv.stream_source, NULL },        /* streamer_vars */
-    { "server_type",      &sv.server_type, NULL },
-    { "host",             &sv.host, NULL },
-    { "port",             &sv.port, NULL },
-    { "mount",            &sv.mount, NULL },
-    { "login",            &sv.login, NULL },
-    { "password",         &sv.password, NULL },
-    { "useragent",        &sv.useragent, NULL },
-    { "dj_name",          &sv.dj_name, NULL },
-    { "listen_url",       &sv.listen_url, NULL },
-    { "description",      &sv.description, NULL },
-    { "genre",            &sv.genre, NULL },
-    { "irc",              &sv.irc, NULL },
-    { "aim",              &sv.aim, NULL },
-    { "icq",              &sv.icq, NULL },
-    { "tls",              &sv.tls, NULL },
-    { "ca_directory",     &sv.ca_dir, NULL },
-    { "ca_file",          &sv.ca_file, NULL },
-    { "client_cert",      &sv.client_cert, NULL },
-    { "make_public",      &sv.make_public, NULL },
-    { "record_source",    &rv.record_source, NULL },        /* recorder_vars */
-    { "record_filename",  &rv.record_filename, NULL },
-    { "record_folder",    &rv.record_folder, NULL },
-    { "pause_button",     &rv.pause_button, NULL },
-    { "command",  &uv.command, NULL},
-    { "dev_type", &uv.dev_type, NULL},
-    { "tab_id",   &uv.tab_id, NULL},
+    { "encode_source",    &ev.encode_source, NULL, KVP_PERSIST },        /* encoder_vars */
+    { "samplerate",       &ev.samplerate, NULL, KVP_PERSIST },
+    { "resample_quality", &ev.resample_quality, NULL, KVP_PERSIST },
+    { "family",           &ev.family, NULL, KVP_PERSIST },
+    { "codec",            &ev.codec, NULL, KVP_PERSIST },
+    { "bitrate",          &ev.bitrate, NULL, KVP_PERSIST },
+    { "variability",      &ev.variability, NULL, KVP_PERSIST },
+    { "bitwidth",         &ev.bitwidth, NULL, KVP_PERSIST },
+    { "mode",             &ev.mode, NULL, KVP_PERSIST },
+    { "metadata_mode",    &ev.metadata_mode, NULL, KVP_PERSIST },
+    { "standard",         &ev.standard, NULL, KVP_PERSIST },
+    { "pregain",          &ev.pregain, NULL, KVP_PERSIST },
+    { "postgain",         &ev.postgain, NULL, KVP_PERSIST },
+    { "quality",          &ev.quality, NULL, KVP_PERSIST },
+    { "complexity",       &ev.complexity, NULL, KVP_PERSIST },
+    { "framesize",        &ev.framesize, NULL, KVP_PERSIST },
+    { "latency_mode",     &ev.latency_mode, NULL, KVP_PERSIST },
+    { "page_duration",    &ev.page_duration, NULL, KVP_PERSIST },
+    { "aac_encoder",      &ev.aac_encoder, NULL, KVP_PERSIST },
+    { "codec_threads",    &ev.codec_threads, NULL, KVP_PERSIST },
+    { "filename",         &ev.filename, NULL, KVP_PERSIST },
+    { "offset",           &ev.offset, NULL, KVP_PERSIST },
+    { "custom_meta",      &ev.custom_meta, NULL, KVP_PERSIST },
+    { "artist",           &ev.artist, NULL, KVP_PERSIST },
+    { "title",            &ev.title, NULL, KVP_PERSIST },
+    { "album",            &ev.album, NULL, KVP_PERSIST },
+    { "replay_seconds",   &ev.replay_seconds, NULL, KVP_PERSIST },
+    { "replay_filename",  &ev.replay_filename, NULL, KVP_PERSIST },
+    { "stream_source",    &sv.stream_source, NULL, KVP_PERSIST },        /* streamer_vars */
+    { "server_type",      &sv.server_type, NULL, KVP_PERSIST },
+    { "host",             &sv.host, NULL, KVP_PERSIST },
+    { "port",             &sv.port, NULL, KVP_PERSIST },
+    { "mount",            &sv.mount, NULL, KVP_PERSIST },
+    { "login",            &sv.login, NULL, KVP_PERSIST },
+    { "password",         &sv.password, NULL, KVP_PERSIST },
+    { "useragent",        &sv.useragent, NULL, KVP_PERSIST },
+    { "dj_name",          &sv.dj_name, NULL, KVP_PERSIST },
+    { "listen_url",       &sv.listen_url, NULL, KVP_PERSIST },
+    { "description",      &sv.description, NULL, KVP_PERSIST },
+    { "genre",            &sv.genre, NULL, KVP_PERSIST },
+    { "irc",              &sv.irc, NULL, KVP_PERSIST },
+    { "aim",              &sv.aim, NULL, KVP_PERSIST },
+    { "icq",              &sv.icq, NULL, KVP_PERSIST },
+    { "tls",              &sv.tls, NULL, KVP_PERSIST },
+    { "ca_directory",     &sv.ca_dir, NULL, KVP_PERSIST },
+    { "ca_file",          &sv.ca_file, NULL, KVP_PERSIST },
+    { "client_cert",      &sv.client_cert, NULL, KVP_PERSIST },
+    { "make_public",      &sv.make_public, NULL, KVP_PERSIST },
+    { "buffer_mode",      &sv.buffer_mode, NULL, KVP_PERSIST },
+    { "latency_min",      &sv.latency_min, NULL, KVP_PERSIST },
+    { "latency_max",      &sv.latency_max, NULL, KVP_PERSIST },
+    { "tier_sources",     &sv.tier_sources, NULL, KVP_PERSIST },
+    { "record_source",    &rv.record_source, NULL, KVP_PERSIST },        /* recorder_vars */
+    { "record_filename",  &rv.record_filename, NULL, KVP_PERSIST },
+    { "record_folder",    &rv.record_folder, NULL, KVP_PERSIST },
+    { "pause_button",     &rv.pause_button, NULL, KVP_PERSIST },
+    { "segment_minutes",  &rv.segment_minutes, NULL, KVP_PERSIST },
+    { "hls_source",       &hv.hls_source, NULL, KVP_PERSIST },           /* hlssink_vars */
+    { "hls_folder",       &hv.hls_folder, NULL, KVP_PERSIST },
+    { "hls_name",         &hv.hls_name, NULL, KVP_PERSIST },
+    { "hls_segment_s",    &hv.hls_segment_s, NULL, KVP_PERSIST },
+    { "hls_window",       &hv.hls_window, NULL, KVP_PERSIST },
+    { "command",  &uv.command, NULL, KVP_PERSIST },
+    { "dev_type", &uv.dev_type, NULL, KVP_PERSIST },
+    { "tab_id",   &uv.tab_id, NULL, KVP_PERSIST },
     { NULL, NULL, NULL } };
 
 static struct commandmap commandmap[] = {
@@ -208,9 +262,16 @@ static struct commandmap commandmap[] = {
     { "recorder_stop", recorder_stop, NULL },
     { "recorder_pause", recorder_pause, &rv },
     { "recorder_unpause", recorder_unpause, &rv },
+    { "hls_start", hlssink_start, &hv },
+    { "hls_stop", hlssink_stop, NULL },
     { "server_connect", streamer_connect, &sv },
     { "server_disconnect", streamer_disconnect, NULL },
     { "initiate_fade", encoder_initiate_fade, NULL },
+    { "replay_dump", encoder_replay_dump, &ev },
+#ifdef HAVE_AVCODEC
+    { "aac_benchmark", live_aac_encoder_benchmark, &ev },
+    { "aac_benchmark_report", live_aac_encoder_benchmark_report, NULL },
+#endif
     { NULL, NULL, NULL } }; 
 
 static void sourceclient_cleanup()
@@ -233,7 +294,7 @@ void sourceclient_init()
 
 int sourceclient_main()
     {
-    if (!kvp_parse(kvpdict, g.in))
+    if (!(g.framed_input ? kvp_parse_frame(kvpdict, g.in) : kvp_parse(kvpdict, g.in)))
         return FALSE;
 
     if (uv.command && command_parse(commandmap, &ti, &uv))
@@ -28,15 +28,20 @@ enum { FALSE, TRUE };
 struct encoder;
 struct streamer;
 struct recorder;
+struct hlssink;
 
 struct threads_info
     {
     int n_encoders;
     int n_streamers;
     int n_recorders;
+    int n_hlssinks;
     struct encoder **encoder;
+    struct encoder **encoder_spare;  /* for reordering ti->encoder in one store */
+    unsigned encoder_walk_epoch;     /* odd while the jack thread walks ti->encoder */
     struct streamer **streamer;
     struct recorder **recorder;
+    struct hlssink **hlssink;
     struct audio_feed *audio_feed;
     };
 
@@ -58,6 +63,7 @@ struct commandmap
 #include "encoder.h"
 #include "streamer.h"
 #include "recorder.h"
+#include "hlssink.h"
 
 void sourceclient_init();
 int sourceclient_main();
@@ -24,10 +24,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#ifndef USE_BSD_COMPAT
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 #include <shoutidjc/shout.h>
+#include <jack/jack.h>
 #include "sourceclient.h"
 #include "sig.h"
 #include "main.h"
+#include "evloop.h"
 
 /* other versions of libshout define SHOUT_FORMAT_VORBIS instead */
 #ifndef SHOUT_FORMAT_OGG
@@ -37,152 +47,754 @@
 /* the number of seconds of audio to stockpile before packet dumping takes place */
 static const int shout_buffer_seconds = 9;
 
-static void *streamer_main(void *args)
+/* how often the adaptive send queue is resized and how quickly the measurements decay */
+static const double adapt_interval = 1.0;
+static const double peak_delay_decay = 0.9;
+
+/* seconds of a near full queue before dropping a tier and of a near empty one before climbing back */
+static const int tier_down_secs = 3;
+static const int tier_up_secs = 30;
+
+/* how long a connection attempt may take including name resolution and the tls handshake */
+static const int connect_timeout_s = 15;
+
+/* how long a connection may keep saying to retry before it is given up on */
+static const int retry_timeout_s = 2;
+
+/* the longest time to wait for a packet before checking on the connection */
+static const int packet_wait_ms = 100;
+
+#ifndef USE_BSD_COMPAT
+/* the shared streaming engine, selected with $streamer_engine=shared
+ * one thread serves every connection, woken through eventfds by the encoders
+ * and by connect and disconnect requests, libshout being in non-blocking mode
+ */
+static struct streamer_engine
     {
-    struct streamer *self = args;
+    struct threads_info *threads_info;
+    pthread_t thread_h;
+    int epoll_fd;
+    int wake_fd;                 /* has the engine look over every connection */
+    int terminate;
+    int running;
+    } engine = { .epoll_fd = -1, .wake_fd = -1 };
+#endif
+
+/* streamer_latency_add: by the streamer, the time audio took from the mixer to libshout */
+static void streamer_latency_add(struct streamer *self, uint64_t capture_usecs)
+    {
+    uint64_t usecs = jack_get_time();
+
+    if (__atomic_exchange_n(&self->latency_reset_due, 0, __ATOMIC_ACQUIRE))
+        self->n_latency = 0;
+    __atomic_store_n(&self->latency_us[self->n_latency % STREAMER_LATENCY_SAMPLES],
+                usecs > capture_usecs ? (uint32_t)(usecs - capture_usecs) : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->n_latency, self->n_latency + 1, __ATOMIC_RELEASE);
+    }
+
+static int streamer_latency_cmp(const void *a, const void *b)
+    {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+    }
+
+/* streamer_latency_format: p50:p99 in milliseconds since the last call, 0 when not probing */
+static void streamer_latency_format(struct streamer *self, char *buf, size_t size)
+    {
+    uint32_t sorted[STREAMER_LATENCY_SAMPLES];
+    unsigned int n = __atomic_load_n(&self->n_latency, __ATOMIC_ACQUIRE);
+
+    if (n > STREAMER_LATENCY_SAMPLES)
+        n = STREAMER_LATENCY_SAMPLES;
+    for (unsigned int i = 0; i < n; ++i)
+        sorted[i] = __atomic_load_n(&self->latency_us[i], __ATOMIC_RELAXED);
+    qsort(sorted, n, sizeof sorted[0], streamer_latency_cmp);
+    snprintf(buf, size, "%.1f:%.1f", n ? sorted[n / 2] / 1000.0 : 0.0,
+                n ? sorted[(n - 1) * 99 / 100] / 1000.0 : 0.0);
+    /* the streamer starts the next window when it next sends */
+    __atomic_store_n(&self->latency_reset_due, 1, __ATOMIC_RELEASE);
+    }
+
+/* streamer_queue_audio: collect packet payloads so they can be sent with one call
+ * capture_usecs is when the packet's audio entered the mixer, 0 if not known
+ */
+static void streamer_queue_audio(struct streamer *self, void *data, size_t data_size, uint64_t capture_usecs)
+    {
+    char *newbuf;
+    size_t newsize;
+
+    if (self->send_fill + data_size > self->send_buffer_size)
+        {
+        for (newsize = self->send_buffer_size ? self->send_buffer_size : 4096; newsize < self->send_fill + data_size; newsize *= 2);
+        if (!(newbuf = realloc(self->send_buffer, newsize)))
+            {
+            fprintf(stderr, "streamer_queue_audio: malloc failure, packet lost\n");
+            return;
+            }
+        self->send_buffer = newbuf;
+        self->send_buffer_size = newsize;
+        }
+    if (!self->send_fill || !self->send_capture_usecs)
+        self->send_capture_usecs = capture_usecs;
+    memcpy(self->send_buffer + self->send_fill, data, data_size);
+    self->send_fill += data_size;
+    }
+
+/* streamer_send_audio: hand the collected audio over to libshout */
+static void streamer_send_audio(struct streamer *self)
+    {
+    if (!self->send_fill)
+        return;
+
+    switch(shout_send(self->shout, (unsigned char *)self->send_buffer, self->send_fill))
+        {
+        case SHOUTERR_SUCCESS:
+        case SHOUTERR_BUSY:
+            self->bytes_queued += self->send_fill;
+            if (self->send_capture_usecs)
+                streamer_latency_add(self, self->send_capture_usecs);
+            break;
+        default:
+            fprintf(stderr, "streamer_main: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
+            self->stream_mode = SM_DISCONNECTING;
+        }
+    self->send_fill = 0;
+    self->send_capture_usecs = 0;
+    }
+
+/* streamer_engine_wake: have the shared engine, if in use, look over every connection */
+static void streamer_engine_wake()
+    {
+#ifndef USE_BSD_COMPAT
+    uint64_t one = 1;
+
+    if (engine.wake_fd >= 0 && write(engine.wake_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        perror("streamer_engine_wake");
+#endif
+    }
+
+/* a connection being opened on a helper thread which the streamer may walk away from */
+struct streamer_open
+    {
+    shout_t *shout;
+    long status;
+    int state;
+    };
+
+enum { OPEN_BUSY, OPEN_DONE, OPEN_ABANDONED };
+
+/* helper threads still in shout_open, which libshout must outlive */
+static int open_helpers;
+
+/* streamer_open_main: open the server connection away from the command and streaming threads
+ * shout_open resolves the host name and so can block for a long time on a bad network
+ */
+static void *streamer_open_main(void *args)
+    {
+    struct streamer_open *job = args;
     struct timespec ms10 = { 0, 10000000 };
-    struct encoder_op_packet *packet;
-    size_t data_size;
-    unsigned connect_time = 0;
     int try_count = 10;
+    long status;
 
     sig_mask_thread();
-    while (!self->thread_terminate_f)
-        {
+    while ((status = shout_open(job->shout)) == SHOUTERR_RETRY && --try_count > 0)
         nanosleep(&ms10, NULL);
+    if (status == SHOUTERR_SUCCESS)
+        status = SHOUTERR_CONNECTED;
+    job->status = status;
+    if (__atomic_exchange_n(&job->state, OPEN_DONE, __ATOMIC_ACQ_REL) == OPEN_ABANDONED)
+        {
+        /* the streamer disconnected meanwhile so the connection is ours to drop */
+        shout_close(job->shout);
+        shout_free(job->shout);
+        free(job);
+        }
+    else
+        streamer_engine_wake();
+    __atomic_sub_fetch(&open_helpers, 1, __ATOMIC_RELEASE);
+    return NULL;
+    }
+
+/* streamer_open_start: begin opening the connection on a detached helper thread */
+static int streamer_open_start(struct streamer *self)
+    {
+    struct streamer_open *job;
+    pthread_attr_t attr;
+    pthread_t thread_h;
+    int rv;
+
+    if (!(job = calloc(1, sizeof (struct streamer_open))))
+        {
+        fprintf(stderr, "streamer_open_start: malloc failure\n");
+        return FAILED;
+        }
+    job->shout = self->shout;
+    job->state = OPEN_BUSY;
+    __atomic_add_fetch(&open_helpers, 1, __ATOMIC_ACQ_REL);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ((rv = pthread_create(&thread_h, &attr, streamer_open_main, job)))
+        {
+        fprintf(stderr, "streamer_open_start: pthread_create failed with error %d\n", rv);
+        __atomic_sub_fetch(&open_helpers, 1, __ATOMIC_RELEASE);
+        free(job);
+        }
+    else
+        self->open_job = job;
+    pthread_attr_destroy(&attr);
+    return rv ? FAILED : SUCCEEDED;
+    }
+
+/* streamer_open_abandon: stop waiting on the helper thread
+ * if shout_open has yet to return the helper is left to close and free the shout object
+ */
+static void streamer_open_abandon(struct streamer *self)
+    {
+    if (__atomic_exchange_n(&self->open_job->state, OPEN_ABANDONED, __ATOMIC_ACQ_REL) == OPEN_BUSY)
+        self->shout = NULL;
+    else
+        free(self->open_job);
+    self->open_job = NULL;
+    }
+
+/* streamer_adapt_start: begin measuring the connection for a stream of nominal bit rate br */
+static void streamer_adapt_start(struct streamer *self, int br)
+    {
+    self->byte_rate = ((br > 1000) ? br / 1000 : br) << 7;
+    self->throughput = self->offered = self->byte_rate;
+    self->peak_delay = 0.0;
+    self->bytes_queued = 0;
+    self->last_queuelen = shout_queuelen(self->shout);
+    clock_gettime(CLOCK_MONOTONIC, &self->adapt_time);
+
+    /* determine how much audio to hold in the send buffer */
+    if (self->adaptive)
+        self->max_shout_queue = (ssize_t)((self->latency_min + self->latency_max) * 0.5 * self->byte_rate);
+    else
+        self->max_shout_queue = shout_buffer_seconds * self->byte_rate;
+    }
+
+/* streamer_release_encoders: detach from every encoder used by this stream */
+static void streamer_release_encoders(struct streamer *self)
+    {
+    for (int i = 0; i < self->n_tiers; i++)
+        {
+        encoder_unregister_client(self->tier_op[i]);
+        self->tier_op[i] = NULL;
+        }
+    self->n_tiers = 0;
+    self->tier = 0;
+    self->encoder_op = NULL;
+    }
 
-        switch (self->stream_mode)
+/* streamer_switch_tier: carry on streaming from another tier's encoder starting at its newest packet
+ * the start of the new data is trimmed to a frame header so listeners hear only the one glitch
+ */
+static void streamer_switch_tier(struct streamer *self, int tier)
+    {
+    struct encoder_op *op = self->tier_op[tier];
+    int br = op->encoder->bitrate;
+    double target = self->byte_rate ? (double)self->max_shout_queue / self->byte_rate : shout_buffer_seconds;
+
+    fprintf(stderr, "streamer_main: switching from encoder %d to %d\n", self->encoder_op->encoder->numeric_id, op->encoder->numeric_id);
+    if (self->notify_fd >= 0)
+        {
+        encoder_client_set_notify(self->encoder_op, -1);
+        encoder_client_set_notify(op, self->notify_fd);
+        }
+    encoder_client_catch_up(op);
+    self->encoder_op = op;
+    self->tier = tier;
+    self->tier_sync = TRUE;
+    self->initial_serial = 0;
+    self->congested_secs = self->clear_secs = 0;
+
+    /* keep the same queue latency at the new rate */
+    self->byte_rate = ((br > 1000) ? br / 1000 : br) << 7;
+    self->throughput = self->offered = self->byte_rate;
+    self->max_shout_queue = (ssize_t)(target * self->byte_rate);
+    }
+
+/* streamer_tier_check: step down a tier when the queue stays full and back up after a long clear spell */
+static void streamer_tier_check(struct streamer *self, ssize_t queuelen)
+    {
+    int fill_pc;
+
+    if (self->n_tiers < 2 || self->disconnect_pending || !self->max_shout_queue)
+        return;
+
+    fill_pc = (int)(queuelen * 100 / self->max_shout_queue);
+    if (fill_pc >= 75)
+        {
+        self->clear_secs = 0;
+        if (++self->congested_secs >= tier_down_secs && self->tier + 1 < self->n_tiers)
+            streamer_switch_tier(self, self->tier + 1);
+        }
+    else if (fill_pc <= 10)
+        {
+        self->congested_secs = 0;
+        if (++self->clear_secs >= tier_up_secs && self->tier > 0)
+            streamer_switch_tier(self, self->tier - 1);
+        }
+    else
+        self->congested_secs = self->clear_secs = 0;
+    }
+
+/* streamer_add_tiers: register with the fallback encoders named in tier_sources
+ * they must be running and produce the same kind of stream as the main encoder at a lower bit rate
+ * only headerless mpeg and adts streams can be switched between at an arbitrary frame
+ */
+static void streamer_add_tiers(struct streamer *self, struct threads_info *ti, const char *tier_sources)
+    {
+    struct encoder *primary = self->tier_op[0]->encoder;
+    struct encoder_op *op;
+    const char *p = tier_sources;
+    char *end;
+    long id;
+    int i;
+
+    if (!p || !*p)
+        return;
+    if (primary->data_format.family != ENCODER_FAMILY_MPEG)
+        {
+        fprintf(stderr, "streamer_connect: bit rate tiers are only available for mpeg and aac streams\n");
+        return;
+        }
+
+    while (*p && self->n_tiers < STREAMER_MAX_TIERS)
+        {
+        id = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        p = end + strspn(end, ", ");
+
+        for (i = 0; i < self->n_tiers; i++)
+            if (self->tier_op[i]->encoder->numeric_id == id)
+                break;
+        if (i < self->n_tiers)
+            continue;
+        if (!(op = encoder_register_client(ti, (int)id)))
             {
-            case SM_DISCONNECTED:
-                pthread_mutex_lock(&self->mode_mutex);
-                while (self->stream_mode == SM_DISCONNECTED && !self->thread_terminate_f)
-                    pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
-                pthread_mutex_unlock(&self->mode_mutex);
-                continue;
-            case SM_CONNECTING:
-                switch(self->shout_status)
+            fprintf(stderr, "streamer_connect: failed to register with tier encoder %ld\n", id);
+            continue;
+            }
+        if (!op->encoder->run_request_f || op->encoder->data_format.family != primary->data_format.family ||
+                    op->encoder->data_format.codec != primary->data_format.codec ||
+                    op->encoder->target_samplerate != primary->target_samplerate ||
+                    op->encoder->n_channels != primary->n_channels || op->encoder->bitrate >= primary->bitrate)
+            {
+            fprintf(stderr, "streamer_connect: encoder %ld is not a usable lower tier\n", id);
+            encoder_unregister_client(op);
+            continue;
+            }
+
+        /* keep the tiers in order of falling bit rate */
+        for (i = self->n_tiers; i > 1 && self->tier_op[i - 1]->encoder->bitrate < op->encoder->bitrate; i--)
+            self->tier_op[i] = self->tier_op[i - 1];
+        self->tier_op[i] = op;
+        self->n_tiers++;
+        fprintf(stderr, "streamer_connect: encoder %ld at %d is a fallback tier\n", id, op->encoder->bitrate);
+        }
+    }
+
+/* streamer_adapt: measure how well the server keeps up and in adaptive mode size the queue to suit
+ * libshout keeps the socket to itself so round trip time is not available, instead the
+ * time data spends in the queue and the rate at which it drains serve the same purpose
+ */
+static void streamer_adapt(struct streamer *self)
+    {
+    struct timespec now;
+    double dt, delay, drained, target;
+    ssize_t queuelen;
+
+    if (!self->byte_rate)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dt = (now.tv_sec - self->adapt_time.tv_sec) + (now.tv_nsec - self->adapt_time.tv_nsec) * 1e-9;
+    if (dt < adapt_interval)
+        return;
+
+    queuelen = shout_queuelen(self->shout);
+    drained = (double)(self->bytes_queued - (queuelen - self->last_queuelen));
+    self->throughput = self->throughput * 0.75 + drained / dt * 0.25;
+    self->offered = self->offered * 0.75 + self->bytes_queued / dt * 0.25;
+    self->bytes_queued = 0;
+    self->last_queuelen = queuelen;
+    self->adapt_time = now;
+
+    delay = (double)queuelen / self->byte_rate;
+    self->peak_delay *= peak_delay_decay;
+    if (delay > self->peak_delay)
+        self->peak_delay = delay;
+    self->effective_latency_ms = (int)(delay * 1000.0);
+
+    streamer_tier_check(self, queuelen);
+    if (!self->adaptive)
+        return;
+
+    /* allow twice the worst recent stall plus some slack, all of it when the server is falling behind
+     * what the encoder actually produced is the measure as variable bit rate streams run under the nominal rate
+     */
+    if (self->throughput < self->offered * 0.95)
+        target = self->latency_max;
+    else
+        target = self->peak_delay * 2.0 + 0.5;
+    if (target < self->latency_min)
+        target = self->latency_min;
+    if (target > self->latency_max)
+        target = self->latency_max;
+    self->max_shout_queue = (ssize_t)(target * self->byte_rate);
+    }
+
+/* streamer_service: advance the connection state machine by one step
+ * called whenever there may be something to do, from either threading model
+ */
+static void streamer_service(struct streamer *self)
+    {
+    struct encoder_op_packet *packet;
+    enum stream_mode before = self->stream_mode;
+
+    switch (self->stream_mode)
+        {
+        case SM_DISCONNECTED:
+            break;
+        case SM_CONNECTING:
+            /* the helper thread has the shout object until shout_open returns */
+            if (self->open_job)
+                {
+                struct timespec now;
+
+                if (__atomic_load_n(&self->open_job->state, __ATOMIC_ACQUIRE) == OPEN_DONE)
                     {
-                    case SHOUTERR_RETRY:
-                        break;
-                    case SHOUTERR_BUSY:
-                        self->shout_status = shout_get_connected(self->shout);
+                    self->shout_status = self->open_job->status;
+                    free(self->open_job);
+                    self->open_job = NULL;
+                    }
+                else
+                    {
+                    /* a disconnect need not wait out a slow name lookup or connect */
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (self->disconnect_request || now.tv_sec > self->connect_deadline)
+                        {
+                        if (!self->disconnect_request)
+                            fprintf(stderr, "streamer_main: timed out connecting to the server\n");
+                        streamer_open_abandon(self);
+                        self->stream_mode = SM_DISCONNECTING;
+                        }
+                    break;
+                    }
+                }
+            switch(self->shout_status)
+                {
+                case SHOUTERR_UNCONNECTED:
+                    if (self->disconnect_request || streamer_open_start(self) == FAILED)
+                        self->stream_mode = SM_DISCONNECTING;
+                    break;
+                case SHOUTERR_RETRY:
+                case SHOUTERR_BUSY:
+                    {
+                    struct timespec now;
 
-                        if (self->disconnect_request || ++connect_time > 120)
-                            self->stream_mode = SM_DISCONNECTING;
-                        break;
-                    case SHOUTERR_CONNECTED:
-                        /* lock the encoder, grab the serial number and issue encoder flush */
-                        /* this makes the encoder contemporaneous with the stream */
-                        self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
-                        fprintf(stderr, "streamer_main: connected to server - awaiting serial %d\n", self->initial_serial);
-                        self->brand_new_connection = TRUE;
-                        self->stream_mode = SM_CONNECTED;
-                        break;
-                    default:
-                        fprintf(stderr, "streamer_main: connection failed, shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
+                    self->shout_status = shout_get_connected(self->shout);
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (self->shout_status != SHOUTERR_CONNECTED && (self->disconnect_request || now.tv_sec > self->connect_deadline))
+                        {
+                        if (!self->disconnect_request)
+                            fprintf(stderr, "streamer_main: timed out connecting to the server\n");
                         self->stream_mode = SM_DISCONNECTING;
+                        }
                     }
-                break;
-            case SM_CONNECTED:
-                /* check the connection is still on */
+                    break;
+                case SHOUTERR_CONNECTED:
+                    /* lock the encoder, grab the serial number and issue encoder flush */
+                    /* this makes the encoder contemporaneous with the stream */
+                    /* Ogg and WebM streams can be joined using the cached headers */
+                    if ((self->initial_serial = encoder_client_attach(self->encoder_op)) >= 0)
+                        {
+                        self->attached = TRUE;
+                        fprintf(stderr, "streamer_main: connected to server - joined serial %d in progress\n", self->initial_serial);
+                        }
+                    else
+                        {
+                        self->attached = FALSE;
+                        self->initial_serial = encoder_client_set_flush(self->encoder_op) + 1;
+                        fprintf(stderr, "streamer_main: connected to server - awaiting serial %d\n", self->initial_serial);
+                        }
+                    self->brand_new_connection = TRUE;
+                    self->stream_mode = SM_CONNECTED;
+                    break;
+                default:
+                    fprintf(stderr, "streamer_main: connection failed, shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
+                    self->stream_mode = SM_DISCONNECTING;
+                }
+            break;
+        case SM_CONNECTED:
+            /* check the connection is still on */
 
-                if ((self->shout_status = shout_get_connected(self->shout)) != SHOUTERR_CONNECTED)
+            if ((self->shout_status = shout_get_connected(self->shout)) != SHOUTERR_CONNECTED)
+                {
+                if (self->shout_status == SHOUTERR_RETRY)
                     {
-                    if (self->shout_status == SHOUTERR_RETRY && try_count-- > 0) {
+                    struct timespec now;
+
+                    /* by the clock since the shared engine comes through here on every wakeup */
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (!self->retry_deadline)
+                        self->retry_deadline = now.tv_sec + retry_timeout_s;
+                    if (now.tv_sec <= self->retry_deadline)
+                        {
                         fprintf(stderr, "retry\n");
                         break;
+                        }
                     }
-                    fprintf(stderr, "streamer_main: shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
-                    self->stream_mode = SM_DISCONNECTING;
-                    }
-                if (self->disconnect_request && (!self->disconnect_pending))
-                    {
-                    self->disconnect_pending = TRUE;
-                    fprintf(stderr, "streamer_main: disconnect_pending is set\n");
-                    self->final_serial = encoder_client_set_flush(self->encoder_op);
-                    fprintf(stderr, "streamer_main: issued flush to mixer, disconnecting from server when final packet of serial=%d arrives\n", self->final_serial);
-                    }
-                if ((packet = encoder_client_get_packet(self->encoder_op)))
+                fprintf(stderr, "streamer_main: shout_get_error reports %ld %s\n", self->shout_status, shout_get_error(self->shout));
+                self->stream_mode = SM_DISCONNECTING;
+                }
+            else
+                self->retry_deadline = 0;
+            if (self->disconnect_request && !self->disconnect_pending && self->attached)
+                {
+                /* leave straight away rather than flushing the encoder for everyone */
+                fprintf(stderr, "streamer_main: disconnecting without a flush\n");
+                streamer_send_audio(self);
+                self->stream_mode = SM_DISCONNECTING;
+                break;
+                }
+            if (self->disconnect_request && (!self->disconnect_pending))
+                {
+                self->disconnect_pending = TRUE;
+                fprintf(stderr, "streamer_main: disconnect_pending is set\n");
+                self->final_serial = encoder_client_set_flush(self->encoder_op);
+                fprintf(stderr, "streamer_main: issued flush to mixer, disconnecting from server when final packet of serial=%d arrives\n", self->final_serial);
+                }
+            /* drain everything the encoder has produced since the last wakeup */
+            while (self->stream_mode == SM_CONNECTED && (packet = encoder_client_read_packet(self->encoder_op)))
+                {
+                if (packet->header.serial >= self->initial_serial)
                     {
-                    if (packet->header.serial >= self->initial_serial)
+                    if (packet->header.flags & PF_INITIAL)
+                        streamer_adapt_start(self, packet->header.bit_rate);
+                    if (self->tier_sync && (packet->header.flags & (PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2)) && packet->data)
                         {
-                        if (packet->header.flags & PF_INITIAL)
-                            {
-                            int br = packet->header.bit_rate;
+                        ssize_t offset = encoder_packet_boundary(packet);
 
-                            /* determine how much audio to hold in the send buffer */
-                            self->max_shout_queue = (shout_buffer_seconds * ((br > 1000) ? br / 1000 : br)) << 7;
-                            }
-                        if (packet->header.flags & (PF_WEBM | PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
-                            {
-                            if ((packet->header.flags & (PF_HEADER | PF_FINAL)) || shout_queuelen(self->shout) < self->max_shout_queue)
-                                data_size = packet->header.data_size;
-                            else
-                                {
-                                data_size = 0;
-                                fprintf(stderr, "streamer_main: **** packet dumped due to buffer being full ****\n");
-                                }
-#if 1
-                            switch(shout_send(self->shout, packet->data, data_size))
-                                {
-                                case SHOUTERR_SUCCESS:
-                                case SHOUTERR_BUSY:
-                                    break;
-                                default:
-                                    fprintf(stderr, "streamer_main: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                    self->stream_mode = SM_DISCONNECTING;
-                                }
-#else
-                            if (shout_send_raw(self->shout, packet->data, data_size) != data_size)
-                                {
-                                fprintf(stderr, "streamer_main: failed writing to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                self->stream_mode = SM_DISCONNECTING;
-                                }
-#endif
-                            }
-                        if (packet->header.flags & PF_FINAL)
-                            fprintf(stderr, "streamer_main: final packet with serial %d\n", packet->header.serial);
-                        if (self->disconnect_pending && (packet->header.serial > self->final_serial || ((packet->header.flags & PF_FINAL) && self->final_serial == packet->header.serial)))
+                        if (offset >= 0)
                             {
-                            fprintf(stderr, "streamer_main: last packet wrote, disconnecting\n");
-                            self->stream_mode = SM_DISCONNECTING;
+                            streamer_queue_audio(self, (char *)packet->data + offset, packet->header.data_size - offset, packet->header.capture_usecs);
+                            self->tier_sync = FALSE;
                             }
                         }
-                    if (packet->header.flags & PF_METADATA)  /* tell server about new metadata */
+                    else if (packet->header.flags & (PF_WEBM | PF_OGG | PF_MP3 | PF_MP2 | PF_AAC | PF_AACP2))
                         {
-                        *strpbrk(packet->data, "\n") = '\0';
-                        fprintf(stderr, "streamer_main: packet is metadata: %s\n", (char *)packet->data);
-                        shout_metadata_add(self->shout_meta, "song", packet->data);
-                        switch (shout_set_metadata(self->shout, self->shout_meta))
-                            {
-                            case SHOUTERR_SUCCESS:
-                            case SHOUTERR_BUSY:
-                                break;
-                            default:
-                                fprintf(stderr, "streamer_main: failed writing metadata to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
-                                self->stream_mode = SM_DISCONNECTING;
-                            }
+                        if ((packet->header.flags & (PF_HEADER | PF_FINAL)) || shout_queuelen(self->shout) + (ssize_t)self->send_fill < self->max_shout_queue)
+                            streamer_queue_audio(self, packet->data, packet->header.data_size, packet->header.capture_usecs);
+                        else
+                            fprintf(stderr, "streamer_main: **** packet dumped due to buffer being full ****\n");
+                        }
+                    if (packet->header.flags & PF_FINAL)
+                        fprintf(stderr, "streamer_main: final packet with serial %d\n", packet->header.serial);
+                    if (self->disconnect_pending && (packet->header.serial > self->final_serial || ((packet->header.flags & PF_FINAL) && self->final_serial == packet->header.serial)))
+                        {
+                        fprintf(stderr, "streamer_main: last packet wrote, disconnecting\n");
+                        streamer_send_audio(self);
+                        self->stream_mode = SM_DISCONNECTING;
                         }
-                    encoder_client_free_packet(packet);
                     }
-                break;
-            case SM_DISCONNECTING:
-                fprintf(stderr, "streamer_main: disconencting from server\n");
+                if (packet->header.flags & PF_METADATA)  /* tell server about new metadata */
+                    {
+                    /* audio that precedes the metadata change goes out first */
+                    streamer_send_audio(self);
+                    *strpbrk(packet->data, "\n") = '\0';
+                    fprintf(stderr, "streamer_main: packet is metadata: %s\n", (char *)packet->data);
+                    shout_metadata_add(self->shout_meta, "song", packet->data);
+                    switch (shout_set_metadata(self->shout, self->shout_meta))
+                        {
+                        case SHOUTERR_SUCCESS:
+                        case SHOUTERR_BUSY:
+                            break;
+                        default:
+                            fprintf(stderr, "streamer_main: failed writing metadata to stream, shout_get_error reports: %s\n", shout_get_error(self->shout));
+                            self->stream_mode = SM_DISCONNECTING;
+                        }
+                    }
+                }
+            /* the tiers not in use have nothing to catch up on if switched to */
+            for (int i = 0; i < self->n_tiers; i++)
+                if (self->tier_op[i] != self->encoder_op)
+                    encoder_client_catch_up(self->tier_op[i]);
+            if (self->stream_mode == SM_CONNECTED)
+                {
+                streamer_send_audio(self);
+                streamer_adapt(self);
+                }
+            else
+                self->send_fill = 0;
+            break;
+        case SM_DISCONNECTING:
+            fprintf(stderr, "streamer_main: disconencting from server\n");
+            if (self->shout)
+                {
                 shout_close(self->shout);
                 shout_free(self->shout);
-                shout_metadata_free(self->shout_meta);
-                encoder_unregister_client(self->encoder_op);
-                self->shout = NULL;
-                self->shout_meta = NULL;
-                self->encoder_op = NULL;
-                self->max_shout_queue = 0;
-                self->disconnect_request = FALSE;
-                self->disconnect_pending = FALSE;
-                self->stream_mode = SM_DISCONNECTED;
-                connect_time = 0;
-                fprintf(stderr, "streamer_main: disconnection complete\n");
+                }
+            shout_metadata_free(self->shout_meta);
+            streamer_release_encoders(self);
+            self->shout = NULL;
+            self->shout_meta = NULL;
+            self->tier_sync = FALSE;
+            self->congested_secs = self->clear_secs = 0;
+            self->max_shout_queue = 0;
+            self->byte_rate = 0;
+            self->effective_latency_ms = 0;
+            self->send_fill = 0;
+            self->disconnect_request = FALSE;
+            self->disconnect_pending = FALSE;
+            self->stream_mode = SM_DISCONNECTED;
+            self->retry_deadline = 0;
+            fprintf(stderr, "streamer_main: disconnection complete\n");
+            break;
+        }
+    /* the interface shows the connection state so it hears of changes straight away */
+    if (self->stream_mode != before && (self->stream_mode == SM_CONNECTED || self->stream_mode == SM_DISCONNECTED))
+        evloop_post(EVLOOP_STATUS);
+    }
+
+#ifndef USE_BSD_COMPAT
+/* streamer_engine_timeout: how long the engine may sleep with nothing signalled */
+static int streamer_engine_timeout()
+    {
+    struct threads_info *ti = engine.threads_info;
+    int timeout = -1;
+
+    for (int i = 0; i < ti->n_streamers; i++)
+        {
+        struct streamer *s = ti->streamer[i];
+
+        if (!s)
+            continue;
+        switch (s->stream_mode)
+            {
+            case SM_DISCONNECTED:
                 break;
+            case SM_CONNECTED:
+                /* check on the connection as often as the threaded streamers do */
+                if (shout_queuelen(s->shout) <= 0)
+                    {
+                    timeout = packet_wait_ms;
+                    break;
+                    }
+                /* libshout only moves its queue along when called so fall through */
+            default:
+                return 10;
+            }
+        }
+    return timeout;
+    }
+
+static void *streamer_engine_main(void *args)
+    {
+    struct threads_info *ti = engine.threads_info;
+    struct epoll_event events[16];
+    struct threadstat_sample usage;
+    uint64_t count;
+    int n;
+
+    sig_mask_thread();
+    threadstat_name("streamer", "engine");
+    while (!engine.terminate)
+        {
+        if ((n = epoll_wait(engine.epoll_fd, events, 16, streamer_engine_timeout())) < 0)
+            {
+            if (errno != EINTR)
+                perror("streamer_engine_main: epoll_wait");
+            n = 0;
+            }
+        for (int i = 0; i < n; i++)
+            if (read(events[i].data.fd, &count, sizeof count) < 0 && errno != EAGAIN)
+                perror("streamer_engine_main: read");
+
+        /* connections with nothing to do return right away */
+        for (int i = 0; i < ti->n_streamers; i++)
+            if (ti->streamer[i] && ti->streamer[i]->stream_mode != SM_DISCONNECTED)
+                {
+                threadstat_read(&usage);
+                streamer_service(ti->streamer[i]);
+                threadstat_add(&ti->streamer[i]->threadstat, &usage);
+                }
+        }
+    return NULL;
+    }
+
+static void streamer_engine_add(int fd)
+    {
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+    if (epoll_ctl(engine.epoll_fd, EPOLL_CTL_ADD, fd, &ev))
+        {
+        perror("streamer_engine_add: epoll_ctl");
+        exit(5);
+        }
+    }
+
+static void streamer_engine_start()
+    {
+    if ((engine.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (engine.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        {
+        perror("streamer_engine_start");
+        exit(5);
+        }
+    streamer_engine_add(engine.wake_fd);
+    if (pthread_create(&engine.thread_h, NULL, streamer_engine_main, NULL))
+        {
+        fprintf(stderr, "streamer_engine_start: failed to start thread\n");
+        exit(5);
+        }
+    engine.running = TRUE;
+    fprintf(stderr, "streamer_engine_start: one thread is serving all the streamers\n");
+    }
+
+static void streamer_engine_stop()
+    {
+    if (!engine.running)
+        return;
+    engine.terminate = TRUE;
+    streamer_engine_wake();
+    pthread_join(engine.thread_h, NULL);
+    close(engine.wake_fd);
+    close(engine.epoll_fd);
+    engine.running = FALSE;
+    }
+#endif /* USE_BSD_COMPAT */
+
+static void *streamer_main(void *args)
+    {
+    struct streamer *self = args;
+    struct timespec ms10 = { 0, 10000000 };
+    char id[12];
+
+    sig_mask_thread();
+    snprintf(id, sizeof id, "%d", self->numeric_id);
+    threadstat_name("streamer", id);
+    while (!self->thread_terminate_f)
+        {
+        threadstat_sample(&self->threadstat);
+        /* when connected sleep until the encoder has something for us */
+        if (self->stream_mode == SM_CONNECTED)
+            encoder_client_wait_packet(self->encoder_op, packet_wait_ms);
+        else
+            nanosleep(&ms10, NULL);
+
+        if (self->stream_mode == SM_DISCONNECTED)
+            {
+            pthread_mutex_lock(&self->mode_mutex);
+            while (self->stream_mode == SM_DISCONNECTED && !self->thread_terminate_f)
+                pthread_cond_wait(&self->mode_cv, &self->mode_mutex);
+            pthread_mutex_unlock(&self->mode_mutex);
+            continue;
             }
+        streamer_service(self);
         }
     return NULL;
     }
@@ -192,16 +804,61 @@ int streamer_make_report(struct streamer *self)
     int buffer_fill_pc = 0;
     int new_connection = self->brand_new_connection; /* for thread safety */
     int max_shout_queue = self->max_shout_queue;
+    int byte_rate = self->byte_rate;
+    int tier = self->tier;
+    int target_ms = 0;
+    char thread_stats[64];
+    char latency[32];
 
     if (self->stream_mode == SM_CONNECTED && max_shout_queue)
         buffer_fill_pc = (int)(shout_queuelen(self->shout) * 100 / max_shout_queue);
-    fprintf(g.out, "idjcsc: streamer%dreport=%d:%d:%d\n", self->numeric_id, (int)self->stream_mode, buffer_fill_pc, new_connection);
+    if (byte_rate)
+        target_ms = (int)((int64_t)max_shout_queue * 1000 / byte_rate);
+    threadstat_format(&self->threadstat, &self->threadstat_reported, thread_stats, sizeof thread_stats);
+    streamer_latency_format(self, latency, sizeof latency);
+    fprintf(g.out, "idjcsc: streamer%dreport=%d:%d:%d:%d:%d:%d:%s:%s\n", self->numeric_id, (int)self->stream_mode,
+                buffer_fill_pc, new_connection, self->effective_latency_ms, target_ms, tier, thread_stats, latency);
     if (new_connection)
         self->brand_new_connection = FALSE;
     fflush(g.out);
     return SUCCEEDED;
     }
 
+static int shout_up;
+
+void shout_initialiser()
+    {
+    int major, minor, patch;
+
+    shout_init();
+    shout_version(&major, &minor, &patch);
+    fprintf(stderr, "libshout-idjc version %d.%d.%d\n", major, minor, patch);
+    shout_up = TRUE;
+    }
+
+static void shout_finaliser()
+    {
+    if (shout_up)
+        shout_shutdown();
+    }
+
+/* streamer_first_use: libshout and the streamer's thread are left until they're needed */
+static void streamer_first_use(struct streamer *self)
+    {
+    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+
+    pthread_once(&once_control, shout_initialiser);
+    if (self->notify_fd < 0 && !self->thread_started)
+        {
+        if (pthread_create(&self->thread_h, NULL, streamer_main, self))
+            {
+            fprintf(stderr, "streamer_first_use: failed to start thread\n");
+            exit(5);
+            }
+        self->thread_started = TRUE;
+        }
+    }
+
 int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *other)
     {
     struct streamer_vars *sv = other;
@@ -210,18 +867,23 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
     char channels[2];
     char bitrate[6];
     char samplerate[6];
-    int try_count = 10;
 
     void sce(char *parameter)    /* stream connect error */
         {
         fprintf(stderr, "streamer_connect: failed to set parameter %s\n", parameter);
         }
 
+    streamer_first_use(self);
     if (!(self->encoder_op = encoder_register_client(ti, atoi(sv->stream_source))))
         {
         fprintf(stderr, "streamer_start: failed to register with encoder\n");
         return FAILED;
         }
+    self->tier_op[0] = self->encoder_op;
+    self->n_tiers = 1;
+    self->tier = 0;
+    if (self->notify_fd >= 0)
+        encoder_client_set_notify(self->encoder_op, self->notify_fd);
     if (!self->encoder_op->encoder->run_request_f)
         {
         fprintf(stderr, "streamer_start: encoder is not running\n");
@@ -387,6 +1049,16 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
         sce("make public");
         goto error;
         }
+
+    self->adaptive = sv->buffer_mode && !strcmp(sv->buffer_mode, "adaptive");
+    self->latency_min = sv->latency_min ? atof(sv->latency_min) : 0.0;
+    self->latency_max = sv->latency_max ? atof(sv->latency_max) : 0.0;
+    if (self->latency_min < 0.5)
+        self->latency_min = 0.5;
+    if (self->latency_max < self->latency_min)
+        self->latency_max = (self->latency_min > shout_buffer_seconds) ? self->latency_min : shout_buffer_seconds;
+    if (self->adaptive)
+        fprintf(stderr, "streamer_connect: adaptive send queue of %0.1f to %0.1f seconds\n", self->latency_min, self->latency_max);
     #if SHOUT_TLS
     if (!strcmp("Disabled", sv->tls))
         tls = SHOUT_TLS_DISABLED;
@@ -448,36 +1120,34 @@ int streamer_connect(struct threads_info *ti, struct universal_vars *uv, void *o
         goto error;
         }
 
+    streamer_add_tiers(self, ti, sv->tier_sources);
+
     if (shout_set_nonblocking(self->shout, 1) != SHOUTERR_SUCCESS)
         {
         sce("non-blocking");
         goto error;
         }
-    retry:
-    fprintf(stderr, "calling shout_open: remaining tries=%d\n", try_count--);
-    switch(self->shout_status = shout_open(self->shout))
-        {
-        case SHOUTERR_RETRY:
-            while (try_count > 0) {
-                goto retry;
-            }
-            break;
-        case SHOUTERR_SUCCESS:
-            self->shout_status = SHOUTERR_CONNECTED;
-        case SHOUTERR_BUSY:
-        case SHOUTERR_CONNECTED:
-            pthread_mutex_lock(&self->mode_mutex);
-            self->stream_mode = SM_CONNECTING;
-            pthread_cond_signal(&self->mode_cv);
-            pthread_mutex_unlock(&self->mode_mutex);
-            fprintf(stderr, "streamer_connect: established connection to the server\n");
-            return SUCCEEDED;
-        }
+    {
+        struct timespec now;
+
+        /* the streaming side opens the connection so a slow or dead server holds up nothing else */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        self->connect_deadline = now.tv_sec + connect_timeout_s;
+        self->shout_status = SHOUTERR_UNCONNECTED;
+    }
+    pthread_mutex_lock(&self->mode_mutex);
+    self->stream_mode = SM_CONNECTING;
+    pthread_cond_signal(&self->mode_cv);
+    pthread_mutex_unlock(&self->mode_mutex);
+    streamer_engine_wake();
+    fprintf(stderr, "streamer_connect: connection to the server is under way\n");
+    return SUCCEEDED;
+
     error:
     fprintf(stderr, "streamer_connect: shout_get_error reports: %s\n", shout_get_error(self->shout));
     shout_free(self->shout);
     shout_metadata_free(self->shout_meta);
-    encoder_unregister_client(self->encoder_op);
+    streamer_release_encoders(self);
     return FAILED;
     }
 
@@ -492,6 +1162,7 @@ int streamer_disconnect(struct threads_info *ti, struct universal_vars *uv, void
         return FAILED;
         }
     self->disconnect_request = TRUE;
+    streamer_engine_wake();
     fprintf(stderr, "streamer_disconnect: disconnection_request is set\n");
     while(self->stream_mode != SM_DISCONNECTED)
         nanosleep(&ms10, NULL);
@@ -499,21 +1170,14 @@ int streamer_disconnect(struct threads_info *ti, struct universal_vars *uv, void
     return SUCCEEDED;
     }
 
-void shout_initialiser()
-    {
-    int major, minor, patch;
-
-    shout_init();
-    shout_version(&major, &minor, &patch);
-    fprintf(stderr, "libshout-idjc version %d.%d.%d\n", major, minor, patch);
-    }
-
 struct streamer *streamer_init(struct threads_info *ti, int numeric_id)
     {
     struct streamer *self;
-    static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+#ifndef USE_BSD_COMPAT
+    static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+    char *engine_env;
+#endif
 
-    pthread_once(&once_control, shout_initialiser);
     if (!(self = calloc(1, sizeof (struct streamer))))
         {
         fprintf(stderr, "streamer_init: malloc failure\n");
@@ -521,24 +1185,58 @@ struct streamer *streamer_init(struct threads_info *ti, int numeric_id)
         }
     self->threads_info = ti;
     self->numeric_id = numeric_id;
+    self->notify_fd = -1;
     pthread_mutex_init(&self->mode_mutex, NULL);
     pthread_cond_init(&self->mode_cv, NULL);
-    pthread_create(&self->thread_h, NULL, streamer_main, self);
+#ifndef USE_BSD_COMPAT
+    if ((engine_env = getenv("streamer_engine")) && !strcmp(engine_env, "shared"))
+        {
+        engine.threads_info = ti;
+        pthread_once(&engine_once, streamer_engine_start);
+        if ((self->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            {
+            perror("streamer_init: eventfd");
+            exit(5);
+            }
+        streamer_engine_add(self->notify_fd);
+        }
+#endif
     return self;
     }
 
 void streamer_destroy(struct streamer *self)
     {
     static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+    struct timespec ms10 = { 0, 10000000 };
     void *thread_ret;
 
-    pthread_once(&once_control, shout_shutdown);
-    pthread_mutex_lock(&self->mode_mutex);
-    self->thread_terminate_f = TRUE;
-    pthread_cond_signal(&self->mode_cv);
-    pthread_mutex_unlock(&self->mode_mutex);
-    pthread_join(self->thread_h, &thread_ret);
+#ifndef USE_BSD_COMPAT
+    static pthread_once_t engine_once = PTHREAD_ONCE_INIT;
+
+    if (self->notify_fd >= 0)
+        {
+        pthread_once(&engine_once, streamer_engine_stop);
+        close(self->notify_fd);
+        }
+    else
+#endif
+    if (self->thread_started)
+        {
+        pthread_mutex_lock(&self->mode_mutex);
+        self->thread_terminate_f = TRUE;
+        pthread_cond_signal(&self->mode_cv);
+        pthread_mutex_unlock(&self->mode_mutex);
+        pthread_join(self->thread_h, &thread_ret);
+        }
+    if (self->open_job)
+        streamer_open_abandon(self);
+    /* libshout has to outlive every shout_open still in progress */
+    while (__atomic_load_n(&open_helpers, __ATOMIC_ACQUIRE))
+        nanosleep(&ms10, NULL);
+    pthread_once(&once_control, shout_finaliser);
     pthread_cond_destroy(&self->mode_cv);
     pthread_mutex_destroy(&self->mode_mutex);
+    if (self->send_buffer)
+        free(self->send_buffer);
     free(self);
     }
@@ -20,7 +20,10 @@
 #ifndef STREAMER_H
 #define STREAMER_H
 
+#include <time.h>
+#include <stdint.h>
 #include "sourceclient.h"
+#include "threadstat.h"
 
 struct streamer_vars
     {
@@ -44,11 +47,22 @@ struct streamer_vars
     char *ca_file;
     char *client_cert;
     char *make_public;
+    char *buffer_mode;           /* "fixed" or "adaptive" send queue sizing */
+    char *latency_min;           /* bounds on the adaptive queue in seconds */
+    char *latency_max;
+    char *tier_sources;          /* comma separated encoders of the same mix to fall back on */
     };
 
+/* mixer to libshout latencies kept for the percentiles in each report */
+#define STREAMER_LATENCY_SAMPLES 512
+
+/* the most encoders a stream can switch between as the connection allows */
+#define STREAMER_MAX_TIERS 4
+
 enum stream_mode { SM_DISCONNECTED, SM_CONNECTING, SM_CONNECTED, SM_DISCONNECTING };
 
-struct shout; 
+struct shout;
+struct streamer_open; 
 struct _util_dict;
 
 struct streamer
@@ -56,7 +70,10 @@ struct streamer
     struct threads_info *threads_info;
     int numeric_id;
     pthread_t thread_h;
+    int thread_started;          /* the thread is made on the first connect */
     int thread_terminate_f;
+    struct threadstat threadstat;        /* of the streamer thread or its share of the engine */
+    struct threadstat_report threadstat_reported;
     int disconnect_request;
     int disconnect_pending;
     struct encoder_op *encoder_op;
@@ -66,10 +83,39 @@ struct streamer
     int brand_new_connection;    /* used for triggering actions in the gui */
     long shout_status;
     int initial_serial;  /* the enocoder serial number we commence streaming from */
+    int attached;        /* joined the encoder mid-stream so needn't flush it to leave */
     int final_serial;    /* the serial number to cease streaming at the end of */
     ssize_t max_shout_queue;     /* how much audio data we are willing to stockpile */
+    char *send_buffer;           /* audio from several packets coalesced for one shout_send */
+    size_t send_buffer_size;
+    size_t send_fill;
+    uint64_t send_capture_usecs; /* when the oldest audio in send_buffer entered the mixer, for the latency probe */
+    uint32_t latency_us[STREAMER_LATENCY_SAMPLES]; /* the most recent sends since the last report */
+    unsigned int n_latency;
+    int latency_reset_due;       /* the reporter asks the streamer to start a new window */
     pthread_mutex_t mode_mutex;
     pthread_cond_t mode_cv;
+    time_t connect_deadline;     /* when to give up on a connection attempt */
+    time_t retry_deadline;       /* when a connection that keeps saying to retry is given up on, 0 if it isn't */
+    struct streamer_open *open_job; /* shout_open in progress on a helper thread, else NULL */
+    int notify_fd;               /* eventfd the encoder signals when run by the shared engine, else -1 */
+    int adaptive;                /* max_shout_queue follows the measured connection quality */
+    double latency_min;          /* adaptive queue bounds in seconds */
+    double latency_max;
+    ssize_t byte_rate;           /* nominal stream rate in bytes per second */
+    ssize_t bytes_queued;        /* handed to libshout since the last adaptation */
+    ssize_t last_queuelen;
+    double throughput;           /* smoothed rate at which the server takes our data */
+    double offered;              /* smoothed rate at which the encoder gives it, below byte_rate for vbr */
+    double peak_delay;           /* decaying peak of the time data spends queued */
+    struct timespec adapt_time;
+    int effective_latency_ms;    /* for the report, the queue delay just measured */
+    struct encoder_op *tier_op[STREAMER_MAX_TIERS]; /* same mix at falling bit rates, first is the main one */
+    int n_tiers;
+    int tier;                    /* the tier encoder_op currently points to */
+    int tier_sync;               /* skipping audio up to a frame boundary after a switch */
+    int congested_secs;          /* how long the queue has been near full */
+    int clear_secs;              /* or near empty */
     };
 
 struct streamer *streamer_init(struct threads_info *ti, int numeric_id);
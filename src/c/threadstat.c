@@ -0,0 +1,116 @@
+/*
+#   threadstat.c: cpu and scheduling figures of the worker threads
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gnusource.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "threadstat.h"
+
+#define SAMPLE_NS 100000000
+
+void threadstat_name(const char *kind, const char *id)
+    {
+#ifndef USE_BSD_COMPAT
+    char name[16];              /* the kernel's limit */
+
+    snprintf(name, sizeof name, "%s %s", kind, id);
+    pthread_setname_np(pthread_self(), name);
+#endif
+    }
+
+void threadstat_read(struct threadstat_sample *from)
+    {
+#ifdef RUSAGE_THREAD
+    struct rusage ru;
+
+    if (!getrusage(RUSAGE_THREAD, &ru))
+        {
+        from->cpu_ns = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL
+                        + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+        from->nvcsw = ru.ru_nvcsw;
+        from->nivcsw = ru.ru_nivcsw;
+        from->wakeups = 0;
+        return;
+        }
+#endif
+    struct timespec t;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    from->cpu_ns = t.tv_sec * 1000000000ULL + t.tv_nsec;
+    from->nvcsw = from->nivcsw = from->wakeups = 0;
+    }
+
+void threadstat_sample(struct threadstat *self)
+    {
+    struct threadstat_sample s;
+    struct timespec t;
+
+    __atomic_store_n(&self->now.wakeups, self->now.wakeups + 1, __ATOMIC_RELAXED);
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+    if ((t.tv_sec - self->sample_time.tv_sec) * 1000000000LL + t.tv_nsec - self->sample_time.tv_nsec < SAMPLE_NS)
+        return;
+    self->sample_time = t;
+
+    threadstat_read(&s);
+    __atomic_store_n(&self->now.cpu_ns, s.cpu_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->now.nvcsw, s.nvcsw, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->now.nivcsw, s.nivcsw, __ATOMIC_RELAXED);
+    }
+
+void threadstat_add(struct threadstat *self, const struct threadstat_sample *from)
+    {
+    struct threadstat_sample s;
+
+    threadstat_read(&s);
+    __atomic_add_fetch(&self->now.cpu_ns, s.cpu_ns - from->cpu_ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&self->now.nvcsw, s.nvcsw - from->nvcsw, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&self->now.nivcsw, s.nivcsw - from->nivcsw, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&self->now.wakeups, 1, __ATOMIC_RELAXED);
+    }
+
+void threadstat_format(struct threadstat *self, struct threadstat_report *rep, char *buf, size_t size)
+    {
+    struct threadstat_sample now, *prev = &rep->reported;
+    struct timespec t;
+    double interval;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    now.cpu_ns = __atomic_load_n(&self->now.cpu_ns, __ATOMIC_RELAXED);
+    now.nvcsw = __atomic_load_n(&self->now.nvcsw, __ATOMIC_RELAXED);
+    now.nivcsw = __atomic_load_n(&self->now.nivcsw, __ATOMIC_RELAXED);
+    now.wakeups = __atomic_load_n(&self->now.wakeups, __ATOMIC_RELAXED);
+
+    /* figures that have gone backwards are of a thread that has been replaced */
+    if (now.cpu_ns < prev->cpu_ns || now.wakeups < prev->wakeups)
+        memset(prev, 0, sizeof *prev);
+
+    interval = (t.tv_sec - rep->report_time.tv_sec) + (t.tv_nsec - rep->report_time.tv_nsec) / 1e9;
+    if (rep->report_time.tv_sec && interval > 0.0)
+        snprintf(buf, size, "%.1f:%.1f:%.1f:%.1f", (now.cpu_ns - prev->cpu_ns) / (interval * 1e7),
+                    (now.nvcsw - prev->nvcsw) / interval, (now.nivcsw - prev->nivcsw) / interval,
+                    (now.wakeups - prev->wakeups) / interval);
+    else
+        snprintf(buf, size, "0.0:0.0:0.0:0.0");
+
+    *prev = now;
+    rep->report_time = t;
+    }
@@ -0,0 +1,66 @@
+/*
+#   threadstat.h: cpu and scheduling figures of the worker threads
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADSTAT_H
+#define THREADSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+struct threadstat_sample
+    {
+    uint64_t cpu_ns;
+    uint64_t nvcsw;                     /* voluntary context switches, waits and sleeps */
+    uint64_t nivcsw;                    /* involuntary ones, preemption */
+    uint64_t wakeups;                   /* passes through the thread's loop or jobs run */
+    };
+
+/* written by the thread measured */
+struct threadstat
+    {
+    struct threadstat_sample now;
+    struct timespec sample_time;
+    };
+
+/* kept by whoever reports on it */
+struct threadstat_report
+    {
+    struct threadstat_sample reported;
+    struct timespec report_time;
+    };
+
+/* threadstat_name: name the calling thread kind and id for top -H and the debuggers */
+void threadstat_name(const char *kind, const char *id);
+
+/* threadstat_sample: for a thread of its own, call once per pass through its loop
+ * the totals are refreshed at most every 100ms so this is cheap enough for a busy loop
+ */
+void threadstat_sample(struct threadstat *self);
+
+/* threadstat_read and threadstat_add: for work done on a shared thread
+ * the usage of the calling thread between the two calls is charged to self
+ */
+void threadstat_read(struct threadstat_sample *from);
+void threadstat_add(struct threadstat *self, const struct threadstat_sample *from);
+
+/* threadstat_format: cpu%:voluntary/s:involuntary/s:wakeups/s since the last call */
+void threadstat_format(struct threadstat *self, struct threadstat_report *rep, char *buf, size_t size);
+
+#endif /* THREADSTAT_H */
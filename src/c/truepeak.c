@@ -0,0 +1,250 @@
+/*
+#   truepeak.c: lookahead true peak limiter
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "truepeak.h"
+
+typedef jack_default_audio_sample_t sample_t;
+
+/* 4x oversampling by a 12 tap per phase windowed sinc, as BS.1770 suggests */
+#define PHASES 4
+#define TAPS 12
+/* the oversampled points lie between this many samples ago and the next */
+#define FIR_DELAY (TAPS / 2)
+/* audio is taken a chunk at a time so the taps are applied across a whole chunk */
+#define CHUNK 256
+
+struct truepeak_limiter
+    {
+    int sample_rate;
+    float coef[PHASES - 1][TAPS];   /* phase zero is the sample itself */
+    sample_t tail_l[TAPS - 1];      /* the input preceding the current chunk */
+    sample_t tail_r[TAPS - 1];
+    int lookahead;                  /* in samples, zero when bypassed */
+    volatile int new_lookahead;
+    float ceiling;
+    volatile float new_ceiling;
+    float release;                  /* one pole coefficient */
+    float smooth;                   /* the gain wanted now with release applied */
+    unsigned size, mask;            /* of the rings below, a power of two */
+    sample_t *delay_l;              /* the audio while the gain catches up */
+    sample_t *delay_r;
+    unsigned w;                     /* count of samples taken */
+    unsigned *min_index;            /* monotonic queue for the sliding minimum */
+    float *min_value;
+    unsigned min_head, min_tail;
+    float *box;                     /* the held minimum, averaged over the lookahead */
+    double box_sum;
+    };
+
+static float window_sinc(float u)
+    {
+    const float half_width = FIR_DELAY + 0.5f;
+    float w;
+
+    if (fabsf(u) >= half_width)
+        return 0.0f;
+    w = 0.42f + 0.5f * cosf(M_PI * u / half_width) + 0.08f * cosf(2.0f * M_PI * u / half_width);
+    return (u == 0.0f) ? w : w * sinf(M_PI * u) / (M_PI * u);
+    }
+
+struct truepeak_limiter *truepeak_limiter_new(int sample_rate, float ceiling_db, float release_ms)
+    {
+    struct truepeak_limiter *self;
+    unsigned span;
+    float sum;
+
+    if (!(self = calloc(1, sizeof (struct truepeak_limiter))))
+        {
+        fprintf(stderr, "truepeak_limiter_new: malloc failure\n");
+        return NULL;
+        }
+    self->sample_rate = sample_rate;
+
+    /* the most delay needed, rounded up to the ring size */
+    span = (unsigned)ceilf(sample_rate * TRUEPEAK_MAX_LOOKAHEAD_MS / 1000.0f) + FIR_DELAY + 1;
+    for (self->size = 1; self->size < span; self->size <<= 1);
+    self->mask = self->size - 1;
+    if (!(self->delay_l = calloc(self->size, sizeof (sample_t))) ||
+                !(self->delay_r = calloc(self->size, sizeof (sample_t))) ||
+                !(self->min_index = calloc(self->size, sizeof (unsigned))) ||
+                !(self->min_value = calloc(self->size, sizeof (float))) ||
+                !(self->box = calloc(self->size, sizeof (float))))
+        {
+        fprintf(stderr, "truepeak_limiter_new: malloc failure\n");
+        truepeak_limiter_destroy(self);
+        return NULL;
+        }
+
+    /* tap j multiplies the sample j places before the newest in the span of the taps */
+    for (int p = 1; p < PHASES; ++p)
+        {
+        sum = 0.0f;
+        for (int j = 0; j < TAPS; ++j)
+            sum += self->coef[p - 1][j] = window_sinc(TAPS - 1 - j - FIR_DELAY + (float)p / PHASES);
+        /* unity gain at DC */
+        for (int j = 0; j < TAPS; ++j)
+            self->coef[p - 1][j] /= sum;
+        }
+
+    self->release = 1.0f - expf(-1000.0f / (release_ms * sample_rate));
+    self->smooth = 1.0f;
+    self->ceiling = self->new_ceiling = powf(10.0f, ceiling_db / 20.0f);
+    return self;
+    }
+
+void truepeak_limiter_destroy(struct truepeak_limiter *self)
+    {
+    if (self)
+        {
+        free(self->delay_l);
+        free(self->delay_r);
+        free(self->min_index);
+        free(self->min_value);
+        free(self->box);
+        free(self);
+        }
+    }
+
+void truepeak_limiter_configure(struct truepeak_limiter *self, float lookahead_ms, float ceiling_db)
+    {
+    if (lookahead_ms > TRUEPEAK_MAX_LOOKAHEAD_MS)
+        lookahead_ms = TRUEPEAK_MAX_LOOKAHEAD_MS;
+    if (lookahead_ms > 0.0f && lookahead_ms < 1.0f)
+        lookahead_ms = 1.0f;
+    self->new_ceiling = powf(10.0f, ceiling_db / 20.0f);
+    self->new_lookahead = (lookahead_ms > 0.0f) ? (int)(self->sample_rate * lookahead_ms / 1000.0f) : 0;
+    }
+
+int truepeak_limiter_latency(struct truepeak_limiter *self)
+    {
+    return self->lookahead ? self->lookahead - 1 + FIR_DELAY : 0;
+    }
+
+/* start over with a new lookahead with the gain at unity */
+static void truepeak_limiter_reset(struct truepeak_limiter *self, int lookahead)
+    {
+    self->lookahead = lookahead;
+    memset(self->delay_l, 0, self->size * sizeof (sample_t));
+    memset(self->delay_r, 0, self->size * sizeof (sample_t));
+    memset(self->tail_l, 0, sizeof self->tail_l);
+    memset(self->tail_r, 0, sizeof self->tail_r);
+    for (unsigned i = 0; i < self->size; ++i)
+        self->box[i] = 1.0f;
+    self->box_sum = lookahead;
+    self->min_head = self->min_tail = 0;
+    self->smooth = 1.0f;
+    self->w = 0;
+    }
+
+/* the peak of each sample and the three points oversampled ahead of it, for both channels */
+static void truepeak_limiter_detect(struct truepeak_limiter *self, const sample_t *left,
+                                            const sample_t *right, int n, float *restrict peak)
+    {
+    sample_t ext_l[TAPS - 1 + CHUNK], ext_r[TAPS - 1 + CHUNK];
+    const sample_t *restrict xl = ext_l, *restrict xr = ext_r;
+    float yl, yr, a;
+
+    memcpy(ext_l, self->tail_l, sizeof self->tail_l);
+    memcpy(ext_r, self->tail_r, sizeof self->tail_r);
+    memcpy(ext_l + TAPS - 1, left, n * sizeof (sample_t));
+    memcpy(ext_r + TAPS - 1, right, n * sizeof (sample_t));
+    memcpy(self->tail_l, ext_l + n, sizeof self->tail_l);
+    memcpy(self->tail_r, ext_r + n, sizeof self->tail_r);
+
+    /* phase zero is the sample FIR_DELAY ago */
+    for (int i = 0; i < n; ++i)
+        {
+        yl = fabsf(xl[i + TAPS - 1 - FIR_DELAY]);
+        yr = fabsf(xr[i + TAPS - 1 - FIR_DELAY]);
+        peak[i] = (yl > yr) ? yl : yr;
+        }
+    for (int p = 0; p < PHASES - 1; ++p)
+        {
+        const float *restrict c = self->coef[p];
+
+        for (int i = 0; i < n; ++i)
+            {
+            yl = yr = 0.0f;
+            for (int j = 0; j < TAPS; ++j)
+                {
+                yl += c[j] * xl[i + j];
+                yr += c[j] * xr[i + j];
+                }
+            yl = fabsf(yl);
+            yr = fabsf(yr);
+            a = (yl > yr) ? yl : yr;
+            peak[i] = (peak[i] > a) ? peak[i] : a;
+            }
+        }
+    }
+
+void truepeak_limiter_process(struct truepeak_limiter *self, sample_t *left, sample_t *right, jack_nframes_t nframes)
+    {
+    float peak[CHUNK], wanted, held;
+    unsigned d, w, lookahead;
+    int n;
+
+    if (self->new_lookahead != self->lookahead)
+        truepeak_limiter_reset(self, self->new_lookahead);
+    self->ceiling = self->new_ceiling;
+    if (!(lookahead = self->lookahead))
+        return;
+    d = lookahead - 1 + FIR_DELAY;
+
+    for (; nframes; nframes -= n, left += n, right += n)
+        {
+        n = (nframes > CHUNK) ? CHUNK : nframes;
+        truepeak_limiter_detect(self, left, right, n, peak);
+
+        for (int i = 0; i < n; ++i)
+            {
+            w = self->w++;
+
+            /* instant attack, release towards unity */
+            wanted = (peak[i] > self->ceiling) ? self->ceiling / peak[i] : 1.0f;
+            self->smooth += (1.0f - self->smooth) * self->release;
+            if (self->smooth > wanted)
+                self->smooth = wanted;
+
+            /* the lowest gain of the lookahead window */
+            while (self->min_tail != self->min_head && self->min_value[(self->min_tail - 1) & self->mask] >= self->smooth)
+                --self->min_tail;
+            self->min_index[self->min_tail & self->mask] = w;
+            self->min_value[self->min_tail++ & self->mask] = self->smooth;
+            if (w - self->min_index[self->min_head & self->mask] >= lookahead)
+                ++self->min_head;
+            held = self->min_value[self->min_head & self->mask];
+
+            /* averaging the held minimum over the same window ramps the gain down
+             * ahead of the peak and never lets it exceed what the peak needs
+             */
+            self->box_sum += held - self->box[w % lookahead];
+            self->box[w % lookahead] = held;
+
+            self->delay_l[w & self->mask] = left[i];
+            self->delay_r[w & self->mask] = right[i];
+            left[i] = self->delay_l[(w - d) & self->mask] * (float)(self->box_sum / lookahead);
+            right[i] = self->delay_r[(w - d) & self->mask] * (float)(self->box_sum / lookahead);
+            }
+        }
+    }
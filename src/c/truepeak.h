@@ -0,0 +1,48 @@
+/*
+#   truepeak.h: lookahead true peak limiter
+#   Copyright (C) 2026 Stephen Fairchild (s-fairchild@users.sourceforge.net)
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program in the file entitled COPYING.
+#   If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRUEPEAK_H
+#define TRUEPEAK_H
+
+#include <jack/jack.h>
+
+/* the longest lookahead that can be set without reallocating */
+#define TRUEPEAK_MAX_LOOKAHEAD_MS 5.0f
+
+struct truepeak_limiter;
+
+/* truepeak_limiter_new: a stereo brickwall limiter, NULL on failure
+ * inter-sample peaks are found by 4x oversampling so the output stays under
+ * ceiling_db after reconstruction and the audio is delayed by a little more than the lookahead
+ */
+struct truepeak_limiter *truepeak_limiter_new(int sample_rate, float ceiling_db, float release_ms);
+void truepeak_limiter_destroy(struct truepeak_limiter *self);
+
+/* truepeak_limiter_configure: lookahead of 1 to 5 ms, or zero to pass the audio straight through
+ * called from outside the audio thread, the change happens at the next block
+ */
+void truepeak_limiter_configure(struct truepeak_limiter *self, float lookahead_ms, float ceiling_db);
+
+/* truepeak_limiter_process: limit in place, the output being latency samples behind */
+void truepeak_limiter_process(struct truepeak_limiter *self, jack_default_audio_sample_t *left,
+                                        jack_default_audio_sample_t *right, jack_nframes_t nframes);
+
+int truepeak_limiter_latency(struct truepeak_limiter *self);
+
+#endif /* TRUEPEAK_H */
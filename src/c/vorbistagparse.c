@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include "vorbistagparse.h"
 
@@ -455,6 +456,152 @@ vtag_cleanup(struct vtag *s)
     free(s);
     }
 
+int
+vtag_view_init(struct vtag_view *v, void const *data, size_t bytes)
+    {
+    char const *p = data;
+    uint32_t len, to_do;
+
+    v->end = p + bytes;
+    if (bytes < 8)
+        return VE_CROPPED;
+
+    v->vendor_length = READINT(p);
+    if (v->vendor_length > bytes - 8)
+        return VE_CROPPED;
+    v->vendor = p;
+    p += v->vendor_length;
+
+    v->n_comments = to_do = READINT(p);
+    v->comments = p;
+    /* after this the comments can be walked without further bounds checks */
+    while (to_do--)
+        {
+        if (v->end - p < 4)
+            return VE_CROPPED;
+        len = READINT(p);
+        if ((size_t)(v->end - p) < len)
+            return VE_CROPPED;
+        p += len;
+        }
+
+    return VE_OK;
+    }
+
+/* view_next: find the next usable comment matching key from *pos
+ * *remaining counts down the comments yet to be looked at
+ * return value: the value, not terminated, with its length in *value_length
+ */
+static char const *
+view_next(struct vtag_view *v, char const **pos, uint32_t *remaining,
+                        char const *key, size_t key_length, size_t *value_length)
+    {
+    char const *p = *pos, *comment, *value;
+    uint32_t len;
+
+    while (*remaining)
+        {
+        --*remaining;
+        len = READINT(p);
+        comment = p;
+        value = comment + key_length + 1;
+        p += len;
+        if (len > key_length + 1 && comment[key_length] == '=' &&
+                            !strncasecmp(comment, key, key_length) &&
+                            g_utf8_validate(value, p - value, NULL))
+            {
+            *pos = p;
+            *value_length = p - value;
+            return value;
+            }
+        }
+
+    *pos = p;
+    return NULL;
+    }
+
+int
+vtag_view_count(struct vtag_view *v, char const *key)
+    {
+    char const *pos = v->comments;
+    uint32_t remaining = v->n_comments;
+    size_t key_length = strlen(key), value_length;
+    int count = 0;
+
+    while (view_next(v, &pos, &remaining, key, key_length, &value_length))
+        ++count;
+
+    return count;
+    }
+
+char *
+vtag_view_lookup(struct vtag_view *v, char const *key, enum vtag_lookup_mode mode, char *sep)
+    {
+    char const *pos = v->comments, *value, *found = NULL, *start, *first_pos = NULL;
+    uint32_t remaining = v->n_comments, start_remaining, first_remaining = 0;
+    size_t key_length = strlen(key), value_length, found_length = 0, sep_length, length = 0;
+    int count = 0;
+    char *out, *o;
+
+    if (!sep)
+        sep = "";
+    sep_length = strlen(sep);
+
+    for (;;)
+        {
+        start = pos;
+        start_remaining = remaining;
+        if (!(value = view_next(v, &pos, &remaining, key, key_length, &value_length)))
+            break;
+        if (!found)
+            {
+            first_pos = start;
+            first_remaining = start_remaining;
+            }
+        if (!found || mode == VLM_LAST)
+            {
+            found = value;
+            found_length = value_length;
+            }
+        length += value_length;
+        ++count;
+        if (mode == VLM_FIRST)
+            break;
+        }
+
+    if (!found)
+        return NULL;
+
+    if (mode != VLM_MERGE || count == 1)
+        {
+        if (!(out = strndup(found, found_length)))
+            fprintf(stderr, "vtag_view_lookup: malloc failure\n");
+        return out;
+        }
+
+    if (!(o = out = malloc(length + (count - 1) * sep_length + 1)))
+        {
+        fprintf(stderr, "vtag_view_lookup: malloc failure\n");
+        return NULL;
+        }
+
+    /* the second pass starts from the first match */
+    pos = first_pos;
+    remaining = first_remaining;
+    while (count-- && (value = view_next(v, &pos, &remaining, key, key_length, &value_length)))
+        {
+        memcpy(o, value, value_length);
+        o += value_length;
+        if (count)
+            {
+            memcpy(o, sep, sep_length);
+            o += sep_length;
+            }
+        }
+    *o = '\0';
+    return out;
+    }
+
 char const *
 vtag_strerror(int error)
     {
@@ -17,6 +17,7 @@
 #   If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdint.h>
 #include <glib.h>
 
 struct vtag;
@@ -51,6 +52,33 @@ struct vtag *vtag_new(const char *vendor_string, int *error);
  */
 struct vtag *vtag_parse(void *data, size_t bytes, int *error);
 
+/* a read only view of a vorbis comment block that refers to the caller's data
+ * nothing is copied or allocated until vtag_view_lookup returns a value
+ * so the data must outlive the view
+ */
+struct vtag_view {
+    char const *vendor;
+    uint32_t vendor_length;
+    char const *comments;   /* the length field of the first comment */
+    char const *end;
+    uint32_t n_comments;
+};
+
+/* vtag_view_init: frame a vorbis comment block for lookups
+ * only the lengths are checked here, malformed comments and values
+ * that are not valid UTF-8 are passed over when looked up
+ * return value: VE_OK or VE_CROPPED
+ */
+int vtag_view_init(struct vtag_view *v, void const *data, size_t bytes);
+
+/* vtag_view_count: the number of usable comments with the given key */
+int vtag_view_count(struct vtag_view *v, char const *key);
+
+/* vtag_view_lookup: as vtag_lookup but reading from the raw block
+ * return value: a newly allocated value or NULL if there was none
+ */
+char *vtag_view_lookup(struct vtag_view *v, char const *key, enum vtag_lookup_mode mode, char *sep);
+
 /* vtag_comment_count:
  * return value: the number of comments attached to a given key, key
  */
@@ -26,6 +26,7 @@
 #include <math.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
 #include <samplerate.h>
 
 #include "ialloc.h"
@@ -36,6 +37,8 @@
 #include "flacdecode.h"
 #include "sndfiledecode.h"
 #include "avcodecdecode.h"
+#include "pcmcache.h"
+#include "peaks.h"
 #include "bsdcompat.h"
 #include "sig.h"
 #include "main.h"
@@ -43,11 +46,43 @@
 #define TRUE 1
 #define FALSE 0
 
-#define PBSPEED_INPUT_SAMPLE_SIZE 256
-#define PBSPEED_INPUT_BUFFER_SIZE (PBSPEED_INPUT_SAMPLE_SIZE * sizeof (float))
+/* the furthest the jack callback will stretch the buffered audio to follow a speed change */
+#define PBS_MAX_STEP 4.0
+
+/* initial size in samples of the decoder output buffers */
+#define OP_BUFFER_PREALLOC 16384
+
+/* the least audio in seconds a preloader holds so a slow open of the track after it is covered */
+#define PRELOAD_MIN_S 1.0
 
 typedef jack_default_audio_sample_t sample_t;
 
+/* the player pool
+ * rather than a thread each the players of a pool take turns on a few workers
+ * a turn is one pass of the player's loop, typically one decoded chunk,
+ * after which the player goes back on the ready queue unless it is stopped
+ * with no command to act on or parked until the jack callback drains its
+ * ringbuffer, the jack callback and new commands waking the workers
+ */
+#define POOL_WAIT_NS 20000000
+
+struct xlplayer_pool
+    {
+    char *name;
+    pthread_t *worker;
+    int n_workers;
+    int terminate;
+    struct xlplayer **player;           /* every player the pool runs */
+    int n_players;
+    int max_players;
+    struct xlplayer **queue;            /* FIFO of players ready for a turn */
+    int queue_head;
+    int queue_len;
+    pthread_mutex_t mutex;
+    pthread_cond_t turn_done_cv;        /* a player's turn has ended */
+    sem_t wake_sem;
+    };
+
 int mpg123ok = FALSE;
 
 void xlplayer_mpg123_status()
@@ -61,50 +96,117 @@ void xlplayer_mpg123_status()
     fflush(g.out);
     }
 
-/* make_audio_to_float: convert the audio to the format used by jack and libsamplerate */
-float *xlplayer_make_audio_to_float(struct xlplayer *self, float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels)
+/* xlplayer_add_dither: adds triangular dither of +/- half of lsb
+ * four interleaved xorshift generators keep the loop free of dependencies
+ */
+void xlplayer_add_dither(struct xlplayer *self, float *buffer, int num_samples, float lsb)
+    {
+    uint32_t *state = self->dither_state;
+    const float dscale = 0.25F / 2147483648.0F * lsb;
+    uint32_t a, b;
+    int i = 0;
+
+    for (; i + 4 <= num_samples; i += 4)
+        for (int j = 0; j < 4; ++j)
+            {
+            a = state[j];
+            a ^= a << 13;
+            a ^= a >> 17;
+            a ^= a << 5;
+            b = a ^ (a << 13);
+            b ^= b >> 17;
+            b ^= b << 5;
+            state[j] = b;
+            buffer[i + j] += ((float)(int32_t)a + (float)(int32_t)b) * dscale;
+            }
+
+    for (; i < num_samples; ++i)
+        {
+        a = state[0];
+        a ^= a << 13;
+        a ^= a >> 17;
+        a ^= a << 5;
+        b = a ^ (a << 13);
+        b ^= b >> 17;
+        b ^= b << 5;
+        state[0] = b;
+        buffer[i] += ((float)(int32_t)a + (float)(int32_t)b) * dscale;
+        }
+    }
+
+/* conversion kernels for the common little endian sample formats */
+static void pcm16_to_float(float *restrict fptr, const uint8_t *restrict data, int n)
+    {
+    for (int i = 0; i < n; ++i, data += 2)
+        fptr[i] = (float)(int16_t)(data[0] | data[1] << 8) * (1.0F / 32768.0F);
+    }
+
+static void pcm24_to_float(float *restrict fptr, const uint8_t *restrict data, int n)
+    {
+    for (int i = 0; i < n; ++i, data += 3)
+        fptr[i] = (float)((int32_t)((uint32_t)data[0] << 8 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 24) >> 8) * (1.0F / 8388608.0F);
+    }
+
+static void pcm32_to_float(float *restrict fptr, const uint8_t *restrict data, int n)
+    {
+    for (int i = 0; i < n; ++i, data += 4)
+        fptr[i] = (float)(int32_t)((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24) * (1.0F / 2147483648.0F);
+    }
+
+/* any other sample width up to 32 bits */
+static void pcm_generic_to_float(float *fptr, const uint8_t *data, int n, int bits_per_sample)
     {
     int num_bytes;
-    int i;
     uint32_t msb_mask;
     uint32_t neg_mask;
     uint32_t holder;
     uint32_t mult;
-    float *fptr = buffer;
     float fscale;
-    const float half_randmax = (float)(RAND_MAX >> 1);
-    float dscale;
 
     msb_mask = 1UL << (bits_per_sample - 1);             /* negative number detector */
     neg_mask = (uint32_t)((~0UL) << (bits_per_sample));  /* negative number maker */
     fscale = 1.0F/(float)msb_mask;                       /* multiplier to make the floating point range -1 to +1 */
-    dscale = 0.25F / half_randmax * fscale;
+
+    while (n--)
+        {
+        for (num_bytes = (bits_per_sample + 7) >> 3, mult = 1, holder = 0; num_bytes--; mult <<=8)
+            {
+            holder |= ((uint32_t)*data++) * mult;
+            }
+        if (holder & msb_mask)
+            holder |= neg_mask;
+        *fptr++ = ((float)((int32_t)holder)) * fscale;
+        }
+    }
+
+/* make_audio_to_float: convert the audio to the format used by jack and libsamplerate */
+float *xlplayer_make_audio_to_float(struct xlplayer *self, float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels)
+    {
+    int n = num_samples * num_channels;
 
     if (bits_per_sample > 32)
         {
-        memset(buffer, 0, sizeof (sample_t) * num_samples * num_channels);
+        memset(buffer, 0, sizeof (sample_t) * n);
         }
     else
         {
-        while (num_samples--)
+        switch (bits_per_sample)
             {
-            for (i = 0; i < num_channels; i++)
-                {
-                for (num_bytes = (bits_per_sample + 7) >> 3, mult = 1, holder = 0; num_bytes--; mult <<=8)
-                    {
-                    holder |= ((uint32_t)*data++) * mult;
-                    }
-                if (holder & msb_mask)
-                    holder |= neg_mask;
-                if (self->dither && bits_per_sample < 20)
-                    /* adds triangular dither */
-                    *fptr++ = (((float)(int32_t)holder) * fscale) +
-                    (((((float)rand_r(&self->seed)) - half_randmax) +
-                    (((float)rand_r(&self->seed)) - half_randmax)) * dscale);
-                else
-                    *fptr++ = ((float)((int32_t)holder)) * fscale;
-                }
+            case 16:
+                pcm16_to_float(buffer, data, n);
+                break;
+            case 24:
+                pcm24_to_float(buffer, data, n);
+                break;
+            case 32:
+                pcm32_to_float(buffer, data, n);
+                break;
+            default:
+                pcm_generic_to_float(buffer, data, n, bits_per_sample);
             }
+
+        if (self->dither && bits_per_sample < 20)
+            xlplayer_add_dither(self, buffer, n, 1.0F / (float)(1UL << (bits_per_sample - 1)));
         }
     return buffer;
     }
@@ -117,121 +219,408 @@ sample_t xlplayer_get_next_gain(struct xlplayer *self)
     }
 
 /* xlplayer_demux_channel_data: this is where down/upmixing is performed - audio split to 2 channels */
-void xlplayer_demux_channel_data(struct xlplayer *self, sample_t *buffer, int num_samples, int num_channels, float scale)
+/* xlplayer_reserve_output: make room for num_samples in the output buffers
+ * the buffers only ever grow so decoders don't reallocate on each chunk
+ */
+void xlplayer_reserve_output(struct xlplayer *self, int num_samples)
     {
-    int i;
-    sample_t *lc, *rc, *src, gain;
+    size_t cap = self->op_buffercap;
 
-    self->op_buffersize = num_samples * sizeof (sample_t);
-    if ((!(self->leftbuffer = realloc(self->leftbuffer, self->op_buffersize))) && num_samples)
+    if ((size_t)num_samples <= cap)
+        return;
+
+    if (cap < OP_BUFFER_PREALLOC)
+        cap = OP_BUFFER_PREALLOC;
+    while (cap < (size_t)num_samples)
+        cap <<= 1;
+
+    if (!(self->leftbuffer = realloc(self->leftbuffer, cap * sizeof (sample_t))) ||
+                !(self->rightbuffer = realloc(self->rightbuffer, cap * sizeof (sample_t))) ||
+                !(self->gainbuffer = realloc(self->gainbuffer, cap * sizeof (sample_t))))
         {
         fprintf(stderr, "xlplayer: malloc failure");
         exit(5);
         }
-    if ((!(self->rightbuffer = realloc(self->rightbuffer, self->op_buffersize))) && num_samples)
+    self->op_buffercap = cap;
+    }
+
+/* xlplayer_get_gain_block: gain values of the next n samples multiplied by scale */
+void xlplayer_get_gain_block(struct xlplayer *self, sample_t *gain, int n, float scale)
+    {
+    const sample_t g = self->gain * scale;
+    float level;
+
+    if (fade_idle(self->fadein, &level))
         {
-        fprintf(stderr, "xlplayer: malloc failure");
-        exit(5);
+        /* the fade is idle so the gain is the same throughout */
+        for (int i = 0; i < n; i++)
+            gain[i] = level * g;
         }
+    else
+        {
+        fade_get_block(self->fadein, gain, n);
+        for (int i = 0; i < n; i++)
+            gain[i] *= g;
+        }
+    }
+
+void xlplayer_demux_channel_data(struct xlplayer *self, sample_t *buffer, int num_samples, int num_channels, float scale)
+    {
+    int i;
+    sample_t *restrict lc, *restrict rc, *restrict g;
+    const sample_t *restrict src = buffer;
+
+    xlplayer_reserve_output(self, num_samples);
+    self->op_buffersize = num_samples * sizeof (sample_t);
+    lc = self->leftbuffer;
+    rc = self->rightbuffer;
+    g = self->gainbuffer;
+    if (num_channels)
+        xlplayer_get_gain_block(self, g, num_samples, scale);
+
     switch (num_channels)
         {
         case 0:
-            break;                 /* this is a wtf case */
+            return;                /* this is a wtf case */
         case 1:
-            for (lc = self->leftbuffer, src = buffer, i = 0; i < num_samples; i++)
-                {
-                gain = xlplayer_get_next_gain(self);        /* used for fade-in */
-                *lc++ = *src++ * gain * scale;
-                }
-            memcpy(self->rightbuffer, self->leftbuffer, self->op_buffersize);
+            memcpy(lc, src, self->op_buffersize);
+            memcpy(rc, src, self->op_buffersize);
             break;
         case 2:
-            for (lc = self->leftbuffer, rc = self->rightbuffer, src = buffer, i = 0; i < num_samples; i++)
+            for (i = 0; i < num_samples; i++)
                 {
-                gain = xlplayer_get_next_gain(self);
-                *lc++ = *src++ * gain * scale;      /* stereo mix is a simple demultiplex job */
-                *rc++ = *src++ * gain * scale;
+                lc[i] = src[2 * i];      /* stereo mix is a simple demultiplex job */
+                rc[i] = src[2 * i + 1];
                 }
             break;
         case 3:
-            for (lc = self->leftbuffer, rc = self->rightbuffer, src = buffer, i = 0; i < num_samples; i++)
+            for (i = 0; i < num_samples; i++, src += 3)
                 {
-                gain = xlplayer_get_next_gain(self) * 0.5F;
-                *lc = (*src++) * gain * scale; /* do the left and right channels */
-                *rc = (*src++) * gain * scale;
-                *(lc++) += (*src) *gain * scale;    /* downmix the middle channel to the left and right one */
-                *(rc++) += (*src++) *gain * scale;
+                /* downmix the middle channel to the left and right one */
+                lc[i] = (src[0] + src[2]) * 0.5F;
+                rc[i] = (src[1] + src[2]) * 0.5F;
                 }
             break;
         case 4:
-            for (lc = self->leftbuffer, rc = self->rightbuffer, src = buffer, i = 0; i < num_samples; i++, src += 4)
+            for (i = 0; i < num_samples; i++, src += 4)
                 {
-                gain = xlplayer_get_next_gain(self) * 0.5F;
-                *lc++ = (src[0] + src[3]) * gain * scale;
-                *rc++ = (src[2] + src[4]) * gain * scale;
+                lc[i] = (src[0] + src[3]) * 0.5F;
+                rc[i] = (src[2] + src[4]) * 0.5F;
                 }
             break;
         case 5:
-            for (lc = self->leftbuffer, rc = self->rightbuffer, src = buffer, i = 0; i < num_samples; i++, src += 5)
+            for (i = 0; i < num_samples; i++, src += 5)
                 {
-                gain = xlplayer_get_next_gain(self) * 0.5F;
-                *lc++ = (src[0] + src[3]) * gain * scale;   /* this is for 4.1 channels with sub discarded */
-                *rc++ = (src[2] + src[4]) * gain * scale;
+                lc[i] = (src[0] + src[3]) * 0.5F;   /* this is for 4.1 channels with sub discarded */
+                rc[i] = (src[2] + src[4]) * 0.5F;
                 }
             break;
         case 6:
-            for (lc = self->leftbuffer, rc = self->rightbuffer, src = buffer, i = 0; i < num_samples; i++, src += 6)
+            for (i = 0; i < num_samples; i++, src += 6)
                 {
-                gain = xlplayer_get_next_gain(self) * 0.33333333F;
-                *lc++ = (src[0] + src[3] + src[4]) * gain * scale;  /* this is for 5.1 channels */
-                *rc++ = (src[2] + src[4] + src[5]) * gain * scale;   /* sub discarded */
+                lc[i] = (src[0] + src[3] + src[4]) * 0.33333333F;  /* this is for 5.1 channels */
+                rc[i] = (src[2] + src[4] + src[5]) * 0.33333333F;   /* sub discarded */
                 }
             break;
         }
+
+    /* the overview is cached by pathname so it is taken before the ReplayGain and fades of this play */
+    if (self->peaks_capture)
+        peaks_capture_append(self->peaks_capture, lc, rc, num_samples);
+
+    for (i = 0; i < num_samples; i++)
+        {
+        lc[i] *= g[i];
+        rc[i] *= g[i];
+        }
+    }
+
+/* the player ringbuffers hold interleaved stereo frames so each transfer
+ * is one index update and the channels can't be seen out of step
+ */
+static size_t xlp_rb_frames(jack_ringbuffer_t *rb)
+    {
+    return jack_ringbuffer_read_space(rb) / (2 * sizeof (sample_t));
+    }
+
+static size_t xlp_rb_space(jack_ringbuffer_t *rb)
+    {
+    return jack_ringbuffer_write_space(rb) / (2 * sizeof (sample_t));
+    }
+
+static void xlp_rb_write(jack_ringbuffer_t *rb, const sample_t *l, const sample_t *r, size_t frames)
+    {
+    jack_ringbuffer_data_t vec[2];
+    size_t total = frames;
+
+    jack_ringbuffer_get_write_vector(rb, vec);
+    for (int v = 0; v < 2 && frames; ++v)
+        {
+        sample_t *restrict dst = (sample_t *)vec[v].buf;
+        size_t n = vec[v].len / (2 * sizeof (sample_t));
+
+        if (n > frames)
+            n = frames;
+        for (size_t i = 0; i < n; ++i)
+            {
+            dst[2 * i] = l[i];
+            dst[2 * i + 1] = r[i];
+            }
+        l += n;
+        r += n;
+        frames -= n;
+        }
+    jack_ringbuffer_write_advance(rb, (total - frames) * 2 * sizeof (sample_t));
+    }
+
+static void xlp_rb_read(jack_ringbuffer_t *rb, sample_t *l, sample_t *r, size_t frames)
+    {
+    jack_ringbuffer_data_t vec[2];
+    size_t total = frames;
+
+    jack_ringbuffer_get_read_vector(rb, vec);
+    for (int v = 0; v < 2 && frames; ++v)
+        {
+        const sample_t *restrict src = (const sample_t *)vec[v].buf;
+        size_t n = vec[v].len / (2 * sizeof (sample_t));
+
+        if (n > frames)
+            n = frames;
+        for (size_t i = 0; i < n; ++i)
+            {
+            l[i] = src[2 * i];
+            r[i] = src[2 * i + 1];
+            }
+        l += n;
+        r += n;
+        frames -= n;
+        }
+    jack_ringbuffer_read_advance(rb, (total - frames) * 2 * sizeof (sample_t));
+    }
+
+/* block the decoder until the jack callback has drained the ringbuffer
+ * down to mark bytes or a new command arrives
+ */
+static void xlplayer_wait_space(struct xlplayer *self, size_t mark)
+    {
+    struct timespec ts;
+
+    self->pool_parked = FALSE;
+    while (jack_ringbuffer_read_space(self->main_rb) > mark && self->command == CMD_COMPLETE && *(self->jack_shutdown_f) == FALSE)
+        {
+        self->want_space = mark;
+        /* the jack callback may have drained the buffer before seeing want_space */
+        if (jack_ringbuffer_read_space(self->main_rb) <= mark)
+            break;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += 20000000) >= 1000000000)
+            {
+            ts.tv_nsec -= 1000000000;
+            ++ts.tv_sec;
+            }
+        sem_timedwait(&self->space_sem, &ts);
+        }
+    self->want_space = 0;
+    }
+
+/* called from the jack callback to wake a waiting decoder */
+static void xlplayer_signal_space(struct xlplayer *self)
+    {
+    size_t mark = self->want_space;
+
+    if (mark && jack_ringbuffer_read_space(self->main_rb) <= mark)
+        {
+        self->want_space = 0;
+        sem_post(self->pool_parked ? &self->pool->wake_sem : &self->space_sem);
+        }
+    }
+
+/* a pooled player hands its worker back until the ringbuffer has drained down to mark
+ * the decoder may still write what fits in the meantime
+ */
+static void xlplayer_pool_park(struct xlplayer *self, size_t mark)
+    {
+    self->pool_mark = mark;
+    self->pool_parked = TRUE;
+    self->want_space = mark;
+    }
+
+/* freewheeling, block the jack callback until the decoder has written frames or stopped
+ * JACK runs the callback in an ordinary thread then so it can wait for the decoder
+ * instead of the mix going silent or the callback spinning
+ */
+static void xlplayer_wait_data(struct xlplayer *self, size_t frames)
+    {
+    struct timespec ts;
+
+    while (self->playmode != PM_STOPPED && xlp_rb_frames(self->main_rb) < frames && g.freewheel && *(self->jack_shutdown_f) == FALSE)
+        {
+        self->want_data = frames;
+        /* the decoder may have written before seeing want_data */
+        if (xlp_rb_frames(self->main_rb) >= frames || self->playmode == PM_STOPPED)
+            break;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += 20000000) >= 1000000000)
+            {
+            ts.tv_nsec -= 1000000000;
+            ++ts.tv_sec;
+            }
+        sem_timedwait(&self->data_sem, &ts);
+        }
+    self->want_data = 0;
+    }
+
+/* called from the decoder to wake a waiting jack callback */
+static void xlplayer_signal_data(struct xlplayer *self)
+    {
+    size_t frames = self->want_data;
+
+    if (frames && (self->playmode == PM_STOPPED || xlp_rb_frames(self->main_rb) >= frames))
+        {
+        self->want_data = 0;
+        sem_post(&self->data_sem);
+        }
+    }
+
+/* xlplayer_speed_marker: note that audio from here on in main_rb is at a new speed
+ * when the jack callback has too many still to reach the speed is left as it was
+ */
+static int xlplayer_speed_marker(struct xlplayer *self, float ratio)
+    {
+    unsigned w = self->pbs_marker_w;
+
+    if (ratio == self->pbs_decode_ratio)
+        return TRUE;
+    if (w - __atomic_load_n(&self->pbs_marker_r, __ATOMIC_ACQUIRE) == PBS_MARKERS)
+        return FALSE;
+    self->pbs_markers[w % PBS_MARKERS] = (struct pbs_marker){ self->pbs_frames_in, ratio };
+    __atomic_store_n(&self->pbs_marker_w, w + 1, __ATOMIC_RELEASE);
+    self->pbs_decode_ratio = ratio;
+    return TRUE;
+    }
+
+/* xlplayer_apply_speed: playback speed conversion of the output buffers in place */
+static void xlplayer_apply_speed(struct xlplayer *self)
+    {
+    size_t in_frames = self->op_buffersize / sizeof (sample_t), cap;
+    float ratio = self->use_sv ? self->newpbspeed : 1.0f;
+    SRC_DATA data = { .end_of_input = 0 };
+
+    if (ratio <= 0.0f || !xlplayer_speed_marker(self, ratio))
+        ratio = self->pbs_decode_ratio;
+    if (ratio == 1.0f)
+        return;
+
+    cap = (size_t)(in_frames * ratio) + 16;
+    if (cap > self->pbs_out_cap)
+        {
+        if (!(self->pbs_out_l = realloc(self->pbs_out_l, cap * sizeof (sample_t))) ||
+                    !(self->pbs_out_r = realloc(self->pbs_out_r, cap * sizeof (sample_t))))
+            {
+            fprintf(stderr, "xlplayer: malloc failure");
+            exit(5);
+            }
+        self->pbs_out_cap = cap;
+        }
+
+    src_set_ratio(self->pbspeed_conv_l, ratio);
+    src_set_ratio(self->pbspeed_conv_r, ratio);
+    data.src_ratio = ratio;
+    data.input_frames = in_frames;
+    data.output_frames = cap;
+    data.data_in = self->leftbuffer;
+    data.data_out = self->pbs_out_l;
+    src_process(self->pbspeed_conv_l, &data);
+    data.data_in = self->rightbuffer;
+    data.data_out = self->pbs_out_r;
+    src_process(self->pbspeed_conv_r, &data);
+
+    xlplayer_reserve_output(self, data.output_frames_gen);
+    memcpy(self->leftbuffer, self->pbs_out_l, data.output_frames_gen * sizeof (sample_t));
+    memcpy(self->rightbuffer, self->pbs_out_r, data.output_frames_gen * sizeof (sample_t));
+    self->op_buffersize = data.output_frames_gen * sizeof (sample_t);
+    }
+
+/* xlplayer_trailing_silence: the number of frames at the end of a block that are quieter than threshold
+ * the block is scanned from the end backward in chunks whose absolute peak is all that's tested
+ * so the chunk loop is branch free and only the chunk where the audio starts is looked at in detail
+ */
+#define SILENCE_CHUNK 16
+
+static u_int32_t xlplayer_trailing_silence(const float *restrict l, const float *restrict r, u_int32_t n, float threshold)
+    {
+    u_int32_t end = n;
+
+    while (end >= SILENCE_CHUNK)
+        {
+        const float *restrict lc = l + end - SILENCE_CHUNK;
+        const float *restrict rc = r + end - SILENCE_CHUNK;
+        float peak = 0.0f;
+
+        for (int i = 0; i < SILENCE_CHUNK; ++i)
+            {
+            float a = fmaxf(fabsf(lc[i]), fabsf(rc[i]));
+
+            peak = fmaxf(peak, a);
+            }
+        if (peak > threshold)
+            break;
+        end -= SILENCE_CHUNK;
+        }
+
+    while (end && fabsf(l[end - 1]) <= threshold && fabsf(r[end - 1]) <= threshold)
+        --end;
+    return n - end;
     }
 
 void xlplayer_write_channel_data(struct xlplayer *self)
     {
-    u_int32_t samplecount;
-    const float threshold = 0.003;
-    float *lp, *rp;
-    int sc;
+    u_int32_t samplecount, sc;
+
+    /* a deferred write was converted the first time round */
+    if (!self->pbs_converted)
+        {
+        self->pbs_source_frames = self->op_buffersize / sizeof (sample_t);
+        if (self->pcm_capture && self->op_buffersize)
+            pcmcache_capture_append(&self->pcm_capture, self->leftbuffer, self->rightbuffer, self->pbs_source_frames);
+        if (self->op_buffersize)
+            xlplayer_apply_speed(self);
+        self->pbs_converted = TRUE;
+        }
 
-    if (self->op_buffersize > jack_ringbuffer_write_space(self->right_ch))
+    if (self->op_buffersize / sizeof (sample_t) > xlp_rb_space(self->main_rb))
         {
+        size_t fill = jack_ringbuffer_read_space(self->main_rb);
+        size_t capacity = fill + jack_ringbuffer_write_space(self->main_rb);
+        size_t needed = self->op_buffersize * 2;
+
         self->write_deferred = TRUE;      /* prevent further accumulation of data that would clobber */
-        usleep(20000);
+        xlplayer_wait_space(self, (capacity > needed) ? capacity - needed : 0);
         }
     else
         {
         if (self->op_buffersize)
             {
-            jack_ringbuffer_write(self->left_ch, (char *)self->leftbuffer, self->op_buffersize);
-            jack_ringbuffer_write(self->right_ch, (char *)self->rightbuffer, self->op_buffersize);
             samplecount = self->op_buffersize / sizeof (sample_t);
-            self->samples_written += samplecount;
-            self->sleep_samples += samplecount;
+            xlp_rb_write(self->main_rb, self->leftbuffer, self->rightbuffer, samplecount);
+            xlplayer_signal_data(self);
+            self->pbs_frames_in += samplecount;
+            self->samples_written += self->pbs_source_frames;
             /* count cumulative silent samples */
-            for (sc = 0, lp = self->leftbuffer, rp = self->rightbuffer; samplecount--; ++lp, ++rp)
-                {
-                if (*lp > threshold || *rp > threshold)
-                    {
-                    sc = 0;
-                    self->silence = 0.0f;
-                    }
-                else
-                    ++sc;
-                }
+            sc = xlplayer_trailing_silence(self->leftbuffer, self->rightbuffer, samplecount, self->silence_threshold);
+            if (sc < samplecount)
+                self->silence = 0.0f;
             self->silence += (float)sc / self->samplerate;
             }
         self->write_deferred = FALSE;
-        if (self->sleep_samples > 6000)
+        self->pbs_converted = FALSE;
+        /* decode in bursts between the high and low watermarks, flat out when freewheeling */
+        if (!g.freewheel && jack_ringbuffer_read_space(self->main_rb) > self->rb_high_mark)
             {
-            if (self->sleep_samples > 12000)
-                usleep(20000);
+            if (self->pool)
+                xlplayer_pool_park(self, self->rb_low_mark);
             else
-                usleep(10000);
-            self->sleep_samples = 0;
+                xlplayer_wait_space(self, self->rb_low_mark);
             }
         }
     }
@@ -242,7 +631,8 @@ static u_int32_t xlplayer_update_progress_time_ms(struct xlplayer *self)
     int32_t rb_time_ms;  /* the amount of time it would take to play all the samples in the buffer */
     int32_t progress;
 
-    rb_time_ms = (float)jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t) * 1000.0f / self->samplerate;
+    /* the buffered audio is at the speed it was written at */
+    rb_time_ms = (float)xlp_rb_frames(self->main_rb) * 1000.0f / (self->samplerate * self->pbs_read_ratio);
     progress = self->samples_written * 1000.0f / self->samplerate - rb_time_ms + self->seek_s * 1000.0f;
 
     if (progress >= 0)
@@ -269,234 +659,563 @@ static char *get_extension(char *pathname)
     return extension;
     }
 
-static void xlplayer_command(struct xlplayer *self, enum command_t new_command)
+/* wait for any outstanding command on this player to be completed */
+static void xlplayer_command_wait(struct xlplayer *self)
+    {
+    pthread_mutex_lock(&self->command_mutex);
+    while (self->command != CMD_COMPLETE)
+        pthread_cond_wait(&self->command_done_cv, &self->command_mutex);
+    pthread_mutex_unlock(&self->command_mutex);
+    }
+
+static void xlplayer_command_async(struct xlplayer *self, enum command_t new_command)
     {
+    xlplayer_command_wait(self);
     pthread_mutex_lock(&self->command_mutex);
     self->command = new_command;
     pthread_cond_signal(&self->command_cv);
     pthread_mutex_unlock(&self->command_mutex);
-    while (self->command)
+    if (self->pool)
+        sem_post(&self->pool->wake_sem);
+    }
+
+static void xlplayer_command(struct xlplayer *self, enum command_t new_command)
+    {
+    xlplayer_command_async(self, new_command);
+    xlplayer_command_wait(self);
+    }
+
+/* called by the player thread to hand back control */
+static void xlplayer_command_complete(struct xlplayer *self)
+    {
+    pthread_mutex_lock(&self->command_mutex);
+    self->command = CMD_COMPLETE;
+    pthread_cond_broadcast(&self->command_done_cv);
+    pthread_mutex_unlock(&self->command_mutex);
+    }
+
+void xlplayer_command_cancel(struct xlplayer *self)
+    {
+    xlplayer_command_complete(self);
+    }
+
+/* wait for the jack callback to discard the old audio */
+static void xlplayer_flush(struct xlplayer *self)
+    {
+    xlplayer_set_fadesteps(self, self->fade_mode);
+    if (self->headless)
+        {
+        jack_ringbuffer_reset(self->main_rb);
+        return;
+        }
+    self->jack_flush = TRUE;
+    while (self->jack_is_flushed == 0 && *(self->jack_shutdown_f) == FALSE)
         usleep(10000);
+    self->jack_is_flushed = 0;
+
+    /* the jack callback dropped its speed markers along with the audio */
+    if (!self->noflush)
+        {
+        self->pbs_frames_in = 0;
+        self->pbs_decode_ratio = 0.0f;
+        src_reset(self->pbspeed_conv_l);
+        src_reset(self->pbspeed_conv_r);
+        }
     }
 
-static void *xlplayer_main(struct xlplayer *self)
+/* the preloader is done with, keep it for the next preload if there's room */
+static void xlplayer_preloader_return(struct xlplayer *self, struct xlplayer *pl)
     {
-    char *extension;
+    pthread_mutex_lock(&self->command_mutex);
+    if (!self->preloader)
+        self->preloader = pl;
+    else if (!self->preload_spare)
+        self->preload_spare = pl;
+    else
+        {
+        pthread_mutex_unlock(&self->command_mutex);
+        xlplayer_destroy(pl);
+        return;
+        }
+    pthread_mutex_unlock(&self->command_mutex);
+    }
 
-    sig_mask_thread();
-    for(self->up = TRUE; self->command != CMD_THREADEXIT; self->watchdog_timer = 0)
+/* the player relays the audio of a preloader which carries on decoding the track
+ * so the open, probe and decoder start happened well ahead of time
+ */
+static void xlplayer_relay_init(struct xlplayer *self)
+    {
+    /* nothing to set up, the preloader's decoder was started when the track was preloaded
+     * and its seek, gain and fade mode were checked against this play in xlplayer_take_preload
+     */
+    }
+
+/* xlplayer_relay_wait: block a little while for the preloader to get ahead */
+static void xlplayer_relay_wait(struct xlplayer *pl)
+    {
+    struct timespec ts;
+
+    pl->want_data = 1;
+    /* the preloader may have written before seeing want_data */
+    if (!xlp_rb_frames(pl->main_rb) && pl->playmode != PM_STOPPED)
         {
-        switch (self->command)
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += 20000000) >= 1000000000)
             {
-            case CMD_COMPLETE:
-                break;
-            case CMD_PLAY:
-                self->playmode = PM_INITIATE;
-                break;
-            case CMD_PLAYMANY:
-                self->pathname = self->playlist[self->playlistindex = 0];
-                self->playmode = PM_INITIATE;
-                break;
-            case CMD_EJECT:
-                if (self->playmode != PM_STOPPED)
-                    self->playmode = PM_EJECTING;
-                else
-                    {
-                    xlplayer_set_fadesteps(self, self->fade_mode);
-                    self->jack_flush = TRUE;
-                    while (self->jack_is_flushed == 0 && *(self->jack_shutdown_f) == FALSE)
-                        usleep(10000);
-                    self->jack_is_flushed = 0;
-                    self->command = CMD_COMPLETE;
-                    }
-                break;
-            case CMD_CLEANUP:
-                if (self->playlist)
-                    free(self->playlist);
-                self->command = CMD_THREADEXIT;
-            case CMD_THREADEXIT:
-                continue;
+            ts.tv_nsec -= 1000000000;
+            ++ts.tv_sec;
             }
-        switch (self->playmode)
-            {
-            case PM_STOPPED:
-                pthread_mutex_lock(&self->command_mutex);
-                while (self->command == CMD_COMPLETE)
-                    pthread_cond_wait(&self->command_cv, &self->command_mutex);
-                pthread_mutex_unlock(&self->command_mutex);
-                continue;
-            case PM_INITIATE:
-                self->initial_audio_context = -1;   /* pre-select failure return code */
-                xlplayer_set_fadesteps(self, self->fade_mode);
-                extension = get_extension(self->pathname);
-                if (
-                          ((!strcmp(extension, "ogg") || !strcmp(extension, "oga")) && oggdecode_reg(self))
+        sem_timedwait(&pl->data_sem, &ts);
+        }
+    pl->want_data = 0;
+    }
+
+static void xlplayer_relay_play(struct xlplayer *self)
+    {
+    struct xlplayer *pl = self->dec_data;
+    struct xlp_dynamic_metadata *dm = &pl->dynamic_metadata;
+    int stopped = (pl->playmode == PM_STOPPED);
+    size_t n = xlp_rb_frames(pl->main_rb);
+
+    /* titles that change mid-file were picked up by the preloader's decoder */
+    if (dm->data_type)
+        {
+        pthread_mutex_lock(&dm->meta_mutex);
+        xlplayer_set_dynamic_metadata(self, dm->data_type, dm->artist, dm->title, dm->album,
+                                        dm->rbdelay + xlplayer_calc_rbdelay(self));
+        dm->data_type = DM_NONE_NEW;
+        pthread_mutex_unlock(&dm->meta_mutex);
+        }
+
+    if (n == 0)
+        {
+        if (stopped)
+            self->playmode = PM_FLUSH;
+        else
+            xlplayer_relay_wait(pl);
+        return;
+        }
+    if (n > 4096)
+        n = 4096;
+    xlplayer_reserve_output(self, n);
+    xlp_rb_read(pl->main_rb, self->leftbuffer, self->rightbuffer, n);
+    xlplayer_signal_space(pl);
+    self->op_buffersize = n * sizeof (sample_t);
+    xlplayer_write_channel_data(self);
+    }
+
+static void xlplayer_relay_eject(struct xlplayer *self)
+    {
+    struct xlplayer *pl = self->dec_data;
+
+    self->relay_source = NULL;
+    xlplayer_eject(pl);
+    xlplayer_preloader_return(self, pl);
+    }
+
+/* xlplayer_take_preload: relay the preloader if it has the track about to be played */
+static int xlplayer_take_preload(struct xlplayer *self)
+    {
+    struct xlplayer *pl;
+
+    pthread_mutex_lock(&self->command_mutex);
+    pl = self->preloader;
+    if (!pl || !self->preload_pathname || strcmp(self->preload_pathname, self->pathname)
+                || self->preload_seek_s != self->seek_s || self->preload_gain != self->gain
+                || self->preload_fade_mode != self->fade_mode)
+        {
+        pthread_mutex_unlock(&self->command_mutex);
+        return FALSE;
+        }
+    /* the player has it for as long as the track lasts */
+    self->preloader = NULL;
+    free(self->preload_pathname);
+    self->preload_pathname = NULL;
+    pthread_mutex_unlock(&self->command_mutex);
+
+    /* the preloader must at least have got the track started */
+    xlplayer_command_wait(pl);
+    if (pl->initial_audio_context == -1)
+        {
+        xlplayer_preloader_return(self, pl);
+        return FALSE;
+        }
+
+    self->relay_source = self->dec_data = pl;
+    self->dec_init = xlplayer_relay_init;
+    self->dec_play = xlplayer_relay_play;
+    self->dec_eject = xlplayer_relay_eject;
+    fprintf(stderr, "xlplayer: %s started with %ld preloaded samples\n", self->playername, (long)xlp_rb_frames(pl->main_rb));
+    return TRUE;
+    }
+
+/* xlplayer_preload_next: have the next playlist entry opened while this one plays */
+static void xlplayer_preload_next(struct xlplayer *self)
+    {
+    int next = self->playlistindex + 1;
+
+    if (next == self->playlistsize && self->loop)
+        next = 0;
+    if (next < self->playlistsize)
+        xlplayer_preload(self, self->playlist[next], 0, 0, 20.0f * log10f(self->gain));
+    }
+
+/* take on the track parameters of an asynchronous play */
+static void xlplayer_apply_pending(struct xlplayer *self)
+    {
+    struct xlplayer_pending *p = &self->pending;
+
+    free(self->async_pathname);
+    self->pathname = self->async_pathname = p->pathname;
+    p->pathname = NULL;
+    self->gain = p->gain;
+    self->seek_s = p->seek_s;
+    self->size = p->size;
+    }
+
+/* xlplayer_step: one pass of the player's loop, FALSE once the player has been told to exit */
+static int xlplayer_step(struct xlplayer *self)
+    {
+    char *extension;
+    int relayed, cached;
+
+    if (self->command == CMD_THREADEXIT)
+        return FALSE;
+    switch (self->command)
+        {
+        case CMD_COMPLETE:
+            break;
+        case CMD_PLAY:
+            self->playmode = PM_INITIATE;
+            break;
+        case CMD_PLAYMANY:
+            self->pathname = self->playlist[self->playlistindex = 0];
+            self->playmode = PM_INITIATE;
+            break;
+        case CMD_EJECT:
+            if (self->playmode != PM_STOPPED)
+                self->playmode = PM_EJECTING;
+            else
+                {
+                xlplayer_flush(self);
+                xlplayer_command_complete(self);
+                }
+            break;
+        case CMD_EJECTPLAY:
+            if (self->playmode != PM_STOPPED)
+                self->playmode = PM_EJECTING;
+            else
+                {
+                /* the eject is done, carry on as CMD_PLAY */
+                xlplayer_flush(self);
+                xlplayer_apply_pending(self);
+                self->command = CMD_PLAY;
+                self->playmode = PM_INITIATE;
+                }
+            break;
+        case CMD_CLEANUP:
+            if (self->playlist)
+                free(self->playlist);
+            self->command = CMD_THREADEXIT;
+        case CMD_THREADEXIT:
+            return TRUE;
+        }
+    switch (self->playmode)
+        {
+        case PM_STOPPED:
+            /* the pool leaves a stopped player be until it has a command */
+            if (self->pool)
+                return TRUE;
+            pthread_mutex_lock(&self->command_mutex);
+            while (self->command == CMD_COMPLETE)
+                pthread_cond_wait(&self->command_cv, &self->command_mutex);
+            pthread_mutex_unlock(&self->command_mutex);
+            return TRUE;
+        case PM_INITIATE:
+            self->initial_audio_context = -1;   /* pre-select failure return code */
+            xlplayer_set_fadesteps(self, self->fade_mode);
+            relayed = xlplayer_take_preload(self);
+            extension = get_extension(self->pathname);
+            cached = !relayed && self->use_pcmcache && !self->seek_s && pcmcache_reg(self);
+            if (relayed || cached ||
+                      ((!strcmp(extension, "ogg") || !strcmp(extension, "oga")) && oggdecode_reg(self))
 #ifdef HAVE_SPEEX
-                          || (!strcmp(extension, "spx") && oggdecode_reg(self))
+                      || (!strcmp(extension, "spx") && oggdecode_reg(self))
 #endif
 #ifdef HAVE_OPUS
-                          || (!strcmp(extension, "opus") && oggdecode_reg(self))
+                      || (!strcmp(extension, "opus") && oggdecode_reg(self))
 #endif
 #ifdef HAVE_FLAC
-                          || (!strcmp(extension, "flac") && flacdecode_reg(self))
+                      || (!strcmp(extension, "flac") && flacdecode_reg(self))
 #endif
-                          || ((!strcmp(extension, "wav") || !strcmp(extension, "au") || !strcmp(extension, "aiff")) && sndfiledecode_reg(self))
+                      || ((!strcmp(extension, "wav") || !strcmp(extension, "au") || !strcmp(extension, "aiff")) && sndfiledecode_reg(self))
 #ifdef HAVE_LIBAV
-                          || ((!strcmp(extension, "aac") || !strcmp(extension, "m4a") || !strcmp(extension, "mp4") || !strcmp(extension, "m4b") || !strcmp(extension, "m4p") || !strcmp(extension, "wma") || !strcmp(extension, "avi") || !strcmp(extension, "mpc") || !strcmp(extension, "ape")) && avcodecdecode_reg(self))
+                      || ((!strcmp(extension, "aac") || !strcmp(extension, "m4a") || !strcmp(extension, "mp4") || !strcmp(extension, "m4b") || !strcmp(extension, "m4p") || !strcmp(extension, "wma") || !strcmp(extension, "avi") || !strcmp(extension, "mpc") || !strcmp(extension, "ape")) && avcodecdecode_reg(self))
 #endif /* HAVE_LIBAV */
-                          || ((!strcmp(extension, "mp3") || (!strcmp(extension, "mp2"))) && mpg123ok && mp3decode_reg(self))
-                    )
+                      || ((!strcmp(extension, "mp3") || (!strcmp(extension, "mp2"))) && mpg123ok && mp3decode_reg(self))
+                )
+                {
+                self->playmode = PM_PLAYING;
+                self->play_progress_ms = 0;
+                self->write_deferred = 0;
+                self->pbs_converted = FALSE;
+                self->pause = 0;
+                self->samples_written = 0;
+                fade_set(self->fadein, (self->seek_s || self->fade_mode) ? FADE_SET_LOW : FADE_SET_HIGH, -1.0f, FADE_IN);
+                self->silence = 0.0f;
+                self->dec_init(self);
+                /* decoded output is gathered for the cache only from the very start */
+                if (self->use_pcmcache && !cached && !relayed && self->playmode == PM_PLAYING)
+                    self->pcm_capture = pcmcache_capture_begin(self);
+                /* so is the waveform overview, which cached output can't give as it has this play's gain in it */
+                if (!relayed && !cached && self->playmode == PM_PLAYING)
+                    self->peaks_capture = peaks_capture_begin(self);
+                if (self->playlistmode && self->playmode == PM_PLAYING)
+                    xlplayer_preload_next(self);
+                if (self->command != CMD_COMPLETE)
+                    ++self->current_audio_context;
+                self->initial_audio_context = self->current_audio_context;
+                }
+            else
+                self->playmode = PM_STOPPED;
+            xlplayer_command_complete(self);
+            free(extension);
+            break;
+        case PM_PLAYING:
+            if (self->write_deferred)
+                xlplayer_write_channel_data(self);
+            else
+                self->dec_play(self);
+            break;
+        case PM_FLUSH:
+            if (self->write_deferred)
+                xlplayer_write_channel_data(self);
+            else
+                {
+                /* played through to the end so the capture is the whole track */
+                if (self->pcm_capture)
                     {
-                    self->playmode = PM_PLAYING;
-                    self->play_progress_ms = 0;
-                    self->write_deferred = 0;
-                    self->pause = 0;
-                    self->samples_written = 0;
-                    self->sleep_samples = 0;
-                    fade_set(self->fadein, (self->seek_s || self->fade_mode) ? FADE_SET_LOW : FADE_SET_HIGH, -1.0f, FADE_IN);
-                    self->silence = 0.0f;
-                    self->dec_init(self);
-                    if (self->command != CMD_COMPLETE)
-                        ++self->current_audio_context;
-                    self->initial_audio_context = self->current_audio_context;
+                    pcmcache_capture_commit(self->pcm_capture);
+                    self->pcm_capture = NULL;
                     }
-                else
-                    self->playmode = PM_STOPPED;
-                self->command = CMD_COMPLETE;
-                free(extension);
-                break;
-            case PM_PLAYING:
-                if (self->write_deferred)
-                    xlplayer_write_channel_data(self);
-                else
-                    self->dec_play(self);
-                break;
-            case PM_FLUSH:
-                if (self->write_deferred)
-                    xlplayer_write_channel_data(self);
-                else
-                    self->playmode = PM_EJECTING;
-                break;
-            case PM_EJECTING:
-                xlplayer_set_fadesteps(self, self->fade_mode);
-                self->dec_eject(self);
-                if (self->playlistmode)
+                if (self->peaks_capture)
                     {
-                    if (self->command != CMD_EJECT)
+                    peaks_capture_commit(self->peaks_capture);
+                    self->peaks_capture = NULL;
+                    }
+                self->playmode = PM_EJECTING;
+                }
+            break;
+        case PM_EJECTING:
+            xlplayer_set_fadesteps(self, self->fade_mode);
+            if (self->pcm_capture)
+                {
+                pcmcache_capture_abandon(self->pcm_capture);
+                self->pcm_capture = NULL;
+                }
+            if (self->peaks_capture)
+                {
+                peaks_capture_abandon(self->peaks_capture);
+                self->peaks_capture = NULL;
+                }
+            self->dec_eject(self);
+            if (self->playlistmode)
+                {
+                if (self->command != CMD_EJECT && self->command != CMD_EJECTPLAY)
+                    {
+                    /* implements the internal playlist here */
+                    if (++self->playlistindex == self->playlistsize && self->loop)
+                        self->playlistindex = 0;                   /* perform looparound if relevant */
+                    if (self->playlistindex < self->playlistsize) /* check for non end of playlist */
                         {
-                        /* implements the internal playlist here */
-                        if (++self->playlistindex == self->playlistsize && self->loop)
-                            self->playlistindex = 0;                   /* perform looparound if relevant */
-                        if (self->playlistindex < self->playlistsize) /* check for non end of playlist */
-                            {
-                            self->pathname = self->playlist[self->playlistindex];
-                            self->playmode = PM_INITIATE;
-                            continue;
-                            }
+                        self->pathname = self->playlist[self->playlistindex];
+                        self->playmode = PM_INITIATE;
+                        return TRUE;
                         }
-                    else
-                        while (self->playlistsize--)
-                            free(self->playlist[self->playlistsize]);
                     }
-                ++self->current_audio_context;
-                self->playmode = PM_STOPPED;
-                break;
+                else
+                    while (self->playlistsize--)
+                        free(self->playlist[self->playlistsize]);
+                }
+            ++self->current_audio_context;
+            self->playmode = PM_STOPPED;
+            xlplayer_signal_data(self);
+            break;
+        }
+    return TRUE;
+    }
+
+static void *xlplayer_main(struct xlplayer *self)
+    {
+    sig_mask_thread();
+    threadstat_name("player", self->playername);
+    self->up = TRUE;
+    for (;;)
+        {
+        threadstat_sample(&self->threadstat);
+        if (!xlplayer_step(self))
+            break;
+        self->watchdog_timer = 0;
+        }
+    xlplayer_command_complete(self);
+    return 0;
+    }
+
+/* xlplayer_pool_ready: whether a player has work to do, pool mutex held */
+static int xlplayer_pool_ready(struct xlplayer *self)
+    {
+    if (self->pool_exited)
+        return FALSE;
+    if (self->command != CMD_COMPLETE)
+        return TRUE;
+    if (self->playmode == PM_STOPPED)
+        return FALSE;
+    return !self->pool_parked || jack_ringbuffer_read_space(self->main_rb) <= self->pool_mark || *(self->jack_shutdown_f);
+    }
+
+/* xlplayer_pool_fill: queue up the players with work to do, pool mutex held */
+static void xlplayer_pool_fill(struct xlplayer_pool *pool)
+    {
+    for (int i = 0; i < pool->n_players; ++i)
+        if (!pool->player[i]->pool_queued && xlplayer_pool_ready(pool->player[i]))
+            {
+            pool->player[i]->pool_queued = TRUE;
+            pool->queue[(pool->queue_head + pool->queue_len++) % pool->max_players] = pool->player[i];
             }
-        }
-    self->command = CMD_COMPLETE;
-    return 0;
     }
 
-/* callback functions for feeding the playback speed resampler */
-static long conv_l_read(void *cb_data, float **audiodata)
+static void *xlplayer_pool_worker(struct xlplayer_pool *pool)
     {
-    struct xlplayer *self = (struct xlplayer *)cb_data;
+    static int n_named;
+    struct xlplayer *job;
+    struct threadstat_sample usage;
+    struct timespec ts;
+    char id[24];
 
-    if (self->pbs_exchange == 0)         /* used to maintain mapping of input buffers after a swap */
+    sig_mask_thread();
+    snprintf(id, sizeof id, "%s pool %d", pool->name, __atomic_fetch_add(&n_named, 1, __ATOMIC_RELAXED));
+    threadstat_name("player", id);
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->terminate)
         {
-        /* try and get at least PBSPEED_INPUT_SAMPLE_SIZE samples */
-        self->pbs_norm_read_qty = jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t);
-        if (self->pbs_norm_read_qty > PBSPEED_INPUT_SAMPLE_SIZE)
-            self->pbs_norm_read_qty = PBSPEED_INPUT_SAMPLE_SIZE;
+        if (!pool->queue_len)
+            xlplayer_pool_fill(pool);
+        if (pool->queue_len)
+            {
+            job = pool->queue[pool->queue_head];
+            pool->queue_head = (pool->queue_head + 1) % pool->max_players;
+            pool->queue_len--;
+            pthread_mutex_unlock(&pool->mutex);
+
+            job->pool_parked = FALSE;
+            job->want_space = 0;
+            threadstat_read(&usage);
+            if (!xlplayer_step(job))
+                {
+                job->pool_exited = TRUE;
+                xlplayer_command_complete(job);
+                }
+            threadstat_add(&job->threadstat, &usage);
+            job->watchdog_timer = 0;
 
-        jack_ringbuffer_read(self->left_ch, (char *)self->pbsrb_l, self->pbs_norm_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_l;
-        return self->pbs_norm_read_qty;
-        }
-    else
-        {
-        self->pbs_fade_read_qty = jack_ringbuffer_read_space(self->left_fade) / sizeof (sample_t);
-        if (self->pbs_fade_read_qty > PBSPEED_INPUT_SAMPLE_SIZE)
-            self->pbs_fade_read_qty = PBSPEED_INPUT_SAMPLE_SIZE;
+            pthread_mutex_lock(&pool->mutex);
+            job->pool_queued = FALSE;
+            pthread_cond_broadcast(&pool->turn_done_cv);
+            continue;
+            }
 
-        jack_ringbuffer_read(self->left_fade, (char *)self->pbsrb_lf, self->pbs_fade_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_lf;
-        return self->pbs_fade_read_qty;
+        /* nothing to do until a command or the jack callback posts */
+        pthread_mutex_unlock(&pool->mutex);
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += POOL_WAIT_NS) >= 1000000000)
+            {
+            ts.tv_nsec -= 1000000000;
+            ++ts.tv_sec;
+            }
+        sem_timedwait(&pool->wake_sem, &ts);
+        pthread_mutex_lock(&pool->mutex);
         }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
     }
 
-static long conv_r_read(void *cb_data, float **audiodata)
+struct xlplayer_pool *xlplayer_pool_create(const char *name, int n_workers, int max_players)
     {
-    struct xlplayer *self = (struct xlplayer *)cb_data;
+    struct xlplayer_pool *pool;
 
-    if (self->pbs_exchange == 0)
-        {
-        jack_ringbuffer_read(self->right_ch, (char *)self->pbsrb_r, self->pbs_norm_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_r;
-        return self->pbs_norm_read_qty;
-        }
-    else
+    if (!(pool = calloc(1, sizeof (struct xlplayer_pool))) || !(pool->name = strdup(name))
+                || !(pool->player = calloc(max_players, sizeof (struct xlplayer *)))
+                || !(pool->queue = calloc(max_players, sizeof (struct xlplayer *)))
+                || !(pool->worker = calloc(n_workers, sizeof (pthread_t))))
         {
-        jack_ringbuffer_read(self->right_fade, (char *)self->pbsrb_rf, self->pbs_fade_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_rf;
-        return self->pbs_fade_read_qty;
+        fprintf(stderr, "xlplayer_pool_create: malloc failure\n");
+        exit(5);
         }
+    pool->max_players = max_players;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->turn_done_cv, NULL);
+    sem_init(&pool->wake_sem, 0, 0);
+    for (; pool->n_workers < n_workers; pool->n_workers++)
+        if (pthread_create(&pool->worker[pool->n_workers], NULL, (void *(*)(void *))xlplayer_pool_worker, pool))
+            {
+            fprintf(stderr, "xlplayer_pool_create: failed to start a worker\n");
+            exit(5);
+            }
+    fprintf(stderr, "xlplayer_pool_create: %d %s decoding threads for up to %d players\n", n_workers, name, max_players);
+    return pool;
     }
 
-static long conv_lf_read(void *cb_data, float **audiodata)
+/* the players must have been destroyed first */
+void xlplayer_pool_destroy(struct xlplayer_pool *pool)
     {
-    struct xlplayer *self = (struct xlplayer *)cb_data;
-
-    if (self->pbs_exchange == 0)
-        {
-        self->pbs_fade_read_qty = jack_ringbuffer_read_space(self->left_fade) / sizeof (sample_t);
-        if (self->pbs_fade_read_qty > PBSPEED_INPUT_SAMPLE_SIZE)
-            self->pbs_fade_read_qty = PBSPEED_INPUT_SAMPLE_SIZE;
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->terminate = TRUE;
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->n_workers; ++i)
+        sem_post(&pool->wake_sem);
+    for (int i = 0; i < pool->n_workers; ++i)
+        pthread_join(pool->worker[i], NULL);
+    sem_destroy(&pool->wake_sem);
+    pthread_cond_destroy(&pool->turn_done_cv);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->worker);
+    free(pool->queue);
+    free(pool->player);
+    free(pool->name);
+    free(pool);
+    }
 
-        jack_ringbuffer_read(self->left_fade, (char *)self->pbsrb_lf, self->pbs_fade_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_lf;
-        return self->pbs_fade_read_qty;
-        }
-    else
+static void xlplayer_pool_add(struct xlplayer_pool *pool, struct xlplayer *self)
+    {
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->n_players == pool->max_players)
         {
-        self->pbs_norm_read_qty = jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t);
-        if (self->pbs_norm_read_qty > PBSPEED_INPUT_SAMPLE_SIZE)
-            self->pbs_norm_read_qty = PBSPEED_INPUT_SAMPLE_SIZE;
-
-        jack_ringbuffer_read(self->left_ch, (char *)self->pbsrb_l, self->pbs_norm_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_l;
-        return self->pbs_norm_read_qty;
+        fprintf(stderr, "xlplayer_pool_add: the %s pool is full\n", pool->name);
+        exit(5);
         }
+    pool->player[pool->n_players++] = self;
+    self->pool = pool;
+    pthread_mutex_unlock(&pool->mutex);
     }
-static long conv_rf_read(void *cb_data, float **audiodata)
+
+/* xlplayer_pool_remove: once the player has exited and its last turn is over */
+static void xlplayer_pool_remove(struct xlplayer *self)
     {
-    struct xlplayer *self = (struct xlplayer *)cb_data;
+    struct xlplayer_pool *pool = self->pool;
+    int i;
 
-    if (self->pbs_exchange == 0)
-        {
-        jack_ringbuffer_read(self->right_fade, (char *)self->pbsrb_rf, self->pbs_fade_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_rf;
-        return self->pbs_fade_read_qty;
-        }
-    else
-        {
-        jack_ringbuffer_read(self->right_ch, (char *)self->pbsrb_r, self->pbs_norm_read_qty * sizeof (sample_t));
-        *audiodata = self->pbsrb_r;
-        return self->pbs_norm_read_qty;
-        }
+    pthread_mutex_lock(&pool->mutex);
+    while (self->pool_queued)
+        pthread_cond_wait(&pool->turn_done_cv, &pool->mutex);
+    for (i = 0; i < pool->n_players && pool->player[i] != self; ++i);
+    if (i < pool->n_players)
+        pool->player[i] = pool->player[--pool->n_players];
+    pthread_mutex_unlock(&pool->mutex);
     }
 
-struct xlplayer *xlplayer_create(int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s)
+static struct xlplayer *xlplayer_new(struct xlplayer_pool *pool, int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s)
     {
     struct xlplayer *self;
     int error;
@@ -507,49 +1226,33 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
         fprintf(stderr, "xlplayer: malloc failure");
         exit(5);
         }
-    self->rbsize = (int)(duration * samplerate) << 2;
+    self->rbsize = (int)(duration * samplerate) * 2 * sizeof (sample_t);
     self->rbdelay = (int)(duration * 1000);
+    self->rb_high_mark = self->rbsize / 4 * 3;
+    self->rb_low_mark = self->rbsize / 2;
     self->samples_cutoff = samplerate * cutoff_s;
-    if (!(self->left_ch = jack_ringbuffer_create(self->rbsize)))
-        {
-        fprintf(stderr, "xlplayer: ringbuffer creation failure");
-        exit(5);
-        }
-    if (!(self->right_ch = jack_ringbuffer_create(self->rbsize)))
-        {
-        fprintf(stderr, "xlplayer: ringbuffer creation failure");
-        exit(5);
-        }
-    if (!(self->left_fade = jack_ringbuffer_create(self->rbsize)))
+    self->silence_threshold = XLP_SILENCE_THRESHOLD;
+    if (!(self->main_rb = jack_ringbuffer_create(self->rbsize)))
         {
         fprintf(stderr, "xlplayer: ringbuffer creation failure");
         exit(5);
         }
-    if (!(self->right_fade = jack_ringbuffer_create(self->rbsize)))
+    if (!(self->fade_rb = jack_ringbuffer_create(self->rbsize)))
         {
         fprintf(stderr, "xlplayer: ringbuffer creation failure");
         exit(5);
         }
-    if (!(self->pbspeed_conv_l = src_callback_new(conv_l_read, SRC_LINEAR, 1, &error, self)))
-        {
-        fprintf(stderr, "xlplayer: playback speed converter initialisation failure");
-        exit(5);
-        }
-    if (!(self->pbspeed_conv_r = src_callback_new(conv_r_read, SRC_LINEAR, 1, &error, self)))
-        {
-        fprintf(stderr, "xlplayer: playback speed converter initialisation failure");
-        exit(5);
-        }
-    if (!(self->pbspeed_conv_lf = src_callback_new(conv_lf_read, SRC_LINEAR, 1, &error, self)))
+    if (!(self->pbspeed_conv_l = src_new(SRC_LINEAR, 1, &error)))
         {
         fprintf(stderr, "xlplayer: playback speed converter initialisation failure");
         exit(5);
         }
-    if (!(self->pbspeed_conv_rf = src_callback_new(conv_rf_read, SRC_LINEAR, 1, &error, self)))
+    if (!(self->pbspeed_conv_r = src_new(SRC_LINEAR, 1, &error)))
         {
         fprintf(stderr, "xlplayer: playback speed converter initialisation failure");
         exit(5);
         }
+    self->newpbspeed = self->pbs_decode_ratio = self->pbs_read_ratio = 1.0f;
     if (pthread_mutex_init(&(self->dynamic_metadata.meta_mutex), NULL))
         {
         fprintf(stderr, "xlplayer: failed initialising metadata_mutex\n");
@@ -557,18 +1260,10 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
         }
     self->fadein = fade_init(samplerate, minlevel);
     self->fadeout = fade_init(samplerate, minlevel);
-    self->pbsrb_l = malloc(PBSPEED_INPUT_BUFFER_SIZE);
-    self->pbsrb_r = malloc(PBSPEED_INPUT_BUFFER_SIZE);
-    self->pbsrb_lf = malloc(PBSPEED_INPUT_BUFFER_SIZE);
-    self->pbsrb_rf = malloc(PBSPEED_INPUT_BUFFER_SIZE);
-    if (!(self->pbsrb_l && self->pbsrb_r && self->pbsrb_lf && self->pbsrb_rf))
-        {
-        fprintf(stderr, "xlplayer: playback speed converter input buffer initialisation failure\n");
-        exit(5);
-        }
     self->playername = playername;
     self->cf_l_gain = self->cf_r_gain = 1.0f;
-    self->seed = 17234;
+    for (int i = 0; i < 4; ++i)
+        self->dither_state[i] = 17234 + i * 0x9E3779B9U;
     self->samplerate = samplerate;
     self->jack_shutdown_f = shutdown_f;
     self->command = CMD_COMPLETE;
@@ -579,39 +1274,69 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
     smoothing_mute_init(&self->mute_aud, audmute_c);
     pthread_mutex_init(&self->command_mutex, NULL);
     pthread_cond_init(&self->command_cv, NULL);
+    pthread_cond_init(&self->command_done_cv, NULL);
+    sem_init(&self->space_sem, 0, 0);
+    sem_init(&self->data_sem, 0, 0);
+    if (pool)
+        {
+        self->up = TRUE;
+        xlplayer_pool_add(pool, self);
+        return self;
+        }
     pthread_create(&self->thread, NULL, (void *(*)(void *)) xlplayer_main, self);
     while (self->up == FALSE)
         usleep(10000);
     return self;
     }
 
+struct xlplayer *xlplayer_create(int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s)
+    {
+    return xlplayer_new(NULL, samplerate, duration, playername, shutdown_f, vol_c, vol_scale, strmute_c, audmute_c, cutoff_s);
+    }
+
+struct xlplayer *xlplayer_create_pooled(struct xlplayer_pool *pool, int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s)
+    {
+    return xlplayer_new(pool, samplerate, duration, playername, shutdown_f, vol_c, vol_scale, strmute_c, audmute_c, cutoff_s);
+    }
+
 void xlplayer_destroy(struct xlplayer *self)
     {
     if (self)
         {
         xlplayer_command(self, CMD_CLEANUP);
-        pthread_join(self->thread, NULL);
+        if (self->pool)
+            xlplayer_pool_remove(self);
+        else
+            pthread_join(self->thread, NULL);
+        xlplayer_destroy(self->relay_source);
+        xlplayer_destroy(self->preloader);
+        xlplayer_destroy(self->preload_spare);
+        free(self->preload_pathname);
         pthread_cond_destroy(&self->command_cv);
+        pthread_cond_destroy(&self->command_done_cv);
+        sem_destroy(&self->space_sem);
+        sem_destroy(&self->data_sem);
         pthread_mutex_destroy(&self->command_mutex);
+        free(self->pending.pathname);
+        free(self->async_pathname);
         pthread_mutex_destroy(&(self->dynamic_metadata.meta_mutex));
+        free(self->leftbuffer);
+        free(self->rightbuffer);
+        free(self->gainbuffer);
         ifree(self->lcb);
         ifree(self->rcb);
         ifree(self->lcfb);
         ifree(self->rcfb);
-        free(self->pbsrb_l);
-        free(self->pbsrb_r);
-        free(self->pbsrb_lf);
-        free(self->pbsrb_rf);
+        free(self->pbs_out_l);
+        free(self->pbs_out_r);
+        ifree(self->pbs_hist_l);
+        ifree(self->pbs_hist_r);
         fade_destroy(self->fadein);
         fade_destroy(self->fadeout);
         src_delete(self->pbspeed_conv_l);
         src_delete(self->pbspeed_conv_r);
-        src_delete(self->pbspeed_conv_lf);
-        src_delete(self->pbspeed_conv_rf);
-        jack_ringbuffer_free(self->left_ch);
-        jack_ringbuffer_free(self->right_ch);
-        jack_ringbuffer_free(self->left_fade);
-        jack_ringbuffer_free(self->right_fade);
+        jack_ringbuffer_free(self->main_rb);
+        jack_ringbuffer_free(self->fade_rb);
         free(self);
         }
     }
@@ -623,7 +1348,7 @@ int xlplayer_play(struct xlplayer *self, char *pathname, int seek_s, int size, f
     self->gain = pow(10.0, gain_db / 20.0);
     self->seek_s = seek_s;
     self->size = size;
-    self->id = 1 << id;
+    self->id = (uint64_t)1 << id;
     self->loop = FALSE;
     self->usedelay = FALSE;
     self->playlistmode = FALSE;
@@ -631,6 +1356,88 @@ int xlplayer_play(struct xlplayer *self, char *pathname, int seek_s, int size, f
     return self->initial_audio_context;
     }
 
+int xlplayer_play_async(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db, int id)
+    {
+    struct xlplayer_pending *p = &self->pending;
+    int context;
+
+    xlplayer_command_wait(self);
+    if (!(p->pathname = strdup(pathname)))
+        {
+        fprintf(stderr, "xlplayer: malloc failure\n");
+        exit(5);
+        }
+    p->gain = pow(10.0, gain_db / 20.0);
+    p->seek_s = seek_s;
+    p->size = size;
+    self->id = (uint64_t)1 << id;
+    self->loop = FALSE;
+    self->usedelay = FALSE;
+    self->playlistmode = FALSE;
+
+    /* an odd context will be bumped by the eject and both by the start */
+    context = self->current_audio_context;
+    context += (context & 0x1) ? 2 : 1;
+
+    if (!self->fadeout_f)
+        xlplayer_pause(self);
+    xlplayer_command_async(self, CMD_EJECTPLAY);
+    return context;
+    }
+
+void xlplayer_preload(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db)
+    {
+    struct xlplayer *pl, *old;
+    char *copy;
+
+    if (!(copy = strdup(pathname)))
+        {
+        fprintf(stderr, "xlplayer: malloc failure\n");
+        exit(5);
+        }
+
+    /* out of reach of the player thread while it is set up */
+    pthread_mutex_lock(&self->command_mutex);
+    if ((pl = self->preloader))
+        self->preloader = NULL;
+    else if ((pl = self->preload_spare))
+        self->preload_spare = NULL;
+    free(self->preload_pathname);
+    self->preload_pathname = NULL;
+    pthread_mutex_unlock(&self->command_mutex);
+
+    /* a second of audio at least so a player with a short ringbuffer can relay it */
+    if (!pl)
+        {
+        pl = xlplayer_create(self->samplerate, fmax(self->rbdelay / 2000.0, PRELOAD_MIN_S), self->playername,
+                                self->jack_shutdown_f, NULL, 0.0f, NULL, NULL, 0.0f);
+        pl->headless = TRUE;
+        }
+
+    /* decode exactly as the player itself would */
+    pl->fade_mode = self->fade_mode;
+    pl->dither = self->dither;
+    pl->rsqual = self->rsqual;
+    pl->silence_threshold = self->silence_threshold;
+    pl->resampler = self->resampler;
+    xlplayer_play_async(pl, pathname, seek_s, size, gain_db, 0);
+
+    pthread_mutex_lock(&self->command_mutex);
+    /* a relayed track may have ended in the meantime and given its preloader back */
+    if ((old = self->preloader) && !self->preload_spare)
+        {
+        self->preload_spare = old;
+        old = NULL;
+        }
+    self->preloader = pl;
+    self->preload_pathname = copy;
+    self->preload_seek_s = seek_s;
+    self->preload_gain = pow(10.0, gain_db / 20.0);
+    self->preload_fade_mode = self->fade_mode;
+    pthread_mutex_unlock(&self->command_mutex);
+    xlplayer_destroy(old);
+    }
+
 int xlplayer_playmany(struct xlplayer *self, char *playlist, int loop_f)
     {
     char *start = playlist, *end;
@@ -683,7 +1490,7 @@ int xlplayer_play_noflush(struct xlplayer *self, char *pathname, int seek_s, int
     self->gain = pow(10.0, gain_db / 20.0);
     self->seek_s = seek_s;
     self->size = size;
-    self->id = 1 << id;
+    self->id = (uint64_t)1 << id;
     self->loop = FALSE;
     self->playlistmode = FALSE;
     xlplayer_command(self, CMD_PLAY);
@@ -713,6 +1520,12 @@ void xlplayer_eject(struct xlplayer *self)
     xlplayer_command(self, CMD_EJECT);
     }
 
+/* xlplayer_set_silence_threshold: the level in dBFS below which audio counts towards the trailing silence */
+void xlplayer_set_silence_threshold(struct xlplayer *self, float db)
+    {
+    self->silence_threshold = (db < 0.0f) ? powf(10.0f, db / 20.0f) : XLP_SILENCE_THRESHOLD;
+    }
+
 void xlplayer_set_fadesteps(struct xlplayer *self, int fade_mode)
     {
     static float a[] = {1.0f, 5.0f, 10.0f, 0.1f, 0.05f};
@@ -721,87 +1534,157 @@ void xlplayer_set_fadesteps(struct xlplayer *self, int fade_mode)
     fade_set(self->fadein, FADE_SET_SAME, b[fade_mode], FADE_DIRECTION_UNCHANGED);
     }
 
-/* version supporting playback speed variance */
-size_t read_from_player_sv(struct xlplayer *self, sample_t *left_buf, sample_t *right_buf, sample_t *left_fbuf, sample_t *right_fbuf, jack_nframes_t nframes)
+/* the jack callback's part of a flush, the audio goes over to the fade buffer unless paused */
+static void xlplayer_jack_flush(struct xlplayer *self)
     {
     jack_ringbuffer_t *swap;
-    SRC_STATE *pbs_swap;
-    float *pbsrb_swap;
-    size_t todo = 0, ftodo = 0;
 
-    if (self->jack_flush)
+    if (self->noflush == FALSE)
         {
-        if (self->noflush == FALSE)
+        if (self->pause == 0)
             {
-            if (self->pause == 0)
-                {
-                /* perform the exchange of handles for the purpose of fading out the remaining buffer contents */
-                /* exchange speed converter handles */
-                pbs_swap = self->pbspeed_conv_l;
-                self->pbspeed_conv_l = self->pbspeed_conv_lf;
-                self->pbspeed_conv_lf = pbs_swap;
-                pbs_swap = self->pbspeed_conv_r;
-                self->pbspeed_conv_r = self->pbspeed_conv_rf;
-                self->pbspeed_conv_rf = pbs_swap;
-                /* exchange speed converter input buffers */
-                pbsrb_swap = self->pbsrb_l;
-                self->pbsrb_l = self->pbsrb_lf;
-                self->pbsrb_lf = pbsrb_swap;
-                pbsrb_swap = self->pbsrb_r;
-                self->pbsrb_r = self->pbsrb_rf;
-                self->pbsrb_rf = pbsrb_swap;
-                self->pbs_exchange = !self->pbs_exchange;
-                /* exchange ring buffers */
-                swap = self->left_ch;
-                self->left_ch = self->left_fade;
-                self->left_fade = swap;
-                swap = self->right_ch;
-                self->right_ch = self->right_fade;
-                self->right_fade = swap;
-                /* initialisations for fade */
-                fade_set(self->fadeout, FADE_SET_HIGH, -1.0f, FADE_OUT);
-                }
-            /* buffer flushing */
-            src_reset(self->pbspeed_conv_l);
-            src_reset(self->pbspeed_conv_r);
-            jack_ringbuffer_reset(self->left_ch);
-            jack_ringbuffer_reset(self->right_ch);
+            swap = self->main_rb;
+            self->main_rb = self->fade_rb;
+            self->fade_rb = swap;
+            fade_set(self->fadeout, FADE_SET_HIGH, -1.0f, FADE_OUT);
             }
-        self->jack_is_flushed = 1;
-        self->jack_flush = 0;
-        self->pause = 0;
+        jack_ringbuffer_reset(self->main_rb);
+        /* the speed markers went with the audio */
+        __atomic_store_n(&self->pbs_marker_r, __atomic_load_n(&self->pbs_marker_w, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        self->pbs_frames_out = 0;
+        self->pbs_have = 0;
+        self->pbs_phase = 0.0;
         }
+    self->jack_is_flushed = 1;
+    self->jack_flush = 0;
+    self->pause = 0;
+    }
 
-    if (self->pause == 0)
+/* xlplayer_pbs_markers: pick up the speed of the audio about to be read */
+static void xlplayer_pbs_markers(struct xlplayer *self)
+    {
+    unsigned r = self->pbs_marker_r, w = __atomic_load_n(&self->pbs_marker_w, __ATOMIC_ACQUIRE);
+
+    while (r != w && self->pbs_markers[r % PBS_MARKERS].frame <= self->pbs_frames_out)
+        self->pbs_read_ratio = self->pbs_markers[r++ % PBS_MARKERS].ratio;
+    __atomic_store_n(&self->pbs_marker_r, r, __ATOMIC_RELEASE);
+    }
+
+/* xlplayer_pbs_correct: stretch the buffered audio by step by linear interpolation
+ * this covers a speed change until audio decoded at the new speed comes through
+ * return value: the number of frames made
+ */
+static size_t xlplayer_pbs_correct(struct xlplayer *self, sample_t *left_buf, sample_t *right_buf, jack_nframes_t nframes, double step)
+    {
+    sample_t *hl = self->pbs_hist_l, *hr = self->pbs_hist_r;
+    size_t drop = (size_t)self->pbs_phase, need, n, m, i, idx;
+    float f;
+
+    /* frames already passed over are let go */
+    if (drop > self->pbs_have)
+        drop = self->pbs_have;
+    if (drop)
         {
-        if (self->pbspeed != self->newpbspeed)
+        self->pbs_have -= drop;
+        memmove(hl, hl + drop, self->pbs_have * sizeof (sample_t));
+        memmove(hr, hr + drop, self->pbs_have * sizeof (sample_t));
+        self->pbs_phase -= drop;
+        }
+
+    if (step == 1.0)
+        {
+        /* back in step: a jump of up to half a sample and what is held back goes out as it is */
+        if (self->pbs_phase >= 0.5 && self->pbs_have)
             {
-            self->pbspeed = self->newpbspeed;
-            src_set_ratio(self->pbspeed_conv_l, self->pbspeed);    /* bug workaround for libsamplerate 0.1.2 */
-            src_set_ratio(self->pbspeed_conv_r, self->pbspeed);
-            src_set_ratio(self->pbspeed_conv_lf, self->pbspeed);
-            src_set_ratio(self->pbspeed_conv_rf, self->pbspeed);
+            --self->pbs_have;
+            memmove(hl, hl + 1, self->pbs_have * sizeof (sample_t));
+            memmove(hr, hr + 1, self->pbs_have * sizeof (sample_t));
             }
-        /* the number of samples in the ring buffer used when calculating play progress */
-        /* samples stored in the resampler are not worth the bother of accounting for */
-        for(;;) {
-            self->avail = jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t);
-            if (self->playmode != PM_STOPPED && self->avail < nframes * 4 + 160 && g.freewheel)
-                usleep(100);
-            else
-                break;
+        self->pbs_phase = 0.0;
+        n = (self->pbs_have > nframes) ? nframes : self->pbs_have;
+        memcpy(left_buf, hl, n * sizeof (sample_t));
+        memcpy(right_buf, hr, n * sizeof (sample_t));
+        self->pbs_have -= n;
+        memmove(hl, hl + n, self->pbs_have * sizeof (sample_t));
+        memmove(hr, hr + n, self->pbs_have * sizeof (sample_t));
+        m = nframes - n;
+        if (m > self->avail)
+            m = self->avail;
+        xlp_rb_read(self->main_rb, left_buf + n, right_buf + n, m);
+        self->pbs_frames_out += m;
+        return n + m;
+        }
+
+    need = (size_t)(self->pbs_phase + (nframes - 1) * step) + 2;
+    if (need > self->pbs_hist_cap)
+        need = self->pbs_hist_cap;
+    if (need > self->pbs_have)
+        {
+        n = need - self->pbs_have;
+        if (n > self->avail)
+            n = self->avail;
+        xlp_rb_read(self->main_rb, hl + self->pbs_have, hr + self->pbs_have, n);
+        self->pbs_have += n;
+        self->pbs_frames_out += n;
+        }
+
+    for (i = 0; i < nframes; ++i)
+        {
+        idx = (size_t)self->pbs_phase;
+        if (idx + 1 >= self->pbs_have)
+            break;
+        f = self->pbs_phase - idx;
+        left_buf[i] = hl[idx] + f * (hl[idx + 1] - hl[idx]);
+        right_buf[i] = hr[idx] + f * (hr[idx + 1] - hr[idx]);
+        self->pbs_phase += step;
         }
+    return i;
+    }
+
+/* version supporting playback speed variance
+ * the decoder applies the speed so this is a plain copy unless the speed has just changed
+ */
+size_t read_from_player_sv(struct xlplayer *self, sample_t *left_buf, sample_t *right_buf, sample_t *left_fbuf, sample_t *right_fbuf, jack_nframes_t nframes)
+    {
+    size_t todo = 0, favail, ftodo;
+    double step = 1.0;
+
+    if (self->jack_flush)
+        xlplayer_jack_flush(self);
+
+    if (self->pause == 0)
+        {
+        xlplayer_pbs_markers(self);
+        if (self->newpbspeed > 0.0f && self->pbs_read_ratio != self->newpbspeed)
+            {
+            step = (double)self->pbs_read_ratio / self->newpbspeed;
+            if (step > PBS_MAX_STEP)
+                step = PBS_MAX_STEP;
+            if (step < 1.0 / PBS_MAX_STEP)
+                step = 1.0 / PBS_MAX_STEP;
+            }
+
+        if (g.freewheel)
+            xlplayer_wait_data(self, nframes * step + 2);
+        self->avail = xlp_rb_frames(self->main_rb);
+
+        if (step == 1.0 && self->pbs_have == 0)
+            {
+            todo = (self->avail > nframes) ? nframes : self->avail;
+            xlp_rb_read(self->main_rb, left_buf, right_buf, todo);
+            self->pbs_frames_out += todo;
+            }
+        else
+            todo = xlplayer_pbs_correct(self, left_buf, right_buf, nframes, step);
+        memset(left_buf + todo, 0, (nframes - todo) * sizeof (sample_t));
+        memset(right_buf + todo, 0, (nframes - todo) * sizeof (sample_t));
 
-        /* read data from playback speed resampler */
-        todo = src_callback_read(self->pbspeed_conv_l, self->pbspeed, nframes, left_buf);
-        src_callback_read(self->pbspeed_conv_r, self->pbspeed, todo, right_buf);
-        memset(left_buf + self->avail, 0, (nframes - todo) * sizeof (sample_t));
-        memset(right_buf + self->avail, 0, (nframes - todo) * sizeof (sample_t));
-        /* read fade data from playback speed resampler */
+        /* the fade out plays on at the speed it was decoded at */
         if (left_fbuf && right_fbuf)
             {
-            ftodo = src_callback_read(self->pbspeed_conv_lf, self->pbspeed, nframes, left_fbuf);
-            src_callback_read(self->pbspeed_conv_rf, self->pbspeed, ftodo, right_fbuf);
+            favail = xlp_rb_frames(self->fade_rb);
+            ftodo = (favail > nframes) ? nframes : favail;
+            xlp_rb_read(self->fade_rb, left_fbuf, right_fbuf, ftodo);
             memset(left_fbuf + ftodo, 0, (nframes - ftodo) * sizeof (sample_t));
             memset(right_fbuf + ftodo, 0, (nframes - ftodo) * sizeof (sample_t));
             }
@@ -818,60 +1701,37 @@ size_t read_from_player_sv(struct xlplayer *self, sample_t *left_buf, sample_t *
             }
         }
     xlplayer_update_progress_time_ms(self);
+    xlplayer_signal_space(self);
     return todo;
     }
 
 /* version not supporting playback speed variance but uses less CPU */
 size_t read_from_player(struct xlplayer *self, sample_t *left_buf, sample_t *right_buf, sample_t *left_fbuf, sample_t *right_fbuf, jack_nframes_t nframes)
     {
-    jack_ringbuffer_t *swap;
     size_t todo, favail, ftodo;
 
     if (self->jack_flush)
-        {
-        if (self->noflush == FALSE)
-            {
-            if (self->pause == 0)
-                {
-                swap = self->left_ch;
-                self->left_ch = self->left_fade;
-                self->left_fade = swap;
-                swap = self->right_ch;
-                self->right_ch = self->right_fade;
-                self->right_fade = swap;
-                fade_set(self->fadeout, FADE_SET_HIGH, -1.0f, FADE_OUT);
-                }
-            jack_ringbuffer_reset(self->left_ch);
-            jack_ringbuffer_reset(self->right_ch);
-            }
-        self->jack_is_flushed = 1;
-        self->jack_flush = 0;
-        self->pause = 0;
-        }
-
-    for(;;) {
-        self->avail = jack_ringbuffer_read_space(self->right_ch) / sizeof (sample_t);
-        todo = (self->avail > nframes ? nframes : self->avail);
-        favail = jack_ringbuffer_read_space(self->right_fade) / sizeof (sample_t);
-        ftodo = (favail > nframes ? nframes : favail);
-        if (self->playmode != PM_STOPPED && todo < nframes && g.freewheel)
-            usleep(100);
-        else
-            break;
-    }
+        xlplayer_jack_flush(self);
+
+    if (g.freewheel)
+        xlplayer_wait_data(self, nframes);
+    self->avail = xlp_rb_frames(self->main_rb);
+    todo = (self->avail > nframes ? nframes : self->avail);
+    favail = xlp_rb_frames(self->fade_rb);
+    ftodo = (favail > nframes ? nframes : favail);
 
     if (self->pause == 0)
         {
         /* fill the frame with whatever data is available, then pad as needed with zeroes */
-        jack_ringbuffer_read(self->left_ch, (char *)left_buf, todo * sizeof (sample_t));
+        xlp_rb_read(self->main_rb, left_buf, right_buf, todo);
+        self->pbs_frames_out += todo;
+        xlplayer_pbs_markers(self);
         memset(left_buf + todo, 0, (nframes - todo) * sizeof (sample_t));
-        jack_ringbuffer_read(self->right_ch, (char *)right_buf, todo * sizeof (sample_t));
         memset(right_buf + todo, 0, (nframes - todo) * sizeof (sample_t));
         if (left_fbuf && right_fbuf)
             {
-            jack_ringbuffer_read(self->left_fade, (char *)left_fbuf, ftodo * sizeof (sample_t));
+            xlp_rb_read(self->fade_rb, left_fbuf, right_fbuf, ftodo);
             memset(left_fbuf + ftodo, 0, (nframes - ftodo) * sizeof (sample_t));
-            jack_ringbuffer_read(self->right_fade, (char *)right_fbuf, ftodo * sizeof (sample_t));
             memset(right_fbuf + ftodo, 0, (nframes - ftodo) * sizeof (sample_t));
             }
         if (!(self->have_data_f = todo > 0) && self->command == CMD_COMPLETE && self->playmode == PM_STOPPED)
@@ -888,12 +1748,13 @@ size_t read_from_player(struct xlplayer *self, sample_t *left_buf, sample_t *rig
             }
         }
     xlplayer_update_progress_time_ms(self);
+    xlplayer_signal_space(self);
     return (todo > ftodo) ? todo : ftodo;
     }
 
 int xlplayer_calc_rbdelay(struct xlplayer *xlplayer)
     {
-    return jack_ringbuffer_read_space(xlplayer->left_ch) * 1000 / (sizeof (sample_t) * xlplayer->samplerate);
+    return xlp_rb_frames(xlplayer->main_rb) * 1000 / xlplayer->samplerate;
     }
 
 void xlplayer_set_dynamic_metadata(struct xlplayer *xlplayer, enum metadata_t type, char *artist, char *title, char *album, int delay)
@@ -916,12 +1777,44 @@ void xlplayer_set_dynamic_metadata(struct xlplayer *xlplayer, enum metadata_t ty
     pthread_mutex_unlock(&(dm->meta_mutex));
     }
 
-void xlplayer_buffer_alloc(struct xlplayer *self, jack_nframes_t nframes)
+/* room for the correction stage to read ahead at the widest stretch */
+static size_t xlplayer_pbs_hist_frames(jack_nframes_t nframes)
+    {
+    return (size_t)(nframes * PBS_MAX_STEP) + 4;
+    }
+
+void xlplayer_buffer_reserve(struct xlplayer *self, jack_nframes_t nframes)
     {
+    if (nframes <= self->buf_frames_cap)
+        return;
     self->lcb = irealloc(self->lcb, nframes);
     self->rcb = irealloc(self->rcb, nframes);
     self->lcfb = irealloc(self->lcfb, nframes);
     self->rcfb = irealloc(self->rcfb, nframes);
+    self->pbs_hist_l = irealloc(self->pbs_hist_l, xlplayer_pbs_hist_frames(nframes));
+    self->pbs_hist_r = irealloc(self->pbs_hist_r, xlplayer_pbs_hist_frames(nframes));
+    self->buf_frames_cap = nframes;
+    }
+
+void xlplayer_buffer_alloc(struct xlplayer *self, jack_nframes_t nframes)
+    {
+    if (nframes > self->buf_frames_cap)
+        {
+        if (self->buf_frames_cap)
+            fprintf(stderr, "xlplayer_buffer_alloc: %s: period of %u frames is over the %u reserved\n",
+                        self->playername, (unsigned)nframes, (unsigned)self->buf_frames_cap);
+        xlplayer_buffer_reserve(self, nframes);
+        }
+    /* the history only holds what the current period size needs */
+    self->pbs_hist_cap = xlplayer_pbs_hist_frames(nframes);
+    self->pbs_have = 0;
+    self->pbs_phase = 0.0;
+    }
+
+void xlplayer_buffer_reserve_all(struct xlplayer **list, jack_nframes_t nframes)
+    {
+    while (*list)
+        xlplayer_buffer_reserve(*list++, nframes);
     }
 
 void xlplayer_buffer_alloc_all(struct xlplayer **list, jack_nframes_t nframes)
@@ -944,6 +1837,14 @@ size_t xlplayer_read_start(struct xlplayer *self, jack_nframes_t nframes)
     else
         samples_read = read_from_player(self, self->lcb, self->rcb, self->lcfb, self->rcfb, nframes);
 
+    /* only while decoding, the final drain of the ringbuffer is no underrun */
+    if (self->playmode == PM_PLAYING)
+        {
+        rbstat_sample(&self->rb_stats, self->avail, self->main_rb->size / (2 * sizeof (sample_t)));
+        if (self->avail < nframes && !self->pause)
+            rbstat_underrun(&self->rb_stats);
+        }
+
     return samples_read;
     }
 
@@ -975,12 +1876,104 @@ void xlplayer_read_next_all(struct xlplayer **list)
         xlplayer_read_next(*list++);
     }
 
+/* xlplayer_read_next_block: as xlplayer_read_next for n_frames samples at once
+ * the results go to ls and rs rather than self->ls and self->rs
+ */
+void xlplayer_read_next_block(struct xlplayer *self, float *ls, float *rs, int n_frames)
+    {
+    float fade_level, fade[64], abs, peak = self->peak;
+    const float *lcp = self->lcp, *rcp = self->rcp, *lcfp = self->lcfp, *rcfp = self->rcfp;
+    int i, j, n;
+
+    for (i = 0; i < n_frames; i++)
+        {
+        if ((abs = fabsf(lcp[i])) > peak)
+            peak = abs;
+        if ((abs = fabsf(rcp[i])) > peak)
+            peak = abs;
+        }
+
+    if (fade_idle(self->fadeout, &fade_level))
+        {
+        /* the fade buffer is silent or mixed at a fixed level */
+        if (fade_level == 0.0f)
+            {
+            memcpy(ls, lcp, n_frames * sizeof (float));
+            memcpy(rs, rcp, n_frames * sizeof (float));
+            }
+        else
+            for (i = 0; i < n_frames; i++)
+                {
+                ls[i] = lcp[i] + lcfp[i] * fade_level;
+                rs[i] = rcp[i] + rcfp[i] * fade_level;
+                }
+        }
+    else
+        for (i = 0; i < n_frames; i += n)
+            {
+            n = (n_frames - i > 64) ? 64 : n_frames - i;
+            fade_get_block(self->fadeout, fade, n);
+            for (j = 0; j < n; j++)
+                {
+                ls[i + j] = lcp[i + j] + lcfp[i + j] * fade[j];
+                rs[i + j] = rcp[i + j] + rcfp[i + j] * fade[j];
+                }
+            }
+
+    self->lcp += n_frames;
+    self->rcp += n_frames;
+    self->lcfp += n_frames;
+    self->rcfp += n_frames;
+    self->peak = peak;
+    if (n_frames > 0)
+        {
+        self->ls = ls[n_frames - 1];
+        self->rs = rs[n_frames - 1];
+        }
+    }
+
+/* xlplayer_levels_block: as xlplayer_levels over a block with the gains ramped
+ * from where the last block left them so changes are spread across the block
+ * scale is a further gain for both mixes such as the effects headroom
+ * ls_aud and rs_aud may be NULL when the dj mix is not wanted
+ */
+void xlplayer_levels_block(struct xlplayer *self, const float *ls, const float *rs, int n_frames, float scale,
+                            float *restrict ls_aud, float *restrict rs_aud, float *restrict ls_str, float *restrict rs_str)
+    {
+    const float lg_aud = self->lg_aud * scale, rg_aud = self->rg_aud * scale;
+    const float lg_str = self->lg_str * scale, rg_str = self->rg_str * scale;
+    const float l0_aud = self->lg_aud_from, r0_aud = self->rg_aud_from;
+    const float l0_str = self->lg_str_from, r0_str = self->rg_str_from;
+    const float inv_n = 1.0f / n_frames;
+    const float dl_aud = (lg_aud - l0_aud) * inv_n, dr_aud = (rg_aud - r0_aud) * inv_n;
+    const float dl_str = (lg_str - l0_str) * inv_n, dr_str = (rg_str - r0_str) * inv_n;
+    int i;
+
+    if (ls_aud)
+        for (i = 0; i < n_frames; i++)
+            {
+            ls_aud[i] = ls[i] * (l0_aud + dl_aud * (i + 1));
+            rs_aud[i] = rs[i] * (r0_aud + dr_aud * (i + 1));
+            }
+
+    for (i = 0; i < n_frames; i++)
+        {
+        ls_str[i] = ls[i] * (l0_str + dl_str * (i + 1));
+        rs_str[i] = rs[i] * (r0_str + dr_str * (i + 1));
+        }
+
+    self->lg_aud_from = lg_aud;
+    self->rg_aud_from = rg_aud;
+    self->lg_str_from = lg_str;
+    self->rg_str_from = rg_str;
+    }
+
 void xlplayer_levels(struct xlplayer *self)
     {
-    self->ls_aud = self->ls * self->volume.level * self->mute_aud.level * (self->cf_aud ? self->cf_l_gain : 1.0f);
-    self->rs_aud = self->rs * self->volume.level * self->mute_aud.level * (self->cf_aud ? self->cf_r_gain : 1.0f);
-    self->ls_str = self->ls * self->volume.level * self->mute_str.level * self->cf_l_gain;
-    self->rs_str = self->rs * self->volume.level * self->mute_str.level * self->cf_r_gain;
+    self->ls_aud = self->ls * self->lg_aud;
+    self->rs_aud = self->rs * self->rg_aud;
+    self->ls_str = self->ls * self->lg_str;
+    self->rs_str = self->rs * self->rg_str;
     }
 
 void xlplayer_levels_all(struct xlplayer **list)
@@ -996,43 +1989,59 @@ void xlplayer_smoothing_process(struct xlplayer *self)
     smoothing_mute_process(&self->mute_aud);
     }
 
+void xlplayer_gains_update(struct xlplayer *self)
+    {
+    const float v = self->volume.level;
+
+    self->lg_aud = v * self->mute_aud.level * (self->cf_aud ? self->cf_l_gain : 1.0f);
+    self->rg_aud = v * self->mute_aud.level * (self->cf_aud ? self->cf_r_gain : 1.0f);
+    self->lg_str = v * self->mute_str.level * self->cf_l_gain;
+    self->rg_str = v * self->mute_str.level * self->cf_r_gain;
+    }
+
+void xlplayer_gains_update_all(struct xlplayer **list)
+    {
+    while (*list)
+        xlplayer_gains_update(*list++);
+    }
+
+void xlplayer_smoothing_settle(struct xlplayer *self)
+    {
+    smoothing_volume_settle(&self->volume);
+    smoothing_mute_settle(&self->mute_str);
+    smoothing_mute_settle(&self->mute_aud);
+    xlplayer_gains_update(self);
+    }
+
+int xlplayer_idle(struct xlplayer *self)
+    {
+    return !self->have_data_f && self->command == CMD_COMPLETE && self->playmode == PM_STOPPED
+                && !self->jack_flush && !xlp_rb_frames(self->fade_rb);
+    }
+
+int xlplayer_buffered(struct xlplayer *self, jack_nframes_t nframes)
+    {
+    return self->playmode != PM_PLAYING || self->pause || xlp_rb_frames(self->main_rb) >= nframes;
+    }
+
 void xlplayer_smoothing_process_all(struct xlplayer **list)
     {
     while (*list)
         xlplayer_smoothing_process(*list++);
     }
 
-void xlplayer_stats(struct xlplayer *self)
+/* xlplayer_stats_metadata: report metadata changes which are text whichever form the stats take */
+void xlplayer_stats_metadata(struct xlplayer *self)
     {
-    char prefix[20];
     struct xlp_dynamic_metadata *dm = &self->dynamic_metadata;
 
-    snprintf(prefix, 20, "%s_", self->playername);
-    #define PREFIX() fputs(prefix, g.out)
-
-    PREFIX();
-    fprintf(g.out, "elapsed=%d\n", self->play_progress_ms / 1000);
-    PREFIX();
-    fprintf(g.out, "playing=%d\n", self->have_data_f | (self->current_audio_context & 0x1));
-    PREFIX();
-    fprintf(g.out, "signal=%d\n", self->peak > 0.001F || self->peak < 0.0F || self->pause);
-    PREFIX();
-    fprintf(g.out, "cid=%d\n", self->current_audio_context);
-    PREFIX();
-    fprintf(g.out, "audio_runout=%d\n", self->avail < self->samples_cutoff && (!(self->current_audio_context & 0x1)));
-    PREFIX();
-    fprintf(g.out, "silence=%f\n", self->silence);
-
-    self->peak = 0.0f;
-
     if (dm->data_type)
         {
         pthread_mutex_lock(&(dm->meta_mutex));
         fprintf(stderr, "new dynamic metadata\n");
         if (dm->data_type != DM_JOINED_UC)
             {
-            PREFIX();
-            fprintf(g.out, "new_metadata=d%d:%dd%d:%sd%d:%sd%d:%sd9:%09dd9:%09dx\n", (int)log10(dm->data_type) + 1, dm->data_type, (int)strlen(dm->artist), dm->artist, (int)strlen(dm->title), dm->title, (int)strlen(dm->album), dm->album, dm->current_audio_context, dm->rbdelay);
+            fprintf(g.out, "%s_new_metadata=d%d:%dd%d:%sd%d:%sd%d:%sd9:%09dd9:%09dx\n", self->playername, (int)log10(dm->data_type) + 1, dm->data_type, (int)strlen(dm->artist), dm->artist, (int)strlen(dm->title), dm->title, (int)strlen(dm->album), dm->album, dm->current_audio_context, dm->rbdelay);
             }
         else
             {
@@ -1041,12 +2050,94 @@ void xlplayer_stats(struct xlplayer *self)
         dm->data_type = DM_NONE_NEW;
         pthread_mutex_unlock(&(dm->meta_mutex));
         }
+    }
+
+/* xlplayer_stats: append the stats to out, leaving out those unchanged since last time when delta is set */
+void xlplayer_stats(struct xlplayer *self, GString *out, int delta)
+    {
+    struct levels_player lp, *last = &self->stats_sent;
+
+    xlplayer_stats_binary(self, &lp);
+    delta = delta && self->stats_sent_valid;
+
+    #define STAT(field, fmt) if (!delta || lp.field != last->field) \
+                g_string_append_printf(out, "%s_" #field "=" fmt "\n", self->playername, lp.field)
+
+    STAT(elapsed, "%d");
+    STAT(playing, "%d");
+    STAT(signal, "%d");
+    STAT(cid, "%d");
+    STAT(audio_runout, "%d");
+    STAT(silence, "%f");
+
+    #undef STAT
+
+    *last = lp;
+    self->stats_sent_valid = TRUE;
+    xlplayer_stats_metadata(self);
+    }
+
+/* xlplayer_stats_binary: the same stats as xlplayer_stats in the binary report layout
+ * metadata is left for xlplayer_stats_metadata so this is safe to call from the real time thread
+ */
+void xlplayer_stats_binary(struct xlplayer *self, struct levels_player *lp)
+    {
+    memset(lp->name, 0, sizeof lp->name);
+    strncpy(lp->name, self->playername, sizeof lp->name - 1);
+    lp->elapsed = self->play_progress_ms / 1000;
+    lp->playing = self->have_data_f | (self->current_audio_context & 0x1);
+    lp->signal = self->peak > 0.001F || self->peak < 0.0F || self->pause;
+    lp->cid = self->current_audio_context;
+    lp->audio_runout = self->avail < self->samples_cutoff && (!(self->current_audio_context & 0x1));
+    lp->silence = self->silence;
+
+    self->peak = 0.0f;
+    }
 
-    #undef PREFIX
+void xlplayer_stats_all(struct xlplayer **list, GString *out, int delta)
+    {
+    while (*list)
+        xlplayer_stats(*list++, out, delta);
+    }
+
+/* xlplayer_make_report: the player thread's cpu%:voluntary/s:involuntary/s:wakeups/s
+ * and the ringbuffer's min:avg:max:high water mark:underruns:overruns
+ */
+void xlplayer_make_report(struct xlplayer *self, GString *out)
+    {
+    char buf[64];
+
+    threadstat_format(&self->threadstat, &self->threadstat_reported, buf, sizeof buf);
+    g_string_append_printf(out, "%s_thread=%s\n", self->playername, buf);
+    rbstat_format(&self->rb_stats, ':', buf, sizeof buf);
+    g_string_append_printf(out, "%s_rb=%s\n", self->playername, buf);
+    }
+
+void xlplayer_make_report_all(struct xlplayer **list, GString *out)
+    {
+    while (*list)
+        xlplayer_make_report(*list++, out);
     }
 
-void xlplayer_stats_all(struct xlplayer **list)
+void xlplayer_stats_metadata_all(struct xlplayer **list)
     {
     while (*list)
-        xlplayer_stats(*list++);
+        xlplayer_stats_metadata(*list++);
+    }
+
+/* xlplayer_stats_binary_all: fill in a record for each player in the list, returning how many
+ * with hold set a signal already flagged in lp stays flagged
+ */
+int xlplayer_stats_binary_all(struct xlplayer **list, struct levels_player *lp, int hold)
+    {
+    int n, signal;
+
+    for (n = 0; list[n]; n++)
+        {
+        signal = lp[n].signal;
+        xlplayer_stats_binary(list[n], lp + n);
+        if (hold)
+            lp[n].signal |= signal;
+        }
+    return n;
     }
@@ -24,10 +24,12 @@
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <stdlib.h>
 #include <samplerate.h>
 #include <sndfile.h>
 #include <signal.h>
+#include <glib.h>
 
 #ifdef HAVE_FLAC
 #include <FLAC/all.h>
@@ -35,8 +37,18 @@
 
 #include "fade.h"
 #include "smoothing.h"
+#include "levels.h"
+#include "threadstat.h"
+#include "rbstat.h"
+#include "resampler.h"
 
-enum command_t {CMD_COMPLETE, CMD_PLAY, CMD_EJECT, CMD_CLEANUP, CMD_THREADEXIT, CMD_PLAYMANY};
+/* the most speed changes that can be waiting in the ringbuffer at once */
+#define PBS_MARKERS 32
+
+/* the default peak level below which audio counts towards the trailing silence, about -50dBFS */
+#define XLP_SILENCE_THRESHOLD 0.003f
+
+enum command_t {CMD_COMPLETE, CMD_PLAY, CMD_EJECT, CMD_CLEANUP, CMD_THREADEXIT, CMD_PLAYMANY, CMD_EJECTPLAY};
 
 enum playmode_t {PM_STOPPED, PM_INITIATE, PM_PLAYING, PM_FLUSH, PM_EJECTING };
 
@@ -53,14 +65,16 @@ struct xlp_dynamic_metadata     /* song titles can change mid-file */
     enum metadata_t data_type;
     };
 
+struct xlplayer_pool;
+struct pcmcache_entry;
+struct peaks;
+
 struct xlplayer
     {
     struct fade *fadein;                /* fade level computation */
     struct fade *fadeout;
-    jack_ringbuffer_t *left_ch;         /* main playback buffer */
-    jack_ringbuffer_t *right_ch;
-    jack_ringbuffer_t *left_fade;       /* buffers used for fade - swapped with above when needed */
-    jack_ringbuffer_t *right_fade;
+    jack_ringbuffer_t *main_rb;         /* main playback buffer of interleaved stereo frames */
+    jack_ringbuffer_t *fade_rb;         /* buffer used for fade - swapped with above when needed */
     size_t rbsize;                      /* the size of the jack ringbuffers in bytes */
     int rbdelay;                        /* rough time lag of the ringbuffers in ms */
     size_t op_buffersize;               /* the current size of the player output buffers */
@@ -75,6 +89,8 @@ struct xlplayer
     int playlistsize;                   /* the number of tracks in the playlist */
     jack_default_audio_sample_t *leftbuffer;     /* the output buffers */
     jack_default_audio_sample_t *rightbuffer;
+    jack_default_audio_sample_t *gainbuffer;     /* per sample gain for the output buffers */
+    size_t op_buffercap;                /* allocated size of the above in samples */
     int fade_mode;                      /* deferred fade mode */
     int fadeout_f;                      /* flag indicated if fade is applied upon stopping */
     int jack_flush;                     /* tells the jack callback to flush the ringbuffers */
@@ -92,29 +108,57 @@ struct xlplayer
     int current_audio_context;          /* bumps when started, bumps when stopped. Odd=playing */
     int initial_audio_context;          /* return code placeholder variable for above */
     int dither;                         /* whether to add dither to player output FLAC, MP4, WAV only */
-    unsigned int seed;                  /* used for dither */
+    uint32_t dither_state[4];           /* dither generator state */
     pthread_t thread;                   /* thread pointer for the player main loop */
-    u_int32_t sleep_samples;            /* used to count off when it is appropriate to call sleep */
-    SRC_STATE *src_state;               /* used by resampler */
+    sem_t space_sem;                    /* posted by the jack callback when the ringbuffer drains */
+    volatile size_t want_space;         /* fill level in bytes the decoder is waiting for, or zero */
+    struct xlplayer_pool *pool;         /* the workers that decode for this player or NULL for a thread of its own */
+    int pool_queued;                    /* on the pool's ready queue or having a turn */
+    int pool_parked;                    /* waiting on the jack callback to drain the ringbuffer to pool_mark */
+    size_t pool_mark;
+    int pool_exited;
+    sem_t data_sem;                     /* posted by the decoder for a freewheeling jack callback */
+    volatile size_t want_data;          /* frames the freewheeling jack callback is waiting for, or zero */
+    size_t rb_high_mark;                /* decoding pauses when the ringbuffer fill exceeds this */
+    size_t rb_low_mark;                 /* and resumes once it has drained down to this */
+    struct resampler *src_state;        /* the decoder's sample rate converter */
     SRC_DATA src_data;
     int rsqual;                         /* resample quality */   
+    enum resampler_kind resampler;      /* which converter the decoders use */
     int noflush;                        /* suppresses ringbuffer flushes for gapless playback */
     int *jack_shutdown_f;               /* inidcator that jack has shut down */
     volatile sig_atomic_t watchdog_timer;
     int up;                             /* set to true when the player is fully initialised */
-    double pbspeed;                     /* the playback speed as a factor */
-    float newpbspeed;                   /* the value the above is updated with */
+    struct threadstat threadstat;       /* of the player thread */
+    struct threadstat_report threadstat_reported;
+    struct rbstat rb_stats;             /* main_rb fill as seen by the jack callback during playback */
+    float newpbspeed;                   /* the playback speed as a resample factor, set by the user interface */
+    /* playback speed is applied by the decoder thread as the ringbuffer is written
+     * the jack callback corrects for the difference while the buffered audio catches up
+     */
     SRC_STATE *pbspeed_conv_l;          /* libsamplerate handle for playback speed control - left channel */
     SRC_STATE *pbspeed_conv_r;
-    SRC_STATE *pbspeed_conv_lf;         /* as above but for fade buffer */
-    SRC_STATE *pbspeed_conv_rf;
-    float *pbsrb_l;                     /* input buffers for the playback speed converter */
-    float *pbsrb_r;
-    float *pbsrb_lf;
-    float *pbsrb_rf;
-    long pbs_norm_read_qty;             /* the number of normal samples which will be read from left and right channels */
-    long pbs_fade_read_qty;             /* the number of fadeout samples which will be read */
-    int pbs_exchange;                   /* keeps correct association for input buffers after a buffer swap occurs */
+    float *pbs_out_l;                   /* converter output before it goes back in leftbuffer */
+    float *pbs_out_r;
+    size_t pbs_out_cap;
+    int pbs_converted;                  /* the output buffer contents have already been converted */
+    size_t pbs_source_frames;           /* how many frames they were before conversion */
+    float pbs_decode_ratio;             /* the speed of the audio last written, zero to force a marker */
+    u_int64_t pbs_frames_in;            /* frames written to main_rb since it was last emptied */
+    struct pbs_marker                   /* where in main_rb the speed of the audio changes */
+        {
+        u_int64_t frame;
+        float ratio;
+        } pbs_markers[PBS_MARKERS];
+    unsigned pbs_marker_w;              /* written by the decoder thread */
+    unsigned pbs_marker_r;              /* read by the jack callback */
+    u_int64_t pbs_frames_out;           /* frames read from main_rb since it was last emptied */
+    float pbs_read_ratio;               /* the speed the audio at the read position was written at */
+    float *pbs_hist_l;                  /* frames held back by the correction stage */
+    float *pbs_hist_r;
+    size_t pbs_hist_cap;
+    size_t pbs_have;                    /* valid frames in the above */
+    double pbs_phase;                   /* interpolation position relative to the first of them */
     void *dec_data;                     /* points to audio decoder data */
     void (*dec_init)(struct xlplayer *);/* audio decoder init function */
     void (*dec_play)(struct xlplayer *);/* function that decodes one frame of audio data */
@@ -122,6 +166,9 @@ struct xlplayer
     struct xlp_dynamic_metadata dynamic_metadata;
     int usedelay;                       /* client to delay dynamic metadata display */
     float silence;                      /* the number of seconds of silence */
+    float silence_threshold;            /* peak level below which the audio counts as silence */
+    struct levels_player stats_sent;    /* the stats as last reported, for delta encoding */
+    int stats_sent_valid;
     int samples_cutoff;                 /* audio cutoff imminent when fewer than this value samples remain */
     
     int use_sv;                         /* speed variance version of read function will be used */
@@ -130,6 +177,7 @@ struct xlplayer
     float *rcb;                         /* right channel buffer */
     float *lcfb;                        /* left channel fade buffer */
     float *rcfb;                        /* right channel fade buffer */
+    jack_nframes_t buf_frames_cap;      /* the longest period the above are allocated for */
     
     float *lcp, *rcp, *lcfp, *rcfp;     /* pointers into the above buffers */
     
@@ -142,11 +190,37 @@ struct xlplayer
 
     float cf_l_gain, cf_r_gain;         /* per channel gain adjustment -- e.g. for apply crossfade */
     int cf_aud;                         /* apply crossfade on dj audio */
+    int effect_bank;                    /* for effects players the bank mixed into */
+    int effect_listed;                  /* on the mixer's list of effects players that may sound */
+    float lg_aud, rg_aud;               /* volume, mute and crossfade gains combined */
+    float lg_str, rg_str;
+    float lg_aud_from, rg_aud_from;     /* the gains xlplayer_levels_block ended its last block on */
+    float lg_str_from, rg_str_from;
     float ls_aud, ls_str;               /* the gain adjusted audio samples */
     float rs_aud, rs_str;
-    uint32_t id;                        /* player identity e.g. player 3 = 1 << 3 */
+    uint64_t id;                        /* player identity e.g. player 3 = 1 << 3 */
     pthread_mutex_t command_mutex;      /* lock for command varaible change */
     pthread_cond_t command_cv;          /* used to wake up idle worker thread */
+    pthread_cond_t command_done_cv;     /* signalled when command returns to CMD_COMPLETE */
+    struct xlplayer_pending
+        {
+        char *pathname;                 /* player owned copy of the pathname */
+        int seek_s;
+        int size;
+        float gain;
+        } pending;                      /* track parameters for CMD_EJECTPLAY */
+    char *async_pathname;               /* pathname storage of the last asynchronous play */
+    struct xlplayer *preloader;         /* starts decoding a cued track or the next playlist entry ahead of time */
+    struct xlplayer *preload_spare;     /* a preloader done with and kept for reuse */
+    struct xlplayer *relay_source;      /* the preloader whose audio is being relayed */
+    int headless;                       /* not read by the jack callback - true of a preloader */
+    char *preload_pathname;             /* the track the preloader holds */
+    int preload_seek_s;
+    float preload_gain;
+    int preload_fade_mode;
+    int use_pcmcache;                   /* keep the decoded audio of short tracks in memory -- the effects */
+    struct pcmcache_entry *pcm_capture; /* the decoded audio of the current track so far */
+    struct peaks *peaks_capture;        /* its waveform overview so far */
     };
 
 /* xlplayer_create: create an instance of the player */
@@ -154,11 +228,30 @@ struct xlplayer *xlplayer_create(int samplerate, double duration, char *playerna
 /* xlplayer_destroy: the opposite of xlplayer_create */
 void xlplayer_destroy(struct xlplayer *);
 
+/* xlplayer_pool_create: n_workers threads to decode for as many as max_players players
+ * rather than every player having a thread of its own */
+struct xlplayer_pool *xlplayer_pool_create(const char *name, int n_workers, int max_players);
+/* xlplayer_pool_destroy: after its players have been destroyed */
+void xlplayer_pool_destroy(struct xlplayer_pool *pool);
+/* xlplayer_create_pooled: as xlplayer_create but the player is decoded for by the pool */
+struct xlplayer *xlplayer_create_pooled(struct xlplayer_pool *pool, int samplerate, double duration, char *playername, sig_atomic_t *shutdown_f, int *vol_c, float vol_scale, int *strmute_c, int *audmute_c, float cutoff_s);
+
 /* xlplayer_play: starts the player on a particular track immediately
 * if a track is currently playing eject is called
 * return value: a context-id for this track */
 int xlplayer_play(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db, int id);
 
+/* xlplayer_play_async: as xlplayer_play but returns without waiting for the
+* eject or the start of playback, only commands to this player are serialised
+* return value: the context-id the track will have if it can be played */
+int xlplayer_play_async(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db, int id);
+
+/* xlplayer_preload: starts decoding a track in the background so that a
+* subsequent play of the same track with the same seek and gain, which
+* includes xlplayer_play_noflush, only has to relay the decoded audio
+* playlists do this for their next entry by themselves */
+void xlplayer_preload(struct xlplayer *self, char *pathname, int seek_s, int size, float gain_db);
+
 /* xlplayer_playmany: starts the player on a playlist
 * if a track is currently playing eject is called, also can set looping with this function
 * return value: a context-id for this playlist */
@@ -182,6 +275,9 @@ void xlplayer_dither(struct xlplayer *self, int dither_f);
 /* to suppress fadeout call pause beforehand */
 void xlplayer_eject(struct xlplayer *self);
 
+/* xlplayer_command_cancel: abandons the current command releasing any waiters */
+void xlplayer_command_cancel(struct xlplayer *self);
+
 /* read_from_player: reads out the audio data from the buffers */
 /* this is meant to be run inside the jack callback */
 size_t read_from_player(struct xlplayer *self, jack_default_audio_sample_t *left_buf, jack_default_audio_sample_t *right_buf, jack_default_audio_sample_t *left_fbuf, jack_default_audio_sample_t *right_fbuf, jack_nframes_t nframes);
@@ -193,9 +289,18 @@ size_t read_from_player_sv(struct xlplayer *self, jack_default_audio_sample_t *l
 /* calculate the gain for fading in - used when seeking to prevent clicks */
 jack_default_audio_sample_t xlplayer_get_next_gain(struct xlplayer *self);
 
+/* the gain of the next n samples multiplied by scale as one block */
+void xlplayer_get_gain_block(struct xlplayer *self, jack_default_audio_sample_t *gain, int n, float scale);
+
 /* put audio data in format recognised by jack and libsamplerate */
 float *xlplayer_make_audio_to_float(struct xlplayer *self, float *buffer, uint8_t *data, int num_samples, int bits_per_sample, int num_channels);
 
+/* adds triangular dither of up to half of lsb in either direction */
+void xlplayer_add_dither(struct xlplayer *self, float *buffer, int num_samples, float lsb);
+
+/* makes sure the output buffers will hold num_samples */
+void xlplayer_reserve_output(struct xlplayer *self, int num_samples);
+
 /* splits audio data into separate audio streams, ready for writing */
 void xlplayer_demux_channel_data(struct xlplayer *self, jack_default_audio_sample_t *buffer, int num_samples, int num_channels, float scale);
 
@@ -210,6 +315,13 @@ int xlplayer_calc_rbdelay(struct xlplayer *xlplayer);
 
 /* this sets the speed of fading for a particular mode */
 void xlplayer_set_fadesteps(struct xlplayer *self, int fade_step);
+void xlplayer_set_silence_threshold(struct xlplayer *self, float db);
+
+/* allocate the readout buffers for periods of up to nframes, ahead of time */
+void xlplayer_buffer_reserve(struct xlplayer *self, jack_nframes_t nframes);
+
+/* a new period size, which only allocates beyond what was reserved */
+void xlplayer_buffer_alloc(struct xlplayer *self, jack_nframes_t nframes);
 
 /* pull player audio from the ringbuffer into the readout buffers */
 size_t xlplayer_read_start(struct xlplayer *self, jack_nframes_t nframes);
@@ -217,18 +329,41 @@ size_t xlplayer_read_start(struct xlplayer *self, jack_nframes_t nframes);
 /* compute the next sample */
 void xlplayer_read_next(struct xlplayer *self);
 
+/* compute the next n_frames samples into caller supplied buffers */
+void xlplayer_read_next_block(struct xlplayer *self, float *ls, float *rs, int n_frames);
+
+/* apply volume, mute and crossfader gains to a block of samples, scaled for both mixes */
+void xlplayer_levels_block(struct xlplayer *self, const float *ls, const float *rs, int n_frames, float scale,
+                            float *restrict ls_aud, float *restrict rs_aud, float *restrict ls_str, float *restrict rs_str);
+
 /* volume control and mute toggle smoothing single iteration */
 void xlplayer_smoothing_process(struct xlplayer *self);
-
-void xlplayer_stats(struct xlplayer *self);
+/* xlplayer_gains_update: combine the smoothed levels and crossfade gains for the levels functions */
+void xlplayer_gains_update(struct xlplayer *self);
+void xlplayer_gains_update_all(struct xlplayer **list);
+/* xlplayer_smoothing_settle: bring the smoothed levels straight to the controls */
+void xlplayer_smoothing_settle(struct xlplayer *self);
+/* xlplayer_idle: stopped with nothing left to play out, called from the jack callback */
+int xlplayer_idle(struct xlplayer *self);
+/* xlplayer_buffered: not playing or with nframes ready, offline code uses it to pace the jack callback */
+int xlplayer_buffered(struct xlplayer *self, jack_nframes_t nframes);
+
+void xlplayer_stats(struct xlplayer *self, GString *out, int delta);
 
 /* group process all players from the list */
 void xlplayer_read_start_all(struct xlplayer **list, jack_nframes_t nframes, struct xlplayer **roster);
 void xlplayer_read_next_all(struct xlplayer **list);
 void xlplayer_levels_all(struct xlplayer **list);
+void xlplayer_buffer_reserve_all(struct xlplayer **list, jack_nframes_t nframes);
 void xlplayer_buffer_alloc_all(struct xlplayer **list, jack_nframes_t nframes);
 void xlplayer_smoothing_process_all(struct xlplayer **list);
-void xlplayer_stats_all(struct xlplayer **list);
+void xlplayer_stats_all(struct xlplayer **list, GString *out, int delta);
+void xlplayer_stats_binary(struct xlplayer *self, struct levels_player *lp);
+void xlplayer_stats_metadata(struct xlplayer *self);
+void xlplayer_stats_metadata_all(struct xlplayer **list);
+int xlplayer_stats_binary_all(struct xlplayer **list, struct levels_player *lp, int hold);
+void xlplayer_make_report(struct xlplayer *self, GString *out);
+void xlplayer_make_report_all(struct xlplayer **list, GString *out);
 
 /* initialise mpg123 runtime linking (if falling back to runtime linking) and report the operational status */
 void xlplayer_mpg123_status();
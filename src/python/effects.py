@@ -559,7 +559,7 @@ class EffectsPlayers(Gtk.HBox):
         effects_hbox.set_spacing(6)
         effects = PGlobs.num_effects
         base = 0
-        max_rows = 12
+        max_rows = PGlobs.effects_bank_size
         effect_cols = (effects + max_rows - 1) // max_rows
         self.all_effects = []
         self.effect_banks = []
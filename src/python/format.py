@@ -945,14 +945,38 @@ class FormatCodecOpusPostGain(FormatDropdown):
             _("A gain adjustment for the player to apply."))
 
 
+class FormatCodecOpusPageDuration(FormatDropdown):
+    """Longest stretch of audio to collect in one Ogg page."""
+
+    def __init__(self, prev_object):
+        FormatDropdown.__init__(self, prev_object, _('Page Length'), "page_duration", (
+            dict(display_text=_('Default'), value="default", default=True, chain="FormatCodecOpusPostGain"),
+            dict(display_text=_('200 ms'), value="200", chain="FormatCodecOpusPostGain"),
+            dict(display_text=_('100 ms'), value="100", chain="FormatCodecOpusPostGain"),
+            dict(display_text=_('40 ms'), value="40", chain="FormatCodecOpusPostGain"),
+            dict(display_text=_('20 ms'), value="20", chain="FormatCodecOpusPostGain"),
+            dict(display_text=_('1 packet'), value="0", chain="FormatCodecOpusPostGain")), 1,
+            _("Audio waits here until a page is complete. Short pages cost a little bandwidth in exchange for lower latency. The default is 200 ms, or one packet per page in low latency mode."))
+
+
+class FormatCodecOpusLatency(FormatDropdown):
+    """Trade sound quality for a shorter delay."""
+
+    def __init__(self, prev_object):
+        FormatDropdown.__init__(self, prev_object, _('Latency'), "latency_mode", (
+            dict(display_text=_('Normal'), value="normal", default=True, chain="FormatCodecOpusPageDuration"),
+            dict(display_text=_('Low'), value="low", chain="FormatCodecOpusPageDuration")), 1,
+            _("Low latency reduces the encoder delay for talkback use. It works best with the smaller frame sizes and page lengths."))
+
+
 class FormatCodecOpusVariability(FormatDropdown):
     """Set VBR, CBR, etc."""
 
     def __init__(self, prev_object):
         FormatDropdown.__init__(self, prev_object, _('Variability'), "variability", (
-            dict(display_text=_('CBR *'), value="cbr", default=True, chain="FormatCodecOpusPostGain"),
-            dict(display_text=_('CVBR'), value="cvbr", chain="FormatCodecOpusPostGain"),
-            dict(display_text=_('VBR'), value="vbr", chain="FormatCodecOpusPostGain")), 0,
+            dict(display_text=_('CBR *'), value="cbr", default=True, chain="FormatCodecOpusLatency"),
+            dict(display_text=_('CVBR'), value="cvbr", chain="FormatCodecOpusLatency"),
+            dict(display_text=_('VBR'), value="vbr", chain="FormatCodecOpusLatency")), 0,
             _("Bitrate variability. Actual VBR operation may require a higher frame size."))
 
 
@@ -963,8 +987,11 @@ class FormatCodecOpusFrameSize(FormatDropdown):
         FormatDropdown.__init__(self, prev_object, _('Frame Size'), "framesize", (
             dict(display_text=_('60 ms'), value="60", chain="FormatCodecOpusVariability"),
             dict(display_text=_('40 ms'), value="40", chain="FormatCodecOpusVariability"),
-            dict(display_text=_('20 ms'), value="20", default=True, chain="FormatCodecOpusVariability")), 0,
-            _("A higher frame size may sound better on very low bitrates."))
+            dict(display_text=_('20 ms'), value="20", default=True, chain="FormatCodecOpusVariability"),
+            dict(display_text=_('10 ms'), value="10", chain="FormatCodecOpusVariability"),
+            dict(display_text=_('5 ms'), value="5", chain="FormatCodecOpusVariability"),
+            dict(display_text=_('2.5 ms'), value="2.5", chain="FormatCodecOpusVariability")), 0,
+            _("A higher frame size may sound better on very low bitrates. A lower one reduces latency."))
 
 
 class FormatCodecOpusComplexity(FormatDropdown):
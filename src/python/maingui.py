@@ -32,6 +32,8 @@ import collections
 import json
 import uuid
 import ctypes
+import struct
+import mmap
 from binascii import hexlify, unhexlify
 
 import dbus
@@ -2506,12 +2508,19 @@ class MainWindow(dbus.service.Object):
         return True
 
     def mixer_write(self, message, target="mx"):
-        """The means to communicate with and launch the backend."""
+        """The means to communicate with and launch the backend.
+
+        The message is text key=value lines or bytes made by mixer_frame.
+        """
 
         if target == True or target == False or target == None:
             raise RuntimeError("want traceback")
         try:
-            self._mixer_ctrl.write("%s\n%s" % (target, message))
+            if isinstance(message, bytes):
+                # Upper case module names tell the backend a frame follows.
+                self._mixer_ctrl.write(target.upper().encode() + b"\n" + message)
+            else:
+                self._mixer_ctrl.write(("%s\n%s" % (target, message)).encode())
             self._mixer_ctrl.flush()
         except (IOError, ValueError, AttributeError) as e:
             if message == "bootstrap":
@@ -2528,11 +2537,12 @@ class MainWindow(dbus.service.Object):
                     continue
 
                 try:
-                    self._mixer_ctrl = os.fdopen(write.value, "w")
-                    self._mixer_rply = os.fdopen(read.value, "r")
+                    self._mixer_ctrl = os.fdopen(write.value, "wb")
+                    self._mixer_rply = os.fdopen(read.value, "rb")
                 except OSError:
                     "failed to open streams to backend"
                     continue
+                self.watch_backend_events()
 
                 print("awaiting reply")
 
@@ -2567,11 +2577,147 @@ class MainWindow(dbus.service.Object):
                 print("giving up")
                 self.destroy_hard()
 
+    @staticmethod
+    def mixer_frame(pairs):
+        """Key value pairs in the backend's binary frame format.
+
+        Each record is a byte of key length, the key, a 16 bit value length
+        and the value, all preceded by a 32 bit frame length.
+        """
+
+        body = bytearray()
+        for key, value in pairs:
+            key = key.encode()
+            value = str(value).encode()
+            body += struct.pack("=B", len(key)) + key
+            body += struct.pack("=H", len(value)) + value
+        return struct.pack("=I", len(body)) + bytes(body)
+
+    _levels_header = struct.Struct("=IHHHH7i")
+    _levels_player = struct.Struct("=16s5if")
+    _levels_mic = struct.Struct("=5i")
+
+    def unpack_levels(self, data):
+        """The binary meter report as the key value pairs of the text one."""
+
+        try:
+            magic, version, n_players, n_mics, _, *header = \
+                                        self._levels_header.unpack_from(data)
+        except struct.error:
+            print("meter report is truncated")
+            return []
+        if magic != 0x4C564C53 or version != 1:
+            print("meter report has the wrong magic number or version")
+            return []
+
+        pairs = list(zip(("str_l_peak", "str_r_peak", "str_l_rms", "str_r_rms",
+                    "ports_connections_changed", "effects_playing",
+                    "freewheel_mode"), header))
+        offset = self._levels_header.size
+        for i in range(n_players):
+            name, *values = self._levels_player.unpack_from(data, offset)
+            offset += self._levels_player.size
+            name = name.rstrip(b"\0").decode()
+            pairs.extend((name + "_" + key, value) for key, value in zip(
+                        ("elapsed", "playing", "signal", "cid",
+                        "audio_runout", "silence"), values))
+        for i in range(n_mics):
+            mic_id, *levels = self._levels_mic.unpack_from(data, offset)
+            offset += self._levels_mic.size
+            pairs.append(("mic_%d_levels" % mic_id,
+                                        ",".join(str(x) for x in levels)))
+        return pairs
+
+    _meters = None
+
+    def meter_snapshot(self):
+        """A consistent copy of the meter report the mixer keeps in shared memory.
+
+        The mixer makes the sequence number odd while it updates the report
+        so a copy is only good if the number was even and is unchanged after.
+        The number is then written back so the mixer can stop holding peaks.
+        None means there is no mapping and the report must come through the pipe.
+        """
+
+        if self._meters is None:
+            try:
+                with open(os.environ["meters"], "r+b") as f:
+                    self._meters = mmap.mmap(f.fileno(), 0)
+            except (OSError, ValueError):
+                return None
+            if len(self._meters) < 12:
+                self._meters.close()
+                self._meters = None
+                return None
+
+        # An update takes microseconds so a few short waits are plenty.
+        for attempt in range(5):
+            seq, size = struct.unpack_from("=II", self._meters)
+            if not seq & 1:
+                data = self._meters[12:12 + size]
+                if struct.unpack_from("=I", self._meters)[0] == seq:
+                    struct.pack_into("=I", self._meters, 8, seq)
+                    # Nothing has been published until the first update completes.
+                    return data if seq else b""
+            time.sleep(0.0001 * (1 << attempt))
+        return b""
+
+    def watch_backend_events(self):
+        """Listen for the backend telling of things without being asked.
+
+        Each line names an event. The backend connects when it gets round
+        to it and drops events while nobody is listening, so this is only
+        a prompt to poll sooner than the timers would.
+        """
+
+        if self._backend_events is not None:
+            fd, watch = self._backend_events
+            source_remove(watch)
+            os.close(fd)
+            self._backend_events = None
+        try:
+            fd = os.open(os.environ["be2ui_events"],
+                                                os.O_RDONLY | os.O_NONBLOCK)
+        except OSError as e:
+            print("backend events unavailable:", e)
+            return
+        watch = GLib.io_add_watch(fd, GLib.PRIORITY_DEFAULT,
+                    GLib.IOCondition.IN | GLib.IOCondition.HUP,
+                    self._on_backend_event)
+        self._backend_events = (fd, watch)
+
+    def _on_backend_event(self, fd, condition):
+        try:
+            data = os.read(fd, 4096)
+        except BlockingIOError:
+            return True
+        except OSError:
+            data = b""
+        if not data:
+            # The backend went away. A new one gets a new watch.
+            os.close(fd)
+            self._backend_events = None
+            return False
+
+        events = data.decode("ascii", "replace").split()
+        if "session" in events:
+            self.vu_update()
+        if "status" in events:
+            self.server_window.monitor()
+        return True
+
+    def mixer_read_bytes(self, size):
+        try:
+            return self._mixer_rply.read(size)
+        except IOError as e:
+            print(str(e))
+            return b""
+
     def mixer_read(self, iters = 0):
         if iters == 5:
             self.destroy_hard()
         try:
-            line = self._mixer_rply.readline()
+            line = self._mixer_rply.readline().decode("utf-8", "replace")
         except IOError as e:
             print(str(e))
             line = self.mixer_read(iters + 1)
@@ -2595,63 +2741,76 @@ class MainWindow(dbus.service.Object):
         if vu_update_counter[0] % 20 == 0:
             self.heartbeat()
 
+        meters = self.meter_snapshot()
         try:
-            self.mixer_write("ACTN=requestlevels\nend\n")
+            self.mixer_write(self.mixer_frame((("ACTN", "requestlevels"),
+                        ("FRMT", "binary" if meters is None else "shm"))))
         except (ValueError, IOError):
             return True
 
+        # The shared memory report goes first so the reply's values prevail.
+        shm_pairs = self.unpack_levels(meters) if meters else None
 
         while 1:
-            line = self.mixer_read().rstrip()
-            if line == "":
-                return True
+            if shm_pairs is not None:
+                pairs, shm_pairs = shm_pairs, None
+            else:
+                line = self.mixer_read().rstrip()
+                if line == "":
+                    return True
 
-            if line == "end":
-                break
+                if line == "end":
+                    break
 
-            if not line.count("="):
-                print(line)
-                continue
+                if not line.count("="):
+                    print(line)
+                    continue
 
-            key, value = line.split("=", 1)
+                key, value = line.split("=", 1)
+                if key == "frame":
+                    pairs = self.unpack_levels(
+                                        self.mixer_read_bytes(int(value)))
+                else:
+                    pairs = ((key, value),)
 
-            if key == "midi":
-                midis= value
-                continue
+            for key, value in pairs:
+                if key == "midi":
+                    midis= value
+                    continue
 
-            if key.startswith("session_"):
-                session_ns[key[8:]] = value
-                continue
+                if key.startswith("session_"):
+                    session_ns[key[8:]] = value
+                    continue
 
-            if key == "ports_connections_changed":
-                cons_changed = value != "0"
+                if key == "ports_connections_changed":
+                    cons_changed = str(value) != "0"
 
-            if key.endswith("_silence"):
-                try:
-                    value = float(value)
-                except ValueError:
-                    pass
-            else:
-                try:
-                    value = int(value)
-                except ValueError:
-                    pass
+                if key.endswith("_silence"):
+                    try:
+                        value = float(value)
+                    except ValueError:
+                        pass
+                else:
+                    try:
+                        value = int(value)
+                    except ValueError:
+                        pass
 
-            if key.endswith("_new_metadata"):
-                if not key.startswith("jingles"):
-                    if key.startswith("interlude"):
-                        target = self.background.player
-                    else:
-                        target = getattr(self, "player_" +
-                                                    key.split("_", 1)[0])
-                    player_metadata.append((target, value))
-                continue
+                if key.endswith("_new_metadata"):
+                    if not key.startswith("jingles"):
+                        if key.startswith("interlude"):
+                            target = self.background.player
+                        else:
+                            target = getattr(self, "player_" +
+                                                        key.split("_", 1)[0])
+                        player_metadata.append((target, value))
+                    continue
 
-            try:
-                self.vumap[key].set_value(value)
-            except KeyError:
-                pass
-                # print("key value", key, "missing from vumap")
+                try:
+                    self.vumap[key].set_value(value)
+                except KeyError:
+                    pass
+                    # print("key value", key, "missing from vumap")
 
         if self.jingles.playing == True and int(self.jingles_playing) == 0:
             self.jingles.clear_indicators()
@@ -2861,12 +3020,16 @@ class MainWindow(dbus.service.Object):
         os.environ["num_encoders"] = str(PGlobs.num_encoders)
         os.environ["num_recorders"] = str(PGlobs.num_recorders)
         os.environ["num_effects"] = str(PGlobs.num_effects)
+        os.environ["effects_bank_size"] = str(PGlobs.effects_bank_size)
         os.environ["has_head"] = "1"
         os.environ["libmp3lame_filename"] = FGlobs.libmp3lame_filename
         os.environ["libmpg123_filename"] = FGlobs.libmpg123_filename
         # For IPC.
         os.environ["ui2be"] = pm.basedir / "ui2be"
         os.environ["be2ui"] = pm.basedir / "be2ui"
+        os.environ["meters"] = pm.basedir / "meters"
+        os.environ["be2ui_events"] = pm.basedir / "be2ui_events"
+        self._backend_events = None
 
         print("jack client ID:", client_id)
 
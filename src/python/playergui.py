@@ -1089,7 +1089,26 @@ class IDJC_Media_Player(dbus.service.Object):
 
 
         # Trying for metadata from native tagging formats.
-        if (filext == ".wav" or filext == ".aiff" or filext == ".au"):
+        probed = self._probed.pop(filename, False)
+        if probed is None:
+            return NOTVALID._replace(filename=filename)
+        elif probed:
+            # Same as the per file requests below but read in a batch.
+            is_ogg = filext in (".ogg", ".oga", ".spx")
+            length = float(probed["LENGTH"])
+            if is_ogg or (probed["ARTIST"] and probed["TITLE"]):
+                artist = probed["ARTIST"].strip()
+                title = probed["TITLE"].strip()
+            if is_ogg or probed["ALBUM"]:
+                album = probed["ALBUM"].strip()
+            if is_ogg or (rg == RGDEF and probed["REPLAYGAIN_TRACK_GAIN"]):
+                rg = gain(gain=probed["REPLAYGAIN_TRACK_GAIN"].rstrip(),
+                    ref=probed["REPLAYGAIN_REFERENCE_LOUDNESS"].rstrip())
+            # Untagged files get the gain from the backend's own measurement,
+            # which is made against the ReplayGain reference of -18 LUFS.
+            if rg == RGDEF and "LOUDNESS_GAIN" in probed:
+                rg = gain(gain=probed["LOUDNESS_GAIN"], ref="-18")
+        elif (filext == ".wav" or filext == ".aiff" or filext == ".au"):
             self.parent.mixer_write("SNDP=%s\nACTN=sndfileinforequest\nend\n" %
                                                                     filename)
             while 1:
@@ -2805,7 +2824,59 @@ class IDJC_Media_Player(dbus.service.Object):
 
         return self.get_elements_from_chosen(pathnames)
 
+    # Formats whose metadata the backend can read many files at a time.
+    probed_extensions = (".wav", ".aiff", ".au", ".ogg", ".oga", ".spx",
+                                                                ".mp3", ".mp2")
+    if FGlobs.avenabled:
+        probed_extensions += (".avi", ".wma", ".ape", ".mpc", ".aac", ".mp4",
+                                            ".m4a", ".m4b", ".m4p", ".flac")
+
+    def probe_media(self, pathnames):
+        """Have the backend read the metadata of many files in one request.
+
+        The backend works through them on several threads and caches the
+        results, which are kept here for get_media_metadata to pick up.
+        """
+
+        # Results left over from an abandoned batch could now be stale.
+        self._probed.clear()
+        wanted = [x for x in pathnames if "\n" not in x and
+                            supported.check_media(x) in self.probed_extensions]
+        if len(wanted) < 2:
+            return
+
+        self.parent.mixer_write(self.parent.mixer_frame(
+                    [("+PRBL", x) for x in wanted] + [("ACTN", "probemany")]))
+        item = None
+        fields = {}
+        while 1:
+            line = self.parent.mixer_read()
+            if line == "" or line == "PRB:end\n":
+                break
+            key, _, value = line[4:].rstrip("\n").partition("=")
+            if key == "ITEM":
+                item = wanted[int(value)]
+                fields = {}
+            elif key == "DONE":
+                self._probed[item] = fields
+            elif key == "NOT VALID":
+                self._probed[item] = None
+            else:
+                fields[key] = value
+
+        # Have files with no gain of any kind measured in the background
+        # so they have one the next time they are added.
+        unmeasured = [x for x in wanted if self._probed.get(x) and
+                    not self._probed[x]["REPLAYGAIN_TRACK_GAIN"].strip() and
+                    "LOUDNESS_GAIN" not in self._probed[x]]
+        if unmeasured:
+            self.parent.mixer_write(self.parent.mixer_frame(
+                [("+PRBL", x) for x in unmeasured] + [("ACTN", "loudnessscan")]))
+            self.parent.mixer_read()
+
     def get_elements_from_chosen(self, chosenfiles):
+        chosenfiles = list(chosenfiles)
+        self.probe_media(chosenfiles)
         for each in chosenfiles:
             meta = self.get_media_metadata(each)
             if meta:
@@ -2847,6 +2918,7 @@ class IDJC_Media_Player(dbus.service.Object):
         print(chosendir)
         files = os.listdir(chosendir)
         files.sort()
+        self.probe_media(["/".join((chosendir, x)) for x in files])
         for filename in files:
             pathname = "/".join((chosendir, filename))
             if os.path.isdir(pathname):
@@ -3920,6 +3992,7 @@ class IDJC_Media_Player(dbus.service.Object):
 
     def __init__(self, pbox, name, parent):
         self.parent = parent
+        self._probed = {}
         if pbox == None and name == None:
             return
         self.playername = name
@@ -709,6 +709,17 @@ class mixprefs:
         self.parent.mixer_write(string_to_send)
 
 
+    def cb_tp_limiter(self, widget, data = None):
+        lookahead = self.tp_lookahead.get_value() if self.tp_limiter.get_active() else 0.0
+        self.parent.mixer_write("TPLA=%f\nACTN=truepeaklimiter\nend\n" % lookahead)
+
+
+    def cb_silence_threshold(self, widget):
+        for player in ("left", "right", "interlude"):
+            self.parent.mixer_write("SLNC=%f\nACTN=silencethreshold_%s\nend\n"
+                                            % (widget.get_value(), player))
+
+
     def cb_vol_changed(self, widget):
         self.parent.send_new_mixer_stats()
 
@@ -1272,8 +1283,25 @@ class mixprefs:
         self.recorder_filename.set_margin_top(3)
         self.recorder_filename.set_margin_end(3)
         self.recorder_filename.set_margin_bottom(3)
-        frame.add(self.recorder_filename)
+        vbox = Gtk.VBox()
+        frame.add(vbox)
+        vbox.pack_start(self.recorder_filename, False, False, 0)
         self.recorder_filename.show()
+        hbox = Gtk.HBox()
+        hbox.set_spacing(6)
+        hbox.set_margin_start(3)
+        hbox.set_margin_end(3)
+        hbox.set_margin_bottom(3)
+        label = Gtk.Label.new(_('Start a new file every N minutes'))
+        hbox.pack_start(label, False, False, 0)
+        self.recorder_segment_minutes = Gtk.SpinButton.new_with_range(0, 1440, 1)
+        set_tip(self.recorder_segment_minutes, _('Long recordings of MP3, AAC, '
+                'Ogg and WebM streams are split into files of this length '
+                'aligned to the clock with no audio lost between them. '
+                'Zero keeps the whole recording in one file.'))
+        hbox.pack_end(self.recorder_segment_minutes, False, False, 0)
+        vbox.pack_start(hbox, False, False, 0)
+        vbox.show_all()
         outervbox.pack_start(frame, False, False, 0)
         frame.show()
 
@@ -1293,6 +1321,21 @@ class mixprefs:
         vbox.pack_start(self.silence_killer, False, False, 0)
         self.silence_killer.show()
 
+        hbox = Gtk.HBox()
+        hbox.set_spacing(6)
+        label = Gtk.Label.new(_('Trailing silence threshold in dBFS'))
+        hbox.pack_start(label, False, False, 0)
+        self.silence_threshold = Gtk.SpinButton.new_with_range(-80.0, -20.0, 1.0)
+        self.silence_threshold.set_value(-50.0)
+        self.silence_threshold.connect("value-changed",
+                                                    self.cb_silence_threshold)
+        hbox.pack_end(self.silence_threshold, False, False, 0)
+        vbox.pack_start(hbox, False, False, 0)
+        hbox.show_all()
+        set_tip(self.silence_threshold, _('Audio at the end of a track that '
+                'stays below this level counts as silence. Raise it for '
+                'tracks that fade into a noisy background.'))
+
         self.bonus_killer = Gtk.CheckButton.new_with_label(
                             _('End tracks containing long passages of silence'))
         self.bonus_killer.set_active(True)
@@ -1354,6 +1397,23 @@ class mixprefs:
         set_tip(self.dither, _('This feature maybe improves the sound quality '
                             'a little when listening on a 24 bit sound card.'))
 
+        hbox = Gtk.HBox()
+        hbox.set_spacing(6)
+        self.tp_limiter = Gtk.CheckButton.new_with_label(
+                        _('True-peak limit the stream, lookahead in ms'))
+        hbox.pack_start(self.tp_limiter, False, False, 0)
+        self.tp_lookahead = Gtk.SpinButton.new_with_range(1.0, 5.0, 0.5)
+        self.tp_lookahead.set_value(2.0)
+        hbox.pack_end(self.tp_lookahead, False, False, 0)
+        self.tp_limiter.connect("toggled", self.cb_tp_limiter)
+        self.tp_lookahead.connect("value-changed", self.cb_tp_limiter)
+        vbox.pack_start(hbox, False, False, 0)
+        hbox.show_all()
+        set_tip(self.tp_limiter, _('Holds the stream below -1 dBTP, '
+                'counting the peaks that form between samples when the '
+                'audio is decoded. A longer lookahead is gentler on '
+                'transients but delays the stream a little more.'))
+
         self.enable_tooltips = Gtk.CheckButton.new_with_label(_('Enable tooltips'))
         self.enable_tooltips.connect("toggled", self.callback, "tooltips")
         vbox.pack_start(self.enable_tooltips, False, False, 0)
@@ -1667,6 +1727,7 @@ class mixprefs:
             "strmon"      : self.stream_mon,
             "bigdigibox"  : self.bigger_box_toggle,
             "dither"      : self.dither,
+            "tp_limiter"  : self.tp_limiter,
             "recallsession" : self.restore_session_option,
             "best_rs"       : self.best_quality_resample,
             "good_rs"       : self.good_quality_resample,
@@ -1708,7 +1769,10 @@ class mixprefs:
             "rg_boost"      : self.rg_boost,
             "r128_boost"    : self.r128_boost,
             "all_boost"     : self.all_boost,
-            "hist_scale"    : self.history_scale
+            "hist_scale"    : self.history_scale,
+            "rec_segment_minutes" : self.recorder_segment_minutes,
+            "tp_lookahead"  : self.tp_lookahead,
+            "silence_threshold" : self.silence_threshold
             }
 
         for each in itertools.chain(mic_controls, (opener_settings,
@@ -1157,6 +1157,57 @@ class Troubleshooting(Gtk.VBox):
         for each in (self.sbf_discard_audio, self.sbf_reconnect):
             sbfbox.pack_start(each, True, False)
 
+        adaptbox = Gtk.HBox()
+        adaptbox.set_spacing(4)
+        sbfbox.pack_start(adaptbox, True, False)
+        # TC: The stream buffer size follows the network conditions.
+        self.adaptive_buffer = Gtk.CheckButton.new_with_label(
+                                            _("Adapt the buffer size between"))
+        set_tip(self.adaptive_buffer, _("Rather than holding a fixed nine"
+            " seconds of audio, size the stream buffer to suit how well the"
+            " server has been keeping up. A healthy connection gets a short"
+            " buffer and so lower latency."))
+        adaptbox.pack_start(self.adaptive_buffer, False)
+        latbox = Gtk.HBox()
+        latbox.set_spacing(4)
+        adaptbox.pack_start(latbox, False)
+        adj = Gtk.Adjustment(value=1.0, lower=0.5, upper=60.0,
+                                    step_increment=0.5, page_increment=5.0)
+        self.latency_min = Gtk.SpinButton.new(adj, 0.5, 1)
+        latbox.pack_start(self.latency_min, False)
+        # TC: Second part of a range of values, as in "from x and y".
+        latbox.pack_start(Gtk.Label.new(_("and")), False)
+        adj = Gtk.Adjustment(value=9.0, lower=0.5, upper=60.0,
+                                    step_increment=0.5, page_increment=5.0)
+        self.latency_max = Gtk.SpinButton.new(adj, 0.5, 1)
+        latbox.pack_start(self.latency_max, False)
+        latbox.pack_start(Gtk.Label.new(_("seconds.")), False)
+        latbox.set_sensitive(False)
+        self.adaptive_buffer.connect("toggled",
+                                        self._on_adaptive_buffer, latbox)
+        self.buffer_latency = Gtk.Label()
+        self.buffer_latency.set_xalign(0.0)
+        sbfbox.pack_start(self.buffer_latency, True, False)
+        set_tip(self.buffer_latency, _("How long audio is currently spending"
+            " in the stream buffer and how long the buffer is sized to hold."))
+
+        ft = _('Under sustained congestion fall back to...')
+        frame = Gtk.Frame.new(" {} ".format(ft))
+        tierbox = Gtk.HBox()
+        tierbox.set_border_width(6)
+        tierbox.set_spacing(4)
+        frame.add(tierbox)
+        self.pack_start(frame, False)
+        # TC: Followed by a list of stream numbers.
+        tierbox.pack_start(Gtk.Label.new(_("Streams")), False)
+        self.tier_streams = Gtk.Entry()
+        tierbox.pack_start(self.tier_streams, True)
+        set_tip(self.tier_streams, _("A comma separated list of stream numbers"
+            " that encode the same audio at lower bit rates. When the stream"
+            " buffer stays full the connection switches down to the next of"
+            " these and returns once the link has recovered. Only MP3 and AAC"
+            " streams with matching sample rate and channels qualify."))
+
         self.show_all()
 
         self.objects = {"custom_user_agent": (self.custom_user_agent, "active"),
@@ -1166,6 +1217,10 @@ class Troubleshooting(Gtk.VBox):
             "reconnection_repeat": (self.reconnection_repeat, "active"),
             "reconnection_quiet": (self.reconnection_quiet, "active"),
             "sbf_reconnect": (self.sbf_reconnect, "active"),
+            "adaptive_buffer": (self.adaptive_buffer, "active"),
+            "latency_min": (self.latency_min, "value"),
+            "latency_max": (self.latency_max, "value"),
+            "tier_streams": (self.tier_streams, "text"),
         }
 
     def _on_custom_user_agent(self, widget):
@@ -1174,6 +1229,28 @@ class Troubleshooting(Gtk.VBox):
     def _on_automatic_reconnection(self, widget, reconbox):
         reconbox.set_sensitive(widget.get_active())
 
+    def _on_adaptive_buffer(self, widget, latbox):
+        latbox.set_sensitive(widget.get_active())
+
+    def show_buffer_latency(self, latency_ms, target_ms):
+        if target_ms:
+            # TC: The delay through the stream buffer and its size, in milliseconds.
+            self.buffer_latency.set_text(_("Buffer latency {0} ms of {1} ms.")
+                                            .format(latency_ms, target_ms))
+        else:
+            self.buffer_latency.set_text("")
+
+    def get_tier_sources(self):
+        """The fallback streams as comma separated encoder numbers."""
+
+        tiers = []
+        for each in self.tier_streams.get_text().replace(",", " ").split():
+            try:
+                tiers.append(str(int(each) - 1))
+            except ValueError:
+                pass
+        return ",".join(tiers)
+
 
 class StreamTab(Tab):
     def make_combo_box(self, items):
@@ -1296,6 +1373,13 @@ class StreamTab(Tab):
                     "ca_file=" + d["ca_file"],
                     "client_cert=" + d["client_cert"],
                     "make_public=" + str(bool(self.make_public.get_active())),
+                    "buffer_mode=" + ("fixed", "adaptive")[
+                        self.troubleshooting.adaptive_buffer.get_active()],
+                    "latency_min={}".format(
+                        self.troubleshooting.latency_min.get_value()),
+                    "latency_max={}".format(
+                        self.troubleshooting.latency_max.get_value()),
+                    "tier_sources=" + self.troubleshooting.get_tier_sources(),
                     "command=server_connect\n"))
             self.send(self.connection_string)
             self.is_shoutcast = d["server_type"] == 1
@@ -1826,10 +1910,12 @@ class RecordTab(Tab):
                         table = (("$$", "$"), ("$r", "{:02d}".format(self.parentobject.numeric_id + 1)))
                         filename = string_multireplace(filename, table)
                         folder = sd.file_chooser_button.get_current_folder()
+                        segment_minutes = self.parentobject.scg.parent.prefs_window.recorder_segment_minutes.get_value_as_int()
                         self.parentobject.send("record_source={}\n"
                                                "record_filename={}\n"
                                                "record_folder={}\n"
-                                               "command=recorder_start\n".format(num_id, filename, folder))
+                                               "segment_minutes={}\n"
+                                               "command=recorder_start\n".format(num_id, filename, folder, segment_minutes))
                         sd.set_sensitive(False)
                         self.parentobject.time_indicator.set_sensitive(True)
                         self.path = folder
@@ -2238,7 +2324,7 @@ class SourceClientGui(dbus.service.Object):
                     break
                 if reply.startswith("recorder{}report=".format(rectab.numeric_id)):
                     recorder_state, recorded_seconds = reply.split("=")[
-                                                                1].split(":")
+                                                            1].split(":")[:2]
                     rectab.show_indicator(("clear", "red", "amber", "clear")[
                                                         int(recorder_state)])
                     rectab.time_indicator.set_value(int(recorded_seconds))
@@ -2263,9 +2349,12 @@ class SourceClientGui(dbus.service.Object):
             if reply != "failed":
                 self.receive()
                 if reply.startswith("streamer{}report=".format(streamtab.numeric_id)):
-                    streamer_state, stream_sendbuffer_pc, brand_new = \
-                                                    reply.split("=")[1].split(":")
+                    streamer_state, stream_sendbuffer_pc, brand_new, \
+                            latency_ms, target_ms = \
+                                            reply.split("=")[1].split(":")[:5]
                     state = int(streamer_state)
+                    streamtab.troubleshooting.show_buffer_latency(
+                                            int(latency_ms), int(target_ms))
                     self._handle_streamstate(streamtab.numeric_id,
                                             int(state > 1), streamtab)
                     streamtab.show_indicator(